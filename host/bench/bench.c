@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+#include "esp_log.h"
+
+// Entry point and harness for host_bench. Prints one line per benchmark:
+//
+//   <name> <iterations> <ns/op>
+//
+// With --csv FILE the results are also appended as "rev,name,ns_per_op" so
+// they can be tracked across commits (see the bench_record target).
+
+#define BENCH_TARGET_NS 200000000ULL
+
+volatile uint32_t bench_sink;
+
+static const char *s_filter;
+static FILE *s_csv;
+static const char *s_rev = "local";
+static double s_last_ns_per_op;
+
+void bench_anomaly_suite(void);
+void bench_core_suite(void);
+void bench_cycle_suite(void);
+void bench_gzip_suite(void);
+void bench_ingest_suite(void);
+void bench_mqtt_suite(void);
+void bench_rules_suite(void);
+void bench_stream_suite(void);
+void bench_tls_suite(void);
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void bench_run(const char *name, bench_fn_t fn, void *ctx) {
+    if (s_filter && !strstr(name, s_filter)) {
+        return;
+    }
+
+    // Warm up and grow the iteration count until one run is long enough
+    uint64_t iters = 1;
+    uint64_t elapsed = 0;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        fn(iters, ctx);
+        elapsed = now_ns() - t0;
+        if (elapsed >= BENCH_TARGET_NS / 10 || iters >= (1ULL << 40)) {
+            break;
+        }
+        iters *= (elapsed < BENCH_TARGET_NS / 1000) ? 10 : 2;
+    }
+    uint64_t target_iters = elapsed > 0 ? iters * BENCH_TARGET_NS / elapsed : iters;
+    if (target_iters < 1) target_iters = 1;
+
+    uint64_t t0 = now_ns();
+    fn(target_iters, ctx);
+    elapsed = now_ns() - t0;
+
+    s_last_ns_per_op = (double)elapsed / (double)target_iters;
+    printf("%-36s %12llu %14.1f ns/op\n", name, (unsigned long long)target_iters, s_last_ns_per_op);
+    if (s_csv) {
+        fprintf(s_csv, "%s,%s,%.1f\n", s_rev, name, s_last_ns_per_op);
+    }
+}
+
+double bench_last_ns_per_op(void) {
+    return s_last_ns_per_op;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            s_filter = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            s_csv = fopen(argv[++i], "a");
+            if (!s_csv) {
+                perror("--csv");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--rev") == 0 && i + 1 < argc) {
+            s_rev = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--filter SUBSTR] [--csv FILE] [--rev REV]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    printf("%-36s %12s %14s\n", "benchmark", "iterations", "time");
+    bench_anomaly_suite();
+    bench_core_suite();
+    bench_cycle_suite();
+    bench_gzip_suite();
+    bench_ingest_suite();
+    bench_mqtt_suite();
+    bench_rules_suite();
+    bench_stream_suite();
+    bench_tls_suite();
+
+    if (s_csv) {
+        fclose(s_csv);
+    }
+    return 0;
+}
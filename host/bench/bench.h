@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// Micro-benchmark harness for the host build. A benchmark body runs `iters`
+// iterations of the operation under test; the harness picks the iteration
+// count so each measurement takes roughly BENCH_TARGET_NS.
+
+typedef void (*bench_fn_t)(uint64_t iters, void *ctx);
+
+/**
+ * @brief Time fn and report ns/op under name (skipped if the name filter does not match)
+ */
+void bench_run(const char *name, bench_fn_t fn, void *ctx);
+
+// Results of the most recent bench_run()
+double bench_last_ns_per_op(void);
+
+// Keeps the optimiser from discarding benchmark results
+extern volatile uint32_t bench_sink;
+
+#endif // BENCH_H
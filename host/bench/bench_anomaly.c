@@ -0,0 +1,59 @@
+#include <math.h>
+#include "aqua_anomaly.h"
+#include "bench.h"
+#include "pond_model.h"
+
+// Anomaly scoring: the scalar reference against the vectorised path over
+// quantised vectors from the pond model, and a whole detector sample
+// (features, scoring and attribution).
+
+#define VECTORS 64
+
+typedef struct {
+    int16_t x[VECTORS][AQUA_ANOMALY_FEATURES] AQUA_ANOMALY_ALIGNED;
+    aqua_reading_t readings[VECTORS];
+} anomaly_bench_t;
+
+static void setup(anomaly_bench_t *b) {
+    pond_model_t pond;
+    pond_model_init(&pond, 4, 0.0);
+    float avg[AQUA_MEAS_ID_COUNT];
+    for (int i = 0; i < AQUA_MEAS_ID_COUNT; i++) avg[i] = NAN;
+    for (int i = 0; i < VECTORS; i++) {
+        float features[AQUA_ANOMALY_FEATURES];
+        pond_model_next(&pond, &b->readings[i]);
+        aqua_anomaly_features(&b->readings[i], avg, features);
+        aqua_anomaly_average(&b->readings[i], avg);
+        aqua_anomaly_quantize(aqua_anomaly_model(), features, b->x[i]);
+    }
+}
+
+static void b_score_ref(uint64_t iters, void *ctx) {
+    anomaly_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_anomaly_score_ref(aqua_anomaly_model(), b->x[i % VECTORS], NULL);
+    }
+}
+
+static void b_score(uint64_t iters, void *ctx) {
+    anomaly_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_anomaly_score(aqua_anomaly_model(), b->x[i % VECTORS], NULL);
+    }
+}
+
+static void b_observe(uint64_t iters, void *ctx) {
+    anomaly_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_anomaly_observe(&b->readings[i % VECTORS])->score;
+    }
+}
+
+void bench_anomaly_suite(void) {
+    static anomaly_bench_t b;
+    setup(&b);
+    aqua_anomaly_init();
+    bench_run("anomaly/score_scalar", b_score_ref, &b);
+    bench_run("anomaly/score_vector", b_score, &b);
+    bench_run("anomaly/observe", b_observe, &b);
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_dsp.h"
+#include "aqua_log.h"
+#include "aqua_params.h"
+#include "aqua_registry.h"
+#include "bench.h"
+#include "ca_anchors.h"
+#include "ca_der.h"
+
+// Pure-logic hot paths from aqua_core.c
+
+static const aqua_reading_t reading = {
+    .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+    .do_level = AQUA_SENSOR_ERROR, .turbidity = 10.0f, .ammonia = AQUA_SENSOR_ERROR
+};
+static const aqua_controls_t controls = { .aerator = true };
+
+static void b_crc8(uint64_t iters, void *ctx) {
+    uint8_t scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        scratchpad[0] = (uint8_t)i;
+        bench_sink += aqua_crc8(scratchpad, 8);
+    }
+}
+
+static void b_average_convert(uint64_t iters, void *ctx) {
+    int samples[10] = { 2490, 2510, 2500, 2500, 2495, 2505, 2500, 2500, 2500, 2500 };
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        samples[i % 10] = 2500 + (int)(i & 7);
+        float ph = aqua_mv_to_ph(aqua_average_mv(samples, 10));
+        bench_sink += (uint32_t)ph;
+    }
+}
+
+static void b_dht22_decode(uint64_t iters, void *ctx) {
+    uint8_t frame[5] = { 0x02, 0x58, 0x01, 0x09, 0x64 };
+    float hum, temp;
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_dht22_decode(frame, &hum, &temp);
+    }
+}
+
+// Response plus 40 bits: the work done per read once the capture is in
+static void b_dht22_decode_pulses(uint64_t iters, void *ctx) {
+    static const uint8_t frame[5] = { 0x02, 0x58, 0x01, 0x09, 0x64 };
+    uint16_t pulses[83];
+    uint8_t data[5];
+    (void)ctx;
+    pulses[0] = pulses[1] = 80;
+    for (int bit = 0; bit < 40; bit++) {
+        pulses[2 + 2 * bit] = 50;
+        pulses[3 + 2 * bit] = (frame[bit / 8] >> (7 - bit % 8)) & 1 ? 70 : 27;
+    }
+    pulses[82] = 50;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_dht22_decode_pulses(pulses, 83, data);
+        bench_sink += data[4];
+    }
+}
+
+static void b_validate(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_validate_reading(&reading);
+    }
+}
+
+static void b_build_payload(uint64_t iters, void *ctx) {
+    char buf[512];
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_build_payload(&reading, &controls, buf, sizeof(buf));
+    }
+}
+
+static void b_alert_diff(uint64_t iters, void *ctx) {
+    aqua_alert_states_t last = {0}, current;
+    aqua_reading_t r = reading;
+    aqua_params_t defaults;
+    aqua_params_defaults(&defaults);
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        r.ph = (i & 1) ? 9.0f : 7.0f;
+        aqua_eval_alerts(&r, &defaults, &current);
+        bench_sink += aqua_alerts_changed(&last, &current);
+        last = current;
+    }
+}
+
+static void b_build_alert_payload(uint64_t iters, void *ctx) {
+    aqua_alert_states_t alerts = { .low = AQUA_ALERT_BIT(AQUA_MEAS_DO) };
+    char buf[384];
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_build_alert_payload(&alerts, &reading, buf, sizeof(buf));
+    }
+}
+
+// As in the cycle: take the live parameters for each decision
+static void b_decide_controls(uint64_t iters, void *ctx) {
+    aqua_controls_t c;
+    aqua_reading_t r = reading;
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        r.ph = 6.0f + (float)(i & 3);
+        const aqua_params_t *p = aqua_params_acquire();
+        aqua_decide_controls(&r, p, &c);
+        aqua_params_release(p);
+        bench_sink += c.ph_relay;
+    }
+}
+
+static void count_cmd(const char *type, bool state, void *ctx) {
+    (void)type;
+    *(int *)ctx += state;
+}
+
+static void b_parse_relay_commands(uint64_t iters, void *ctx) {
+    static const char json[] =
+        "[{\"id\":10,\"relay_type\":\"ph\",\"state\":true,\"timestamp\":\"2025-11-12T08:30:00\"},"
+        "{\"id\":9,\"relay_type\":\"aerator\",\"state\":false,\"timestamp\":\"2025-11-12T08:29:00\"},"
+        "{\"id\":8,\"relay_type\":\"filter\",\"state\":true,\"timestamp\":\"2025-11-12T08:28:00\"},"
+        "{\"id\":7,\"relay_type\":\"pump\",\"state\":false,\"timestamp\":\"2025-11-12T08:27:00\"}]";
+    int on = 0;
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_parse_relay_commands(json, count_cmd, &on);
+    }
+    bench_sink += (uint32_t)on;
+}
+
+// Text mode cost is measured up to the log backend (output discarded)
+static int discard_vprintf(const char *format, va_list args) {
+    (void)format;
+    (void)args;
+    return 0;
+}
+
+static void b_log_text(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        AQUA_LOG(CYCLE_FINAL, 26.5f, 60.0f, 7.0f, "OFF");
+    }
+}
+
+static void b_log_deferred(uint64_t iters, void *ctx) {
+    uint8_t drain[AQUA_LOG_RING_SIZE];
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        AQUA_LOG(CYCLE_FINAL, 26.5f, 60.0f, 7.0f, "OFF");
+        if ((i & 127) == 127) {
+            bench_sink += (uint32_t)aqua_log_drain(drain, sizeof(drain));
+        }
+    }
+}
+
+static void bench_log_suite(void) {
+    vprintf_like_t previous = esp_log_set_vprintf(discard_vprintf);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+    bench_run("log/emit_text", b_log_text, NULL);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    esp_log_set_vprintf(previous);
+
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    bench_run("log/emit_deferred", b_log_deferred, NULL);
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+}
+
+// Trust-anchor decoding: what every TLS client paid with a PEM chain (base64
+// decode before the X.509 parse) versus walking the shared DER bundle. The
+// X.509 parse itself happens once on the device and is not modelled here.
+typedef struct {
+    char pem[4096];
+    size_t pem_len;
+    uint8_t der[4096];
+} ca_bench_t;
+
+static void ca_bench_encode(ca_bench_t *b) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t pos = 0;
+    const uint8_t *der;
+    size_t der_len;
+    b->pem_len = 0;
+    while (ca_der_next(aqua_ca_anchors, sizeof(aqua_ca_anchors), &pos, &der, &der_len)) {
+        b->pem_len += (size_t)snprintf(b->pem + b->pem_len, sizeof(b->pem) - b->pem_len,
+                                       "-----BEGIN CERTIFICATE-----\n");
+        for (size_t i = 0; i < der_len; i += 3) {
+            uint32_t v = (uint32_t)der[i] << 16;
+            if (i + 1 < der_len) v |= (uint32_t)der[i + 1] << 8;
+            if (i + 2 < der_len) v |= der[i + 2];
+            b->pem[b->pem_len++] = alphabet[(v >> 18) & 63];
+            b->pem[b->pem_len++] = alphabet[(v >> 12) & 63];
+            b->pem[b->pem_len++] = i + 1 < der_len ? alphabet[(v >> 6) & 63] : '=';
+            b->pem[b->pem_len++] = i + 2 < der_len ? alphabet[v & 63] : '=';
+            if (i % 48 == 45 || i + 3 >= der_len) b->pem[b->pem_len++] = '\n';
+        }
+        b->pem_len += (size_t)snprintf(b->pem + b->pem_len, sizeof(b->pem) - b->pem_len,
+                                       "-----END CERTIFICATE-----\n");
+    }
+}
+
+static void b_ca_pem_decode(uint64_t iters, void *ctx) {
+    ca_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        size_t len = 0;
+        bench_sink += (uint32_t)ca_der_import_pem(b->pem, b->pem_len, b->der, sizeof(b->der), &len);
+        bench_sink += (uint32_t)len;
+    }
+}
+
+static void b_ca_der_walk(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)ca_der_count(aqua_ca_anchors, sizeof(aqua_ca_anchors));
+    }
+}
+
+static void bench_ca_suite(void) {
+    static ca_bench_t b;
+    ca_bench_encode(&b);
+    bench_run("ca/pem_decode_2_anchors", b_ca_pem_decode, &b);
+    bench_run("ca/der_walk_2_anchors", b_ca_der_walk, NULL);
+}
+
+// Decimation chain on one 4096-sample burst (2500 counts, +/-64 noise);
+// the two FIR paths run over the same CIC output
+typedef struct {
+    int16_t raw[4096] AQUA_DSP_ALIGNED;
+    int16_t cic[4096 / AQUA_DSP_CIC_DECIM] AQUA_DSP_ALIGNED;
+    int16_t work[4096 / AQUA_DSP_CIC_DECIM] AQUA_DSP_ALIGNED;
+    size_t cic_len;
+} dsp_bench_t;
+
+static void b_fir_ref(uint64_t iters, void *ctx) {
+    dsp_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_fir_decimate_ref(b->cic, b->cic_len, b->work);
+    }
+}
+
+static void b_fir_fast(uint64_t iters, void *ctx) {
+    dsp_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_fir_decimate(b->cic, b->cic_len, b->work);
+    }
+}
+
+static void b_oversample(uint64_t iters, void *ctx) {
+    dsp_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_oversample_mv(b->raw, 4096, b->work);
+    }
+}
+
+// Lock-in demodulation of the same burst, fed a block at a time as the
+// modulated read delivers it
+static void b_lockin(uint64_t iters, void *ctx) {
+    dsp_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        aqua_lockin_t l;
+        aqua_lockin_init(&l, LOCKIN_HALF_PERIOD);
+        for (int k = 0; k < 4096; k += LOCKIN_BLOCK_SAMPLES) {
+            aqua_lockin_feed(&l, b->raw + k, LOCKIN_BLOCK_SAMPLES);
+        }
+        bench_sink += (uint32_t)l.on_sum;
+    }
+}
+
+static void bench_dsp_suite(void) {
+    static dsp_bench_t b;
+    uint32_t seed = 1;
+    for (int i = 0; i < 4096; i++) {
+        seed = seed * 1103515245u + 12345u;
+        b.raw[i] = (int16_t)(2500 + (int)((seed >> 16) % 129) - 64);
+    }
+    b.cic_len = aqua_cic_decimate(b.raw, 4096, b.cic);
+    bench_run("dsp/fir_decimate_scalar", b_fir_ref, &b);
+    bench_run("dsp/fir_decimate_vector", b_fir_fast, &b);
+    bench_run("dsp/oversample_4096", b_oversample, &b);
+    bench_run("dsp/lockin_4096", b_lockin, &b);
+}
+
+void bench_core_suite(void) {
+    bench_run("core/crc8_scratchpad", b_crc8, NULL);
+    bench_run("core/average_and_convert", b_average_convert, NULL);
+    bench_run("core/dht22_decode", b_dht22_decode, NULL);
+    bench_run("core/dht22_decode_pulses", b_dht22_decode_pulses, NULL);
+    bench_run("core/validate_reading", b_validate, NULL);
+    bench_run("core/build_payload", b_build_payload, NULL);
+    bench_run("core/alert_eval_diff", b_alert_diff, NULL);
+    bench_run("core/build_alert_payload", b_build_alert_payload, NULL);
+    bench_run("core/decide_controls", b_decide_controls, NULL);
+    bench_run("core/parse_relay_commands_4", b_parse_relay_commands, NULL);
+    bench_ca_suite();
+    bench_log_suite();
+    bench_dsp_suite();
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_xadc.h"
+#include "bench.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+#include "sensors.h"
+#include "supabase.h"
+
+// Driver and cycle paths on the simulated HAL. Sensor timings are virtual,
+// so these measure the CPU cost of the firmware logic, not bus time.
+
+static void b_dht22_read(uint64_t iters, void *ctx) {
+    float hum, temp;
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += dht22_read(&hum, &temp);
+    }
+}
+
+static void b_ds18b20_read(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)read_water_temp();
+    }
+}
+
+static void b_read_analog(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        for (size_t m = 0; m < aqua_measure_count; m++) {
+            if (aqua_measures[m].adc_channel >= 0) {
+                bench_sink += (uint32_t)read_analog_sensor(&aqua_measures[m]);
+            }
+        }
+    }
+}
+
+// CPU cost of driving a 16-input scan (bus and conversion time are simulated)
+static void b_xadc_scan(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        aqua_xadc_scan_start(0xFFFF);
+        aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS);
+        for (int n = 0; n < XADC_MAX_INPUTS; n++) {
+            int mv = 0;
+            aqua_xadc_read_mv(n, &mv);
+            bench_sink += (uint32_t)mv;
+        }
+    }
+}
+
+static void b_upload(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f,
+                                       false, true, false, false);
+    }
+}
+
+static const aqua_reading_t bench_reading = {
+    .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+    .do_level = AQUA_SENSOR_ERROR, .turbidity = 10.0f, .ammonia = AQUA_SENSOR_ERROR
+};
+static const aqua_controls_t bench_controls = { .aerator = true };
+
+// Two round trips: relay_commands poll, then the row upload
+static void b_poll_and_upload(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += poll_relay_commands();
+        bench_sink += send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f,
+                                       false, true, false, false);
+    }
+}
+
+// One round trip: ingest_reading RPC
+static void b_exchange(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += exchange_with_supabase(&bench_reading, &bench_controls);
+    }
+}
+
+// A full backlog (rows queued through an outage) sent once the link is back;
+// ctx is the number of uploads in flight at once
+static void b_backlog_catchup(uint64_t iters, void *ctx) {
+    supabase_set_pipeline_depth(*(const int *)ctx);
+    for (uint64_t i = 0; i < iters; i++) {
+        hal_sim_config()->link_up = false;
+        for (int r = 0; r < AQUA_OUTQ_SLOTS; r++) {
+            send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f, false, true, false, false);
+        }
+        hal_delay_ms(OUTQ_LIVE_DEADLINE_MS);
+        hal_sim_config()->link_up = true;
+        supabase_outbound_drain(0);
+        hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+        supabase_outbound_drain(OUTQ_DRAIN_MS);
+        bench_sink += (uint32_t)aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT);
+    }
+    supabase_set_pipeline_depth(UPLOAD_PIPELINE_DEPTH);
+}
+
+static void b_full_cycle(uint64_t iters, void *ctx) {
+    aqua_cycle_state_t *state = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        aqua_cycle_run(state);
+        bench_sink += state->uploaded;
+    }
+}
+
+void bench_cycle_suite(void) {
+    standin_t *server = standin_start();
+    if (!server) {
+        fprintf(stderr, "bench_cycle: failed to start HTTP stand-in\n");
+        return;
+    }
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    aqua_gpio_init();
+
+    bench_run("sim/dht22_read", b_dht22_read, NULL);
+    bench_run("sim/ds18b20_read", b_ds18b20_read, NULL);
+    bench_run("sim/read_analog_scan", b_read_analog, NULL);
+    aqua_xadc_init();
+    bench_run("sim/xadc_scan_16", b_xadc_scan, NULL);
+    bench_run("http/upload_standin", b_upload, NULL);
+
+    aqua_cycle_state_t state = {0};
+    bench_run("http/full_cycle_standin", b_full_cycle, &state);
+
+    // Per-cycle network cost with a 5 ms round trip on every request
+    rpc_standin_t *model = rpc_standin_attach(server);
+    rpc_standin_add_command(model, "aerator", true);
+    standin_set_delay_ms(server, 5);
+    bench_run("http/poll_and_upload_rtt5ms", b_poll_and_upload, NULL);
+    bench_run("http/exchange_rtt5ms", b_exchange, NULL);
+    standin_set_delay_ms(server, 0);
+    rpc_standin_detach(model);
+
+    // Catch-up after an outage with a 50 ms round trip: one POST at a time,
+    // each on its own connection, against UPLOAD_PIPELINE_DEPTH in flight on one
+    standin_accept_gzip(server, true);
+    standin_set_latency_ms(server, 50);
+    static const int serial = 1, pipelined = UPLOAD_PIPELINE_DEPTH;
+    bench_run("http/backlog_catchup_rtt50ms_serial", b_backlog_catchup, (void *)&serial);
+    bench_run("http/backlog_catchup_rtt50ms_pipelined", b_backlog_catchup, (void *)&pipelined);
+    standin_set_latency_ms(server, 0);
+
+    standin_stop(server);
+}
@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_gzip.h"
+#include "aqua_outq.h"
+#include "bench.h"
+#include "log_ingest.h"
+#ifdef STANDIN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Upload compression over real readings: every cycle in esp32_monitor.log is
+// rebuilt into the sensor_data row the firmware would send, and the rows are
+// packed into backlog batches as supabase.c does (OUTQ_BATCH_MAX_ROWS rows,
+// OUTQ_BATCH_MAX_BYTES at most). One op compresses every batch; the ratio
+// and input throughput are printed after each run, with zlib's default level
+// as a reference when it is available.
+
+#define BENCH_MAX_BATCHES 512
+
+typedef struct {
+    char *body[BENCH_MAX_BATCHES];
+    size_t len[BENCH_MAX_BATCHES];
+    int count;
+    int rows;
+    size_t bytes;
+    size_t out_bytes;
+    bool ran;
+} batches_t;
+
+static batches_t batches;
+static char batch[OUTQ_BATCH_MAX_BYTES + 1];
+static size_t batch_len;
+static int batch_rows;
+
+static void close_batch(void) {
+    if (batch_rows == 0 || batches.count == BENCH_MAX_BATCHES) {
+        return;
+    }
+    batch[batch_len++] = ']';
+    batches.body[batches.count] = malloc(batch_len);
+    if (batches.body[batches.count]) {
+        memcpy(batches.body[batches.count], batch, batch_len);
+        batches.len[batches.count++] = batch_len;
+        batches.bytes += batch_len;
+    }
+    batch_len = 0;
+    batch_rows = 0;
+}
+
+static float value(const ingest_row_t *row, ingest_value_t v) {
+    return isnan(row->values[v]) ? AQUA_SENSOR_ERROR : row->values[v];
+}
+
+static void add_row(const ingest_row_t *row, void *ctx) {
+    aqua_reading_t r;
+    aqua_reading_clear(&r);
+    r.air_temp = value(row, INGEST_AIR_TEMP);
+    r.humidity = value(row, INGEST_HUMIDITY);
+    r.water_temp = value(row, INGEST_WATER_TEMP);
+    r.ph = value(row, INGEST_PH);
+    r.do_level = value(row, INGEST_DO);
+    r.turbidity = value(row, INGEST_TURBIDITY);
+    r.ammonia = value(row, INGEST_AMMONIA);
+    r.has_health = row->health[0] >= 0;
+    for (int i = 0; i < INGEST_HEALTH_COUNT && i < AQUA_SENSOR_COUNT; i++) {
+        r.health[i] = row->health[i] < 0 ? 0 : (uint8_t)row->health[i];
+    }
+    r.has_time = row->uptime_ms >= 0;
+    r.sampled_us = row->uptime_ms * 1000;
+
+    aqua_controls_t c = {
+        .ph_relay = row->relays[INGEST_RELAY_PH] == 1,
+        .aerator = row->relays[INGEST_RELAY_AERATOR] == 1,
+        .filter = row->relays[INGEST_RELAY_FILTER] == 1,
+        .pump = row->relays[INGEST_RELAY_PUMP] == 1
+    };
+    char payload[AQUA_OUTQ_BODY_MAX + 1];
+    int n = aqua_build_payload(&r, &c, payload, sizeof(payload));
+    if (n <= 0) {
+        return;
+    }
+    if (batch_rows == OUTQ_BATCH_MAX_ROWS || batch_len + (size_t)n + 2 > OUTQ_BATCH_MAX_BYTES) {
+        close_batch();
+    }
+    batch[batch_len++] = batch_rows == 0 ? '[' : ',';
+    memcpy(batch + batch_len, payload, (size_t)n);
+    batch_len += (size_t)n;
+    batch_rows++;
+    batches.rows++;
+}
+
+static bool load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    static ingest_source_t src;
+    ingest_sink_t sink = { .row = add_row };
+    ingest_source_init(&src, "bench", &sink);
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        ingest_feed(&src, buf, n);
+    }
+    ingest_finish(&src);
+    fclose(f);
+    close_batch();
+    return batches.count > 0;
+}
+
+static bool count_bytes(void *ctx, const void *data, size_t len) {
+    *(size_t *)ctx += len;
+    bench_sink += ((const uint8_t *)data)[0];
+    return true;
+}
+
+static void b_aqua_gzip(uint64_t iters, void *ctx) {
+    static aqua_gzip_t z;
+    batches.ran = true;
+    for (uint64_t i = 0; i < iters; i++) {
+        size_t out = 0;
+        for (int b = 0; b < batches.count; b++) {
+            aqua_gzip_init(&z, count_bytes, &out);
+            aqua_gzip_feed(&z, batches.body[b], batches.len[b]);
+            aqua_gzip_finish(&z);
+        }
+        batches.out_bytes = out;
+    }
+}
+
+#ifdef STANDIN_HAVE_ZLIB
+static void b_zlib(uint64_t iters, void *ctx) {
+    static uint8_t out[OUTQ_BATCH_MAX_BYTES * 2];
+    batches.ran = true;
+    for (uint64_t i = 0; i < iters; i++) {
+        size_t total = 0;
+        for (int b = 0; b < batches.count; b++) {
+            z_stream zs = {0};
+            deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+            zs.next_in = (Bytef *)batches.body[b];
+            zs.avail_in = (uInt)batches.len[b];
+            zs.next_out = out;
+            zs.avail_out = sizeof(out);
+            deflate(&zs, Z_FINISH);
+            total += zs.total_out;
+            deflateEnd(&zs);
+        }
+        batches.out_bytes = total;
+    }
+}
+#endif
+
+static void run(const char *name, bench_fn_t fn) {
+    batches.ran = false;
+    bench_run(name, fn, NULL);
+    double ns = bench_last_ns_per_op();
+    if (batches.ran && ns > 0) {
+        printf("%-36s %12zu %14.2f ratio\n", "", batches.out_bytes,
+               (double)batches.bytes / (double)batches.out_bytes);
+        printf("%-36s %12zu %14.1f MB/s\n", "", batches.bytes, batches.bytes * 1e3 / ns);
+    }
+}
+
+void bench_gzip_suite(void) {
+    if (!load(AQUA_REPO_DIR "/esp32_monitor.log")) {
+        return;
+    }
+    run("gzip/backlog_batches", b_aqua_gzip);
+#ifdef STANDIN_HAVE_ZLIB
+    run("gzip/backlog_batches_zlib6", b_zlib);
+#endif
+    for (int b = 0; b < batches.count; b++) {
+        free(batches.body[b]);
+    }
+    memset(&batches, 0, sizeof(batches));
+}
@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "log_ingest.h"
+
+// Log ingest over the bundled serial captures, one op = one whole capture,
+// fed in 64 KiB chunks as aqua_ingest reads it. Lines/s is printed after
+// each run; captures missing from the checkout are skipped.
+
+#define BENCH_CHUNK 65536
+
+typedef struct {
+    char *data;
+    size_t len;
+    uint64_t lines;
+    bool ran;                           // False when the name filter skipped it
+} capture_t;
+
+static bool load(capture_t *c, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    c->data = malloc((size_t)size);
+    c->len = c->data ? fread(c->data, 1, (size_t)size, f) : 0;
+    fclose(f);
+    c->lines = 0;
+    c->ran = false;
+    for (size_t i = 0; i < c->len; i++) {
+        c->lines += c->data[i] == '\n';
+    }
+    return c->len > 0;
+}
+
+static void count_row(const ingest_row_t *row, void *ctx) {
+    bench_sink += (uint32_t)row->cycle;
+}
+
+static void count_alert(const char *source, int boot, int64_t uptime_ms, ingest_alert_t alert,
+                        const char *line, void *ctx) {
+    bench_sink += (uint32_t)alert;
+}
+
+static void b_ingest(uint64_t iters, void *ctx) {
+    capture_t *c = ctx;
+    c->ran = true;
+    static ingest_source_t src;
+    ingest_sink_t sink = { .row = count_row, .alert = count_alert };
+    for (uint64_t i = 0; i < iters; i++) {
+        ingest_source_init(&src, "bench", &sink);
+        for (size_t pos = 0; pos < c->len; pos += BENCH_CHUNK) {
+            size_t n = c->len - pos < BENCH_CHUNK ? c->len - pos : BENCH_CHUNK;
+            ingest_feed(&src, c->data + pos, n);
+        }
+        ingest_finish(&src);
+    }
+}
+
+static void run_capture(const char *name, const char *file) {
+    capture_t c;
+    if (!load(&c, file)) {
+        return;
+    }
+    bench_run(name, b_ingest, &c);
+    double ns = bench_last_ns_per_op();
+    if (c.ran && ns > 0) {
+        printf("%-36s %12llu %14.0f lines/s\n", "", (unsigned long long)c.lines, c.lines * 1e9 / ns);
+    }
+    free(c.data);
+}
+
+void bench_ingest_suite(void) {
+    run_capture("ingest/esp32_monitor_log", AQUA_REPO_DIR "/esp32_monitor.log");
+    run_capture("ingest/screenlog", AQUA_REPO_DIR "/screenlog.0");
+}
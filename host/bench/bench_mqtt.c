@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_mqtt.h"
+#include "bench.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "mqtt_standin.h"
+#include "supabase.h"
+
+// Telemetry upload over MQTT versus the REST path, with the same injected
+// round trip on both stand-ins so the numbers compare per-reading latency
+// (QoS 1 waiting for each PUBACK) with windowed throughput.
+//
+// Set AQUA_BENCH_MQTT=host:port to repeat the MQTT runs against a real
+// broker (e.g. a local Mosquitto) without injected latency.
+
+#define BENCH_RTT_MS 5
+
+typedef struct {
+    aqua_mqtt_client_t client;
+    char payload[512];
+    size_t payload_len;
+} mqtt_bench_t;
+
+static bool bench_connect(mqtt_bench_t *b, const char *host, int port, int window) {
+    aqua_mqtt_config_t cfg = {
+        .host = host,
+        .port = port,
+        .tls = HAL_TLS_NONE,
+        .client_id = "bench-" AQUA_DEVICE_ID,
+        .keepalive_s = 0,
+        .inflight_window = window,
+        .ack_timeout_ms = 0,
+    };
+    aqua_mqtt_init(&b->client, &cfg);
+    return aqua_mqtt_connect(&b->client, 2000) == ESP_OK;
+}
+
+static void b_qos1_sync(uint64_t iters, void *ctx) {
+    mqtt_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_mqtt_publish(&b->client, "aqua/" AQUA_DEVICE_ID "/telemetry",
+                                        b->payload, b->payload_len, 1, 5000);
+        bench_sink += aqua_mqtt_flush(&b->client, 5000);
+    }
+}
+
+static void b_qos1_window(uint64_t iters, void *ctx) {
+    mqtt_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_mqtt_publish(&b->client, "aqua/" AQUA_DEVICE_ID "/telemetry",
+                                        b->payload, b->payload_len, 1, 5000);
+    }
+    bench_sink += aqua_mqtt_flush(&b->client, 5000);
+}
+
+static void b_http_upload(uint64_t iters, void *ctx) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f,
+                                       false, true, false, false);
+    }
+}
+
+static void run_mqtt(mqtt_bench_t *b, const char *prefix, const char *host, int port) {
+    char name[64];
+
+    if (bench_connect(b, host, port, 1)) {
+        snprintf(name, sizeof(name), "%s/qos1_sync", prefix);
+        bench_run(name, b_qos1_sync, b);
+        aqua_mqtt_disconnect(&b->client);
+    }
+    if (bench_connect(b, host, port, 4)) {
+        snprintf(name, sizeof(name), "%s/qos1_window4", prefix);
+        bench_run(name, b_qos1_window, b);
+        aqua_mqtt_disconnect(&b->client);
+    }
+}
+
+void bench_mqtt_suite(void) {
+    standin_t *http = standin_start();
+    mqtt_standin_t *broker = mqtt_standin_start();
+    mqtt_bench_t *b = calloc(1, sizeof(*b));
+    if (!http || !broker || !b) {
+        fprintf(stderr, "bench_mqtt: failed to start stand-ins\n");
+        standin_stop(http);
+        mqtt_standin_stop(broker);
+        free(b);
+        return;
+    }
+
+    aqua_reading_t reading = {
+        .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+        .do_level = AQUA_SENSOR_ERROR, .turbidity = 10.0f, .ammonia = AQUA_SENSOR_ERROR
+    };
+    aqua_controls_t controls = { .aerator = true };
+    b->payload_len = (size_t)aqua_build_payload(&reading, &controls, b->payload, sizeof(b->payload));
+
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(http));
+    hal_sim_set_stream_endpoint("127.0.0.1", mqtt_standin_port(broker));
+
+    standin_set_delay_ms(http, BENCH_RTT_MS);
+    mqtt_standin_set_ack_delay_ms(broker, BENCH_RTT_MS);
+    bench_run("http/upload_rtt5ms", b_http_upload, NULL);
+    run_mqtt(b, "mqtt/rtt5ms", "127.0.0.1", mqtt_standin_port(broker));
+
+    const char *real = getenv("AQUA_BENCH_MQTT");
+    if (real) {
+        char host[64];
+        int port = 1883;
+        snprintf(host, sizeof(host), "%s", real);
+        char *colon = strchr(host, ':');
+        if (colon) {
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+        hal_sim_set_stream_endpoint(host, port);
+        run_mqtt(b, "mqtt/broker", host, port);
+    }
+    hal_sim_set_stream_endpoint("", 0);
+
+    free(b);
+    mqtt_standin_stop(broker);
+    standin_stop(http);
+}
@@ -0,0 +1,94 @@
+#include <math.h>
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_params.h"
+#include "aqua_rules.h"
+#include "bench.h"
+
+// Local rules against the hard-coded path: the built-in control and alert
+// decisions as rules, run by the bytecode interpreter over a sweep of
+// readings, next to aqua_decide_controls() plus aqua_eval_alerts() over the
+// same readings; and the cost of compiling them on the device.
+
+static const char source[] =
+    "when ph < ph_relay_on_below then ph_relay on\n"
+    "when dissolved_oxygen < aerator_on_below then aerator on\n"
+    "when turbidity > filter_on_above then filter on\n"
+    "when ammonia > pump_on_above then pump on\n"
+    "when water_temp < temp_min then alert low_temperature\n"
+    "when water_temp > temp_max then alert high_temperature\n"
+    "when ph < ph_min then alert low_ph\n"
+    "when ph > ph_max then alert high_ph\n"
+    "when do_level < do_min then alert low_dissolved_oxygen\n"
+    "when turbidity > turbidity_max then alert high_turbidity\n"
+    "when ammonia > ammonia_max then alert high_ammonia\n";
+
+#define READINGS 64
+
+static aqua_reading_t readings[READINGS];
+static aqua_params_t params;
+static aqua_rules_program_t prog;
+
+static void setup(void) {
+    aqua_params_defaults(&params);
+    for (int i = 0; i < READINGS; i++) {
+        aqua_reading_t *r = &readings[i];
+        aqua_reading_clear(r);
+        r->air_temp = 26.5f;
+        r->humidity = 60.0f;
+        r->water_temp = 22.0f + 0.2f * (float)i;
+        r->ph = 5.5f + 0.06f * (float)i;
+        r->do_level = 3.0f + 0.07f * (float)(i % 50);
+        r->turbidity = 2.0f * (float)i;
+        r->ammonia = 0.02f * (float)(i % 40);
+    }
+}
+
+static uint32_t fold(const aqua_controls_t *c, const aqua_alert_states_t *a) {
+    return (uint32_t)c->ph_relay + c->aerator + c->filter + c->pump + a->low + a->high;
+}
+
+static void b_hardcoded(uint64_t iters, void *ctx) {
+    for (uint64_t i = 0; i < iters; i++) {
+        const aqua_reading_t *r = &readings[i % READINGS];
+        aqua_controls_t c;
+        aqua_alert_states_t a;
+        aqua_decide_controls(r, &params, &c);
+        aqua_eval_alerts(r, &params, &a);
+        bench_sink += fold(&c, &a);
+    }
+}
+
+static void b_bytecode(uint64_t iters, void *ctx) {
+    for (uint64_t i = 0; i < iters; i++) {
+        aqua_rules_input_t in = { .reading = &readings[i % READINGS], .params = &params, .hour = NAN };
+        aqua_controls_t c = {0};
+        aqua_alert_states_t a = {0};
+        aqua_rules_run(&prog, &in, &c, &a);
+        bench_sink += fold(&c, &a);
+    }
+}
+
+static void b_compile(uint64_t iters, void *ctx) {
+    static aqua_rules_program_t out;
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += (uint32_t)aqua_rules_compile(source, &out, NULL) + out.code_len;
+    }
+}
+
+static void b_verify(uint64_t iters, void *ctx) {
+    for (uint64_t i = 0; i < iters; i++) {
+        bench_sink += aqua_rules_verify(&prog);
+    }
+}
+
+void bench_rules_suite(void) {
+    setup();
+    if (aqua_rules_compile(source, &prog, NULL) != ESP_OK) {
+        return;
+    }
+    bench_run("rules/hardcoded", b_hardcoded, NULL);
+    bench_run("rules/bytecode", b_bytecode, NULL);
+    bench_run("rules/compile", b_compile, NULL);
+    bench_run("rules/verify", b_verify, NULL);
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_stream.h"
+#include "bench.h"
+#include "hal.h"
+#include "hal_sim.h"
+
+// Raw sample streaming: the per-frame cost of packing and COBS-encoding on
+// the device, the receiver's decoding, and whole captures over the simulated
+// USB port. A capture reports what got through in device time: sustained
+// scans and wire bytes a second, and scans skipped because writing fell
+// behind. It runs once over USB full speed and once over a link as slow as
+// the 115200-baud console, which cannot keep up.
+
+#define BENCH_USB_BYTES_PER_S 1000000   // USB-Serial-JTAG bulk, full speed
+#define BENCH_UART_BYTES_PER_S 11520    // 115200 baud, 8N1
+
+static aqua_stream_frame_t frame;
+static uint8_t raw[AQUA_STREAM_FRAME_MAX];
+static uint8_t wire[AQUA_STREAM_WIRE_MAX];
+static size_t wire_len;
+static aqua_stream_rx_t rx;
+
+// A full frame of plausible 12-bit conversions, zeros included
+static void make_frame(void) {
+    memset(&frame, 0, sizeof(frame));
+    frame.nch = AQUA_STREAM_MAX_CHANNELS;
+    frame.scans = AQUA_STREAM_MAX_SCANS;
+    frame.period_us = 1000;
+    frame.first_us = 123456789;
+    for (int c = 0; c < frame.nch; c++) {
+        frame.channels[c] = (uint8_t)c;
+    }
+    uint32_t noise = 1;
+    for (int i = 0; i < frame.nch * frame.scans; i++) {
+        noise = noise * 1103515245u + 12345u;
+        frame.samples[i] = (int16_t)(2048 + (int)((noise >> 16) % 64) - 32);
+    }
+    frame.samples[5] = 0;
+    wire_len = aqua_cobs_encode(raw, aqua_stream_pack(&frame, raw, sizeof(raw)), wire, sizeof(wire));
+}
+
+static void b_encode(uint64_t iters, void *ctx) {
+    for (uint64_t i = 0; i < iters; i++) {
+        frame.seq = (uint32_t)i;
+        size_t len = aqua_stream_pack(&frame, raw, sizeof(raw));
+        bench_sink += (uint32_t)aqua_cobs_encode(raw, len, wire, sizeof(wire));
+    }
+}
+
+static void b_decode(uint64_t iters, void *ctx) {
+    aqua_stream_rx_init(&rx, NULL, NULL);
+    for (uint64_t i = 0; i < iters; i++) {
+        aqua_stream_rx_feed(&rx, wire, wire_len);
+    }
+    bench_sink += rx.stats.frames;
+}
+
+typedef struct {
+    uint32_t bytes_per_s;
+    aqua_stream_stats_t stats;
+    int64_t sim_us;
+} capture_bench_t;
+
+// One second at the top rate on every built-in probe
+static void b_capture(uint64_t iters, void *ctx) {
+    capture_bench_t *b = ctx;
+    static uint8_t drain[65536];
+    for (uint64_t i = 0; i < iters; i++) {
+        hal_sim_reset();
+        hal_sim_config()->usb_bytes_per_s = b->bytes_per_s;
+        hal_stream_t *port = hal_usb_cdc_open();
+        aqua_stream_config_t cfg;
+        aqua_stream_parse_command("start", &cfg);
+        cfg.rate_hz = STREAM_MAX_RATE_HZ;
+        cfg.duration_s = 1;
+        aqua_stream_stats_t before;
+        aqua_stream_get_stats(&before);
+        int64_t t0 = hal_time_us();
+        aqua_stream_start(&cfg);
+        aqua_stream_serve(port, 0);
+        b->sim_us = hal_time_us() - t0;
+        hal_stream_close(port);
+        while (hal_sim_usb_take(drain, sizeof(drain)) > 0) {
+        }
+
+        aqua_stream_get_stats(&b->stats);
+        b->stats.frames -= before.frames;
+        b->stats.scans -= before.scans;
+        b->stats.bytes -= before.bytes;
+        b->stats.skipped_scans -= before.skipped_scans;
+    }
+}
+
+static void run_capture(const char *name, uint32_t bytes_per_s) {
+    capture_bench_t b = { .bytes_per_s = bytes_per_s };
+    bench_run(name, b_capture, &b);
+    if (b.sim_us > 0) {
+        double s = b.sim_us / 1e6;
+        printf("%-36s %12llu %14.0f scans/s (%u skipped)\n", "", (unsigned long long)b.stats.scans,
+               b.stats.scans / s, b.stats.skipped_scans);
+        printf("%-36s %12llu %14.1f kB/s\n", "", (unsigned long long)b.stats.bytes, b.stats.bytes / s / 1e3);
+    }
+}
+
+void bench_stream_suite(void) {
+    make_frame();
+    bench_run("stream/pack_cobs_8ch_64", b_encode, NULL);
+    double ns = bench_last_ns_per_op();
+    if (ns > 0) {
+        printf("%-36s %12zu %14.1f MB/s\n", "", wire_len, wire_len * 1e3 / ns);
+    }
+    bench_run("stream/rx_decode_8ch_64", b_decode, NULL);
+    ns = bench_last_ns_per_op();
+    if (ns > 0) {
+        printf("%-36s %12zu %14.1f MB/s\n", "", wire_len, wire_len * 1e3 / ns);
+    }
+    run_capture("stream/capture_1khz_usb", BENCH_USB_BYTES_PER_S);
+    run_capture("stream/capture_1khz_uart", BENCH_UART_BYTES_PER_S);
+}
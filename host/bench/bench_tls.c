@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "tls_standin.h"
+
+// Full TLS handshakes against the stand-in (host/tls_standin.h), client and
+// server in process. ns/op covers both sides; the lines after it give the
+// client's share, its peak heap, the bytes each way and the round trips, for
+// the untuned and tuned client profiles against an RSA and an ECDSA chain.
+// OpenSSL on a PC is not mbedTLS on the S3, so the times only rank the
+// options; CONFIG_AQUA_TLS_BENCH measures the device itself.
+
+typedef struct {
+    tls_standin_t *server;
+    tls_standin_client_t *client;
+    tls_standin_result_t last;
+    int64_t client_ns;
+    uint64_t handshakes;
+    bool failed;
+} tls_bench_t;
+
+static void b_handshake(uint64_t iters, void *ctx) {
+    tls_bench_t *b = ctx;
+    b->client_ns = 0;
+    b->handshakes = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        if (!tls_standin_handshake(b->server, b->client, &b->last)) {
+            b->failed = true;
+            return;
+        }
+        b->client_ns += b->last.client_ns;
+        b->handshakes++;
+    }
+}
+
+static void run(const char *name, unsigned chains, bool max_tls12, const tls_standin_profile_t *profile) {
+    tls_bench_t b = {
+        .server = tls_standin_create(AQUA_STANDIN_CERT_DIR, chains, max_tls12),
+        .client = tls_standin_client_create(AQUA_STANDIN_CERT_DIR, profile),
+    };
+    if (b.server && b.client) {
+        bench_run(name, b_handshake, &b);
+    }
+    if (b.failed) {
+        printf("%-36s handshake failed\n", name);
+    } else if (b.handshakes > 0) {
+        const tls_standin_result_t *r = &b.last;
+        printf("%-36s %12s %14.1f us client\n", "", r->version, b.client_ns / 1e3 / b.handshakes);
+        printf("%-36s %12s %14zu B client heap peak, %zu B kept\n", "", "", r->client_peak_heap,
+               r->client_heap_after);
+        printf("%-36s %12s %14zu B sent, %zu B received, %d round trip(s)\n", "", "", r->client_sent,
+               r->client_received, r->round_trips);
+        printf("%-36s %12s %s %s\n", "", "", r->suite, r->group);
+    }
+    tls_standin_client_free(b.client);
+    tls_standin_free(b.server);
+}
+
+void bench_tls_suite(void) {
+#ifdef STANDIN_HAVE_OPENSSL
+    run("tls/handshake_rsa_default", TLS_STANDIN_RSA, false, &tls_standin_profile_default);
+    run("tls/handshake_rsa_tuned", TLS_STANDIN_RSA, false, &tls_standin_profile_tuned);
+    run("tls/handshake_ecdsa_tuned", TLS_STANDIN_ECDSA, false, &tls_standin_profile_tuned);
+    run("tls/handshake_ecdsa_tuned_tls12", TLS_STANDIN_ECDSA, true, &tls_standin_profile_tuned);
+#endif
+}
@@ -0,0 +1,214 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_delta.h"
+#include "delta_encoder.h"
+
+#define HASH_BITS 18
+#define HASH_WINDOW 8
+#define MIN_MATCH 16
+#define MAX_CHAIN 64
+#define MERGE_GAP 3     // Matching bytes absorbed into a run rather than splitting it
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+} out_buf_t;
+
+static void put_bytes(out_buf_t *o, const void *data, size_t len) {
+    if (o->failed) return;
+    if (o->len + len > o->cap) {
+        size_t cap = o->cap ? o->cap : 4096;
+        while (cap < o->len + len) cap *= 2;
+        uint8_t *buf = realloc(o->buf, cap);
+        if (!buf) {
+            o->failed = true;
+            return;
+        }
+        o->buf = buf;
+        o->cap = cap;
+    }
+    memcpy(o->buf + o->len, data, len);
+    o->len += len;
+}
+
+static void put_u8(out_buf_t *o, uint8_t v) {
+    put_bytes(o, &v, 1);
+}
+
+static void put_u32(out_buf_t *o, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    put_bytes(o, b, 4);
+}
+
+static void put_varint(out_buf_t *o, uint64_t v) {
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        put_u8(o, v ? (b | 0x80) : b);
+    } while (v);
+}
+
+static uint32_t hash_at(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+static size_t exact_length(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len) {
+    size_t n = 0;
+    size_t max = a_len < b_len ? a_len : b_len;
+    while (n < max && a[n] == b[n]) n++;
+    return n;
+}
+
+// Longest forward extension keeping matches above half (bsdiff's criterion)
+static size_t approx_extension(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len) {
+    size_t max = a_len < b_len ? a_len : b_len;
+    long score = 0, best_score = 0;
+    size_t best = 0;
+    for (size_t i = 0; i < max; i++) {
+        score += a[i] == b[i] ? 1 : -1;
+        if (score > best_score) {
+            best_score = score;
+            best = i + 1;
+        } else if (score < best_score - 2 * MIN_MATCH) {
+            break;
+        }
+    }
+    return best;
+}
+
+static void emit_insert(out_buf_t *o, const uint8_t *data, size_t len, delta_encode_stats_t *st) {
+    if (len == 0) return;
+    put_u8(o, AQUA_DELTA_OP_INSERT);
+    put_varint(o, len);
+    put_bytes(o, data, len);
+    st->insert_ops++;
+    st->new_bytes += len;
+}
+
+static void emit_patch(out_buf_t *o, const uint8_t *src, const uint8_t *dst, size_t len,
+                       int64_t src_delta, delta_encode_stats_t *st) {
+    put_u8(o, AQUA_DELTA_OP_PATCH);
+    put_varint(o, ((uint64_t)src_delta << 1) ^ (uint64_t)(src_delta >> 63));
+    put_varint(o, len);
+    st->patch_ops++;
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t skip = 0;
+        while (pos + skip < len && src[pos + skip] == dst[pos + skip]) skip++;
+        put_varint(o, skip);
+        st->copied_bytes += skip;
+        pos += skip;
+        if (pos == len) return;
+
+        // A run ends at MERGE_GAP consecutive matching bytes (or the patch end)
+        size_t n = 0, same = 0;
+        while (pos + n + same < len && same < MERGE_GAP) {
+            if (src[pos + n + same] == dst[pos + n + same]) {
+                same++;
+            } else {
+                n += same + 1;
+                same = 0;
+            }
+        }
+        put_varint(o, n);
+        put_bytes(o, dst + pos, n);
+        st->new_bytes += n;
+        pos += n;
+    }
+    put_varint(o, 0);
+}
+
+size_t delta_encode(const uint8_t *source, size_t source_len,
+                    const uint8_t *target, size_t target_len,
+                    uint8_t **out, delta_encode_stats_t *stats) {
+    delta_encode_stats_t local;
+    delta_encode_stats_t *st = stats ? stats : &local;
+    memset(st, 0, sizeof(*st));
+    *out = NULL;
+    if (target_len == 0 || source_len > UINT32_MAX || target_len > UINT32_MAX) return 0;
+
+    int32_t *head = malloc(sizeof(int32_t) << HASH_BITS);
+    int32_t *next = malloc(sizeof(int32_t) * (source_len + 1));
+    if (!head || !next) {
+        free(head);
+        free(next);
+        return 0;
+    }
+    memset(head, 0xFF, sizeof(int32_t) << HASH_BITS);
+    // Insert back to front so chains start with the earliest position
+    for (size_t i = source_len >= HASH_WINDOW ? source_len - HASH_WINDOW + 1 : 0; i-- > 0; ) {
+        uint32_t h = hash_at(source + i);
+        next[i] = head[h];
+        head[h] = (int32_t)i;
+    }
+
+    out_buf_t o = {0};
+    put_bytes(&o, AQUA_DELTA_MAGIC, 4);
+    put_u32(&o, (uint32_t)source_len);
+    put_u32(&o, aqua_crc32(0, source, source_len));
+    put_u32(&o, (uint32_t)target_len);
+    put_u32(&o, aqua_crc32(0, target, target_len));
+
+    size_t i = 0, literal = 0;
+    size_t src_end = 0;         // End of the previous PATCH in the source
+    int64_t diagonal = 0;       // Source minus target offset of the previous PATCH
+
+    while (i + HASH_WINDOW <= target_len) {
+        size_t best_len = 0, best_src = 0;
+
+        // Continuing the previous alignment is cheapest to encode
+        int64_t diag_src = (int64_t)i + diagonal;
+        if (diag_src >= 0 && (size_t)diag_src < source_len) {
+            best_len = exact_length(source + diag_src, source_len - (size_t)diag_src,
+                                    target + i, target_len - i);
+            best_src = (size_t)diag_src;
+        }
+        int chain = 0;
+        for (int32_t c = head[hash_at(target + i)]; c >= 0 && chain < MAX_CHAIN; c = next[c], chain++) {
+            size_t n = exact_length(source + c, source_len - (size_t)c, target + i, target_len - i);
+            if (n > best_len) {
+                best_len = n;
+                best_src = (size_t)c;
+            }
+        }
+        if (best_len < MIN_MATCH) {
+            i++;
+            continue;
+        }
+
+        // Pull the match back over literal bytes that also agree
+        while (i > literal && best_src > 0 && source[best_src - 1] == target[i - 1]) {
+            i--;
+            best_src--;
+            best_len++;
+        }
+        emit_insert(&o, target + literal, i - literal, st);
+
+        size_t len = best_len + approx_extension(source + best_src + best_len,
+                                                 source_len - best_src - best_len,
+                                                 target + i + best_len, target_len - i - best_len);
+        emit_patch(&o, source + best_src, target + i, len, (int64_t)best_src - (int64_t)src_end, st);
+        src_end = best_src + len;
+        diagonal = (int64_t)best_src - (int64_t)i;
+        i += len;
+        literal = i;
+    }
+    emit_insert(&o, target + literal, target_len - literal, st);
+    put_u8(&o, AQUA_DELTA_OP_END);
+
+    free(head);
+    free(next);
+    if (o.failed) {
+        free(o.buf);
+        return 0;
+    }
+    *out = o.buf;
+    return o.len;
+}
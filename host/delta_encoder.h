@@ -0,0 +1,32 @@
+#ifndef DELTA_ENCODER_H
+#define DELTA_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Produces the firmware deltas that main/aqua_delta.c applies (format in
+// aqua_delta.h). Host only: the matcher indexes the whole source image.
+//
+// Exact matches are found through a hash of 8-byte windows, then extended
+// forward while at least half the bytes still agree. That turns the usual
+// firmware change - code shifted by an edit, with every absolute address
+// after it adjusted - into long PATCH runs carrying only the changed bytes.
+
+typedef struct {
+    size_t patch_ops;
+    size_t insert_ops;
+    size_t copied_bytes;        // Target bytes taken from the source
+    size_t new_bytes;           // Target bytes carried in the delta
+} delta_encode_stats_t;
+
+/**
+ * @brief Encode target as a delta against source
+ * @param out Receives a malloc'd buffer; the caller frees it
+ * @param stats Optional breakdown
+ * @return Delta length, 0 on failure
+ */
+size_t delta_encode(const uint8_t *source, size_t source_len,
+                    const uint8_t *target, size_t target_len,
+                    uint8_t **out, delta_encode_stats_t *stats);
+
+#endif // DELTA_ENCODER_H
@@ -0,0 +1,724 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_params.h"
+#include "fleet_sim.h"
+
+#define FLEET_OUT_MAX 2048
+#define FLEET_IN_MAX 4096
+#define FLEET_MAX_STEPS 4
+#define FLEET_MAX_EVENTS 256
+#define FLEET_EPOCH_US 1760000000000000LL   // Wall clock of device time 0
+
+// Device timings (device ms), from the bundled serial captures
+#define BOOT_MIN_MS 3000                    // Power-on to the first cycle, mostly the WiFi join
+#define BOOT_MAX_MS 7000
+#define WORK_MIN_MS 1000                    // Sensor reads before a cycle's first request
+#define WORK_MAX_MS 1600
+#define SHORT_TIMEOUT_MS 10000              // Alert POST and params poll
+
+typedef enum { ACT_CYCLE, ACT_REQUEST } action_t;
+
+typedef struct {
+    int id;
+    char name[16];
+    uint32_t rng;
+
+    // Firmware state
+    aqua_reading_t reading;
+    aqua_controls_t controls;
+    aqua_alert_states_t sent_alerts;
+    aqua_alert_states_t pending_alerts;
+    int32_t last_command_id;
+    int cycle_count;
+    int64_t boot_at;
+    bool uploaded;
+
+    // This cycle's requests
+    fleet_req_t steps[FLEET_MAX_STEPS];
+    int step_count;
+    int step;
+    int attempt;
+
+    // Timer: only the entry with the current seq is live
+    action_t next;
+    uint32_t seq;
+    int64_t offline_until;
+    int64_t next_drop;
+
+    // Request in flight (fd >= 0)
+    int fd;
+    bool sending;
+    int64_t started;
+    size_t out_len;
+    size_t out_sent;
+    size_t in_len;
+    char out[FLEET_OUT_MAX];
+    char in[FLEET_IN_MAX];
+} device_t;
+
+typedef struct {
+    int64_t at;
+    uint32_t dev;
+    uint32_t seq;
+} fleet_timer_t;
+
+typedef struct {
+    const fleet_config_t *cfg;
+    fleet_report_t *report;
+    device_t *devices;
+    struct sockaddr_in addr;
+    int epoll_fd;
+    int64_t t0;                             // Monotonic µs at the start
+    int64_t now;                            // Real µs since the start
+    fleet_timer_t *heap;
+    size_t heap_len;
+    size_t heap_cap;
+    fleet_samples_t latency[FLEET_REQ_COUNT];
+    uint32_t *starts;                       // Requests sent per device second
+    size_t seconds;
+    int in_flight;
+    uint64_t completed;
+    aqua_params_t params;
+} fleet_t;
+
+static int64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Real µs for a device duration
+static int64_t dev_ms(const fleet_t *f, double ms) {
+    return (int64_t)(ms * 1000.0 / f->cfg->speed);
+}
+
+static double dev_seconds(const fleet_t *f) {
+    return (double)f->now * f->cfg->speed / 1e6;
+}
+
+// ========== RANDOM ==========
+static double frand(device_t *d) {
+    d->rng ^= d->rng << 13;
+    d->rng ^= d->rng >> 17;
+    d->rng ^= d->rng << 5;
+    return (d->rng >> 8) / 16777216.0;
+}
+
+static double uniform(device_t *d, double lo, double hi) {
+    return lo + (hi - lo) * frand(d);
+}
+
+static double exponential(device_t *d, double mean) {
+    return -mean * log(1.0 - frand(d));
+}
+
+// ========== SAMPLES ==========
+void fleet_samples_add(fleet_samples_t *s, int64_t us) {
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity ? 2 * s->capacity : 1024;
+        uint32_t *grown = realloc(s->us, capacity * sizeof(*grown));
+        if (!grown) return;
+        s->us = grown;
+        s->capacity = capacity;
+    }
+    s->us[s->count++] = us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void fleet_samples_percentiles(fleet_samples_t *s, fleet_percentiles_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (s->count == 0) {
+        return;
+    }
+    qsort(s->us, s->count, sizeof(s->us[0]), cmp_u32);
+    const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+    double *dst[] = { &out->p50_ms, &out->p90_ms, &out->p99_ms, &out->p999_ms };
+    for (int i = 0; i < 4; i++) {
+        size_t idx = (size_t)(q[i] * (double)s->count);
+        if (idx >= s->count) idx = s->count - 1;
+        *dst[i] = s->us[idx] / 1000.0;
+    }
+    out->max_ms = s->us[s->count - 1] / 1000.0;
+}
+
+void fleet_samples_free(fleet_samples_t *s) {
+    free(s->us);
+    memset(s, 0, sizeof(*s));
+}
+
+// ========== TIMERS ==========
+static void heap_push(fleet_t *f, fleet_timer_t t) {
+    if (f->heap_len == f->heap_cap) {
+        size_t cap = f->heap_cap ? 2 * f->heap_cap : 1024;
+        fleet_timer_t *grown = realloc(f->heap, cap * sizeof(*grown));
+        if (!grown) abort();
+        f->heap = grown;
+        f->heap_cap = cap;
+    }
+    size_t i = f->heap_len++;
+    while (i > 0 && f->heap[(i - 1) / 2].at > t.at) {
+        f->heap[i] = f->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    f->heap[i] = t;
+}
+
+static fleet_timer_t heap_pop(fleet_t *f) {
+    fleet_timer_t top = f->heap[0];
+    fleet_timer_t last = f->heap[--f->heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= f->heap_len) break;
+        if (c + 1 < f->heap_len && f->heap[c + 1].at < f->heap[c].at) c++;
+        if (last.at <= f->heap[c].at) break;
+        f->heap[i] = f->heap[c];
+        i = c;
+    }
+    if (f->heap_len > 0) {
+        f->heap[i] = last;
+    }
+    return top;
+}
+
+static void schedule(fleet_t *f, device_t *d, action_t next, int64_t at) {
+    d->next = next;
+    d->seq++;
+    heap_push(f, (fleet_timer_t){ .at = at, .dev = (uint32_t)d->id, .seq = d->seq });
+}
+
+// ========== DEVICE MODEL ==========
+static float wander(device_t *d, float v, float step, float lo, float hi) {
+    v += step * (float)(2.0 * frand(d) - 1.0);
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static void boot(fleet_t *f, device_t *d, int64_t first_cycle) {
+    aqua_reading_clear(&d->reading);
+    d->reading.water_temp = (float)uniform(d, 24, 28);
+    d->reading.air_temp = (float)uniform(d, 24, 30);
+    d->reading.humidity = (float)uniform(d, 45, 75);
+    d->reading.ph = (float)uniform(d, 6.8, 7.6);
+    d->reading.do_level = (float)uniform(d, 5.5, 7.5);
+    d->reading.turbidity = (float)uniform(d, 2, 12);
+    d->reading.ammonia = (float)uniform(d, 0.1, 0.5);
+    memset(&d->sent_alerts, 0, sizeof(d->sent_alerts));
+    d->last_command_id = 0;
+    d->cycle_count = 0;
+    d->step = d->step_count = 0;
+    d->boot_at = f->now;
+    f->report->boots++;
+    schedule(f, d, ACT_CYCLE, first_cycle);
+}
+
+static void sample(fleet_t *f, device_t *d) {
+    aqua_reading_t *r = &d->reading;
+    r->water_temp = wander(d, r->water_temp, 0.1f, 18, 34);
+    r->air_temp = wander(d, r->air_temp, 0.2f, 10, 45);
+    r->humidity = wander(d, r->humidity, 1.0f, 10, 100);
+    r->ph = wander(d, r->ph, 0.03f, 5.5f, 9.5f);
+    r->do_level = wander(d, r->do_level, 0.1f, 2, 12);
+    r->turbidity = wander(d, r->turbidity, 0.5f, 0, 60);
+    r->ammonia = wander(d, r->ammonia, 0.03f, 0, 3);
+    r->has_health = true;
+    memset(r->health, 100, sizeof(r->health));
+
+    int64_t uptime = (int64_t)((double)(f->now - d->boot_at) * f->cfg->speed);
+    r->has_time = true;
+    r->sampled_us = uptime;
+    r->time = (aqua_timestamp_t){
+        .unix_us = FLEET_EPOCH_US + (int64_t)((double)f->now * f->cfg->speed),
+        .quality = AQUA_TIME_SYNCED,
+        .error_ms = TIME_SYNC_ERROR_MS,
+    };
+}
+
+// The requests of aqua_cycle_run() for the HTTP transports
+static void plan_cycle(fleet_t *f, device_t *d) {
+    d->cycle_count++;
+    sample(f, d);
+    aqua_decide_controls(&d->reading, &f->params, &d->controls);
+
+    d->step_count = 0;
+    d->step = 0;
+    d->attempt = 0;
+    d->uploaded = false;
+    if (f->cfg->exchange) {
+        d->steps[d->step_count++] = FLEET_REQ_EXCHANGE;
+    } else {
+        d->steps[d->step_count++] = FLEET_REQ_POLL;
+        d->steps[d->step_count++] = FLEET_REQ_UPLOAD;
+    }
+    if (f->cfg->alerts) {
+        aqua_eval_alerts(&d->reading, &f->params, &d->pending_alerts);
+        if (aqua_alerts_changed(&d->sent_alerts, &d->pending_alerts)) {
+            d->steps[d->step_count++] = FLEET_REQ_ALERT;
+        }
+    }
+    if (d->cycle_count % PARAMS_POLL_INTERVAL_CYCLES == 0) {
+        d->steps[d->step_count++] = FLEET_REQ_PARAMS;
+    }
+}
+
+static int max_attempts(fleet_req_t kind) {
+    switch (kind) {
+    case FLEET_REQ_POLL: return RELAY_POLL_MAX_ATTEMPTS;
+    case FLEET_REQ_UPLOAD:
+    case FLEET_REQ_EXCHANGE: return UPLOAD_MAX_ATTEMPTS;
+    default: return 1;
+    }
+}
+
+static int retry_delay_ms(fleet_req_t kind, int attempt) {
+    int first = kind == FLEET_REQ_POLL ? RELAY_POLL_RETRY_DELAY_MS : UPLOAD_RETRY_DELAY_MS;
+    return first << attempt;
+}
+
+static bool status_ok(fleet_req_t kind, int status) {
+    switch (kind) {
+    case FLEET_REQ_UPLOAD: return status == 200 || status == 201;
+    case FLEET_REQ_ALERT: return status >= 200 && status < 300;
+    default: return status == 200;
+    }
+}
+
+static void end_step(fleet_t *f, device_t *d) {
+    d->step++;
+    d->attempt = 0;
+    if (d->step < d->step_count) {
+        schedule(f, d, ACT_REQUEST, f->now);
+        return;
+    }
+
+    f->report->cycles++;
+    if (d->uploaded) {
+        f->report->rows_uploaded++;
+    } else {
+        f->report->rows_lost++;
+    }
+    double sleep_ms = SAMPLE_DELAY_MS + (f->cfg->cycle_jitter_ms > 0 ? uniform(d, 0, f->cfg->cycle_jitter_ms) : 0);
+    schedule(f, d, ACT_CYCLE, f->now + dev_ms(f, sleep_ms));
+}
+
+static void attempt_done(fleet_t *f, device_t *d, bool ok) {
+    fleet_req_t kind = d->steps[d->step];
+    if (ok) {
+        if (kind == FLEET_REQ_UPLOAD || kind == FLEET_REQ_EXCHANGE) d->uploaded = true;
+        if (kind == FLEET_REQ_ALERT) d->sent_alerts = d->pending_alerts;
+        end_step(f, d);
+    } else if (d->attempt + 1 < max_attempts(kind)) {
+        int delay = retry_delay_ms(kind, d->attempt);
+        d->attempt++;
+        schedule(f, d, ACT_REQUEST, f->now + dev_ms(f, delay));
+    } else {
+        end_step(f, d);
+    }
+}
+
+// ========== REQUESTS ==========
+static int build_request(fleet_t *f, device_t *d, fleet_req_t kind) {
+    char body[640];
+    char url_buf[256];
+    const char *method = "POST", *url = NULL, *extra = "";
+    int body_len = 0;
+
+    switch (kind) {
+    case FLEET_REQ_POLL:
+        method = "GET";
+        url = SUPABASE_RELAY_POLL_URL;
+        extra = "Prefer: return=representation\r\n";
+        break;
+    case FLEET_REQ_UPLOAD:
+        url = SUPABASE_URL;
+        body_len = aqua_build_payload(&d->reading, &d->controls, body, sizeof(body));
+        break;
+    case FLEET_REQ_EXCHANGE:
+        url = SUPABASE_RPC_URL;
+        body_len = aqua_build_exchange_payload(&d->reading, &d->controls, d->last_command_id,
+                                               body, sizeof(body));
+        break;
+    case FLEET_REQ_ALERT:
+        url = SUPABASE_ALERTS_URL;
+        body_len = aqua_build_alert_payload(&d->pending_alerts, &d->reading, body, sizeof(body));
+        break;
+    default:
+        method = "GET";
+        snprintf(url_buf, sizeof(url_buf), SUPABASE_PARAMS_URL "?device_id=eq.%s&version=gt.%lu"
+                 "&order=version.desc&limit=1", d->name, (unsigned long)f->params.version);
+        url = url_buf;
+        break;
+    }
+    if (body_len < 0) {
+        return -1;
+    }
+
+    const char *path = strchr(url + sizeof("https://") - 1, '/');
+    int n = snprintf(d->out, sizeof(d->out),
+                     "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                     "apikey: " SUPABASE_KEY "\r\nAuthorization: Bearer " SUPABASE_KEY "\r\n"
+                     "%sContent-Length: %d\r\nConnection: close\r\n\r\n",
+                     method, path, f->cfg->host, extra, body_len);
+    if (n < 0 || (size_t)n + (size_t)body_len > sizeof(d->out)) {
+        return -1;
+    }
+    memcpy(d->out + n, body, (size_t)body_len);
+    d->out_len = (size_t)n + (size_t)body_len;
+    return 0;
+}
+
+static void update_wifi(fleet_t *f, device_t *d) {
+    while (d->next_drop <= f->now) {
+        d->offline_until = d->next_drop + dev_ms(f, 1000.0 * exponential(d, f->cfg->wifi_drop_mean_s));
+        d->next_drop = d->offline_until + dev_ms(f, 1000.0 * exponential(d, 3600.0 / f->cfg->wifi_drops_per_hour));
+    }
+}
+
+static bool server_outage(const fleet_t *f) {
+    double t = dev_seconds(f);
+    return f->cfg->outage_at_s >= 0 && t >= f->cfg->outage_at_s && t < f->cfg->outage_at_s + f->cfg->outage_s;
+}
+
+static void start_request(fleet_t *f, device_t *d) {
+    fleet_req_t kind = d->steps[d->step];
+    fleet_req_stats_t *st = &f->report->req[kind];
+
+    update_wifi(f, d);
+    bool wifi_down = f->now < d->offline_until;
+    if (wifi_down && (kind == FLEET_REQ_UPLOAD || kind == FLEET_REQ_EXCHANGE)) {
+        // hal_net_ensure_connected() fails: the upload is given up without attempts
+        st->unreachable++;
+        end_step(f, d);
+        return;
+    }
+    if (wifi_down || server_outage(f)) {
+        st->unreachable++;
+        attempt_done(f, d, false);
+        return;
+    }
+    if (build_request(f, d, kind) < 0) {
+        end_step(f, d);
+        return;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || (connect(fd, (struct sockaddr *)&f->addr, sizeof(f->addr)) != 0 && errno != EINPROGRESS)) {
+        if (fd >= 0) close(fd);
+        st->failed++;
+        attempt_done(f, d, false);
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = d };
+    epoll_ctl(f->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+    d->fd = fd;
+    d->sending = true;
+    d->started = f->now;
+    d->out_sent = 0;
+    d->in_len = 0;
+    st->sent++;
+    if (++f->in_flight > f->report->peak_in_flight) {
+        f->report->peak_in_flight = f->in_flight;
+    }
+    size_t second = (size_t)dev_seconds(f);
+    if (second < f->seconds) {
+        f->starts[second]++;
+    }
+
+    int timeout = kind == FLEET_REQ_ALERT || kind == FLEET_REQ_PARAMS ? SHORT_TIMEOUT_MS : UPLOAD_TIMEOUT_MS;
+    schedule(f, d, ACT_REQUEST, f->now + dev_ms(f, timeout));
+}
+
+static void on_command(const char *type, bool state, void *ctx) {
+    fleet_t *f = ctx;
+    f->report->commands_applied++;
+}
+
+static void apply_reply(fleet_t *f, device_t *d, fleet_req_t kind) {
+    d->in[d->in_len < FLEET_IN_MAX ? d->in_len : FLEET_IN_MAX - 1] = '\0';
+    char *body = strstr(d->in, "\r\n\r\n");
+    if (!body) {
+        return;
+    }
+    body += 4;
+    if (kind == FLEET_REQ_POLL) {
+        aqua_parse_relay_commands(body, on_command, f);
+    } else if (kind == FLEET_REQ_EXCHANGE) {
+        int32_t newest = d->last_command_id;
+        aqua_parse_relay_commands_after(body, d->last_command_id, on_command, f, &newest);
+        d->last_command_id = newest;
+    }
+}
+
+static void close_request(fleet_t *f, device_t *d) {
+    close(d->fd);
+    d->fd = -1;
+    f->in_flight--;
+}
+
+static void complete(fleet_t *f, device_t *d, bool timed_out) {
+    fleet_req_t kind = d->steps[d->step];
+    fleet_req_stats_t *st = &f->report->req[kind];
+    close_request(f, d);
+
+    int status = 0;
+    if (!timed_out && d->in_len >= 12 && memcmp(d->in, "HTTP/1.", 7) == 0) {
+        status = atoi(d->in + 9);
+    }
+    if (timed_out) {
+        st->timeouts++;
+    } else if (status > 0) {
+        fleet_samples_add(&f->latency[kind], f->now - d->started);
+        f->completed++;
+    }
+
+    bool ok = status_ok(kind, status);
+    if (ok) {
+        st->ok++;
+        apply_reply(f, d, kind);
+    } else if (!timed_out) {
+        st->failed++;
+    }
+    attempt_done(f, d, ok);
+}
+
+static void on_writable(fleet_t *f, device_t *d) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+        complete(f, d, false);
+        return;
+    }
+    while (d->out_sent < d->out_len) {
+        ssize_t n = send(d->fd, d->out + d->out_sent, d->out_len - d->out_sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            complete(f, d, false);
+            return;
+        }
+        d->out_sent += (size_t)n;
+    }
+    d->sending = false;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = d };
+    epoll_ctl(f->epoll_fd, EPOLL_CTL_MOD, d->fd, &ev);
+}
+
+static void on_readable(fleet_t *f, device_t *d) {
+    for (;;) {
+        char scratch[1024];
+        char *dst = d->in_len < FLEET_IN_MAX - 1 ? d->in + d->in_len : scratch;
+        size_t room = d->in_len < FLEET_IN_MAX - 1 ? FLEET_IN_MAX - 1 - d->in_len : sizeof(scratch);
+        ssize_t n = recv(d->fd, dst, room, 0);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) break;
+        if (dst != scratch) d->in_len += (size_t)n;
+    }
+    complete(f, d, false);
+}
+
+static void wake(fleet_t *f, device_t *d) {
+    if (d->fd >= 0) {
+        complete(f, d, true);
+    } else if (d->next == ACT_CYCLE) {
+        plan_cycle(f, d);
+        schedule(f, d, ACT_REQUEST, f->now + dev_ms(f, uniform(d, WORK_MIN_MS, WORK_MAX_MS)));
+    } else {
+        start_request(f, d);
+    }
+}
+
+static void reboot_all(fleet_t *f) {
+    for (int i = 0; i < f->cfg->devices; i++) {
+        device_t *d = &f->devices[i];
+        if (d->fd >= 0) {
+            close_request(f, d);
+            f->report->aborted++;
+        }
+        boot(f, d, f->now + dev_ms(f, uniform(d, BOOT_MIN_MS, BOOT_MAX_MS)));
+    }
+}
+
+// ========== RUN ==========
+void fleet_config_defaults(fleet_config_t *cfg) {
+    *cfg = (fleet_config_t){
+        .host = "127.0.0.1",
+        .devices = 100,
+        .duration_s = 120,
+        .speed = 1,
+        .exchange = AQUA_USE_RPC,
+        .alerts = ALERTS_ENABLED,
+        .seed = 1,
+        .wifi_drop_mean_s = 30,
+        .outage_at_s = -1,
+        .storm_at_s = -1,
+        .commands_per_min = 1,
+    };
+}
+
+static void raise_fd_limit(int devices) {
+    // Both ends of every connection when the stand-in runs in this process
+    struct rlimit rl;
+    rlim_t want = (rlim_t)devices * 2 + 64;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < want) {
+        rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max > want ? want : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+bool fleet_run(const fleet_config_t *cfg, fleet_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    fleet_t f = { .cfg = cfg, .report = report };
+    f.addr.sin_family = AF_INET;
+    f.addr.sin_port = htons((uint16_t)cfg->port);
+    if (cfg->devices <= 0 || cfg->speed <= 0 || cfg->duration_s <= 0 || cfg->port <= 0 ||
+        inet_pton(AF_INET, cfg->host, &f.addr.sin_addr) != 1) {
+        return false;
+    }
+
+    raise_fd_limit(cfg->devices);
+    f.seconds = (size_t)ceil(cfg->duration_s);
+    f.devices = calloc((size_t)cfg->devices, sizeof(device_t));
+    f.starts = calloc(f.seconds, sizeof(uint32_t));
+    f.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!f.devices || !f.starts || f.epoll_fd < 0) {
+        free(f.devices);
+        free(f.starts);
+        if (f.epoll_fd >= 0) close(f.epoll_fd);
+        return false;
+    }
+    aqua_params_defaults(&f.params);
+
+    // Devices already running, at random phases of their cycle
+    for (int i = 0; i < cfg->devices; i++) {
+        device_t *d = &f.devices[i];
+        d->id = i;
+        d->fd = -1;
+        d->rng = (cfg->seed + 1) * 2654435761u ^ (uint32_t)(i + 1) * 40503u;
+        if (d->rng == 0) d->rng = 1;
+        snprintf(d->name, sizeof(d->name), "pond-%04d", i + 1);
+        d->next_drop = INT64_MAX;
+        if (cfg->wifi_drops_per_hour > 0) {
+            d->next_drop = dev_ms(&f, 1000.0 * exponential(d, 3600.0 / cfg->wifi_drops_per_hour));
+        }
+        boot(&f, d, dev_ms(&f, uniform(d, 0, SAMPLE_DELAY_MS + WORK_MAX_MS)));
+    }
+
+    int64_t end = dev_ms(&f, cfg->duration_s * 1000.0);
+    int64_t next_command = 0;
+    bool stormed = cfg->storm_at_s < 0;
+    int command = 0;
+    static const char *const relays[] = { "ph", "aerator", "filter", "pump" };
+    struct epoll_event events[FLEET_MAX_EVENTS];
+
+    f.t0 = mono_us();
+    while (f.now < end) {
+        int timeout_ms = 50;
+        if (f.heap_len > 0) {
+            int64_t wait = f.heap[0].at - f.now;
+            timeout_ms = wait <= 0 ? 0 : wait >= 50000 ? 50 : (int)((wait + 999) / 1000);
+        }
+        int n = epoll_wait(f.epoll_fd, events, FLEET_MAX_EVENTS, timeout_ms);
+        f.now = mono_us() - f.t0;
+        for (int i = 0; i < n; i++) {
+            device_t *d = events[i].data.ptr;
+            if (d->fd < 0) continue;
+            if (d->sending) {
+                on_writable(&f, d);
+            } else {
+                on_readable(&f, d);
+            }
+        }
+
+        if (!stormed && dev_seconds(&f) >= cfg->storm_at_s) {
+            stormed = true;
+            reboot_all(&f);
+        }
+        if (cfg->model && cfg->commands_per_min > 0 && f.now >= next_command) {
+            rpc_standin_add_command(cfg->model, relays[command % 4], command % 8 < 4);
+            command++;
+            next_command += dev_ms(&f, 60000.0 / cfg->commands_per_min);
+        }
+        while (f.heap_len > 0 && f.heap[0].at <= f.now) {
+            fleet_timer_t t = heap_pop(&f);
+            device_t *d = &f.devices[t.dev];
+            if (t.seq == d->seq) {
+                wake(&f, d);
+            }
+        }
+    }
+
+    for (int i = 0; i < cfg->devices; i++) {
+        if (f.devices[i].fd >= 0) {
+            close_request(&f, &f.devices[i]);
+            report->aborted++;
+        }
+    }
+    report->real_s = f.now / 1e6;
+    report->throughput = report->real_s > 0 ? f.completed / report->real_s : 0;
+
+    uint64_t sent = 0;
+    for (size_t s = 0; s < f.seconds; s++) {
+        sent += f.starts[s];
+        if (f.starts[s] > report->peak_rate) {
+            report->peak_rate = f.starts[s];
+            report->peak_at_s = (double)s;
+        }
+    }
+    report->mean_rate = (double)sent / cfg->duration_s;
+    for (int k = 0; k < FLEET_REQ_COUNT; k++) {
+        fleet_samples_percentiles(&f.latency[k], &report->req[k].latency);
+        fleet_samples_free(&f.latency[k]);
+    }
+
+    close(f.epoll_fd);
+    free(f.heap);
+    free(f.starts);
+    free(f.devices);
+    return true;
+}
+
+const char *fleet_req_name(fleet_req_t req) {
+    static const char *const names[FLEET_REQ_COUNT] = {
+        [FLEET_REQ_POLL] = "relay_poll",
+        [FLEET_REQ_UPLOAD] = "upload",
+        [FLEET_REQ_EXCHANGE] = "exchange",
+        [FLEET_REQ_ALERT] = "alert",
+        [FLEET_REQ_PARAMS] = "params_poll",
+    };
+    return (unsigned)req < FLEET_REQ_COUNT ? names[req] : "unknown";
+}
+
+// ========== SERVER SIDE ==========
+static void observe(const standin_request_t *req, int status, int64_t service_us, void *ctx) {
+    fleet_server_t *srv = ctx;
+    pthread_mutex_lock(&srv->lock);
+    fleet_samples_add(&srv->service, service_us);
+    srv->requests++;
+    if (status >= 400) srv->errors++;
+    pthread_mutex_unlock(&srv->lock);
+}
+
+void fleet_server_attach(fleet_server_t *srv, standin_t *server) {
+    memset(srv, 0, sizeof(*srv));
+    pthread_mutex_init(&srv->lock, NULL);
+    standin_set_observer(server, observe, srv);
+}
+
+void fleet_server_detach(fleet_server_t *srv, standin_t *server) {
+    standin_set_observer(server, NULL, NULL);
+    pthread_mutex_destroy(&srv->lock);
+}
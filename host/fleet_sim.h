@@ -0,0 +1,131 @@
+#ifndef FLEET_SIM_H
+#define FLEET_SIM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "http_standin.h"
+#include "rpc_standin.h"
+
+// Load generator emulating a fleet of controllers against a PostgREST-style
+// server (host/tools/aqua_fleet.c).
+//
+// Every device runs the firmware's network schedule from a single event
+// loop: a cycle of sensor work, then either the relay_commands poll and the
+// sensor_data upload or one ingest_reading exchange, the alert POST when the
+// alert set changes and the device_params poll, each with the firmware's
+// attempts, back-off and timeouts (aqua_config.h). Payloads are built and
+// replies parsed with the firmware's own aqua_core functions, from readings
+// that wander per device. Device time can run faster than real time
+// (speed), which scales every delay the devices take but not the server's.
+//
+// Devices start at random phases. Faults: per-device WiFi drops, a server
+// outage (connections refused) and a reboot storm, where every device
+// restarts at once and reconnects within the WiFi join time.
+
+typedef enum {
+    FLEET_REQ_POLL,                     // GET relay_commands
+    FLEET_REQ_UPLOAD,                   // POST sensor_data
+    FLEET_REQ_EXCHANGE,                 // POST rpc/ingest_reading
+    FLEET_REQ_ALERT,
+    FLEET_REQ_PARAMS,                   // GET device_params
+    FLEET_REQ_COUNT
+} fleet_req_t;
+
+typedef struct {
+    const char *host;                   // Server under load (IPv4 address)
+    int port;
+    int devices;
+    double duration_s;                  // Device time to emulate
+    double speed;                       // Device time per real second
+    bool exchange;                      // ingest_reading RPC instead of poll + upload
+    bool alerts;                        // Send alert notifications (ALERTS_ENABLED)
+    uint32_t seed;
+    int cycle_jitter_ms;                // Random extra sleep per cycle; 0 = firmware as shipped
+    double wifi_drops_per_hour;         // Per device
+    double wifi_drop_mean_s;            // Mean length of a drop (exponential)
+    double outage_at_s;                 // Server refuses connections from here... (<0: never)
+    double outage_s;                    // ... for this long
+    double storm_at_s;                  // Every device reboots at this time (<0: never)
+    rpc_standin_t *model;               // If set, relay commands are added to it...
+    double commands_per_min;            // ... at this rate
+} fleet_config_t;
+
+typedef struct {
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double p999_ms;
+    double max_ms;
+} fleet_percentiles_t;
+
+typedef struct {
+    uint64_t sent;                      // Connections opened
+    uint64_t ok;
+    uint64_t failed;                    // Error status, refused or reset
+    uint64_t timeouts;                  // No reply within the firmware's timeout
+    uint64_t unreachable;               // Not sent: WiFi down or server outage
+    fleet_percentiles_t latency;        // Connect to last byte, real time, completed requests
+} fleet_req_stats_t;
+
+typedef struct {
+    fleet_req_stats_t req[FLEET_REQ_COUNT];
+    uint64_t boots;
+    uint64_t cycles;                    // Completed cycles
+    uint64_t rows_uploaded;
+    uint64_t rows_lost;                 // Cycles whose upload failed; the firmware drops them
+    uint64_t commands_applied;
+    uint64_t aborted;                   // In flight at a reboot or at the end of the run
+    int peak_in_flight;
+    double mean_rate;                   // Requests started per device second...
+    double peak_rate;                   // ... on average and in the busiest second
+    double peak_at_s;
+    double real_s;                      // Wall time of the run
+    double throughput;                  // Completed requests per real second
+} fleet_report_t;
+
+// Latency samples in microseconds
+typedef struct {
+    uint32_t *us;
+    size_t count;
+    size_t capacity;
+} fleet_samples_t;
+
+// Server-side view of the stand-in: every reply's service time
+typedef struct {
+    pthread_mutex_t lock;
+    fleet_samples_t service;
+    uint64_t requests;
+    uint64_t errors;                    // Status 400 and above
+} fleet_server_t;
+
+void fleet_config_defaults(fleet_config_t *cfg);
+
+/**
+ * @brief Emulate the fleet for cfg->duration_s of device time
+ * @return false if the configuration is invalid or setup failed
+ */
+bool fleet_run(const fleet_config_t *cfg, fleet_report_t *report);
+
+const char *fleet_req_name(fleet_req_t req);
+
+void fleet_samples_add(fleet_samples_t *s, int64_t us);
+
+/**
+ * @brief Percentiles of the samples (sorts them in place)
+ */
+void fleet_samples_percentiles(fleet_samples_t *s, fleet_percentiles_t *out);
+void fleet_samples_free(fleet_samples_t *s);
+
+/**
+ * @brief Collect service times from the stand-in's observer
+ */
+void fleet_server_attach(fleet_server_t *srv, standin_t *server);
+
+/**
+ * @brief Stop collecting; srv->service stays valid until fleet_samples_free()
+ */
+void fleet_server_detach(fleet_server_t *srv, standin_t *server);
+
+#endif // FLEET_SIM_H
@@ -0,0 +1,1406 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "i2c_standin.h"
+
+// Linux back-end of the HAL. Time is virtual: it only advances through
+// delays and pin polling, so a full cycle (with its 750 ms DS18B20
+// conversions) runs in microseconds of real time and is deterministic.
+
+#define TAG "HAL"
+
+static hal_sim_config_t s_cfg;
+static hal_sim_stats_t s_stats;
+static int64_t s_now_us;
+
+// SNTP: a sync is due every s_sync_interval_us once started
+static bool s_sync_started;
+static int64_t s_sync_interval_us;
+static int64_t s_last_sync_us;
+
+static hal_gpio_mode_t s_mode[HAL_SIM_GPIO_COUNT];
+static int s_level[HAL_SIM_GPIO_COUNT];
+static uint32_t s_noise_state = 1;
+
+static char s_http_host[64] = "";
+static int s_http_port;
+static char s_stream_host[64] = "";
+static int s_stream_port;
+
+// Pulse capture state: the start pulse ends at s_capture_release
+static bool s_capture_armed;
+static int s_capture_pin;
+static int64_t s_capture_release;
+
+// Pulse counters: totals integrated over virtual time up to s_pulses_at
+static uint64_t s_counted_pins;
+static double s_pulses[HAL_SIM_GPIO_COUNT];
+static int64_t s_pulses_at;
+
+static void pulses_advance(void);
+
+// USB port: output waiting for hal_sim_usb_take(), input from hal_sim_usb_send()
+static uint8_t *s_usb_out;
+static size_t s_usb_out_len;
+static uint8_t s_usb_in[256];
+static int64_t s_usb_in_at[256];        // When each byte arrives
+static size_t s_usb_in_len;
+static bool s_usb_open;
+static int s_usb_writes;
+
+// DS18B20 raw-pin model used by the diagnostic tests: a reset pulse
+// (>= 400 µs low) is answered by a presence pulse starting 20 µs after release.
+static int64_t s_ow_low_since = -1;
+static int64_t s_ow_presence_start = -1;
+
+// DS18B20 transaction model used by hal_onewire_*
+typedef enum {
+    OW_IDLE,
+    OW_ROM_CMD,
+    OW_FUNC_CMD,
+    OW_READ_SCRATCHPAD
+} ow_state_t;
+
+static ow_state_t s_ow_state = OW_IDLE;
+static uint8_t s_ow_shift;
+static int s_ow_bits;
+
+// Async events (I2C completions, falling edges) waiting for their time,
+// ordered by at_us; hal_event_wait() moves the clock to the next one
+#define SIM_EVENT_MAX 32
+#define SIM_I2C_QUEUE_DEPTH 8   // Matches the ESP32 back-end's trans_queue_depth
+
+typedef struct {
+    int64_t at_us;
+    hal_event_t evt;
+} sim_event_t;
+
+static sim_event_t s_events[SIM_EVENT_MAX];
+static int s_event_count;
+static uint64_t s_falling_pins;
+static bool s_i2c_ready;
+static int s_i2c_pending;
+
+// Firmware slots: two RAM-backed app slots. A restart boots the slot chosen
+// by hal_ota_end() or hal_ota_rollback(); a freshly written image starts on trial.
+static uint8_t *s_slot[2];
+static size_t s_slot_len[2];
+static int s_running_slot;
+static int s_boot_slot;
+static bool s_boot_trial;
+static bool s_pending_verify;
+static bool s_ota_writing;
+static size_t s_ota_expected;
+
+static bool slot_alloc(int slot) {
+    if (!s_slot[slot]) {
+        s_slot[slot] = malloc(HAL_SIM_OTA_SLOT_SIZE);
+        if (!s_slot[slot]) {
+            return false;
+        }
+        memset(s_slot[slot], 0xFF, HAL_SIM_OTA_SLOT_SIZE);
+    }
+    return true;
+}
+
+static void ota_reset(void) {
+    s_running_slot = 0;
+    s_boot_slot = 0;
+    s_boot_trial = false;
+    s_pending_verify = false;
+    s_ota_writing = false;
+    s_slot_len[0] = s_slot_len[1] = 0;
+}
+
+// Settings store: survives hal_restart(), cleared by hal_sim_reset() like an erased flash
+typedef struct {
+    char key[16];
+    uint8_t *data;
+    size_t len;
+} setting_t;
+
+static setting_t s_settings[HAL_SIM_SETTINGS_MAX];
+
+static void settings_reset(void) {
+    for (int i = 0; i < HAL_SIM_SETTINGS_MAX; i++) {
+        free(s_settings[i].data);
+        memset(&s_settings[i], 0, sizeof(s_settings[i]));
+    }
+}
+
+// ========== SIM CONTROL ==========
+void hal_sim_reset(void) {
+    memset(&s_cfg, 0, sizeof(s_cfg));
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(s_mode, 0, sizeof(s_mode));
+    memset(s_level, 0, sizeof(s_level));
+    s_now_us = 0;
+    s_sync_started = false;
+    s_last_sync_us = -1;
+    s_noise_state = 1;
+    s_capture_armed = false;
+    s_ow_low_since = -1;
+    s_ow_presence_start = -1;
+    s_ow_state = OW_IDLE;
+    ota_reset();
+    settings_reset();
+    s_event_count = 0;
+    s_falling_pins = 0;
+    s_i2c_ready = false;
+    s_i2c_pending = 0;
+    s_counted_pins = 0;
+    memset(s_pulses, 0, sizeof(s_pulses));
+    s_pulses_at = 0;
+    s_usb_out_len = 0;
+    s_usb_in_len = 0;
+    s_usb_open = false;
+    s_usb_writes = 0;
+
+    // External converters: all inputs at 0 mV until a test sets them
+    static const int alert_pins[] = XADC_ALERT_PINS;
+    i2c_standin_reset();
+    for (int n = 0; n < XADC_COUNT; n++) {
+        i2c_standin_add_ads1115(XADC_ADDR_BASE + n, alert_pins[n]);
+    }
+
+    s_cfg.dht_connected = true;
+    s_cfg.air_temp = 26.5f;
+    s_cfg.humidity = 60.0f;
+    s_cfg.ds18b20_connected = true;
+    s_cfg.ds18b20_presence_us = 120;
+    s_cfg.water_temp = 25.5f;
+    s_cfg.adc_mv[PH_ADC_CH] = 2500;          // pH 7.00
+    s_cfg.adc_mv[TURBIDITY_ADC_CH] = 20;     // 10 NTU
+    s_cfg.adc_mv[DO_ADC_CH] = 4095;          // not connected (floating)
+    s_cfg.adc_mv[AMMONIA_ADC_CH] = 4095;     // not connected (floating)
+    // Healthy meters: each flows at its rated rate while its output is on
+    for (int pin = 0; pin < HAL_SIM_GPIO_COUNT; pin++) {
+        s_cfg.pulse_gate[pin] = -1;
+    }
+    s_cfg.pulse_hz[PUMP_FLOW_PIN] = 3.0f * PUMP_PULSES_PER_LITRE / 60;         // 3 L/min
+    s_cfg.pulse_gate[PUMP_FLOW_PIN] = PUMP_PIN;
+    s_cfg.pulse_hz[FILTER_FLOW_PIN] = 8.0f * FILTER_PULSES_PER_LITRE / 60;     // 8 L/min
+    s_cfg.pulse_gate[FILTER_FLOW_PIN] = FILTER_PIN;
+    s_cfg.pulse_hz[AERATOR_FLOW_PIN] = 20.0f * AERATOR_PULSES_PER_LITRE / 60;  // 20 L/min of air
+    s_cfg.pulse_gate[AERATOR_FLOW_PIN] = AERATOR_PIN;
+    s_cfg.link_up = true;
+    s_cfg.sntp_reachable = true;
+    s_cfg.wall_epoch_us = 1760000000LL * 1000000;   // 2025-10-09 08:53:20 UTC
+}
+
+hal_sim_config_t *hal_sim_config(void) {
+    return &s_cfg;
+}
+
+const hal_sim_stats_t *hal_sim_stats(void) {
+    return &s_stats;
+}
+
+void hal_sim_set_http_endpoint(const char *host, int port) {
+    snprintf(s_http_host, sizeof(s_http_host), "%s", host);
+    s_http_port = port;
+}
+
+void hal_sim_set_stream_endpoint(const char *host, int port) {
+    snprintf(s_stream_host, sizeof(s_stream_host), "%s", host);
+    s_stream_port = port;
+}
+
+int hal_sim_output_level(int pin) {
+    return (pin >= 0 && pin < HAL_SIM_GPIO_COUNT) ? s_level[pin] : 0;
+}
+
+// ========== CLOCK ==========
+int64_t hal_time_us(void) {
+    return s_now_us++;
+}
+
+void hal_delay_ms(uint32_t ms) {
+    s_now_us += (int64_t)ms * 1000;
+}
+
+void hal_delay_us(uint32_t us) {
+    s_now_us += us;
+}
+
+esp_err_t hal_time_sync_start(const char *server, uint32_t interval_s) {
+    s_sync_started = true;
+    s_sync_interval_us = (int64_t)interval_s * 1000000;
+    return ESP_OK;
+}
+
+bool hal_time_sync_poll(int64_t *unix_us, int64_t *mono_us) {
+    if (!s_sync_started || !s_cfg.sntp_reachable || !s_cfg.link_up ||
+        (s_last_sync_us >= 0 && s_now_us - s_last_sync_us < s_sync_interval_us)) {
+        return false;
+    }
+    s_last_sync_us = s_now_us;
+    *mono_us = s_now_us;
+    *unix_us = s_cfg.wall_epoch_us + s_now_us -
+               llround((double)s_now_us * s_cfg.clock_drift_ppm / (1e6 + s_cfg.clock_drift_ppm));
+    s_stats.time_syncs++;
+    return true;
+}
+
+void hal_watchdog_feed(void) {
+    s_stats.watchdog_feeds++;
+}
+
+// ========== DHT22 WAVEFORM ==========
+// After the host releases the line the sensor answers with 80 µs low, 80 µs
+// high, then 40 bits of 50 µs low + 27 µs (0) or 70 µs (1) high, and a final
+// 50 µs low. Returns the pulse count; the frame starts 20 µs after release.
+#define DHT_FRAME_PULSES 83
+
+static size_t dht_frame(uint16_t *durations) {
+    uint16_t hum = (uint16_t)lroundf(s_cfg.humidity * 10.0f);
+    uint16_t temp = (uint16_t)lroundf(s_cfg.air_temp * 10.0f);
+    uint8_t data[5] = { hum >> 8, hum & 0xFF, temp >> 8, temp & 0xFF, 0 };
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+    if (s_cfg.dht_corrupt_checksum) {
+        data[4] ^= 0x01;
+    }
+
+    size_t n = 0;
+    durations[n++] = 80;
+    durations[n++] = 80;
+    for (int i = 0; i < 40; i++) {
+        int bit = (data[i / 8] >> (7 - (i % 8))) & 1;
+        durations[n++] = 50;
+        durations[n++] = bit ? 70 : 27;
+    }
+    durations[n++] = 50;
+    return n;
+}
+
+// ========== DS18B20 MODEL ==========
+// Scratchpad starts at the power-on value (85 °C) until a CONVERT T.
+static uint8_t s_scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+
+static void ds18b20_convert(void) {
+    int16_t raw = (int16_t)lroundf(s_cfg.water_temp * 16.0f);
+    s_scratchpad[0] = raw & 0xFF;
+    s_scratchpad[1] = (raw >> 8) & 0xFF;
+    s_scratchpad[8] = aqua_crc8(s_scratchpad, 8);
+    if (s_cfg.ds18b20_corrupt_crc) {
+        s_scratchpad[8] ^= 0x5A;
+    }
+}
+
+static void ds18b20_byte_received(uint8_t byte) {
+    if (s_ow_state == OW_ROM_CMD) {
+        s_ow_state = (byte == 0xCC) ? OW_FUNC_CMD : OW_IDLE;
+    } else if (s_ow_state == OW_FUNC_CMD) {
+        if (byte == 0x44) {
+            ds18b20_convert();
+            s_ow_state = OW_IDLE;
+        } else if (byte == 0xBE) {
+            s_ow_state = OW_READ_SCRATCHPAD;
+        } else {
+            s_ow_state = OW_IDLE;
+        }
+    }
+    s_ow_bits = 0;
+    s_ow_shift = 0;
+}
+
+// ========== GPIO ==========
+void hal_gpio_reset(int pin) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) return;
+    s_mode[pin] = HAL_GPIO_INPUT;
+    s_level[pin] = 0;
+}
+
+static void pin_released(int pin) {
+    if (pin == WATER_TEMP_PIN && s_ow_low_since >= 0) {
+        if (s_cfg.ds18b20_connected && s_now_us - s_ow_low_since >= 400) {
+            s_ow_presence_start = s_now_us + 20;
+        }
+        s_ow_low_since = -1;
+    }
+}
+
+void hal_gpio_set_direction(int pin, hal_gpio_mode_t mode) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) return;
+    if (mode == HAL_GPIO_INPUT && s_mode[pin] == HAL_GPIO_OUTPUT) {
+        pin_released(pin);
+    }
+    s_mode[pin] = mode;
+}
+
+void hal_gpio_pullup(int pin) {
+    (void)pin;
+}
+
+void hal_gpio_set_level(int pin, int level) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) return;
+    pulses_advance();       // Meters gated by this output count up to now at the old level
+    if (s_mode[pin] == HAL_GPIO_OUTPUT) {
+        if (level == 0) {
+            if (pin == WATER_TEMP_PIN) s_ow_low_since = s_now_us;
+        } else if (pin == WATER_TEMP_PIN) {
+            pin_released(pin);
+        }
+    }
+    s_level[pin] = level ? 1 : 0;
+}
+
+int hal_gpio_get_level(int pin) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) return 0;
+    s_now_us++;
+    if (s_mode[pin] == HAL_GPIO_OUTPUT) {
+        return s_level[pin];
+    }
+    if (pin == WATER_TEMP_PIN) {
+        if (s_ow_presence_start >= 0 && s_now_us >= s_ow_presence_start &&
+            s_now_us < s_ow_presence_start + s_cfg.ds18b20_presence_us) {
+            return 0;
+        }
+        return 1;   // Pull-up
+    }
+    return s_level[pin];
+}
+
+// ========== ADC ==========
+esp_err_t hal_adc_init(void) {
+    return ESP_OK;
+}
+
+// Light from other sources at t_us on the virtual clock
+static int ambient_mv(int channel, int64_t t_us) {
+    int mv = s_cfg.adc_ambient_mv[channel];
+    if (s_cfg.adc_flicker_mv[channel] != 0) {
+        mv += (int)lround(s_cfg.adc_flicker_mv[channel] * sin(2.0 * M_PI * s_cfg.flicker_hz * (double)t_us / 1e6));
+    }
+    return mv;
+}
+
+// One conversion at t_us; lit: the probe's own signal is present
+static int adc_sample_at(int channel, bool lit, int64_t t_us) {
+    int value = (lit ? s_cfg.adc_mv[channel] : 0) + ambient_mv(channel, t_us);
+    if (s_cfg.adc_noise_mv > 0) {
+        s_noise_state = s_noise_state * 1103515245u + 12345u;
+        value += (int)((s_noise_state >> 16) % (2 * s_cfg.adc_noise_mv + 1)) - s_cfg.adc_noise_mv;
+    }
+    if (value < 0) value = 0;
+    if (value > 4095) value = 4095;
+    return value;
+}
+
+static int adc_sample(int channel) {
+    return adc_sample_at(channel, true, s_now_us);
+}
+
+esp_err_t hal_adc_read_mv(int channel, int *mv) {
+    if (channel < 0 || channel >= HAL_SIM_ADC_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *mv = adc_sample(channel);
+    s_now_us += 20;
+    return ESP_OK;
+}
+
+esp_err_t hal_adc_read_burst(int channel, uint32_t rate_hz, int16_t *samples, size_t count) {
+    if (channel < 0 || channel >= HAL_SIM_ADC_CHANNELS || rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = (int16_t)adc_sample(channel);
+    }
+    s_now_us += (int64_t)count * 1000000 / rate_hz;
+    s_stats.adc_bursts++;
+    return ESP_OK;
+}
+
+esp_err_t hal_adc_read_modulated(int channel, int emitter_pin, uint32_t rate_hz, uint32_t half_period,
+                                 size_t count, int16_t *block, size_t block_len,
+                                 hal_adc_block_cb_t cb, void *ctx) {
+    if (channel < 0 || channel >= HAL_SIM_ADC_CHANNELS || emitter_pin < 0 ||
+        emitter_pin >= HAL_SIM_GPIO_COUNT || rate_hz == 0 || half_period == 0 || half_period % 2 != 0 ||
+        block_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t start = s_now_us;
+    size_t fill = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool on = hal_emitter_on(i, half_period);
+        if (on != s_level[emitter_pin]) {
+            s_level[emitter_pin] = on;
+            s_stats.emitter_edges++;
+        }
+        int64_t t = start + (int64_t)i * 1000000 / rate_hz;
+        block[fill++] = (int16_t)adc_sample_at(channel, on, t);
+        if (fill == block_len) {
+            cb(block, fill, ctx);
+            fill = 0;
+        }
+    }
+    if (s_level[emitter_pin]) {
+        s_level[emitter_pin] = 0;
+        s_stats.emitter_edges++;
+    }
+    s_now_us += (int64_t)count * 1000000 / rate_hz;
+    if (fill > 0) {
+        cb(block, fill, ctx);
+    }
+    s_stats.adc_modulated_reads++;
+    return ESP_OK;
+}
+
+// Scan n is due n + 1 periods after the call, as the first timer tick is.
+// Time cb spent (USB writes) is on the virtual clock, so overruns skip scans
+// exactly as the timer-paced firmware does.
+esp_err_t hal_adc_scan(const int *channels, size_t nch, uint32_t period_us, int16_t *block, size_t block_len,
+                       hal_adc_scan_cb_t cb, void *ctx) {
+    if (nch == 0 || period_us == 0 || block_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t c = 0; c < nch; c++) {
+        if (channels[c] < 0 || channels[c] >= HAL_SIM_ADC_CHANNELS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    s_stats.adc_scans++;
+    int64_t start = s_now_us;
+    uint32_t scan = 0;
+    uint32_t first = 0;
+    size_t fill = 0;
+    for (;;) {
+        // The latest scan due by now; anything before it and not taken is gone
+        uint32_t latest = (uint32_t)((s_now_us - start) / period_us);
+        if (latest > 0 && latest - 1 > scan) {
+            s_stats.adc_scans_skipped += (int)(latest - 1 - scan);
+            scan = latest - 1;
+            if (fill > 0) {
+                bool more = cb(block, fill, first, start + (int64_t)(first + 1) * period_us, ctx);
+                fill = 0;
+                if (!more) {
+                    return ESP_OK;
+                }
+                continue;
+            }
+        }
+        int64_t due = start + (int64_t)(scan + 1) * period_us;
+        if (s_now_us < due) {
+            s_now_us = due;
+        }
+        if (fill == 0) {
+            first = scan;
+        }
+        for (size_t c = 0; c < nch; c++) {
+            block[fill * nch + c] = (int16_t)adc_sample_at(channels[c], true, due);
+        }
+        scan++;
+        if (++fill == block_len) {
+            fill = 0;
+            if (!cb(block, block_len, first, start + (int64_t)(first + 1) * period_us, ctx)) {
+                return ESP_OK;
+            }
+        }
+    }
+}
+
+// ========== 1-WIRE ==========
+bool hal_onewire_reset(int pin) {
+    s_now_us += 960;
+    if (pin != WATER_TEMP_PIN || !s_cfg.ds18b20_connected) {
+        return false;
+    }
+    s_stats.onewire_resets++;
+    s_ow_state = OW_ROM_CMD;
+    s_ow_bits = 0;
+    s_ow_shift = 0;
+    return true;
+}
+
+bool hal_onewire_reset_timed(int pin, int *presence_us) {
+    bool present = hal_onewire_reset(pin);
+    *presence_us = present ? s_cfg.ds18b20_presence_us : 0;
+    return present;
+}
+
+void hal_onewire_write_bit(int pin, int bit) {
+    s_now_us += 65;
+    if (pin != WATER_TEMP_PIN || !s_cfg.ds18b20_connected) {
+        return;
+    }
+    if (s_ow_state == OW_ROM_CMD || s_ow_state == OW_FUNC_CMD) {
+        s_ow_shift |= (bit ? 1 : 0) << s_ow_bits;
+        if (++s_ow_bits == 8) {
+            ds18b20_byte_received(s_ow_shift);
+        }
+    }
+}
+
+int hal_onewire_read_bit(int pin) {
+    s_now_us += 66;
+    if (pin != WATER_TEMP_PIN || !s_cfg.ds18b20_connected) {
+        return 1;
+    }
+    if (s_ow_state != OW_READ_SCRATCHPAD || s_ow_bits >= 72) {
+        return 1;
+    }
+    int bit = (s_scratchpad[s_ow_bits / 8] >> (s_ow_bits % 8)) & 1;
+    s_ow_bits++;
+    return bit;
+}
+
+// ========== PULSE CAPTURE ==========
+esp_err_t hal_pulse_capture_start(int pin, uint32_t start_low_us) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_capture_armed = true;
+    s_capture_pin = pin;
+    s_capture_release = s_now_us + start_low_us;
+    s_stats.pulse_captures++;
+    return ESP_OK;
+}
+
+esp_err_t hal_pulse_capture_wait(uint16_t *durations, size_t max, size_t *count, uint32_t timeout_ms) {
+    *count = 0;
+    if (!s_capture_armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_capture_armed = false;
+
+    // Sleeps until the line has idled after the frame (or the timeout)
+    int64_t done_at;
+    if (s_capture_pin != DHT_PIN || !s_cfg.dht_connected) {
+        done_at = s_now_us + (int64_t)timeout_ms * 1000;
+        if (s_now_us < done_at) s_now_us = done_at;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint16_t frame[DHT_FRAME_PULSES];
+    size_t n = dht_frame(frame);
+    if (s_cfg.dht_capture_pulses > 0 && (size_t)s_cfg.dht_capture_pulses < n) {
+        n = (size_t)s_cfg.dht_capture_pulses;
+    }
+    done_at = s_capture_release + 20 + 200;
+    for (size_t i = 0; i < n; i++) {
+        done_at += frame[i];
+        if (*count < max) durations[(*count)++] = frame[i];
+    }
+    if (s_now_us < done_at) s_now_us = done_at;
+    return ESP_OK;
+}
+
+// ========== PULSE COUNTERS ==========
+static void pulses_advance(void) {
+    double elapsed_s = (double)(s_now_us - s_pulses_at) / 1e6;
+    s_pulses_at = s_now_us;
+    for (int pin = 0; pin < HAL_SIM_GPIO_COUNT; pin++) {
+        if (!(s_counted_pins & (1ULL << pin))) continue;
+        int gate = s_cfg.pulse_gate[pin];
+        if (gate < 0 || (gate < HAL_SIM_GPIO_COUNT && s_level[gate])) {
+            s_pulses[pin] += s_cfg.pulse_hz[pin] * elapsed_s;
+        }
+    }
+}
+
+esp_err_t hal_pulse_count_start(int pin) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(s_counted_pins & (1ULL << pin))) {
+        pulses_advance();
+        s_counted_pins |= 1ULL << pin;
+        s_pulses[pin] = 0;
+        s_mode[pin] = HAL_GPIO_INPUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_pulse_count_read(int pin, uint32_t *count) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT || !(s_counted_pins & (1ULL << pin))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pulses_advance();
+    *count = (uint32_t)(uint64_t)s_pulses[pin];
+    s_stats.pulse_count_reads++;
+    return ESP_OK;
+}
+
+// ========== ASYNC EVENTS ==========
+static void event_push(int64_t at_us, const hal_event_t *evt) {
+    if (s_event_count == SIM_EVENT_MAX) {
+        ESP_LOGE(TAG, "Event queue full, dropping event %d", evt->type);
+        return;
+    }
+    int i = s_event_count++;
+    while (i > 0 && s_events[i - 1].at_us > at_us) {    // Equal times keep their order
+        s_events[i] = s_events[i - 1];
+        i--;
+    }
+    s_events[i].at_us = at_us;
+    s_events[i].evt = *evt;
+}
+
+esp_err_t hal_event_wait(hal_event_t *evt, uint32_t timeout_ms) {
+    int64_t deadline = s_now_us + (int64_t)timeout_ms * 1000;
+    if (s_event_count == 0 || s_events[0].at_us > deadline) {
+        s_now_us = deadline;
+        return ESP_ERR_TIMEOUT;
+    }
+    if (s_events[0].at_us > s_now_us) {
+        s_now_us = s_events[0].at_us;
+    }
+    *evt = s_events[0].evt;
+    s_event_count--;
+    memmove(&s_events[0], &s_events[1], (size_t)s_event_count * sizeof(s_events[0]));
+    if (evt->type == HAL_EVENT_I2C_DONE) {
+        s_i2c_pending--;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_gpio_falling_enable(int pin) {
+    if (pin < 0 || pin >= HAL_SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_mode[pin] = HAL_GPIO_INPUT;
+    s_falling_pins |= 1ULL << pin;
+    return ESP_OK;
+}
+
+// ========== I2C ==========
+esp_err_t hal_i2c_init(int sda_pin, int scl_pin, uint32_t freq_hz) {
+    if (!s_i2c_ready) {
+        i2c_standin_set_freq(freq_hz);
+        s_i2c_ready = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_i2c_submit(uint8_t addr, const uint8_t *wbuf, size_t wlen,
+                         uint8_t *rbuf, size_t rlen, void *tag) {
+    if (!s_i2c_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_i2c_pending == SIM_I2C_QUEUE_DEPTH) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    i2c_standin_result_t res;
+    i2c_standin_transfer(s_now_us, addr, wbuf, wlen, rbuf, rlen, &res);
+    hal_event_t done = { .type = HAL_EVENT_I2C_DONE, .err = res.ack ? ESP_OK : ESP_FAIL, .tag = tag };
+    event_push(res.done_us, &done);
+    s_i2c_pending++;
+    if (res.alert_pin >= 0 && (s_falling_pins & (1ULL << res.alert_pin))) {
+        hal_event_t edge = { .type = HAL_EVENT_GPIO_FALLING, .pin = res.alert_pin };
+        event_push(res.alert_us, &edge);
+    }
+    return ESP_OK;
+}
+
+// ========== HTTP TRANSPORT ==========
+bool hal_net_ensure_connected(void) {
+    if (!s_cfg.link_up) {
+        ESP_LOGE(TAG, "WiFi connection failed after 3 attempts");
+    }
+    return s_cfg.link_up;
+}
+
+static const char *url_path(const char *url) {
+    const char *p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    p = strchr(p, '/');
+    return p ? p : "/";
+}
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Connects to the configured endpoint; returns the socket or -1
+static int http_connect(int timeout_ms) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)s_http_port)
+    };
+    if (inet_pton(AF_INET, s_http_host, &addr.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+esp_err_t hal_http_perform(const hal_http_request_t *req, hal_http_response_t *resp) {
+    resp->status = 0;
+    resp->body_len = 0;
+    if (resp->body && resp->body_size > 0) {
+        resp->body[0] = '\0';
+    }
+
+    s_stats.http_requests++;
+    if (s_http_port == 0 || !s_cfg.link_up) {
+        s_stats.http_failures++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int fd = http_connect(req->timeout_ms);
+    if (fd < 0) {
+        s_stats.http_failures++;
+        return ESP_FAIL;
+    }
+
+    size_t body_len = req->body ? req->body_len : 0;
+    char head[2048];
+    int n = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n",
+                     req->method == HAL_HTTP_POST ? "POST" : "GET", url_path(req->url), s_http_host);
+    for (size_t i = 0; i < req->header_count && n < (int)sizeof(head); i++) {
+        n += snprintf(head + n, sizeof(head) - n, "%s: %s\r\n",
+                      req->headers[i].name, req->headers[i].value);
+    }
+    if (n < (int)sizeof(head)) {
+        n += snprintf(head + n, sizeof(head) - n, "Content-Length: %zu\r\n\r\n", body_len);
+    }
+    if (n >= (int)sizeof(head)) {
+        close(fd);
+        s_stats.http_failures++;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (!send_all(fd, head, (size_t)n) || (body_len > 0 && !send_all(fd, req->body, body_len))) {
+        close(fd);
+        s_stats.http_failures++;
+        return ESP_FAIL;
+    }
+
+    // Read the whole response (the stand-in closes the connection)
+    char raw[8192];
+    size_t raw_len = 0;
+    for (;;) {
+        ssize_t r = recv(fd, raw + raw_len, sizeof(raw) - 1 - raw_len, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        raw_len += (size_t)r;
+        if (raw_len == sizeof(raw) - 1) break;
+    }
+    close(fd);
+    raw[raw_len] = '\0';
+
+    int status = 0;
+    if (sscanf(raw, "HTTP/1.%*d %d", &status) != 1) {
+        s_stats.http_failures++;
+        return raw_len == 0 ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    }
+    resp->status = status;
+
+    const char *body = strstr(raw, "\r\n\r\n");
+    if (body && resp->body && resp->body_size > 1) {
+        body += 4;
+        size_t len = raw_len - (size_t)(body - raw);
+        if (len > resp->body_size - 1) {
+            len = resp->body_size - 1;
+        }
+        memcpy(resp->body, body, len);
+        resp->body[len] = '\0';
+        resp->body_len = (int)len;
+    }
+    return ESP_OK;
+}
+
+struct hal_http_download {
+    int fd;
+    char head[2048];            // Response headers, then any body bytes read with them
+    size_t pending;             // Body bytes left in head
+    size_t pending_pos;
+};
+
+hal_http_download_t *hal_http_download_open(const char *url, hal_tls_mode_t tls, int timeout_ms,
+                                            int *status, int *content_length) {
+    (void)tls;
+    s_stats.http_requests++;
+    if (s_http_port == 0 || !s_cfg.link_up) {
+        s_stats.http_failures++;
+        return NULL;
+    }
+
+    hal_http_download_t *dl = calloc(1, sizeof(*dl));
+    if (!dl) {
+        return NULL;
+    }
+    dl->fd = http_connect(timeout_ms);
+    int n = snprintf(dl->head, sizeof(dl->head), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                     url_path(url), s_http_host);
+    if (dl->fd < 0 || !send_all(dl->fd, dl->head, (size_t)n)) {
+        hal_http_download_close(dl);
+        s_stats.http_failures++;
+        return NULL;
+    }
+
+    size_t len = 0;
+    char *end = NULL;
+    while (!end && len < sizeof(dl->head) - 1) {
+        ssize_t r = recv(dl->fd, dl->head + len, sizeof(dl->head) - 1 - len, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        len += (size_t)r;
+        dl->head[len] = '\0';
+        end = strstr(dl->head, "\r\n\r\n");
+    }
+    if (!end || sscanf(dl->head, "HTTP/1.%*d %d", status) != 1) {
+        hal_http_download_close(dl);
+        s_stats.http_failures++;
+        return NULL;
+    }
+
+    *content_length = -1;
+    for (char *h = strstr(dl->head, "\r\n"); h && h < end; h = strstr(h + 2, "\r\n")) {
+        if (strncasecmp(h + 2, "Content-Length:", 15) == 0) {
+            *content_length = atoi(h + 2 + 15);
+        }
+    }
+    dl->pending_pos = (size_t)(end + 4 - dl->head);
+    dl->pending = len - dl->pending_pos;
+    return dl;
+}
+
+int hal_http_download_read(hal_http_download_t *dl, void *buf, size_t size) {
+    if (!s_cfg.link_up) {
+        return -1;
+    }
+    if (dl->pending > 0) {
+        size_t n = dl->pending < size ? dl->pending : size;
+        memcpy(buf, dl->head + dl->pending_pos, n);
+        dl->pending -= n;
+        dl->pending_pos += n;
+        s_stats.http_download_bytes += n;
+        return (int)n;
+    }
+    for (;;) {
+        ssize_t r = recv(dl->fd, buf, size, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r > 0) s_stats.http_download_bytes += (size_t)r;
+        return r < 0 ? -1 : (int)r;
+    }
+}
+
+void hal_http_download_close(hal_http_download_t *dl) {
+    if (!dl) {
+        return;
+    }
+    if (dl->fd >= 0) {
+        close(dl->fd);
+    }
+    free(dl);
+}
+
+// ========== STREAM TRANSPORT ==========
+// Plain TCP regardless of the TLS mode. Real time spent waiting for data is
+// added to the virtual clock so protocol timeouts and keepalives still fire.
+// Accepted (server) streams are served from other threads and leave the
+// clock and the simulated link alone.
+struct hal_stream {
+    int fd;
+    bool accepted;
+    bool usb;                       // The simulated USB port, no socket
+};
+
+static int64_t real_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+hal_stream_t *hal_stream_open(const char *host, int port, hal_tls_mode_t tls, int timeout_ms) {
+    (void)tls;
+    (void)timeout_ms;
+    if (!s_cfg.link_up) {
+        return NULL;
+    }
+    if (s_stream_port != 0) {
+        host = s_stream_host;
+        port = s_stream_port;
+    }
+
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0 || !res) {
+        return NULL;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        if (fd >= 0) close(fd);
+        freeaddrinfo(res);
+        return NULL;
+    }
+    freeaddrinfo(res);
+    // Small request/acknowledge exchanges: do not let Nagle hold them back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    hal_stream_t *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->accepted = false;
+    stream->usb = false;
+    s_stats.stream_connects++;
+    return stream;
+}
+
+// Writes cost their transfer time at usb_bytes_per_s; a dropped one, or one
+// that would overflow what the test has not taken, costs the timeout
+static int usb_write(const void *data, size_t len, int timeout_ms) {
+    s_usb_writes++;
+    if ((s_cfg.usb_drop_every > 0 && s_usb_writes % s_cfg.usb_drop_every == 0) ||
+        len > HAL_SIM_USB_BUFFER - s_usb_out_len) {
+        s_now_us += (int64_t)timeout_ms * 1000;
+        s_stats.usb_write_failures++;
+        return -1;
+    }
+    if (!s_usb_out) {
+        s_usb_out = malloc(HAL_SIM_USB_BUFFER);
+        if (!s_usb_out) {
+            return -1;
+        }
+    }
+    memcpy(s_usb_out + s_usb_out_len, data, len);
+    s_usb_out_len += len;
+    s_stats.usb_bytes += len;
+    if (s_cfg.usb_bytes_per_s > 0) {
+        s_now_us += (int64_t)len * 1000000 / s_cfg.usb_bytes_per_s;
+    }
+    return (int)len;
+}
+
+static int usb_read(void *buf, size_t size, int timeout_ms) {
+    int64_t deadline = s_now_us + (int64_t)timeout_ms * 1000;
+    if (s_usb_in_len == 0 || s_usb_in_at[0] > deadline) {
+        s_now_us = deadline;
+        return 0;
+    }
+    if (s_usb_in_at[0] > s_now_us) {
+        s_now_us = s_usb_in_at[0];
+    }
+    size_t n = 0;
+    while (n < size && n < s_usb_in_len && s_usb_in_at[n] <= s_now_us) {
+        n++;
+    }
+    memcpy(buf, s_usb_in, n);
+    memmove(s_usb_in, s_usb_in + n, s_usb_in_len - n);
+    memmove(s_usb_in_at, s_usb_in_at + n, (s_usb_in_len - n) * sizeof(s_usb_in_at[0]));
+    s_usb_in_len -= n;
+    return (int)n;
+}
+
+int hal_stream_write(hal_stream_t *stream, const void *data, size_t len, int timeout_ms) {
+    if (stream->usb) {
+        return usb_write(data, len, timeout_ms);
+    }
+    if (!stream->accepted && !s_cfg.link_up) {
+        return -1;
+    }
+    return send_all(stream->fd, data, len) ? (int)len : -1;
+}
+
+int hal_stream_read(hal_stream_t *stream, void *buf, size_t size, int timeout_ms) {
+    if (stream->usb) {
+        return usb_read(buf, size, timeout_ms);
+    }
+    if (!stream->accepted && !s_cfg.link_up) {
+        return -1;
+    }
+
+    struct pollfd pfd = { .fd = stream->fd, .events = POLLIN };
+    int64_t start = real_now_us();
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (!stream->accepted) {
+        s_now_us += real_now_us() - start;
+    }
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (ready == 0) {
+        return 0;
+    }
+
+    ssize_t n = recv(stream->fd, buf, size, 0);
+    if (n < 0 && errno == EINTR) {
+        return 0;
+    }
+    return n > 0 ? (int)n : -1;
+}
+
+void hal_stream_close(hal_stream_t *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->usb) {
+        s_usb_open = false;
+    } else {
+        close(stream->fd);
+    }
+    free(stream);
+}
+
+// Goes to the configured HTTP endpoint like hal_http_perform(), whatever the URL
+hal_stream_t *hal_http_stream_open(const char *url, hal_tls_mode_t tls, int timeout_ms) {
+    (void)url;
+    (void)tls;
+    s_stats.http_requests++;
+    if (s_http_port == 0 || !s_cfg.link_up) {
+        s_stats.http_failures++;
+        return NULL;
+    }
+
+    int fd = http_connect(timeout_ms);
+    if (fd < 0) {
+        s_stats.http_failures++;
+        return NULL;
+    }
+    // The receive timeout is poll()ed by hal_stream_read(); keep recv() blocking
+    struct timeval tv = { 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    hal_stream_t *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->accepted = false;
+    stream->usb = false;
+    s_stats.stream_connects++;
+    return stream;
+}
+
+hal_stream_t *hal_usb_cdc_open(void) {
+    if (s_usb_open) {
+        return NULL;
+    }
+    hal_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->fd = -1;
+    stream->usb = true;
+    s_usb_open = true;
+    return stream;
+}
+
+size_t hal_sim_usb_take(void *buf, size_t size) {
+    size_t n = size < s_usb_out_len ? size : s_usb_out_len;
+    if (n == 0) {
+        return 0;
+    }
+    memcpy(buf, s_usb_out, n);
+    memmove(s_usb_out, s_usb_out + n, s_usb_out_len - n);
+    s_usb_out_len -= n;
+    return n;
+}
+
+void hal_sim_usb_send_at(int64_t at_us, const void *data, size_t len) {
+    if (len > sizeof(s_usb_in) - s_usb_in_len) {
+        len = sizeof(s_usb_in) - s_usb_in_len;
+    }
+    memcpy(s_usb_in + s_usb_in_len, data, len);
+    for (size_t i = 0; i < len; i++) {
+        s_usb_in_at[s_usb_in_len++] = at_us;
+    }
+}
+
+void hal_sim_usb_send(const void *data, size_t len) {
+    hal_sim_usb_send_at(s_now_us, data, len);
+}
+
+// ========== STREAM SERVER ==========
+struct hal_listener {
+    int fd;
+    int port;
+};
+
+hal_listener_t *hal_listener_open(int port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port),
+                                .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    hal_listener_t *listener = malloc(sizeof(*listener));
+    if (!listener) {
+        close(fd);
+        return NULL;
+    }
+    listener->fd = fd;
+    listener->port = ntohs(addr.sin_port);
+    return listener;
+}
+
+int hal_listener_port(const hal_listener_t *listener) {
+    return listener->port;
+}
+
+hal_stream_t *hal_listener_accept(hal_listener_t *listener, int timeout_ms) {
+    struct pollfd pfd = { .fd = listener->fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return NULL;
+    }
+    int fd = accept(listener->fd, NULL, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    hal_stream_t *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->accepted = true;
+    stream->usb = false;
+    return stream;
+}
+
+void hal_listener_close(hal_listener_t *listener) {
+    if (!listener) {
+        return;
+    }
+    close(listener->fd);
+    free(listener);
+}
+
+// ========== TASKS ==========
+// A detached thread per task
+typedef struct {
+    hal_task_fn_t fn;
+    void *arg;
+} task_start_t;
+
+static void *task_thread(void *p) {
+    task_start_t start = *(task_start_t *)p;
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+esp_err_t hal_task_start(const char *name, hal_task_fn_t fn, void *arg, uint32_t stack_bytes, int priority) {
+    (void)name;
+    (void)stack_bytes;
+    (void)priority;
+    task_start_t *start = malloc(sizeof(*start));
+    if (!start) {
+        return ESP_ERR_NO_MEM;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_thread, start) != 0) {
+        free(start);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+// ========== FIRMWARE SLOTS ==========
+void hal_sim_ota_flash(const void *image, size_t len) {
+    ota_reset();
+    if (len > HAL_SIM_OTA_SLOT_SIZE || !slot_alloc(0)) {
+        return;
+    }
+    memset(s_slot[0], 0xFF, HAL_SIM_OTA_SLOT_SIZE);
+    memcpy(s_slot[0], image, len);
+    s_slot_len[0] = len;
+}
+
+const uint8_t *hal_sim_ota_slot(int slot, size_t *len) {
+    *len = s_slot_len[slot & 1];
+    return s_slot[slot & 1];
+}
+
+int hal_sim_ota_running_slot(void) {
+    return s_running_slot;
+}
+
+esp_err_t hal_ota_begin(size_t image_size) {
+    int target = 1 - s_running_slot;
+    if (image_size > HAL_SIM_OTA_SLOT_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!slot_alloc(target)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_slot[target], 0xFF, HAL_SIM_OTA_SLOT_SIZE);
+    s_slot_len[target] = 0;
+    s_ota_expected = image_size;
+    s_ota_writing = true;
+    return ESP_OK;
+}
+
+esp_err_t hal_ota_write(const void *data, size_t len) {
+    int target = 1 - s_running_slot;
+    if (!s_ota_writing || s_slot_len[target] + len > HAL_SIM_OTA_SLOT_SIZE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memcpy(s_slot[target] + s_slot_len[target], data, len);
+    s_slot_len[target] += len;
+    return ESP_OK;
+}
+
+esp_err_t hal_ota_end(void) {
+    int target = 1 - s_running_slot;
+    if (!s_ota_writing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ota_writing = false;
+    // Stands in for esp_ota_end()'s image validation
+    if (s_slot_len[target] == 0 || (s_ota_expected && s_slot_len[target] != s_ota_expected)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_boot_slot = target;
+    s_boot_trial = true;
+    return ESP_OK;
+}
+
+void hal_ota_abort(void) {
+    s_ota_writing = false;
+}
+
+esp_err_t hal_ota_read_running(size_t offset, void *buf, size_t len) {
+    if (offset + len > HAL_SIM_OTA_SLOT_SIZE || !slot_alloc(s_running_slot)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(buf, s_slot[s_running_slot] + offset, len);
+    return ESP_OK;
+}
+
+size_t hal_ota_slot_size(void) {
+    return HAL_SIM_OTA_SLOT_SIZE;
+}
+
+bool hal_ota_pending_verify(void) {
+    return s_pending_verify;
+}
+
+void hal_ota_mark_valid(void) {
+    s_pending_verify = false;
+}
+
+void hal_ota_rollback(void) {
+    s_stats.rollbacks++;
+    s_boot_slot = 1 - s_running_slot;
+    s_boot_trial = false;
+    hal_restart();
+}
+
+void hal_restart(void) {
+    s_stats.restarts++;
+    if (s_boot_slot != s_running_slot) {
+        s_running_slot = s_boot_slot;
+        s_pending_verify = s_boot_trial;
+    }
+    s_boot_trial = false;
+}
+
+// ========== SETTINGS STORE ==========
+static setting_t *find_setting(const char *key) {
+    for (int i = 0; i < HAL_SIM_SETTINGS_MAX; i++) {
+        if (s_settings[i].key[0] && strcmp(s_settings[i].key, key) == 0) {
+            return &s_settings[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t hal_settings_get(const char *key, void *buf, size_t *len) {
+    setting_t *st = find_setting(key);
+    if (!st) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (*len < st->len) {
+        *len = st->len;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf, st->data, st->len);
+    *len = st->len;
+    return ESP_OK;
+}
+
+esp_err_t hal_settings_set(const char *key, const void *data, size_t len) {
+    if (strlen(key) >= sizeof(s_settings[0].key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_cfg.settings_write_fail) {
+        return ESP_FAIL;
+    }
+    setting_t *st = find_setting(key);
+    for (int i = 0; !st && i < HAL_SIM_SETTINGS_MAX; i++) {
+        if (!s_settings[i].key[0]) {
+            st = &s_settings[i];
+        }
+    }
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!st || !copy) {
+        free(copy);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, data, len);
+    free(st->data);
+    snprintf(st->key, sizeof(st->key), "%s", key);
+    st->data = copy;
+    st->len = len;
+    s_stats.settings_writes++;
+    return ESP_OK;
+}
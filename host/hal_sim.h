@@ -0,0 +1,141 @@
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Control surface of the Linux HAL back-end (hal_linux.c). Tests, the
+// simulator and the benchmarks use it to script sensor values and faults.
+
+#define HAL_SIM_GPIO_COUNT 49
+#define HAL_SIM_ADC_CHANNELS 10
+#define HAL_SIM_OTA_SLOT_SIZE 0xF0000   // Matches the ota_0/ota_1 partitions
+#define HAL_SIM_SETTINGS_MAX 8          // Keys in the simulated settings store
+#define HAL_SIM_USB_BUFFER (1 << 20)    // USB port output kept until taken
+
+typedef struct {
+    // DHT22 on DHT_PIN
+    bool dht_connected;
+    float air_temp;
+    float humidity;
+    bool dht_corrupt_checksum;
+    int dht_capture_pulses;         // Cut the captured frame short after this many pulses (0 = whole)
+
+    // DS18B20 on WATER_TEMP_PIN
+    bool ds18b20_connected;
+    float water_temp;
+    bool ds18b20_corrupt_crc;
+    int ds18b20_presence_us;        // Presence pulse length (spec: 60-240)
+
+    // Analog channels (raw counts) and +/- noise amplitude
+    int adc_mv[HAL_SIM_ADC_CHANNELS];
+    int adc_noise_mv;
+
+    // Light reaching an optical probe from elsewhere (sunlight, lamps
+    // flickering at flicker_hz), added to every sample of its channel. In a
+    // hal_adc_read_modulated() read, adc_mv is only there while the emitter is on.
+    int adc_ambient_mv[HAL_SIM_ADC_CHANNELS];
+    int adc_flicker_mv[HAL_SIM_ADC_CHANNELS];   // Sine amplitude
+    int flicker_hz;
+
+    // Pulse-output meters: pulse_hz on a counted pin while the output
+    // pulse_gate names is high (-1: always). A change counts from the last
+    // counter read or output change.
+    float pulse_hz[HAL_SIM_GPIO_COUNT];
+    int8_t pulse_gate[HAL_SIM_GPIO_COUNT];
+
+    // Native USB port: the host takes usb_bytes_per_s (0: at once), and
+    // every usb_drop_every-th write times out instead (0: none)
+    uint32_t usb_bytes_per_s;
+    int usb_drop_every;
+
+    // Settings store: every hal_settings_set() fails, as on a full or worn NVS
+    bool settings_write_fail;
+
+    // Network
+    bool link_up;
+
+    // SNTP: true time is wall_epoch_us + elapsed, the local clock runs fast
+    // by clock_drift_ppm against it
+    bool sntp_reachable;
+    int64_t wall_epoch_us;          // True time when the virtual clock read 0
+    int clock_drift_ppm;
+} hal_sim_config_t;
+
+typedef struct {
+    int http_requests;
+    int http_failures;
+    int watchdog_feeds;
+    int onewire_resets;
+    int pulse_captures;             // hal_pulse_capture_start() calls
+    int adc_bursts;                 // hal_adc_read_burst() calls
+    int adc_modulated_reads;        // hal_adc_read_modulated() calls
+    int emitter_edges;              // Emitter switched on or off by them
+    int adc_scans;                  // hal_adc_scan() calls
+    int adc_scans_skipped;          // Scans they skipped because cb overran
+    int pulse_count_reads;          // hal_pulse_count_read() calls
+    int stream_connects;
+    size_t usb_bytes;               // Written to the USB port
+    int usb_write_failures;
+    size_t http_download_bytes;     // Body bytes read through hal_http_download_read()
+    int restarts;
+    int rollbacks;
+    int settings_writes;            // hal_settings_set() calls that stored a blob
+    int time_syncs;                 // SNTP results handed out by hal_time_sync_poll()
+} hal_sim_stats_t;
+
+/**
+ * @brief Restore default sensor values, clear GPIO state, stats and the clock
+ *
+ * Also erases the settings store and both firmware slots.
+ */
+void hal_sim_reset(void);
+
+hal_sim_config_t *hal_sim_config(void);
+const hal_sim_stats_t *hal_sim_stats(void);
+
+/**
+ * @brief Route every hal_http_perform() to http://host:port, keeping the URL path
+ */
+void hal_sim_set_http_endpoint(const char *host, int port);
+
+/**
+ * @brief Route every hal_stream_open() to host:port (port 0 connects as requested)
+ */
+void hal_sim_set_stream_endpoint(const char *host, int port);
+
+/**
+ * @brief Move what the firmware wrote to the USB port into buf, as the host would read it
+ * @return Bytes moved (at most size)
+ */
+size_t hal_sim_usb_take(void *buf, size_t size);
+
+/**
+ * @brief Queue bytes for the firmware to read from the USB port
+ */
+void hal_sim_usb_send(const void *data, size_t len);
+
+/**
+ * @brief Queue bytes that arrive at at_us on the virtual clock (after anything queued before)
+ */
+void hal_sim_usb_send_at(int64_t at_us, const void *data, size_t len);
+
+/**
+ * @brief Last level driven on an output pin
+ */
+int hal_sim_output_level(int pin);
+
+/**
+ * @brief Flash image into slot 0 and boot it (erases slot 1, clears trial state)
+ */
+void hal_sim_ota_flash(const void *image, size_t len);
+
+/**
+ * @brief Contents of a firmware slot and the length last written to it
+ */
+const uint8_t *hal_sim_ota_slot(int slot, size_t *len);
+
+int hal_sim_ota_running_slot(void);
+
+#endif // HAL_SIM_H
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_log.h"
+#include "aqua_meter.h"
+#include "aqua_modbus.h"
+#include "aqua_params.h"
+#include "aqua_rules.h"
+#include "aqua_seq.h"
+#include "aqua_stream.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+
+// Runs the firmware's monitoring cycle against simulated sensors and the
+// local HTTP stand-in. Each cycle applies one step of a scripted scenario.
+//
+//   host_sim [--cycles N] [--verbose] [--binlog] [--stream SECONDS]
+//
+// --binlog switches to deferred logging; pipe the output through
+// aqua_logdecode to read it. --stream runs a raw sample capture of the
+// built-in probes instead of cycles and writes what the USB port would carry;
+// pipe it through aqua_streamrx.
+
+typedef struct {
+    const char *name;
+    void (*apply)(hal_sim_config_t *cfg);
+} scenario_step_t;
+
+static void step_nominal(hal_sim_config_t *cfg) { (void)cfg; }
+static void step_low_ph(hal_sim_config_t *cfg) { cfg->adc_mv[PH_ADC_CH] = 2950; }
+static void step_turbid(hal_sim_config_t *cfg) { cfg->adc_mv[TURBIDITY_ADC_CH] = 90; }
+static void step_probe_lost(hal_sim_config_t *cfg) { cfg->ds18b20_connected = false; }
+static void step_dht_crc(hal_sim_config_t *cfg) { cfg->dht_corrupt_checksum = true; }
+static void step_link_down(hal_sim_config_t *cfg) { cfg->link_up = false; }
+static void step_air_blocked(hal_sim_config_t *cfg) { cfg->pulse_hz[AERATOR_FLOW_PIN] = 0.0f; }
+
+static const scenario_step_t scenario[] = {
+    {"nominal", step_nominal},
+    {"low pH", step_low_ph},
+    {"turbid water", step_turbid},
+    {"DS18B20 lost", step_probe_lost},
+    {"DHT22 checksum error", step_dht_crc},
+    {"WiFi down", step_link_down},
+    {"aerator line blocked", step_air_blocked},
+};
+
+#define SCENARIO_STEPS (sizeof(scenario) / sizeof(scenario[0]))
+
+// A capture at the default rate, taken by the host at USB full speed
+static int run_stream(int seconds) {
+    hal_sim_config()->adc_noise_mv = 12;
+    hal_sim_config()->usb_bytes_per_s = 1000000;
+    hal_stream_t *port = hal_usb_cdc_open();
+    aqua_stream_config_t cfg;
+    aqua_stream_parse_command("start", &cfg);
+    cfg.duration_s = (uint32_t)seconds;
+    if (!port || aqua_stream_start(&cfg) != ESP_OK) {
+        fprintf(stderr, "cannot start a capture\n");
+        return 1;
+    }
+    aqua_stream_serve(port, 0);
+    hal_stream_close(port);
+
+    static uint8_t buf[65536];
+    size_t n;
+    while ((n = hal_sim_usb_take(buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, n, stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int cycles = (int)SCENARIO_STEPS;
+    int stream_s = 0;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            esp_log_level_set("*", ESP_LOG_INFO);
+        } else if (strcmp(argv[i], "--binlog") == 0) {
+            aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_s = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--cycles N] [--verbose] [--binlog] [--stream SECONDS]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (stream_s > 0) {
+        hal_sim_reset();
+        return run_stream(stream_s);
+    }
+
+    standin_t *server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+    standin_route(server, "GET", "/rest/v1/sensor_data/relay_commands", 200,
+                  "[{\"relay_type\":\"pump\",\"state\":true}]");
+
+    hal_sim_reset();
+    aqua_log_init();
+    aqua_params_init();
+    aqua_rules_init();
+    aqua_anomaly_init();
+    aqua_modbus_init();
+    aqua_seq_init();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    aqua_gpio_init();
+    aqua_meter_init();
+    hal_time_sync_start(TIME_SNTP_SERVER, TIME_SYNC_INTERVAL_S);
+
+    aqua_cycle_state_t state = {0};
+    for (int i = 0; i < cycles; i++) {
+        const scenario_step_t *step = &scenario[i % SCENARIO_STEPS];
+        hal_sim_config_t *cfg = hal_sim_config();
+        hal_sim_config_t saved = *cfg;
+        step->apply(cfg);
+
+        int before = standin_request_count(server);
+        int64_t t0 = hal_time_us();
+        aqua_cycle_run(&state);
+        int64_t sim_ms = (hal_time_us() - t0) / 1000;
+
+        const aqua_reading_t *r = &state.reading;
+        const aqua_controls_t *c = &state.controls;
+        printf("cycle %-3d %-22s air=%6.1f hum=%6.1f water=%7.2f ph=%7.2f turb=%7.2f "
+               "relays=%d%d%d%d upload=%-4s requests=%d sim_time=%lldms\n",
+               state.cycle_count, step->name, r->air_temp, r->humidity, r->water_temp,
+               r->ph, r->turbidity, c->ph_relay, c->aerator, c->filter, c->pump,
+               state.uploaded ? "ok" : "FAIL", standin_request_count(server) - before,
+               (long long)sim_ms);
+
+        *cfg = saved;
+    }
+
+    standin_stop(server);
+    return 0;
+}
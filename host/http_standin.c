@@ -0,0 +1,581 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef STANDIN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "http_standin.h"
+
+#define STANDIN_LOG_SIZE 64
+#define STANDIN_MAX_ROUTES 16
+#define STANDIN_MAX_FILES 8
+#define STANDIN_PIPELINE 16         // Requests read ahead of their replies on one connection
+#define STANDIN_IDLE_MS 5000        // Kept-alive connection closed after this long without a request
+
+typedef struct {
+    char method[8];
+    char prefix[128];
+    int status;
+    char *body;
+} standin_route_t;
+
+typedef struct {
+    char path[128];
+    uint8_t *data;
+    size_t len;
+} standin_file_t;
+
+struct standin {
+    int listen_fd;
+    int port;
+    pthread_t threads[STANDIN_MAX_WORKERS];
+    int workers;
+    volatile bool running;
+    pthread_mutex_t lock;
+
+    standin_route_t routes[STANDIN_MAX_ROUTES];
+    int route_count;
+    standin_file_t files[STANDIN_MAX_FILES];
+    int file_count;
+    long truncate_at;           // Cut the next longer file reply after this many body bytes (-1: off)
+    standin_handler_t handler;
+    void *handler_ctx;
+    standin_observer_t observer;
+    void *observer_ctx;
+    bool gzip_accept;
+    int fail_count;
+    int fail_status;
+    int delay_ms;
+    int latency_ms;
+    int drop_count;
+
+    standin_request_t *log;     // Ring of the last STANDIN_LOG_SIZE requests
+    int request_count;
+};
+
+// One kept-alive connection: bytes received but not parsed yet, and requests
+// read ahead of their replies
+typedef struct {
+    standin_reply_t reply;
+    standin_request_t *req;
+    const standin_file_t *file; // GET of a file: sent instead of reply
+    bool drop;                  // Close instead of replying (standin_drop_next)
+    bool close;                 // The request asked for Connection: close
+    int64_t arrived_us;
+    int64_t due_us;             // Not sent before (latency injection)
+} standin_pending_t;
+
+typedef struct {
+    int fd;
+    char buf[STANDIN_MAX_HEADERS + STANDIN_MAX_BODY + 512];
+    size_t len;
+    bool eof;
+    standin_pending_t pending[STANDIN_PIPELINE];
+    int head;
+    int count;
+} standin_conn_t;
+
+// Take the first request out of the connection buffer
+// Returns 1 if one was parsed, 0 if it has not all arrived, -1 if it is malformed or too large
+static int parse_request(standin_conn_t *c, standin_request_t *req, bool *close_after) {
+    c->buf[c->len] = '\0';
+    char *header_end = strstr(c->buf, "\r\n\r\n");
+    if (!header_end) {
+        return c->len >= sizeof(c->buf) - 1 ? -1 : 0;
+    }
+
+    memset(req, 0, sizeof(*req));
+    *close_after = false;
+    if (sscanf(c->buf, "%7s %511s", req->method, req->path) != 2) return -1;
+
+    char *line = strstr(c->buf, "\r\n") + 2;
+    size_t header_len = (size_t)(header_end + 2 - line);
+    if (header_len >= sizeof(req->headers)) header_len = sizeof(req->headers) - 1;
+    memcpy(req->headers, line, header_len);
+
+    size_t content_length = 0;
+    for (char *h = line; h < header_end; ) {
+        char *eol = strstr(h, "\r\n");
+        if (strncasecmp(h, "Content-Length:", 15) == 0) {
+            content_length = strtoul(h + 15, NULL, 10);
+        } else if (strncasecmp(h, "Content-Encoding:", 17) == 0 && strstr(h, "gzip") && strstr(h, "gzip") < eol) {
+            req->gzip = true;
+        } else if (strncasecmp(h, "Connection:", 11) == 0) {
+            const char *v = h + 11;
+            while (*v == ' ') v++;
+            *close_after = strncasecmp(v, "close", 5) == 0;
+        }
+        h = eol + 2;
+    }
+    if (content_length >= sizeof(req->body)) return -1;
+
+    char *body = header_end + 4;
+    size_t used = (size_t)(body - c->buf) + content_length;
+    if (c->len < used) {
+        return 0;
+    }
+    memcpy(req->body, body, content_length);
+    req->body[content_length] = '\0';
+    req->body_len = content_length;
+    req->wire_len = content_length;
+
+    c->len -= used;
+    memmove(c->buf, c->buf + used, c->len);
+    return 1;
+}
+
+// Replace a gzip body by its decoded form; false if it cannot be decoded
+static bool decode_gzip(standin_request_t *req) {
+#ifdef STANDIN_HAVE_ZLIB
+    static __thread char plain[STANDIN_MAX_BODY];
+    z_stream zs = {0};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) return false;
+    zs.next_in = (Bytef *)req->body;
+    zs.avail_in = (uInt)req->body_len;
+    zs.next_out = (Bytef *)plain;
+    zs.avail_out = sizeof(plain) - 1;
+    int rc = inflate(&zs, Z_FINISH);
+    size_t len = zs.total_out;
+    inflateEnd(&zs);
+    if (rc != Z_STREAM_END) return false;
+    memcpy(req->body, plain, len);
+    req->body[len] = '\0';
+    req->body_len = len;
+    return true;
+#else
+    (void)req;
+    return false;
+#endif
+}
+
+static void default_reply(standin_t *s, const standin_request_t *req, standin_reply_t *reply) {
+    reply->status = strcmp(req->method, "POST") == 0 ? 201 : 200;
+    reply->content_type = "application/json";
+    reply->body_len = 0;
+    if (strcmp(req->method, "GET") == 0) {
+        reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body), "[]");
+    }
+
+    for (int i = s->route_count - 1; i >= 0; i--) {
+        standin_route_t *r = &s->routes[i];
+        if (strcmp(r->method, req->method) == 0 &&
+            strncmp(req->path, r->prefix, strlen(r->prefix)) == 0) {
+            reply->status = r->status;
+            reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body), "%s", r->body);
+            return;
+        }
+    }
+}
+
+static void send_reply(int fd, const standin_reply_t *reply, bool close_after) {
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                     reply->status, reply->status < 300 ? "OK" : "Error",
+                     reply->content_type ? reply->content_type : "application/json",
+                     reply->body_len, close_after ? "close" : "keep-alive");
+    send(fd, head, (size_t)n, MSG_NOSIGNAL);
+    if (reply->body_len > 0) {
+        send(fd, reply->body, reply->body_len, MSG_NOSIGNAL);
+    }
+}
+
+static void sleep_ms(int ms) {
+    if (ms > 0) {
+        struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static standin_file_t *find_file(standin_t *s, const char *path) {
+    size_t len = strcspn(path, "?");
+    for (int i = 0; i < s->file_count; i++) {
+        if (strlen(s->files[i].path) == len && strncmp(s->files[i].path, path, len) == 0) {
+            return &s->files[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with the lock held so the file cannot be replaced mid-send
+static void send_file(standin_t *s, int fd, const standin_file_t *f) {
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n", f->len);
+    send(fd, head, (size_t)n, MSG_NOSIGNAL);
+
+    size_t len = f->len;
+    if (s->truncate_at >= 0 && (size_t)s->truncate_at < len) {
+        len = (size_t)s->truncate_at;
+        s->truncate_at = -1;
+    }
+    for (size_t sent = 0; sent < len; ) {
+        ssize_t r = send(fd, f->data + sent, len - sent, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        sent += (size_t)r;
+    }
+}
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Answer (or fail, or hold) a request as it is read; the reply waits in p
+static void process_request(standin_t *s, standin_pending_t *p, int64_t arrived_us) {
+    standin_request_t *req = p->req;
+    standin_reply_t *reply = &p->reply;
+    memset(reply, 0, sizeof(*reply));
+    p->file = NULL;
+    p->arrived_us = arrived_us;
+
+    pthread_mutex_lock(&s->lock);
+    bool undecodable = req->gzip && !(s->gzip_accept && decode_gzip(req));
+    s->log[s->request_count % STANDIN_LOG_SIZE] = *req;
+    s->request_count++;
+
+    int delay_ms = s->delay_ms;
+    p->due_us = arrived_us + (int64_t)s->latency_ms * 1000;
+    p->drop = false;
+    if (s->fail_count > 0) {
+        s->fail_count--;
+        reply->status = s->fail_status;
+    } else if (undecodable && s->gzip_accept) {
+        reply->status = 415;    // Built without zlib, or a corrupt stream
+    } else if (undecodable) {
+        reply->status = 400;
+        reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body),
+                                           "{\"code\":\"PGRST102\",\"message\":\"Empty or invalid json\"}");
+    } else if (strcmp(req->method, "GET") == 0 && (p->file = find_file(s, req->path)) != NULL) {
+        p->close = true;
+    } else {
+        if (!s->handler || !s->handler(req, reply, s->handler_ctx)) {
+            default_reply(s, req, reply);
+        }
+        if (s->drop_count > 0) {
+            s->drop_count--;
+            p->drop = true;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    // Holds this worker, unlike the latency
+    sleep_ms(delay_ms);
+}
+
+// Returns false once the connection is to be closed
+static bool send_pending(standin_t *s, standin_conn_t *c) {
+    standin_pending_t *p = &c->pending[c->head];
+    c->head = (c->head + 1) % STANDIN_PIPELINE;
+    c->count--;
+    if (p->drop) {
+        return false;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (p->file) {
+        send_file(s, c->fd, p->file);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (!p->file) {
+        send_reply(c->fd, &p->reply, p->close);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (s->observer) {
+        s->observer(p->req, p->file ? 200 : p->reply.status, now_us() - p->arrived_us, s->observer_ctx);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return !p->close;
+}
+
+// Requests are read as soon as they arrive, so pipelined ones are answered
+// latency_ms after each arrived rather than one latency after the other
+static void serve_connection(standin_t *s, int fd) {
+    standin_conn_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        return;
+    }
+    c->fd = fd;
+    int ready = 0;
+    for (; ready < STANDIN_PIPELINE; ready++) {
+        c->pending[ready].req = malloc(sizeof(standin_request_t));
+        if (!c->pending[ready].req) break;
+    }
+
+    int64_t arrived_us = now_us();
+    int64_t idle_since_us = arrived_us;
+    bool closing = false;       // No more requests are read
+    while (s->running && ready == STANDIN_PIPELINE) {
+        // Take every request that has arrived whole
+        while (!closing && c->count < STANDIN_PIPELINE) {
+            standin_pending_t *p = &c->pending[(c->head + c->count) % STANDIN_PIPELINE];
+            int r = parse_request(c, p->req, &p->close);
+            if (r < 0) {
+                closing = true;
+                break;
+            }
+            if (r == 0) {
+                break;
+            }
+            process_request(s, p, arrived_us);
+            c->count++;
+            closing = p->close;
+        }
+
+        // Replies go in request order, each once it is due
+        int64_t now = now_us();
+        bool open = true;
+        while (c->count > 0 && c->pending[c->head].due_us <= now) {
+            if (!send_pending(s, c)) {
+                open = false;
+                break;
+            }
+            now = now_us();
+            idle_since_us = now;
+        }
+        if (!open || (c->count == 0 && (closing || c->eof))) {
+            break;
+        }
+
+        int wait_ms = 50;
+        if (c->count > 0) {
+            int64_t due_ms = (c->pending[c->head].due_us - now + 999) / 1000;
+            wait_ms = due_ms < wait_ms ? (int)due_ms : wait_ms;
+        } else if (now - idle_since_us > STANDIN_IDLE_MS * 1000LL) {
+            break;
+        }
+        bool room = !closing && !c->eof && c->len < sizeof(c->buf) - 1;
+        struct pollfd pfd = { .fd = fd, .events = room ? POLLIN : 0 };
+        if (poll(&pfd, 1, wait_ms) <= 0 || !room) {
+            continue;
+        }
+        ssize_t n = recv(fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            c->eof = true;
+            continue;
+        }
+        c->len += (size_t)n;
+        arrived_us = now_us();
+    }
+
+    for (int i = 0; i < ready; i++) {
+        free(c->pending[i].req);
+    }
+    free(c);
+}
+
+static void *standin_thread(void *arg) {
+    standin_t *s = arg;
+
+    while (s->running) {
+        struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        // The listening socket is non-blocking: another worker may win the accept
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        serve_connection(s, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+standin_t *standin_start(void) {
+    return standin_start_workers(1);
+}
+
+standin_t *standin_start_workers(int workers) {
+    if (workers < 1) workers = 1;
+    if (workers > STANDIN_MAX_WORKERS) workers = STANDIN_MAX_WORKERS;
+    standin_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->log = calloc(STANDIN_LOG_SIZE, sizeof(standin_request_t));
+    if (!s->log) {
+        free(s);
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->truncate_at = -1;
+
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (s->listen_fd < 0 ||
+        bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(s->listen_fd, SOMAXCONN) != 0 ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        if (s->listen_fd >= 0) close(s->listen_fd);
+        free(s->log);
+        free(s);
+        return NULL;
+    }
+    s->port = ntohs(addr.sin_port);
+    fcntl(s->listen_fd, F_SETFL, fcntl(s->listen_fd, F_GETFL) | O_NONBLOCK);
+
+    s->running = true;
+    for (s->workers = 0; s->workers < workers; s->workers++) {
+        if (pthread_create(&s->threads[s->workers], NULL, standin_thread, s) != 0) {
+            break;
+        }
+    }
+    if (s->workers == 0) {
+        close(s->listen_fd);
+        free(s->log);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void standin_stop(standin_t *s) {
+    if (!s) return;
+    s->running = false;
+    for (int i = 0; i < s->workers; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+    close(s->listen_fd);
+    for (int i = 0; i < s->route_count; i++) {
+        free(s->routes[i].body);
+    }
+    for (int i = 0; i < s->file_count; i++) {
+        free(s->files[i].data);
+    }
+    pthread_mutex_destroy(&s->lock);
+    free(s->log);
+    free(s);
+}
+
+int standin_port(const standin_t *s) {
+    return s->port;
+}
+
+void standin_route(standin_t *s, const char *method, const char *path_prefix,
+                   int status, const char *body) {
+    pthread_mutex_lock(&s->lock);
+    if (s->route_count < STANDIN_MAX_ROUTES) {
+        standin_route_t *r = &s->routes[s->route_count++];
+        snprintf(r->method, sizeof(r->method), "%s", method);
+        snprintf(r->prefix, sizeof(r->prefix), "%s", path_prefix);
+        r->status = status;
+        r->body = strdup(body ? body : "");
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+bool standin_file(standin_t *s, const char *path, const void *data, size_t len) {
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!copy) return false;
+    memcpy(copy, data, len);
+
+    pthread_mutex_lock(&s->lock);
+    standin_file_t *f = find_file(s, path);
+    if (!f && s->file_count < STANDIN_MAX_FILES) {
+        f = &s->files[s->file_count++];
+        snprintf(f->path, sizeof(f->path), "%s", path);
+    }
+    if (f) {
+        free(f->data);
+        f->data = copy;
+        f->len = len;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (!f) free(copy);
+    return f != NULL;
+}
+
+void standin_truncate_next_file(standin_t *s, size_t bytes) {
+    pthread_mutex_lock(&s->lock);
+    s->truncate_at = (long)bytes;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_set_handler(standin_t *s, standin_handler_t handler, void *ctx) {
+    pthread_mutex_lock(&s->lock);
+    s->handler = handler;
+    s->handler_ctx = ctx;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_set_observer(standin_t *s, standin_observer_t observer, void *ctx) {
+    pthread_mutex_lock(&s->lock);
+    s->observer = observer;
+    s->observer_ctx = ctx;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_fail_next(standin_t *s, int count, int status) {
+    pthread_mutex_lock(&s->lock);
+    s->fail_count = count;
+    s->fail_status = status;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_set_delay_ms(standin_t *s, int delay_ms) {
+    pthread_mutex_lock(&s->lock);
+    s->delay_ms = delay_ms;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_set_latency_ms(standin_t *s, int latency_ms) {
+    pthread_mutex_lock(&s->lock);
+    s->latency_ms = latency_ms;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_drop_next(standin_t *s, int count) {
+    pthread_mutex_lock(&s->lock);
+    s->drop_count = count;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void standin_accept_gzip(standin_t *s, bool accept) {
+    pthread_mutex_lock(&s->lock);
+    s->gzip_accept = accept;
+    pthread_mutex_unlock(&s->lock);
+}
+
+int standin_request_count(standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->request_count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+bool standin_get_request(standin_t *s, int idx, standin_request_t *out) {
+    bool ok = false;
+    pthread_mutex_lock(&s->lock);
+    if (idx >= 0 && idx < s->request_count && idx >= s->request_count - STANDIN_LOG_SIZE) {
+        *out = s->log[idx % STANDIN_LOG_SIZE];
+        ok = true;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+void standin_clear(standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    s->request_count = 0;
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,137 @@
+#ifndef HTTP_STANDIN_H
+#define HTTP_STANDIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal local HTTP/1.1 server standing in for Supabase/PostgREST in host
+// tests and benchmarks. Runs on background threads bound to 127.0.0.1 and
+// records every request it serves. Connections are kept alive unless the
+// request says Connection: close, and pipelined requests are read ahead of
+// their replies.
+
+#define STANDIN_MAX_BODY 8192
+#define STANDIN_MAX_HEADERS 2048
+
+typedef struct {
+    char method[8];
+    char path[512];
+    char headers[STANDIN_MAX_HEADERS];  // Raw header block, "Name: value\r\n" lines
+    char body[STANDIN_MAX_BODY];        // Decoded if it arrived gzip-encoded
+    size_t body_len;
+    size_t wire_len;                    // Body bytes as received
+    bool gzip;                          // Content-Encoding: gzip
+} standin_request_t;
+
+typedef struct {
+    int status;
+    const char *content_type;
+    char body[STANDIN_MAX_BODY];
+    size_t body_len;
+} standin_reply_t;
+
+/**
+ * @brief Custom request handler
+ * @return true if the reply was filled in, false to fall back to the routes
+ */
+typedef bool (*standin_handler_t)(const standin_request_t *req, standin_reply_t *reply, void *ctx);
+
+/**
+ * @brief Called after every reply with the time from the request's arrival to the last byte sent
+ *
+ * Runs on the worker thread that served the request, with the stand-in's lock
+ * held; once standin_set_observer() returns, the previous observer is not running.
+ */
+typedef void (*standin_observer_t)(const standin_request_t *req, int status, int64_t service_us,
+                                   void *ctx);
+
+typedef struct standin standin_t;
+
+#define STANDIN_MAX_WORKERS 64
+
+/**
+ * @brief Start the server on an ephemeral port
+ * @return Server handle, NULL on failure
+ */
+standin_t *standin_start(void);
+
+/**
+ * @brief Start the server with workers threads serving connections in parallel
+ *
+ * Models a server with a fixed pool (e.g. PostgREST's database connections);
+ * a reply delay (standin_set_delay_ms) then holds one worker, not the server.
+ */
+standin_t *standin_start_workers(int workers);
+void standin_stop(standin_t *s);
+int standin_port(const standin_t *s);
+
+/**
+ * @brief Fixed reply for requests whose method matches and path starts with prefix
+ *
+ * Later routes take precedence. Without a matching route, POST gets
+ * 201 and GET gets 200 with an empty JSON array.
+ */
+void standin_route(standin_t *s, const char *method, const char *path_prefix,
+                   int status, const char *body);
+void standin_set_handler(standin_t *s, standin_handler_t handler, void *ctx);
+void standin_set_observer(standin_t *s, standin_observer_t observer, void *ctx);
+
+/**
+ * @brief Serve a copy of data (any size) for GET path, ignoring any query string
+ *
+ * Files take precedence over the handler and routes; serving path again
+ * replaces the content.
+ * @return false if out of memory or file slots
+ */
+bool standin_file(standin_t *s, const char *path, const void *data, size_t len);
+
+/**
+ * @brief Close the connection after bytes of the next file body (fault injection)
+ *
+ * Files no longer than bytes are sent whole and do not use up the fault.
+ */
+void standin_truncate_next_file(standin_t *s, size_t bytes);
+
+/**
+ * @brief Answer the next count requests with status (fault injection)
+ */
+void standin_fail_next(standin_t *s, int count, int status);
+
+/**
+ * @brief Decode gzip request bodies (off: answer them 400, as PostgREST does)
+ *
+ * Decoding needs zlib; a build without it answers 415 instead.
+ */
+void standin_accept_gzip(standin_t *s, bool accept);
+
+/**
+ * @brief Delay every reply by delay_ms (latency injection)
+ *
+ * The worker sleeps, so requests behind it on the connection wait too.
+ */
+void standin_set_delay_ms(standin_t *s, int delay_ms);
+
+/**
+ * @brief Send every reply latency_ms after its request arrived (round trip injection)
+ *
+ * Unlike standin_set_delay_ms() the worker keeps reading, so requests
+ * pipelined on one connection wait out their latency together.
+ */
+void standin_set_latency_ms(standin_t *s, int latency_ms);
+
+/**
+ * @brief Handle the next count requests, then close the connection instead of
+ *        replying (a response lost on the way back, fault injection)
+ */
+void standin_drop_next(standin_t *s, int count);
+
+int standin_request_count(standin_t *s);
+
+/**
+ * @brief Copy of the idx-th recorded request (only the last 64 are kept)
+ */
+bool standin_get_request(standin_t *s, int idx, standin_request_t *out);
+void standin_clear(standin_t *s);
+
+#endif // HTTP_STANDIN_H
@@ -0,0 +1,214 @@
+#include <string.h>
+#include "i2c_standin.h"
+
+// ADS1115 registers and config fields (datasheet section 8.6)
+#define REG_CONVERSION 0
+#define REG_CONFIG 1
+#define REG_LO_THRESH 2
+#define REG_HI_THRESH 3
+
+#define CFG_OS 0x8000
+#define CFG_MUX_SHIFT 12
+#define CFG_MODE_SINGLE 0x0100
+#define CFG_DR_SHIFT 5
+#define CFG_COMP_QUE_MASK 0x0003
+
+static const int s_data_rates[8] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+
+typedef struct {
+    uint8_t addr;
+    bool present;
+    bool alert_stuck;
+    int alert_pin;
+    int input_mv[I2C_STANDIN_INPUTS];
+
+    uint8_t pointer;
+    uint16_t config;
+    uint16_t lo_thresh;
+    uint16_t hi_thresh;
+    int16_t conversion;
+    int16_t next_conversion;        // Result of the conversion in progress
+    int64_t conversion_end_us;      // -1 when none is in progress
+} ads1115_t;
+
+static ads1115_t s_devs[I2C_STANDIN_MAX_DEVICES];
+static int s_dev_count;
+static uint32_t s_freq_hz = 100000;
+static int64_t s_bus_free_us;
+static i2c_standin_stats_t s_stats;
+
+void i2c_standin_reset(void) {
+    memset(s_devs, 0, sizeof(s_devs));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_dev_count = 0;
+    s_freq_hz = 100000;
+    s_bus_free_us = 0;
+}
+
+void i2c_standin_set_freq(uint32_t freq_hz) {
+    s_freq_hz = freq_hz ? freq_hz : 100000;
+}
+
+static ads1115_t *find(uint8_t addr) {
+    for (int i = 0; i < s_dev_count; i++) {
+        if (s_devs[i].addr == addr) {
+            return &s_devs[i];
+        }
+    }
+    return NULL;
+}
+
+bool i2c_standin_add_ads1115(uint8_t addr, int alert_pin) {
+    if (s_dev_count == I2C_STANDIN_MAX_DEVICES || find(addr)) {
+        return false;
+    }
+    ads1115_t *d = &s_devs[s_dev_count++];
+    d->addr = addr;
+    d->present = true;
+    d->alert_pin = alert_pin;
+    d->config = 0x8583;             // Power-on defaults
+    d->lo_thresh = 0x8000;
+    d->hi_thresh = 0x7FFF;
+    d->conversion_end_us = -1;
+    return true;
+}
+
+void i2c_standin_set_input_mv(uint8_t addr, int input, int mv) {
+    ads1115_t *d = find(addr);
+    if (d && input >= 0 && input < I2C_STANDIN_INPUTS) {
+        d->input_mv[input] = mv;
+    }
+}
+
+void i2c_standin_set_present(uint8_t addr, bool present) {
+    ads1115_t *d = find(addr);
+    if (d) d->present = present;
+}
+
+void i2c_standin_set_alert_stuck(uint8_t addr, bool stuck) {
+    ads1115_t *d = find(addr);
+    if (d) d->alert_stuck = stuck;
+}
+
+const i2c_standin_stats_t *i2c_standin_stats(void) {
+    return &s_stats;
+}
+
+// ========== DEVICE MODEL ==========
+// Full-scale range from the PGA field, in mV
+static int full_scale_mv(uint16_t config) {
+    static const int fsr[8] = { 6144, 4096, 2048, 1024, 512, 256, 256, 256 };
+    return fsr[(config >> 9) & 7];
+}
+
+static void settle(ads1115_t *d, int64_t now_us) {
+    if (d->conversion_end_us >= 0 && now_us >= d->conversion_end_us) {
+        d->conversion = d->next_conversion;
+        d->conversion_end_us = -1;
+    }
+}
+
+// A config write with OS set in single-shot mode starts a conversion
+static void start_conversion(ads1115_t *d, int64_t now_us, i2c_standin_result_t *res) {
+    int mux = (d->config >> CFG_MUX_SHIFT) & 7;
+    int mv = mux >= 4 ? d->input_mv[mux - 4] : 0;     // Differential modes read 0 here
+    int fsr = full_scale_mv(d->config);
+    int32_t code = (int32_t)((int64_t)mv * 32768 / fsr);
+    if (code > 32767) code = 32767;
+    if (code < -32768) code = -32768;
+
+    int sps = s_data_rates[(d->config >> CFG_DR_SHIFT) & 7];
+    d->next_conversion = (int16_t)code;
+    d->conversion_end_us = now_us + 1000000 / sps + 25;    // Plus oscillator start-up
+    s_stats.conversions++;
+
+    // Conversion-ready mode: hi_thresh MSB set, lo_thresh MSB clear, comparator on
+    bool rdy_mode = (d->hi_thresh & 0x8000) && !(d->lo_thresh & 0x8000) &&
+                    (d->config & CFG_COMP_QUE_MASK) != CFG_COMP_QUE_MASK;
+    if (rdy_mode && !d->alert_stuck) {
+        res->alert_pin = d->alert_pin;
+        res->alert_us = d->conversion_end_us;
+    }
+}
+
+static void write_register(ads1115_t *d, const uint8_t *wbuf, size_t wlen, int64_t now_us,
+                           i2c_standin_result_t *res) {
+    d->pointer = wbuf[0] & 3;
+    if (wlen < 3) {
+        return;     // Pointer only
+    }
+    uint16_t value = (uint16_t)(wbuf[1] << 8 | wbuf[2]);
+    switch (d->pointer) {
+    case REG_CONFIG:
+        d->config = value & ~CFG_OS;
+        if ((value & CFG_OS) && (value & CFG_MODE_SINGLE) && d->conversion_end_us < 0) {
+            start_conversion(d, now_us, res);
+        }
+        break;
+    case REG_LO_THRESH:
+        d->lo_thresh = value;
+        break;
+    case REG_HI_THRESH:
+        d->hi_thresh = value;
+        break;
+    default:
+        break;      // Conversion register is read-only
+    }
+}
+
+static uint16_t read_register(ads1115_t *d) {
+    switch (d->pointer) {
+    case REG_CONVERSION:
+        return (uint16_t)d->conversion;
+    case REG_CONFIG:
+        // OS reads 1 when no conversion is in progress
+        return d->config | (d->conversion_end_us < 0 ? CFG_OS : 0);
+    case REG_LO_THRESH:
+        return d->lo_thresh;
+    default:
+        return d->hi_thresh;
+    }
+}
+
+// ========== BUS ==========
+static int64_t bus_time_us(size_t bytes) {
+    // Nine clocks per byte (eight bits and ACK) plus start/stop conditions
+    return (int64_t)((bytes * 9 + 2) * 1000000ULL / s_freq_hz) + 1;
+}
+
+void i2c_standin_transfer(int64_t now_us, uint8_t addr, const uint8_t *wbuf, size_t wlen,
+                          uint8_t *rbuf, size_t rlen, i2c_standin_result_t *res) {
+    res->ack = false;
+    res->alert_pin = -1;
+    res->alert_us = 0;
+    if (rlen) memset(rbuf, 0xFF, rlen);
+
+    int64_t start = now_us > s_bus_free_us ? now_us : s_bus_free_us;
+    ads1115_t *d = find(addr);
+    size_t bytes = 1;
+    if (d && d->present) {
+        res->ack = true;
+        bytes += wlen + (wlen && rlen ? 1 : 0) + rlen;     // Repeated start resends the address
+    }
+    int64_t end = start + bus_time_us(bytes);
+
+    s_stats.transactions++;
+    s_stats.bytes += bytes;
+    s_stats.busy_us += end - start;
+    s_bus_free_us = end;
+    res->done_us = end;
+    if (!res->ack) {
+        s_stats.nacks++;
+        return;
+    }
+
+    settle(d, end);
+    if (wlen) {
+        write_register(d, wbuf, wlen, end, res);
+    }
+    if (rlen) {
+        uint16_t value = read_register(d);
+        rbuf[0] = value >> 8;
+        if (rlen > 1) rbuf[1] = value & 0xFF;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef I2C_STANDIN_H
+#define I2C_STANDIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Model of one I2C bus carrying ADS1115 converters, used by hal_linux.c for
+// hal_i2c_submit(). Works on the simulated clock: each transfer is placed
+// after the previous one on the bus, its byte count sets its length at the
+// bus frequency, and a single-shot conversion started by a config write ends
+// 1/SPS later with a falling edge on the converter's ALERT/RDY pin (when the
+// threshold registers select conversion-ready mode).
+
+#define I2C_STANDIN_MAX_DEVICES 8
+#define I2C_STANDIN_INPUTS 4
+
+typedef struct {
+    int64_t done_us;                // When the transfer finishes on the bus
+    bool ack;                       // false: the address was not acknowledged
+    int alert_pin;                  // Pin that falls when a conversion started here ends, -1 if none
+    int64_t alert_us;
+} i2c_standin_result_t;
+
+typedef struct {
+    int transactions;
+    int nacks;
+    size_t bytes;                   // Address and data bytes clocked
+    int conversions;                // Single-shot conversions started
+    int64_t busy_us;                // Time the bus was driven
+} i2c_standin_stats_t;
+
+/**
+ * @brief Remove every device, clear the stats and free the bus (100 kHz)
+ */
+void i2c_standin_reset(void);
+
+void i2c_standin_set_freq(uint32_t freq_hz);
+
+/**
+ * @brief Attach an ADS1115 at addr with its ALERT/RDY output on alert_pin
+ * @return false if the bus is full
+ */
+bool i2c_standin_add_ads1115(uint8_t addr, int alert_pin);
+
+/**
+ * @brief Voltage on input 0-3 (AINx against GND), in mV
+ */
+void i2c_standin_set_input_mv(uint8_t addr, int input, int mv);
+
+/**
+ * @brief Take a device off the bus (NACKs its address) or put it back
+ */
+void i2c_standin_set_present(uint8_t addr, bool present);
+
+/**
+ * @brief Keep ALERT/RDY high: conversions finish but never signal it
+ */
+void i2c_standin_set_alert_stuck(uint8_t addr, bool stuck);
+
+/**
+ * @brief Run one transaction that is submitted at now_us
+ *
+ * Writes wlen bytes then reads rlen after a repeated start, as
+ * hal_i2c_submit() describes. rbuf is filled with what the device returns
+ * at the end of the transfer.
+ */
+void i2c_standin_transfer(int64_t now_us, uint8_t addr, const uint8_t *wbuf, size_t wlen,
+                          uint8_t *rbuf, size_t rlen, i2c_standin_result_t *res);
+
+const i2c_standin_stats_t *i2c_standin_stats(void);
+
+#endif // I2C_STANDIN_H
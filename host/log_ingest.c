@@ -0,0 +1,447 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_log.h"
+#include "log_ingest.h"
+
+#define BIT(alert) (1u << (alert))
+
+// Conditions re-evaluated every cycle
+#define PER_CYCLE_ALERTS (BIT(INGEST_ALERT_CRITICAL_MISSING) | BIT(INGEST_ALERT_WATER_TEMP_OFFLINE) | \
+                          BIT(INGEST_ALERT_PH_OFFLINE) | BIT(INGEST_ALERT_UPLOAD_FAILED))
+
+// True if s starts with the string literal lit
+#define STARTS(s, lit) (strncmp((s), (lit), sizeof(lit) - 1) == 0)
+
+void ingest_source_init(ingest_source_t *src, const char *name, const ingest_sink_t *sink) {
+    memset(src, 0, sizeof(*src));
+    src->name = name;
+    if (sink) {
+        src->sink = *sink;
+    }
+    src->boot = 1;
+    src->last_ms = -1;
+}
+
+// ========== ROWS AND ALERTS ==========
+static void raise_alert(ingest_source_t *src, ingest_alert_t alert, const char *line) {
+    src->raised |= BIT(alert);
+    if (src->active & BIT(alert)) {
+        return;
+    }
+    src->active |= BIT(alert);
+    src->stats.alerts++;
+    if (src->sink.alert) {
+        src->sink.alert(src->name, src->boot, src->last_ms, alert, line, src->sink.ctx);
+    }
+}
+
+static void clear_alert(ingest_source_t *src, ingest_alert_t alert) {
+    src->active &= ~BIT(alert);
+}
+
+static void close_row(ingest_source_t *src) {
+    if (!src->row_open) {
+        return;
+    }
+    if (src->row_data) {
+        src->stats.rows++;
+        if (src->sink.row) {
+            src->sink.row(&src->row, src->sink.ctx);
+        }
+    }
+    src->active &= ~(PER_CYCLE_ALERTS & ~src->raised);
+    src->raised = 0;
+    src->row_open = false;
+}
+
+static void open_row(ingest_source_t *src, int cycle) {
+    close_row(src);
+    ingest_row_t *row = &src->row;
+    row->source = src->name;
+    row->boot = src->boot;
+    row->cycle = cycle;
+    row->uptime_ms = src->last_ms;
+    for (int i = 0; i < INGEST_VALUE_COUNT; i++) row->values[i] = NAN;
+    memset(row->relays, -1, sizeof(row->relays));
+    row->uploaded = -1;
+    memset(row->health, -1, sizeof(row->health));
+    src->cycles_in_boot = cycle;
+    src->row_open = true;
+    src->row_data = false;
+}
+
+// Row that the current line reports into
+static ingest_row_t *current_row(ingest_source_t *src) {
+    if (!src->row_open) {
+        open_row(src, src->cycles_in_boot + 1);
+    }
+    src->row_data = true;
+    return &src->row;
+}
+
+// A value of AQUA_SENSOR_ERROR or below means the sensor is missing
+static void set_value(ingest_source_t *src, ingest_value_t v, float value) {
+    current_row(src)->values[v] = value <= AQUA_SENSOR_ERROR ? NAN : value;
+}
+
+static void reset_seen(ingest_source_t *src) {
+    close_row(src);
+    if (src->last_ms >= 0 || src->stats.rows > 0) {
+        src->boot++;
+    }
+    src->cycles_in_boot = 0;
+    src->active = 0;
+    src->raised = 0;
+    src->last_ms = -1;
+}
+
+// ========== MESSAGES ==========
+static float number_after(const char *s, const char *key) {
+    const char *p = strstr(s, key);
+    return p ? strtof(p + strlen(key), NULL) : NAN;
+}
+
+static int8_t on_off_after(const char *s, const char *key) {
+    const char *p = strstr(s, key);
+    if (!p) return -1;
+    p += strlen(key);
+    return STARTS(p, "ON") ? 1 : STARTS(p, "OFF") ? 0 : -1;
+}
+
+static void sensor_missing(ingest_source_t *src, ingest_value_t v, const char *line) {
+    set_value(src, v, AQUA_SENSOR_ERROR);
+    if (v == INGEST_PH) raise_alert(src, INGEST_ALERT_PH_OFFLINE, line);
+    if (v == INGEST_WATER_TEMP) raise_alert(src, INGEST_ALERT_WATER_TEMP_OFFLINE, line);
+}
+
+static void upload_result(ingest_source_t *src, bool ok, const char *line) {
+    current_row(src)->uploaded = ok;
+    if (ok) {
+        clear_alert(src, INGEST_ALERT_UPLOAD_FAILED);
+    } else {
+        raise_alert(src, INGEST_ALERT_UPLOAD_FAILED, line);
+    }
+}
+
+// "<probe>: <value>" and "<probe> sensor error" for the analog probes, in
+// the texts of both the registry-driven and the older firmware
+static bool analog_probe(ingest_source_t *src, const char *m, const char *label, ingest_value_t v) {
+    size_t n = strlen(label);
+    if (strncmp(m, label, n) != 0) return false;
+    if (m[n] == ':' && m[n + 1] == ' ') {
+        set_value(src, v, strtof(m + n + 2, NULL));
+        return true;
+    }
+    if (STARTS(m + n, " sensor error") || STARTS(m + n, " sensor disconnected")) {
+        sensor_missing(src, v, m);
+        return true;
+    }
+    return false;
+}
+
+static void cycle_start(ingest_source_t *src, const char *m) {
+    open_row(src, atoi(m + sizeof("========== CYCLE #") - 1));
+}
+
+// Message text of an AQUA log line, dispatched on its first character
+static void aqua_message(ingest_source_t *src, const char *m) {
+    while (*m == '\n' || *m == ' ') m++;
+
+    switch (m[0]) {
+    case 'A':
+        if (STARTS(m, "Air Temp: ")) {
+            set_value(src, INGEST_AIR_TEMP, strtof(m + 10, NULL));
+            set_value(src, INGEST_HUMIDITY, number_after(m, "Humidity: "));
+        } else {
+            analog_probe(src, m, "Ammonia", INGEST_AMMONIA);
+        }
+        break;
+    case 'W':
+        if (STARTS(m, "Water Temp: ")) {
+            float t = strtof(m + 12, NULL);
+            if (t <= AQUA_SENSOR_ERROR) {
+                sensor_missing(src, INGEST_WATER_TEMP, m);
+            } else {
+                set_value(src, INGEST_WATER_TEMP, t);
+            }
+        } else if (STARTS(m, "Water temperature sensor missing")) {
+            sensor_missing(src, INGEST_WATER_TEMP, m);
+        } else if (STARTS(m, "WiFi CONNECTED")) {
+            clear_alert(src, INGEST_ALERT_WIFI_FAILED);
+        } else if (STARTS(m, "WiFi connection failed") || STARTS(m, "WiFi initialization failed")) {
+            raise_alert(src, INGEST_ALERT_WIFI_FAILED, m);
+        }
+        break;
+    case 'p':
+        analog_probe(src, m, "pH", INGEST_PH);
+        break;
+    case 'D':
+        if (STARTS(m, "DHT22 READ FAILED")) {
+            set_value(src, INGEST_AIR_TEMP, AQUA_SENSOR_ERROR);
+            set_value(src, INGEST_HUMIDITY, AQUA_SENSOR_ERROR);
+        } else if (STARTS(m, "DS18B20 not responding")) {
+            sensor_missing(src, INGEST_WATER_TEMP, m);
+        } else {
+            analog_probe(src, m, "DO", INGEST_DO);
+        }
+        break;
+    case 'T':
+        analog_probe(src, m, "Turbidity", INGEST_TURBIDITY);
+        break;
+    case 'S':
+        if (STARTS(m, "Sensor not connected yet")) {
+            if (strstr(m, "DO sensor")) set_value(src, INGEST_DO, AQUA_SENSOR_ERROR);
+            if (strstr(m, "ammonia")) set_value(src, INGEST_AMMONIA, AQUA_SENSOR_ERROR);
+        } else if (STARTS(m, "SYSTEM FAILURE") && strstr(m, "CRITICAL SENSORS MISSING")) {
+            raise_alert(src, INGEST_ALERT_CRITICAL_MISSING, m);
+        }
+        break;
+    case 'C':
+        if (STARTS(m, "Control States")) {
+            ingest_row_t *r = current_row(src);
+            r->relays[INGEST_RELAY_PH] = on_off_after(m, "pH Relay: ");
+            r->relays[INGEST_RELAY_AERATOR] = on_off_after(m, "Aerator: ");
+            r->relays[INGEST_RELAY_FILTER] = on_off_after(m, "Filter: ");
+            r->relays[INGEST_RELAY_PUMP] = on_off_after(m, "Pump: ");
+        }
+        break;
+    case 'H':
+        if (STARTS(m, "Health: ")) {
+            // "Health: DHT22 %d, DS18B20 %d, pH %d, DO %d, Turbidity %d, NH3 %d"
+            ingest_row_t *r = current_row(src);
+            const char *p = m + 8;
+            for (int i = 0; i < INGEST_HEALTH_COUNT && p; i++) {
+                const char *score = strchr(p, ' ');
+                if (!score) break;
+                r->health[i] = (int8_t)atoi(score + 1);
+                p = strchr(score, ',');
+                if (p) p += 2;
+            }
+        }
+        break;
+    case 'R':
+        // The first message of a cycle in firmware without cycle banners
+        if (STARTS(m, "Reading DHT22 sensor") && (!src->row_open || src->row_data)) {
+            open_row(src, src->cycles_in_boot + 1);
+        }
+        break;
+    case 'U':
+        if (STARTS(m, "UPLOAD FAILED")) upload_result(src, false, m);
+        break;
+    case '=':
+        if (STARTS(m, "========== CYCLE #")) cycle_start(src, m);
+        break;
+    case '[':
+        if (STARTS(m, "[SUPABASE] ")) {
+            const char *s = m + 11;
+            if (STARTS(s, "Data sent successfully") || STARTS(s, "Exchange OK")) {
+                upload_result(src, true, m);
+            } else if (STARTS(s, "All ") || STARTS(s, "Exchange failed after")) {
+                upload_result(src, false, m);
+            }
+        } else if (STARTS(m, "[MQTT] Published")) {
+            upload_result(src, true, m);
+        } else if (STARTS(m, "[MQTT] Publish failed")) {
+            upload_result(src, false, m);
+        } else if (STARTS(m, "[HEALTH] ")) {
+            if (strstr(m, " dropped to ")) {
+                raise_alert(src, INGEST_ALERT_SENSOR_DEGRADED, m);
+            } else if (strstr(m, " recovered ")) {
+                clear_alert(src, INGEST_ALERT_SENSOR_DEGRADED);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// ========== DEFERRED RECORDS ==========
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static void deferred_records(ingest_source_t *src, const char *b64) {
+    uint8_t buf[INGEST_LINE_MAX];
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (; *b64 && *b64 != '='; b64++) {
+        int v = base64_value(*b64);
+        if (v < 0 || n == sizeof(buf)) {
+            src->stats.bad_records++;
+            return;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            buf[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < n) {
+        aqua_log_record_t rec;
+        char text[512];
+        size_t used = aqua_log_decode(buf + pos, n - pos, &rec);
+        if (used == 0 || aqua_log_format(&rec, text, sizeof(text)) < 0) {
+            src->stats.bad_records++;
+            return;
+        }
+        src->stats.records++;
+        src->last_ms = rec.timestamp_ms;
+        aqua_message(src, text);
+        pos += used;
+    }
+}
+
+// ========== LINES ==========
+// Drop colour codes: ESC [ ... m
+static char *strip_colour(char *p, size_t *len) {
+    while (*len > 0 && p[0] == '\033') {
+        char *m = memchr(p, 'm', *len);
+        if (!m) break;
+        *len -= (size_t)(m + 1 - p);
+        p = m + 1;
+    }
+    char *esc = memchr(p, '\033', *len);
+    if (esc) {
+        *len = (size_t)(esc - p);
+    }
+    p[*len] = '\0';
+    return p;
+}
+
+// "L (ms) tag: message"; false for any other line
+static bool split_log_line(char *p, int64_t *ms, char **tag, char **msg) {
+    if (!strchr("EWIDV", p[0]) || p[0] == '\0' || p[1] != ' ' || p[2] != '(') {
+        return false;
+    }
+    char *end;
+    long long t = strtoll(p + 3, &end, 10);
+    if (end == p + 3 || end[0] != ')' || end[1] != ' ') {
+        return false;
+    }
+    char *colon = strchr(end + 2, ':');
+    if (!colon) {
+        return false;
+    }
+    *ms = t;
+    *tag = end + 2;
+    *colon = '\0';
+    *msg = colon[1] == ' ' ? colon + 2 : colon + 1;
+    return true;
+}
+
+void ingest_line(ingest_source_t *src, const char *line, size_t len) {
+    char buf[INGEST_LINE_MAX + 1];
+    if (len > INGEST_LINE_MAX) len = INGEST_LINE_MAX;
+    memcpy(buf, line, len);
+    while (len > 0 && (buf[len - 1] == '\r' || buf[len - 1] == ' ')) len--;
+    buf[len] = '\0';
+    char *p = strip_colour(buf, &len);
+    src->stats.lines++;
+
+    int64_t ms;
+    char *tag, *msg;
+    if (split_log_line(p, &ms, &tag, &msg)) {
+        src->last_ms = ms;
+        if (strcmp(tag, "AQUA") == 0) {
+            aqua_message(src, msg);
+        } else if (strcmp(tag, "task_wdt") == 0 && STARTS(msg, "Task watchdog got triggered")) {
+            raise_alert(src, INGEST_ALERT_CRASH, msg);
+        }
+        return;
+    }
+
+    // Untagged: reset and panic output, the cycle banner, deferred records
+    char *aql;
+    if (STARTS(p, "rst:0x")) {
+        reset_seen(src);
+    } else if (STARTS(p, "========== CYCLE #")) {
+        cycle_start(src, p);
+    } else if (STARTS(p, "Guru Meditation Error") || STARTS(p, "abort() was called") ||
+               STARTS(p, "Brownout detector was triggered")) {
+        raise_alert(src, INGEST_ALERT_CRASH, p);
+    } else if ((aql = strstr(p, "AQL:")) != NULL) {
+        deferred_records(src, aql + 4);
+    }
+}
+
+void ingest_feed(ingest_source_t *src, const char *data, size_t len) {
+    src->stats.bytes += len;
+    while (len > 0) {
+        const char *nl = memchr(data, '\n', len);
+        size_t chunk = nl ? (size_t)(nl - data) : len;
+
+        // Whole lines are parsed in place; only partial ones are buffered
+        if (nl && src->line_len == 0) {
+            ingest_line(src, data, chunk);
+        } else {
+            size_t room = INGEST_LINE_MAX - src->line_len;
+            size_t take = chunk < room ? chunk : room;
+            memcpy(src->line + src->line_len, data, take);
+            src->line_len += take;
+            if (nl) {
+                ingest_line(src, src->line, src->line_len);
+                src->line_len = 0;
+            }
+        }
+        if (!nl) break;
+        data = nl + 1;
+        len -= chunk + 1;
+    }
+}
+
+void ingest_finish(ingest_source_t *src) {
+    if (src->line_len > 0) {
+        ingest_line(src, src->line, src->line_len);
+        src->line_len = 0;
+    }
+    close_row(src);
+}
+
+// ========== NAMES ==========
+const char *ingest_value_name(ingest_value_t value) {
+    static const char *const names[INGEST_VALUE_COUNT] = {
+        [INGEST_AIR_TEMP] = "air_temperature",
+        [INGEST_HUMIDITY] = "humidity",
+        [INGEST_WATER_TEMP] = "water_temperature",
+        [INGEST_PH] = "ph",
+        [INGEST_DO] = "dissolved_oxygen",
+        [INGEST_TURBIDITY] = "turbidity",
+        [INGEST_AMMONIA] = "ammonia",
+    };
+    return (unsigned)value < INGEST_VALUE_COUNT ? names[value] : "unknown";
+}
+
+const char *ingest_relay_name(ingest_relay_t relay) {
+    static const char *const names[INGEST_RELAY_COUNT] = {
+        [INGEST_RELAY_PH] = "ph_relay",
+        [INGEST_RELAY_AERATOR] = "aerator",
+        [INGEST_RELAY_FILTER] = "filter",
+        [INGEST_RELAY_PUMP] = "pump",
+    };
+    return (unsigned)relay < INGEST_RELAY_COUNT ? names[relay] : "unknown";
+}
+
+const char *ingest_alert_name(ingest_alert_t alert) {
+    static const char *const names[INGEST_ALERT_COUNT] = {
+        [INGEST_ALERT_CRITICAL_MISSING] = "critical sensors missing",
+        [INGEST_ALERT_WATER_TEMP_OFFLINE] = "water temperature probe offline",
+        [INGEST_ALERT_PH_OFFLINE] = "pH probe offline",
+        [INGEST_ALERT_UPLOAD_FAILED] = "upload failed",
+        [INGEST_ALERT_WIFI_FAILED] = "WiFi connection failed",
+        [INGEST_ALERT_SENSOR_DEGRADED] = "sensor health degraded",
+        [INGEST_ALERT_CRASH] = "firmware crashed",
+    };
+    return (unsigned)alert < INGEST_ALERT_COUNT ? names[alert] : "unknown";
+}
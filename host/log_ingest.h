@@ -0,0 +1,137 @@
+#ifndef LOG_INGEST_H
+#define LOG_INGEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming parser for the firmware's console output (host/tools/aqua_ingest.c).
+//
+// Each source (a capture file or a serial device) has its own state. Bytes
+// are fed as they arrive and every line is parsed once: ESP-IDF log lines
+// ("I (1234) AQUA: ..."), with or without colour codes, the firmware's older
+// and current message texts, "AQL:" deferred records (decoded with the
+// message table from main/aqua_log_msgs.h), and the ROM's reset and panic
+// lines. Readings are collected into one row per cycle, and alert conditions
+// fire on the line that raises them.
+
+#define INGEST_LINE_MAX 1024            // Longer lines are cut here
+
+typedef enum {
+    INGEST_AIR_TEMP,
+    INGEST_HUMIDITY,
+    INGEST_WATER_TEMP,
+    INGEST_PH,
+    INGEST_DO,
+    INGEST_TURBIDITY,
+    INGEST_AMMONIA,
+    INGEST_VALUE_COUNT
+} ingest_value_t;
+
+typedef enum {
+    INGEST_RELAY_PH,
+    INGEST_RELAY_AERATOR,
+    INGEST_RELAY_FILTER,
+    INGEST_RELAY_PUMP,
+    INGEST_RELAY_COUNT
+} ingest_relay_t;
+
+#define INGEST_HEALTH_COUNT 6           // Sensors in the "Health:" line, aqua_sensor_t order
+
+// One monitoring cycle. Unknown values are NAN (sensor missing or not
+// reported); unknown flags and scores are -1.
+typedef struct {
+    const char *source;
+    int boot;                           // Resets seen in this source, 1 for the first boot
+    int cycle;                          // Firmware cycle number, or count within the boot
+    int64_t uptime_ms;                  // Log timestamp of the cycle's first line, -1 if none
+    float values[INGEST_VALUE_COUNT];
+    int8_t relays[INGEST_RELAY_COUNT];  // 1 = on
+    int8_t uploaded;                    // 1 = accepted by the server, 0 = failed
+    int8_t health[INGEST_HEALTH_COUNT]; // 0-100
+} ingest_row_t;
+
+typedef enum {
+    INGEST_ALERT_CRITICAL_MISSING,      // Critical sensors missing this cycle
+    INGEST_ALERT_WATER_TEMP_OFFLINE,
+    INGEST_ALERT_PH_OFFLINE,
+    INGEST_ALERT_UPLOAD_FAILED,
+    INGEST_ALERT_WIFI_FAILED,
+    INGEST_ALERT_SENSOR_DEGRADED,       // [HEALTH] score dropped
+    INGEST_ALERT_CRASH,                 // Panic, abort, watchdog or brownout
+    INGEST_ALERT_COUNT
+} ingest_alert_t;
+
+typedef struct {
+    void (*row)(const ingest_row_t *row, void *ctx);
+    void (*alert)(const char *source, int boot, int64_t uptime_ms, ingest_alert_t alert,
+                  const char *line, void *ctx);
+    void *ctx;
+} ingest_sink_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t lines;
+    uint64_t rows;
+    uint64_t alerts;
+    uint64_t records;                   // Deferred records decoded from AQL: lines
+    uint64_t bad_records;               // AQL: lines that did not decode
+} ingest_stats_t;
+
+typedef struct {
+    const char *name;
+    ingest_sink_t sink;
+    ingest_stats_t stats;
+
+    // Line assembly across feeds
+    char line[INGEST_LINE_MAX];
+    size_t line_len;
+
+    // Cycle being collected
+    ingest_row_t row;
+    bool row_open;
+    bool row_data;                      // Anything reported into row
+    int boot;
+    int cycles_in_boot;
+    int64_t last_ms;
+
+    // Alerts: fired when raised while inactive. Per-cycle conditions clear at
+    // the end of a cycle that did not raise them; the others on their own
+    // recovery line or a reset.
+    uint32_t active;
+    uint32_t raised;
+} ingest_source_t;
+
+/**
+ * @brief Start a source; name must stay valid while it is used
+ */
+void ingest_source_init(ingest_source_t *src, const char *name, const ingest_sink_t *sink);
+
+/**
+ * @brief Feed raw bytes; complete lines are parsed at once, the rest is kept
+ */
+void ingest_feed(ingest_source_t *src, const char *data, size_t len);
+
+/**
+ * @brief Parse one line (without its newline)
+ */
+void ingest_line(ingest_source_t *src, const char *line, size_t len);
+
+/**
+ * @brief End of input: parse a trailing partial line and emit the open row
+ */
+void ingest_finish(ingest_source_t *src);
+
+/**
+ * @brief Column name of a value, as in the sensor_data table
+ */
+const char *ingest_value_name(ingest_value_t value);
+
+const char *ingest_relay_name(ingest_relay_t relay);
+
+/**
+ * @brief Short description for alert output
+ */
+const char *ingest_alert_name(ingest_alert_t alert);
+
+#endif // LOG_INGEST_H
@@ -0,0 +1,341 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "aqua_modbus.h"
+#include "aqua_registry.h"
+#include "modbus_client.h"
+#include "pond_model.h"
+
+#define REPLY_TIMEOUT_MS 2000
+
+struct modbus_client {
+    int fd;
+    uint16_t transaction;
+};
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+modbus_client_t *modbus_connect(const char *host, int port) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        return NULL;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    modbus_client_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return NULL;
+    }
+    c->fd = fd;
+    return c;
+}
+
+void modbus_close(modbus_client_t *c) {
+    if (!c) {
+        return;
+    }
+    close(c->fd);
+    free(c);
+}
+
+static bool send_all(int fd, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Exactly len bytes; false on timeout or close
+static bool recv_all(int fd, uint8_t *p, size_t len, int timeout_ms) {
+    while (len > 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// One request and its answer; returns the answer's PDU length, or -1
+static int transact(modbus_client_t *c, const uint8_t *pdu, size_t pdu_len, uint8_t *out, size_t out_size) {
+    uint8_t frame[AQUA_MODBUS_FRAME_MAX];
+    uint16_t tid = ++c->transaction;
+    frame[0] = (uint8_t)(tid >> 8);
+    frame[1] = (uint8_t)tid;
+    frame[2] = frame[3] = 0;
+    frame[4] = (uint8_t)((pdu_len + 1) >> 8);
+    frame[5] = (uint8_t)(pdu_len + 1);
+    frame[6] = 1;
+    memcpy(frame + 7, pdu, pdu_len);
+    if (!send_all(c->fd, frame, 7 + pdu_len)) {
+        return -1;
+    }
+
+    uint8_t head[7];
+    if (!recv_all(c->fd, head, sizeof(head), REPLY_TIMEOUT_MS)) {
+        return -1;
+    }
+    size_t len = (size_t)(head[4] << 8 | head[5]);
+    if ((head[0] << 8 | head[1]) != tid || head[2] != 0 || head[3] != 0 || len < 2 || len - 1 > out_size) {
+        return -1;
+    }
+    return recv_all(c->fd, out, len - 1, REPLY_TIMEOUT_MS) ? (int)(len - 1) : -1;
+}
+
+// 0, the exception code, or -1 if the answer does not fit the request
+static int check(const uint8_t *pdu, int n, uint8_t fc, int want) {
+    if (n >= 2 && pdu[0] == (fc | 0x80)) {
+        return pdu[1];
+    }
+    return n == want && pdu[0] == fc ? 0 : -1;
+}
+
+int modbus_read_registers(modbus_client_t *c, uint8_t fc, uint16_t start, uint16_t count, uint16_t *out) {
+    uint8_t req[5] = { fc, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count };
+    uint8_t pdu[AQUA_MODBUS_FRAME_MAX];
+    int n = transact(c, req, sizeof(req), pdu, sizeof(pdu));
+    int status = check(pdu, n, fc, 2 + 2 * count);
+    if (status != 0) {
+        return status;
+    }
+    for (int i = 0; i < count; i++) {
+        out[i] = (uint16_t)(pdu[2 + 2 * i] << 8 | pdu[3 + 2 * i]);
+    }
+    return 0;
+}
+
+int modbus_read_coils(modbus_client_t *c, uint16_t start, uint16_t count, uint8_t *bits) {
+    uint8_t req[5] = { 0x01, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count };
+    uint8_t pdu[AQUA_MODBUS_FRAME_MAX];
+    int n = transact(c, req, sizeof(req), pdu, sizeof(pdu));
+    int status = check(pdu, n, 0x01, 2 + (count + 7) / 8);
+    if (status == 0) {
+        memcpy(bits, pdu + 2, (size_t)(count + 7) / 8);
+    }
+    return status;
+}
+
+int modbus_write_coil(modbus_client_t *c, uint16_t addr, bool on) {
+    uint8_t req[5] = { 0x05, (uint8_t)(addr >> 8), (uint8_t)addr, on ? 0xFF : 0x00, 0x00 };
+    uint8_t pdu[AQUA_MODBUS_FRAME_MAX];
+    int n = transact(c, req, sizeof(req), pdu, sizeof(pdu));
+    int status = check(pdu, n, 0x05, 5);
+    return status == 0 && memcmp(pdu, req, 5) != 0 ? -1 : status;
+}
+
+int modbus_write_coils(modbus_client_t *c, uint16_t start, uint16_t count, uint8_t bits) {
+    uint8_t req[7] = { 0x0F, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count, 1, bits };
+    uint8_t pdu[AQUA_MODBUS_FRAME_MAX];
+    int n = transact(c, req, sizeof(req), pdu, sizeof(pdu));
+    int status = check(pdu, n, 0x0F, 5);
+    return status == 0 && memcmp(pdu, req, 5) != 0 ? -1 : status;
+}
+
+int modbus_exchange_raw(modbus_client_t *c, const void *req, size_t len, uint8_t *resp, size_t size,
+                        int timeout_ms) {
+    if (len > 0 && !send_all(c->fd, req, len)) {
+        return -1;
+    }
+    struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+    ssize_t n = recv(c->fd, resp, size, 0);
+    return n > 0 ? (int)n : -1;
+}
+
+// ========== LOAD ==========
+typedef struct {
+    const modbus_poll_config_t *cfg;
+    int64_t end_us;
+    bool started;
+    fleet_samples_t latency;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t torn;
+    uint32_t last_sample;
+    uint64_t samples_seen;
+} poller_t;
+
+static atomic_bool publishing;
+
+void modbus_poll_defaults(modbus_poll_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->host = "127.0.0.1";
+    cfg->pollers = 4;
+    cfg->duration_s = 5.0;
+    cfg->interval_ms = 0;
+}
+
+// The x100 and float copies of each measurement come from one sample
+static bool consistent(const uint16_t *regs) {
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        uint32_t bits = (uint32_t)regs[AQUA_MODBUS_REG_FLOAT + 2 * id] << 16 | regs[AQUA_MODBUS_REG_FLOAT + 2 * id + 1];
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        uint16_t fixed = regs[AQUA_MODBUS_REG_VALUE + id];
+        if (isnan(v) != (fixed == AQUA_MODBUS_MISSING)) {
+            return false;
+        }
+        if (!isnan(v) && fabsf(roundf(v * 100.0f) - (float)(int16_t)fixed) > 0.5f &&
+            fabsf(v * 100.0f) < 32767.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *poller_thread(void *arg) {
+    poller_t *p = arg;
+    const modbus_poll_config_t *cfg = p->cfg;
+    modbus_client_t *c = modbus_connect(cfg->host, cfg->port);
+    if (!c) {
+        p->errors++;
+        return NULL;
+    }
+    uint16_t regs[AQUA_MODBUS_REGISTERS];
+    while (now_us() < p->end_us) {
+        int64_t t0 = now_us();
+        int status = modbus_read_registers(c, 0x04, 0, AQUA_MODBUS_REGISTERS, regs);
+        if (status != 0) {
+            p->errors++;
+            if (status < 0) {
+                break;
+            }
+            continue;
+        }
+        fleet_samples_add(&p->latency, now_us() - t0);
+        p->requests++;
+        p->torn += !consistent(regs);
+        uint32_t sample = (uint32_t)regs[AQUA_MODBUS_REG_SAMPLE] << 16 | regs[AQUA_MODBUS_REG_SAMPLE + 1];
+        if (sample != p->last_sample) {
+            p->samples_seen++;
+            p->last_sample = sample;
+        }
+        if (cfg->interval_ms > 0) {
+            struct timespec ts = { .tv_sec = cfg->interval_ms / 1000, .tv_nsec = (cfg->interval_ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    modbus_close(c);
+    return NULL;
+}
+
+typedef struct {
+    int publish_us;
+    uint64_t published;
+} publisher_t;
+
+// Stands in for the monitoring cycle, much faster than SAMPLE_DELAY_MS
+static void *publisher_thread(void *arg) {
+    publisher_t *pub = arg;
+    pond_model_t pond;
+    pond_model_init(&pond, 5, 0.0);
+    aqua_controls_t c = {0};
+    while (atomic_load(&publishing)) {
+        aqua_reading_t r;
+        pond_model_next(&pond, &r);
+        if (pub->published % 7 == 0) {
+            r.ph = AQUA_SENSOR_ERROR;
+        }
+        c.aerator = r.do_level < 6.0f;
+        aqua_modbus_publish(&r, &c, (uint32_t)++pub->published);
+        struct timespec ts = { .tv_sec = 0, .tv_nsec = pub->publish_us * 1000L };
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+bool modbus_poll_run(const modbus_poll_config_t *cfg, modbus_poll_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    if (cfg->pollers < 1 || cfg->duration_s <= 0 || cfg->port <= 0) {
+        return false;
+    }
+    poller_t *pollers = calloc((size_t)cfg->pollers, sizeof(*pollers));
+    pthread_t *threads = calloc((size_t)cfg->pollers, sizeof(*threads));
+    if (!pollers || !threads) {
+        free(pollers);
+        free(threads);
+        return false;
+    }
+
+    publisher_t pub = { .publish_us = cfg->publish_us };
+    pthread_t pub_thread;
+    bool with_publisher = false;
+    if (cfg->publish_us > 0) {
+        atomic_store(&publishing, true);
+        with_publisher = pthread_create(&pub_thread, NULL, publisher_thread, &pub) == 0;
+    }
+
+    int64_t start = now_us();
+    for (int i = 0; i < cfg->pollers; i++) {
+        pollers[i].cfg = cfg;
+        pollers[i].end_us = start + (int64_t)(cfg->duration_s * 1e6);
+        pollers[i].started = pthread_create(&threads[i], NULL, poller_thread, &pollers[i]) == 0;
+        pollers[i].errors += !pollers[i].started;
+    }
+    for (int i = 0; i < cfg->pollers; i++) {
+        if (pollers[i].started) pthread_join(threads[i], NULL);
+    }
+    report->real_s = (double)(now_us() - start) / 1e6;
+    if (with_publisher) {
+        atomic_store(&publishing, false);
+        pthread_join(pub_thread, NULL);
+        report->published = pub.published;
+    }
+
+    fleet_samples_t all = {0};
+    for (int i = 0; i < cfg->pollers; i++) {
+        poller_t *p = &pollers[i];
+        report->requests += p->requests;
+        report->errors += p->errors;
+        report->torn += p->torn;
+        report->samples_seen += p->samples_seen;
+        for (size_t k = 0; k < p->latency.count; k++) {
+            fleet_samples_add(&all, p->latency.us[k]);
+        }
+        fleet_samples_free(&p->latency);
+    }
+    fleet_samples_percentiles(&all, &report->latency);
+    fleet_samples_free(&all);
+    free(pollers);
+    free(threads);
+    return report->requests > 0;
+}
@@ -0,0 +1,63 @@
+#ifndef MODBUS_CLIENT_H
+#define MODBUS_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fleet_sim.h"
+
+// Minimal Modbus TCP client, the way a SCADA poller talks to the device's
+// server (main/aqua_modbus.h), and a load run of several pollers at once.
+// Plain sockets and real time: it never touches the simulated HAL.
+
+typedef struct modbus_client modbus_client_t;
+
+modbus_client_t *modbus_connect(const char *host, int port);
+void modbus_close(modbus_client_t *c);
+
+/**
+ * @brief Read registers with function 3 or 4
+ * @return 0, the exception code the server answered with, or -1 on a
+ *         connection or framing error
+ */
+int modbus_read_registers(modbus_client_t *c, uint8_t fc, uint16_t start, uint16_t count, uint16_t *out);
+int modbus_read_coils(modbus_client_t *c, uint16_t start, uint16_t count, uint8_t *bits);
+int modbus_write_coil(modbus_client_t *c, uint16_t addr, bool on);
+int modbus_write_coils(modbus_client_t *c, uint16_t start, uint16_t count, uint8_t bits);
+
+/**
+ * @brief Send raw bytes and read whatever comes back within timeout_ms
+ * @return Bytes read, 0 on timeout, -1 if the server closed the connection
+ */
+int modbus_exchange_raw(modbus_client_t *c, const void *req, size_t len, uint8_t *resp, size_t size,
+                        int timeout_ms);
+
+// ========== LOAD ==========
+typedef struct {
+    const char *host;
+    int port;
+    int pollers;                        // Connections polling at once
+    double duration_s;
+    int interval_ms;                    // Between one poller's requests; 0 back to back
+    int publish_us;                     // > 0: publish a pond model sample this often (in-process server)
+} modbus_poll_config_t;
+
+typedef struct {
+    uint64_t requests;                  // Answered reads of the whole register map
+    uint64_t errors;                    // Exceptions, failed connections and closed streams
+    uint64_t torn;                      // Answers mixing two samples
+    uint64_t samples_seen;              // Distinct sample numbers in the answers
+    uint64_t published;
+    double real_s;
+    fleet_percentiles_t latency;        // Request sent to answer read, real time
+} modbus_poll_report_t;
+
+void modbus_poll_defaults(modbus_poll_config_t *cfg);
+
+/**
+ * @brief Run the pollers (and the publisher) for cfg->duration_s
+ * @return false if the configuration is invalid or no poller connected
+ */
+bool modbus_poll_run(const modbus_poll_config_t *cfg, modbus_poll_report_t *report);
+
+#endif // MODBUS_CLIENT_H
@@ -0,0 +1,509 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "mqtt_standin.h"
+
+#define MQTT_STANDIN_LOG_SIZE 64
+#define MQTT_STANDIN_SESSIONS 4
+#define MQTT_STANDIN_SUBS 4
+#define MQTT_STANDIN_QUEUE 16
+#define MQTT_STANDIN_ACKS 64
+#define MQTT_STANDIN_RX (MQTT_STANDIN_MAX_PAYLOAD + 256)
+
+typedef struct {
+    char topic[128];
+    char payload[MQTT_STANDIN_MAX_PAYLOAD];
+} queued_t;
+
+typedef struct {
+    bool used;
+    char client_id[64];
+    char subs[MQTT_STANDIN_SUBS][128];
+    int sub_count;
+    queued_t queue[MQTT_STANDIN_QUEUE];
+    int queue_count;
+} session_t;
+
+typedef struct {
+    uint16_t packet_id;
+    int64_t due_us;
+} pending_ack_t;
+
+struct mqtt_standin {
+    int listen_fd;
+    int port;
+    pthread_t thread;
+    volatile bool running;
+    pthread_mutex_t lock;
+
+    int client_fd;
+    session_t *client;              // Session of the connected client
+    uint8_t rx[MQTT_STANDIN_RX];
+    size_t rx_len;
+    uint16_t next_id;
+
+    session_t sessions[MQTT_STANDIN_SESSIONS];
+    pending_ack_t acks[MQTT_STANDIN_ACKS];
+    int ack_count;
+    int drop_acks;
+    int ack_delay_ms;
+    bool kick;
+
+    mqtt_standin_message_t *log;    // Ring of the last MQTT_STANDIN_LOG_SIZE publishes
+    int publish_count;
+    int connect_count;
+    int ping_count;
+    int delivered_acks;
+};
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void send_packet(mqtt_standin_t *s, uint8_t type, const uint8_t *body, size_t body_len) {
+    uint8_t packet[5 + MQTT_STANDIN_RX];
+    size_t n = 0;
+    packet[n++] = type;
+    size_t len = body_len;
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        if (len > 0) b |= 0x80;
+        packet[n++] = b;
+    } while (len > 0);
+    memcpy(packet + n, body, body_len);
+    send(s->client_fd, packet, n + body_len, MSG_NOSIGNAL);
+}
+
+static size_t put_str(uint8_t *p, const char *str, size_t len) {
+    p[0] = (uint8_t)(len >> 8);
+    p[1] = (uint8_t)len;
+    memcpy(p + 2, str, len);
+    return len + 2;
+}
+
+static void deliver(mqtt_standin_t *s, const char *topic, const char *payload) {
+    uint8_t body[MQTT_STANDIN_MAX_PAYLOAD + 160];
+    size_t payload_len = strlen(payload);
+    size_t pos = put_str(body, topic, strlen(topic));
+    uint16_t id = s->next_id++;
+    if (s->next_id == 0) s->next_id = 1;
+    body[pos++] = (uint8_t)(id >> 8);
+    body[pos++] = (uint8_t)id;
+    memcpy(body + pos, payload, payload_len);
+    send_packet(s, 0x32, body, pos + payload_len);
+}
+
+static bool subscribed(const session_t *session, const char *topic) {
+    for (int i = 0; i < session->sub_count; i++) {
+        if (strcmp(session->subs[i], topic) == 0) return true;
+    }
+    return false;
+}
+
+static void close_client(mqtt_standin_t *s) {
+    if (s->client_fd >= 0) {
+        close(s->client_fd);
+    }
+    s->client_fd = -1;
+    s->client = NULL;
+    s->rx_len = 0;
+    s->ack_count = 0;
+}
+
+static session_t *find_session(mqtt_standin_t *s, const char *client_id, bool create) {
+    session_t *free_slot = NULL;
+    for (int i = 0; i < MQTT_STANDIN_SESSIONS; i++) {
+        session_t *session = &s->sessions[i];
+        if (session->used && strcmp(session->client_id, client_id) == 0) return session;
+        if (!session->used && !free_slot) free_slot = session;
+    }
+    if (!create) return NULL;
+    if (!free_slot) free_slot = &s->sessions[0];
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = true;
+    snprintf(free_slot->client_id, sizeof(free_slot->client_id), "%s", client_id);
+    return free_slot;
+}
+
+static void handle_connect(mqtt_standin_t *s, const uint8_t *p, size_t len) {
+    // Protocol name (6) + level + flags + keepalive, then the client ID
+    if (len < 12) {
+        close_client(s);
+        return;
+    }
+    uint8_t flags = p[7];
+    size_t id_len = ((size_t)p[10] << 8) | p[11];
+    char client_id[64];
+    if (id_len >= sizeof(client_id) || 12 + id_len > len) {
+        close_client(s);
+        return;
+    }
+    memcpy(client_id, p + 12, id_len);
+    client_id[id_len] = '\0';
+
+    bool clean = (flags & 0x02) != 0;
+    session_t *existing = find_session(s, client_id, false);
+    bool present = existing && !clean;
+    if (existing && clean) {
+        existing->used = false;
+    }
+    s->client = find_session(s, client_id, true);
+    s->connect_count++;
+
+    uint8_t connack[2] = { present ? 1 : 0, 0 };
+    send_packet(s, 0x20, connack, sizeof(connack));
+
+    // Messages queued while the client was away
+    for (int i = 0; i < s->client->queue_count; i++) {
+        deliver(s, s->client->queue[i].topic, s->client->queue[i].payload);
+    }
+    s->client->queue_count = 0;
+}
+
+static void handle_publish(mqtt_standin_t *s, uint8_t flags, const uint8_t *p, size_t len) {
+    mqtt_standin_message_t *msg = &s->log[s->publish_count % MQTT_STANDIN_LOG_SIZE];
+    memset(msg, 0, sizeof(*msg));
+    msg->qos = (flags >> 1) & 0x03;
+    msg->dup = (flags & 0x08) != 0;
+
+    size_t topic_len = len >= 2 ? (((size_t)p[0] << 8) | p[1]) : 0;
+    size_t pos = 2 + topic_len;
+    if (pos > len || topic_len >= sizeof(msg->topic)) {
+        close_client(s);
+        return;
+    }
+    memcpy(msg->topic, p + 2, topic_len);
+    if (msg->qos > 0) {
+        if (pos + 2 > len) {
+            close_client(s);
+            return;
+        }
+        msg->packet_id = (uint16_t)((p[pos] << 8) | p[pos + 1]);
+        pos += 2;
+    }
+    msg->payload_len = len - pos < sizeof(msg->payload) - 1 ? len - pos : sizeof(msg->payload) - 1;
+    memcpy(msg->payload, p + pos, msg->payload_len);
+    s->publish_count++;
+
+    if (msg->qos == 0) return;
+    if (s->drop_acks > 0) {
+        s->drop_acks--;
+        return;
+    }
+    if (s->ack_count < MQTT_STANDIN_ACKS) {
+        s->acks[s->ack_count].packet_id = msg->packet_id;
+        s->acks[s->ack_count].due_us = now_us() + (int64_t)s->ack_delay_ms * 1000;
+        s->ack_count++;
+    }
+}
+
+static void handle_subscribe(mqtt_standin_t *s, const uint8_t *p, size_t len) {
+    if (len < 5) {
+        close_client(s);
+        return;
+    }
+    size_t topic_len = ((size_t)p[2] << 8) | p[3];
+    uint8_t rc = 0x80;
+    if (4 + topic_len < len && topic_len < 128 && s->client->sub_count < MQTT_STANDIN_SUBS) {
+        char topic[128];
+        memcpy(topic, p + 4, topic_len);
+        topic[topic_len] = '\0';
+        if (!subscribed(s->client, topic)) {
+            snprintf(s->client->subs[s->client->sub_count++], sizeof(s->client->subs[0]), "%s", topic);
+        }
+        rc = p[4 + topic_len] & 0x01;
+    }
+    uint8_t suback[3] = { p[0], p[1], rc };
+    send_packet(s, 0x90, suback, sizeof(suback));
+}
+
+static void handle_packet(mqtt_standin_t *s, const uint8_t *packet, size_t header_len, size_t total) {
+    uint8_t type = packet[0] & 0xF0;
+    const uint8_t *body = packet + header_len;
+    size_t body_len = total - header_len;
+
+    if (!s->client && type != 0x10) {
+        close_client(s);
+        return;
+    }
+    switch (type) {
+    case 0x10:
+        handle_connect(s, body, body_len);
+        break;
+    case 0x30:
+        handle_publish(s, packet[0] & 0x0F, body, body_len);
+        break;
+    case 0x40:
+        s->delivered_acks++;
+        break;
+    case 0x80:
+        handle_subscribe(s, body, body_len);
+        break;
+    case 0xC0:
+        s->ping_count++;
+        send_packet(s, 0xD0, NULL, 0);
+        break;
+    case 0xE0:
+        close_client(s);
+        break;
+    default:
+        break;
+    }
+}
+
+static void process_rx(mqtt_standin_t *s) {
+    while (s->client_fd >= 0 && s->rx_len >= 2) {
+        size_t remaining = 0, header_len = 0;
+        int shift = 0;
+        for (size_t i = 1; i < 5 && i < s->rx_len; i++) {
+            remaining |= (size_t)(s->rx[i] & 0x7F) << shift;
+            shift += 7;
+            if (!(s->rx[i] & 0x80)) {
+                header_len = i + 1;
+                break;
+            }
+        }
+        if (header_len == 0) return;
+        size_t total = header_len + remaining;
+        if (total > sizeof(s->rx)) {
+            close_client(s);
+            return;
+        }
+        if (s->rx_len < total) return;
+
+        uint8_t packet[MQTT_STANDIN_RX];
+        memcpy(packet, s->rx, total);
+        s->rx_len -= total;
+        memmove(s->rx, s->rx + total, s->rx_len);
+        handle_packet(s, packet, header_len, total);
+    }
+}
+
+// Sends due PUBACKs; returns ms until the next one (or 10 when idle)
+static int send_due_acks(mqtt_standin_t *s) {
+    int64_t now = now_us();
+    int wait_ms = 10;
+    int kept = 0;
+    for (int i = 0; i < s->ack_count; i++) {
+        pending_ack_t *ack = &s->acks[i];
+        if (ack->due_us <= now) {
+            uint8_t body[2] = { (uint8_t)(ack->packet_id >> 8), (uint8_t)ack->packet_id };
+            send_packet(s, 0x40, body, sizeof(body));
+        } else {
+            int left = (int)((ack->due_us - now + 999) / 1000);
+            if (left < wait_ms) wait_ms = left;
+            s->acks[kept++] = *ack;
+        }
+    }
+    s->ack_count = kept;
+    return wait_ms;
+}
+
+static void *mqtt_standin_thread(void *arg) {
+    mqtt_standin_t *s = arg;
+
+    while (s->running) {
+        pthread_mutex_lock(&s->lock);
+        if (s->kick) {
+            close_client(s);
+            s->kick = false;
+        }
+        int wait_ms = s->client_fd >= 0 ? send_due_acks(s) : 10;
+        pthread_mutex_unlock(&s->lock);
+
+        struct pollfd pfd[2] = {
+            { .fd = s->listen_fd, .events = POLLIN },
+            { .fd = s->client_fd, .events = POLLIN },
+        };
+        if (poll(pfd, s->client_fd >= 0 ? 2 : 1, wait_ms) <= 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(s->listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                // One client at a time: a new connection replaces the old one
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                close_client(s);
+                s->client_fd = fd;
+            }
+        } else if (s->client_fd >= 0 && (pfd[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = recv(s->client_fd, s->rx + s->rx_len, sizeof(s->rx) - s->rx_len, 0);
+            if (n > 0) {
+                s->rx_len += (size_t)n;
+                process_rx(s);
+            } else if (n == 0 || errno != EINTR) {
+                close_client(s);
+            }
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+mqtt_standin_t *mqtt_standin_start(void) {
+    mqtt_standin_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->log = calloc(MQTT_STANDIN_LOG_SIZE, sizeof(mqtt_standin_message_t));
+    if (!s->log) {
+        free(s);
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->client_fd = -1;
+    s->next_id = 1;
+
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (s->listen_fd < 0 ||
+        bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(s->listen_fd, 16) != 0 ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        if (s->listen_fd >= 0) close(s->listen_fd);
+        free(s->log);
+        free(s);
+        return NULL;
+    }
+    s->port = ntohs(addr.sin_port);
+
+    s->running = true;
+    if (pthread_create(&s->thread, NULL, mqtt_standin_thread, s) != 0) {
+        close(s->listen_fd);
+        free(s->log);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void mqtt_standin_stop(mqtt_standin_t *s) {
+    if (!s) return;
+    s->running = false;
+    pthread_join(s->thread, NULL);
+    close_client(s);
+    close(s->listen_fd);
+    pthread_mutex_destroy(&s->lock);
+    free(s->log);
+    free(s);
+}
+
+int mqtt_standin_port(const mqtt_standin_t *s) {
+    return s->port;
+}
+
+void mqtt_standin_publish(mqtt_standin_t *s, const char *topic, const char *payload) {
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < MQTT_STANDIN_SESSIONS; i++) {
+        session_t *session = &s->sessions[i];
+        if (!session->used || !subscribed(session, topic)) continue;
+        if (session == s->client) {
+            deliver(s, topic, payload);
+        } else if (session->queue_count < MQTT_STANDIN_QUEUE) {
+            queued_t *q = &session->queue[session->queue_count++];
+            snprintf(q->topic, sizeof(q->topic), "%s", topic);
+            snprintf(q->payload, sizeof(q->payload), "%s", payload);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void mqtt_standin_drop_acks(mqtt_standin_t *s, int count) {
+    pthread_mutex_lock(&s->lock);
+    s->drop_acks = count;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void mqtt_standin_set_ack_delay_ms(mqtt_standin_t *s, int delay_ms) {
+    pthread_mutex_lock(&s->lock);
+    s->ack_delay_ms = delay_ms;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// The broker thread owns the socket; it closes it on its next pass
+void mqtt_standin_kick(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    s->kick = true;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void mqtt_standin_clear_sessions(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    s->kick = true;
+    s->client = NULL;
+    memset(s->sessions, 0, sizeof(s->sessions));
+    pthread_mutex_unlock(&s->lock);
+}
+
+int mqtt_standin_publish_count(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->publish_count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+bool mqtt_standin_get_publish(mqtt_standin_t *s, int idx, mqtt_standin_message_t *out) {
+    bool ok = false;
+    pthread_mutex_lock(&s->lock);
+    if (idx >= 0 && idx < s->publish_count && idx >= s->publish_count - MQTT_STANDIN_LOG_SIZE) {
+        *out = s->log[idx % MQTT_STANDIN_LOG_SIZE];
+        ok = true;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+bool mqtt_standin_client_connected(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    bool connected = s->client != NULL;
+    pthread_mutex_unlock(&s->lock);
+    return connected;
+}
+
+int mqtt_standin_connect_count(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->connect_count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+int mqtt_standin_ping_count(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->ping_count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+int mqtt_standin_delivered_acks(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->delivered_acks;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+void mqtt_standin_clear(mqtt_standin_t *s) {
+    pthread_mutex_lock(&s->lock);
+    s->publish_count = 0;
+    s->connect_count = 0;
+    s->ping_count = 0;
+    s->delivered_acks = 0;
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,84 @@
+#ifndef MQTT_STANDIN_H
+#define MQTT_STANDIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal MQTT 3.1.1 broker standing in for Mosquitto in host tests and
+// benchmarks. Runs on a background thread bound to 127.0.0.1, serves one
+// client connection at a time and keeps persistent sessions (subscriptions
+// and queued QoS 1 messages) per client ID. Every PUBLISH it receives is
+// recorded.
+
+#define MQTT_STANDIN_MAX_PAYLOAD 1024
+
+typedef struct {
+    char topic[128];
+    char payload[MQTT_STANDIN_MAX_PAYLOAD];
+    size_t payload_len;
+    int qos;
+    bool dup;
+    uint16_t packet_id;
+} mqtt_standin_message_t;
+
+typedef struct mqtt_standin mqtt_standin_t;
+
+/**
+ * @brief Start the broker on an ephemeral port
+ * @return Broker handle, NULL on failure
+ */
+mqtt_standin_t *mqtt_standin_start(void);
+void mqtt_standin_stop(mqtt_standin_t *s);
+int mqtt_standin_port(const mqtt_standin_t *s);
+
+/**
+ * @brief Publish to topic with QoS 1, as another client would
+ *
+ * Delivered to the subscribed session now, or queued until it reconnects.
+ */
+void mqtt_standin_publish(mqtt_standin_t *s, const char *topic, const char *payload);
+
+/**
+ * @brief Do not acknowledge the next count PUBLISH packets (fault injection)
+ */
+void mqtt_standin_drop_acks(mqtt_standin_t *s, int count);
+
+/**
+ * @brief Send each PUBACK delay_ms after the PUBLISH arrived (latency injection)
+ */
+void mqtt_standin_set_ack_delay_ms(mqtt_standin_t *s, int delay_ms);
+
+/**
+ * @brief Close the current client connection; its session is kept
+ */
+void mqtt_standin_kick(mqtt_standin_t *s);
+
+/**
+ * @brief Forget every session (as if the broker restarted without persistence)
+ */
+void mqtt_standin_clear_sessions(mqtt_standin_t *s);
+
+int mqtt_standin_publish_count(mqtt_standin_t *s);
+
+/**
+ * @brief Copy of the idx-th recorded PUBLISH (only the last 64 are kept)
+ */
+bool mqtt_standin_get_publish(mqtt_standin_t *s, int idx, mqtt_standin_message_t *out);
+
+/**
+ * @brief True while a client holds an open, CONNECTed session
+ */
+bool mqtt_standin_client_connected(mqtt_standin_t *s);
+
+int mqtt_standin_connect_count(mqtt_standin_t *s);
+int mqtt_standin_ping_count(mqtt_standin_t *s);
+
+/**
+ * @brief PUBACKs received for messages the broker delivered
+ */
+int mqtt_standin_delivered_acks(mqtt_standin_t *s);
+
+void mqtt_standin_clear(mqtt_standin_t *s);
+
+#endif // MQTT_STANDIN_H
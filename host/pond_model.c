@@ -0,0 +1,66 @@
+#include <math.h>
+#include "aqua_config.h"
+#include "pond_model.h"
+
+#define DAY_MS (24LL * 3600 * 1000)
+
+static double frand(pond_model_t *p) {
+    p->rng = p->rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(p->rng >> 11) / 9007199254740992.0;
+}
+
+double pond_model_gauss(pond_model_t *p) {
+    double u = frand(p);
+    double v = frand(p);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+void pond_model_init(pond_model_t *p, uint32_t seed, double start_hour) {
+    p->rng = seed * 2654435761ULL + 1;
+    p->t_ms = (int64_t)(start_hour * 3600e3);
+    p->weather = 0.0;
+}
+
+double pond_model_hour(const pond_model_t *p) {
+    return (double)(p->t_ms % DAY_MS) / 3600e3;
+}
+
+// Oxygen saturation in fresh water, mg/L (Benson and Krause fit)
+static double do_saturation(double t) {
+    return 14.652 - 0.41022 * t + 0.007991 * t * t - 0.000077774 * t * t * t;
+}
+
+// Response to the feed given at hour fed, peaking two hours later
+static double feed_pulse(double hour, double fed) {
+    double x = (hour - fed) / 2.0;
+    if (x < 0) x += 12.0;               // Yesterday's feed at this time
+    return x * exp(1.0 - x);
+}
+
+static double steps(double v, double step) {
+    return round(v / step) * step;
+}
+
+void pond_model_next(pond_model_t *p, aqua_reading_t *r) {
+    double h = pond_model_hour(p);
+    double dt_h = SAMPLE_DELAY_MS / 3600e3;
+    p->weather += -p->weather * dt_h / 12.0 + 0.35 * sqrt(dt_h) * pond_model_gauss(p);
+
+    double sun = sin(2.0 * M_PI * (h - 10.0) / 24.0);     // Peak 16:00, trough 04:00
+    double warm = sin(2.0 * M_PI * (h - 9.0) / 24.0);
+    double fed = feed_pulse(h, 8.0) + feed_pulse(h, 17.0);
+
+    double water = 27.0 + p->weather + 1.2 * sun;
+    aqua_reading_clear(r);
+    r->water_temp = (float)steps(water + 0.03 * pond_model_gauss(p), 0.0625);
+    r->air_temp = (float)steps(water + 1.0 + 4.0 * warm + 0.5 * p->weather + 0.15 * pond_model_gauss(p), 0.1);
+    r->humidity = (float)steps(75.0 - 15.0 * warm - 2.0 * p->weather + 1.0 * pond_model_gauss(p), 0.1);
+    r->do_level = (float)(do_saturation(water) * (0.9 + 0.2 * sun) - 0.3 * fed + 0.08 * pond_model_gauss(p));
+    r->ph = (float)(7.5 + 0.45 * sun - 0.05 * fed + 0.03 * pond_model_gauss(p));
+    r->ammonia = (float)(0.15 + 0.1 * fed + 0.015 * pond_model_gauss(p));
+    r->turbidity = (float)(8.0 + 3.0 * fed + 1.5 * sun + 0.4 * pond_model_gauss(p));
+    r->has_time = true;
+    r->sampled_us = p->t_ms * 1000;
+
+    p->t_ms += SAMPLE_DELAY_MS;
+}
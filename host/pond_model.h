@@ -0,0 +1,44 @@
+#ifndef POND_MODEL_H
+#define POND_MODEL_H
+
+#include <stdint.h>
+#include "aqua_core.h"
+
+// Synthetic pond water for training and testing the anomaly detector
+// (main/aqua_anomaly.h), one reading every SAMPLE_DELAY_MS.
+//
+// Values follow the daily cycle of a stocked pond: water temperature peaks
+// in the afternoon; photosynthesis raises dissolved oxygen (towards
+// saturation at that temperature) and pH with it, and both bottom out at
+// dawn; feeding at 08:00 and 17:00 brings an ammonia and turbidity pulse;
+// the weather moves temperatures and humidity over hours. Probe noise and
+// resolution are added on top (0.0625 C steps for the DS18B20, 0.1 for the
+// DHT22). The same seed gives the same series on every run.
+
+typedef struct {
+    uint64_t rng;
+    int64_t t_ms;                       // Local time since midnight of day 0
+    double weather;                     // Temperature offset, mean-reverting walk
+} pond_model_t;
+
+/**
+ * @brief Start a series at a local hour of day 0
+ */
+void pond_model_init(pond_model_t *p, uint32_t seed, double start_hour);
+
+/**
+ * @brief Next reading, SAMPLE_DELAY_MS after the previous one
+ */
+void pond_model_next(pond_model_t *p, aqua_reading_t *r);
+
+/**
+ * @brief Local hour of the reading pond_model_next() returns next
+ */
+double pond_model_hour(const pond_model_t *p);
+
+/**
+ * @brief Standard normal draw from the series' generator
+ */
+double pond_model_gauss(pond_model_t *p);
+
+#endif // POND_MODEL_H
@@ -0,0 +1,324 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpc_standin.h"
+
+#define RPC_STANDIN_COMMANDS 64
+
+typedef struct {
+    int id;
+    char relay_type[32];
+    bool state;
+} command_t;
+
+// sensor_data's unique (device_id, seq) key from sql/upload_seq.sql
+typedef struct {
+    char device_id[32];
+    unsigned long seq;
+} row_key_t;
+
+struct rpc_standin {
+    standin_t *server;
+    pthread_mutex_t lock;
+    command_t commands[RPC_STANDIN_COMMANDS];
+    int command_count;
+    int next_id;
+    int row_count;
+    int duplicate_count;
+    row_key_t *keys;
+    int key_count;
+    int key_cap;
+    char last_row[1024];
+    int last_seen_id;
+};
+
+static void append_command(standin_reply_t *reply, const command_t *c, bool *first) {
+    size_t left = sizeof(reply->body) - reply->body_len;
+    int n = snprintf(reply->body + reply->body_len, left, "%s{\"id\":%d,\"relay_type\":\"%s\",\"state\":%s}",
+                     *first ? "" : ",", c->id, c->relay_type, c->state ? "true" : "false");
+    if (n > 0 && (size_t)n < left) {
+        reply->body_len += (size_t)n;
+    }
+    *first = false;
+}
+
+// The row's key; false if it has none (rows without seq never conflict)
+static bool row_key(const char *json, size_t len, row_key_t *key) {
+    char row[1024];
+    if (len >= sizeof(row)) len = sizeof(row) - 1;
+    memcpy(row, json, len);
+    row[len] = '\0';
+    const char *seq = strstr(row, "\"seq\":");
+    const char *device = strstr(row, "\"device_id\":\"");
+    if (!seq || !device) {
+        return false;
+    }
+    key->seq = strtoul(seq + strlen("\"seq\":"), NULL, 10);
+    device += strlen("\"device_id\":\"");
+    size_t n = strcspn(device, "\"");
+    if (n >= sizeof(key->device_id)) n = sizeof(key->device_id) - 1;
+    memcpy(key->device_id, device, n);
+    key->device_id[n] = '\0';
+    return true;
+}
+
+static bool key_stored(const rpc_standin_t *m, const row_key_t *key) {
+    for (int i = 0; i < m->key_count; i++) {
+        if (m->keys[i].seq == key->seq && strcmp(m->keys[i].device_id, key->device_id) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Skips a row whose key is already stored (ON CONFLICT DO NOTHING)
+static void store_row(rpc_standin_t *m, const char *json, size_t len) {
+    row_key_t key;
+    if (row_key(json, len, &key)) {
+        if (key_stored(m, &key)) {
+            m->duplicate_count++;
+            return;
+        }
+        if (m->key_count == m->key_cap) {
+            int cap = m->key_cap ? m->key_cap * 2 : 256;
+            row_key_t *keys = realloc(m->keys, (size_t)cap * sizeof(*keys));
+            if (!keys) return;
+            m->keys = keys;
+            m->key_cap = cap;
+        }
+        m->keys[m->key_count++] = key;
+    }
+
+    if (len >= sizeof(m->last_row)) len = sizeof(m->last_row) - 1;
+    memcpy(m->last_row, json, len);
+    m->last_row[len] = '\0';
+    m->row_count++;
+}
+
+// End of the JSON object starting at p
+static const char *object_end(const char *p) {
+    int depth = 0;
+    do {
+        if (*p == '{') depth++;
+        if (*p == '}') depth--;
+        p++;
+    } while (*p && depth > 0);
+    return p;
+}
+
+// Top-level keys of the object at json, comma-joined in order
+static void object_keys(const char *json, const char *end, char *out, size_t size) {
+    size_t n = 0;
+    int depth = 0;
+    bool key = false;
+    out[0] = '\0';
+    for (const char *p = json; p < end; p++) {
+        if (*p == '"') {
+            const char *close = p + 1;
+            while (close < end && *close != '"') close += *close == '\\' ? 2 : 1;
+            if (key && depth == 1) {
+                int w = snprintf(out + n, size - n, "%s%.*s", n ? "," : "", (int)(close - p - 1), p + 1);
+                n = w > 0 && (size_t)w < size - n ? n + (size_t)w : n;
+                key = false;
+            }
+            p = close;
+        } else if (*p == '{' || *p == '[') {
+            key = ++depth == 1;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == ',' && depth == 1) {
+            key = true;
+        }
+    }
+}
+
+// A PostgREST insert body is one row or an array of them. The rows of an
+// array must all have the same keys unless ?columns= lists them (400,
+// PGRST102). Without Prefer: resolution=ignore-duplicates a row whose key
+// is already stored fails the whole insert (409, unique violation) and
+// nothing is stored.
+static int store_rows(rpc_standin_t *m, const char *json, size_t len, bool ignore_duplicates, bool columns) {
+    bool array = len > 0 && json[0] == '[';
+    const char *rows = array ? strchr(json, '{') : NULL;
+    if (rows && !columns) {
+        char first[512], keys[512];
+        object_keys(rows, object_end(rows), first, sizeof(first));
+        for (const char *p = rows; p; p = strchr(p, '{')) {
+            const char *end = object_end(p);
+            object_keys(p, end, keys, sizeof(keys));
+            if (strcmp(keys, first) != 0) {
+                return 400;
+            }
+            p = end;
+        }
+    }
+    if (!ignore_duplicates) {
+        for (const char *p = array ? strchr(json, '{') : json; p && *p; p = array ? strchr(p, '{') : NULL) {
+            const char *end = array ? object_end(p) : json + len;
+            row_key_t key;
+            if (row_key(p, (size_t)(end - p), &key) && key_stored(m, &key)) {
+                return 409;
+            }
+            p = end;
+        }
+    }
+
+    if (!array) {
+        store_row(m, json, len);
+        return 201;
+    }
+    for (const char *p = strchr(json, '{'); p; p = strchr(p, '{')) {
+        const char *end = object_end(p);
+        store_row(m, p, (size_t)(end - p));
+        p = end;
+    }
+    return 201;
+}
+
+// Mirrors public.ingest_reading(): store the row, return newer commands
+static void ingest_reading(rpc_standin_t *m, const standin_request_t *req, standin_reply_t *reply) {
+    const char *row = strstr(req->body, "\"reading\":");
+    const char *last = strstr(req->body, "\"last_command_id\":");
+    if (!row || !last) {
+        reply->status = 400;
+        reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body),
+                                           "{\"message\":\"missing reading or last_command_id\"}");
+        return;
+    }
+
+    row += strlen("\"reading\":");
+    const char *end = object_end(row);
+    store_row(m, row, (size_t)(end - row));
+
+    long after = strtol(last + strlen("\"last_command_id\":"), NULL, 10);
+    m->last_seen_id = (int)after;
+
+    reply->status = 200;
+    reply->body_len = 1;
+    reply->body[0] = '[';
+    bool first = true;
+    for (int i = 0; i < m->command_count; i++) {
+        const command_t *c = &m->commands[i];
+        if (after > 0) {
+            if (c->id > after) append_command(reply, c, &first);
+            continue;
+        }
+        // Fresh boot: newest command per relay only
+        bool newest = true;
+        for (int j = i + 1; j < m->command_count; j++) {
+            if (strcmp(m->commands[j].relay_type, c->relay_type) == 0) newest = false;
+        }
+        if (newest) append_command(reply, c, &first);
+    }
+    reply->body[reply->body_len++] = ']';
+    reply->body[reply->body_len] = '\0';
+}
+
+// PostgREST-style relay_commands poll: newest first, limit 10
+static void list_commands(rpc_standin_t *m, standin_reply_t *reply) {
+    reply->status = 200;
+    reply->body_len = 1;
+    reply->body[0] = '[';
+    bool first = true;
+    for (int i = m->command_count - 1; i >= 0 && i >= m->command_count - 10; i--) {
+        append_command(reply, &m->commands[i], &first);
+    }
+    reply->body[reply->body_len++] = ']';
+    reply->body[reply->body_len] = '\0';
+}
+
+static bool handle(const standin_request_t *req, standin_reply_t *reply, void *ctx) {
+    rpc_standin_t *m = ctx;
+    bool handled = true;
+
+    pthread_mutex_lock(&m->lock);
+    reply->content_type = "application/json";
+    if (strcmp(req->method, "POST") == 0 && strstr(req->path, "/rpc/ingest_reading")) {
+        ingest_reading(m, req, reply);
+    } else if (strcmp(req->method, "GET") == 0 && strstr(req->path, "/relay_commands")) {
+        list_commands(m, reply);
+    } else if (strcmp(req->method, "POST") == 0 && strstr(req->path, "/sensor_data") &&
+               !strstr(req->path, "/alerts")) {
+        reply->status = store_rows(m, req->body, req->body_len,
+                                   strstr(req->headers, "resolution=ignore-duplicates") != NULL,
+                                   strstr(req->path, "columns=") != NULL);
+        if (reply->status == 201) {
+            reply->body_len = 0;
+        } else if (reply->status == 400) {
+            reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body),
+                                               "{\"code\":\"PGRST102\",\"message\":\"All object keys must match\"}");
+        } else {
+            reply->body_len = (size_t)snprintf(reply->body, sizeof(reply->body),
+                                               "{\"code\":\"23505\",\"message\":\"duplicate key value "
+                                               "violates unique constraint \\\"sensor_data_device_seq_key\\\"\"}");
+        }
+    } else {
+        handled = false;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return handled;
+}
+
+rpc_standin_t *rpc_standin_attach(standin_t *server) {
+    rpc_standin_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    pthread_mutex_init(&m->lock, NULL);
+    m->server = server;
+    m->next_id = 1;
+    m->last_seen_id = -1;
+    standin_set_handler(server, handle, m);
+    return m;
+}
+
+void rpc_standin_detach(rpc_standin_t *m) {
+    if (!m) return;
+    standin_set_handler(m->server, NULL, NULL);
+    pthread_mutex_destroy(&m->lock);
+    free(m->keys);
+    free(m);
+}
+
+int rpc_standin_add_command(rpc_standin_t *m, const char *relay_type, bool state) {
+    pthread_mutex_lock(&m->lock);
+    if (m->command_count == RPC_STANDIN_COMMANDS) {
+        memmove(m->commands, m->commands + 1, sizeof(m->commands) - sizeof(m->commands[0]));
+        m->command_count--;
+    }
+    command_t *c = &m->commands[m->command_count++];
+    c->id = m->next_id++;
+    snprintf(c->relay_type, sizeof(c->relay_type), "%s", relay_type);
+    c->state = state;
+    int id = c->id;
+    pthread_mutex_unlock(&m->lock);
+    return id;
+}
+
+int rpc_standin_row_count(rpc_standin_t *m) {
+    pthread_mutex_lock(&m->lock);
+    int count = m->row_count;
+    pthread_mutex_unlock(&m->lock);
+    return count;
+}
+
+bool rpc_standin_last_row(rpc_standin_t *m, char *out, size_t size) {
+    pthread_mutex_lock(&m->lock);
+    bool ok = m->row_count > 0;
+    if (ok) snprintf(out, size, "%s", m->last_row);
+    pthread_mutex_unlock(&m->lock);
+    return ok;
+}
+
+int rpc_standin_last_seen_id(rpc_standin_t *m) {
+    pthread_mutex_lock(&m->lock);
+    int id = m->last_seen_id;
+    pthread_mutex_unlock(&m->lock);
+    return id;
+}
+
+int rpc_standin_duplicate_count(rpc_standin_t *m) {
+    pthread_mutex_lock(&m->lock);
+    int count = m->duplicate_count;
+    pthread_mutex_unlock(&m->lock);
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef RPC_STANDIN_H
+#define RPC_STANDIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "http_standin.h"
+
+// In-memory model of the Supabase tables behind an HTTP stand-in: the
+// sensor_data and relay_commands tables, and the ingest_reading RPC from
+// sql/ingest_reading.sql. It answers the REST upload, the relay_commands
+// poll and the combined exchange, so both cycle variants can be tested
+// offline against the same state. Rows carrying device_id and seq are
+// unique on that pair, as with sql/upload_seq.sql.
+
+typedef struct rpc_standin rpc_standin_t;
+
+/**
+ * @brief Install the model as the stand-in's request handler
+ */
+rpc_standin_t *rpc_standin_attach(standin_t *server);
+void rpc_standin_detach(rpc_standin_t *m);
+
+/**
+ * @brief Insert a relay_commands row
+ * @return The new command ID
+ */
+int rpc_standin_add_command(rpc_standin_t *m, const char *relay_type, bool state);
+
+int rpc_standin_row_count(rpc_standin_t *m);
+
+/**
+ * @brief Rows skipped because their (device_id, seq) was already stored
+ */
+int rpc_standin_duplicate_count(rpc_standin_t *m);
+
+/**
+ * @brief JSON of the newest sensor_data row
+ */
+bool rpc_standin_last_row(rpc_standin_t *m, char *out, size_t size);
+
+/**
+ * @brief last_command_id sent with the newest ingest_reading call (-1 before any)
+ */
+int rpc_standin_last_seen_id(rpc_standin_t *m);
+
+#endif // RPC_STANDIN_H
@@ -0,0 +1,239 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "pond_model.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Anomaly detector: the vectorised path against the scalar reference, the
+// golden check, a normal pond day, a water event against a drifting probe,
+// missing probes, and the alert payload.
+
+#define DAY_SAMPLES (24 * 3600 * 1000 / SAMPLE_DELAY_MS)
+#define FAULT_SAMPLES 180
+
+static standin_t *server;
+
+typedef enum { FAULT_EVENT, FAULT_PH_PROBE } fault_t;
+
+// Afternoon water, settled from 14:00, then an hour-long ramp into a fault
+// (the trainer's check faults)
+static void start(pond_model_t *pond) {
+    aqua_anomaly_init();
+    pond_model_init(pond, 3, 14.0);
+    aqua_reading_t r;
+    while (pond_model_hour(pond) < 15.0) {
+        pond_model_next(pond, &r);
+        aqua_anomaly_observe(&r);
+    }
+}
+
+static void inject(fault_t fault, int i, aqua_reading_t *r) {
+    float f = (float)(i < 60 ? i : 60) / 60.0f;
+    if (fault == FAULT_EVENT) {
+        r->water_temp += 1.5f * f;
+        r->do_level -= 2.5f * f;
+        r->ammonia += 0.4f * f;
+    } else {
+        r->ph -= 1.0f * f;
+    }
+}
+
+// Feeds the fault; returns the samples it was raised for
+static int run_fault(fault_t fault, int samples, uint8_t health) {
+    pond_model_t pond;
+    start(&pond);
+    int raised = 0;
+    for (int i = 0; i < samples; i++) {
+        aqua_reading_t r;
+        pond_model_next(&pond, &r);
+        inject(fault, i, &r);
+        if (health) {
+            r.has_health = true;
+            memset(r.health, health, sizeof(r.health));
+        }
+        raised += aqua_anomaly_observe(&r)->raised;
+    }
+    return raised;
+}
+
+// ========== INFERENCE ==========
+static uint32_t rng = 12345;
+
+static int16_t rand8(void) {
+    rng = rng * 1103515245u + 12345u;
+    return (int16_t)((int)((rng >> 16) % 255) - 127);
+}
+
+static void test_vector_matches_reference(void) {
+    // The built-in model, and a full random one that saturates the hidden layer
+    static aqua_anomaly_model_t random_model;
+    for (int k = 0; k < AQUA_ANOMALY_COMPONENTS; k++) {
+        for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+            random_model.enc[k][i] = rand8();
+            random_model.dec[i][k] = rand8();
+        }
+    }
+    random_model.components = AQUA_ANOMALY_COMPONENTS;
+    const aqua_anomaly_model_t *models[] = { aqua_anomaly_model(), &random_model };
+
+    int mismatches = 0;
+    for (int m = 0; m < 2; m++) {
+        for (int n = 0; n < 2000; n++) {
+            int16_t x[AQUA_ANOMALY_FEATURES] AQUA_ANOMALY_ALIGNED;
+            for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+                x[i] = n == 0 ? 127 : n == 1 ? -127 : rand8();
+            }
+            int32_t want[AQUA_ANOMALY_FEATURES], got[AQUA_ANOMALY_FEATURES];
+            int32_t a = aqua_anomaly_score_ref(models[m], x, want);
+            int32_t b = aqua_anomaly_score(models[m], x, got);
+            mismatches += a != b || memcmp(want, got, sizeof(want)) != 0;
+        }
+    }
+    CHECK_EQ_INT(mismatches, 0);
+}
+
+static void test_quantize(void) {
+    aqua_anomaly_model_t m = {0};
+    float features[AQUA_ANOMALY_FEATURES];
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        m.mean[i] = 1.0f;
+        m.scale[i] = 10.0f;
+        features[i] = 1.0f;
+    }
+    features[0] = 1.25f;        // 2.5 rounds away from zero
+    features[1] = 0.75f;
+    features[2] = 100.0f;       // Clamped
+    features[3] = -100.0f;
+    features[4] = NAN;          // Missing: the mean
+    m.scale[5] = 0.0f;          // Not in the model
+    features[5] = 50.0f;
+    int16_t x[AQUA_ANOMALY_FEATURES];
+    aqua_anomaly_quantize(&m, features, x);
+    CHECK_EQ_INT(x[0], 3);
+    CHECK_EQ_INT(x[1], -3);
+    CHECK_EQ_INT(x[2], 127);
+    CHECK_EQ_INT(x[3], -127);
+    CHECK_EQ_INT(x[4], 0);
+    CHECK_EQ_INT(x[5], 0);
+    CHECK_EQ_INT(x[6], 0);
+}
+
+static void test_golden(void) {
+    aqua_anomaly_init();
+    CHECK(aqua_anomaly_get_stats()->model_ok);
+    CHECK(aqua_anomaly_get_stats()->vector_ok);
+    CHECK_STR(aqua_anomaly_backend(), "vector");
+    CHECK(aqua_anomaly_model()->components > 0);
+    CHECK(aqua_anomaly_model()->components <= AQUA_ANOMALY_COMPONENTS);
+}
+
+// ========== DETECTOR ==========
+static void test_normal_day(void) {
+    aqua_anomaly_init();
+    pond_model_t pond;
+    pond_model_init(&pond, 3, 0.0);
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        aqua_reading_t r;
+        pond_model_next(&pond, &r);
+        aqua_anomaly_observe(&r);
+    }
+    CHECK_EQ_INT(aqua_anomaly_get_stats()->samples, DAY_SAMPLES);
+    CHECK(aqua_anomaly_get_stats()->above < DAY_SAMPLES / 1000);
+    CHECK_EQ_INT(aqua_anomaly_get_stats()->raised, 0);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly, 0);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, 0);
+}
+
+static void test_water_event(void) {
+    CHECK(run_fault(FAULT_EVENT, FAULT_SAMPLES, 0) > FAULT_SAMPLES / 2);
+    uint32_t both = AQUA_ALERT_BIT(AQUA_MEAS_WATER_TEMP) | AQUA_ALERT_BIT(AQUA_MEAS_DO);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly & both, both);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly & AQUA_ALERT_BIT(AQUA_MEAS_PH), 0);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, 0);
+    CHECK_EQ_INT(aqua_anomaly_get_stats()->raised, 1);
+}
+
+static void test_probe_drift(void) {
+    CHECK(run_fault(FAULT_PH_PROBE, FAULT_SAMPLES, 0) > FAULT_SAMPLES / 2);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, AQUA_ALERT_BIT(AQUA_MEAS_PH));
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly, 0);
+}
+
+static void test_degraded_probe(void) {
+    // The same water event, but the probe carrying most of it reads unhealthy
+    CHECK(run_fault(FAULT_EVENT, FAULT_SAMPLES, HEALTH_DEGRADED_BELOW - 1) > FAULT_SAMPLES / 2);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, AQUA_ALERT_BIT(AQUA_MEAS_DO));
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly, 0);
+}
+
+static void test_missing_probe(void) {
+    // A day without the pH probe: its features are left out, not scored as 0
+    aqua_anomaly_init();
+    pond_model_t pond;
+    pond_model_init(&pond, 3, 0.0);
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        aqua_reading_t r;
+        pond_model_next(&pond, &r);
+        r.ph = AQUA_SENSOR_ERROR;
+        const aqua_anomaly_result_t *res = aqua_anomaly_observe(&r);
+        if (i == DAY_SAMPLES / 2) {
+            CHECK(res->dominant != AQUA_MEAS_PH);
+        }
+    }
+    CHECK_EQ_INT(aqua_anomaly_get_stats()->raised, 0);
+}
+
+static void test_alert_payload(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    supabase_outbound_reset();
+
+    run_fault(FAULT_PH_PROBE, FAULT_SAMPLES, 0);
+    int before = standin_request_count(server);
+    check_and_send_alerts(27.0f, 7.0f, 6.8f, 0.2f, 10.0f);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    standin_request_t req;
+    CHECK(standin_get_request(server, before, &req));
+    CHECK(strstr(req.body, "\"suspect_probe\":[\"ph\"]") != NULL);
+    CHECK(strstr(req.body, "\"anomaly\"") == NULL);
+
+    // Cleared once the probe reads normally again
+    pond_model_t pond;
+    start(&pond);
+    before = standin_request_count(server);
+    check_and_send_alerts(27.0f, 7.0f, 6.8f, 0.2f, 10.0f);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    CHECK(standin_get_request(server, before, &req));
+    CHECK(strstr(req.body, "suspect_probe") == NULL);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_vector_matches_reference);
+    RUN_TEST(test_quantize);
+    RUN_TEST(test_golden);
+    RUN_TEST(test_normal_day);
+    RUN_TEST(test_water_event);
+    RUN_TEST(test_probe_drift);
+    RUN_TEST(test_degraded_probe);
+    RUN_TEST(test_missing_probe);
+    RUN_TEST(test_alert_payload);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
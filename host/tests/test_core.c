@@ -0,0 +1,366 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_params.h"
+#include "aqua_registry.h"
+#include "ca_anchors.h"
+#include "ca_der.h"
+#include "test_util.h"
+
+static const aqua_reading_t nominal = {
+    .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+    .do_level = AQUA_SENSOR_ERROR, .turbidity = 10.0f, .ammonia = AQUA_SENSOR_ERROR
+};
+
+static void test_crc8(void) {
+    // DS18B20 datasheet power-on scratchpad
+    const uint8_t scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+    CHECK_EQ_INT(aqua_crc8(scratchpad, 8), 0x1C);
+    CHECK_EQ_INT(aqua_crc8(scratchpad, 9), 0x00);
+    CHECK_NEAR(aqua_ds18b20_raw_to_c(scratchpad), 85.0, 1e-6);
+
+    const uint8_t negative[2] = { 0x5E, 0xFF };    // -10.125 °C
+    CHECK_NEAR(aqua_ds18b20_raw_to_c(negative), -10.125, 1e-6);
+}
+
+static void test_conversions(void) {
+    const int samples[10] = { 2490, 2510, 2500, 2500, 2495, 2505, 2500, 2500, 2500, 2500 };
+    CHECK_EQ_INT(aqua_average_mv(samples, 10), 2500);
+    CHECK_NEAR(aqua_mv_to_ph(2500), 7.0, 1e-6);
+    CHECK_NEAR(aqua_mv_to_ph(5000), -1.0, 1e-6);     // below pH 0
+    CHECK_NEAR(aqua_mv_to_do(40), 8.0, 1e-5);
+    CHECK_NEAR(aqua_mv_to_do(4095), -1.0, 1e-6);     // floating input
+    CHECK_NEAR(aqua_mv_to_turbidity(20), 10.0, 1e-6);
+    CHECK_NEAR(aqua_mv_to_ammonia(5), 0.5, 1e-6);
+}
+
+static void test_dht22_decode(void) {
+    const uint8_t frame[5] = { 0x02, 0x58, 0x01, 0x09, 0x64 };  // 60.0 %, 26.5 °C
+    float hum = 0, temp = 0;
+    CHECK_EQ_INT(aqua_dht22_decode(frame, &hum, &temp), ESP_OK);
+    CHECK_NEAR(hum, 60.0, 1e-5);
+    CHECK_NEAR(temp, 26.5, 1e-5);
+
+    const uint8_t bad_crc[5] = { 0x02, 0x58, 0x01, 0x09, 0x65 };
+    CHECK_EQ_INT(aqua_dht22_decode(bad_crc, &hum, &temp), ESP_ERR_INVALID_CRC);
+
+    const uint8_t out_of_range[5] = { 0x27, 0x10, 0x01, 0x09, 0x41 };  // 1000 %
+    CHECK_EQ_INT(aqua_dht22_decode(out_of_range, &hum, &temp), ESP_ERR_INVALID_RESPONSE);
+}
+
+static void test_payload(void) {
+    aqua_controls_t controls = { .aerator = true };
+    char buf[512];
+
+    int len = aqua_build_payload(&nominal, &controls, buf, sizeof(buf));
+    CHECK_STR(buf, "{\"air_temperature\":26.50,\"humidity\":60.00,\"water_temperature\":25.50,"
+                   "\"ph\":7.00,\"turbidity\":10.00,"
+                   "\"ph_relay\":false,\"aerator\":true,\"filter\":false,\"pump\":false}");
+    CHECK_EQ_INT(len, (int)strlen(buf));
+
+    aqua_reading_t all = nominal;
+    all.do_level = 8.0f;
+    all.ammonia = 0.25f;
+    aqua_build_payload(&all, &controls, buf, sizeof(buf));
+    CHECK(strstr(buf, ",\"dissolved_oxygen\":8.00,\"turbidity\":10.00,\"ammonia\":0.25,") != NULL);
+
+    char small[40];
+    CHECK_EQ_INT(aqua_build_payload(&nominal, &controls, small, sizeof(small)), -1);
+
+    // Numbered rows carry the key the server dedupes retries on
+    aqua_reading_t numbered = nominal;
+    numbered.seq = 4242;
+    aqua_build_payload(&numbered, &controls, buf, sizeof(buf));
+    CHECK(strstr(buf, "\"pump\":false,\"device_id\":\"" AQUA_DEVICE_ID "\",\"seq\":4242") != NULL);
+}
+
+static void test_exchange_payload(void) {
+    aqua_controls_t controls = { .aerator = true };
+    char row[512], buf[640], expected[700];
+
+    aqua_build_payload(&nominal, &controls, row, sizeof(row));
+    int len = aqua_build_exchange_payload(&nominal, &controls, 42, buf, sizeof(buf));
+    snprintf(expected, sizeof(expected), "{\"reading\":%s,\"last_command_id\":42}", row);
+    CHECK_STR(buf, expected);
+    CHECK_EQ_INT(len, (int)strlen(buf));
+
+    // Row fits but the trailer does not
+    char small[180];
+    CHECK_EQ_INT(aqua_build_exchange_payload(&nominal, &controls, 42, small, sizeof(small)), -1);
+}
+
+static void test_validation(void) {
+    aqua_reading_t r = nominal;
+    CHECK(aqua_validate_reading(&r));
+    CHECK_EQ_INT(aqua_count_missing_critical(&r), 0);
+
+    r.water_temp = AQUA_SENSOR_ERROR;
+    r.ph = AQUA_SENSOR_ERROR;
+    CHECK(aqua_validate_reading(&r));
+    CHECK_EQ_INT(aqua_count_missing_critical(&r), 2);
+
+    r.humidity = 120.0f;
+    CHECK(!aqua_validate_reading(&r));
+}
+
+static void test_alerts(void) {
+    aqua_alert_states_t none = {0}, current;
+    aqua_params_t p;
+    aqua_params_defaults(&p);
+    aqua_eval_alerts(&nominal, &p, &current);
+    // Missing DO/ammonia read as -999: a probe fault for sensor health, not a low value
+    CHECK_EQ_INT(current.low, 0);
+    CHECK_EQ_INT(current.high, 0);
+    CHECK(!aqua_alerts_changed(&none, &current));
+
+    aqua_reading_t low_do = nominal;
+    low_do.do_level = 3.0f;
+    aqua_eval_alerts(&low_do, &p, &current);
+    CHECK_EQ_INT(current.low, AQUA_ALERT_BIT(AQUA_MEAS_DO));
+    CHECK(aqua_alerts_changed(&none, &current));
+    CHECK(!aqua_alerts_changed(&current, &current));
+
+    char buf[384];
+    int len = aqua_build_alert_payload(&current, &low_do, buf, sizeof(buf));
+    CHECK(len > 0);
+    int depth = 0, min_depth = 0;
+    for (int i = 0; i < len; i++) {
+        if (buf[i] == '{') depth++;
+        if (buf[i] == '}') depth--;
+        if (i < len - 1 && depth < 1) min_depth = -1;
+    }
+    CHECK_EQ_INT(depth, 0);
+    CHECK_EQ_INT(min_depth, 0);
+    CHECK(strstr(buf, "\"low_dissolved_oxygen\":true") != NULL);
+    CHECK(strstr(buf, "\"high_temperature\":false,\"low_temperature\":false") != NULL);
+    CHECK(strstr(buf, "\"water_temp\":25.50,\"ph\":7.00,\"do_level\":3.00,") != NULL);
+
+    // A warm-water species: 25.5 °C is now too cold
+    p.temp_min = 26.0f;
+    p.temp_max = 32.0f;
+    aqua_eval_alerts(&nominal, &p, &current);
+    CHECK(current.low & AQUA_ALERT_BIT(AQUA_MEAS_WATER_TEMP));
+    CHECK(!(current.high & AQUA_ALERT_BIT(AQUA_MEAS_WATER_TEMP)));
+}
+
+static void test_controls(void) {
+    aqua_controls_t c;
+    aqua_params_t p;
+    aqua_params_defaults(&p);
+    aqua_decide_controls(&nominal, &p, &c);
+    CHECK(!c.ph_relay);
+    CHECK(c.aerator);       // DO missing counts as low
+    CHECK(!c.filter);
+    CHECK(!c.pump);
+
+    aqua_reading_t r = nominal;
+    r.ph = 6.0f;
+    r.turbidity = 45.0f;
+    r.ammonia = 2.0f;
+    r.do_level = 7.5f;
+    aqua_decide_controls(&r, &p, &c);
+    CHECK(c.ph_relay && !c.aerator && c.filter && c.pump);
+
+    // Cut-offs follow the parameters, not the factory values
+    p.ph_relay_on_below = 5.5f;
+    p.aerator_on_below = 8.0f;
+    p.filter_on_above = 50.0f;
+    p.pump_on_above = 2.5f;
+    aqua_decide_controls(&r, &p, &c);
+    CHECK(!c.ph_relay && c.aerator && !c.filter && !c.pump);
+}
+
+static void test_params_validation(void) {
+    aqua_params_t p;
+    aqua_params_defaults(&p);
+    CHECK_EQ_INT(p.version, 0);
+    CHECK(aqua_params_valid(&p));
+
+    aqua_params_t bad = p;
+    bad.temp_min = bad.temp_max;            // Empty band
+    CHECK(!aqua_params_valid(&bad));
+    bad = p;
+    bad.ph_max = 15.0f;
+    CHECK(!aqua_params_valid(&bad));
+    bad = p;
+    bad.aerator_on_below = -1.0f;
+    CHECK(!aqua_params_valid(&bad));
+    bad = p;
+    bad.turbidity_max = NAN;
+    CHECK(!aqua_params_valid(&bad));
+}
+
+static void test_params_parse(void) {
+    aqua_params_t base, p;
+    aqua_params_defaults(&base);
+
+    // PostgREST row: partial, extra columns and nulls keep the base values
+    const char *row = "[{\"id\":9,\"device_id\":\"pond-01\",\"version\":3,\"temp_min\":24.5,"
+                      "\"aerator_on_below\":5.5,\"ph_max\":null,\"pump_on_above\":-0.5e0}]";
+    CHECK_EQ_INT(aqua_parse_params(row, &base, &p), 1);
+    CHECK_EQ_INT(p.version, 3);
+    CHECK_NEAR(p.temp_min, 24.5, 1e-6);
+    CHECK_NEAR(p.aerator_on_below, 5.5, 1e-6);
+    CHECK_NEAR(p.ph_max, base.ph_max, 1e-6);
+    CHECK_NEAR(p.temp_max, base.temp_max, 1e-6);
+    CHECK_NEAR(p.pump_on_above, -0.5, 1e-6);
+    CHECK(!aqua_params_valid(&p));          // Parsed, but refused later
+
+    CHECK_EQ_INT(aqua_parse_params("{\"version\":4}", &base, &p), 1);
+    CHECK_EQ_INT(p.version, 4);
+    CHECK_EQ_INT(aqua_parse_params(" [ ] ", &base, &p), 0);
+    CHECK_EQ_INT(aqua_parse_params("[{\"temp_min\":24.5}]", &base, &p), -1);
+    CHECK_EQ_INT(aqua_parse_params("[{\"version\":4},{\"version\":3}]", &base, &p), -1);
+    CHECK_EQ_INT(aqua_parse_params("[{\"version\":4,\"do_min\":\"high\"}]", &base, &p), -1);
+    CHECK_EQ_INT(aqua_parse_params("{\"version\":4", &base, &p), -1);
+}
+
+typedef struct {
+    char types[8][32];
+    bool states[8];
+    int count;
+} collected_t;
+
+static void collect(const char *type, bool state, void *ctx) {
+    collected_t *c = ctx;
+    if (c->count < 8) {
+        snprintf(c->types[c->count], sizeof(c->types[0]), "%s", type);
+        c->states[c->count] = state;
+    }
+    c->count++;
+}
+
+static void test_relay_commands(void) {
+    collected_t c = {0};
+    const char *json =
+        "[ {\"id\": 7, \"relay_type\": \"ph\", \"state\": true, \"timestamp\": \"2025-01-01T00:00:00\"},"
+        "  {\"relay_type\":\"aerator\",\"meta\":{\"by\":\"app\",\"tags\":[1,2]},\"state\":false},"
+        "  {\"relay_type\":\"filter\",\"state\":\"on\"},"
+        "  {\"relay_type\":\"pu\\\"mp\",\"state\":null} ]";
+    CHECK_EQ_INT(aqua_parse_relay_commands(json, collect, &c), 2);
+    CHECK_STR(c.types[0], "ph");
+    CHECK(c.states[0]);
+    CHECK_STR(c.types[1], "aerator");
+    CHECK(!c.states[1]);
+
+    c.count = 0;
+    CHECK_EQ_INT(aqua_parse_relay_commands("[]", collect, &c), 0);
+    CHECK_EQ_INT(aqua_parse_relay_commands("{\"message\":\"no\"}", collect, &c), -1);
+    CHECK_EQ_INT(aqua_parse_relay_commands("[{\"relay_type\":\"ph\",", collect, &c), -1);
+    CHECK_EQ_INT(c.count, 0);
+}
+
+static void test_relay_commands_after(void) {
+    collected_t c = {0};
+    int32_t max_id = 5;
+    const char *json =
+        "[{\"id\":4,\"relay_type\":\"ph\",\"state\":true},"
+        " {\"id\":6,\"relay_type\":\"aerator\",\"state\":false},"
+        " {\"relay_type\":\"filter\",\"state\":true},"
+        " {\"id\":9,\"relay_type\":\"pump\",\"state\":true}]";
+    // Only commands newer than the last applied one
+    CHECK_EQ_INT(aqua_parse_relay_commands_after(json, 5, collect, &c, &max_id), 2);
+    CHECK_STR(c.types[0], "aerator");
+    CHECK_STR(c.types[1], "pump");
+    CHECK_EQ_INT(max_id, 9);
+
+    c.count = 0;
+    max_id = 0;
+    CHECK_EQ_INT(aqua_parse_relay_commands_after(json, -1, collect, &c, &max_id), 4);
+    CHECK_EQ_INT(max_id, 9);
+    CHECK_EQ_INT(aqua_parse_relay_commands_after("[]", 3, collect, &c, NULL), 0);
+}
+
+static size_t read_pem(const char *name, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", AQUA_CERT_DIR, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t n = fread(buf, 1, size, f);
+    fclose(f);
+    return n;
+}
+
+static void test_ca_der_import(void) {
+    static char pem[8192];
+    static uint8_t bundle[8192];
+    size_t pem_len = read_pem("gts_root_r4.pem", pem, sizeof(pem));
+    pem_len += read_pem("isrg_root_x1.pem", pem + pem_len, sizeof(pem) - pem_len);
+    CHECK_EQ_INT((int)pem_len, AQUA_CA_ANCHORS_PEM_BYTES);
+
+    size_t len = 0;
+    CHECK_EQ_INT(ca_der_import_pem(pem, pem_len, bundle, sizeof(bundle), &len), 2);
+    CHECK_EQ_INT((int)len, (int)sizeof(aqua_ca_anchors));
+    CHECK(memcmp(bundle, aqua_ca_anchors, len) == 0);
+    CHECK_EQ_INT(ca_der_count(aqua_ca_anchors, sizeof(aqua_ca_anchors)), AQUA_CA_ANCHORS_COUNT);
+
+    // Entries walk in order, each a complete DER SEQUENCE
+    size_t pos = 0, der_len = 0, total = 0;
+    const uint8_t *der;
+    int n = 0;
+    while (ca_der_next(aqua_ca_anchors, sizeof(aqua_ca_anchors), &pos, &der, &der_len)) {
+        CHECK_EQ_INT(der[0], 0x30);
+        CHECK_EQ_INT((int)ca_der_cert_length(der, der_len), (int)der_len);
+        total += 2 + der_len;
+        n++;
+    }
+    CHECK_EQ_INT(n, 2);
+    CHECK_EQ_INT((int)total, (int)sizeof(aqua_ca_anchors));
+    // DER is about a quarter smaller than the PEM it came from
+    CHECK(len * 4 < pem_len * 3 + 200);
+
+    // Output too small
+    CHECK_EQ_INT(ca_der_import_pem(pem, pem_len, bundle, 1000, &len), -1);
+    // No certificates at all
+    CHECK_EQ_INT(ca_der_import_pem("hello", 5, bundle, sizeof(bundle), &len), 0);
+}
+
+static void test_ca_der_malformed(void) {
+    uint8_t bundle[64];
+    size_t len = 0;
+
+    const char *bad_b64 = "-----BEGIN CERTIFICATE-----\nMII*\n-----END CERTIFICATE-----\n";
+    CHECK_EQ_INT(ca_der_import_pem(bad_b64, strlen(bad_b64), bundle, sizeof(bundle), &len), -1);
+    const char *no_end = "-----BEGIN CERTIFICATE-----\nMAA=\n";
+    CHECK_EQ_INT(ca_der_import_pem(no_end, strlen(no_end), bundle, sizeof(bundle), &len), -1);
+    // "MAA=" is an empty SEQUENCE; "MAE=" claims a 1-byte body it lacks
+    const char *empty_seq = "-----BEGIN CERTIFICATE-----\nMAA=\n-----END CERTIFICATE-----\n";
+    CHECK_EQ_INT(ca_der_import_pem(empty_seq, strlen(empty_seq), bundle, sizeof(bundle), &len), 1);
+    CHECK_EQ_INT((int)len, 4);
+    const char *short_seq = "-----BEGIN CERTIFICATE-----\nMAE=\n-----END CERTIFICATE-----\n";
+    CHECK_EQ_INT(ca_der_import_pem(short_seq, strlen(short_seq), bundle, sizeof(bundle), &len), -1);
+
+    // Not a SEQUENCE, or a long-form length running past the buffer
+    const uint8_t not_seq[] = { 0x31, 0x00 };
+    CHECK_EQ_INT((int)ca_der_cert_length(not_seq, sizeof(not_seq)), 0);
+    const uint8_t long_form[] = { 0x30, 0x82, 0x01, 0x00, 0x00 };
+    CHECK_EQ_INT((int)ca_der_cert_length(long_form, sizeof(long_form)), 0);
+
+    // Entry length past the end, and trailing garbage
+    const uint8_t truncated[] = { 0x00, 0x05, 0x30, 0x00 };
+    CHECK_EQ_INT(ca_der_count(truncated, sizeof(truncated)), -1);
+    const uint8_t trailing[] = { 0x00, 0x02, 0x30, 0x00, 0x00 };
+    CHECK_EQ_INT(ca_der_count(trailing, sizeof(trailing)), -1);
+    CHECK_EQ_INT(ca_der_count(trailing, 4), 1);
+}
+
+int main(void) {
+    RUN_TEST(test_crc8);
+    RUN_TEST(test_conversions);
+    RUN_TEST(test_dht22_decode);
+    RUN_TEST(test_payload);
+    RUN_TEST(test_exchange_payload);
+    RUN_TEST(test_validation);
+    RUN_TEST(test_alerts);
+    RUN_TEST(test_controls);
+    RUN_TEST(test_params_validation);
+    RUN_TEST(test_params_parse);
+    RUN_TEST(test_relay_commands);
+    RUN_TEST(test_relay_commands_after);
+    RUN_TEST(test_ca_der_import);
+    RUN_TEST(test_ca_der_malformed);
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,357 @@
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_meter.h"
+#include "aqua_rules.h"
+#include "aqua_seq.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+#include "sensors.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Full-cycle regression: firmware cycle code + Linux HAL + local HTTP stand-in
+
+#define UPLOAD_PATH "/rest/v1/sensor_data?on_conflict=device_id,seq"
+#define ALERTS_PATH "/rest/v1/sensor_data/alerts"
+
+static standin_t *server;
+
+static void setup(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    supabase_outbound_reset();
+    aqua_seq_init();
+    aqua_gpio_init();
+    sensor_health_reset();
+}
+
+static const standin_request_t *find_request(const char *method, const char *path) {
+    static standin_request_t req;
+    for (int i = standin_request_count(server) - 1; i >= 0; i--) {
+        if (standin_get_request(server, i, &req) &&
+            strcmp(req.method, method) == 0 && strcmp(req.path, path) == 0) {
+            return &req;
+        }
+    }
+    return NULL;
+}
+
+// One sample interval on, a cycle; returns the index of its first request
+static int next_cycle(aqua_cycle_state_t *state) {
+    int first = standin_request_count(server);
+    hal_delay_ms(SAMPLE_DELAY_MS);
+    aqua_cycle_run(state);
+    return first;
+}
+
+static void test_sensor_drivers(void) {
+    setup();
+    float hum = 0, temp = 0;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_OK);
+    CHECK_NEAR(hum, 60.0, 0.05);
+    CHECK_NEAR(temp, 26.5, 0.05);
+    CHECK_NEAR(read_water_temp(), 25.5, 0.0625);
+    CHECK_NEAR(read_analog_sensor(aqua_measure(AQUA_MEAS_PH)), 7.0, 0.01);
+    CHECK_NEAR(read_analog_sensor(aqua_measure(AQUA_MEAS_TURBIDITY)), 10.0, 0.01);
+    CHECK_NEAR(read_analog_sensor(aqua_measure(AQUA_MEAS_DO)), -1.0, 1e-6);
+
+    hal_sim_config()->dht_corrupt_checksum = true;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_INVALID_CRC);
+    hal_sim_config()->dht_connected = false;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_TIMEOUT);
+    hal_sim_config()->ds18b20_connected = false;
+    CHECK_NEAR(read_water_temp(), -999.0, 1e-6);
+}
+
+static void test_nominal_cycle(void) {
+    setup();
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+
+    CHECK_EQ_INT(state.cycle_count, 1);
+    CHECK(state.uploaded);
+    CHECK_NEAR(state.reading.water_temp, 25.5, 0.0625);
+    CHECK_NEAR(state.reading.do_level, AQUA_SENSOR_ERROR, 1e-6);
+    CHECK(state.controls.aerator);
+    CHECK(!state.controls.ph_relay);
+    CHECK_EQ_INT(hal_sim_output_level(AERATOR_PIN), 1);
+
+    // DO is not fitted: no threshold alert for it
+    CHECK_EQ_INT(standin_request_count(server), 2);
+    CHECK(find_request("GET", "/rest/v1/sensor_data/relay_commands?order=timestamp.desc&limit=10") != NULL);
+    CHECK(find_request("POST", ALERTS_PATH) == NULL);
+    const standin_request_t *post = find_request("POST", UPLOAD_PATH);
+    CHECK(post != NULL);
+    if (post) {
+        CHECK_STR(post->body, "{\"air_temperature\":26.50,\"humidity\":60.00,"
+                              "\"water_temperature\":25.50,\"ph\":7.00,\"turbidity\":10.00,"
+                              "\"ph_relay\":false,\"aerator\":true,\"filter\":false,\"pump\":false,"
+                              "\"device_id\":\"" AQUA_DEVICE_ID "\",\"seq\":1,"
+                              "\"uptime_us\":0,\"time_quality\":\"unsynced\","
+                              "\"sensor_health\":{\"dht22\":100,\"ds18b20\":100,\"ph\":100,"
+                              "\"dissolved_oxygen\":50,\"turbidity\":100,\"ammonia\":50},"
+                              "\"actuators\":{\"ph_relay\":{\"on_s\":0,\"wh\":0.0},"
+                              "\"aerator\":{\"on_s\":0,\"wh\":0.0,\"l\":0.0,\"lpm\":0.00},"
+                              "\"filter\":{\"on_s\":0,\"wh\":0.0,\"l\":0.0,\"lpm\":0.00},"
+                              "\"pump\":{\"on_s\":0,\"wh\":0.0,\"l\":0.0,\"lpm\":0.00}}}");
+        CHECK(strstr(post->headers, "apikey: ") != NULL);
+    }
+}
+
+static void test_relay_commands_applied(void) {
+    setup();
+    standin_route(server, "GET", "/rest/v1/sensor_data/relay_commands", 200,
+                  "[{\"relay_type\":\"pump\",\"state\":true},{\"relay_type\":\"filter\",\"state\":true}]");
+    CHECK(poll_relay_commands());
+    CHECK_EQ_INT(hal_sim_output_level(PUMP_RELAY_PIN), 1);
+    CHECK_EQ_INT(hal_sim_output_level(FILTER_PIN), 1);
+    standin_route(server, "GET", "/rest/v1/sensor_data/relay_commands", 200, "[]");
+}
+
+static void test_upload_retries(void) {
+    setup();
+    standin_fail_next(server, 3, 500);
+    CHECK(!send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                            AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(standin_request_count(server), 3);
+
+    standin_fail_next(server, 1, 503);
+    CHECK(send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                           AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(standin_request_count(server), 5);
+
+    // Invalid values are rejected before anything is sent
+    CHECK(!send_to_supabase(26.5f, 25.5f, 160.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                            AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(standin_request_count(server), 5);
+
+    hal_sim_config()->link_up = false;
+    CHECK(!send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                            AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(standin_request_count(server), 5);
+}
+
+static void test_degraded_cycle(void) {
+    setup();
+    hal_sim_config()->ds18b20_connected = false;
+    hal_sim_config()->adc_mv[PH_ADC_CH] = 2950;    // pH 4.5 -> relay on
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+
+    CHECK(state.uploaded);
+    CHECK_NEAR(state.reading.water_temp, AQUA_SENSOR_ERROR, 1e-6);
+    CHECK(state.controls.ph_relay);
+    CHECK_EQ_INT(hal_sim_output_level(RELAY_PIN), 1);
+    const standin_request_t *post = find_request("POST", UPLOAD_PATH);
+    CHECK(post && strstr(post->body, "water_temperature") == NULL);
+    CHECK(post && strstr(post->body, "\"ph\":4.50") != NULL);
+}
+
+static void test_alert_diffing(void) {
+    setup();
+    check_and_send_alerts(25.0f, 8.0f, 7.0f, 0.2f, 10.0f);
+    check_and_send_alerts(25.0f, 8.0f, 7.0f, 0.2f, 10.0f);    // unchanged: no request
+    CHECK_EQ_INT(standin_request_count(server), 0);
+
+    check_and_send_alerts(25.0f, 3.0f, 7.0f, 0.2f, 10.0f);
+    CHECK_EQ_INT(standin_request_count(server), 1);
+    const standin_request_t *post = find_request("POST", ALERTS_PATH);
+    CHECK(post && strstr(post->body, "\"low_dissolved_oxygen\":true") != NULL);
+
+    check_and_send_alerts(25.0f, 3.0f, 7.0f, 0.2f, 10.0f);
+    CHECK_EQ_INT(standin_request_count(server), 1);
+}
+
+static void test_backlog_after_outage(void) {
+    setup();
+    standin_fail_next(server, 3, 500);
+    CHECK(!send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                            AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), 1);
+
+    // Once the backlog row is due, a new alert still goes out ahead of it
+    hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+    check_and_send_alerts(25.0f, 3.0f, 5.0f, 0.2f, 10.0f);
+    CHECK_EQ_INT(standin_request_count(server), 4);
+    standin_request_t req;
+    CHECK(standin_get_request(server, 3, &req) && strcmp(req.path, ALERTS_PATH) == 0);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), 1);
+
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(standin_request_count(server), 5);
+    CHECK(standin_get_request(server, 4, &req) && strcmp(req.path, UPLOAD_PATH) == 0);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+}
+
+static void test_exchange_cycle(void) {
+    setup();
+    rpc_standin_t *model = rpc_standin_attach(server);
+    int old = rpc_standin_add_command(model, "filter", false);
+    rpc_standin_add_command(model, "filter", true);
+    rpc_standin_add_command(model, "pump", true);
+    aqua_cycle_set_transport(AQUA_TRANSPORT_EXCHANGE);
+
+    // One request per cycle; after boot only the newest command per relay
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    CHECK(state.uploaded);
+    CHECK_EQ_INT(standin_request_count(server), 1);
+    CHECK_EQ_INT(rpc_standin_last_seen_id(model), 0);
+    CHECK_EQ_INT(hal_sim_output_level(FILTER_PIN), 1);
+    CHECK_EQ_INT(hal_sim_output_level(PUMP_RELAY_PIN), 1);
+    CHECK_EQ_INT(supabase_last_command_id(), old + 2);
+
+    char row[AQUA_OUTQ_BODY_MAX], expected[AQUA_OUTQ_BODY_MAX];
+    aqua_build_payload(&state.reading, &state.controls, expected, sizeof(expected));
+    CHECK(rpc_standin_last_row(model, row, sizeof(row)));
+    CHECK_STR(row, expected);
+
+    // Stale commands are not re-applied: switch the relay by hand and re-run
+    hal_gpio_set_level(PUMP_RELAY_PIN, 0);
+    aqua_cycle_run(&state);
+    CHECK_EQ_INT(rpc_standin_last_seen_id(model), old + 2);
+    CHECK_EQ_INT(hal_sim_output_level(PUMP_RELAY_PIN), 0);
+
+    int id = rpc_standin_add_command(model, "pump", true);
+    aqua_cycle_run(&state);
+    CHECK_EQ_INT(hal_sim_output_level(PUMP_RELAY_PIN), 1);
+    CHECK_EQ_INT(supabase_last_command_id(), id);
+    CHECK_EQ_INT(standin_request_count(server), 3);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 3);
+
+    aqua_cycle_set_transport(AQUA_TRANSPORT_HTTP);
+    rpc_standin_detach(model);
+}
+
+static void test_alert_sources(void) {
+    // A local rule, a welded relay and a drifting pH probe, each found during
+    // ordinary cycles; all three go out together, ahead of the cycle's polls
+    setup();
+    aqua_meter_init();
+    aqua_anomaly_init();
+    aqua_rules_init();
+    CHECK_EQ_INT(aqua_rules_update(1, "when turbidity > 5 then alert high_turbidity"), ESP_OK);
+    hal_sim_config()->pulse_gate[FILTER_FLOW_PIN] = -1;
+
+    aqua_cycle_state_t state = {0};
+    for (int i = 0; i < 30; i++) {
+        next_cycle(&state);
+    }
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, 0);
+    int first = 0;
+    for (int i = 1; i <= 12 && !aqua_anomaly_alerts()->suspect; i++) {
+        hal_sim_config()->adc_mv[PH_ADC_CH] = 2500 + 6 * i;         // 0.033 pH per sample
+        first = next_cycle(&state);
+    }
+    CHECK_EQ_INT(aqua_anomaly_alerts()->suspect, AQUA_ALERT_BIT(AQUA_MEAS_PH));
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, first, &req) && strcmp(req.path, ALERTS_PATH) == 0);
+    CHECK(strstr(req.body, "\"high_turbidity\":true") != NULL);
+    CHECK(strstr(req.body, "\"low_ph\":false") != NULL);
+    CHECK(strstr(req.body, "\"suspect_probe\":[\"ph\"]") != NULL);
+    CHECK(strstr(req.body, "\"flow_while_off\":[\"filter\"]") != NULL);
+
+    hal_sim_reset();
+    aqua_rules_init();
+}
+
+static void test_anomaly_reaches_server(void) {
+    // Water warming and clouding together, each still inside its limits
+    setup();
+    aqua_anomaly_init();
+    aqua_cycle_state_t state = {0};
+    for (int i = 0; i < 30; i++) {
+        next_cycle(&state);
+    }
+    int first = 0;
+    for (int i = 1; i <= 10 && !aqua_anomaly_alerts()->anomaly; i++) {
+        hal_sim_config()->water_temp = 25.5f + 0.05f * i;
+        hal_sim_config()->adc_mv[TURBIDITY_ADC_CH] = 20 + 2 * i;   // +1 NTU per sample
+        first = next_cycle(&state);
+    }
+    uint32_t both = AQUA_ALERT_BIT(AQUA_MEAS_WATER_TEMP) | AQUA_ALERT_BIT(AQUA_MEAS_TURBIDITY);
+    CHECK_EQ_INT(aqua_anomaly_alerts()->anomaly & both, both);
+    CHECK(state.reading.turbidity < TURBIDITY_MAX);
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, first, &req) && strcmp(req.path, ALERTS_PATH) == 0);
+    CHECK(strstr(req.body, "\"anomaly\":[") != NULL);
+    CHECK(strstr(req.body, "\"water_temperature\"") != NULL);
+    CHECK(strstr(req.body, "\"high_turbidity\":false") != NULL);
+
+    // Back to normal: the cleared set goes out once the detector settles
+    hal_sim_config()->water_temp = 25.5f;
+    hal_sim_config()->adc_mv[TURBIDITY_ADC_CH] = 20;
+    for (int i = 0; i < 120 && aqua_anomaly_result()->raised; i++) {
+        next_cycle(&state);
+    }
+    CHECK(!aqua_anomaly_result()->raised);
+    const standin_request_t *cleared = find_request("POST", ALERTS_PATH);
+    CHECK(cleared && strstr(cleared->body, "anomaly") == NULL);
+}
+
+static void test_flow_fault_ahead_of_backlog(void) {
+    // The aerator runs (DO is not fitted) but its blower moves no air, while
+    // a row from an outage waits in the backlog
+    setup();
+    aqua_meter_init();
+    aqua_cycle_state_t state = {0};
+    next_cycle(&state);
+    next_cycle(&state);                                     // Settled
+    CHECK(state.controls.aerator);
+    CHECK_EQ_INT(aqua_meter_alerts()->no_flow, 0);
+    hal_sim_config()->pulse_hz[AERATOR_FLOW_PIN] = 0.0f;
+
+    standin_fail_next(server, 3, 500);
+    CHECK(!send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                            AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), 1);
+    hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+
+    int first = next_cycle(&state);
+    CHECK_EQ_INT(aqua_meter_alerts()->no_flow, AQUA_ALERT_BIT(AQUA_ACT_AERATOR));
+    standin_request_t req;
+    CHECK(standin_get_request(server, first, &req) && strcmp(req.path, ALERTS_PATH) == 0);
+    CHECK(strstr(req.body, "\"no_flow\":[\"aerator\"]") != NULL);
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+
+    // Air again: the cleared set goes out
+    hal_sim_config()->pulse_hz[AERATOR_FLOW_PIN] = 20.0f * AERATOR_PULSES_PER_LITRE / 60;
+    next_cycle(&state);
+    CHECK_EQ_INT(aqua_meter_alerts()->no_flow, 0);
+    const standin_request_t *cleared = find_request("POST", ALERTS_PATH);
+    CHECK(cleared && strstr(cleared->body, "no_flow") == NULL);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+    // Rows with actuator totals are long enough to go out compressed
+    standin_accept_gzip(server, true);
+
+    RUN_TEST(test_sensor_drivers);
+    RUN_TEST(test_nominal_cycle);
+    RUN_TEST(test_relay_commands_applied);
+    RUN_TEST(test_upload_retries);
+    RUN_TEST(test_degraded_cycle);
+    RUN_TEST(test_alert_diffing);
+    RUN_TEST(test_backlog_after_outage);
+    RUN_TEST(test_exchange_cycle);
+    RUN_TEST(test_alert_sources);
+    RUN_TEST(test_anomaly_reaches_server);
+    RUN_TEST(test_flow_fault_ahead_of_backlog);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
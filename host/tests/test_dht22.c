@@ -0,0 +1,177 @@
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_cycle.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "sensors.h"
+#include "test_util.h"
+
+// DHT22 pulse-train decoding on recorded captures, clean and corrupted, and
+// the capture-based driver on the simulated HAL.
+
+// 61.3 %RH, 24.8 °C. Starts with the tail of the host's start pulse and the
+// idle high before the response.
+static const uint16_t room[] = {
+    4, 31, 80, 80, 52, 24, 49, 28, 49, 26, 53, 24, 53, 25,
+    49, 24, 52, 71, 49, 25, 49, 28, 52, 68, 55, 72, 49, 25,
+    54, 28, 49, 72, 53, 27, 49, 69, 49, 28, 55, 25, 51, 27,
+    50, 28, 49, 28, 51, 28, 55, 25, 49, 28, 53, 73, 50, 70,
+    49, 72, 54, 68, 53, 68, 53, 25, 52, 28, 52, 26, 52, 28,
+    52, 70, 51, 25, 55, 69, 54, 74, 50, 68, 53, 70, 53, 71,
+    51,
+};
+
+// 45.0 %RH, 30.0 °C from a sensor whose clock runs about 18% slow
+static const uint16_t slow_clock[] = {
+    98, 97, 60, 33, 58, 29, 62, 32, 59, 31, 59, 32, 61, 29,
+    63, 29, 64, 85, 62, 87, 64, 83, 60, 31, 62, 32, 62, 32,
+    58, 29, 60, 84, 63, 29, 58, 31, 63, 33, 63, 32, 60, 32,
+    63, 31, 58, 32, 60, 30, 62, 81, 61, 29, 59, 31, 59, 86,
+    59, 32, 61, 87, 61, 81, 59, 32, 61, 33, 60, 82, 64, 84,
+    64, 85, 60, 86, 61, 31, 63, 32, 59, 30, 58, 30, 59,
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint16_t train[AQUA_DHT22_MAX_PULSES];
+
+static size_t copy_room(void) {
+    memcpy(train, room, sizeof(room));
+    return COUNT(room);
+}
+
+// Index of the high pulse of bit n in room[]
+static size_t room_bit_high(int n) {
+    return 2 + 2 + 2 * (size_t)n + 1;
+}
+
+// ========== RECORDED CAPTURES ==========
+static void test_recorded_frames(void) {
+    uint8_t data[5];
+    float hum = 0, temp = 0;
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(room, COUNT(room), data), ESP_OK);
+    CHECK_EQ_INT(data[0], 0x02);
+    CHECK_EQ_INT(data[4], 0x5F);
+    CHECK_EQ_INT(aqua_dht22_decode(data, &hum, &temp), ESP_OK);
+    CHECK_NEAR(hum, 61.3, 1e-4);
+    CHECK_NEAR(temp, 24.8, 1e-4);
+
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(slow_clock, COUNT(slow_clock), data), ESP_OK);
+    CHECK_EQ_INT(aqua_dht22_decode(data, &hum, &temp), ESP_OK);
+    CHECK_NEAR(hum, 45.0, 1e-4);
+    CHECK_NEAR(temp, 30.0, 1e-4);
+}
+
+static void test_no_response(void) {
+    uint8_t data[5];
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(room, 0, data), ESP_ERR_TIMEOUT);
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(room, 2, data), ESP_ERR_TIMEOUT);   // Start pulse tail only
+
+    // Line noise with no 80/80 response in it
+    const uint16_t noise[] = { 3, 12, 250, 9, 14, 400, 2 };
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(noise, COUNT(noise), data), ESP_ERR_TIMEOUT);
+}
+
+// ========== CORRUPTED CAPTURES ==========
+static void test_truncated(void) {
+    uint8_t data[5];
+    // Capture stopped 10 bits early
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(room, COUNT(room) - 21, data), ESP_ERR_INVALID_SIZE);
+    // Missing only the trailer is fine: every bit is complete
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(room, COUNT(room) - 1, data), ESP_OK);
+}
+
+static void test_glitch_splits_pulse(void) {
+    uint8_t data[5];
+    size_t n = copy_room();
+    // A spike in the middle of bit 6's 71 µs high: 35 high, 2 low, 34 high
+    size_t at = room_bit_high(6);
+    CHECK_EQ_INT(train[at], 71);
+    memmove(&train[at + 3], &train[at + 1], (n - at - 1) * sizeof(train[0]));
+    train[at] = 35;
+    train[at + 1] = 2;
+    train[at + 2] = 34;
+    n += 2;
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(train, n, data), ESP_ERR_INVALID_SIZE);
+}
+
+static void test_ambiguous_bit(void) {
+    uint8_t data[5];
+    // Between a 0 and a 1: rejected rather than guessed
+    copy_room();
+    train[room_bit_high(20)] = 50;
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(train, COUNT(room), data), ESP_ERR_INVALID_SIZE);
+
+    // A bit low stretched far beyond 50 µs
+    copy_room();
+    train[room_bit_high(33) - 1] = 140;
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(train, COUNT(room), data), ESP_ERR_INVALID_SIZE);
+}
+
+static void test_flipped_bit_fails_checksum(void) {
+    uint8_t data[5];
+    float hum, temp;
+    // Well-formed pulses, wrong value: only the checksum can tell
+    copy_room();
+    train[room_bit_high(0)] = 70;
+    CHECK_EQ_INT(aqua_dht22_decode_pulses(train, COUNT(room), data), ESP_OK);
+    CHECK_EQ_INT(aqua_dht22_decode(data, &hum, &temp), ESP_ERR_INVALID_CRC);
+}
+
+// ========== DRIVER ==========
+static void setup(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    sensor_health_reset();
+}
+
+static void test_capture_runs_in_background(void) {
+    setup();
+    float hum = 0, temp = 0;
+    CHECK_EQ_INT(dht22_start(), ESP_OK);
+    hal_delay_ms(750);      // Water temperature conversion
+
+    // The frame is already complete: collecting it does not wait
+    int64_t before = hal_time_us();
+    CHECK_EQ_INT(dht22_finish(&hum, &temp), ESP_OK);
+    CHECK(hal_time_us() - before < 10);
+    CHECK_NEAR(hum, 60.0, 0.05);
+    CHECK_NEAR(temp, 26.5, 0.05);
+    CHECK_EQ_INT(hal_sim_stats()->pulse_captures, 1);
+
+    // Blocking read: start pulse plus the ~5 ms frame
+    before = hal_time_us();
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_OK);
+    int64_t took = hal_time_us() - before;
+    CHECK(took > 20000 && took < 26000);
+}
+
+static void test_driver_faults(void) {
+    setup();
+    float hum, temp;
+    CHECK_EQ_INT(dht22_finish(&hum, &temp), ESP_ERR_TIMEOUT);     // Never started
+
+    hal_sim_config()->dht_capture_pulses = 50;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_INVALID_SIZE);
+    CHECK(sensor_health(AQUA_SENSOR_DHT22)->crc_rate > 0.0f);
+
+    hal_sim_config()->dht_capture_pulses = 0;
+    hal_sim_config()->dht_connected = false;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_TIMEOUT);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_recorded_frames);
+    RUN_TEST(test_no_response);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_glitch_splits_pulse);
+    RUN_TEST(test_ambiguous_bit);
+    RUN_TEST(test_flipped_bit_fails_checksum);
+    RUN_TEST(test_capture_runs_in_background);
+    RUN_TEST(test_driver_faults);
+
+    return TEST_EXIT_CODE;
+}
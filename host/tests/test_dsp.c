@@ -0,0 +1,274 @@
+#include <math.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_dsp.h"
+#include "aqua_registry.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "sensors.h"
+#include "test_util.h"
+
+// Oversampling chain: CIC gain, the scalar and vectorised FIR paths
+// against each other, and the resolution a burst recovers from noisy
+// 12-bit conversions. Lock-in detection against synthetic sunlight and
+// lamp flicker far stronger than the emitter's signal.
+
+#define BURST OVERSAMPLE_SAMPLES
+
+static int16_t raw[BURST] AQUA_DSP_ALIGNED;
+static int16_t work[BURST / AQUA_DSP_CIC_DECIM] AQUA_DSP_ALIGNED;
+static uint32_t seed;
+
+static int noise(int amplitude) {
+    seed = seed * 1103515245u + 12345u;
+    return (int)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// true_mv plus uniform noise, rounded to whole counts like the ADC
+static void make_burst(double true_mv, int amplitude) {
+    seed = 7;
+    for (int i = 0; i < BURST; i++) {
+        int v = (int)floor(true_mv + noise(amplitude) + (noise(500) + 500) / 1001.0);
+        raw[i] = (int16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+    }
+}
+
+// ========== STAGES ==========
+static void test_cic_dc(void) {
+    for (int i = 0; i < BURST; i++) raw[i] = 2148;
+    size_t n = aqua_cic_decimate(raw, BURST, work);
+    CHECK_EQ_INT(n, BURST / AQUA_DSP_CIC_DECIM - AQUA_DSP_CIC_ORDER);
+    CHECK_EQ_INT(work[0], 100 << AQUA_DSP_FRAC_BITS);
+    CHECK_EQ_INT(work[n - 1], 100 << AQUA_DSP_FRAC_BITS);
+
+    // Full-scale extremes do not wrap
+    for (int i = 0; i < BURST; i++) raw[i] = (i / 64) % 2 ? 4095 : 0;
+    n = aqua_cic_decimate(raw, BURST, work);
+    for (size_t k = 0; k < n; k++) {
+        CHECK(work[k] >= -(AQUA_DSP_MIDSCALE << AQUA_DSP_FRAC_BITS));
+        CHECK(work[k] < AQUA_DSP_MIDSCALE << AQUA_DSP_FRAC_BITS);
+    }
+}
+
+static void test_fir_paths_match(void) {
+    static int16_t in[512] AQUA_DSP_ALIGNED;
+    int16_t ref[64], fast[64];
+
+    // Noise, a sine near the cutoff, and both rails
+    seed = 3;
+    for (int i = 0; i < 512; i++) {
+        in[i] = (int16_t)noise(16384);
+    }
+    size_t n_ref = aqua_fir_decimate_ref(in, 512, ref);
+    size_t n_fast = aqua_fir_decimate(in, 512, fast);
+    CHECK_EQ_INT(n_ref, (512 - AQUA_DSP_FIR_TAPS) / AQUA_DSP_FIR_DECIM + 1);
+    CHECK_EQ_INT(n_fast, n_ref);
+    int diff = 0;
+    for (size_t k = 0; k < n_ref; k++) diff += ref[k] != fast[k];
+    CHECK_EQ_INT(diff, 0);
+
+    for (int i = 0; i < 512; i++) {
+        in[i] = (int16_t)lround(12000 * sin(i * 0.3));
+    }
+    aqua_fir_decimate_ref(in, 512, ref);
+    aqua_fir_decimate(in, 512, fast);
+    diff = 0;
+    for (size_t k = 0; k < n_ref; k++) diff += ref[k] != fast[k];
+    CHECK_EQ_INT(diff, 0);
+
+    for (int i = 0; i < 512; i++) {
+        in[i] = (i / 3) % 2 ? 16383 : -16384;
+    }
+    aqua_fir_decimate_ref(in, 512, ref);
+    aqua_fir_decimate(in, 512, fast);
+    diff = 0;
+    for (size_t k = 0; k < n_ref; k++) diff += ref[k] != fast[k];
+    CHECK_EQ_INT(diff, 0);
+
+    // DC passes at unity gain
+    for (int i = 0; i < 512; i++) in[i] = 800;
+    aqua_fir_decimate(in, 512, fast);
+    CHECK_EQ_INT(fast[0], 800);
+
+    CHECK_EQ_INT(aqua_fir_decimate(in, AQUA_DSP_FIR_TAPS - 1, fast), 0);
+}
+
+static void test_compare(void) {
+    make_burst(2500.0, 64);
+    aqua_dsp_compare_t res;
+    aqua_dsp_compare(raw, BURST, work, 3, &res);
+    CHECK(res.outputs > 0);
+    CHECK_EQ_INT(res.mismatches, 0);
+}
+
+// ========== CHAIN ==========
+static void test_resolution(void) {
+    // A level between two codes comes back to a fraction of a count
+    make_burst(2500.375, 2);
+    CHECK_NEAR(aqua_oversample_mv(raw, BURST, work), 2500.375, 0.05);
+
+    // Much closer than ten samples under heavy noise
+    make_burst(1234.5, 200);
+    float over = aqua_oversample_mv(raw, BURST, work);
+    CHECK_NEAR(over, 1234.5, 5.0);
+
+    CHECK_NEAR(aqua_oversample_mv(raw, 100, work), -1.0, 1e-6);
+}
+
+static void test_sensor_path(void) {
+    hal_sim_reset();
+    sensor_health_reset();
+    hal_sim_config()->adc_noise_mv = 200;
+    sensors_set_oversampling(true);
+
+    int64_t t0 = hal_time_us();
+    float ph = read_analog_sensor(aqua_measure(AQUA_MEAS_PH));
+    CHECK_NEAR(ph, 7.0, 5.0 / 180.0);
+    CHECK_EQ_INT(hal_sim_stats()->adc_bursts, 1);
+    CHECK(hal_time_us() - t0 >= (int64_t)BURST * 1000000 / OVERSAMPLE_RATE_HZ);
+
+    // The noise estimate still sees the raw spread
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_PH)), 80);
+
+    sensors_set_oversampling(false);
+    read_analog_sensor(aqua_measure(AQUA_MEAS_PH));
+    CHECK_EQ_INT(hal_sim_stats()->adc_bursts, 1);
+}
+
+// ========== LOCK-IN ==========
+#define HALF LOCKIN_HALF_PERIOD
+
+// Sunlight (a cloud edge fading it by ramp_mv over the burst) and lamp
+// flicker at 50/60 Hz and their harmonics, plus signal_mv while the emitter
+// is on and uniform noise, rounded to whole counts
+static void make_lit_burst(double signal_mv, double sun_mv, double ramp_mv, int amplitude) {
+    seed = 11;
+    for (int i = 0; i < BURST; i++) {
+        double t = (double)i / OVERSAMPLE_RATE_HZ;
+        double v = sun_mv - ramp_mv * i / BURST +
+                   400.0 * sin(2 * M_PI * 100 * t) + 150.0 * sin(2 * M_PI * 300 * t + 1.0) +
+                   250.0 * sin(2 * M_PI * 120 * t + 0.5) + 80.0 * sin(2 * M_PI * 50 * t + 2.0);
+        if (hal_emitter_on(i, HALF)) {
+            v += signal_mv;
+        }
+        int c = (int)lround(v) + (amplitude > 0 ? noise(amplitude) : 0);
+        raw[i] = (int16_t)(c < 0 ? 0 : c > 4095 ? 4095 : c);
+    }
+}
+
+static float lockin(size_t block) {
+    aqua_lockin_t l;
+    aqua_lockin_init(&l, HALF);
+    for (size_t i = 0; i < BURST; i += block) {
+        aqua_lockin_feed(&l, raw + i, i + block <= BURST ? block : BURST - i);
+    }
+    CHECK_EQ_INT(l.clipped, 0);
+    return aqua_lockin_amplitude(&l);
+}
+
+static void test_lockin_rejects_ambient(void) {
+    // 40 counts of emitter under 2000 of sunlight and 880 of flicker
+    make_lit_burst(40.0, 2000.0, 0.0, 0);
+    CHECK_NEAR(lockin(LOCKIN_BLOCK_SAMPLES), 40.0, 0.05);
+
+    // What averaging the burst would report
+    double mean = 0;
+    for (int i = 0; i < BURST; i++) mean += raw[i];
+    CHECK(mean / BURST > 2000.0);
+
+    // A cloud passing: the light falls by 600 counts in the burst
+    make_lit_burst(40.0, 2400.0, 600.0, 0);
+    CHECK_NEAR(lockin(LOCKIN_BLOCK_SAMPLES), 40.0, 0.05);
+
+    // Heavy noise on top
+    make_lit_burst(40.0, 2400.0, 600.0, 60);
+    CHECK_NEAR(lockin(LOCKIN_BLOCK_SAMPLES), 40.0, 2.0);
+
+    // No emitter light at all reads zero, not the sunlight
+    make_lit_burst(0.0, 2000.0, 300.0, 0);
+    CHECK_NEAR(lockin(LOCKIN_BLOCK_SAMPLES), 0.0, 0.05);
+}
+
+static void test_lockin_blocks(void) {
+    make_lit_burst(25.0, 1500.0, 200.0, 20);
+    float whole = lockin(BURST);
+
+    // Blocks that cut emitter half periods anywhere give the same sums
+    CHECK_NEAR(lockin(LOCKIN_BLOCK_SAMPLES), whole, 1e-4);
+    CHECK_NEAR(lockin(100), whole, 1e-4);
+    CHECK_NEAR(lockin(7), whole, 1e-4);
+
+    // Merging per-block measurements is the same as one long one
+    aqua_lockin_t total, part;
+    aqua_lockin_init(&total, HALF);
+    for (int i = 0; i < BURST; i += LOCKIN_BLOCK_SAMPLES) {
+        aqua_lockin_init(&part, HALF);
+        aqua_lockin_feed(&part, raw + i, LOCKIN_BLOCK_SAMPLES);
+        aqua_lockin_merge(&total, &part);
+    }
+    CHECK_NEAR(aqua_lockin_amplitude(&total), whole, 1e-4);
+    CHECK_EQ_INT(total.on_count, BURST / 2);
+    CHECK_EQ_INT(total.off_count, BURST / 2);
+    CHECK_NEAR(aqua_lockin_ambient(&total), 1400.0, 20.0);
+
+    aqua_lockin_init(&part, HALF);
+    CHECK_NEAR(aqua_lockin_amplitude(&part), 0.0, 1e-6);
+}
+
+static void test_lockin_clipping(void) {
+    // Midday sun drives the photodiode into the rail
+    make_lit_burst(40.0, 3900.0, 0.0, 0);
+    aqua_lockin_t l;
+    aqua_lockin_init(&l, HALF);
+    aqua_lockin_feed(&l, raw, BURST);
+    CHECK(l.clipped > 0);
+}
+
+static void test_lockin_sensor_path(void) {
+    hal_sim_reset();
+    sensor_health_reset();
+    hal_sim_config_t *cfg = hal_sim_config();
+    cfg->adc_noise_mv = 30;
+    cfg->adc_ambient_mv[TURBIDITY_ADC_CH] = 1500;
+    cfg->adc_flicker_mv[TURBIDITY_ADC_CH] = 600;
+    cfg->flicker_hz = 100;
+    const aqua_measure_t *m = aqua_measure(AQUA_MEAS_TURBIDITY);
+    CHECK(m->flags & AQUA_MEAS_LOCKIN);
+
+    // Read plainly, sunlight is turbidity
+    sensors_set_lockin(false);
+    CHECK(read_analog_sensor(m) > 500.0f);
+
+    sensors_set_lockin(true);
+    int64_t t0 = hal_time_us();
+    CHECK_NEAR(read_analog_sensor(m), 10.0, 0.5);
+    CHECK_EQ_INT(hal_sim_stats()->adc_modulated_reads, 1);
+    CHECK_EQ_INT(hal_sim_stats()->emitter_edges, BURST / HALF);
+    CHECK_EQ_INT(hal_sim_output_level(TURBIDITY_EMITTER_PIN), 0);
+    CHECK(hal_time_us() - t0 >= (int64_t)BURST * 1000000 / OVERSAMPLE_RATE_HZ);
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_TURBIDITY)), 100);
+
+    // Other probes are read as before
+    CHECK_NEAR(read_analog_sensor(aqua_measure(AQUA_MEAS_PH)), 7.0, 0.5);
+    CHECK_EQ_INT(hal_sim_stats()->adc_modulated_reads, 1);
+
+    // Saturated by the sun: dropped, and counted against the probe
+    cfg->adc_ambient_mv[TURBIDITY_ADC_CH] = 3800;
+    CHECK_NEAR(read_analog_sensor(m), -1.0, 1e-6);
+    CHECK(sensor_health(AQUA_SENSOR_TURBIDITY)->range_rate > 0.0f);
+    sensors_set_lockin(false);
+}
+
+int main(void) {
+    RUN_TEST(test_cic_dc);
+    RUN_TEST(test_fir_paths_match);
+    RUN_TEST(test_compare);
+    RUN_TEST(test_resolution);
+    RUN_TEST(test_sensor_path);
+    RUN_TEST(test_lockin_rejects_ambient);
+    RUN_TEST(test_lockin_blocks);
+    RUN_TEST(test_lockin_clipping);
+    RUN_TEST(test_lockin_sensor_path);
+
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,161 @@
+#include "aqua_config.h"
+#include "esp_log.h"
+#include "fleet_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+#include "test_util.h"
+
+// Fleet load generator against the stand-in: request accounting for both
+// HTTP transports, a server outage, a reboot storm and the stand-in's
+// worker pool. Device time runs 50x real time to keep the runs short.
+
+static standin_t *server;
+
+static void config(fleet_config_t *cfg, rpc_standin_t *model) {
+    fleet_config_defaults(cfg);
+    cfg->port = standin_port(server);
+    cfg->devices = 40;
+    cfg->duration_s = 60;
+    cfg->speed = 50;
+    cfg->exchange = false;
+    cfg->model = model;
+}
+
+static void test_rest_fleet(void) {
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fleet_server_t srv;
+    fleet_server_attach(&srv, server);
+    fleet_config_t cfg;
+    config(&cfg, model);
+    cfg.alerts = true;
+
+    fleet_report_t r;
+    CHECK(fleet_run(&cfg, &r));
+    fleet_server_detach(&srv, server);
+
+    // Every device cycles about every SAMPLE_DELAY_MS plus its sensor work
+    CHECK_EQ_INT(r.boots, 40);
+    CHECK(r.cycles >= 40 * 4);
+    CHECK(r.cycles <= 40 * 6);
+    CHECK_EQ_INT(r.rows_lost, 0);
+    CHECK_EQ_INT(r.req[FLEET_REQ_EXCHANGE].sent, 0);
+
+    // One poll and one upload per cycle, within bounds rather than exactly:
+    // the end of the run can leave a device a step into its next cycle, and
+    // under load a reply can miss the firmware's timeout and be retried. The
+    // server may have stored the row of any upload it received, answered or
+    // not, so the rows are bounded by the uploads sent
+    const fleet_req_stats_t *poll = &r.req[FLEET_REQ_POLL];
+    const fleet_req_stats_t *upload = &r.req[FLEET_REQ_UPLOAD];
+    CHECK(poll->ok + poll->timeouts + poll->failed >= r.cycles);
+    CHECK(poll->ok <= r.cycles + (uint64_t)cfg.devices);
+    CHECK(upload->ok >= r.rows_uploaded);
+    CHECK(upload->ok <= r.rows_uploaded + (uint64_t)cfg.devices);
+    uint64_t rows = (uint64_t)rpc_standin_row_count(model);
+    CHECK(rows >= r.rows_uploaded);
+    CHECK(rows <= upload->sent);
+    CHECK(r.commands_applied > 0);
+    CHECK(r.req[FLEET_REQ_UPLOAD].latency.p50_ms > 0);
+    CHECK(r.req[FLEET_REQ_UPLOAD].latency.max_ms >= r.req[FLEET_REQ_UPLOAD].latency.p99_ms);
+
+    // The server saw every request the devices completed
+    uint64_t sent = 0;
+    for (int k = 0; k < FLEET_REQ_COUNT; k++) sent += r.req[k].sent;
+    CHECK(srv.requests + r.aborted >= sent);
+    CHECK(srv.requests <= sent);
+    CHECK_EQ_INT(srv.service.count, srv.requests);
+    fleet_samples_free(&srv.service);
+    rpc_standin_detach(model);
+}
+
+static void test_exchange_outage(void) {
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fleet_config_t cfg;
+    config(&cfg, model);
+    cfg.exchange = true;
+    cfg.outage_at_s = 20;
+    cfg.outage_s = 15;
+
+    fleet_report_t r;
+    CHECK(fleet_run(&cfg, &r));
+    const fleet_req_stats_t *ex = &r.req[FLEET_REQ_EXCHANGE];
+    CHECK_EQ_INT(r.req[FLEET_REQ_POLL].sent, 0);
+    CHECK(ex->unreachable > 0);
+    CHECK(r.rows_lost > 0);
+    CHECK_EQ_INT(r.rows_uploaded + r.rows_lost, r.cycles);
+
+    // Bounds, as in test_rest_fleet: an exchange that timed out, failed or
+    // was cut off around the outage may still have stored its row
+    CHECK(ex->ok >= r.rows_uploaded);
+    CHECK(ex->ok <= r.rows_uploaded + (uint64_t)cfg.devices);
+    uint64_t rows = (uint64_t)rpc_standin_row_count(model);
+    CHECK(rows >= r.rows_uploaded);
+    CHECK(rows <= ex->sent);
+
+    // Each lost row used up all attempts of the firmware's back-off
+    CHECK(ex->unreachable + ex->failed >= r.rows_lost * UPLOAD_MAX_ATTEMPTS);
+    rpc_standin_detach(model);
+}
+
+static void test_reboot_storm(void) {
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fleet_config_t cfg;
+    config(&cfg, model);
+    cfg.devices = 100;
+    cfg.storm_at_s = 30;
+
+    fleet_report_t r;
+    CHECK(fleet_run(&cfg, &r));
+    CHECK_EQ_INT(r.boots, 200);
+    CHECK_EQ_INT(r.rows_lost, 0);
+
+    // Rebooted together, the fleet stays bunched within the WiFi join spread
+    // (random phases would put about 20 requests in each second)
+    CHECK(r.peak_at_s >= 33);
+    CHECK(r.peak_rate > 2 * r.mean_rate);
+    rpc_standin_detach(model);
+}
+
+static void test_worker_pool(void) {
+    // With a 2 ms service time, one worker queues a burst; eight do not
+    standin_t *pool = standin_start_workers(8);
+    CHECK(pool != NULL);
+    rpc_standin_t *model = rpc_standin_attach(pool);
+    standin_set_delay_ms(pool, 2);
+    fleet_server_t srv;
+    fleet_server_attach(&srv, pool);
+
+    fleet_config_t cfg;
+    config(&cfg, model);
+    cfg.port = standin_port(pool);
+    cfg.duration_s = 25;
+    fleet_report_t r;
+    CHECK(fleet_run(&cfg, &r));
+    fleet_server_detach(&srv, pool);
+
+    CHECK_EQ_INT(r.rows_lost, 0);
+    fleet_percentiles_t p;
+    fleet_samples_percentiles(&srv.service, &p);
+    CHECK(p.p50_ms >= 2.0);
+    CHECK(p.p50_ms < 20.0);
+    fleet_samples_free(&srv.service);
+    rpc_standin_detach(model);
+    standin_stop(pool);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_rest_fleet);
+    RUN_TEST(test_exchange_outage);
+    RUN_TEST(test_reboot_storm);
+    RUN_TEST(test_worker_pool);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
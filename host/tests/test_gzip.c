@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_gzip.h"
+#include "aqua_seq.h"
+#include "aqua_time.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+#include "supabase.h"
+#include "test_util.h"
+#ifdef STANDIN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Streaming gzip compressor: streams inflate back to their input whatever
+// the shape of the input and the way it is fed, output stays within the
+// bound, and backlog uploads go out batched and compressed, falling back to
+// plain bodies when the server refuses them. A batch whose rows have
+// different keys lists its columns.
+
+static standin_t *server;
+
+static const char row[] = "{\"air_temperature\":26.50,\"humidity\":60.00,\"water_temperature\":25.50,"
+                          "\"ph\":7.00,\"turbidity\":10.00,\"ph_relay\":false,\"aerator\":true}";
+
+typedef struct {
+    uint8_t data[65536];
+    size_t len;
+    size_t limit;           // Fail writes past this many bytes (0: never)
+    int writes;
+} sink_t;
+
+static bool sink_write(void *ctx, const void *data, size_t len) {
+    sink_t *s = ctx;
+    s->writes++;
+    if ((s->limit && s->len + len > s->limit) || s->len + len > sizeof(s->data)) {
+        return false;
+    }
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+    return true;
+}
+
+static aqua_gzip_t z;
+static sink_t out;
+static uint8_t plain[65536];
+
+static void gzip_all(const void *data, size_t len, size_t chunk) {
+    memset(&out, 0, sizeof(out));
+    aqua_gzip_init(&z, sink_write, &out);
+    const uint8_t *p = data;
+    for (size_t pos = 0; pos < len; pos += chunk) {
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        CHECK(aqua_gzip_feed(&z, p + pos, n));
+    }
+    CHECK(aqua_gzip_finish(&z));
+}
+
+// Inflate out[] and compare with the input; without zlib, check the framing only
+static void check_round_trip(const void *data, size_t len) {
+    CHECK(out.len >= 20);
+    CHECK(out.len <= aqua_gzip_bound(len));
+    CHECK_EQ_INT(out.data[0], 0x1f);
+    CHECK_EQ_INT(out.data[1], 0x8b);
+    uint32_t crc = 0, size = 0;
+    for (int i = 0; i < 4; i++) {
+        crc |= (uint32_t)out.data[out.len - 8 + i] << (8 * i);
+        size |= (uint32_t)out.data[out.len - 4 + i] << (8 * i);
+    }
+    CHECK_EQ_INT(crc, aqua_crc32(0, data, len));
+    CHECK_EQ_INT(size, len);
+#ifdef STANDIN_HAVE_ZLIB
+    z_stream zs = {0};
+    CHECK_EQ_INT(inflateInit2(&zs, 16 + MAX_WBITS), Z_OK);
+    zs.next_in = out.data;
+    zs.avail_in = (uInt)out.len;
+    zs.next_out = plain;
+    zs.avail_out = sizeof(plain);
+    CHECK_EQ_INT(inflate(&zs, Z_FINISH), Z_STREAM_END);
+    CHECK_EQ_INT(zs.total_out, len);
+    CHECK_EQ_INT(zs.avail_in, 0);
+    CHECK(zs.total_out == len && memcmp(plain, data, len) == 0);
+    inflateEnd(&zs);
+#endif
+}
+
+static void test_small_inputs(void) {
+    gzip_all("", 0, 1);
+    check_round_trip("", 0);
+    gzip_all("a", 1, 1);
+    check_round_trip("a", 1);
+    gzip_all("aaa", 3, 1);
+    check_round_trip("aaa", 3);
+    gzip_all(row, sizeof(row) - 1, sizeof(row));
+    check_round_trip(row, sizeof(row) - 1);
+}
+
+static void test_repetitive(void) {
+    // Rows repeat across many windows; every match length and distance code
+    static char text[40000];
+    size_t n = 0;
+    for (int i = 0; n + sizeof(row) < sizeof(text); i++) {
+        n += (size_t)snprintf(text + n, sizeof(text) - n, "%.*s%d,", (int)(sizeof(row) - 1 - (size_t)(i % 50)),
+                              row, i);
+    }
+    gzip_all(text, n, n);
+    check_round_trip(text, n);
+    CHECK(out.len < n / 4);
+
+    // Long runs: maximum-length matches at distance one
+    memset(text, 'x', sizeof(text));
+    gzip_all(text, sizeof(text), sizeof(text));
+    check_round_trip(text, sizeof(text));
+    CHECK(out.len < sizeof(text) / 100);
+}
+
+static void test_random(void) {
+    static uint8_t noise[20000];
+    uint32_t lcg = 1;
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        lcg = lcg * 1664525u + 1013904223u;
+        noise[i] = (uint8_t)(lcg >> 24);
+    }
+    gzip_all(noise, sizeof(noise), sizeof(noise));
+    check_round_trip(noise, sizeof(noise));
+
+    // Short random strings repeated at distances across the window
+    for (size_t i = 0; i + 64 < sizeof(noise); i += 64) {
+        size_t back = 1 + (size_t)((i * 2654435761u) % AQUA_GZIP_WINDOW);
+        if (back <= i && (i / 64) % 3 == 0) memcpy(noise + i, noise + i - back, 64);
+    }
+    gzip_all(noise, sizeof(noise), sizeof(noise));
+    check_round_trip(noise, sizeof(noise));
+}
+
+static void test_chunked(void) {
+    static char text[9000];
+    size_t n = 0;
+    while (n + sizeof(row) < sizeof(text)) {
+        memcpy(text + n, row, sizeof(row) - 1);
+        n += sizeof(row) - 1;
+        text[n] = (char)('0' + n % 10);
+        n++;
+    }
+    gzip_all(text, n, n);
+    size_t whole = out.len;
+    uint8_t whole_data[4096];
+    CHECK(whole <= sizeof(whole_data));
+    memcpy(whole_data, out.data, whole < sizeof(whole_data) ? whole : sizeof(whole_data));
+
+    // Output does not depend on how the input was split
+    const size_t chunks[] = { 1, 7, 64, 257, 1023, 2048 };
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        gzip_all(text, n, chunks[i]);
+        check_round_trip(text, n);
+        CHECK_EQ_INT(out.len, whole);
+        CHECK(out.len == whole && memcmp(out.data, whole_data, whole) == 0);
+    }
+}
+
+static void test_write_failure(void) {
+    static char text[4000];
+    for (size_t i = 0; i < sizeof(text); i++) text[i] = (char)('a' + (i * 7) % 26);
+
+    memset(&out, 0, sizeof(out));
+    out.limit = 64;
+    aqua_gzip_init(&z, sink_write, &out);
+    aqua_gzip_feed(&z, text, sizeof(text));
+    CHECK(!aqua_gzip_finish(&z));
+    int writes = out.writes;
+    CHECK(!aqua_gzip_feed(&z, text, sizeof(text)));
+    CHECK_EQ_INT(out.writes, writes);
+}
+
+// ========== UPLOADS ==========
+
+static void setup(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    supabase_outbound_reset();
+}
+
+// Readings that failed live and wait in the backlog
+static void fill_backlog(int rows) {
+    for (int i = 0; i < rows; i++) {
+        standin_fail_next(server, 3, 500);
+        CHECK(!send_to_supabase(26.5f + 0.1f * (float)i, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                                AQUA_SENSOR_ERROR, false, false, false, false));
+    }
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), rows);
+    hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+}
+
+static bool gzip_request(int idx, standin_request_t *req) {
+    return standin_get_request(server, idx, req) && strstr(req->headers, "Content-Encoding: gzip") != NULL;
+}
+
+static void test_backlog_batched(void) {
+    setup();
+    standin_accept_gzip(server, true);
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fill_backlog(6);
+    int before = standin_request_count(server);
+
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 6);
+
+    standin_request_t req;
+#ifdef STANDIN_HAVE_ZLIB
+    CHECK(gzip_request(before, &req));
+    CHECK(req.wire_len < req.body_len / 2);
+#else
+    CHECK(standin_get_request(server, before, &req));
+#endif
+    CHECK(req.body[0] == '[' && strstr(req.body, "\"air_temperature\":27.00") != NULL);
+
+    // A live row stays a plain single-row body
+    CHECK(send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                           AQUA_SENSOR_ERROR, false, false, false, false));
+    CHECK(standin_get_request(server, before + 1, &req) && !gzip_request(before + 1, &req));
+    CHECK(req.body[0] == '{');
+
+    rpc_standin_detach(model);
+    standin_accept_gzip(server, false);
+}
+
+static void test_gzip_refused(void) {
+    setup();
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fill_backlog(6);
+    int before = standin_request_count(server);
+
+    // Refused once, resent plain, and not compressed again
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(standin_request_count(server), before + 2);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 6);
+    standin_request_t req;
+    CHECK(gzip_request(before, &req));
+    CHECK(standin_get_request(server, before + 1, &req) && !gzip_request(before + 1, &req));
+    CHECK(req.body[0] == '[');
+
+    fill_backlog(4);
+    before = standin_request_count(server);
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    CHECK(!gzip_request(before, &req));
+    CHECK_EQ_INT(rpc_standin_row_count(model), 10);
+
+    rpc_standin_detach(model);
+}
+
+// A timed reading that fails live and joins the backlog
+static void backlog_timed(float ph) {
+    aqua_reading_t r;
+    aqua_reading_clear(&r);
+    r.air_temp = 26.5f;
+    r.humidity = 60.0f;
+    r.water_temp = 25.5f;
+    r.ph = ph;
+    r.turbidity = 10.0f;
+    r.seq = aqua_seq_next();
+    r.sampled_us = hal_time_us();
+    r.has_time = true;
+    aqua_time_stamp(r.sampled_us, &r.time);
+    aqua_controls_t c = {0};
+    standin_fail_next(server, 3, 500);
+    CHECK(!send_reading_to_supabase(&r, &c));
+    hal_delay_ms(1000);                     // Short of OUTQ_BACKLOG_RETRY_MS
+}
+
+static void test_batch_spans_sync(void) {
+    // Rows from before the first sync lack sampled_at, and one lost its pH probe
+    setup();
+    aqua_time_reset();
+    standin_accept_gzip(server, true);
+    rpc_standin_t *model = rpc_standin_attach(server);
+    backlog_timed(7.0f);
+    backlog_timed(AQUA_SENSOR_ERROR);
+    CHECK_EQ_INT(hal_time_sync_start(TIME_SNTP_SERVER, TIME_SYNC_INTERVAL_S), ESP_OK);
+    CHECK(aqua_time_poll());
+    backlog_timed(7.0f);
+    backlog_timed(7.0f);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), 4);
+    hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+
+    int before = standin_request_count(server);
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 4);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+    standin_request_t req;
+    CHECK(standin_get_request(server, before, &req));
+    CHECK(strstr(req.path, "&columns=air_temperature,") != NULL);
+    CHECK(strstr(req.path, ",sampled_at,") != NULL);
+    CHECK(strstr(req.body, "\"sampled_at\"") != NULL);
+
+    // Without the list the server refuses the same array
+    hal_http_request_t post = {
+        .url = SUPABASE_UPLOAD_URL,
+        .method = HAL_HTTP_POST,
+        .body = req.body,
+        .body_len = req.body_len,
+        .timeout_ms = 1000
+    };
+    hal_http_response_t resp = {0};
+    CHECK_EQ_INT(hal_http_perform(&post, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 400);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 4);
+
+    rpc_standin_detach(model);
+    standin_accept_gzip(server, false);
+    aqua_time_reset();
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_small_inputs);
+    RUN_TEST(test_repetitive);
+    RUN_TEST(test_random);
+    RUN_TEST(test_chunked);
+    RUN_TEST(test_write_failure);
+    RUN_TEST(test_backlog_batched);
+    RUN_TEST(test_gzip_refused);
+    RUN_TEST(test_batch_spans_sync);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
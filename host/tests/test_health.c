@@ -0,0 +1,230 @@
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_health.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "sensors.h"
+#include "test_util.h"
+
+// Sensor health: the running statistics and score, and the drivers feeding
+// them from normal reads with the DS18B20 suite gated on a degraded score.
+
+static void setup(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    sensor_health_reset();
+}
+
+static aqua_health_t fresh(void) {
+    aqua_health_t h;
+    aqua_health_limits_t limits = { .stuck_reads = 5, .noise_limit = 10.0f,
+                                    .presence_min_us = 60, .presence_max_us = 240 };
+    aqua_health_init(&h, &limits);
+    return h;
+}
+
+// ========== MODEL ==========
+static void test_rates(void) {
+    aqua_health_t h = fresh();
+    CHECK_EQ_INT(aqua_health_score(&h), 100);
+
+    // The first read counts fully
+    aqua_health_record(&h, AQUA_READ_NO_RESPONSE, 0.0f);
+    CHECK_NEAR(h.no_response_rate, 1.0, 1e-6);
+    CHECK_EQ_INT(aqua_health_score(&h), 40);
+
+    // Plain average while warming up, then a fixed window
+    for (int i = 0; i < 3; i++) aqua_health_record(&h, AQUA_READ_OK, (float)i);
+    CHECK_NEAR(h.no_response_rate, 0.25, 1e-6);
+    for (int i = 0; i < 200; i++) aqua_health_record(&h, AQUA_READ_OK, (float)i);
+    CHECK(h.no_response_rate < 0.01f);
+    CHECK_EQ_INT(aqua_health_score(&h), 100);
+
+    // A burst of bad CRCs shows up within a few reads
+    for (int i = 0; i < 8; i++) aqua_health_record(&h, AQUA_READ_BAD_CRC, (float)i);
+    CHECK(h.crc_rate > 0.2f && h.crc_rate < 0.3f);
+    CHECK(aqua_health_score(&h) < 90);
+
+    aqua_health_t range = fresh();
+    aqua_health_record(&range, AQUA_READ_OUT_OF_RANGE, 0.0f);
+    CHECK_EQ_INT(aqua_health_score(&range), 50);
+}
+
+static void test_stuck(void) {
+    aqua_health_t h = fresh();
+    for (int i = 0; i < 4; i++) aqua_health_record(&h, AQUA_READ_OK, 7.0f);
+    CHECK(!aqua_health_stuck(&h));
+    aqua_health_record(&h, AQUA_READ_OK, 7.0f);
+    CHECK(aqua_health_stuck(&h));
+    CHECK_EQ_INT(aqua_health_score(&h), 60);
+
+    // Any change, or a failed read, restarts the run
+    aqua_health_record(&h, AQUA_READ_OK, 7.01f);
+    CHECK(!aqua_health_stuck(&h));
+    for (int i = 0; i < 4; i++) aqua_health_record(&h, AQUA_READ_OK, 7.01f);
+    aqua_health_record(&h, AQUA_READ_NO_RESPONSE, 0.0f);
+    aqua_health_record(&h, AQUA_READ_OK, 7.01f);
+    CHECK(!aqua_health_stuck(&h));
+}
+
+static void test_noise(void) {
+    aqua_health_t h = fresh();
+    const int quiet[] = { 1000, 1004, 998, 1001, 997 };
+    const int noisy[] = { 1000, 1040, 960, 1030, 970 };
+    aqua_health_record_samples(&h, quiet, 5);
+    aqua_health_record(&h, AQUA_READ_OK, 1.0f);
+    CHECK_NEAR(h.noise_var, 7.5, 1e-3);
+    CHECK_EQ_INT(aqua_health_score(&h), 100);
+
+    for (int i = 0; i < 4; i++) aqua_health_record_samples(&h, noisy, 5);
+    CHECK(h.noise_var > 100.0f);
+    CHECK_EQ_INT(aqua_health_score(&h), 80);
+}
+
+static void test_presence(void) {
+    aqua_health_t h = fresh();
+    aqua_health_record(&h, AQUA_READ_OK, 25.0f);
+    for (int i = 0; i < 10; i++) aqua_health_record_presence(&h, 118 + (i % 5));
+    CHECK_NEAR(h.presence_mean_us, 120.0, 1.0);
+    CHECK_EQ_INT(aqua_health_score(&h), 100);
+
+    // A weak pull-down: pulses drift short
+    for (int i = 0; i < 64; i++) aqua_health_record_presence(&h, 40);
+    CHECK(h.presence_mean_us < 60.0f);
+    CHECK_EQ_INT(aqua_health_score(&h), 80);
+
+    // Erratic lengths around a good mean
+    aqua_health_t erratic = fresh();
+    aqua_health_record(&erratic, AQUA_READ_OK, 25.0f);
+    for (int i = 0; i < 64; i++) aqua_health_record_presence(&erratic, i % 2 ? 60 : 220);
+    CHECK_EQ_INT(aqua_health_score(&erratic), 90);
+}
+
+// ========== DRIVERS ==========
+static void test_healthy_probe_skips_suite(void) {
+    setup();
+    int64_t start = hal_time_us();
+    CHECK_NEAR(read_water_temp(), 25.5, 0.0625);
+    int64_t bus_us = hal_time_us() - start;
+
+    // One conversion, two resets; the suite alone took over 2 s
+    CHECK(bus_us < 760000);
+    CHECK_EQ_INT(hal_sim_stats()->onewire_resets, 2);
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 0);
+
+    const aqua_health_t *h = sensor_health(AQUA_SENSOR_DS18B20);
+    CHECK_EQ_INT(h->presence_reads, 1);
+    CHECK_NEAR(h->presence_mean_us, 120.0, 1e-3);
+    CHECK_EQ_INT(aqua_health_score(h), 100);
+}
+
+static void test_lost_probe_runs_suite_once(void) {
+    setup();
+    hal_sim_config()->ds18b20_connected = false;
+    CHECK_NEAR(read_water_temp(), AQUA_SENSOR_ERROR, 1e-6);
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 1);
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_DS18B20)), 40);
+
+    // Still degraded, but the suite waits HEALTH_DIAG_MIN_READS reads
+    for (int i = 1; i < HEALTH_DIAG_MIN_READS; i++) {
+        read_water_temp();
+    }
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 1);
+    read_water_temp();
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 2);
+
+    // Back on the bus: the score climbs back without another suite run
+    hal_sim_config()->ds18b20_connected = true;
+    for (int i = 0; i < 16; i++) {
+        CHECK_NEAR(read_water_temp(), 25.5, 0.0625);
+    }
+    CHECK(aqua_health_score(sensor_health(AQUA_SENSOR_DS18B20)) >= HEALTH_DEGRADED_BELOW);
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 2);
+}
+
+static void test_crc_failures_degrade(void) {
+    setup();
+    hal_sim_config()->ds18b20_corrupt_crc = true;
+    // In range: still accepted, but every read counts against the probe
+    CHECK_NEAR(read_water_temp(), 25.5, 0.0625);
+    CHECK_NEAR(sensor_health(AQUA_SENSOR_DS18B20)->crc_rate, 1.0, 1e-6);
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_DS18B20)), 50);
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 1);
+}
+
+static void test_weak_presence_pulse(void) {
+    setup();
+    hal_sim_config()->ds18b20_presence_us = 30;
+    for (int i = 0; i < 4; i++) {
+        CHECK_NEAR(read_water_temp(), 25.5, 0.0625);
+    }
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_DS18B20)), 80);
+    CHECK_EQ_INT(sensor_diagnostics_runs(), 0);
+}
+
+static void test_analog_faults(void) {
+    setup();
+    hal_sim_config()->adc_noise_mv = 200;
+    read_analog_sensor(aqua_measure(AQUA_MEAS_PH));
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_PH)), 80);
+
+    // Floating input: out of range every read
+    CHECK_NEAR(read_analog_sensor(aqua_measure(AQUA_MEAS_DO)), -1.0, 1e-6);
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_DO)), 50);
+
+    // A frozen ADC: the same average for HEALTH_STUCK_READS_ANALOG reads
+    hal_sim_config()->adc_noise_mv = 0;
+    for (int i = 0; i < HEALTH_STUCK_READS_ANALOG - 1; i++) read_analog_sensor(aqua_measure(AQUA_MEAS_TURBIDITY));
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_TURBIDITY)), 100);
+    read_analog_sensor(aqua_measure(AQUA_MEAS_TURBIDITY));
+    CHECK(aqua_health_stuck(sensor_health(AQUA_SENSOR_TURBIDITY)));
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_TURBIDITY)), 60);
+}
+
+static void test_dht_faults(void) {
+    setup();
+    float hum, temp;
+    hal_sim_config()->dht_connected = false;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_TIMEOUT);
+    CHECK_EQ_INT(aqua_health_score(sensor_health(AQUA_SENSOR_DHT22)), 40);
+    hal_sim_config()->dht_connected = true;
+    hal_sim_config()->dht_corrupt_checksum = true;
+    CHECK_EQ_INT(dht22_read(&hum, &temp), ESP_ERR_INVALID_CRC);
+    CHECK_NEAR(sensor_health(AQUA_SENSOR_DHT22)->crc_rate, 0.5, 1e-6);
+}
+
+static void test_cycle_reports_scores(void) {
+    setup();
+    hal_sim_config()->ds18b20_connected = false;
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+
+    CHECK(state.reading.has_health);
+    CHECK_EQ_INT(state.reading.health[AQUA_SENSOR_DHT22], 100);
+    CHECK_EQ_INT(state.reading.health[AQUA_SENSOR_DS18B20], 40);
+    CHECK_EQ_INT(state.reading.health[AQUA_SENSOR_PH], 100);
+    CHECK_EQ_INT(state.reading.health[AQUA_SENSOR_DO], 50);
+
+    char json[512];
+    CHECK(aqua_build_payload(&state.reading, &state.controls, json, sizeof(json)) > 0);
+    CHECK(strstr(json, "\"sensor_health\":{\"dht22\":100,\"ds18b20\":40,") != NULL);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_rates);
+    RUN_TEST(test_stuck);
+    RUN_TEST(test_noise);
+    RUN_TEST(test_presence);
+    RUN_TEST(test_healthy_probe_skips_suite);
+    RUN_TEST(test_lost_probe_runs_suite_once);
+    RUN_TEST(test_crc_failures_degrade);
+    RUN_TEST(test_weak_presence_pulse);
+    RUN_TEST(test_analog_faults);
+    RUN_TEST(test_dht_faults);
+    RUN_TEST(test_cycle_reports_scores);
+
+    return TEST_EXIT_CODE;
+}
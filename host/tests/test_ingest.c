@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include "aqua_log.h"
+#include "esp_log.h"
+#include "log_ingest.h"
+#include "test_util.h"
+
+// Log ingest: both firmware generations' message texts, colour codes, rows
+// per cycle, alert edges and re-arming, resets and crashes, lines split
+// across reads, and deferred "AQL:" records.
+
+#define MAX_ROWS 16
+#define MAX_ALERTS 16
+
+typedef struct {
+    ingest_row_t rows[MAX_ROWS];
+    int row_count;
+    ingest_alert_t alerts[MAX_ALERTS];
+    int alert_boot[MAX_ALERTS];
+    int64_t alert_ms[MAX_ALERTS];
+    int alert_count;
+} collected_t;
+
+static collected_t out;
+static ingest_source_t src;
+
+static void on_row(const ingest_row_t *row, void *ctx) {
+    if (out.row_count < MAX_ROWS) out.rows[out.row_count] = *row;
+    out.row_count++;
+}
+
+static void on_alert(const char *source, int boot, int64_t uptime_ms, ingest_alert_t alert,
+                     const char *line, void *ctx) {
+    if (out.alert_count < MAX_ALERTS) {
+        out.alerts[out.alert_count] = alert;
+        out.alert_boot[out.alert_count] = boot;
+        out.alert_ms[out.alert_count] = uptime_ms;
+    }
+    out.alert_count++;
+}
+
+static void setup(void) {
+    memset(&out, 0, sizeof(out));
+    ingest_sink_t sink = { .row = on_row, .alert = on_alert };
+    ingest_source_init(&src, "test", &sink);
+}
+
+static void feed(const char *text) {
+    ingest_feed(&src, text, strlen(text));
+}
+
+// ========== PARSING ==========
+static void test_old_firmware_cycle(void) {
+    setup();
+    feed("I (661) AQUA: Reading DHT22 sensor...\r\n"
+         "I (700) AQUA: Air Temp: 26.7°C, Humidity: 48.6%\r\n"
+         "W (1700) AQUA: Water temperature sensor missing\r\n"
+         "I (1710) AQUA: pH: 7.12\r\n"
+         "I (1720) AQUA: Turbidity: 3.40 NTU\r\n"
+         "I (1730) AQUA: Control States - pH Relay: ON, Aerator: ON, Filter: OFF, Pump: OFF\r\n"
+         "I (2000) AQUA: [SUPABASE] Data sent successfully (Status: 201)\r\n"
+         "I (10661) AQUA: Reading DHT22 sensor...\r\n"
+         "I (10700) AQUA: Air Temp: 26.9°C, Humidity: 48.0%\r\n");
+    ingest_finish(&src);
+
+    CHECK_EQ_INT(out.row_count, 2);
+    const ingest_row_t *r = &out.rows[0];
+    CHECK_EQ_INT(r->boot, 1);
+    CHECK_EQ_INT(r->cycle, 1);
+    CHECK_EQ_INT(r->uptime_ms, 661);
+    CHECK_NEAR(r->values[INGEST_AIR_TEMP], 26.7, 1e-4);
+    CHECK_NEAR(r->values[INGEST_HUMIDITY], 48.6, 1e-4);
+    CHECK(isnan(r->values[INGEST_WATER_TEMP]));
+    CHECK_NEAR(r->values[INGEST_PH], 7.12, 1e-4);
+    CHECK_NEAR(r->values[INGEST_TURBIDITY], 3.4, 1e-4);
+    CHECK(isnan(r->values[INGEST_DO]));
+    CHECK_EQ_INT(r->relays[INGEST_RELAY_PH], 1);
+    CHECK_EQ_INT(r->relays[INGEST_RELAY_FILTER], 0);
+    CHECK_EQ_INT(r->uploaded, 1);
+    CHECK_EQ_INT(r->health[0], -1);
+    CHECK_EQ_INT(out.rows[1].cycle, 2);
+    CHECK_EQ_INT(out.rows[1].uploaded, -1);
+
+    CHECK_EQ_INT(out.alert_count, 1);
+    CHECK_EQ_INT(out.alerts[0], INGEST_ALERT_WATER_TEMP_OFFLINE);
+    CHECK_EQ_INT(out.alert_ms[0], 1700);
+    CHECK_EQ_INT(src.stats.lines, 9);
+}
+
+static void test_current_firmware_cycle(void) {
+    setup();
+    feed("I (5000) AQUA: \n"
+         "========== CYCLE #7 ==========\n"
+         "\033[0;32mI (5010) AQUA: Water Temp: 24.5°C\033[0m\n"
+         "\033[0;32mI (5020) AQUA: DO: 6.80 mg/L (connected and working)\033[0m\n"
+         "\033[0;31mE (5030) AQUA: Ammonia sensor error - ADC channel 7 read failed\033[0m\n"
+         "I (5040) AQUA: Health: DHT22 100, DS18B20 95, pH 80, DO 100, Turbidity 60, NH3 0\n"
+         "W (5050) AQUA: [MQTT] Publish failed\n");
+    ingest_finish(&src);
+
+    CHECK_EQ_INT(out.row_count, 1);
+    const ingest_row_t *r = &out.rows[0];
+    CHECK_EQ_INT(r->cycle, 7);
+    CHECK_EQ_INT(r->uptime_ms, 5000);
+    CHECK_NEAR(r->values[INGEST_WATER_TEMP], 24.5, 1e-4);
+    CHECK_NEAR(r->values[INGEST_DO], 6.8, 1e-4);
+    CHECK(isnan(r->values[INGEST_AMMONIA]));
+    CHECK_EQ_INT(r->health[0], 100);
+    CHECK_EQ_INT(r->health[1], 95);
+    CHECK_EQ_INT(r->health[4], 60);
+    CHECK_EQ_INT(r->health[5], 0);
+    CHECK_EQ_INT(r->uploaded, 0);
+    CHECK_EQ_INT(out.alert_count, 1);
+    CHECK_EQ_INT(out.alerts[0], INGEST_ALERT_UPLOAD_FAILED);
+}
+
+// ========== ALERTS ==========
+static void test_alert_edges(void) {
+    setup();
+    // Raised once while it persists, re-armed by a cycle without it
+    for (int cycle = 1; cycle <= 4; cycle++) {
+        char text[256];
+        snprintf(text, sizeof(text),
+                 "========== CYCLE #%d ==========\n"
+                 "I (%d) AQUA: pH%s\n", cycle, cycle * 1000,
+                 cycle == 3 ? ": 7.00" : " sensor disconnected");
+        feed(text);
+    }
+    ingest_finish(&src);
+    CHECK_EQ_INT(out.row_count, 4);
+    CHECK_EQ_INT(out.alert_count, 2);
+    CHECK_EQ_INT(out.alerts[0], INGEST_ALERT_PH_OFFLINE);
+    CHECK_EQ_INT(out.alert_ms[0], 1000);
+    CHECK_EQ_INT(out.alert_ms[1], 4000);
+
+    // Health alerts last until their recovery line
+    setup();
+    feed("W (100) AQUA: [HEALTH] pH health dropped to 40/100\n"
+         "========== CYCLE #2 ==========\n"
+         "W (200) AQUA: [HEALTH] pH health dropped to 30/100\n"
+         "I (300) AQUA: [HEALTH] pH health recovered (90/100)\n"
+         "W (400) AQUA: [HEALTH] pH health dropped to 20/100\n");
+    CHECK_EQ_INT(out.alert_count, 2);
+    CHECK_EQ_INT(out.alerts[1], INGEST_ALERT_SENSOR_DEGRADED);
+}
+
+static void test_resets_and_crashes(void) {
+    setup();
+    feed("I (700) AQUA: Air Temp: 26.0°C, Humidity: 50.0%\n"
+         "E (9000) task_wdt: Task watchdog got triggered. The following tasks did not reset the watchdog in time:\n"
+         "Guru Meditation Error: Core  0 panic'ed (LoadProhibited). Exception was unhandled.\n"
+         "rst:0xc (RTC_SW_CPU_RST),boot:0x2a (SPI_FAST_FLASH_BOOT)\n"
+         "E (621) AQUA: WiFi initialization failed - no networks available\n"
+         "I (700) AQUA: Air Temp: 25.0°C, Humidity: 51.0%\n"
+         "Guru Meditation Error: Core  0 panic'ed (LoadProhibited). Exception was unhandled.\n");
+    ingest_finish(&src);
+
+    CHECK_EQ_INT(out.row_count, 2);
+    CHECK_EQ_INT(out.rows[0].boot, 1);
+    CHECK_EQ_INT(out.rows[1].boot, 2);
+    CHECK_EQ_INT(out.rows[1].cycle, 1);
+
+    // One crash per boot, however many panic lines it prints
+    CHECK_EQ_INT(out.alert_count, 3);
+    CHECK_EQ_INT(out.alerts[0], INGEST_ALERT_CRASH);
+    CHECK_EQ_INT(out.alert_ms[0], 9000);
+    CHECK_EQ_INT(out.alerts[1], INGEST_ALERT_WIFI_FAILED);
+    CHECK_EQ_INT(out.alert_boot[1], 2);
+    CHECK_EQ_INT(out.alerts[2], INGEST_ALERT_CRASH);
+    CHECK_EQ_INT(out.alert_boot[2], 2);
+}
+
+// ========== INPUT ==========
+static void test_split_reads(void) {
+    const char *text = "I (1710) AQUA: pH: 7.12\r\nI (1720) AQUA: Turbidity: 3.40 NTU\r\nI (1730) AQUA: DO: 5.5";
+    setup();
+    for (const char *p = text; *p; p++) {
+        ingest_feed(&src, p, 1);
+    }
+    CHECK_EQ_INT(src.stats.lines, 2);
+    ingest_finish(&src);
+    CHECK_EQ_INT(src.stats.lines, 3);
+    CHECK_EQ_INT(src.stats.bytes, strlen(text));
+    CHECK_EQ_INT(out.row_count, 1);
+    CHECK_NEAR(out.rows[0].values[INGEST_TURBIDITY], 3.4, 1e-4);
+    CHECK_NEAR(out.rows[0].values[INGEST_DO], 5.5, 1e-4);
+
+    // Overlong lines are cut, not split into several
+    setup();
+    char junk[3 * INGEST_LINE_MAX];
+    memset(junk, 'x', sizeof(junk));
+    ingest_feed(&src, junk, sizeof(junk));
+    feed("\nI (1) AQUA: pH: 6.50\n");
+    ingest_finish(&src);
+    CHECK_EQ_INT(src.stats.lines, 2);
+    CHECK_NEAR(out.rows[0].values[INGEST_PH], 6.5, 1e-4);
+}
+
+static uint8_t records[4096];
+static size_t records_len;
+
+static void record_sink(const uint8_t *data, size_t len) {
+    if (records_len + len <= sizeof(records)) {
+        memcpy(records + records_len, data, len);
+        records_len += len;
+    }
+}
+
+static void test_deferred_records(void) {
+    records_len = 0;
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    AQUA_LOG(CYCLE_START, 12);
+    AQUA_LOG(CYCLE_AIR, 26.5f, 60.0f);
+    AQUA_LOG(CYCLE_SENSOR, "pH", 7.25f, "");
+    AQUA_LOG(UPLOAD_OK, 201);
+    aqua_log_set_sink(record_sink);
+    aqua_log_flush();
+    aqua_log_set_sink(NULL);
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+    CHECK(records_len > 0);
+
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char line[INGEST_LINE_MAX] = "AQL:";
+    size_t n = 4;
+    for (size_t i = 0; i < records_len; i += 3) {
+        uint32_t v = (uint32_t)records[i] << 16;
+        if (i + 1 < records_len) v |= (uint32_t)records[i + 1] << 8;
+        if (i + 2 < records_len) v |= records[i + 2];
+        line[n++] = b64[(v >> 18) & 63];
+        line[n++] = b64[(v >> 12) & 63];
+        line[n++] = i + 1 < records_len ? b64[(v >> 6) & 63] : '=';
+        line[n++] = i + 2 < records_len ? b64[v & 63] : '=';
+    }
+
+    setup();
+    ingest_line(&src, line, n);
+    ingest_line(&src, "AQL:not*base64", 14);
+    ingest_finish(&src);
+    CHECK_EQ_INT(src.stats.records, 4);
+    CHECK_EQ_INT(src.stats.bad_records, 1);
+    CHECK_EQ_INT(out.row_count, 1);
+    CHECK_EQ_INT(out.rows[0].cycle, 12);
+    CHECK_NEAR(out.rows[0].values[INGEST_AIR_TEMP], 26.5, 1e-4);
+    CHECK_NEAR(out.rows[0].values[INGEST_PH], 7.25, 1e-4);
+    CHECK_EQ_INT(out.rows[0].uploaded, 1);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_old_firmware_cycle);
+    RUN_TEST(test_current_firmware_cycle);
+    RUN_TEST(test_alert_edges);
+    RUN_TEST(test_resets_and_crashes);
+    RUN_TEST(test_split_reads);
+    RUN_TEST(test_deferred_records);
+
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,288 @@
+#include "aqua_cycle.h"
+#include "aqua_log.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "sensors.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Deferred logging: record encoding, ring buffer behaviour, and equivalence
+// of decoded records with the text-mode output for a full cycle.
+
+#define MAX_LINES 256
+
+typedef struct {
+    char lines[MAX_LINES][512];
+    int count;
+} captured_t;
+
+static standin_t *server;
+static captured_t text_out, records_out;
+static uint8_t sink_buf[16384];
+static size_t sink_len;
+
+static void capture_line(captured_t *c, const char *text) {
+    if (c->count < MAX_LINES) {
+        snprintf(c->lines[c->count], sizeof(c->lines[0]), "%s", text);
+    }
+    c->count++;
+}
+
+// esp_log_set_vprintf hook: keep only the message after "AQUA: "
+static int text_capture(const char *format, va_list args) {
+    char line[512];
+    vsnprintf(line, sizeof(line), format, args);
+    char *msg = strstr(line, "AQUA: ");
+    if (msg) {
+        msg += 6;
+        size_t len = strlen(msg);
+        if (len > 0 && msg[len - 1] == '\n') msg[len - 1] = '\0';
+        capture_line(&text_out, msg);
+    }
+    return 0;
+}
+
+static void record_sink(const uint8_t *records, size_t len) {
+    if (sink_len + len <= sizeof(sink_buf)) {
+        memcpy(sink_buf + sink_len, records, len);
+        sink_len += len;
+    }
+}
+
+// Decodes everything the sink received into records_out
+static int decode_sink(void) {
+    size_t pos = 0;
+    int bad = 0;
+    while (pos < sink_len) {
+        aqua_log_record_t rec;
+        char text[512];
+        size_t used = aqua_log_decode(sink_buf + pos, sink_len - pos, &rec);
+        if (used == 0 || aqua_log_format(&rec, text, sizeof(text)) < 0) {
+            bad++;
+            break;
+        }
+        capture_line(&records_out, text);
+        pos += used;
+    }
+    return bad;
+}
+
+static void reset_capture(void) {
+    memset(&text_out, 0, sizeof(text_out));
+    memset(&records_out, 0, sizeof(records_out));
+    sink_len = 0;
+    uint8_t scratch[AQUA_LOG_RING_SIZE + 64];
+    while (aqua_log_drain(scratch, sizeof(scratch)) > 0) {}
+}
+
+static void test_table_consistency(void) {
+    for (int id = 0; id < AQUA_MSG_COUNT; id++) {
+        const aqua_log_msg_t *msg = aqua_log_msg((aqua_msg_id_t)id);
+        aqua_log_record_t rec = { .id = (aqua_msg_id_t)id };
+        for (const char *sig = msg->signature; *sig; sig++) {
+            if (*sig == 's') {
+                rec.args[rec.argc].s.ptr = "x";
+                rec.args[rec.argc].s.len = 1;
+            } else if (*sig == 'f') {
+                rec.args[rec.argc].f = 1.0f;
+            } else {
+                rec.args[rec.argc].i = 1;
+            }
+            rec.argc++;
+        }
+        char text[512];
+        if (aqua_log_format(&rec, text, sizeof(text)) < 0) {
+            fprintf(stderr, "message %d: signature \"%s\" does not match \"%s\"\n",
+                    id, msg->signature, msg->format);
+            CHECK(false);
+        }
+    }
+}
+
+static void test_round_trip(void) {
+    reset_capture();
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    AQUA_LOG(CYCLE_AIR, 26.5f, 60.0f);
+    AQUA_LOG(UPLOAD_ATTEMPT_FAILED, 2, 503, "ESP_FAIL");
+    AQUA_LOG(DS_FINAL_RAW, 0x50, 0x05, 0x1C, 0x1C);
+    aqua_log_set_sink(record_sink);
+    aqua_log_flush();
+    aqua_log_set_sink(NULL);
+
+    CHECK_EQ_INT(decode_sink(), 0);
+    CHECK_EQ_INT(records_out.count, 3);
+    CHECK_STR(records_out.lines[0], "Air Temp: 26.5°C, Humidity: 60.0%");
+    CHECK_STR(records_out.lines[1], "[SUPABASE] Attempt 2 failed. Status: 503, Error: ESP_FAIL");
+    CHECK_STR(records_out.lines[2], "Raw data: 50 05, CRC calc: 1C, recv: 1C");
+    // 7-byte header + two floats
+    CHECK(sink_len < 3 * (AQUA_LOG_HEADER_SIZE + 16));
+    CHECK_EQ_INT(aqua_log_pending(), 0);
+}
+
+static void test_ring_overwrite(void) {
+    reset_capture();
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    const int total = 1000;
+    for (int i = 1; i <= total; i++) {
+        AQUA_LOG(CYCLE_START, i);
+    }
+    CHECK(aqua_log_pending() <= AQUA_LOG_RING_SIZE);
+
+    uint8_t buf[AQUA_LOG_RING_SIZE + 64];
+    size_t len = aqua_log_drain(buf, sizeof(buf));
+    aqua_log_record_t rec;
+    size_t pos = aqua_log_decode(buf, len, &rec);
+    CHECK_EQ_INT(rec.id, AQUA_MSG_LOG_DROPPED);
+    int dropped = rec.args[0].i;
+    int kept = 0, last = 0;
+    while (pos > 0 && pos < len) {
+        size_t used = aqua_log_decode(buf + pos, len - pos, &rec);
+        CHECK(used > 0);
+        if (used == 0) break;
+        CHECK_EQ_INT(rec.id, AQUA_MSG_CYCLE_START);
+        CHECK_EQ_INT(rec.args[0].i, last == 0 ? dropped + 1 : last + 1);
+        last = rec.args[0].i;
+        kept++;
+        pos += used;
+    }
+    CHECK_EQ_INT(dropped + kept, total);
+    CHECK_EQ_INT(last, total);
+    CHECK_EQ_INT(aqua_log_drain(buf, sizeof(buf)), 0);
+}
+
+static void test_string_truncation(void) {
+    reset_capture();
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    char big[300];
+    memset(big, 'a', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    AQUA_LOG(UPLOAD_PAYLOAD, big);
+
+    uint8_t buf[512];
+    size_t len = aqua_log_drain(buf, sizeof(buf));
+    aqua_log_record_t rec;
+    CHECK_EQ_INT(aqua_log_decode(buf, len, &rec), len);
+    CHECK_EQ_INT(rec.args[0].s.len, AQUA_LOG_MAX_STR);
+}
+
+static void test_level_filter(void) {
+    reset_capture();
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    aqua_log_set_level(ESP_LOG_WARN);
+    AQUA_LOG(CYCLE_READ_DHT);         // INFO: filtered
+    AQUA_LOG(CYCLE_UPLOAD_FAILED);    // WARN: kept
+    aqua_log_set_level(ESP_LOG_INFO);
+    CHECK_EQ_INT(aqua_log_pending(), AQUA_LOG_HEADER_SIZE);
+}
+
+static void test_gate(void) {
+    aqua_log_gate_t gate = {0};
+    CHECK(aqua_log_gate(&gate, 1, 0, 1000));
+    CHECK(!aqua_log_gate(&gate, 1, 500, 1000));
+    CHECK(aqua_log_gate(&gate, 3, 600, 1000));      // state change
+    CHECK(!aqua_log_gate(&gate, 3, 1599, 1000));
+    CHECK(aqua_log_gate(&gate, 3, 1600, 1000));     // repeat interval
+}
+
+static void test_cycle_matches_text(void) {
+    // Text mode reference
+    reset_capture();
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    hal_sim_config()->ds18b20_connected = false;
+    aqua_gpio_init();
+    sensor_health_reset();
+    supabase_outbound_reset();
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    vprintf_like_t previous = esp_log_set_vprintf(text_capture);
+    aqua_cycle_state_t text_state = {0};
+    aqua_cycle_run(&text_state);
+    esp_log_set_vprintf(previous);
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    // Same cycle in deferred mode; the missing-sensor report is gated, so
+    // clear its state by reporting a healthy reading first
+    send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f, false, false, false, false);
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    hal_sim_config()->ds18b20_connected = false;
+    aqua_gpio_init();
+    sensor_health_reset();
+    supabase_outbound_reset();
+    sink_len = 0;
+    uint8_t scratch[AQUA_LOG_RING_SIZE + 64];
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    while (aqua_log_drain(scratch, sizeof(scratch)) > 0) {}
+    aqua_log_set_sink(record_sink);
+    aqua_cycle_state_t deferred_state = {0};
+    aqua_cycle_run(&deferred_state);
+    aqua_log_set_sink(NULL);
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+
+    CHECK_EQ_INT(decode_sink(), 0);
+    CHECK(text_out.count > 20);
+    CHECK_EQ_INT(records_out.count, text_out.count);
+    for (int i = 0; i < text_out.count && i < records_out.count && i < MAX_LINES; i++) {
+        // Payload strings are truncated in records
+        if (strncmp(text_out.lines[i], "[SUPABASE] Payload: ", 20) == 0) {
+            CHECK(strncmp(text_out.lines[i], records_out.lines[i], strlen(records_out.lines[i])) == 0);
+            continue;
+        }
+        CHECK_STR(records_out.lines[i], text_out.lines[i]);
+    }
+
+    // One event for the missing probe instead of a banner per upload
+    int missing = 0;
+    for (int i = 0; i < records_out.count && i < MAX_LINES; i++) {
+        if (strstr(records_out.lines[i], "CRITICAL: DS18B20")) missing++;
+    }
+    CHECK_EQ_INT(missing, 1);
+}
+
+static void test_missing_sensor_events(void) {
+    reset_capture();
+    aqua_log_set_mode(AQUA_LOG_MODE_DEFERRED);
+    aqua_log_set_sink(record_sink);
+    send_to_supabase(26.5f, -999.0f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f, false, false, false, false);
+    send_to_supabase(26.5f, -999.0f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f, false, false, false, false);
+    send_to_supabase(26.5f, 25.5f, 60.0f, 7.0f, -999.0f, 10.0f, -999.0f, false, false, false, false);
+    aqua_log_flush();
+    aqua_log_set_sink(NULL);
+    aqua_log_set_mode(AQUA_LOG_MODE_TEXT);
+
+    CHECK_EQ_INT(decode_sink(), 0);
+    int missing = 0, failures = 0, restored = 0;
+    for (int i = 0; i < records_out.count && i < MAX_LINES; i++) {
+        if (strstr(records_out.lines[i], "CRITICAL: DS18B20")) missing++;
+        if (strstr(records_out.lines[i], "SYSTEM FAILURE: 1 OUT OF 3")) failures++;
+        if (strstr(records_out.lines[i], "All critical sensors connected")) restored++;
+    }
+    CHECK_EQ_INT(missing, 1);
+    CHECK_EQ_INT(failures, 1);
+    CHECK_EQ_INT(restored, 1);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    aqua_log_init();
+
+    RUN_TEST(test_table_consistency);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_ring_overwrite);
+    RUN_TEST(test_string_truncation);
+    RUN_TEST(test_level_filter);
+    RUN_TEST(test_gate);
+    RUN_TEST(test_missing_sensor_events);
+    RUN_TEST(test_cycle_matches_text);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
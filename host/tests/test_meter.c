@@ -0,0 +1,249 @@
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_cycle.h"
+#include "aqua_meter.h"
+#include "aqua_outq.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "test_util.h"
+
+// Actuator metering: run time, energy and flow from pulse totals, the flow
+// fault rules, the simulated pulse counters and the module over them.
+
+#define S(sec) ((int64_t)(sec) * 1000000)
+
+static const aqua_meter_desc_t *pump = &aqua_meter_descs[AQUA_ACT_PUMP];
+
+// Pulses for litres_per_min over sec seconds on the pump meter
+static uint32_t pump_pulses(float litres_per_min, int sec) {
+    return (uint32_t)(litres_per_min * PUMP_PULSES_PER_LITRE * sec / 60.0f);
+}
+
+static void setup(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    aqua_meter_init();
+}
+
+// Drive the outputs to c, let sec seconds pass and sample
+static void run_for(const aqua_controls_t *c, int sec, aqua_reading_t *r) {
+    hal_gpio_set_level(RELAY_PIN, c->ph_relay);
+    hal_gpio_set_level(AERATOR_PIN, c->aerator);
+    hal_gpio_set_level(FILTER_PIN, c->filter);
+    hal_gpio_set_level(PUMP_PIN, c->pump);
+    aqua_meter_sample(c, r);
+    hal_delay_ms((uint32_t)sec * 1000);
+}
+
+// ========== COUNTING ==========
+static void test_run_time_and_energy(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, false);
+    aqua_meter_update(&s, pump, 0, 0, false);
+    aqua_meter_update(&s, pump, S(600), 0, true);       // Off for the first 10 minutes
+    aqua_meter_update(&s, pump, S(4200), 0, true);
+    aqua_meter_update(&s, pump, S(5400), 0, false);
+
+    aqua_actuator_sample_t a;
+    aqua_meter_fill(&s, pump, &a);
+    CHECK_EQ_INT(a.on_s, 4800);
+    CHECK_NEAR(a.energy_wh, PUMP_RATED_W * 4800 / 3600.0f, 1e-3);
+    CHECK(!a.metered);
+    CHECK_EQ_INT(a.fault, AQUA_FLOW_OK);
+}
+
+static void test_flow_rate_and_wrap(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, true);
+    uint32_t start = 0xFFFFFF00u;                       // Counter wraps during the interval
+    aqua_meter_update(&s, pump, 0, start, true);
+    aqua_meter_update(&s, pump, S(60), start + pump_pulses(3.0f, 60), true);
+    CHECK_NEAR(s.flow_lpm, 3.0, 1e-3);
+    CHECK_EQ_INT(s.pulses, pump_pulses(3.0f, 60));
+
+    aqua_actuator_sample_t a;
+    aqua_meter_fill(&s, pump, &a);
+    CHECK(a.metered);
+    CHECK_NEAR(a.litres, 3.0, 1e-3);
+}
+
+static void test_backwards_count_ignored(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, true);
+    aqua_meter_update(&s, pump, 0, 0, true);
+    uint32_t total = pump_pulses(3.0f, 60);
+    aqua_meter_update(&s, pump, S(60), total, true);
+    aqua_meter_update(&s, pump, S(70), total + pump_pulses(3.0f, 10), true);
+
+    // A read that stepped back one counter span: no pulses, no verdict
+    uint32_t at_80 = total + pump_pulses(3.0f, 20);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(80), at_80 - 32767, true), AQUA_FLOW_OK);
+    CHECK_EQ_INT(s.pulses, total + pump_pulses(3.0f, 10));
+    CHECK_NEAR(s.flow_lpm, 3.0, 1e-3);
+
+    // The next read catches up, and nothing is lost
+    uint32_t at_90 = total + pump_pulses(3.0f, 30);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(90), at_90, true), AQUA_FLOW_OK);
+    CHECK_EQ_INT(s.pulses, at_90);
+    CHECK_EQ_INT(s.on_us, S(90));
+}
+
+static void test_no_flow_after_settling(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, true);
+    aqua_meter_update(&s, pump, 0, 0, false);
+    aqua_meter_update(&s, pump, S(60), 0, true);
+
+    // Switched on at the start of this interval: spin-up, not judged
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(70), 0, true), AQUA_FLOW_OK);
+    // On throughout and settled: nothing flowed
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(80), 0, true), AQUA_FLOW_NONE);
+    // Flow below the minimum still counts as none
+    uint32_t count = pump_pulses(0.5f, 10);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(90), count, true), AQUA_FLOW_NONE);
+    // Primed again
+    count += pump_pulses(3.0f, 10);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(100), count, true), AQUA_FLOW_OK);
+}
+
+static void test_flow_while_off(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, true);
+    aqua_meter_update(&s, pump, 0, 0, true);
+    uint32_t count = pump_pulses(3.0f, 60);
+    aqua_meter_update(&s, pump, S(60), count, false);
+
+    // Run-down after switching off is allowed
+    count += pump_pulses(3.0f, 10);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(70), count, false), AQUA_FLOW_OK);
+    // Still flowing once settled: the relay did not open
+    count += pump_pulses(3.0f, 10);
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(80), count, false), AQUA_FLOW_UNCOMMANDED);
+    // Switching it on ends the fault
+    CHECK_EQ_INT(aqua_meter_update(&s, pump, S(90), count + pump_pulses(3.0f, 10), true), AQUA_FLOW_OK);
+}
+
+static void test_clock_restart_takes_new_start(void) {
+    aqua_meter_state_t s;
+    aqua_meter_reset(&s, true);
+    aqua_meter_update(&s, pump, S(100), 5000, true);
+    aqua_meter_update(&s, pump, S(5), 10, true);        // Earlier than the last sample
+    CHECK_EQ_INT(s.on_us, 0);
+    CHECK_EQ_INT(s.pulses, 0);
+    aqua_meter_update(&s, pump, S(15), 10 + pump_pulses(3.0f, 10), true);
+    CHECK_EQ_INT(s.on_us, S(10));
+    CHECK_NEAR(s.flow_lpm, 3.0, 1e-3);
+}
+
+// ========== SIMULATED COUNTERS ==========
+static void test_sim_counter_follows_gate(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    hal_sim_config()->pulse_hz[PUMP_FLOW_PIN] = 100.0f;
+
+    uint32_t count = 1;
+    CHECK_EQ_INT(hal_pulse_count_read(PUMP_FLOW_PIN, &count), ESP_ERR_INVALID_STATE);
+    CHECK_EQ_INT(hal_pulse_count_start(PUMP_FLOW_PIN), ESP_OK);
+
+    hal_delay_ms(1000);                                 // Pump off: nothing
+    CHECK_EQ_INT(hal_pulse_count_read(PUMP_FLOW_PIN, &count), ESP_OK);
+    CHECK_EQ_INT(count, 0);
+
+    hal_gpio_set_level(PUMP_PIN, 1);
+    hal_delay_ms(2000);
+    hal_gpio_set_level(PUMP_PIN, 0);
+    hal_delay_ms(1000);
+    CHECK_EQ_INT(hal_pulse_count_read(PUMP_FLOW_PIN, &count), ESP_OK);
+    CHECK_EQ_INT(count, 200);
+    CHECK_EQ_INT(hal_sim_stats()->pulse_count_reads, 2);
+}
+
+// ========== MODULE ==========
+static void test_module_reports_actuators(void) {
+    setup();
+    aqua_reading_t r;
+    aqua_reading_clear(&r);
+    aqua_controls_t c = { .pump = true, .aerator = true };
+    for (int i = 0; i < 4; i++) {
+        run_for(&c, 10, &r);
+    }
+    aqua_meter_sample(&c, &r);
+
+    CHECK(r.has_actuators);
+    CHECK_EQ_INT(r.actuators[AQUA_ACT_PUMP].on_s, 40);
+    CHECK_NEAR(r.actuators[AQUA_ACT_PUMP].flow_lpm, 3.0, 0.01);
+    CHECK_NEAR(r.actuators[AQUA_ACT_PUMP].litres, 2.0, 0.01);
+    CHECK_NEAR(r.actuators[AQUA_ACT_AERATOR].flow_lpm, 20.0, 0.05);
+    CHECK_EQ_INT(r.actuators[AQUA_ACT_FILTER].on_s, 0);
+    CHECK(!r.actuators[AQUA_ACT_PH_RELAY].metered);
+    CHECK_EQ_INT(aqua_meter_alerts()->no_flow, 0);
+    CHECK_EQ_INT(aqua_meter_alerts()->flow_while_off, 0);
+
+    aqua_controls_t none = { 0 };
+    char json[AQUA_OUTQ_BODY_MAX];
+    CHECK(aqua_build_payload(&r, &none, json, sizeof(json)) > 0);
+    CHECK(strstr(json, ",\"actuators\":{\"ph_relay\":{\"on_s\":0,\"wh\":0.0},") != NULL);
+    CHECK(strstr(json, "\"pump\":{\"on_s\":40,\"wh\":0.2,\"l\":2.0,\"lpm\":3.00}}") != NULL);
+}
+
+static void test_module_raises_flow_faults(void) {
+    setup();
+    aqua_reading_t r;
+    aqua_reading_clear(&r);
+    aqua_controls_t c = { .pump = true, .filter = false };
+    hal_sim_config()->pulse_hz[PUMP_FLOW_PIN] = 0.0f;           // Dry pump
+    hal_sim_config()->pulse_gate[FILTER_FLOW_PIN] = -1;         // Welded filter relay
+    for (int i = 0; i < 3; i++) {
+        run_for(&c, 10, &r);
+    }
+    aqua_meter_sample(&c, &r);
+
+    CHECK_EQ_INT(aqua_meter_alerts()->no_flow, AQUA_ALERT_BIT(AQUA_ACT_PUMP));
+    CHECK_EQ_INT(aqua_meter_alerts()->flow_while_off, AQUA_ALERT_BIT(AQUA_ACT_FILTER));
+    CHECK_EQ_INT(r.actuators[AQUA_ACT_PUMP].fault, AQUA_FLOW_NONE);
+    CHECK_EQ_INT(aqua_meter_get_stats()->faults, 2);
+
+    char json[512];
+    CHECK(aqua_build_alert_payload(aqua_meter_alerts(), &r, json, sizeof(json)) > 0);
+    CHECK(strstr(json, "\"no_flow\":[\"pump\"],\"flow_while_off\":[\"filter\"]}") != NULL);
+
+    aqua_alert_states_t none = { 0 };
+    CHECK(aqua_alerts_changed(&none, aqua_meter_alerts()));
+}
+
+static void test_totals_survive_restart(void) {
+    setup();
+    aqua_reading_t r;
+    aqua_controls_t c = { .pump = true };
+    for (int i = 0; i < METER_SAVE_INTERVAL_CYCLES; i++) {
+        run_for(&c, 10, &r);
+    }
+    CHECK_EQ_INT(aqua_meter_get_stats()->saves, 1);
+    uint64_t on_us = aqua_meter_state(AQUA_ACT_PUMP)->on_us;
+    uint64_t pulses = aqua_meter_state(AQUA_ACT_PUMP)->pulses;
+    CHECK(on_us > 0);
+    CHECK(pulses > 0);
+
+    aqua_meter_init();
+    CHECK(aqua_meter_get_stats()->from_nvs);
+    CHECK_EQ_INT(aqua_meter_state(AQUA_ACT_PUMP)->on_us, on_us);
+    CHECK_EQ_INT(aqua_meter_state(AQUA_ACT_PUMP)->pulses, pulses);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_run_time_and_energy);
+    RUN_TEST(test_flow_rate_and_wrap);
+    RUN_TEST(test_backwards_count_ignored);
+    RUN_TEST(test_no_flow_after_settling);
+    RUN_TEST(test_flow_while_off);
+    RUN_TEST(test_clock_restart_takes_new_start);
+    RUN_TEST(test_sim_counter_follows_gate);
+    RUN_TEST(test_module_reports_actuators);
+    RUN_TEST(test_module_raises_flow_faults);
+    RUN_TEST(test_totals_survive_restart);
+
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,388 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_modbus.h"
+#include "aqua_registry.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "modbus_client.h"
+#include "test_util.h"
+
+// Modbus TCP server: the register image, exceptions, coil writes, and the
+// server on a socket against the client in host/modbus_client.c, with
+// several pollers reading while samples are published.
+
+static const aqua_reading_t reading = {
+    .air_temp = 30.0f, .humidity = 80.5f, .water_temp = 27.25f, .ph = 6.2f,
+    .do_level = 6.1f, .turbidity = 12.0f, .ammonia = AQUA_SENSOR_ERROR,
+    .has_health = true, .health = { 100, 90, 40, 100, 75, 0 },
+    .has_time = true, .time = { .unix_us = 1767225600123456LL, .quality = AQUA_TIME_SYNCED },
+};
+
+static void reset(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    aqua_anomaly_init();
+    aqua_modbus_init();
+}
+
+// One request through aqua_modbus_handle(); returns the response PDU length
+static int ask(const uint8_t *pdu, size_t pdu_len, uint8_t *out) {
+    uint8_t req[AQUA_MODBUS_FRAME_MAX] = { 0x12, 0x34, 0, 0, (uint8_t)((pdu_len + 1) >> 8), (uint8_t)(pdu_len + 1), 7 };
+    memcpy(req + 7, pdu, pdu_len);
+    uint8_t resp[AQUA_MODBUS_FRAME_MAX];
+    int n = aqua_modbus_handle(req, 7 + pdu_len, resp, sizeof(resp));
+    if (n < 7) {
+        return -1;
+    }
+    CHECK(memcmp(resp, req, 4) == 0);
+    CHECK_EQ_INT(resp[4] << 8 | resp[5], n - 6);
+    CHECK_EQ_INT(resp[6], 7);
+    memcpy(out, resp + 7, (size_t)n - 7);
+    return n - 7;
+}
+
+static int read_regs(uint16_t start, uint16_t count, uint16_t *regs) {
+    uint8_t pdu[5] = { 0x04, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count };
+    uint8_t out[AQUA_MODBUS_FRAME_MAX];
+    int n = ask(pdu, sizeof(pdu), out);
+    if (n != 2 + 2 * count || out[0] != 0x04 || out[1] != 2 * count) {
+        return n >= 2 && out[0] == 0x84 ? out[1] : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        regs[i] = (uint16_t)(out[2 + 2 * i] << 8 | out[3 + 2 * i]);
+    }
+    return 0;
+}
+
+// Exception code answered for pdu, or -1 for a normal answer
+static int exception_for(const uint8_t *pdu, size_t len) {
+    uint8_t out[AQUA_MODBUS_FRAME_MAX];
+    int n = ask(pdu, len, out);
+    return n == 2 && out[0] == (pdu[0] | 0x80) ? out[1] : -1;
+}
+
+static float reg_float(const uint16_t *regs, int reg) {
+    uint32_t bits = (uint32_t)regs[reg] << 16 | regs[reg + 1];
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// ========== FRAMES ==========
+static void test_frame_length(void) {
+    uint8_t f[] = { 0, 1, 0, 0, 0, 6, 1, 4, 0, 0, 0, 1 };
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, 5), 0);
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, 6), 12);
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, sizeof(f)), 12);
+    f[3] = 1;                   // Protocol other than Modbus
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, sizeof(f)), -1);
+    f[3] = 0;
+    f[5] = 1;                   // No room for a function code
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, sizeof(f)), -1);
+    f[4] = 1;                   // Longer than any PDU
+    f[5] = 0;
+    CHECK_EQ_INT(aqua_modbus_frame_length(f, sizeof(f)), -1);
+
+    // A frame that is not exactly one request closes the connection
+    uint8_t resp[AQUA_MODBUS_FRAME_MAX];
+    uint8_t g[] = { 0, 1, 0, 0, 0, 6, 1, 4, 0, 0, 0, 1, 0 };
+    CHECK_EQ_INT(aqua_modbus_handle(g, sizeof(g), resp, sizeof(resp)), -1);
+    CHECK_EQ_INT(aqua_modbus_handle(g, sizeof(g) - 2, resp, sizeof(resp)), -1);
+    CHECK_EQ_INT(aqua_modbus_handle(g, sizeof(g) - 1, resp, 8), 0);
+}
+
+// ========== IMAGE ==========
+static void test_empty_image(void) {
+    reset();
+    uint16_t regs[AQUA_MODBUS_REGISTERS];
+    CHECK_EQ_INT(read_regs(0, 100, regs), 0);
+    CHECK_EQ_INT(read_regs(100, 14, regs + 100), 0);
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        CHECK_EQ_INT(regs[AQUA_MODBUS_REG_VALUE + id], AQUA_MODBUS_MISSING);
+        CHECK(isnan(reg_float(regs, AQUA_MODBUS_REG_FLOAT + 2 * id)));
+    }
+    for (int s = 0; s < AQUA_SENSOR_COUNT; s++) {
+        CHECK_EQ_INT(regs[AQUA_MODBUS_REG_HEALTH + s], 0xFFFF);
+    }
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_RELAYS], 0);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_SAMPLE + 1], 0);
+}
+
+static void test_publish(void) {
+    reset();
+    aqua_controls_t c = { .ph_relay = true, .filter = true };
+    aqua_modbus_publish(&reading, &c, 0x10002);
+
+    uint16_t regs[AQUA_MODBUS_REGISTERS];
+    CHECK_EQ_INT(read_regs(0, 100, regs), 0);
+    CHECK_EQ_INT(read_regs(100, 14, regs + 100), 0);
+    CHECK_EQ_INT((int16_t)regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_WATER_TEMP], 2725);
+    CHECK_EQ_INT((int16_t)regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_PH], 620);
+    CHECK_EQ_INT((int16_t)regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_HUMIDITY], 8050);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_AMMONIA], AQUA_MODBUS_MISSING);
+    CHECK_NEAR(reg_float(regs, AQUA_MODBUS_REG_FLOAT + 2 * AQUA_MEAS_DO), 6.1f, 0.0);
+    CHECK(isnan(reg_float(regs, AQUA_MODBUS_REG_FLOAT + 2 * AQUA_MEAS_AMMONIA)));
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_HEALTH + AQUA_SENSOR_PH], 40);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_HEALTH + AQUA_SENSOR_AMMONIA], 0);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_RELAYS], 0x5);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_ALERTS_LOW], AQUA_ALERT_BIT(AQUA_MEAS_PH));
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_ALERTS_HIGH], 0);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_SAMPLE], 1);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_SAMPLE + 1], 2);
+    CHECK_EQ_INT((uint32_t)regs[AQUA_MODBUS_REG_TIME] << 16 | regs[AQUA_MODBUS_REG_TIME + 1], 1767225600u);
+
+    // Holding and input registers are one map
+    uint8_t holding[5] = { 0x03, 0, AQUA_MODBUS_REG_VALUE + AQUA_MEAS_PH, 0, 1 };
+    uint8_t out[AQUA_MODBUS_FRAME_MAX];
+    CHECK_EQ_INT(ask(holding, sizeof(holding), out), 4);
+    CHECK_EQ_INT(out[2] << 8 | out[3], 620);
+
+    // Not synced: no sample time
+    aqua_reading_t unsynced = reading;
+    unsynced.time.quality = AQUA_TIME_UNSYNCED;
+    aqua_modbus_publish(&unsynced, &c, 3);
+    CHECK_EQ_INT(read_regs(AQUA_MODBUS_REG_TIME, 2, regs), 0);
+    CHECK_EQ_INT(regs[0] | regs[1], 0);
+}
+
+static void test_saturation(void) {
+    reset();
+    aqua_reading_t r = reading;
+    r.turbidity = 3000.0f;      // x100 does not fit
+    aqua_controls_t c = {0};
+    aqua_modbus_publish(&r, &c, 1);
+    uint16_t regs[AQUA_MODBUS_REGISTERS];
+    CHECK_EQ_INT(read_regs(0, AQUA_MEAS_ID_COUNT, regs), 0);
+    CHECK_EQ_INT((int16_t)regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_TURBIDITY], 32767);
+    CHECK_EQ_INT(read_regs(AQUA_MODBUS_REG_FLOAT + 2 * AQUA_MEAS_TURBIDITY, 2, regs), 0);
+    CHECK_NEAR(reg_float(regs, 0), 3000.0, 0.0);
+}
+
+static void test_exceptions(void) {
+    reset();
+    uint8_t write_reg[5] = { 0x06, 0, 0, 0, 1 };
+    CHECK_EQ_INT(exception_for(write_reg, sizeof(write_reg)), 0x01);
+    uint8_t past_end[5] = { 0x04, 0, AQUA_MODBUS_REGISTERS - 1, 0, 2 };
+    CHECK_EQ_INT(exception_for(past_end, sizeof(past_end)), 0x02);
+    uint8_t none[5] = { 0x03, 0, 0, 0, 0 };
+    CHECK_EQ_INT(exception_for(none, sizeof(none)), 0x03);
+    uint8_t too_many[5] = { 0x04, 0, 0, 0, 126 };
+    CHECK_EQ_INT(exception_for(too_many, sizeof(too_many)), 0x03);
+    uint8_t short_read[3] = { 0x04, 0, 0 };
+    CHECK_EQ_INT(exception_for(short_read, sizeof(short_read)), 0x03);
+    uint8_t coil_past_end[5] = { 0x01, 0, 2, 0, 3 };
+    CHECK_EQ_INT(exception_for(coil_past_end, sizeof(coil_past_end)), 0x02);
+    uint8_t bad_value[5] = { 0x05, 0, 1, 0x12, 0x34 };
+    CHECK_EQ_INT(exception_for(bad_value, sizeof(bad_value)), 0x03);
+    uint8_t no_coil[5] = { 0x05, 0, AQUA_MODBUS_COILS, 0xFF, 0 };
+    CHECK_EQ_INT(exception_for(no_coil, sizeof(no_coil)), 0x02);
+    uint8_t bad_bytes[7] = { 0x0F, 0, 0, 0, 4, 2, 0xF };
+    CHECK_EQ_INT(exception_for(bad_bytes, sizeof(bad_bytes)), 0x03);
+
+    aqua_modbus_stats_t st;
+    aqua_modbus_get_stats(&st);
+    CHECK_EQ_INT(st.requests, 9);
+    CHECK_EQ_INT(st.exceptions, 9);
+    CHECK_EQ_INT(st.coil_writes, 0);
+    CHECK_EQ_INT(hal_gpio_get_level(AERATOR_PIN), 0);
+}
+
+// ========== COILS ==========
+static void test_coil_writes(void) {
+    reset();
+    aqua_controls_t c = { .aerator = true };
+    aqua_modbus_publish(&reading, &c, 1);
+
+    uint8_t pump_on[5] = { 0x05, 0, 3, 0xFF, 0x00 };
+    uint8_t out[AQUA_MODBUS_FRAME_MAX];
+    CHECK_EQ_INT(ask(pump_on, sizeof(pump_on), out), 5);
+    CHECK(memcmp(out, pump_on, 5) == 0);
+    CHECK_EQ_INT(hal_gpio_get_level(PUMP_PIN), 1);
+
+    // pH relay on, aerator off, filter on in one request
+    uint8_t three[7] = { 0x0F, 0, 0, 0, 3, 1, 0x5 };
+    CHECK_EQ_INT(ask(three, sizeof(three), out), 5);
+    CHECK(memcmp(out, three, 5) == 0);
+    CHECK_EQ_INT(hal_gpio_get_level(RELAY_PIN), 1);
+    CHECK_EQ_INT(hal_gpio_get_level(AERATOR_PIN), 0);
+    CHECK_EQ_INT(hal_gpio_get_level(FILTER_PIN), 1);
+    CHECK_EQ_INT(hal_gpio_get_level(PUMP_PIN), 1);
+
+    uint8_t read_coils[5] = { 0x01, 0, 0, 0, 4 };
+    CHECK_EQ_INT(ask(read_coils, sizeof(read_coils), out), 3);
+    CHECK_EQ_INT(out[1], 1);
+    CHECK_EQ_INT(out[2], 0xD);
+    uint8_t upper[5] = { 0x01, 0, 2, 0, 2 };
+    CHECK_EQ_INT(ask(upper, sizeof(upper), out), 3);
+    CHECK_EQ_INT(out[2], 0x3);
+
+    // The register image shows the relays as driven now
+    uint16_t reg;
+    CHECK_EQ_INT(read_regs(AQUA_MODBUS_REG_RELAYS, 1, &reg), 0);
+    CHECK_EQ_INT(reg, 0xD);
+    aqua_modbus_stats_t st;
+    aqua_modbus_get_stats(&st);
+    CHECK_EQ_INT(st.coil_writes, 2);
+
+    // The next cycle's decision replaces them
+    aqua_modbus_publish(&reading, &c, 2);
+    CHECK_EQ_INT(read_regs(AQUA_MODBUS_REG_RELAYS, 1, &reg), 0);
+    CHECK_EQ_INT(reg, 0x2);
+    CHECK_EQ_INT(ask(read_coils, sizeof(read_coils), out), 3);
+    CHECK_EQ_INT(out[2], 0x2);
+}
+
+// ========== SERVER ==========
+static int port;
+
+static modbus_client_t *connect_client(void) {
+    return modbus_connect("127.0.0.1", port);
+}
+
+static void wait_clients(int n) {
+    aqua_modbus_stats_t st;
+    for (int i = 0; i < 200; i++) {
+        aqua_modbus_get_stats(&st);
+        if (st.clients == n) {
+            return;
+        }
+        sleep_ms(10);
+    }
+    CHECK_EQ_INT(st.clients, n);
+}
+
+static void test_server(void) {
+    reset();
+    CHECK_EQ_INT(aqua_modbus_port(), 0);
+    CHECK_EQ_INT(aqua_modbus_start(0), ESP_OK);
+    port = aqua_modbus_port();
+    CHECK(port > 0);
+    CHECK_EQ_INT(aqua_modbus_start(0), ESP_ERR_INVALID_STATE);
+
+    aqua_controls_t c = { .filter = true };
+    aqua_modbus_publish(&reading, &c, 5);
+    modbus_client_t *cl = connect_client();
+    CHECK(cl != NULL);
+    if (!cl) {
+        return;
+    }
+    uint16_t regs[AQUA_MODBUS_REGISTERS];
+    CHECK_EQ_INT(modbus_read_registers(cl, 0x04, 0, 34, regs), 0);
+    CHECK_EQ_INT((int16_t)regs[AQUA_MODBUS_REG_VALUE + AQUA_MEAS_PH], 620);
+    CHECK_EQ_INT(regs[AQUA_MODBUS_REG_SAMPLE + 1], 5);
+    CHECK_EQ_INT(modbus_read_registers(cl, 0x03, 100, 14, regs), 0);
+    CHECK_NEAR(reg_float(regs, 2 * AQUA_MEAS_WATER_TEMP), 27.25, 0.0);
+    CHECK_EQ_INT(modbus_read_registers(cl, 0x04, 110, 5, regs), 0x02);
+
+    CHECK_EQ_INT(modbus_write_coil(cl, 1, true), 0);
+    CHECK_EQ_INT(modbus_write_coils(cl, 2, 2, 0x2), 0);
+    uint8_t bits = 0;
+    CHECK_EQ_INT(modbus_read_coils(cl, 0, 4, &bits), 0);
+    CHECK_EQ_INT(bits, 0xA);
+    CHECK_EQ_INT(hal_gpio_get_level(AERATOR_PIN), 1);
+    CHECK_EQ_INT(hal_gpio_get_level(FILTER_PIN), 0);
+    CHECK_EQ_INT(hal_gpio_get_level(PUMP_PIN), 1);
+
+    // Two requests in one segment, then one split across two
+    uint8_t two[24] = { 0, 1, 0, 0, 0, 6, 1, 4, 0, AQUA_MODBUS_REG_SAMPLE + 1, 0, 1,
+                        0, 2, 0, 0, 0, 6, 1, 1, 0, 0, 0, 4 };
+    uint8_t resp[64];
+    int have = 0;
+    for (int i = 0; i < 5 && have < 21; i++) {
+        int n = modbus_exchange_raw(cl, i == 0 ? two : NULL, i == 0 ? sizeof(two) : 0, resp + have,
+                                    sizeof(resp) - (size_t)have, 1000);
+        if (n <= 0) break;
+        have += n;
+    }
+    CHECK_EQ_INT(have, 11 + 10);
+    CHECK_EQ_INT(resp[1], 1);
+    CHECK_EQ_INT(resp[10], 5);
+    CHECK_EQ_INT(resp[11 + 1], 2);
+    CHECK_EQ_INT(resp[11 + 9], 0xA);
+    CHECK_EQ_INT(modbus_exchange_raw(cl, two, 5, resp, sizeof(resp), 100), 0);
+    CHECK_EQ_INT(modbus_exchange_raw(cl, two + 5, 7, resp, sizeof(resp), 1000), 11);
+
+    // A frame that is not Modbus closes the connection
+    uint8_t bad[12] = { 0, 3, 0, 9, 0, 6, 1, 4, 0, 0, 0, 1 };
+    CHECK_EQ_INT(modbus_exchange_raw(cl, bad, sizeof(bad), resp, sizeof(resp), 1000), -1);
+    modbus_close(cl);
+    wait_clients(0);
+
+    aqua_modbus_stats_t st;
+    aqua_modbus_get_stats(&st);
+    CHECK_EQ_INT(st.accepted, 1);
+    CHECK_EQ_INT(st.dropped, 1);
+    CHECK_EQ_INT(st.coil_writes, 2);
+}
+
+static void test_client_limit(void) {
+    modbus_client_t *cl[MODBUS_MAX_CLIENTS + 1];
+    uint16_t reg;
+    for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        cl[i] = connect_client();
+        CHECK(cl[i] != NULL);
+        if (!cl[i]) return;
+        CHECK_EQ_INT(modbus_read_registers(cl[i], 0x04, 0, 1, &reg), 0);
+    }
+    wait_clients(MODBUS_MAX_CLIENTS);
+
+    // Connects, then is closed at once
+    cl[MODBUS_MAX_CLIENTS] = connect_client();
+    CHECK(cl[MODBUS_MAX_CLIENTS] != NULL);
+    if (!cl[MODBUS_MAX_CLIENTS]) return;
+    CHECK_EQ_INT(modbus_read_registers(cl[MODBUS_MAX_CLIENTS], 0x04, 0, 1, &reg), -1);
+
+    for (int i = 0; i <= MODBUS_MAX_CLIENTS; i++) {
+        modbus_close(cl[i]);
+    }
+    wait_clients(0);
+    aqua_modbus_stats_t st;
+    aqua_modbus_get_stats(&st);
+    CHECK_EQ_INT(st.refused, 1);
+}
+
+static void test_concurrent_pollers(void) {
+    // Pollers reading the whole map back to back while the samples change
+    // under them every 200 µs: no exceptions and no answer mixing two samples
+    modbus_poll_config_t cfg;
+    modbus_poll_defaults(&cfg);
+    cfg.port = port;
+    cfg.pollers = MODBUS_MAX_CLIENTS;
+    cfg.duration_s = 0.5;
+    cfg.publish_us = 200;
+    modbus_poll_report_t rep;
+    CHECK(modbus_poll_run(&cfg, &rep));
+    CHECK_EQ_INT(rep.errors, 0);
+    CHECK_EQ_INT(rep.torn, 0);
+    CHECK(rep.requests > 100);
+    CHECK(rep.published > 100);
+    CHECK(rep.samples_seen > 10);
+    CHECK(rep.latency.max_ms < 1000.0);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_frame_length);
+    RUN_TEST(test_empty_image);
+    RUN_TEST(test_publish);
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_exceptions);
+    RUN_TEST(test_coil_writes);
+    RUN_TEST(test_server);
+    RUN_TEST(test_client_limit);
+    RUN_TEST(test_concurrent_pollers);
+
+    return TEST_EXIT_CODE;
+}
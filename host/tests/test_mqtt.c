@@ -0,0 +1,209 @@
+#include <unistd.h>
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_log.h"
+#include "aqua_mqtt.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "mqtt_standin.h"
+#include "mqtt_transport.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// MQTT transport against the local broker stand-in: QoS 1 window, resends,
+// persistent sessions, keepalive, and relay commands by subscription.
+
+#define TELEMETRY_TOPIC "aqua/" AQUA_DEVICE_ID "/telemetry"
+#define RELAY_TOPIC "aqua/" AQUA_DEVICE_ID "/relay"
+
+static standin_t *http;
+static mqtt_standin_t *broker;
+static aqua_mqtt_client_t client;     // Direct client for protocol-level tests
+
+static const aqua_reading_t reading = {
+    .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+    .do_level = AQUA_SENSOR_ERROR, .turbidity = 10.0f, .ammonia = AQUA_SENSOR_ERROR
+};
+static const aqua_controls_t controls = { .aerator = true };
+
+static void connect_client(int window, int ack_timeout_ms, uint16_t keepalive_s) {
+    aqua_mqtt_config_t cfg = {
+        .host = "127.0.0.1",
+        .port = mqtt_standin_port(broker),
+        .tls = HAL_TLS_NONE,
+        .client_id = "test-client",
+        .keepalive_s = keepalive_s,
+        .inflight_window = window,
+        .ack_timeout_ms = ack_timeout_ms,
+    };
+    aqua_mqtt_init(&client, &cfg);
+    CHECK_EQ_INT(aqua_mqtt_connect(&client, 1000), ESP_OK);
+}
+
+// Waits (in real time) until the broker has closed the connection
+static void wait_disconnected(aqua_mqtt_client_t *c) {
+    for (int i = 0; i < 100 && c->connected; i++) {
+        aqua_mqtt_poll(c, 10);
+    }
+    CHECK(!c->connected);
+}
+
+// Services the transport until pin reads level
+static bool wait_output(int pin, int level) {
+    for (int i = 0; i < 200; i++) {
+        mqtt_process_commands();
+        if (hal_sim_output_level(pin) == level) return true;
+        usleep(2000);
+    }
+    return false;
+}
+
+static void test_publish_matches_http_body(void) {
+    mqtt_standin_clear(broker);
+    CHECK(mqtt_send_reading(&reading, &controls));
+    CHECK_EQ_INT(aqua_mqtt_flush(mqtt_transport_client(), 1000), ESP_OK);
+
+    char expected[512];
+    aqua_build_payload(&reading, &controls, expected, sizeof(expected));
+    mqtt_standin_message_t msg;
+    CHECK_EQ_INT(mqtt_standin_publish_count(broker), 1);
+    CHECK(mqtt_standin_get_publish(broker, 0, &msg));
+    CHECK_STR(msg.topic, TELEMETRY_TOPIC);
+    CHECK_STR(msg.payload, expected);
+    CHECK_EQ_INT(msg.qos, 1);
+    CHECK(!msg.dup);
+}
+
+static void test_window_and_resend_after_reconnect(void) {
+    mqtt_standin_clear(broker);
+    connect_client(2, 0, 0);
+    mqtt_standin_drop_acks(broker, 2);
+
+    CHECK_EQ_INT(aqua_mqtt_publish(&client, "t/a", "1", 1, 1, 100), ESP_OK);
+    CHECK_EQ_INT(aqua_mqtt_publish(&client, "t/a", "2", 1, 1, 100), ESP_OK);
+    CHECK_EQ_INT(aqua_mqtt_inflight(&client), 2);
+    // Window full and the broker never acknowledges
+    CHECK_EQ_INT(aqua_mqtt_publish(&client, "t/a", "3", 1, 1, 50), ESP_ERR_TIMEOUT);
+
+    mqtt_standin_kick(broker);
+    wait_disconnected(&client);
+    CHECK_EQ_INT(aqua_mqtt_inflight(&client), 2);
+
+    CHECK_EQ_INT(aqua_mqtt_connect(&client, 1000), ESP_OK);
+    CHECK_EQ_INT(aqua_mqtt_flush(&client, 1000), ESP_OK);
+    CHECK_EQ_INT(client.stats.resent, 2);
+    CHECK_EQ_INT(client.stats.acked, 2);
+
+    mqtt_standin_message_t first, resent;
+    CHECK_EQ_INT(mqtt_standin_publish_count(broker), 4);
+    CHECK(mqtt_standin_get_publish(broker, 0, &first));
+    CHECK(mqtt_standin_get_publish(broker, 2, &resent));
+    CHECK(resent.dup);
+    CHECK_EQ_INT(resent.packet_id, first.packet_id);
+    CHECK_STR(resent.payload, first.payload);
+    aqua_mqtt_disconnect(&client);
+}
+
+static void test_resend_after_ack_timeout(void) {
+    connect_client(4, 100, 0);
+    mqtt_standin_drop_acks(broker, 1);
+    CHECK_EQ_INT(aqua_mqtt_publish(&client, "t/b", "x", 1, 1, 100), ESP_OK);
+    CHECK_EQ_INT(aqua_mqtt_poll(&client, 20), ESP_OK);
+    CHECK_EQ_INT(aqua_mqtt_inflight(&client), 1);
+
+    hal_delay_ms(150);
+    CHECK_EQ_INT(aqua_mqtt_flush(&client, 1000), ESP_OK);
+    CHECK_EQ_INT(client.stats.resent, 1);
+    aqua_mqtt_disconnect(&client);
+}
+
+static void test_keepalive_ping(void) {
+    mqtt_standin_clear(broker);
+    connect_client(1, 0, 1);
+    hal_delay_ms(1100);
+    CHECK_EQ_INT(aqua_mqtt_poll(&client, 0), ESP_OK);
+    for (int i = 0; i < 100 && client.ping_outstanding; i++) {
+        aqua_mqtt_poll(&client, 10);
+    }
+    CHECK(!client.ping_outstanding);
+    CHECK(client.connected);
+    CHECK_EQ_INT(mqtt_standin_ping_count(broker), 1);
+
+    // Only one ping per idle keepalive period
+    CHECK_EQ_INT(aqua_mqtt_poll(&client, 0), ESP_OK);
+    CHECK_EQ_INT(mqtt_standin_ping_count(broker), 1);
+    aqua_mqtt_disconnect(&client);
+}
+
+static void test_command_by_subscription(void) {
+    CHECK(mqtt_transport_start());
+    mqtt_standin_publish(broker, RELAY_TOPIC, "[{\"relay_type\":\"aerator\",\"state\":true}]");
+    CHECK(wait_output(AERATOR_PIN, 1));
+    mqtt_standin_publish(broker, RELAY_TOPIC, "[{\"relay_type\":\"aerator\",\"state\":false}]");
+    CHECK(wait_output(AERATOR_PIN, 0));
+}
+
+static void test_persistent_session_queues_commands(void) {
+    CHECK(mqtt_transport_start());
+    mqtt_transport_stop();
+    for (int i = 0; i < 100 && mqtt_standin_client_connected(broker); i++) {
+        usleep(2000);
+    }
+    int connects = mqtt_standin_connect_count(broker);
+
+    // Sent while the device is offline
+    mqtt_standin_publish(broker, RELAY_TOPIC, "[{\"relay_type\":\"filter\",\"state\":true}]");
+    CHECK_EQ_INT(hal_sim_output_level(FILTER_PIN), 0);
+
+    CHECK(mqtt_transport_start());
+    CHECK(mqtt_transport_client()->session_present);
+    CHECK_EQ_INT(mqtt_standin_connect_count(broker), connects + 1);
+    CHECK(wait_output(FILTER_PIN, 1));
+}
+
+static void test_cycle_over_mqtt(void) {
+    hal_sim_reset();
+    aqua_gpio_init();
+    mqtt_standin_clear(broker);
+    standin_clear(http);
+    supabase_outbound_reset();
+
+    aqua_cycle_set_transport(AQUA_TRANSPORT_MQTT);
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    aqua_cycle_run(&state);
+    aqua_cycle_set_transport(AQUA_TRANSPORT_HTTP);
+
+    CHECK(state.uploaded);
+    CHECK_EQ_INT(aqua_mqtt_flush(mqtt_transport_client(), 1000), ESP_OK);
+    CHECK_EQ_INT(mqtt_standin_publish_count(broker), 2);
+    // No REST upload, no relay poll, and no alert for the unplugged DO probe
+    CHECK_EQ_INT(standin_request_count(http), 0);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    http = standin_start();
+    broker = mqtt_standin_start();
+    if (!http || !broker) {
+        fprintf(stderr, "failed to start stand-in servers\n");
+        return 1;
+    }
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(http));
+    hal_sim_set_stream_endpoint("127.0.0.1", mqtt_standin_port(broker));
+    aqua_gpio_init();
+
+    RUN_TEST(test_publish_matches_http_body);
+    RUN_TEST(test_window_and_resend_after_reconnect);
+    RUN_TEST(test_resend_after_ack_timeout);
+    RUN_TEST(test_keepalive_ping);
+    RUN_TEST(test_command_by_subscription);
+    RUN_TEST(test_persistent_session_queues_commands);
+    RUN_TEST(test_cycle_over_mqtt);
+
+    mqtt_transport_stop();
+    mqtt_standin_stop(broker);
+    standin_stop(http);
+    return TEST_EXIT_CODE;
+}
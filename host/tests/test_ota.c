@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_delta.h"
+#include "aqua_ota.h"
+#include "delta_encoder.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "test_util.h"
+
+// Delta encoding/decoding and the OTA path end to end: manifest, delta or
+// full download from the HTTP stand-in into the simulated A/B slots, and
+// the confirm/rollback decision after the first cycle on the new image.
+
+#define IMAGE_BLOCKS 4096               // 256 KiB images
+#define BLOCK 64
+#define INSERT_AT (IMAGE_BLOCKS * 2 / 5)
+#define INSERT_LEN 300
+#define CHANGED_FROM (IMAGE_BLOCKS * 7 / 10)
+#define CHANGED_BLOCKS 32
+
+#define FW_PATH "/storage/v1/object/public/firmware/"
+#define FW_URL "https://example.supabase.co" FW_PATH
+#define MANIFEST_PATH FW_PATH "manifest.json"
+
+static standin_t *server;
+static uint8_t *old_img, *new_img, *delta;
+static size_t old_len, new_len, delta_len;
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+// Code-like image: 60 bytes of "instructions" per block plus one absolute
+// address literal. Version 2 inserts a function (shifting everything after
+// it, and so every address that points past it) and rewrites one region.
+static size_t build_image(uint8_t *out, int version) {
+    size_t pos = 0;
+    for (int b = 0; b < IMAGE_BLOCKS; b++) {
+        if (version == 2 && b == INSERT_AT) {
+            uint32_t s = 0xC0FFEE;
+            for (int i = 0; i < INSERT_LEN; i++) out[pos++] = (uint8_t)lcg(&s);
+        }
+        bool changed = version == 2 && b >= CHANGED_FROM && b < CHANGED_FROM + CHANGED_BLOCKS;
+        uint32_t s = (uint32_t)b * 2654435761u + (changed ? 7 : 0);
+        for (int i = 0; i < BLOCK - 4; i++) out[pos++] = (uint8_t)lcg(&s);
+
+        uint32_t target = lcg(&s) % IMAGE_BLOCKS;
+        uint32_t addr = 0x42000000u + target * BLOCK;
+        if (version == 2 && target >= INSERT_AT) addr += INSERT_LEN;
+        for (int i = 0; i < 4; i++) out[pos++] = (uint8_t)(addr >> (8 * i));
+    }
+    return pos;
+}
+
+// ========== IN-MEMORY DELTA APPLY ==========
+typedef struct {
+    const uint8_t *source;
+    size_t source_len;
+    uint8_t *out;
+    size_t out_len;
+    int writes;
+} mem_ctx_t;
+
+static bool mem_read(void *ctx, size_t offset, void *buf, size_t len) {
+    mem_ctx_t *m = ctx;
+    if (offset + len > m->source_len) return false;
+    memcpy(buf, m->source + offset, len);
+    return true;
+}
+
+static bool mem_write(void *ctx, const void *data, size_t len) {
+    mem_ctx_t *m = ctx;
+    memcpy(m->out + m->out_len, data, len);
+    m->out_len += len;
+    m->writes++;
+    return true;
+}
+
+static aqua_delta_result_t apply(const uint8_t *src, size_t src_len, const uint8_t *d, size_t d_len,
+                                 size_t chunk, mem_ctx_t *m) {
+    static aqua_delta_t dec;
+    memset(m, 0, sizeof(*m));
+    m->source = src;
+    m->source_len = src_len;
+    m->out = malloc(HAL_SIM_OTA_SLOT_SIZE);
+    aqua_delta_init(&dec, mem_read, mem_write, m);
+    aqua_delta_result_t r = AQUA_DELTA_MORE;
+    for (size_t pos = 0; pos < d_len && r == AQUA_DELTA_MORE; pos += chunk) {
+        r = aqua_delta_feed(&dec, d + pos, d_len - pos < chunk ? d_len - pos : chunk);
+    }
+    return r;
+}
+
+static void test_crc32(void) {
+    CHECK_EQ_INT(aqua_crc32(0, "123456789", 9), 0xCBF43926u);
+    // Incremental equals one-shot
+    CHECK_EQ_INT(aqua_crc32(aqua_crc32(0, "1234", 4), "56789", 5), 0xCBF43926u);
+}
+
+static void test_manifest(void) {
+    aqua_ota_manifest_t m;
+    const char *json = "{\"version\":\"4.1.0\",\"url\":\"https://h/fw.bin\",\"size\":1000,\"crc32\":4294967295,"
+                       "\"notes\":{\"a\":[1,2]},\"deltas\":[{\"from\":\"3.9.0\",\"url\":\"https://h/a\",\"size\":5},"
+                       "{\"from\":\"4.0.0\",\"url\":\"https://h/b\",\"size\":7}]}";
+    CHECK(aqua_parse_ota_manifest(json, "4.0.0", &m));
+    CHECK_STR(m.version, "4.1.0");
+    CHECK_STR(m.image_url, "https://h/fw.bin");
+    CHECK_EQ_INT(m.image_size, 1000);
+    CHECK_EQ_INT(m.image_crc, 0xFFFFFFFFu);
+    CHECK_STR(m.delta_url, "https://h/b");
+    CHECK_EQ_INT(m.delta_size, 7);
+
+    CHECK(aqua_parse_ota_manifest(json, "3.0.0", &m));
+    CHECK_STR(m.delta_url, "");
+
+    CHECK(!aqua_parse_ota_manifest("{\"version\":\"4.1.0\",\"url\":\"x\",\"size\":10}", "4.0.0", &m));
+    CHECK(!aqua_parse_ota_manifest("[]", "4.0.0", &m));
+    CHECK(!aqua_parse_ota_manifest("{\"version\":\"4.1.0\",\"url\":\"x\",\"size\":10,\"crc32\":1", "4.0.0", &m));
+}
+
+static void test_delta_roundtrip(void) {
+    mem_ctx_t m;
+    const size_t chunks[] = { 1, 7, 1024, 1 << 20 };
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        CHECK_EQ_INT(apply(old_img, old_len, delta, delta_len, chunks[i], &m), AQUA_DELTA_DONE);
+        CHECK_EQ_INT(m.out_len, new_len);
+        CHECK(memcmp(m.out, new_img, new_len) == 0);
+        free(m.out);
+    }
+
+    // Identical images: a single PATCH with nothing new
+    uint8_t *same = NULL;
+    delta_encode_stats_t st;
+    size_t same_len = delta_encode(old_img, old_len, old_img, old_len, &same, &st);
+    CHECK(same_len < 40);
+    CHECK_EQ_INT(st.new_bytes, 0);
+    CHECK_EQ_INT(apply(old_img, old_len, same, same_len, 4096, &m), AQUA_DELTA_DONE);
+    CHECK(m.out_len == old_len && memcmp(m.out, old_img, old_len) == 0);
+    free(m.out);
+    free(same);
+
+    // Unrelated source: everything is inserted, still correct
+    uint8_t *fresh = NULL;
+    size_t fresh_len = delta_encode((const uint8_t *)"xyz", 3, new_img, new_len, &fresh, NULL);
+    CHECK_EQ_INT(apply((const uint8_t *)"xyz", 3, fresh, fresh_len, 4096, &m), AQUA_DELTA_DONE);
+    CHECK(m.out_len == new_len && memcmp(m.out, new_img, new_len) == 0);
+    free(m.out);
+    free(fresh);
+}
+
+static void test_delta_rejects(void) {
+    mem_ctx_t m;
+
+    // Built against a different image: refused before anything is written
+    uint8_t *other = malloc(old_len);
+    memcpy(other, old_img, old_len);
+    other[old_len / 2] ^= 1;
+    CHECK_EQ_INT(apply(other, old_len, delta, delta_len, 4096, &m), AQUA_DELTA_ERR_SOURCE);
+    CHECK_EQ_INT(m.writes, 0);
+    free(m.out);
+    free(other);
+
+    uint8_t *bad = malloc(delta_len + 1);
+    memcpy(bad, delta, delta_len);
+    bad[0] = 'X';
+    CHECK_EQ_INT(apply(old_img, old_len, bad, delta_len, 4096, &m), AQUA_DELTA_ERR_FORMAT);
+    free(m.out);
+
+    // Flipping a carried byte is caught by the target CRC (or breaks the op stream)
+    memcpy(bad, delta, delta_len);
+    bad[delta_len - 2] ^= 0x55;
+    aqua_delta_result_t r = apply(old_img, old_len, bad, delta_len, 4096, &m);
+    CHECK(r == AQUA_DELTA_ERR_VERIFY || r == AQUA_DELTA_ERR_FORMAT);
+    free(m.out);
+
+    // Truncated: still waiting; trailing garbage: rejected
+    CHECK_EQ_INT(apply(old_img, old_len, delta, delta_len - 1, 4096, &m), AQUA_DELTA_MORE);
+    free(m.out);
+    memcpy(bad, delta, delta_len);
+    bad[delta_len] = 0;
+    CHECK_EQ_INT(apply(old_img, old_len, bad, delta_len + 1, delta_len + 1, &m), AQUA_DELTA_ERR_FORMAT);
+    free(m.out);
+    free(bad);
+}
+
+// ========== OTA OVER HTTP ==========
+static void publish(const char *version) {
+    char manifest[512];
+    snprintf(manifest, sizeof(manifest),
+             "{\"version\":\"%s\",\"url\":\"" FW_URL "fw-4.1.0.bin\",\"size\":%zu,\"crc32\":%u,"
+             "\"deltas\":[{\"from\":\"" AQUA_FW_VERSION "\",\"url\":\"" FW_URL "4.0.0-4.1.0.aqd\",\"size\":%zu}]}",
+             version, new_len, (unsigned)aqua_crc32(0, new_img, new_len), delta_len);
+    standin_file(server, MANIFEST_PATH, manifest, strlen(manifest));
+    standin_file(server, FW_PATH "fw-4.1.0.bin", new_img, new_len);
+    standin_file(server, FW_PATH "4.0.0-4.1.0.aqd", delta, delta_len);
+}
+
+static void setup(const uint8_t *running, size_t len) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    hal_sim_ota_flash(running, len);
+    aqua_gpio_init();
+    publish("4.1.0");
+}
+
+static bool slot_holds(int slot, const uint8_t *img, size_t len) {
+    size_t have;
+    const uint8_t *data = hal_sim_ota_slot(slot, &have);
+    return data && have == len && memcmp(data, img, len) == 0;
+}
+
+static void test_up_to_date(void) {
+    setup(old_img, old_len);
+    publish(AQUA_FW_VERSION);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UP_TO_DATE);
+    CHECK_EQ_INT(hal_sim_stats()->http_download_bytes, 0);
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 0);
+}
+
+static void test_delta_update(void) {
+    setup(old_img, old_len);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    CHECK(aqua_ota_get_stats()->last_used_delta);
+    CHECK(slot_holds(1, new_img, new_len));
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 1);
+    CHECK(hal_ota_pending_verify());
+    CHECK_EQ_INT(hal_sim_stats()->restarts, 1);
+
+    size_t delta_bytes = hal_sim_stats()->http_download_bytes;
+    CHECK_EQ_INT(delta_bytes, delta_len);
+
+    // Same update as a full image, for comparison
+    setup(old_img, old_len);
+    standin_file(server, FW_PATH "4.0.0-4.1.0.aqd", "", 0);
+    char manifest[256];
+    snprintf(manifest, sizeof(manifest), "{\"version\":\"4.1.0\",\"url\":\"" FW_URL "fw-4.1.0.bin\","
+             "\"size\":%zu,\"crc32\":%u}", new_len, (unsigned)aqua_crc32(0, new_img, new_len));
+    standin_file(server, MANIFEST_PATH, manifest, strlen(manifest));
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    CHECK(!aqua_ota_get_stats()->last_used_delta);
+    CHECK(slot_holds(1, new_img, new_len));
+    size_t full_bytes = hal_sim_stats()->http_download_bytes;
+    CHECK_EQ_INT(full_bytes, new_len);
+
+    printf("  image %zu B: full download %zu B, delta download %zu B (%.1f%%)\n",
+           new_len, full_bytes, delta_bytes, 100.0 * (double)delta_bytes / (double)full_bytes);
+    CHECK(delta_bytes * 10 < full_bytes);
+}
+
+static void test_delta_falls_back_to_full(void) {
+    // The device runs a build the delta was not made from
+    uint8_t *other = malloc(old_len);
+    memcpy(other, old_img, old_len);
+    other[100] ^= 0xFF;
+    setup(other, old_len);
+    int fallbacks = aqua_ota_get_stats()->delta_fallbacks;
+
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    CHECK_EQ_INT(aqua_ota_get_stats()->delta_fallbacks, fallbacks + 1);
+    CHECK(!aqua_ota_get_stats()->last_used_delta);
+    CHECK(slot_holds(1, new_img, new_len));
+    free(other);
+}
+
+static void test_interrupted_download(void) {
+    setup(old_img, old_len);
+    standin_truncate_next_file(server, delta_len / 2);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_FAILED);
+    // The running image is untouched and nothing boots next
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 0);
+    CHECK(!hal_ota_pending_verify());
+    CHECK_EQ_INT(hal_sim_stats()->restarts, 0);
+
+    // The next check starts over and succeeds
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    CHECK(slot_holds(1, new_img, new_len));
+}
+
+static void test_confirm_after_healthy_cycle(void) {
+    setup(old_img, old_len);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    // On trial: no further update checks
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UP_TO_DATE);
+
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    CHECK(state.uploaded);
+    CHECK(!hal_ota_pending_verify());
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 1);
+    CHECK_EQ_INT(hal_sim_stats()->rollbacks, 0);
+}
+
+static void test_rollback_after_failed_cycle(void) {
+    setup(old_img, old_len);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+
+    // First cycle on the new image cannot upload
+    hal_sim_config()->link_up = false;
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    CHECK(!state.uploaded);
+    CHECK_EQ_INT(hal_sim_stats()->rollbacks, 1);
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 0);
+    CHECK(!hal_ota_pending_verify());
+    CHECK(slot_holds(0, old_img, old_len));
+
+    // Sensors dead but upload fine also counts as a failed cycle
+    hal_sim_config()->link_up = true;
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    hal_sim_config()->ds18b20_connected = false;
+    hal_sim_config()->adc_mv[PH_ADC_CH] = 4095;
+    hal_sim_config()->adc_mv[TURBIDITY_ADC_CH] = 4095;
+    aqua_cycle_run(&state);
+    CHECK(state.uploaded);
+    CHECK_EQ_INT(hal_sim_stats()->rollbacks, 2);
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), 0);
+}
+
+// Only the water temperature probe dead: tolerated while another critical
+// probe reads, a rollback when it is the only one fitted (test_ota_min)
+static void test_sole_critical_probe_dead(void) {
+    setup(old_img, old_len);
+    CHECK_EQ_INT(aqua_ota_check(), AQUA_OTA_UPDATED);
+    hal_sim_config()->ds18b20_connected = false;
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    CHECK(state.uploaded);
+    bool sole = aqua_count_critical() == 1;
+    CHECK_EQ_INT(hal_sim_stats()->rollbacks, sole ? 1 : 0);
+    CHECK_EQ_INT(hal_sim_ota_running_slot(), sole ? 0 : 1);
+    CHECK(!hal_ota_pending_verify());
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    old_img = malloc(HAL_SIM_OTA_SLOT_SIZE);
+    new_img = malloc(HAL_SIM_OTA_SLOT_SIZE);
+    if (!server || !old_img || !new_img) {
+        fprintf(stderr, "failed to start stand-in server\n");
+        return 1;
+    }
+    old_len = build_image(old_img, 1);
+    new_len = build_image(new_img, 2);
+    delta_len = delta_encode(old_img, old_len, new_img, new_len, &delta, NULL);
+
+    RUN_TEST(test_crc32);
+    RUN_TEST(test_manifest);
+    RUN_TEST(test_delta_roundtrip);
+    RUN_TEST(test_delta_rejects);
+    RUN_TEST(test_up_to_date);
+    RUN_TEST(test_delta_update);
+    RUN_TEST(test_delta_falls_back_to_full);
+    RUN_TEST(test_interrupted_download);
+    RUN_TEST(test_confirm_after_healthy_cycle);
+    RUN_TEST(test_rollback_after_failed_cycle);
+    RUN_TEST(test_sole_critical_probe_dead);
+
+    free(delta);
+    free(old_img);
+    free(new_img);
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,409 @@
+#include <stdint.h>
+#include "aqua_config.h"
+#include "aqua_outq.h"
+#include "test_util.h"
+
+// Outbound scheduler: class order, pre-emption between requests, retries and
+// deadlines, eviction, the airtime budget, and a long run over a simulated
+// lossy link.
+
+#define MS(x) ((int64_t)(x) * 1000)
+#define S(x) ((int64_t)(x) * 1000000)
+
+static const char row[] = "{\"air_temperature\":26.50,\"humidity\":60.00,\"water_temperature\":25.50,"
+                          "\"ph\":7.00,\"turbidity\":10.00,\"ph_relay\":false,\"aerator\":true}";
+
+static int drops;
+static int dropped_kind;
+
+static void count_drop(const aqua_outq_item_t *item, void *ctx) {
+    (void)ctx;
+    drops++;
+    dropped_kind = item->kind;
+}
+
+static void setup(aqua_outq_t *q, const aqua_outq_config_t *cfg) {
+    drops = 0;
+    dropped_kind = -1;
+    aqua_outq_init(q, cfg, count_drop, NULL);
+}
+
+static aqua_outq_item_t *push_row(aqua_outq_t *q, aqua_outq_class_t cls, uint8_t kind, int64_t now_us) {
+    return aqua_outq_push(q, cls, kind, row, sizeof(row) - 1, now_us);
+}
+
+// Rows in the backlog, ready now
+static void fill_backlog(aqua_outq_t *q, int rows, int64_t now_us) {
+    for (int i = 0; i < rows; i++) {
+        aqua_outq_item_t *it = push_row(q, AQUA_OUTQ_BACKLOG, (uint8_t)(100 + i), now_us);
+        CHECK(it != NULL);
+    }
+}
+
+static void test_class_order(void) {
+    aqua_outq_t q;
+    setup(&q, NULL);
+    fill_backlog(&q, 2, 0);
+    push_row(&q, AQUA_OUTQ_LIVE, 3, 0);
+    aqua_outq_push(&q, AQUA_OUTQ_COMMAND, 2, NULL, 0, 0);
+    push_row(&q, AQUA_OUTQ_ALERT, 1, 0);
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_CLASS_COUNT), 5);
+
+    const int order[] = { 1, 2, 3, 100, 101 };
+    for (int i = 0; i < 5; i++) {
+        aqua_outq_item_t *it = aqua_outq_next(&q, MS(i), NULL);
+        CHECK(it != NULL);
+        if (!it) return;
+        CHECK_EQ_INT(it->kind, order[i]);
+        CHECK_EQ_INT(aqua_outq_complete(&q, it, AQUA_OUTQ_DELIVERED, MS(i)), AQUA_OUTQ_DONE);
+    }
+    int64_t wait = 0;
+    CHECK(aqua_outq_next(&q, MS(5), &wait) == NULL);
+    CHECK_EQ_INT(wait, -1);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].delivered, 2);
+}
+
+static void test_alert_preempts_drain(void) {
+    // An alert raised mid-drain goes out as soon as the request in flight ends
+    aqua_outq_t q;
+    setup(&q, NULL);
+    fill_backlog(&q, 20, 0);
+
+    int64_t now = 0;
+    int sent = 0;
+    aqua_outq_item_t *it = aqua_outq_next(&q, now, NULL);
+    while (it && sent < 5) {
+        now += MS(300);
+        aqua_outq_complete(&q, it, AQUA_OUTQ_DELIVERED, now);
+        sent++;
+        if (sent == 3) {
+            push_row(&q, AQUA_OUTQ_ALERT, 1, now - MS(150));
+        }
+        it = aqua_outq_next(&q, now, NULL);
+        if (sent == 3) {
+            CHECK(it && it->kind == 1);
+        } else {
+            CHECK(it && it->cls == AQUA_OUTQ_BACKLOG);
+        }
+    }
+}
+
+static void test_retry_backoff(void) {
+    aqua_outq_t q;
+    setup(&q, NULL);
+
+    // A live row backs off 1 s, then 2 s, then moves to the backlog
+    aqua_outq_item_t *it = push_row(&q, AQUA_OUTQ_LIVE, 7, 0);
+    CHECK(it != NULL);
+    int64_t now = 0, wait = 0;
+    const int64_t delays[] = { MS(UPLOAD_RETRY_DELAY_MS), MS(2 * UPLOAD_RETRY_DELAY_MS) };
+    for (int i = 0; i < 2; i++) {
+        it = aqua_outq_next(&q, now, NULL);
+        CHECK(it != NULL);
+        if (!it) return;
+        CHECK_EQ_INT(aqua_outq_complete(&q, it, AQUA_OUTQ_FAILED, now), AQUA_OUTQ_RETRYING);
+        CHECK(aqua_outq_next(&q, now, &wait) == NULL);
+        CHECK_EQ_INT(wait, delays[i]);
+        now += wait;
+    }
+    it = aqua_outq_next(&q, now, NULL);
+    CHECK(it != NULL);
+    if (!it) return;
+    CHECK_EQ_INT(aqua_outq_complete(&q, it, AQUA_OUTQ_FAILED, now), AQUA_OUTQ_DEMOTED);
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_BACKLOG), 1);
+    CHECK(aqua_outq_next(&q, now, &wait) == NULL);
+    CHECK_EQ_INT(wait, MS(OUTQ_BACKLOG_RETRY_MS));
+    CHECK_EQ_INT(drops, 0);
+
+    // A row waiting to retry does not hold up the one behind it
+    push_row(&q, AQUA_OUTQ_BACKLOG, 8, now);
+    it = aqua_outq_next(&q, now, NULL);
+    CHECK(it && it->kind == 8);
+
+    // Commands give up after their attempts; rejected requests at once
+    aqua_outq_push(&q, AQUA_OUTQ_COMMAND, 9, NULL, 0, now);
+    for (int i = 0; i < RELAY_POLL_MAX_ATTEMPTS; i++) {
+        aqua_outq_item_t *cmd = aqua_outq_next(&q, now, NULL);
+        CHECK(cmd && cmd->kind == 9);
+        if (!cmd) return;
+        aqua_outq_outcome_t outcome = aqua_outq_complete(&q, cmd, AQUA_OUTQ_FAILED, now);
+        CHECK_EQ_INT(outcome, i + 1 < RELAY_POLL_MAX_ATTEMPTS ? AQUA_OUTQ_RETRYING : AQUA_OUTQ_DROPPED);
+        now += MS(RELAY_POLL_RETRY_DELAY_MS);
+    }
+    CHECK_EQ_INT(drops, 1);
+    CHECK_EQ_INT(dropped_kind, 9);
+
+    push_row(&q, AQUA_OUTQ_ALERT, 10, now);
+    it = aqua_outq_next(&q, now, NULL);
+    CHECK(it && it->kind == 10);
+    if (it) CHECK_EQ_INT(aqua_outq_complete(&q, it, AQUA_OUTQ_REJECTED, now), AQUA_OUTQ_DROPPED);
+    CHECK_EQ_INT(drops, 2);
+}
+
+static void test_deadlines(void) {
+    aqua_outq_t q;
+    setup(&q, NULL);
+    aqua_outq_push(&q, AQUA_OUTQ_COMMAND, 1, NULL, 0, 0);
+    push_row(&q, AQUA_OUTQ_LIVE, 2, 0);
+
+    // Past their deadlines: the poll is dropped, the row joins the backlog
+    int64_t now = MS(OUTQ_LIVE_DEADLINE_MS);
+    aqua_outq_item_t *it = aqua_outq_next(&q, now, NULL);
+    CHECK(it == NULL);
+    CHECK_EQ_INT(drops, 1);
+    CHECK_EQ_INT(dropped_kind, 1);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_COMMAND].expired, 1);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_LIVE].expired, 1);
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_BACKLOG), 1);
+
+    // The backlog deadline counts from when the row was taken
+    now = MS(OUTQ_BACKLOG_DEADLINE_MS) - 1;
+    it = aqua_outq_next(&q, now, NULL);
+    CHECK(it && it->kind == 2);
+    if (it) aqua_outq_complete(&q, it, AQUA_OUTQ_FAILED, now);
+    CHECK(aqua_outq_next(&q, now + S(3600), NULL) == NULL);
+    CHECK_EQ_INT(drops, 2);
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_CLASS_COUNT), 0);
+}
+
+static void test_eviction(void) {
+    aqua_outq_t q;
+    setup(&q, NULL);
+    fill_backlog(&q, AQUA_OUTQ_SLOTS, 0);
+
+    // A live row pushes out the oldest backlog row
+    CHECK(push_row(&q, AQUA_OUTQ_LIVE, 1, 0) != NULL);
+    CHECK_EQ_INT(drops, 1);
+    CHECK_EQ_INT(dropped_kind, 100);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].evicted, 1);
+
+    // With only alerts and the live row left, a backlog row cannot get in
+    for (int i = 0; i < AQUA_OUTQ_SLOTS - 1; i++) {
+        CHECK(push_row(&q, AQUA_OUTQ_ALERT, 2, 0) != NULL);
+    }
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_BACKLOG), 0);
+    CHECK(push_row(&q, AQUA_OUTQ_BACKLOG, 3, 0) == NULL);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].refused, 1);
+
+    // A request in flight is never evicted
+    aqua_outq_item_t *it = aqua_outq_next(&q, 0, NULL);
+    CHECK(it && it->kind == 2);
+    CHECK(push_row(&q, AQUA_OUTQ_ALERT, 4, 0) != NULL);
+    CHECK(it && it->used && it->in_flight);
+    CHECK_EQ_INT(dropped_kind, 1);
+
+    // Bodies that do not fit are refused
+    char big[AQUA_OUTQ_BODY_MAX + 2];
+    memset(big, 'x', sizeof(big));
+    CHECK(aqua_outq_push(&q, AQUA_OUTQ_ALERT, 5, big, sizeof(big), 0) == NULL);
+}
+
+static void test_budget(void) {
+    aqua_outq_config_t cfg;
+    aqua_outq_config_defaults(&cfg);
+    cfg.budget_bytes_per_s = 1000;
+    cfg.budget_burst_bytes = 4000;
+    cfg.request_overhead = 1000 - (uint16_t)(sizeof(row) - 1);
+    aqua_outq_t q;
+    setup(&q, &cfg);
+    fill_backlog(&q, 10, 0);
+
+    // The burst covers four rows; after that one per second
+    int64_t wait = 0;
+    for (int i = 0; i < 4; i++) {
+        aqua_outq_item_t *it = aqua_outq_next(&q, 0, NULL);
+        CHECK(it != NULL);
+        if (it) aqua_outq_complete(&q, it, AQUA_OUTQ_DELIVERED, 0);
+    }
+    CHECK(aqua_outq_next(&q, 0, &wait) == NULL);
+    CHECK_EQ_INT(wait, S(1));
+    CHECK(aqua_outq_next(&q, S(1), NULL) != NULL);
+
+    // An alert overdraws the budget, and the backlog waits for it to refill
+    aqua_outq_item_t *it = push_row(&q, AQUA_OUTQ_ALERT, 1, S(1));
+    CHECK(aqua_outq_next(&q, S(1), NULL) == it);
+    CHECK(q.tokens < 0);
+    CHECK(aqua_outq_next(&q, S(1), &wait) == NULL);
+    CHECK_EQ_INT(wait, S(2));
+}
+
+static void test_batch(void) {
+    aqua_outq_config_t cfg;
+    aqua_outq_config_defaults(&cfg);
+    cfg.budget_bytes_per_s = 1000;
+    cfg.budget_burst_bytes = 4 * (sizeof(row) - 1);
+    cfg.request_overhead = 0;
+    aqua_outq_t q;
+    setup(&q, &cfg);
+    for (int i = 0; i < 6; i++) {
+        push_row(&q, AQUA_OUTQ_BACKLOG, 7, 0);
+    }
+    push_row(&q, AQUA_OUTQ_BACKLOG, 8, 0);
+
+    // Same kind only, oldest first, while the budget lasts
+    aqua_outq_item_t *first = aqua_outq_next(&q, 0, NULL);
+    aqua_outq_item_t *more[8];
+    CHECK(first != NULL);
+    if (!first) return;
+    int n = aqua_outq_next_batch(&q, first, more, 8, 4096, 0);
+    CHECK_EQ_INT(n, 3);
+    for (int i = 0; i < n; i++) {
+        CHECK_EQ_INT(more[i]->kind, 7);
+        CHECK(more[i]->in_flight);
+        CHECK(i == 0 || more[i]->seq > more[i - 1]->seq);
+    }
+    CHECK_EQ_INT(q.tokens, 0);
+
+    // Credit for bytes not sent lets more go
+    aqua_outq_credit(&q, AQUA_OUTQ_BACKLOG, sizeof(row) - 1);
+    CHECK_EQ_INT(aqua_outq_next_batch(&q, first, more + n, 8 - n, 4096, 0), 1);
+    n++;
+
+    // Each settles on its own
+    aqua_outq_complete(&q, first, AQUA_OUTQ_DELIVERED, 0);
+    for (int i = 0; i < n; i++) {
+        CHECK_EQ_INT(aqua_outq_complete(&q, more[i], AQUA_OUTQ_FAILED, 0), AQUA_OUTQ_RETRYING);
+    }
+    CHECK_EQ_INT(aqua_outq_pending(&q, AQUA_OUTQ_BACKLOG), 6);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].delivered, 1);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].failed, 4);
+
+    // A byte cap below one row stops the batch
+    aqua_outq_item_t *other = aqua_outq_next(&q, S(10), NULL);
+    CHECK(other != NULL);
+    if (other) CHECK_EQ_INT(aqua_outq_next_batch(&q, other, more, 8, sizeof(row) - 2, S(10)), 0);
+}
+
+// ========== LOSSY LINK ==========
+// Ten minutes of a device's traffic over a link that loses 30% of requests
+// and takes 200-1200 ms per request: a reading and a relay poll every
+// SAMPLE_DELAY_MS, an alert every minute, and a backlog of 100 rows from an
+// earlier outage. One request at a time, as on the device.
+
+static uint32_t lcg;
+
+static uint32_t rnd(uint32_t n) {
+    lcg = lcg * 1664525u + 1013904223u;
+    return (lcg >> 8) % n;
+}
+
+enum { K_ALERT = 1, K_POLL, K_LIVE, K_BACKLOG };
+
+static void test_peek(void) {
+    // Peek shows what next would hand out, and leaves it queued
+    aqua_outq_t q;
+    setup(&q, NULL);
+    fill_backlog(&q, 2, 0);
+
+    const aqua_outq_item_t *peeked = aqua_outq_peek(&q, MS(1));
+    CHECK(peeked != NULL);
+    if (!peeked) return;
+    CHECK_EQ_INT(peeked->kind, 100);
+    CHECK(!peeked->in_flight);
+    CHECK_EQ_INT(peeked->attempts, 0);
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_BACKLOG].attempts, 0);
+
+    // A row queued later in a higher class comes first
+    push_row(&q, AQUA_OUTQ_LIVE, 3, MS(2));
+    peeked = aqua_outq_peek(&q, MS(2));
+    CHECK(peeked != NULL && peeked->kind == 3);
+    aqua_outq_item_t *it = aqua_outq_next(&q, MS(2), NULL);
+    CHECK(it == peeked);
+    if (!it) return;
+
+    // In flight: no longer the one to go
+    peeked = aqua_outq_peek(&q, MS(3));
+    CHECK(peeked != NULL && peeked->kind == 100);
+    aqua_outq_complete(&q, it, AQUA_OUTQ_DELIVERED, MS(3));
+
+    // Waiting out a retry delay: nothing to peek until then
+    it = aqua_outq_next(&q, MS(4), NULL);
+    aqua_outq_item_t *second = aqua_outq_next(&q, MS(4), NULL);
+    CHECK(it != NULL && second != NULL);
+    if (!it || !second) return;
+    aqua_outq_complete(&q, it, AQUA_OUTQ_FAILED, MS(5));
+    CHECK(aqua_outq_peek(&q, MS(5)) == NULL);
+    CHECK(aqua_outq_peek(&q, it->not_before_us) == it);
+}
+
+static void test_lossy_link(void) {
+    aqua_outq_t q;
+    setup(&q, NULL);
+    lcg = 12345;
+    fill_backlog(&q, 100, 0);
+    for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+        if (q.items[i].used) q.items[i].kind = K_BACKLOG;
+    }
+
+    const int64_t end = S(600);
+    int64_t now = 0, next_cycle = 0, next_alert = S(30);
+    int64_t alert_queued = -1, worst_alert = 0;
+    int alerts = 0;
+    uint32_t backlog_bytes = 0;
+
+    while (now < end) {
+        if (now >= next_cycle) {
+            aqua_outq_push(&q, AQUA_OUTQ_COMMAND, K_POLL, NULL, 0, now);
+            push_row(&q, AQUA_OUTQ_LIVE, K_LIVE, now);
+            next_cycle += MS(SAMPLE_DELAY_MS);
+        }
+        if (now >= next_alert && alert_queued < 0) {
+            push_row(&q, AQUA_OUTQ_ALERT, K_ALERT, now);
+            alert_queued = now;
+            alerts++;
+            next_alert += S(60);
+        }
+
+        int64_t wait = 0;
+        aqua_outq_item_t *it = aqua_outq_next(&q, now, &wait);
+        if (!it) {
+            int64_t until = next_cycle < next_alert ? next_cycle : next_alert;
+            now = wait >= 0 && now + wait < until ? now + wait : until;
+            continue;
+        }
+
+        if (it->cls == AQUA_OUTQ_BACKLOG) backlog_bytes += it->len + q.cfg.request_overhead;
+        now += MS(200 + rnd(1000));
+        bool lost = rnd(100) < 30;
+        uint8_t kind = it->kind;
+        aqua_outq_outcome_t outcome = aqua_outq_complete(&q, it, lost ? AQUA_OUTQ_FAILED : AQUA_OUTQ_DELIVERED, now);
+        if (kind == K_ALERT && outcome == AQUA_OUTQ_DONE) {
+            if (now - alert_queued > worst_alert) worst_alert = now - alert_queued;
+            alert_queued = -1;
+        }
+    }
+
+    // Every alert got through within a few retries, whatever the backlog
+    CHECK_EQ_INT(alerts, 10);
+    CHECK(alert_queued < 0 || end - alert_queued < S(10));
+    CHECK(worst_alert < S(20));
+    CHECK_EQ_INT(q.stats[AQUA_OUTQ_ALERT].dropped + q.stats[AQUA_OUTQ_ALERT].expired, 0);
+
+    // Live rows that failed three times were kept, not lost
+    const aqua_outq_class_stats_t *live = &q.stats[AQUA_OUTQ_LIVE];
+    CHECK(live->delivered >= 50);
+    CHECK_EQ_INT(live->dropped, 0);
+    CHECK(q.stats[AQUA_OUTQ_BACKLOG].delivered > 0);
+    CHECK(q.stats[AQUA_OUTQ_BACKLOG].delivered + q.stats[AQUA_OUTQ_BACKLOG].evicted +
+          (uint32_t)aqua_outq_pending(&q, AQUA_OUTQ_BACKLOG) ==
+          q.stats[AQUA_OUTQ_BACKLOG].queued);
+
+    // The backlog spent at most the budget left after everything else
+    uint32_t other = 0;
+    for (int c = 0; c < AQUA_OUTQ_BACKLOG; c++) other += q.stats[c].bytes;
+    CHECK(backlog_bytes + other <= (uint64_t)OUTQ_BUDGET_BYTES_PER_S * 600 + OUTQ_BUDGET_BURST_BYTES);
+    CHECK_EQ_INT(backlog_bytes, q.stats[AQUA_OUTQ_BACKLOG].bytes);
+}
+
+int main(void) {
+    RUN_TEST(test_class_order);
+    RUN_TEST(test_alert_preempts_drain);
+    RUN_TEST(test_retry_backoff);
+    RUN_TEST(test_deadlines);
+    RUN_TEST(test_eviction);
+    RUN_TEST(test_budget);
+    RUN_TEST(test_batch);
+    RUN_TEST(test_peek);
+    RUN_TEST(test_lossy_link);
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,291 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_params.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Runtime parameter block: NVS persistence, version rules, slot reuse while
+// readers hold old blocks, concurrent update during reads, and the
+// device_params poll from the cycle.
+
+#define PARAMS_PATH "/rest/v1/device_params"
+
+static standin_t *server;
+
+static void setup(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    aqua_params_init();
+}
+
+static aqua_params_t version(uint32_t v) {
+    aqua_params_t p;
+    aqua_params_defaults(&p);
+    p.version = v;
+    return p;
+}
+
+static void test_boot_defaults(void) {
+    setup();
+    const aqua_params_t *p = aqua_params_acquire();
+    CHECK_EQ_INT(p->version, 0);
+    CHECK_NEAR(p->temp_min, TEMP_MIN, 1e-6);
+    CHECK_NEAR(p->aerator_on_below, AERATOR_ON_BELOW, 1e-6);
+    aqua_params_release(p);
+    CHECK(!aqua_params_get_stats()->from_nvs);
+}
+
+static void test_update_survives_restart(void) {
+    setup();
+    aqua_params_t next = version(1);
+    next.temp_min = 24.0f;
+    next.aerator_on_below = 6.0f;
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+    CHECK_EQ_INT(aqua_params_version(), 1);
+    CHECK_EQ_INT(hal_sim_stats()->settings_writes, 1);
+
+    hal_restart();
+    aqua_params_init();
+    const aqua_params_t *p = aqua_params_acquire();
+    CHECK_EQ_INT(p->version, 1);
+    CHECK_NEAR(p->temp_min, 24.0, 1e-6);
+    CHECK_NEAR(p->aerator_on_below, 6.0, 1e-6);
+    aqua_params_release(p);
+    CHECK(aqua_params_get_stats()->from_nvs);
+}
+
+static void test_rejects(void) {
+    setup();
+    aqua_params_t next = version(2);
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_ERR_INVALID_VERSION);
+    next.version = 1;
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_ERR_INVALID_VERSION);
+
+    next = version(3);
+    next.ph_min = 9.0f;     // Above ph_max
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(aqua_params_version(), 2);
+    CHECK_EQ_INT(aqua_params_get_stats()->rejected, 3);
+    CHECK_EQ_INT(hal_sim_stats()->settings_writes, 1);
+}
+
+static void test_bad_store_falls_back(void) {
+    setup();
+    aqua_params_t next = version(5);
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+
+    // Flip one stored byte: the CRC catches it
+    uint8_t blob[128];
+    size_t len = sizeof(blob);
+    CHECK_EQ_INT(hal_settings_get("params", blob, &len), ESP_OK);
+    blob[8] ^= 0x01;
+    CHECK_EQ_INT(hal_settings_set("params", blob, len), ESP_OK);
+    aqua_params_init();
+    CHECK_EQ_INT(aqua_params_version(), 0);
+    CHECK(!aqua_params_get_stats()->from_nvs);
+
+    // A block from an older layout
+    CHECK_EQ_INT(hal_settings_set("params", blob, len - 4), ESP_OK);
+    aqua_params_init();
+    CHECK_EQ_INT(aqua_params_version(), 0);
+}
+
+static void test_held_blocks_are_not_reused(void) {
+    setup();
+    aqua_params_t next = version(1);
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+
+    // Three readers each hold a different version
+    const aqua_params_t *held[AQUA_PARAMS_SLOTS - 1];
+    for (int i = 0; i < AQUA_PARAMS_SLOTS - 1; i++) {
+        held[i] = aqua_params_acquire();
+        next = version((uint32_t)i + 2);
+        CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+    }
+    // Current block plus three held: nowhere to write
+    next = version(10);
+    next.temp_min = 10.0f;
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_ERR_NO_MEM);
+    for (int i = 0; i < AQUA_PARAMS_SLOTS - 1; i++) {
+        CHECK_EQ_INT(held[i]->version, i + 1);
+        CHECK_NEAR(held[i]->temp_min, TEMP_MIN, 1e-6);
+    }
+
+    aqua_params_release(held[0]);
+    CHECK_EQ_INT(aqua_params_update(&next), ESP_OK);
+    CHECK_EQ_INT(aqua_params_version(), 10);
+    for (int i = 1; i < AQUA_PARAMS_SLOTS - 1; i++) {
+        CHECK_EQ_INT(held[i]->version, i + 1);
+        aqua_params_release(held[i]);
+    }
+}
+
+// ========== CONCURRENT UPDATE ==========
+#define READERS 4
+#define UPDATES 20000
+
+// Every field is derived from the version, so a torn block is detectable
+static aqua_params_t derived(uint32_t v) {
+    aqua_params_t p = version(v);
+    p.temp_min = 10.0f + (float)(v % 20);
+    p.temp_max = p.temp_min + 5.0f;
+    p.ph_min = 5.0f + (float)(v % 3);
+    p.ph_max = p.ph_min + 1.5f;
+    p.do_min = (float)(v % 16);
+    p.aerator_on_below = p.do_min;
+    p.turbidity_max = (float)(v % 900);
+    p.filter_on_above = p.turbidity_max;
+    return p;
+}
+
+typedef struct {
+    atomic_bool *done;
+    atomic_int *started;
+    long reads;
+    long torn;
+    long went_back;
+} reader_t;
+
+static void *reader_main(void *arg) {
+    reader_t *r = arg;
+    uint32_t last = 0;
+    atomic_fetch_add(r->started, 1);
+    while (!atomic_load(r->done)) {
+        const aqua_params_t *p = aqua_params_acquire();
+        aqua_params_t seen = *p;
+        if ((r->reads & 63) == 0) {
+            sched_yield();      // Hold the block across a reschedule now and then
+        }
+        // Re-read after the yield: a held block never changes
+        if (memcmp(&seen, p, sizeof(seen)) != 0) {
+            r->torn++;
+        }
+        aqua_params_release(p);
+
+        aqua_params_t expect = derived(seen.version);
+        if (seen.version > 0 && memcmp(&seen, &expect, sizeof(seen)) != 0) {
+            r->torn++;
+        }
+        if (seen.version < last) {
+            r->went_back++;
+        }
+        last = seen.version;
+        r->reads++;
+    }
+    return NULL;
+}
+
+static void test_concurrent_update(void) {
+    setup();
+    atomic_bool done = false;
+    atomic_int started = 0;
+    pthread_t threads[READERS];
+    reader_t readers[READERS];
+    for (int i = 0; i < READERS; i++) {
+        readers[i] = (reader_t){ .done = &done, .started = &started };
+        pthread_create(&threads[i], NULL, reader_main, &readers[i]);
+    }
+    while (atomic_load(&started) < READERS) {
+        sched_yield();
+    }
+
+    int busy = 0;
+    for (uint32_t v = 1; v <= UPDATES; v++) {
+        aqua_params_t next = derived(v);
+        esp_err_t err;
+        while ((err = aqua_params_update(&next)) == ESP_ERR_NO_MEM) {
+            busy++;     // Every spare slot briefly held by a reader
+            sched_yield();
+        }
+        CHECK_EQ_INT(err, ESP_OK);
+        if ((v & 15) == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&done, true);
+
+    long reads = 0;
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK_EQ_INT(readers[i].torn, 0);
+        CHECK_EQ_INT(readers[i].went_back, 0);
+        reads += readers[i].reads;
+    }
+    CHECK(reads > 0);
+    CHECK_EQ_INT(aqua_params_version(), UPDATES);
+    printf("  %d updates, %ld reads, %d retries for a free slot\n", UPDATES, reads, busy);
+}
+
+// ========== REMOTE UPDATE ==========
+static void test_poll_applies_newer_row(void) {
+    setup();
+    standin_route(server, "GET", PARAMS_PATH, 200,
+                  "[{\"device_id\":\"" AQUA_DEVICE_ID "\",\"version\":7,\"filter_on_above\":5.0}]");
+    CHECK(poll_device_params());
+    CHECK_EQ_INT(aqua_params_version(), 7);
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.path, "device_id=eq." AQUA_DEVICE_ID) != NULL);
+    CHECK(strstr(req.path, "version=gt.0") != NULL);
+
+    // The server ignores the filter; the same row again changes nothing
+    CHECK(poll_device_params());
+    CHECK_EQ_INT(aqua_params_version(), 7);
+    CHECK_EQ_INT(aqua_params_get_stats()->updates, 1);
+
+    standin_route(server, "GET", PARAMS_PATH, 200, "[{\"version\":8,\"ph_min\":\"low\"}]");
+    CHECK(!poll_device_params());
+    standin_route(server, "GET", PARAMS_PATH, 200, "[]");
+    CHECK(poll_device_params());
+    CHECK_EQ_INT(aqua_params_version(), 7);
+}
+
+static void test_cycle_picks_up_new_cut_off(void) {
+    setup();
+    aqua_gpio_init();
+    // 10 NTU: the filter stays off at the factory cut-off
+    standin_route(server, "GET", PARAMS_PATH, 200, "[{\"version\":1,\"filter_on_above\":5.0}]");
+
+    aqua_cycle_state_t state = {0};
+    for (int i = 0; i < PARAMS_POLL_INTERVAL_CYCLES; i++) {
+        aqua_cycle_run(&state);
+        CHECK(!state.controls.filter);
+    }
+    CHECK_EQ_INT(aqua_params_version(), 1);
+
+    aqua_cycle_run(&state);
+    CHECK(state.controls.filter);
+    CHECK_EQ_INT(hal_sim_output_level(FILTER_PIN), 1);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_boot_defaults);
+    RUN_TEST(test_update_survives_restart);
+    RUN_TEST(test_rejects);
+    RUN_TEST(test_bad_store_falls_back);
+    RUN_TEST(test_held_blocks_are_not_reused);
+    RUN_TEST(test_concurrent_update);
+    RUN_TEST(test_poll_applies_newer_row);
+    RUN_TEST(test_cycle_picks_up_new_cut_off);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
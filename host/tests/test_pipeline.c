@@ -0,0 +1,287 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "aqua_config.h"
+#include "aqua_pipeline.h"
+#include "aqua_seq.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Idempotent pipelined uploads: the HTTP/1.1 response parser, several
+// requests in flight on one connection, backlog catch-up over it, a lost
+// response retried without storing a row twice, and sequence numbers that
+// keep increasing across reboots.
+
+static standin_t *server;
+
+static void setup(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    standin_set_latency_ms(server, 0);
+    supabase_outbound_reset();
+    supabase_set_pipeline_depth(UPLOAD_PIPELINE_DEPTH);
+}
+
+static int parse(const char *raw, int *status, bool *close, char *body, size_t size, int *body_len) {
+    return aqua_http_parse_response(raw, strlen(raw), status, close, body, size, body_len);
+}
+
+static void test_parse_response(void) {
+    int status = 0, body_len = 0;
+    bool close = true;
+    char body[64];
+
+    const char *sized = "HTTP/1.1 201 Created\r\nContent-Length: 5\r\nConnection: keep-alive\r\n\r\nhello";
+    CHECK_EQ_INT(parse(sized, &status, &close, body, sizeof(body), &body_len), (int)strlen(sized));
+    CHECK_EQ_INT(status, 201);
+    CHECK(!close);
+    CHECK_STR(body, "hello");
+    CHECK_EQ_INT(body_len, 5);
+
+    // Every prefix is incomplete
+    for (size_t n = 0; n < strlen(sized); n++) {
+        CHECK_EQ_INT(aqua_http_parse_response(sized, n, &status, &close, body, sizeof(body), &body_len), 0);
+    }
+
+    // Two back to back: only the first is taken
+    char two[256];
+    snprintf(two, sizeof(two), "%sHTTP/1.1 409 Conflict\r\ncontent-length: 0\r\n\r\n", sized);
+    CHECK_EQ_INT(parse(two, &status, &close, body, sizeof(body), &body_len), (int)strlen(sized));
+    CHECK_EQ_INT(parse(two + strlen(sized), &status, &close, body, sizeof(body), &body_len),
+                 (int)(strlen(two) - strlen(sized)));
+    CHECK_EQ_INT(status, 409);
+    CHECK_EQ_INT(body_len, 0);
+
+    const char *chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "4\r\n[{\"a\r\n6;ext=1\r\n\":1}]\n\r\n0\r\nX-Trailer: y\r\n\r\n";
+    CHECK_EQ_INT(parse(chunked, &status, &close, body, sizeof(body), &body_len), (int)strlen(chunked));
+    CHECK_STR(body, "[{\"a\":1}]\n");
+
+    const char *empty = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+    CHECK_EQ_INT(parse(empty, &status, &close, NULL, 0, &body_len), (int)strlen(empty));
+    CHECK_EQ_INT(status, 204);
+    CHECK(close);
+
+    // Cut to the buffer
+    char small[4];
+    CHECK_EQ_INT(parse(sized, &status, &close, small, sizeof(small), &body_len), (int)strlen(sized));
+    CHECK_STR(small, "hel");
+
+    // Not HTTP, or a body that only ends with the connection
+    CHECK_EQ_INT(parse("SSH-2.0-OpenSSH\r\n\r\n", &status, &close, body, sizeof(body), &body_len), -1);
+    CHECK_EQ_INT(parse("HTTP/1.1 200 OK\r\n\r\nrest", &status, &close, body, sizeof(body), &body_len), -1);
+    CHECK_EQ_INT(parse("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", &status, &close,
+                       body, sizeof(body), &body_len), -1);
+}
+
+static void test_requests_in_flight(void) {
+    setup();
+    standin_route(server, "GET", "/rest/v1/first", 200, "[1]");
+    standin_route(server, "GET", "/rest/v1/second", 404, "{}");
+
+    static aqua_pipeline_t p;
+    memset(&p, 0, sizeof(p));
+    CHECK_EQ_INT(aqua_pipeline_open(&p, "https://example.supabase.co/rest/v1/", HAL_TLS_CA_STORE, 2000), ESP_OK);
+    const char *paths[] = { "/rest/v1/first", "/rest/v1/second", "/rest/v1/sensor_data" };
+    char url[3][128];
+    for (int i = 0; i < 3; i++) {
+        snprintf(url[i], sizeof(url[i]), "https://example.supabase.co%s", paths[i]);
+        hal_http_request_t req = {
+            .url = url[i],
+            .method = i == 2 ? HAL_HTTP_POST : HAL_HTTP_GET,
+            .body = i == 2 ? "{}" : NULL,
+            .body_len = 2
+        };
+        CHECK_EQ_INT(aqua_pipeline_send(&p, &req), ESP_OK);
+    }
+    CHECK_EQ_INT(p.in_flight, 3);
+
+    // In the order sent
+    const int statuses[] = { 200, 404, 201 };
+    char body[64];
+    for (int i = 0; i < 3; i++) {
+        hal_http_response_t resp = { .body = body, .body_size = sizeof(body) };
+        CHECK_EQ_INT(aqua_pipeline_receive(&p, &resp), ESP_OK);
+        CHECK_EQ_INT(resp.status, statuses[i]);
+        if (i == 0) {
+            CHECK_STR(body, "[1]");
+        }
+    }
+    CHECK_EQ_INT(p.in_flight, 0);
+    hal_http_response_t resp = { .body = body, .body_size = sizeof(body) };
+    CHECK_EQ_INT(aqua_pipeline_receive(&p, &resp), ESP_FAIL);
+
+    // One connection, and the Host header the URL named
+    CHECK_EQ_INT(hal_sim_stats()->stream_connects, 1);
+    CHECK_EQ_INT(p.stats.max_in_flight, 3);
+    standin_request_t req;
+    CHECK(standin_get_request(server, 1, &req) && strcmp(req.path, "/rest/v1/second") == 0);
+    CHECK(strstr(req.headers, "Host: example.supabase.co\r\n") != NULL);
+    aqua_pipeline_close(&p);
+
+    // Nothing listening
+    hal_sim_set_http_endpoint("127.0.0.1", 0);
+    CHECK_EQ_INT(aqua_pipeline_open(&p, SUPABASE_URL, HAL_TLS_CA_STORE, 2000), ESP_FAIL);
+}
+
+// Readings queued through an outage, past their live deadline when the
+// link comes back, so they wait in the backlog
+static void fill_backlog(int rows) {
+    hal_sim_config()->link_up = false;
+    for (int i = 0; i < rows; i++) {
+        CHECK(!send_to_supabase(26.5f + 0.1f * (float)i, 25.5f, 60.0f, 7.0f, AQUA_SENSOR_ERROR, 10.0f,
+                                AQUA_SENSOR_ERROR, false, false, false, false));
+    }
+    hal_delay_ms(OUTQ_LIVE_DEADLINE_MS);
+    hal_sim_config()->link_up = true;
+    supabase_outbound_drain(0);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), rows);
+    hal_delay_ms(OUTQ_BACKLOG_RETRY_MS);
+}
+
+static void test_pipelined_drain(void) {
+    setup();
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fill_backlog(AQUA_OUTQ_SLOTS);
+    int before = standin_request_count(server);
+    int connects = hal_sim_stats()->stream_connects;
+    uint32_t sent = supabase_pipeline_stats()->requests;
+
+    // Several batches in flight on one connection, every row stored once
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+    CHECK_EQ_INT(rpc_standin_row_count(model), AQUA_OUTQ_SLOTS);
+    CHECK_EQ_INT(rpc_standin_duplicate_count(model), 0);
+    CHECK_EQ_INT(hal_sim_stats()->stream_connects, connects + 1);
+    const aqua_pipeline_stats_t *st = supabase_pipeline_stats();
+    CHECK(st->max_in_flight > 1);
+    CHECK_EQ_INT(st->requests - sent, standin_request_count(server) - before);
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, before, &req));
+    CHECK(strstr(req.path, "on_conflict=device_id,seq") != NULL);
+    CHECK(strstr(req.headers, "Prefer: resolution=ignore-duplicates") != NULL);
+    char row[1024];
+    CHECK(rpc_standin_last_row(model, row, sizeof(row)) && strstr(row, "\"seq\":") != NULL);
+
+    // One at a time: the same rows, one connection each
+    fill_backlog(4);
+    supabase_set_pipeline_depth(1);
+    connects = hal_sim_stats()->stream_connects;
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(rpc_standin_row_count(model), AQUA_OUTQ_SLOTS + 4);
+    CHECK_EQ_INT(hal_sim_stats()->stream_connects, connects);
+
+    rpc_standin_detach(model);
+}
+
+static void test_lost_response(void) {
+    setup();
+    rpc_standin_t *model = rpc_standin_attach(server);
+    fill_backlog(AQUA_OUTQ_SLOTS);
+
+    // The first batch is stored but its answer never comes back; the
+    // connection goes with it, and the answers to the batches behind it
+    standin_drop_next(server, 1);
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+    CHECK_EQ_INT(supabase_pipeline_stats()->broken, 1);
+    int stored = rpc_standin_row_count(model);
+    CHECK(stored > 0);
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_BACKLOG), AQUA_OUTQ_SLOTS);
+
+    // Retried with the same numbers: the server skips what it already has
+    for (int i = 0; i < 5 && aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT) > 0; i++) {
+        hal_delay_ms(OUTQ_BACKLOG_RETRY_MS * 2);
+        supabase_outbound_drain(OUTQ_DRAIN_MS);
+    }
+    CHECK_EQ_INT(aqua_outq_pending(supabase_outbound(), AQUA_OUTQ_CLASS_COUNT), 0);
+    CHECK_EQ_INT(rpc_standin_row_count(model), AQUA_OUTQ_SLOTS);
+    CHECK_EQ_INT(rpc_standin_duplicate_count(model), stored);
+
+    rpc_standin_detach(model);
+}
+
+static void test_duplicate_without_prefer(void) {
+    // The upsert header is what makes a retry safe: without it the server
+    // answers 409 and stores nothing
+    setup();
+    rpc_standin_t *model = rpc_standin_attach(server);
+    const char *row = "{\"ph\":7.00,\"device_id\":\"" AQUA_DEVICE_ID "\",\"seq\":77}";
+    hal_http_header_t json = { "Content-Type", "application/json" };
+    hal_http_request_t req = {
+        .url = SUPABASE_URL, .method = HAL_HTTP_POST, .headers = &json, .header_count = 1,
+        .body = row, .body_len = strlen(row), .timeout_ms = 2000
+    };
+    hal_http_response_t resp = {0};
+    CHECK_EQ_INT(hal_http_perform(&req, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 201);
+    CHECK_EQ_INT(hal_http_perform(&req, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 409);
+    CHECK_EQ_INT(rpc_standin_row_count(model), 1);
+    rpc_standin_detach(model);
+}
+
+static void test_seq_across_reboots(void) {
+    hal_sim_reset();
+    aqua_seq_init();
+    uint32_t first = aqua_seq_next();
+    CHECK_EQ_INT(first, 1);
+    uint32_t last = first;
+    for (int i = 0; i < UPLOAD_SEQ_RESERVE + 3; i++) {
+        uint32_t seq = aqua_seq_next();
+        CHECK_EQ_INT(seq, last + 1);
+        last = seq;
+    }
+    // One write per block, not per reading
+    CHECK_EQ_INT(hal_sim_stats()->settings_writes, 2);
+
+    // Reboot: the rest of the block is skipped, nothing is handed out twice
+    aqua_seq_init();
+    uint32_t after = aqua_seq_next();
+    CHECK(after > last);
+    CHECK_EQ_INT(after, 1 + 2 * UPLOAD_SEQ_RESERVE);
+
+    // A reboot before the first number of a block was used
+    aqua_seq_init();
+    uint32_t next = aqua_seq_next();
+    CHECK(next > after);
+
+    // NVS cannot be written: once the saved block runs out, readings get no
+    // number rather than one that a reboot would hand out again
+    hal_sim_config()->settings_write_fail = true;
+    for (int i = 1; i < UPLOAD_SEQ_RESERVE; i++) {
+        CHECK_EQ_INT(aqua_seq_next(), next + i);
+    }
+    CHECK_EQ_INT(aqua_seq_next(), 0);
+    CHECK_EQ_INT(aqua_seq_next(), 0);
+    aqua_seq_init();
+    CHECK_EQ_INT(aqua_seq_next(), 0);
+
+    // Writable again: numbering resumes past every number handed out
+    hal_sim_config()->settings_write_fail = false;
+    CHECK_EQ_INT(aqua_seq_next(), next + UPLOAD_SEQ_RESERVE);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_parse_response);
+    RUN_TEST(test_requests_in_flight);
+    RUN_TEST(test_pipelined_drain);
+    RUN_TEST(test_lost_response);
+    RUN_TEST(test_duplicate_without_prefer);
+    RUN_TEST(test_seq_across_reboots);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
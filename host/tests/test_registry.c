@@ -0,0 +1,126 @@
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_registry.h"
+#include "test_util.h"
+
+// Sensor registry: table invariants, and the validation, encoding and alert
+// paths driven by it. Built twice: with every probe, and as test_registry_min
+// with the dissolved oxygen and ammonia probes switched off.
+
+static const aqua_reading_t full = {
+    .air_temp = 26.5f, .humidity = 60.0f, .water_temp = 25.5f, .ph = 7.0f,
+    .do_level = 8.0f, .turbidity = 10.0f, .ammonia = 0.5f
+};
+static const aqua_controls_t controls = { .filter = true };
+
+// ========== TABLE ==========
+static void test_table(void) {
+    uint32_t seen = 0;
+    int analog = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        CHECK(!(seen & (1u << m->id)));
+        seen |= 1u << m->id;
+        CHECK(m->offset + sizeof(float) <= offsetof(aqua_reading_t, has_health));
+        CHECK(m->valid_min < m->valid_max);
+        CHECK(aqua_measure(m->id) == m);
+        CHECK((m->adc_channel >= 0) == (m->convert != NULL));
+        CHECK((m->alert_min != AQUA_NO_LIMIT || m->alert_max != AQUA_NO_LIMIT) == (m->alert_name != NULL));
+        if (m->adc_channel >= 0) analog++;
+    }
+    CHECK_EQ_INT(analog, AQUA_HAS_PH + AQUA_HAS_DO + AQUA_HAS_TURBIDITY + AQUA_HAS_AMMONIA);
+    CHECK_EQ_INT(aqua_count_critical(), 1 + AQUA_HAS_PH + AQUA_HAS_TURBIDITY);
+    CHECK_EQ_INT(aqua_measure(AQUA_MEAS_DO) != NULL, AQUA_HAS_DO);
+    CHECK_EQ_INT(aqua_sensor_fitted(AQUA_SENSOR_AMMONIA), AQUA_HAS_AMMONIA);
+    CHECK(aqua_sensor_fitted(AQUA_SENSOR_DHT22) && aqua_sensor_fitted(AQUA_SENSOR_DS18B20));
+}
+
+static void test_clear(void) {
+    aqua_reading_t r = full;
+    r.has_health = true;
+    aqua_reading_clear(&r);
+    CHECK(!r.has_health);
+    CHECK_NEAR(r.do_level, AQUA_SENSOR_ERROR, 1e-6);
+    CHECK_EQ_INT(aqua_count_missing_critical(&r), aqua_count_critical());
+}
+
+// ========== DRIVEN PATHS ==========
+static void test_validation(void) {
+    aqua_reading_t r = full;
+    CHECK(aqua_validate_reading(&r));
+    r.turbidity = 1200.0f;
+    CHECK(!aqua_validate_reading(&r));
+
+    // A probe that is not built in is never range checked
+    r = full;
+    r.do_level = 50.0f;
+    CHECK_EQ_INT(aqua_validate_reading(&r), !AQUA_HAS_DO);
+}
+
+static void test_payload(void) {
+    char json[512];
+    aqua_reading_t r = full;
+    r.has_health = true;
+    memset(r.health, 90, sizeof(r.health));
+    CHECK(aqua_build_payload(&r, &controls, json, sizeof(json)) > 0);
+
+#if AQUA_HAS_DO && AQUA_HAS_AMMONIA
+    CHECK_STR(json, "{\"air_temperature\":26.50,\"humidity\":60.00,\"water_temperature\":25.50,"
+                    "\"ph\":7.00,\"dissolved_oxygen\":8.00,\"turbidity\":10.00,\"ammonia\":0.50,"
+                    "\"ph_relay\":false,\"aerator\":false,\"filter\":true,\"pump\":false,"
+                    "\"sensor_health\":{\"dht22\":90,\"ds18b20\":90,\"ph\":90,"
+                    "\"dissolved_oxygen\":90,\"turbidity\":90,\"ammonia\":90}}");
+#else
+    CHECK_STR(json, "{\"air_temperature\":26.50,\"humidity\":60.00,\"water_temperature\":25.50,"
+                    "\"ph\":7.00,\"turbidity\":10.00,"
+                    "\"ph_relay\":false,\"aerator\":false,\"filter\":true,\"pump\":false,"
+                    "\"sensor_health\":{\"dht22\":90,\"ds18b20\":90,\"ph\":90,\"turbidity\":90}}");
+#endif
+
+    // Missing values are dropped, except the DHT22 pair
+    aqua_reading_clear(&r);
+    CHECK(aqua_build_payload(&r, &controls, json, sizeof(json)) > 0);
+    CHECK_STR(json, "{\"air_temperature\":-999.00,\"humidity\":-999.00,"
+                    "\"ph_relay\":false,\"aerator\":false,\"filter\":true,\"pump\":false}");
+}
+
+static void test_alerts(void) {
+    aqua_params_t p = {
+        .temp_min = 20.0f, .temp_max = 30.0f, .do_min = 5.0f, .ph_min = 6.5f,
+        .ph_max = 8.5f, .ammonia_max = 1.0f, .turbidity_max = 20.0f,
+    };
+    aqua_alert_states_t a;
+    aqua_reading_t r = full;
+    aqua_eval_alerts(&r, &p, &a);
+    CHECK_EQ_INT(a.low, 0);
+    CHECK_EQ_INT(a.high, 0);
+
+    r.water_temp = 31.0f;
+    r.ph = 6.0f;
+    r.do_level = 2.0f;
+    r.ammonia = 3.0f;
+    aqua_eval_alerts(&r, &p, &a);
+    CHECK_EQ_INT(a.high, AQUA_ALERT_BIT(AQUA_MEAS_WATER_TEMP) |
+                         (AQUA_HAS_AMMONIA ? AQUA_ALERT_BIT(AQUA_MEAS_AMMONIA) : 0));
+    CHECK_EQ_INT(a.low, AQUA_ALERT_BIT(AQUA_MEAS_PH) |
+                        (AQUA_HAS_DO ? AQUA_ALERT_BIT(AQUA_MEAS_DO) : 0));
+
+    char json[384];
+    CHECK(aqua_build_alert_payload(&a, &r, json, sizeof(json)) > 0);
+    CHECK(strstr(json, "\"high_temperature\":true,\"low_temperature\":false,"
+                       "\"high_ph\":false,\"low_ph\":true") != NULL);
+    CHECK_EQ_INT(strstr(json, "\"low_dissolved_oxygen\":true") != NULL, AQUA_HAS_DO);
+    CHECK_EQ_INT(strstr(json, "\"high_ammonia\":true") != NULL, AQUA_HAS_AMMONIA);
+    CHECK_EQ_INT(strstr(json, "\"do_level\":") != NULL, AQUA_HAS_DO);
+}
+
+int main(void) {
+    RUN_TEST(test_table);
+    RUN_TEST(test_clear);
+    RUN_TEST(test_validation);
+    RUN_TEST(test_payload);
+    RUN_TEST(test_alerts);
+
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,469 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_params.h"
+#include "aqua_rules.h"
+#include "aqua_time.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "supabase.h"
+#include "test_util.h"
+
+// Local rules: compile errors, equivalence with the hard-coded controls,
+// missing values, time of day and trends, the bytecode verifier, NVS
+// persistence and the device_rules poll.
+
+#define RULES_PATH "/rest/v1/device_rules"
+#define HOUR_US (3600LL * 1000000)
+
+static standin_t *server;
+static aqua_rules_program_t prog;
+static aqua_params_t params;
+
+static void setup(void) {
+    hal_sim_reset();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    aqua_time_reset();
+    aqua_params_defaults(&params);
+    aqua_rules_init();
+}
+
+static aqua_reading_t reading(float ph, float do_level, float turbidity, float ammonia) {
+    aqua_reading_t r;
+    aqua_reading_clear(&r);
+    r.air_temp = 26.5f;
+    r.humidity = 60.0f;
+    r.water_temp = 25.5f;
+    r.ph = ph;
+    r.do_level = do_level;
+    r.turbidity = turbidity;
+    r.ammonia = ammonia;
+    return r;
+}
+
+static int run(const char *source, const aqua_reading_t *r, aqua_controls_t *c, aqua_alert_states_t *a) {
+    CHECK_EQ_INT(aqua_rules_compile(source, &prog, NULL), ESP_OK);
+    CHECK(aqua_rules_verify(&prog));
+    aqua_rules_input_t in = { .reading = r, .params = &params, .hour = NAN };
+    return aqua_rules_run(&prog, &in, c, a);
+}
+
+// ========== COMPILER ==========
+static void check_error(const char *source, esp_err_t status, int line, const char *message) {
+    aqua_rules_error_t err = {0};
+    CHECK_EQ_INT(aqua_rules_compile(source, &prog, &err), status);
+    CHECK_EQ_INT(err.line, line);
+    CHECK(strstr(err.message, message) != NULL);
+}
+
+static void test_compile_errors(void) {
+    check_error("when ph < 6.5 then ph_relay", ESP_ERR_INVALID_ARG, 1, "'on' or 'off'");
+    check_error("# comment\n\nwhen ph <", ESP_ERR_INVALID_ARG, 3, "unexpected 'end'");
+    check_error("when ph < 6.5 then aerator on\nwhen salinity > 3 then pump on", ESP_ERR_INVALID_ARG, 2,
+                "unknown name 'salinity'");
+    check_error("when ph < 6.5 aerator on", ESP_ERR_INVALID_ARG, 1, "expected 'then'");
+    check_error("when ph < 6.5 then heater on", ESP_ERR_INVALID_ARG, 1, "unknown action 'heater'");
+    check_error("when ph < 6.5 then alert high_dissolved_oxygen", ESP_ERR_INVALID_ARG, 1, "unknown alert");
+    check_error("when trend(hour) > 0 then pump on", ESP_ERR_INVALID_ARG, 1, "trend of unknown value");
+    check_error("when ph < 6.5 then pump on pump off", ESP_ERR_INVALID_ARG, 1, "after the actions");
+    check_error("when ph < \\\n 6.5 then pump on; when ph then -", ESP_ERR_INVALID_ARG, 2, "unknown action");
+
+    // Nesting is bounded before the C stack or the VM stack is
+    char deep[256] = "when ";
+    for (int i = 0; i < 40; i++) strcat(deep, "(");
+    strcat(deep, "ph");
+    check_error(deep, ESP_ERR_NO_MEM, 1, "nested too deep");
+    char nots[256] = "when ";
+    for (int i = 0; i < 40; i++) strcat(nots, "not ");
+    strcat(nots, "pump then aerator on");
+    check_error(nots, ESP_ERR_NO_MEM, 1, "nested too deep");
+    check_error("when 1+(1+(1+(1+(1+(1+(1+(1+(1+1)))))))) > 0 then pump on", ESP_ERR_NO_MEM, 1, "too deep");
+
+    // Too long for the bytecode buffer
+    static char big[AQUA_RULES_SOURCE_MAX * 2];
+    big[0] = '\0';
+    for (int i = 0; i < 80; i++) strcat(big, "when ph < 6.5 then pump on\n");
+    check_error(big, ESP_ERR_NO_MEM, 37, "too long");
+
+    // Empty text and comments only: no rules
+    CHECK_EQ_INT(aqua_rules_compile("", &prog, NULL), ESP_OK);
+    CHECK_EQ_INT(prog.rule_count, 0);
+    CHECK_EQ_INT(prog.code_len, 1);
+    CHECK_EQ_INT(aqua_rules_compile("# none yet\n;\n", &prog, NULL), ESP_OK);
+    CHECK(aqua_rules_verify(&prog));
+}
+
+// ========== INTERPRETER ==========
+static void test_matches_hardcoded_controls(void) {
+    // The built-in decisions written as rules, from all relays off
+    static const char source[] =
+        "when ph < ph_relay_on_below then ph_relay on\n"
+        "when dissolved_oxygen < aerator_on_below then aerator on\n"
+        "when turbidity > filter_on_above then filter on\n"
+        "when ammonia > pump_on_above then pump on\n"
+        "when water_temp < temp_min then alert low_temperature\n"
+        "when water_temp > temp_max then alert high_temperature\n"
+        "when ph < ph_min then alert low_ph; when ph > ph_max then alert high_ph\n"
+        "when do_level < do_min then alert low_dissolved_oxygen\n"
+        "when turbidity > turbidity_max then alert high_turbidity\n"
+        "when ammonia > ammonia_max then alert high_ammonia\n";
+    CHECK_EQ_INT(aqua_rules_compile(source, &prog, NULL), ESP_OK);
+    int cases = 0;
+    for (float ph = 5.0f; ph <= 9.0f; ph += 0.25f) {
+        for (float d = 3.0f; d <= 7.0f; d += 0.5f) {
+            for (float t = 0.0f; t <= 120.0f; t += 15.0f) {
+                for (float nh3 = 0.0f; nh3 <= 1.2f; nh3 += 0.1f) {
+                    aqua_reading_t r = reading(ph, d, t, nh3);
+                    r.water_temp = 20.0f + ph;
+                    aqua_controls_t want, got = {0};
+                    aqua_alert_states_t want_alerts, got_alerts = {0};
+                    aqua_decide_controls(&r, &params, &want);
+                    aqua_eval_alerts(&r, &params, &want_alerts);
+                    aqua_rules_input_t in = { .reading = &r, .params = &params, .hour = NAN };
+                    aqua_rules_run(&prog, &in, &got, &got_alerts);
+                    if (memcmp(&want, &got, sizeof(want)) != 0 || want_alerts.low != got_alerts.low ||
+                        want_alerts.high != got_alerts.high) {
+                        CHECK(false);
+                        return;
+                    }
+                    cases++;
+                }
+            }
+        }
+    }
+    CHECK(cases > 10000);
+}
+
+static void test_relay_conditions(void) {
+    aqua_reading_t r = reading(7.0f, 6.0f, 10.0f, 0.1f);
+    aqua_controls_t c = { .filter = true };
+    aqua_alert_states_t a = {0};
+
+    // Later rules see earlier actions, and win over them
+    CHECK_EQ_INT(run("when filter then pump on, aerator on\n"
+                     "when pump and not ph_relay then filter off\n"
+                     "when filter then ph_relay on\n"
+                     "when aerator == 1 then aerator off", &r, &c, &a), 3);
+    CHECK(c.pump && !c.filter && !c.ph_relay && !c.aerator);
+
+    // Arithmetic, negative constants and precedence
+    c = (aqua_controls_t){0};
+    CHECK_EQ_INT(run("when ph - 2 * 0.5 >= 6 and -1 < ammonia then pump on\n"
+                     "when ph * 2 == 14 or hour then filter on\n"
+                     "when 1 + 2 * 3 != 7 then aerator on", &r, &c, &a), 2);
+    CHECK(c.pump && c.filter && !c.aerator);
+}
+
+static void test_missing_values(void) {
+    aqua_reading_t r = reading(AQUA_SENSOR_ERROR, 6.0f, 10.0f, 0.1f);
+    aqua_controls_t c = {0};
+    aqua_alert_states_t a = {0};
+
+    // Every comparison with a missing value is false, negated or not
+    CHECK_EQ_INT(run("when ph < 14 then pump on\n"
+                     "when ph >= 0 then pump on\n"
+                     "when ph != 7 then pump on\n"
+                     "when ph + 1 > 0 then pump on\n"
+                     "when ph < 7 or ph >= 7 then pump on\n"
+                     "when trend(ph) < 0 then pump on\n"
+                     "when hour >= 0 then pump on", &r, &c, &a), 0);
+    CHECK(!c.pump);
+    CHECK_EQ_INT(run("when not (ph < 7) then pump on", &r, &c, &a), 1);
+    CHECK(c.pump);
+}
+
+static void test_hour(void) {
+    setup();
+    aqua_rules_update(1, "when hour >= 22 or hour < 5 then aerator on");
+
+    // Clock not set: the rule never fires
+    aqua_reading_t r = reading(7.0f, 6.0f, 10.0f, 0.1f);
+    aqua_controls_t c = {0};
+    r.has_time = true;
+    r.sampled_us = hal_time_us();
+    aqua_rules_apply(&r, &params, &c);
+    CHECK(!c.aerator);
+
+    // 20:30 UTC is 23:30 local
+    int64_t midnight_utc = 1760832000LL * 1000000;
+    aqua_time_sync(midnight_utc + 20 * HOUR_US + HOUR_US / 2, r.sampled_us);
+    aqua_rules_apply(&r, &params, &c);
+    CHECK(c.aerator);
+
+    // 10:00 local
+    c.aerator = false;
+    r.sampled_us += 10 * HOUR_US + HOUR_US / 2;
+    aqua_rules_apply(&r, &params, &c);
+    CHECK(!c.aerator);
+    CHECK_EQ_INT(aqua_rules_get_stats()->runs, 3);
+    CHECK_EQ_INT(aqua_rules_get_stats()->fired, 1);
+}
+
+static void test_trend(void) {
+    aqua_rules_history_t h;
+    aqua_rules_history_reset(&h);
+    int64_t step = (int64_t)RULES_TREND_STEP_S * 1000000;
+    CHECK(isnan(aqua_rules_trend(&h, AQUA_MEAS_PH, 7.0f, 0)));
+
+    // pH falls 0.1 per step; one point every step, samples in between are skipped
+    int64_t t = 1000;
+    for (int i = 0; i < 20; i++) {
+        aqua_reading_t r = reading(7.5f - 0.1f * (float)i, 6.0f, 10.0f, 0.1f);
+        aqua_rules_history_add(&h, &r, t);
+        aqua_rules_history_add(&h, &r, t + step / 2);
+        t += step;
+    }
+    CHECK_EQ_INT(h.count, RULES_TREND_POINTS);
+    float per_hour = -0.1f * 3600.0f / (float)RULES_TREND_STEP_S;
+    CHECK_NEAR(aqua_rules_trend(&h, AQUA_MEAS_PH, 5.5f, t), per_hour, 1e-3);
+    CHECK(isnan(aqua_rules_trend(&h, AQUA_MEAS_PH, AQUA_SENSOR_ERROR, t)));
+
+    // Too little history for a trend
+    aqua_rules_history_reset(&h);
+    aqua_reading_t r = reading(7.0f, 6.0f, 10.0f, 0.1f);
+    aqua_rules_history_add(&h, &r, 0);
+    CHECK(isnan(aqua_rules_trend(&h, AQUA_MEAS_PH, 6.0f, step - 1)));
+
+    // Through the device program
+    setup();
+    CHECK_EQ_INT(aqua_rules_update(1, "when ph < 7.2 and trend(ph) < -0.5 then ph_relay on"), ESP_OK);
+    aqua_controls_t c = {0};
+    float ph = 7.5f;
+    int64_t now = 1000;
+    for (int i = 0; i < 8 && !c.ph_relay; i++) {
+        r = reading(ph, 6.0f, 10.0f, 0.1f);
+        r.has_time = true;
+        r.sampled_us = now;
+        aqua_rules_apply(&r, &params, &c);
+        ph -= 0.1f;
+        now += step;
+    }
+    CHECK(c.ph_relay);
+    CHECK(ph < 7.2f);
+}
+
+// ========== VERIFIER ==========
+static void set_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void test_verifier(void) {
+    static aqua_rules_program_t bad;
+    CHECK_EQ_INT(aqua_rules_compile("when pump then aerator on\nwhen ph < 7 then filter on", &prog, NULL), ESP_OK);
+    CHECK(aqua_rules_verify(&prog));
+    // RELAY 3, SKIP 9, SET_RELAY 1 1, VALUE ph, CONST 7, LT, SKIP, SET_RELAY 2 1, END
+    CHECK_EQ_INT(prog.code[0], AQUA_OP_RELAY);
+    CHECK_EQ_INT(prog.code[2], AQUA_OP_SKIP_IF_FALSE);
+    CHECK_EQ_INT(prog.code[3], 8);
+
+    // Backward jump
+    bad = prog;
+    set_u16(&bad.code[3], 0);
+    CHECK(!aqua_rules_verify(&bad));
+    // Into the middle of an instruction
+    bad = prog;
+    set_u16(&bad.code[3], 7);
+    CHECK(!aqua_rules_verify(&bad));
+    // Past the end
+    bad = prog;
+    set_u16(&bad.code[3], (uint16_t)prog.code_len);
+    CHECK(!aqua_rules_verify(&bad));
+    // Unknown opcode and operands out of range
+    bad = prog;
+    bad.code[0] = AQUA_OP_COUNT;
+    CHECK(!aqua_rules_verify(&bad));
+    bad = prog;
+    bad.code[1] = AQUA_RULES_RELAY_COUNT;
+    CHECK(!aqua_rules_verify(&bad));
+    bad = prog;
+    bad.code[7] = 2;
+    CHECK(!aqua_rules_verify(&bad));
+    // No END, or bytes after it
+    bad = prog;
+    bad.code_len--;
+    CHECK(!aqua_rules_verify(&bad));
+    bad = prog;
+    bad.code[bad.code_len++] = AQUA_OP_END;
+    CHECK(!aqua_rules_verify(&bad));
+    // Rule count does not match
+    bad = prog;
+    bad.rule_count = 1;
+    CHECK(!aqua_rules_verify(&bad));
+    // Stack underflow and overflow
+    bad = prog;
+    bad.code[0] = AQUA_OP_NOT;
+    bad.code[1] = AQUA_OP_NOT;
+    CHECK(!aqua_rules_verify(&bad));
+    memset(&bad, 0, sizeof(bad));
+    for (int i = 0; i <= AQUA_RULES_STACK; i++) {
+        bad.code[bad.code_len++] = AQUA_OP_HOUR;
+    }
+    bad.code[bad.code_len++] = AQUA_OP_END;
+    CHECK(!aqua_rules_verify(&bad));
+    // Values left on the stack at a jump target that the straight path does not leave
+    memset(&bad, 0, sizeof(bad));
+    uint8_t code[] = { AQUA_OP_HOUR, AQUA_OP_HOUR, AQUA_OP_SKIP_IF_FALSE, 6, 0, AQUA_OP_HOUR, AQUA_OP_END };
+    memcpy(bad.code, code, sizeof(code));
+    bad.code_len = sizeof(code);
+    bad.rule_count = 1;
+    CHECK(!aqua_rules_verify(&bad));
+}
+
+// ========== DEVICE PROGRAM ==========
+static void test_update_survives_restart(void) {
+    setup();
+    CHECK_EQ_INT(aqua_rules_version(), 0);
+    CHECK(!aqua_rules_get_stats()->from_nvs);
+    CHECK_EQ_INT(aqua_rules_update(3, "when turbidity > 5 then filter on, alert high_turbidity"), ESP_OK);
+    CHECK_EQ_INT(hal_sim_stats()->settings_writes, 1);
+
+    hal_restart();
+    aqua_rules_init();
+    CHECK_EQ_INT(aqua_rules_version(), 3);
+    CHECK(aqua_rules_get_stats()->from_nvs);
+
+    aqua_reading_t r = reading(7.0f, 6.0f, 8.0f, 0.1f);
+    aqua_controls_t c = {0};
+    aqua_rules_apply(&r, &params, &c);
+    CHECK(c.filter);
+    CHECK(aqua_rules_alerts()->high & AQUA_ALERT_BIT(AQUA_MEAS_TURBIDITY));
+
+    // An empty source removes the rules
+    CHECK_EQ_INT(aqua_rules_update(4, ""), ESP_OK);
+    c.filter = false;
+    aqua_rules_apply(&r, &params, &c);
+    CHECK(!c.filter);
+    CHECK_EQ_INT(aqua_rules_alerts()->high, 0);
+    hal_restart();
+    aqua_rules_init();
+    CHECK_EQ_INT(aqua_rules_version(), 4);
+}
+
+static void test_rejects(void) {
+    setup();
+    CHECK_EQ_INT(aqua_rules_update(2, "when pump then aerator on"), ESP_OK);
+    CHECK_EQ_INT(aqua_rules_update(2, "when pump then filter on"), ESP_ERR_INVALID_VERSION);
+    CHECK_EQ_INT(aqua_rules_update(1, "when pump then filter on"), ESP_ERR_INVALID_VERSION);
+    CHECK_EQ_INT(aqua_rules_update(5, "when pump then"), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(aqua_rules_version(), 2);
+    CHECK_EQ_INT(aqua_rules_get_stats()->rejected, 1);
+    CHECK_EQ_INT(aqua_rules_get_stats()->rejected_version, 5);
+    CHECK_EQ_INT(hal_sim_stats()->settings_writes, 1);
+
+    // A corrupted image is dropped at boot
+    hal_settings_set("rules", "junk", 4);
+    aqua_rules_init();
+    CHECK_EQ_INT(aqua_rules_version(), 0);
+}
+
+// ========== REMOTE UPDATE ==========
+static void test_parse_rules(void) {
+    uint32_t v = 0;
+    char source[64];
+    CHECK_EQ_INT(aqua_parse_rules("[]", &v, source, sizeof(source)), 0);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":4,\"source\":\"when pump then aerator on\\n\"}]",
+                                  &v, source, sizeof(source)), 1);
+    CHECK_EQ_INT(v, 4);
+    CHECK_STR(source, "when pump then aerator on\n");
+    CHECK_EQ_INT(aqua_parse_rules("{\"source\":\"\",\"version\":5}", &v, source, sizeof(source)), 1);
+    CHECK_EQ_INT(v, 5);
+    CHECK_STR(source, "");
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":4}]", &v, source, sizeof(source)), -1);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":\"4\",\"source\":\"\"}]", &v, source, sizeof(source)), -1);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":4,\"source\":\"when", &v, source, sizeof(source)), -1);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":4,\"source\":\"0123456789\"}]", &v, source, 8), -1);
+    CHECK_EQ_INT(v, 4);
+
+    // A source that fills the buffer exactly fits; one more char does not
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":6,\"source\":\"0123456\"}]", &v, source, 8), 1);
+    CHECK_STR(source, "0123456");
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":6,\"source\":\"01234567\"}]", &v, source, 8), -1);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":6,\"source\":\"0\\n23456\"}]", &v, source, 8), 1);
+    CHECK_EQ_INT(aqua_parse_rules("[{\"version\":", &v, source, sizeof(source)), -1);
+    CHECK_EQ_INT(v, 0);
+}
+
+static void test_poll(void) {
+    setup();
+    supabase_outbound_reset();
+    standin_route(server, "GET", RULES_PATH, 200,
+                  "[{\"version\":7,\"source\":\"when ammonia > 0.5 then pump on\"}]");
+    CHECK(poll_device_rules());
+    CHECK_EQ_INT(aqua_rules_version(), 7);
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.path, "device_id=eq." AQUA_DEVICE_ID) != NULL);
+    CHECK(strstr(req.path, "version=gt.0") != NULL);
+
+    // A version that does not compile is not fetched again
+    standin_route(server, "GET", RULES_PATH, 200, "[{\"version\":9,\"source\":\"when ammonia >\"}]");
+    CHECK(poll_device_rules());
+    CHECK_EQ_INT(aqua_rules_version(), 7);
+    standin_route(server, "GET", RULES_PATH, 200, "[]");
+    CHECK(poll_device_rules());
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.path, "version=gt.9") != NULL);
+
+    // Nor is one that cannot be read
+    standin_route(server, "GET", RULES_PATH, 200, "[{\"version\":10}]");
+    CHECK(!poll_device_rules());
+    CHECK_EQ_INT(aqua_rules_get_stats()->rejected_version, 10);
+    static char row[AQUA_RULES_SOURCE_MAX + 64];
+    int len = snprintf(row, sizeof(row), "[{\"version\":11,\"source\":\"");
+    memset(row + len, '#', AQUA_RULES_SOURCE_MAX);
+    snprintf(row + len + AQUA_RULES_SOURCE_MAX, sizeof(row) - len - AQUA_RULES_SOURCE_MAX, "\"}]");
+    standin_route(server, "GET", RULES_PATH, 200, row);
+    CHECK(!poll_device_rules());
+    CHECK_EQ_INT(aqua_rules_get_stats()->rejected_version, 11);
+    standin_route(server, "GET", RULES_PATH, 200, "[]");
+    CHECK(poll_device_rules());
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.path, "version=gt.11") != NULL);
+
+    standin_route(server, "GET", RULES_PATH, 503, "");
+    CHECK(!poll_device_rules());
+    CHECK_EQ_INT(aqua_rules_version(), 7);
+
+    // The rule's alert goes out with the cycle's other alerts
+    aqua_reading_t r = reading(7.0f, 6.0f, 10.0f, 0.8f);
+    aqua_controls_t c = {0};
+    CHECK_EQ_INT(aqua_rules_update(12, "when ammonia > 0.5 then alert high_ammonia"), ESP_OK);
+    aqua_rules_apply(&r, &params, &c);
+    int before = standin_request_count(server);
+    check_and_send_alerts(r.water_temp, r.do_level, r.ph, 0.1f, r.turbidity);
+    CHECK_EQ_INT(standin_request_count(server), before + 1);
+    CHECK(standin_get_request(server, before, &req));
+    CHECK(strstr(req.body, "\"high_ammonia\":true") != NULL);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+    aqua_params_defaults(&params);
+
+    RUN_TEST(test_compile_errors);
+    RUN_TEST(test_matches_hardcoded_controls);
+    RUN_TEST(test_relay_conditions);
+    RUN_TEST(test_missing_values);
+    RUN_TEST(test_hour);
+    RUN_TEST(test_trend);
+    RUN_TEST(test_verifier);
+    RUN_TEST(test_update_survives_restart);
+    RUN_TEST(test_rejects);
+    RUN_TEST(test_parse_rules);
+    RUN_TEST(test_poll);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
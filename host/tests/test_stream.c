@@ -0,0 +1,358 @@
+#include "adc_config.h"
+#include "aqua_config.h"
+#include "aqua_stream.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "test_util.h"
+
+// Raw sample streaming: COBS framing, frame packing, the command line, the
+// receiver's loss accounting, and captures over the simulated USB port.
+
+static uint8_t wire[1 << 16];
+
+static void make_frame(aqua_stream_frame_t *f, uint32_t seq, uint32_t first_scan, uint16_t scans) {
+    memset(f, 0, sizeof(*f));
+    f->seq = seq;
+    f->first_scan = first_scan;
+    f->period_us = 2000;
+    f->first_us = 5000000000LL + (int64_t)first_scan * 2000;   // Past 32 bits
+    f->nch = 2;
+    f->channels[0] = PH_ADC_CH;
+    f->channels[1] = TURBIDITY_ADC_CH;
+    f->scans = scans;
+    for (int i = 0; i < scans * 2; i++) {
+        f->samples[i] = (int16_t)(i % 3 == 0 ? 0 : 4095 - i);
+    }
+}
+
+static size_t encode(const aqua_stream_frame_t *f, uint8_t *out, size_t size) {
+    uint8_t raw[AQUA_STREAM_FRAME_MAX];
+    return aqua_cobs_encode(raw, aqua_stream_pack(f, raw, sizeof(raw)), out, size);
+}
+
+typedef struct {
+    aqua_stream_frame_t last;
+    int frames;
+    int64_t last_t_us;
+    bool evenly_spaced;
+    bool values_ok;
+    int expect[AQUA_STREAM_MAX_CHANNELS];
+} collect_t;
+
+static void collect(const aqua_stream_frame_t *f, void *ctx) {
+    collect_t *c = ctx;
+    for (int k = 0; k < f->scans; k++) {
+        int64_t t = f->first_us + (int64_t)k * f->period_us;
+        if (c->frames > 0 || k > 0) {
+            c->evenly_spaced &= (t - c->last_t_us) % f->period_us == 0 && t > c->last_t_us;
+        }
+        c->last_t_us = t;
+        for (int ch = 0; ch < f->nch; ch++) {
+            c->values_ok &= f->samples[k * f->nch + ch] == c->expect[ch];
+        }
+    }
+    c->last = *f;
+    c->frames++;
+}
+
+static void collect_init(collect_t *c) {
+    memset(c, 0, sizeof(*c));
+    c->evenly_spaced = true;
+    c->values_ok = true;
+}
+
+// Everything the firmware wrote to the port, through a receiver
+static void receive(aqua_stream_rx_t *rx, collect_t *c) {
+    aqua_stream_rx_init(rx, collect, c);
+    size_t n;
+    while ((n = hal_sim_usb_take(wire, sizeof(wire))) > 0) {
+        aqua_stream_rx_feed(rx, wire, n);
+    }
+}
+
+// ========== FRAMES ==========
+static void test_cobs_round_trip(void) {
+    uint8_t in[600];
+    uint8_t out[AQUA_STREAM_WIRE_MAX];
+    uint8_t back[sizeof(in)];
+    const size_t lens[] = { 0, 1, 253, 254, 255, 600 };
+    for (int pattern = 0; pattern < 3; pattern++) {
+        for (size_t i = 0; i < sizeof(in); i++) {
+            in[i] = pattern == 0 ? 0 : pattern == 1 ? (uint8_t)(i % 255 + 1) : (uint8_t)(i % 7);
+        }
+        for (size_t t = 0; t < sizeof(lens) / sizeof(lens[0]); t++) {
+            size_t len = aqua_cobs_encode(in, lens[t], out, sizeof(out));
+            CHECK(len > lens[t]);
+            CHECK_EQ_INT(out[len - 1], 0);
+            CHECK(memchr(out, 0, len - 1) == NULL);
+            CHECK_EQ_INT(aqua_cobs_decode(out, len - 1, back, sizeof(back)), lens[t]);
+            CHECK(memcmp(in, back, lens[t]) == 0);
+        }
+    }
+    // Worst case overhead: a zero-free run costs a byte per 254
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (uint8_t)(i % 255 + 1);
+    }
+    CHECK_EQ_INT(aqua_cobs_encode(in, 600, out, 600 + 600 / 254 + 2), 604);
+    CHECK_EQ_INT(aqua_cobs_encode(in, 600, out, 603), 0);
+    CHECK_EQ_INT(aqua_cobs_encode((const uint8_t *)"\x01\x02", 2, out, 3), 0);
+
+    const uint8_t truncated[] = { 0x05, 'a', 'b' };
+    CHECK_EQ_INT(aqua_cobs_decode(truncated, sizeof(truncated), back, sizeof(back)), -1);
+}
+
+static void test_pack_round_trip(void) {
+    aqua_stream_frame_t f, g;
+    uint8_t raw[AQUA_STREAM_FRAME_MAX];
+    make_frame(&f, 7, 350, 25);
+    size_t len = aqua_stream_pack(&f, raw, sizeof(raw));
+    CHECK_EQ_INT(len, AQUA_STREAM_HEADER_LEN + 2 + 25 * 2 * 2 + 4);
+    CHECK(aqua_stream_unpack(raw, len, &g));
+    CHECK_EQ_INT(g.seq, 7);
+    CHECK_EQ_INT(g.first_scan, 350);
+    CHECK_EQ_INT(g.first_us, f.first_us);
+    CHECK_EQ_INT(g.period_us, 2000);
+    CHECK_EQ_INT(g.channels[1], TURBIDITY_ADC_CH);
+    CHECK(memcmp(g.samples, f.samples, 25 * 2 * sizeof(int16_t)) == 0);
+
+    raw[40] ^= 0x10;
+    CHECK(!aqua_stream_unpack(raw, len, &g));       // CRC
+    raw[40] ^= 0x10;
+    CHECK(!aqua_stream_unpack(raw, len - 2, &g));   // Length
+    raw[0] = AQUA_STREAM_VERSION + 1;
+    CHECK(!aqua_stream_unpack(raw, len, &g));
+
+    f.scans = AQUA_STREAM_MAX_SCANS + 1;
+    CHECK_EQ_INT(aqua_stream_pack(&f, raw, sizeof(raw)), 0);
+    f.scans = 25;
+    CHECK_EQ_INT(aqua_stream_pack(&f, raw, len - 1), 0);
+}
+
+// ========== COMMANDS ==========
+static void test_parse_commands(void) {
+    aqua_stream_config_t cfg;
+    CHECK_EQ_INT(aqua_stream_parse_command("stop\r\n", &cfg), AQUA_STREAM_CMD_STOP);
+
+    CHECK_EQ_INT(aqua_stream_parse_command("start", &cfg), AQUA_STREAM_CMD_START);
+    CHECK_EQ_INT(cfg.rate_hz, STREAM_DEFAULT_RATE_HZ);
+    CHECK_EQ_INT(cfg.duration_s, 0);
+    CHECK(cfg.nch >= 2);                            // Every built-in analog probe
+    CHECK_EQ_INT(cfg.channels[0], PH_ADC_CH);
+    CHECK_EQ_INT(aqua_stream_check_config(&cfg), ESP_OK);
+
+    CHECK_EQ_INT(aqua_stream_parse_command("  start 250 7,5 30\n", &cfg), AQUA_STREAM_CMD_START);
+    CHECK_EQ_INT(cfg.rate_hz, 250);
+    CHECK_EQ_INT(cfg.nch, 2);
+    CHECK_EQ_INT(cfg.channels[0], TURBIDITY_ADC_CH);
+    CHECK_EQ_INT(cfg.channels[1], PH_ADC_CH);
+    CHECK_EQ_INT(cfg.duration_s, 30);
+
+    const char *bad[] = { "", "starts", "start fast", "start 250 5,,7", "start 250 5 10 x",
+                          "start 250 0,1,2,3,4,5,6,7,8", "stop now" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK_EQ_INT(aqua_stream_parse_command(bad[i], &cfg), AQUA_STREAM_CMD_NONE);
+    }
+
+    // Parsed, but outside what the device can capture
+    aqua_stream_parse_command("start 250 9", &cfg);             // Not a probe's channel
+    CHECK_EQ_INT(aqua_stream_check_config(&cfg), ESP_ERR_INVALID_ARG);
+    aqua_stream_parse_command("start 5000", &cfg);
+    CHECK_EQ_INT(aqua_stream_check_config(&cfg), ESP_ERR_INVALID_ARG);
+    aqua_stream_parse_command("start 0", &cfg);
+    CHECK_EQ_INT(aqua_stream_check_config(&cfg), ESP_ERR_INVALID_ARG);
+}
+
+// ========== RECEIVER ==========
+static void test_rx_counts_losses(void) {
+    aqua_stream_frame_t f;
+    uint8_t buf[4 * AQUA_STREAM_WIRE_MAX + 64];
+    size_t len = 0;
+
+    // Console text ahead of the first delimiter, then frames 0, 2 (1 lost)
+    // and 3, which starts 5 scans late (skipped on the device)
+    memcpy(buf, "I (123) boot\r\n", 14);
+    len += 14;
+    buf[len++] = 0;
+    make_frame(&f, 0, 0, 10);
+    len += encode(&f, buf + len, sizeof(buf) - len);
+    make_frame(&f, 2, 20, 10);
+    len += encode(&f, buf + len, sizeof(buf) - len);
+    make_frame(&f, 3, 35, 10);
+    len += encode(&f, buf + len, sizeof(buf) - len);
+
+    collect_t c;
+    collect_init(&c);
+    aqua_stream_rx_t rx;
+    aqua_stream_rx_init(&rx, collect, &c);
+    for (size_t i = 0; i < len; i++) {                  // A byte at a time
+        aqua_stream_rx_feed(&rx, buf + i, 1);
+    }
+    CHECK_EQ_INT(rx.stats.frames, 3);
+    CHECK_EQ_INT(rx.stats.bad_frames, 1);
+    CHECK_EQ_INT(rx.stats.lost_frames, 1);
+    CHECK_EQ_INT(rx.stats.missed_scans, 15);
+    CHECK_EQ_INT(rx.stats.captures, 1);
+    CHECK_EQ_INT(rx.stats.scans, 30);
+    CHECK_EQ_INT(rx.stats.bytes, len);
+    CHECK_EQ_INT(c.last.seq, 3);
+
+    // A corrupted frame is counted and the next one still decodes
+    make_frame(&f, 4, 45, 10);
+    len = encode(&f, buf, sizeof(buf));
+    buf[10] = buf[10] == 0x55 ? 0x56 : 0x55;
+    aqua_stream_rx_feed(&rx, buf, len);
+    make_frame(&f, 5, 55, 10);
+    len = encode(&f, buf, sizeof(buf));
+    aqua_stream_rx_feed(&rx, buf, len);
+    CHECK_EQ_INT(rx.stats.bad_frames, 2);
+    CHECK_EQ_INT(rx.stats.lost_frames, 2);
+    CHECK_EQ_INT(rx.stats.frames, 4);
+}
+
+// ========== CAPTURE ==========
+static hal_stream_t *setup(void) {
+    hal_sim_reset();
+    hal_sim_config()->adc_mv[PH_ADC_CH] = 2345;
+    hal_sim_config()->adc_mv[TURBIDITY_ADC_CH] = 321;
+    return hal_usb_cdc_open();
+}
+
+static void send(const char *text) {
+    hal_sim_usb_send(text, strlen(text));
+}
+
+static void test_capture_over_usb(void) {
+    hal_stream_t *port = setup();
+    CHECK(port != NULL);
+    CHECK(hal_usb_cdc_open() == NULL);                  // One handle at a time
+
+    aqua_stream_stats_t before;
+    aqua_stream_get_stats(&before);
+    send("start 500 5,7 1\n");
+    aqua_stream_serve(port, 0);
+
+    collect_t c;
+    collect_init(&c);
+    c.expect[0] = 2345;
+    c.expect[1] = 321;
+    aqua_stream_rx_t rx;
+    receive(&rx, &c);
+    CHECK_EQ_INT(rx.stats.frames, 20);                  // 25 scans each at 20 frames/s
+    CHECK_EQ_INT(rx.stats.scans, 500);
+    CHECK_EQ_INT(rx.stats.lost_frames, 0);
+    CHECK_EQ_INT(rx.stats.missed_scans, 0);
+    CHECK_EQ_INT(rx.stats.bad_frames, 0);
+    CHECK(c.values_ok);
+    CHECK(c.evenly_spaced);
+    CHECK_EQ_INT(c.last.period_us, 2000);
+    CHECK_EQ_INT(c.last.first_scan, 475);
+
+    aqua_stream_stats_t after;
+    aqua_stream_get_stats(&after);
+    CHECK_EQ_INT(after.captures - before.captures, 1);
+    CHECK_EQ_INT(after.frames - before.frames, 20);
+    CHECK_EQ_INT(after.bytes - before.bytes, rx.stats.bytes);
+    CHECK_EQ_INT(hal_sim_stats()->adc_scans, 1);
+    hal_stream_close(port);
+}
+
+static void test_stop_command_and_api(void) {
+    hal_stream_t *port = setup();
+
+    // Commands are read between frames: a stop arriving during the second
+    // ends the capture after it
+    send("start\n");
+    hal_sim_usb_send_at(hal_time_us() + 60000, "stop\n", 5);
+    aqua_stream_serve(port, 0);
+    collect_t c;
+    collect_init(&c);
+    aqua_stream_rx_t rx;
+    receive(&rx, &c);
+    CHECK_EQ_INT(rx.stats.frames, 2);
+    CHECK_EQ_INT(c.last.scans, STREAM_DEFAULT_RATE_HZ / STREAM_FRAMES_PER_S);
+    CHECK_EQ_INT(c.last.channels[0], PH_ADC_CH);
+
+    // Nothing asked for: serving only waits for a command
+    int64_t t0 = hal_time_us();
+    aqua_stream_serve(port, 100);
+    CHECK(hal_time_us() - t0 >= 100000);
+    CHECK_EQ_INT(hal_sim_stats()->adc_scans, 1);
+
+    // A start and a stop before it runs cancel out
+    send("start\nstop\n");
+    aqua_stream_serve(port, 0);
+    CHECK_EQ_INT(hal_sim_stats()->adc_scans, 1);
+
+    // From firmware code; a bad configuration is refused
+    aqua_stream_config_t cfg = { .rate_hz = 100, .nch = 1, .channels = { PH_ADC_CH }, .duration_s = 1 };
+    CHECK_EQ_INT(aqua_stream_start(&cfg), ESP_OK);
+    aqua_stream_serve(port, 0);
+    receive(&rx, &c);
+    CHECK_EQ_INT(rx.stats.scans, 100);
+    CHECK_EQ_INT(rx.stats.captures, 1);
+
+    cfg.channels[0] = 9;
+    CHECK_EQ_INT(aqua_stream_start(&cfg), ESP_ERR_INVALID_ARG);
+    send("start 100 9\n");
+    aqua_stream_serve(port, 0);
+    CHECK_EQ_INT(hal_sim_stats()->adc_scans, 2);
+    hal_stream_close(port);
+}
+
+static void test_slow_host_skips_scans(void) {
+    hal_stream_t *port = setup();
+    // A frame of 50 scans x 2 channels takes ~80 ms at 3 kB/s: longer than its 50 ms
+    hal_sim_config()->usb_bytes_per_s = 3000;
+    send("start 1000 5,7 1\n");
+    aqua_stream_serve(port, 0);
+
+    aqua_stream_stats_t st;
+    aqua_stream_get_stats(&st);
+    collect_t c;
+    collect_init(&c);
+    aqua_stream_rx_t rx;
+    receive(&rx, &c);
+    CHECK(hal_sim_stats()->adc_scans_skipped > 0);
+    CHECK_EQ_INT(rx.stats.lost_frames, 0);
+    CHECK_EQ_INT(rx.stats.missed_scans, hal_sim_stats()->adc_scans_skipped);
+    CHECK(c.evenly_spaced);
+    CHECK(rx.stats.scans < 1000);
+    hal_stream_close(port);
+}
+
+static void test_dropped_frames_are_counted(void) {
+    hal_stream_t *port = setup();
+    hal_sim_config()->usb_drop_every = 4;
+    aqua_stream_stats_t before;
+    aqua_stream_get_stats(&before);
+    send("start 500 5 1\n");
+    aqua_stream_serve(port, 0);
+
+    collect_t c;
+    collect_init(&c);
+    aqua_stream_rx_t rx;
+    receive(&rx, &c);
+    aqua_stream_stats_t after;
+    aqua_stream_get_stats(&after);
+    CHECK(after.dropped_frames - before.dropped_frames > 0);
+    CHECK_EQ_INT(rx.stats.lost_frames, after.dropped_frames - before.dropped_frames);
+    CHECK_EQ_INT(rx.stats.lost_frames, hal_sim_stats()->usb_write_failures);
+    CHECK_EQ_INT(rx.stats.frames, after.frames - before.frames);
+    hal_stream_close(port);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_cobs_round_trip);
+    RUN_TEST(test_pack_round_trip);
+    RUN_TEST(test_parse_commands);
+    RUN_TEST(test_rx_counts_losses);
+    RUN_TEST(test_capture_over_usb);
+    RUN_TEST(test_stop_command_and_api);
+    RUN_TEST(test_slow_host_skips_scans);
+    RUN_TEST(test_dropped_frames_are_counted);
+
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_cycle.h"
+#include "aqua_time.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "http_standin.h"
+#include "sensors.h"
+#include "test_util.h"
+
+// Reading timestamps: the SNTP sync model on the simulated clock, drift
+// estimation and holdover, pre-sync readings timed backwards, and the time
+// fields in the row.
+
+#define S(x) ((int64_t)(x) * 1000000)
+
+static standin_t *server;
+
+static void setup(void) {
+    hal_sim_reset();
+    aqua_time_reset();
+}
+
+// What the server would say at the current virtual time
+static int64_t true_time(int64_t mono_us) {
+    const hal_sim_config_t *cfg = hal_sim_config();
+    return cfg->wall_epoch_us + mono_us -
+           llround((double)mono_us * cfg->clock_drift_ppm / (1e6 + cfg->clock_drift_ppm));
+}
+
+// ========== SYNC MODEL ==========
+static void test_unsynced(void) {
+    setup();
+    aqua_timestamp_t ts;
+    CHECK(!aqua_time_stamp(hal_time_us(), &ts));
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_UNSYNCED);
+
+    // Nothing arrives before SNTP is started
+    CHECK(!aqua_time_poll());
+    CHECK_EQ_INT(aqua_time_stats()->last_sync_us, -1);
+}
+
+static void test_presync_backwards(void) {
+    setup();
+    hal_delay_ms(40000);
+    int64_t early = hal_time_us();
+    hal_delay_ms(20000);
+
+    CHECK_EQ_INT(hal_time_sync_start(TIME_SNTP_SERVER, TIME_SYNC_INTERVAL_S), ESP_OK);
+    CHECK(aqua_time_poll());
+    CHECK(!aqua_time_poll());
+    CHECK_EQ_INT(hal_sim_stats()->time_syncs, 1);
+
+    // 20 s before the sync, at the unknown-drift allowance
+    aqua_timestamp_t ts;
+    CHECK(aqua_time_stamp(early, &ts));
+    CHECK_EQ_INT(ts.unix_us, true_time(early));
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_PRESYNC);
+    CHECK_EQ_INT(ts.error_ms, TIME_SYNC_ERROR_MS + 20 * TIME_DRIFT_UNKNOWN_PPM / 1000);
+
+    int64_t now = hal_time_us();
+    CHECK(aqua_time_stamp(now, &ts));
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_SYNCED);
+    CHECK_EQ_INT(ts.unix_us, true_time(now));
+}
+
+static void test_drift_tracking(void) {
+    setup();
+    hal_sim_config()->clock_drift_ppm = 40;
+    hal_time_sync_start(TIME_SNTP_SERVER, TIME_SYNC_INTERVAL_S);
+    CHECK(aqua_time_poll());
+    CHECK(!aqua_time_stats()->drift_known);
+
+    // The first hour runs uncorrected: the next sync steps the clock back by
+    // the 40 ppm it gained
+    hal_delay_ms(TIME_SYNC_INTERVAL_S * 1000);
+    CHECK(aqua_time_poll());
+    const aqua_time_stats_t *st = aqua_time_stats();
+    CHECK(st->drift_known);
+    CHECK_NEAR(st->drift_ppm, 40.0, 0.01);
+    CHECK_NEAR(st->last_step_us / 1000.0, -144.0, 0.1);
+
+    hal_delay_ms(TIME_SYNC_INTERVAL_S * 1000);
+    CHECK(aqua_time_poll());
+    CHECK(llabs(st->last_step_us) < 5);
+    CHECK_EQ_INT(st->drift_rejected, 0);
+
+    // Server gone: two hours on the drift estimate stay within a millisecond
+    // (uncorrected they would be 288 ms off)
+    hal_sim_config()->sntp_reachable = false;
+    hal_delay_ms(2 * 3600 * 1000);
+    CHECK(!aqua_time_poll());
+    int64_t now = hal_time_us();
+    aqua_timestamp_t ts;
+    aqua_time_stamp(now, &ts);
+    CHECK(llabs(ts.unix_us - true_time(now)) < 1000);
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_SYNCED);
+
+    hal_delay_ms(2 * 3600 * 1000);
+    now = hal_time_us();
+    aqua_time_stamp(now, &ts);
+    CHECK(llabs(ts.unix_us - true_time(now)) < 1000);
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_HOLDOVER);
+    CHECK_EQ_INT(ts.error_ms, TIME_SYNC_ERROR_MS + 4 * 3600 * TIME_DRIFT_RESIDUAL_PPM / 1000);
+}
+
+static void test_server_step(void) {
+    setup();
+    int64_t t0 = S(1760000000);
+    aqua_time_sync(t0, S(10));
+
+    // Short spans are only used as references
+    aqua_time_sync(t0 + S(60) + 2000, S(70));
+    CHECK(!aqua_time_stats()->drift_known);
+    CHECK_EQ_INT(aqua_time_stats()->last_step_us, 2000);
+
+    // A 5 s jump over an hour is no crystal: ignored for drift, but followed
+    aqua_time_sync(t0 + S(3605), S(3610));
+    CHECK_EQ_INT(aqua_time_stats()->drift_rejected, 1);
+    CHECK(!aqua_time_stats()->drift_known);
+    aqua_timestamp_t ts;
+    aqua_time_stamp(S(3620), &ts);
+    CHECK_EQ_INT(ts.unix_us, t0 + S(3615));
+}
+
+// ========== PAYLOAD ==========
+static void test_format(void) {
+    char buf[32];
+    CHECK_EQ_INT(aqua_format_utc(0, buf, sizeof(buf)), 27);
+    CHECK_STR(buf, "1970-01-01T00:00:00.000000Z");
+    aqua_format_utc(S(1760000000) + 123456, buf, sizeof(buf));
+    CHECK_STR(buf, "2025-10-09T08:53:20.123456Z");
+    CHECK_EQ_INT(aqua_format_utc(0, buf, 27), -1);
+}
+
+static void test_payload_fields(void) {
+    aqua_reading_t r;
+    aqua_controls_t c = {0};
+    char json[640];
+
+    aqua_reading_clear(&r);
+    aqua_build_payload(&r, &c, json, sizeof(json));
+    CHECK(strstr(json, "uptime_us") == NULL);
+    CHECK(strstr(json, "time_quality") == NULL);
+
+    r.has_time = true;
+    r.sampled_us = 12345678;
+    aqua_build_payload(&r, &c, json, sizeof(json));
+    CHECK(strstr(json, ",\"uptime_us\":12345678,\"time_quality\":\"unsynced\"") != NULL);
+    CHECK(strstr(json, "sampled_at") == NULL);
+
+    r.time = (aqua_timestamp_t){ .unix_us = S(1760000000) + 500, .quality = AQUA_TIME_PRESYNC,
+                                 .error_ms = 21 };
+    aqua_build_payload(&r, &c, json, sizeof(json));
+    CHECK(strstr(json, ",\"uptime_us\":12345678,\"sampled_at\":\"2025-10-09T08:53:20.000500Z\","
+                       "\"time_error_ms\":21,\"time_quality\":\"presync\"") != NULL);
+}
+
+static void test_cycle_rows(void) {
+    setup();
+    hal_sim_set_http_endpoint("127.0.0.1", standin_port(server));
+    standin_clear(server);
+    aqua_gpio_init();
+    sensor_health_reset();
+
+    // No network time yet: the row goes out with its uptime only
+    aqua_cycle_state_t state = {0};
+    aqua_cycle_run(&state);
+    CHECK(state.uploaded);
+    CHECK(state.reading.has_time);
+    CHECK_EQ_INT(state.reading.time.quality, AQUA_TIME_UNSYNCED);
+    int64_t first_sample = state.reading.sampled_us;
+
+    standin_request_t req;
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.body, "\"time_quality\":\"unsynced\"") != NULL);
+
+    // The next cycle takes the sync and times its reading from it
+    hal_time_sync_start(TIME_SNTP_SERVER, TIME_SYNC_INTERVAL_S);
+    hal_delay_ms(SAMPLE_DELAY_MS);
+    aqua_cycle_run(&state);
+    CHECK_EQ_INT(state.reading.time.quality, AQUA_TIME_SYNCED);
+    CHECK_EQ_INT(state.reading.time.unix_us, true_time(state.reading.sampled_us));
+    char utc[32], field[48];
+    aqua_format_utc(state.reading.time.unix_us, utc, sizeof(utc));
+    snprintf(field, sizeof(field), "\"sampled_at\":\"%s\"", utc);
+    CHECK(standin_get_request(server, standin_request_count(server) - 1, &req));
+    CHECK(strstr(req.body, field) != NULL);
+
+    // And the first reading now has a time too
+    aqua_timestamp_t ts;
+    CHECK(aqua_time_stamp(first_sample, &ts));
+    CHECK_EQ_INT(ts.quality, AQUA_TIME_PRESYNC);
+    CHECK_EQ_INT(ts.unix_us, true_time(first_sample));
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    server = standin_start();
+    if (!server) {
+        fprintf(stderr, "failed to start HTTP stand-in\n");
+        return 1;
+    }
+
+    RUN_TEST(test_unsynced);
+    RUN_TEST(test_presync_backwards);
+    RUN_TEST(test_drift_tracking);
+    RUN_TEST(test_server_step);
+    RUN_TEST(test_format);
+    RUN_TEST(test_payload_fields);
+    RUN_TEST(test_cycle_rows);
+
+    standin_stop(server);
+    return TEST_EXIT_CODE;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_util.h"
+#include "tls_standin.h"
+
+// TLS stand-in: the tuned client profile negotiates what sdkconfig.defaults
+// allows (ECDHE, AES-GCM, X25519, ECDSA ahead of RSA), verifies both test
+// chains, refuses a server it has no suite for, and the client's heap is
+// accounted on its own.
+
+#ifdef STANDIN_HAVE_OPENSSL
+
+static bool handshake(unsigned chains, bool max_tls12, const tls_standin_profile_t *profile,
+                      tls_standin_result_t *out) {
+    tls_standin_t *s = tls_standin_create(AQUA_STANDIN_CERT_DIR, chains, max_tls12);
+    tls_standin_client_t *c = tls_standin_client_create(AQUA_STANDIN_CERT_DIR, profile);
+    CHECK(s != NULL && c != NULL);
+    bool ok = s && c && tls_standin_handshake(s, c, out);
+    tls_standin_client_free(c);
+    tls_standin_free(s);
+    return ok;
+}
+
+static void test_tuned_tls13(void) {
+    tls_standin_result_t r;
+    CHECK(handshake(TLS_STANDIN_ECDSA, false, &tls_standin_profile_tuned, &r));
+    CHECK_STR(r.version, "TLSv1.3");
+    CHECK_STR(r.suite, "TLS_AES_128_GCM_SHA256");
+    CHECK_STR(r.group, "X25519");
+    CHECK_EQ_INT(r.round_trips, 1);
+}
+
+static void test_tuned_tls12_prefers_ecdsa(void) {
+    tls_standin_result_t r;
+    CHECK(handshake(TLS_STANDIN_RSA | TLS_STANDIN_ECDSA, true, &tls_standin_profile_tuned, &r));
+    CHECK_STR(r.version, "TLSv1.2");
+    CHECK_STR(r.suite, "ECDHE-ECDSA-AES128-GCM-SHA256");
+    CHECK_STR(r.group, "X25519");
+    CHECK_EQ_INT(r.round_trips, 2);
+
+    CHECK(handshake(TLS_STANDIN_RSA, true, &tls_standin_profile_tuned, &r));
+    CHECK_STR(r.suite, "ECDHE-RSA-AES128-GCM-SHA256");
+}
+
+static void test_no_common_suite(void) {
+    static const tls_standin_profile_t ecdsa_only = {
+        .name = "ecdsa_only",
+        .ciphers = "ECDHE-ECDSA-AES128-GCM-SHA256",
+        .groups = "X25519",
+    };
+    tls_standin_result_t r;
+    CHECK(!handshake(TLS_STANDIN_RSA, true, &ecdsa_only, &r));
+    CHECK(!r.ok);
+}
+
+static void test_client_heap(void) {
+    tls_standin_result_t rsa;
+    tls_standin_result_t ecdsa;
+    CHECK(handshake(TLS_STANDIN_RSA, false, &tls_standin_profile_tuned, &rsa));
+    CHECK(handshake(TLS_STANDIN_ECDSA, false, &tls_standin_profile_tuned, &ecdsa));
+    CHECK(ecdsa.client_peak_heap > 0);
+    CHECK(ecdsa.client_peak_heap > ecdsa.client_heap_after);
+    // The ECDSA chain is the smaller one on the wire
+    CHECK(ecdsa.client_received < rsa.client_received);
+    CHECK(ecdsa.client_sent > 0 && rsa.client_sent > 0);
+}
+
+int main(void) {
+    RUN_TEST(test_tuned_tls13);
+    RUN_TEST(test_tuned_tls12_prefers_ecdsa);
+    RUN_TEST(test_no_common_suite);
+    RUN_TEST(test_client_heap);
+    return TEST_EXIT_CODE;
+}
+
+#else
+
+int main(void) {
+    printf("OpenSSL not found, TLS stand-in tests skipped\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Tiny assertion helpers for the host regression tests. Each test binary
+// calls its test functions through RUN_TEST and returns TEST_EXIT_CODE.
+
+static int test_failures;
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ_INT(a, b) do {                                             \
+        long long a_ = (long long)(a), b_ = (long long)(b);                 \
+        if (a_ != b_) {                                                     \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n",           \
+                    __FILE__, __LINE__, #a, a_, b_);                        \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol) do {                                          \
+        double a_ = (a), b_ = (b);                                          \
+        if (fabs(a_ - b_) > (tol)) {                                        \
+            fprintf(stderr, "%s:%d: %s == %g, expected %g\n",               \
+                    __FILE__, __LINE__, #a, a_, b_);                        \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_STR(a, b) do {                                                \
+        const char *a_ = (a), *b_ = (b);                                    \
+        if (strcmp(a_, b_) != 0) {                                          \
+            fprintf(stderr, "%s:%d: %s ==\n  \"%s\"\nexpected\n  \"%s\"\n", \
+                    __FILE__, __LINE__, #a, a_, b_);                        \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define RUN_TEST(fn) do {                                                   \
+        int before_ = test_failures;                                        \
+        fn();                                                               \
+        printf("%-40s %s\n", #fn, test_failures == before_ ? "ok" : "FAILED"); \
+    } while (0)
+
+#define TEST_EXIT_CODE (test_failures == 0 ? 0 : 1)
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,159 @@
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_registry.h"
+#include "aqua_xadc.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "i2c_standin.h"
+#include "sensors.h"
+#include "test_util.h"
+
+// External ADS1115 scanning on the I2C stand-in: parallel conversions across
+// converters, bus traffic per input, and converters that are missing or never
+// signal ready.
+
+#define CONVERSION_US (1000000 / XADC_DATA_RATE_SPS)
+
+static void setup(void) {
+    hal_sim_reset();
+    for (int n = 0; n < XADC_MAX_INPUTS; n++) {
+        i2c_standin_set_input_mv(XADC_ADDR_BASE + n / XADC_INPUTS_PER_DEVICE,
+                                 n % XADC_INPUTS_PER_DEVICE, 100 * (n + 1));
+    }
+}
+
+// ========== SCANNING ==========
+static void test_init(void) {
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    for (int d = 0; d < XADC_COUNT; d++) {
+        CHECK(aqua_xadc_present(d));
+    }
+    CHECK(!aqua_xadc_present(XADC_COUNT));
+    CHECK_EQ_INT(aqua_xadc_stats()->bus_transactions, 2 * XADC_COUNT);
+}
+
+static void test_full_scan(void) {
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    int tx_before = i2c_standin_stats()->transactions;
+
+    // Returns at once: only the first config writes are queued
+    int64_t t0 = hal_time_us();
+    CHECK_EQ_INT(aqua_xadc_scan_start(0xFFFF), ESP_OK);
+    CHECK(hal_time_us() - t0 < 100);
+
+    CHECK_EQ_INT(aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS), ESP_OK);
+    for (int n = 0; n < XADC_MAX_INPUTS; n++) {
+        int mv = 0;
+        CHECK_EQ_INT(aqua_xadc_read_mv(n, &mv), ESP_OK);
+        CHECK_EQ_INT(mv, 100 * (n + 1));
+    }
+
+    // Four converters in parallel: four conversion times (plus bus time),
+    // not the sixteen a single converter would need
+    const aqua_xadc_stats_t *st = aqua_xadc_stats();
+    CHECK_EQ_INT(st->scans, 1);
+    CHECK_EQ_INT(st->conversions, 16);
+    CHECK_EQ_INT(st->failures, 0);
+    CHECK(st->last_scan_us >= 4 * CONVERSION_US);
+    CHECK(st->last_scan_us < 5 * CONVERSION_US);
+
+    // One config write and one conversion read per input
+    CHECK_EQ_INT(i2c_standin_stats()->transactions - tx_before, 32);
+    CHECK_EQ_INT(i2c_standin_stats()->conversions, 16);
+}
+
+static void test_results_taken_once(void) {
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    int mv = 0;
+
+    // No scan yet: converted on its own
+    CHECK_EQ_INT(aqua_xadc_read_mv(5, &mv), ESP_OK);
+    CHECK_EQ_INT(mv, 600);
+    CHECK_EQ_INT(i2c_standin_stats()->conversions, 1);
+
+    // The next read needs a fresh conversion
+    i2c_standin_set_input_mv(XADC_ADDR_BASE + 1, 1, 1234);
+    CHECK_EQ_INT(aqua_xadc_read_mv(5, &mv), ESP_OK);
+    CHECK_EQ_INT(mv, 1234);
+    CHECK_EQ_INT(i2c_standin_stats()->conversions, 2);
+
+    CHECK_EQ_INT(aqua_xadc_read_mv(XADC_MAX_INPUTS, &mv), ESP_ERR_INVALID_ARG);
+}
+
+// ========== FAULTS ==========
+static void test_missing_converter(void) {
+    setup();
+    i2c_standin_set_present(XADC_ADDR_BASE + 2, false);
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    CHECK(!aqua_xadc_present(2));
+    CHECK(aqua_xadc_present(3));
+
+    CHECK_EQ_INT(aqua_xadc_scan_start(0xFFFF), ESP_OK);
+    CHECK_EQ_INT(aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS), ESP_OK);
+    int mv;
+    CHECK_EQ_INT(aqua_xadc_read_mv(8, &mv), ESP_ERR_NOT_FOUND);
+    CHECK_EQ_INT(aqua_xadc_read_mv(12, &mv), ESP_OK);
+    CHECK_EQ_INT(mv, 1300);
+    CHECK_EQ_INT(aqua_xadc_stats()->conversions, 12);
+    CHECK(aqua_xadc_stats()->last_scan_us < 5 * CONVERSION_US);
+
+    // Unplugged after init: its inputs fail, the others still convert
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    i2c_standin_set_present(XADC_ADDR_BASE + 1, false);
+    CHECK_EQ_INT(aqua_xadc_scan_start(0x00F0 | 0x0001), ESP_OK);
+    CHECK_EQ_INT(aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS), ESP_OK);
+    CHECK_EQ_INT(aqua_xadc_stats()->failures, 4);
+    CHECK_EQ_INT(aqua_xadc_read_mv(4, &mv), ESP_FAIL);
+    CHECK_EQ_INT(aqua_xadc_read_mv(0, &mv), ESP_OK);
+    CHECK_EQ_INT(mv, 100);
+}
+
+static void test_stuck_alert(void) {
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    i2c_standin_set_alert_stuck(XADC_ADDR_BASE + 0, true);
+
+    CHECK_EQ_INT(aqua_xadc_scan_start(0x0013), ESP_OK);     // Inputs 0 and 1, and 4
+    CHECK_EQ_INT(aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS), ESP_OK);
+    int mv;
+    CHECK_EQ_INT(aqua_xadc_read_mv(0, &mv), ESP_FAIL);
+    CHECK_EQ_INT(aqua_xadc_read_mv(1, &mv), ESP_FAIL);
+    CHECK_EQ_INT(aqua_xadc_read_mv(4, &mv), ESP_OK);
+    CHECK_EQ_INT(mv, 500);
+
+    // Each lost input costs its deadline, never the scan timeout
+    CHECK(aqua_xadc_stats()->last_scan_us < 2 * (3 * CONVERSION_US));
+}
+
+// ========== SENSOR PATH ==========
+static void test_registry_probe(void) {
+    setup();
+    CHECK_EQ_INT(aqua_xadc_init(), ESP_OK);
+    sensor_health_reset();
+
+    // The pH probe moved to converter 3, input 2
+    aqua_measure_t ph = *aqua_measure(AQUA_MEAS_PH);
+    ph.adc_channel = XADC_CH(3, 2);
+    i2c_standin_set_input_mv(XADC_ADDR_BASE + 3, 2, 2500);
+    CHECK_NEAR(read_analog_sensor(&ph), aqua_mv_to_ph(2500), 1e-4);
+    CHECK_EQ_INT(sensor_health(AQUA_SENSOR_PH)->reads, 1);
+
+    i2c_standin_set_present(XADC_ADDR_BASE + 3, false);
+    CHECK_NEAR(read_analog_sensor(&ph), -1.0, 1e-6);
+    CHECK(sensor_health(AQUA_SENSOR_PH)->no_response_rate > 0);
+}
+
+int main(void) {
+    RUN_TEST(test_init);
+    RUN_TEST(test_full_scan);
+    RUN_TEST(test_results_taken_once);
+    RUN_TEST(test_missing_converter);
+    RUN_TEST(test_stuck_alert);
+    RUN_TEST(test_registry_probe);
+
+    return TEST_EXIT_CODE;
+}
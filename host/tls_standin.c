@@ -0,0 +1,407 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "tls_standin.h"
+#ifdef STANDIN_HAVE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/objects.h>
+#include <openssl/ssl.h>
+#endif
+
+const tls_standin_profile_t tls_standin_profile_default = {
+    .name = "default",
+    .tls13 = true,
+};
+
+// The suites and groups left in sdkconfig.defaults, ECDSA first as mbedTLS orders them
+const tls_standin_profile_t tls_standin_profile_tuned = {
+    .name = "tuned",
+    .ciphers = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
+               "ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384",
+    .suites13 = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384",
+    .groups = "X25519:P-256:P-384",
+    .tls13 = true,
+};
+
+#ifdef STANDIN_HAVE_OPENSSL
+
+#define SERVE_READ_TIMEOUT_S 5
+
+struct tls_standin {
+    SSL_CTX *ctx;
+};
+
+struct tls_standin_client {
+    SSL_CTX *ctx;
+};
+
+// ========== HEAP ACCOUNTING ==========
+// Every OpenSSL allocation carries its size and whether the client made it,
+// so the client's bytes can be followed while the server runs alongside.
+typedef struct {
+    size_t size;
+    size_t client;
+} mem_hdr_t;
+
+static bool s_hooked;
+static bool s_client_side;
+static size_t s_client_bytes;
+static size_t s_client_peak;
+
+static void client_grow(size_t add) {
+    s_client_bytes += add;
+    if (s_client_bytes > s_client_peak) {
+        s_client_peak = s_client_bytes;
+    }
+}
+
+static void *mem_malloc(size_t n, const char *file, int line) {
+    mem_hdr_t *h = malloc(sizeof(*h) + n);
+    if (!h) {
+        return NULL;
+    }
+    h->size = n;
+    h->client = s_client_side;
+    if (h->client) {
+        client_grow(n);
+    }
+    return h + 1;
+}
+
+static void mem_free(void *p, const char *file, int line) {
+    if (!p) {
+        return;
+    }
+    mem_hdr_t *h = (mem_hdr_t *)p - 1;
+    if (h->client) {
+        s_client_bytes -= h->size;
+    }
+    free(h);
+}
+
+static void *mem_realloc(void *p, size_t n, const char *file, int line) {
+    if (!p) {
+        return mem_malloc(n, file, line);
+    }
+    if (n == 0) {
+        mem_free(p, file, line);
+        return NULL;
+    }
+    mem_hdr_t *h = realloc((mem_hdr_t *)p - 1, sizeof(*h) + n);
+    if (!h) {
+        return NULL;
+    }
+    if (h->client) {
+        s_client_bytes -= h->size;
+        client_grow(n);
+    }
+    h->size = n;
+    return h + 1;
+}
+
+// Only possible before OpenSSL's first allocation; without it peaks read 0
+static void hooks_install(void) {
+    static bool tried;
+    if (!tried) {
+        tried = true;
+        s_hooked = CRYPTO_set_mem_functions(mem_malloc, mem_realloc, mem_free) == 1;
+    }
+}
+
+// ========== SETUP ==========
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool load_chain(SSL_CTX *ctx, const char *dir, const char *name) {
+    char cert[512];
+    char key[512];
+    snprintf(cert, sizeof(cert), "%s/%s.pem", dir, name);
+    snprintf(key, sizeof(key), "%s/%s.key", dir, name);
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM) != 1) {
+        fprintf(stderr, "tls_standin: cannot load %s\n", cert);
+        return false;
+    }
+    return true;
+}
+
+tls_standin_t *tls_standin_create(const char *cert_dir, unsigned chains, bool max_tls12) {
+    hooks_install();
+    tls_standin_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return NULL;
+    }
+    s->ctx = SSL_CTX_new(TLS_server_method());
+    if (!s->ctx) {
+        free(s);
+        return NULL;
+    }
+    // The firmware keeps no sessions, so every handshake is a full one
+    SSL_CTX_set_min_proto_version(s->ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(s->ctx, max_tls12 ? TLS1_2_VERSION : TLS1_3_VERSION);
+    SSL_CTX_set_options(s->ctx, SSL_OP_NO_TICKET | SSL_OP_NO_RENEGOTIATION);
+    SSL_CTX_set_num_tickets(s->ctx, 0);
+    SSL_CTX_set_session_cache_mode(s->ctx, SSL_SESS_CACHE_OFF);
+
+    bool ok = chains != 0;
+    if (ok && (chains & TLS_STANDIN_RSA)) {
+        ok = load_chain(s->ctx, cert_dir, "rsa");
+    }
+    if (ok && (chains & TLS_STANDIN_ECDSA)) {
+        ok = load_chain(s->ctx, cert_dir, "ecdsa");
+    }
+    if (!ok) {
+        tls_standin_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void tls_standin_free(tls_standin_t *s) {
+    if (!s) {
+        return;
+    }
+    SSL_CTX_free(s->ctx);
+    free(s);
+}
+
+tls_standin_client_t *tls_standin_client_create(const char *cert_dir, const tls_standin_profile_t *profile) {
+    hooks_install();
+    tls_standin_client_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        return NULL;
+    }
+    c->ctx = SSL_CTX_new(TLS_client_method());
+    if (!c->ctx) {
+        free(c);
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(c->ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(c->ctx, profile->tls13 ? TLS1_3_VERSION : TLS1_2_VERSION);
+    SSL_CTX_set_options(c->ctx, SSL_OP_NO_TICKET);
+    SSL_CTX_set_session_cache_mode(c->ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_verify(c->ctx, SSL_VERIFY_PEER, NULL);
+
+    char ca[512];
+    snprintf(ca, sizeof(ca), "%s/ca.pem", cert_dir);
+    bool ok = SSL_CTX_load_verify_locations(c->ctx, ca, NULL) == 1;
+    if (ok && profile->ciphers) {
+        ok = SSL_CTX_set_cipher_list(c->ctx, profile->ciphers) == 1;
+    }
+    if (ok && profile->suites13) {
+        ok = SSL_CTX_set_ciphersuites(c->ctx, profile->suites13) == 1;
+    }
+    if (ok && profile->groups) {
+        ok = SSL_CTX_set1_groups_list(c->ctx, profile->groups) == 1;
+    }
+    if (!ok) {
+        fprintf(stderr, "tls_standin: bad client profile %s\n", profile->name);
+        tls_standin_client_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void tls_standin_client_free(tls_standin_client_t *c) {
+    if (!c) {
+        return;
+    }
+    SSL_CTX_free(c->ctx);
+    free(c);
+}
+
+static const char *group_name(int nid) {
+    switch (nid) {
+    case NID_X9_62_prime256v1: return "P-256";
+    case NID_secp384r1: return "P-384";
+    case NID_secp521r1: return "P-521";
+    default: {
+        const char *sn = OBJ_nid2sn(nid);
+        return sn ? sn : "?";
+    }
+    }
+}
+
+static void describe(SSL *ssl, tls_standin_result_t *out) {
+    snprintf(out->version, sizeof(out->version), "%s", SSL_get_version(ssl));
+    snprintf(out->suite, sizeof(out->suite), "%s", SSL_get_cipher_name(ssl));
+    snprintf(out->group, sizeof(out->group), "%s", group_name(SSL_get_negotiated_group(ssl)));
+}
+
+// ========== IN-PROCESS HANDSHAKE ==========
+static size_t pump(BIO *from, BIO *to) {
+    char buf[4096];
+    size_t moved = 0;
+    int n;
+    while ((n = BIO_read(from, buf, sizeof(buf))) > 0) {
+        BIO_write(to, buf, n);
+        moved += (size_t)n;
+    }
+    return moved;
+}
+
+// One handshake step; false once it fails rather than waits for data
+static bool step(SSL *ssl, bool *done, int64_t *ns) {
+    int64_t t0 = now_ns();
+    int r = SSL_do_handshake(ssl);
+    *ns += now_ns() - t0;
+    if (r == 1) {
+        *done = true;
+        return true;
+    }
+    return SSL_get_error(ssl, r) == SSL_ERROR_WANT_READ;
+}
+
+bool tls_standin_handshake(tls_standin_t *s, tls_standin_client_t *c, tls_standin_result_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    s_client_side = true;
+    size_t base = s_client_bytes;
+    s_client_peak = base;
+    SSL *cs = SSL_new(c->ctx);
+    BIO *c_in = BIO_new(BIO_s_mem());
+    BIO *c_out = BIO_new(BIO_s_mem());
+    s_client_side = false;
+    SSL *ss = SSL_new(s->ctx);
+    BIO *s_in = BIO_new(BIO_s_mem());
+    BIO *s_out = BIO_new(BIO_s_mem());
+    if (!cs || !ss || !c_in || !c_out || !s_in || !s_out) {
+        SSL_free(cs);
+        SSL_free(ss);
+        BIO_free(c_in);
+        BIO_free(c_out);
+        BIO_free(s_in);
+        BIO_free(s_out);
+        return false;
+    }
+    s_client_side = true;
+    SSL_set_bio(cs, c_in, c_out);
+    SSL_set_connect_state(cs);
+    SSL_set_tlsext_host_name(cs, TLS_STANDIN_NAME);
+    SSL_set1_host(cs, TLS_STANDIN_NAME);
+    s_client_side = false;
+    SSL_set_bio(ss, s_in, s_out);
+    SSL_set_accept_state(ss);
+
+    bool client_done = false;
+    bool server_done = false;
+    bool ok = true;
+    for (int i = 0; i < 16 && ok && !(client_done && server_done); i++) {
+        if (!client_done) {
+            s_client_side = true;
+            ok = step(cs, &client_done, &out->client_ns);
+            s_client_side = false;
+        }
+        out->client_sent += pump(c_out, s_in);
+        if (ok && !server_done) {
+            ok = step(ss, &server_done, &out->server_ns);
+        }
+        size_t back = pump(s_out, c_in);
+        out->client_received += back;
+        if (back > 0 && !client_done) {
+            out->round_trips++;
+        }
+    }
+
+    out->ok = ok && client_done && server_done && SSL_get_verify_result(cs) == X509_V_OK;
+    out->client_peak_heap = s_hooked ? s_client_peak - base : 0;
+    out->client_heap_after = s_hooked ? s_client_bytes - base : 0;
+    if (out->ok) {
+        describe(cs, out);
+    }
+    ERR_clear_error();
+
+    s_client_side = true;
+    SSL_free(cs);
+    s_client_side = false;
+    SSL_free(ss);
+    return out->ok;
+}
+
+// ========== SOCKET SERVER ==========
+int tls_standin_serve(tls_standin_t *s, int port, int count) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 4) != 0) {
+        close(lfd);
+        return -1;
+    }
+
+    for (int served = 0; count == 0 || served < count; served++) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept(lfd, (struct sockaddr *)&peer, &peer_len);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { .tv_sec = SERVE_READ_TIMEOUT_S };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        SSL *ssl = SSL_new(s->ctx);
+        SSL_set_fd(ssl, fd);
+        int64_t t0 = now_ns();
+        int r = SSL_accept(ssl);
+        double ms = (now_ns() - t0) / 1e6;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        if (r == 1) {
+            tls_standin_result_t res;
+            describe(ssl, &res);
+            printf("%s %s %s %s %.1f ms\n", ip, res.version, res.suite, res.group, ms);
+            char buf[256];
+            SSL_read(ssl, buf, sizeof(buf));
+            SSL_shutdown(ssl);
+        } else {
+            printf("%s handshake failed after %.1f ms\n", ip, ms);
+            ERR_print_errors_fp(stdout);
+        }
+        fflush(stdout);
+        SSL_free(ssl);
+        close(fd);
+    }
+    close(lfd);
+    return 0;
+}
+
+#else // STANDIN_HAVE_OPENSSL
+
+tls_standin_t *tls_standin_create(const char *cert_dir, unsigned chains, bool max_tls12) {
+    return NULL;
+}
+
+void tls_standin_free(tls_standin_t *s) {
+}
+
+tls_standin_client_t *tls_standin_client_create(const char *cert_dir, const tls_standin_profile_t *profile) {
+    return NULL;
+}
+
+void tls_standin_client_free(tls_standin_client_t *c) {
+}
+
+bool tls_standin_handshake(tls_standin_t *s, tls_standin_client_t *c, tls_standin_result_t *out) {
+    memset(out, 0, sizeof(*out));
+    return false;
+}
+
+int tls_standin_serve(tls_standin_t *s, int port, int count) {
+    return -1;
+}
+
+#endif // STANDIN_HAVE_OPENSSL
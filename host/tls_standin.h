@@ -0,0 +1,90 @@
+#ifndef TLS_STANDIN_H
+#define TLS_STANDIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// TLS server standing in for the cloud endpoints in handshake benchmarks,
+// built on OpenSSL when the host has it (STANDIN_HAVE_OPENSSL). It serves the
+// test chains in certificates/standin, both for the name "aqua-tls-standin":
+//
+//   rsa.pem     RSA-2048 leaf under an RSA-4096 root (like ISRG Root X1)
+//   ecdsa.pem   ECDSA P-256 leaf under a P-384 root (like GTS Root R4)
+//
+// and ca.pem holds both roots. tls_standin_handshake() runs a complete
+// handshake in process: client and server talk through memory buffers on the
+// calling thread, so the client's share of the work can be timed and its
+// heap counted on its own. tls_standin_serve() answers real connections,
+// for the firmware's boot-time benchmark (CONFIG_AQUA_TLS_BENCH).
+
+#define TLS_STANDIN_NAME "aqua-tls-standin"
+
+typedef enum {
+    TLS_STANDIN_RSA = 1,
+    TLS_STANDIN_ECDSA = 2,
+} tls_standin_chain_t;
+
+// Client settings, mirroring the firmware's mbedTLS build
+typedef struct {
+    const char *name;
+    const char *ciphers;                // TLS 1.2 suites, OpenSSL names; NULL: library default
+    const char *suites13;               // TLS 1.3 suites; NULL: library default
+    const char *groups;                 // Key exchange groups; NULL: library default
+    bool tls13;                         // Offer TLS 1.3 as well as 1.2
+} tls_standin_profile_t;
+
+// Everything the library offers, as the untuned firmware did
+extern const tls_standin_profile_t tls_standin_profile_default;
+// sdkconfig.defaults: ECDHE with AES-GCM only, X25519/P-256/P-384
+extern const tls_standin_profile_t tls_standin_profile_tuned;
+
+typedef struct {
+    bool ok;
+    int64_t client_ns;                  // In the client's handshake calls
+    int64_t server_ns;
+    size_t client_peak_heap;            // Peak bytes held by the client, from SSL_new() on
+    size_t client_heap_after;           // Still held once connected
+    size_t client_sent;                 // Bytes on the wire
+    size_t client_received;
+    int round_trips;                    // Times the client waited for the server
+    char version[16];
+    char suite[64];
+    char group[16];
+} tls_standin_result_t;
+
+typedef struct tls_standin tls_standin_t;
+typedef struct tls_standin_client tls_standin_client_t;
+
+/**
+ * @brief Load the chains given as a mask of tls_standin_chain_t
+ * @param cert_dir  certificates/standin
+ * @param max_tls12 Refuse TLS 1.3, as a 1.2-only endpoint would
+ * @return Server handle, NULL if OpenSSL is missing or a file fails to load
+ */
+tls_standin_t *tls_standin_create(const char *cert_dir, unsigned chains, bool max_tls12);
+void tls_standin_free(tls_standin_t *s);
+
+/**
+ * @brief Client context trusting ca.pem; shared by its handshakes like the CA store
+ */
+tls_standin_client_t *tls_standin_client_create(const char *cert_dir, const tls_standin_profile_t *profile);
+void tls_standin_client_free(tls_standin_client_t *c);
+
+/**
+ * @brief One full handshake, verifying the chain and the name
+ * @return true if both sides completed it
+ */
+bool tls_standin_handshake(tls_standin_t *s, tls_standin_client_t *c, tls_standin_result_t *out);
+
+/**
+ * @brief Accept connections on port and complete a handshake on each
+ *
+ * Each connection is logged to stdout (peer, version, suite, group, time) and
+ * closed after the client's first read or disconnect. Returns after count
+ * connections (0: never) or on error.
+ * @return 0, or -1 if the port cannot be bound
+ */
+int tls_standin_serve(tls_standin_t *s, int port, int count);
+
+#endif // TLS_STANDIN_H
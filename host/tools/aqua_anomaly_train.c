@@ -0,0 +1,451 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_registry.h"
+#include "pond_model.h"
+
+// Trains the anomaly detector's model and generates main/aqua_anomaly_model.h.
+//
+//   aqua_anomaly_train OUT.h [CSV...]
+//
+// Training data is TRAIN_DAYS of the built-in pond model (host/pond_model.h),
+// plus the rows of any CSV files written by aqua_ingest --csv that carry
+// every measurement. Values are standardised (4 standard deviations to full
+// int8 scale), departures from the average get DELTA_GAIN times their
+// value's scale, all are quantised with the firmware's own functions, and the
+// principal components are taken from the quantised vectors: the fewest
+// that explain VARIANCE_KEPT of the variance. The threshold is
+// THRESHOLD_MARGIN times the THRESHOLD_QUANTILE of the training scores.
+//
+// A fresh series and two injected faults (a water event and a pH probe
+// reading low) are scored as a check, and vectors from them become the
+// golden scores the firmware verifies at boot. The header is committed; the
+// "anomaly_model" target rewrites it and the "anomaly_model_current" test
+// fails if it is stale.
+
+#define TRAIN_DAYS 14
+#define CHECK_DAYS 7
+#define VARIANCE_KEPT 0.90
+#define DELTA_GAIN 4
+#define THRESHOLD_QUANTILE 0.999
+#define THRESHOLD_MARGIN 1.5
+#define TRAIN_SEED 1
+#define CHECK_SEED 2
+
+#define F AQUA_ANOMALY_FEATURES
+#define K AQUA_ANOMALY_COMPONENTS
+
+typedef struct {
+    float (*v)[F];
+    size_t count;
+    size_t cap;
+} set_t;
+
+static void set_add(set_t *s, const float *features) {
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4096;
+        s->v = realloc(s->v, s->cap * sizeof(*s->v));
+        if (!s->v) {
+            fprintf(stderr, "aqua_anomaly_train: out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(s->v[s->count++], features, sizeof(*s->v));
+}
+
+// Feature vectors of a series, after the averages have settled
+typedef struct {
+    float avg[AQUA_MEAS_ID_COUNT];
+    int seen;
+} stream_t;
+
+static void stream_reset(stream_t *st) {
+    for (int i = 0; i < AQUA_MEAS_ID_COUNT; i++) st->avg[i] = NAN;
+    st->seen = 0;
+}
+
+static bool stream_add(stream_t *st, const aqua_reading_t *r, float *features) {
+    aqua_anomaly_features(r, st->avg, features);
+    aqua_anomaly_average(r, st->avg);
+    return ++st->seen > ANOMALY_EMA_SAMPLES;
+}
+
+static void add_pond(set_t *s, uint32_t seed, int days) {
+    pond_model_t pond;
+    stream_t st;
+    aqua_reading_t r;
+    float features[F];
+    pond_model_init(&pond, seed, 0.0);
+    stream_reset(&st);
+    long samples = days * 24L * 3600 * 1000 / SAMPLE_DELAY_MS;
+    for (long i = 0; i < samples; i++) {
+        pond_model_next(&pond, &r);
+        if (stream_add(&st, &r, features)) set_add(s, features);
+    }
+}
+
+// Rows of an aqua_ingest CSV with every measurement; a new boot restarts the averages
+static int add_csv(set_t *s, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[2048];
+    int column[AQUA_MEAS_ID_COUNT];
+    int boot_col = -1;
+    for (int i = 0; i < AQUA_MEAS_ID_COUNT; i++) column[i] = -1;
+    if (fgets(line, sizeof(line), f)) {
+        int col = 0;
+        for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(NULL, ",\r\n"), col++) {
+            if (strcmp(tok, "boot") == 0) boot_col = col;
+            for (size_t i = 0; i < aqua_measure_count; i++) {
+                if (strcmp(tok, aqua_measures[i].key) == 0) column[aqua_measures[i].id] = col;
+            }
+        }
+    }
+
+    stream_t st;
+    stream_reset(&st);
+    long boot = -1;
+    int rows = 0;
+    while (fgets(line, sizeof(line), f)) {
+        aqua_reading_t r;
+        aqua_reading_clear(&r);
+        bool complete = true;
+        long row_boot = 0;
+        char *p = line;
+        for (int col = 0; p; col++) {
+            char *end = strchr(p, ',');
+            if (col == boot_col) row_boot = strtol(p, NULL, 10);
+            for (size_t i = 0; i < aqua_measure_count; i++) {
+                const aqua_measure_t *m = &aqua_measures[i];
+                if (column[m->id] != col) continue;
+                char *num_end;
+                float v = strtof(p, &num_end);
+                if (num_end == p) {
+                    complete = false;
+                } else {
+                    aqua_measure_set(m, &r, v);
+                }
+            }
+            p = end ? end + 1 : NULL;
+        }
+        for (size_t i = 0; i < aqua_measure_count; i++) {
+            complete &= column[aqua_measures[i].id] >= 0;
+        }
+        if (row_boot != boot) {
+            stream_reset(&st);
+            boot = row_boot;
+        }
+        float features[F];
+        if (complete && stream_add(&st, &r, features)) {
+            set_add(s, features);
+            rows++;
+        }
+    }
+    fclose(f);
+    return rows;
+}
+
+// ========== PCA ==========
+// Cyclic Jacobi rotations; a holds the covariance on entry and the
+// eigenvalues on its diagonal on return, v the eigenvectors as columns.
+static void jacobi(double a[F][F], double v[F][F]) {
+    for (int i = 0; i < F; i++) {
+        for (int j = 0; j < F; j++) v[i][j] = i == j;
+    }
+    for (int sweep = 0; sweep < 100; sweep++) {
+        double off = 0;
+        for (int i = 0; i < F; i++) {
+            for (int j = i + 1; j < F; j++) off += a[i][j] * a[i][j];
+        }
+        if (off < 1e-20) break;
+        for (int p = 0; p < F; p++) {
+            for (int q = p + 1; q < F; q++) {
+                if (fabs(a[p][q]) < 1e-30) continue;
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+                for (int k = 0; k < F; k++) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < F; k++) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < F; k++) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+static void train(const set_t *s, aqua_anomaly_model_t *m, double *kept) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < F; i++) {
+        double sum = 0, sq = 0;
+        size_t n = 0;
+        for (size_t j = 0; j < s->count; j++) {
+            double x = s->v[j][i];
+            if (isnan(x)) continue;
+            sum += x;
+            sq += x * x;
+            n++;
+        }
+        double mean = n ? sum / (double)n : 0;
+        double sd = n ? sqrt(fmax(sq / (double)n - mean * mean, 0)) : 0;
+        m->mean[i] = (float)mean;
+        m->scale[i] = sd > 1e-6 ? (float)(127.0 / (4.0 * sd)) : 0.0f;
+    }
+    // Departures in the units of their value, so noise does not earn components of its own
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        m->scale[AQUA_ANOMALY_DELTA(id)] = m->scale[AQUA_ANOMALY_VALUE(id)] * (float)DELTA_GAIN;
+    }
+
+    // Covariance of the quantised vectors, the domain the firmware works in
+    static double cov[F][F], vec[F][F];
+    memset(cov, 0, sizeof(cov));
+    int16_t x[F] AQUA_ANOMALY_ALIGNED;
+    for (size_t j = 0; j < s->count; j++) {
+        aqua_anomaly_quantize(m, s->v[j], x);
+        for (int a = 0; a < F; a++) {
+            for (int b = 0; b < F; b++) cov[a][b] += (double)x[a] * x[b];
+        }
+    }
+    for (int a = 0; a < F; a++) {
+        for (int b = 0; b < F; b++) cov[a][b] /= (double)s->count;
+    }
+    jacobi(cov, vec);
+
+    // Largest eigenvalues first
+    int order[F];
+    double total = 0;
+    for (int i = 0; i < F; i++) {
+        order[i] = i;
+        total += cov[i][i];
+    }
+    for (int i = 0; i < F; i++) {
+        for (int j = i + 1; j < F; j++) {
+            if (cov[order[j]][order[j]] > cov[order[i]][order[i]]) {
+                int t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+        }
+    }
+    double sum = 0;
+    m->components = 0;
+    while (m->components < K && sum < VARIANCE_KEPT * total) {
+        int c = order[m->components];
+        sum += cov[c][c];
+
+        // Sign: largest entry positive, so the header does not flip between runs
+        int big = 0;
+        for (int i = 1; i < F; i++) {
+            if (fabs(vec[i][c]) > fabs(vec[big][c])) big = i;
+        }
+        double sign = vec[big][c] < 0 ? -1.0 : 1.0;
+        for (int i = 0; i < F; i++) {
+            int16_t w = (int16_t)lround(sign * vec[i][c] * (1 << AQUA_ANOMALY_Q));
+            w = w > 127 ? 127 : w < -127 ? -127 : w;
+            m->enc[m->components][i] = w;
+            m->dec[i][m->components] = w;
+        }
+        m->components++;
+    }
+    *kept = total > 0 ? sum / total : 0;
+}
+
+static int32_t score_of(const aqua_anomaly_model_t *m, const float *features, int16_t *x) {
+    aqua_anomaly_quantize(m, features, x);
+    return aqua_anomaly_score_ref(m, x, NULL);
+}
+
+static int cmp_i32(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// ========== CHECKS ==========
+// Samples an injected fault runs for, starting at 15:00 local
+#define FAULT_SAMPLES 180
+
+typedef enum { FAULT_EVENT, FAULT_PH_PROBE } fault_t;
+
+// Afternoon: warming water, oxygen crashing and ammonia climbing while pH
+// stays high (an algae die-off), or a pH probe drifting low while the
+// water is normal.
+static void inject(fault_t fault, int i, aqua_reading_t *r) {
+    float f = (float)(i < 60 ? i : 60) / 60.0f;
+    if (fault == FAULT_EVENT) {
+        r->water_temp += 1.5f * f;
+        r->do_level -= 2.5f * f;
+        r->ammonia += 0.4f * f;
+    } else {
+        r->ph -= 1.0f * f;
+    }
+}
+
+// Samples flagged (raised) in a run of faulty readings; the vector an hour
+// into the fault becomes a golden one
+static int run_fault(const aqua_anomaly_model_t *m, fault_t fault, aqua_anomaly_golden_t *golden) {
+    pond_model_t pond;
+    stream_t st;
+    aqua_reading_t r;
+    float features[F];
+    int16_t x[F] AQUA_ANOMALY_ALIGNED;
+    pond_model_init(&pond, CHECK_SEED, 14.0);
+    stream_reset(&st);
+    while (pond_model_hour(&pond) < 15.0) {
+        pond_model_next(&pond, &r);
+        stream_add(&st, &r, features);
+    }
+    int run = 0, raised = 0;
+    for (int i = 0; i < FAULT_SAMPLES; i++) {
+        pond_model_next(&pond, &r);
+        inject(fault, i, &r);
+        stream_add(&st, &r, features);
+        int32_t score = score_of(m, features, x);
+        run = score > m->threshold ? run + 1 : 0;
+        raised += run >= ANOMALY_CONFIRM_SAMPLES;
+        if (i == 60) {
+            memcpy(golden->x, x, sizeof(x));
+            golden->score = score;
+        }
+    }
+    return raised;
+}
+
+// ========== OUTPUT ==========
+static void print_floats(FILE *out, const char *name, const float *v) {
+    fprintf(out, "    .%s = {", name);
+    for (int i = 0; i < F; i++) {
+        char num[32];
+        snprintf(num, sizeof(num), "%.9g", v[i]);
+        bool integral = !strpbrk(num, ".e");    // "0f" is not a float literal
+        fprintf(out, "%s%s%sf", i == 0 ? "\n        " : i % 4 ? ", " : ",\n        ", num, integral ? ".0" : "");
+    }
+    fprintf(out, "\n    },\n");
+}
+
+static void print_row(FILE *out, const int16_t *v, int n) {
+    fprintf(out, "{");
+    for (int i = 0; i < n; i++) {
+        fprintf(out, "%s%4d", i ? "," : "", v[i]);
+    }
+    fprintf(out, "}");
+}
+
+static void write_header(FILE *out, const aqua_anomaly_model_t *m, const aqua_anomaly_golden_t *golden,
+                         size_t vectors, int csv_files, double kept) {
+    fprintf(out, "#ifndef AQUA_ANOMALY_MODEL_H\n#define AQUA_ANOMALY_MODEL_H\n\n");
+    fprintf(out, "#include \"aqua_anomaly.h\"\n\n");
+    fprintf(out, "// Generated by host/tools/aqua_anomaly_train from %d days of the pond model", TRAIN_DAYS);
+    if (csv_files) {
+        fprintf(out, "\n// and %d capture files", csv_files);
+    }
+    fprintf(out, " (%zu vectors).\n", vectors);
+    fprintf(out, "// %d components keep %.1f%% of the variance.\n", m->components, 100.0 * kept);
+    fprintf(out, "// Do not edit; rebuild the host \"anomaly_model\" target instead.\n\n");
+
+    fprintf(out, "static const aqua_anomaly_model_t aqua_anomaly_builtin = {\n");
+    print_floats(out, "mean", m->mean);
+    print_floats(out, "scale", m->scale);
+    fprintf(out, "    .enc = {\n");
+    for (int k = 0; k < K; k++) {
+        fprintf(out, "        ");
+        print_row(out, m->enc[k], F);
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "    },\n    .dec = {\n");
+    for (int i = 0; i < F; i++) {
+        fprintf(out, "        ");
+        print_row(out, m->dec[i], K);
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "    },\n    .components = %d,\n    .threshold = %ld,\n};\n\n", m->components,
+            (long)m->threshold);
+
+    fprintf(out, "static const aqua_anomaly_golden_t aqua_anomaly_golden[AQUA_ANOMALY_GOLDEN] = {\n");
+    for (int g = 0; g < AQUA_ANOMALY_GOLDEN; g++) {
+        fprintf(out, "    { ");
+        print_row(out, golden[g].x, F);
+        fprintf(out, ", %ld },\n", (long)golden[g].score);
+    }
+    fprintf(out, "};\n\n#endif // AQUA_ANOMALY_MODEL_H\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: aqua_anomaly_train OUT.h [CSV...]\n");
+        return 2;
+    }
+
+    static set_t data;
+    add_pond(&data, TRAIN_SEED, TRAIN_DAYS);
+    for (int i = 2; i < argc; i++) {
+        int rows = add_csv(&data, argv[i]);
+        if (rows < 0) return 1;
+        printf("%s: %d complete rows\n", argv[i], rows);
+    }
+
+    static aqua_anomaly_model_t m;
+    double kept;
+    train(&data, &m, &kept);
+
+    int32_t *scores = malloc(data.count * sizeof(int32_t));
+    if (!scores) return 1;
+    int16_t x[F] AQUA_ANOMALY_ALIGNED;
+    for (size_t j = 0; j < data.count; j++) {
+        scores[j] = score_of(&m, data.v[j], x);
+    }
+    qsort(scores, data.count, sizeof(int32_t), cmp_i32);
+    int32_t q = scores[(size_t)(THRESHOLD_QUANTILE * (double)(data.count - 1))];
+    m.threshold = (int32_t)ceil(q * THRESHOLD_MARGIN);
+    printf("trained on %zu vectors: %d components (%.1f%% of the variance), median score %ld, threshold %ld\n",
+           data.count, m.components, 100.0 * kept, (long)scores[data.count / 2], (long)m.threshold);
+    free(scores);
+
+    // A fresh series: scores above the threshold and raised alerts
+    static set_t check;
+    add_pond(&check, CHECK_SEED, CHECK_DAYS);
+    static aqua_anomaly_golden_t golden[AQUA_ANOMALY_GOLDEN];
+    int above = 0, run = 0, raised = 0;
+    for (size_t j = 0; j < check.count; j++) {
+        int32_t score = score_of(&m, check.v[j], x);
+        above += score > m.threshold;
+        run = score > m.threshold ? run + 1 : 0;
+        raised += run == ANOMALY_CONFIRM_SAMPLES;
+    }
+    for (int g = 0; g < AQUA_ANOMALY_GOLDEN - 2; g++) {
+        size_t j = (size_t)g * (check.count / (AQUA_ANOMALY_GOLDEN - 2));
+        golden[g].score = score_of(&m, check.v[j], golden[g].x);
+    }
+    printf("normal water, %d days: %d of %zu samples above, %d alerts\n", CHECK_DAYS, above, check.count, raised);
+
+    int event = run_fault(&m, FAULT_EVENT, &golden[AQUA_ANOMALY_GOLDEN - 2]);
+    int probe = run_fault(&m, FAULT_PH_PROBE, &golden[AQUA_ANOMALY_GOLDEN - 1]);
+    printf("water event: %d of %d samples raised; pH probe drift: %d of %d\n", event, FAULT_SAMPLES, probe,
+           FAULT_SAMPLES);
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    write_header(out, &m, golden, data.count, argc - 2, kept);
+    fclose(out);
+    free(data.v);
+    free(check.v);
+    return 0;
+}
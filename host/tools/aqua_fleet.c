@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fleet_sim.h"
+#include "http_standin.h"
+#include "rpc_standin.h"
+
+// Emulates a fleet of controllers against a local stand-in or a real
+// PostgREST, and reports throughput and tail latency (host/fleet_sim.h).
+//
+//   aqua_fleet [--devices N] [--duration S] [--speed X] [--exchange] [--alerts]
+//              [--workers W] [--service-ms MS] [--target HOST:PORT]
+//              [--jitter-ms MS] [--wifi-drops PER_HOUR] [--wifi-drop-s S]
+//              [--outage AT_S:FOR_S] [--storm AT_S] [--commands PER_MIN] [--seed N]
+//
+// Times are device seconds; --speed 10 runs the fleet ten times faster than
+// real time (the server's service time is not scaled). Without --target the
+// in-process stand-in serves the requests with the rpc_standin model,
+// --workers threads and --service-ms per reply, and server-side service
+// times are reported too.
+
+static void print_latency(const char *name, const fleet_percentiles_t *p) {
+    printf("  %-12s p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f ms\n",
+           name, p->p50_ms, p->p90_ms, p->p99_ms, p->p999_ms, p->max_ms);
+}
+
+static void print_report(const fleet_config_t *cfg, const fleet_report_t *r) {
+    printf("fleet: %d devices, %.0f s at %.1fx (%.2f s real), %s transport\n", cfg->devices,
+           cfg->duration_s, cfg->speed, r->real_s, cfg->exchange ? "exchange" : "rest");
+    printf("cycles %llu, rows uploaded %llu, rows lost %llu, boots %llu, commands applied %llu\n",
+           (unsigned long long)r->cycles, (unsigned long long)r->rows_uploaded,
+           (unsigned long long)r->rows_lost, (unsigned long long)r->boots,
+           (unsigned long long)r->commands_applied);
+    printf("request rate: mean %.1f/s, peak %.0f/s at %.0f s (device time); "
+           "peak in flight %d; completed %.0f/s real\n",
+           r->mean_rate, r->peak_rate, r->peak_at_s, r->peak_in_flight, r->throughput);
+
+    printf("%-14s %10s %10s %10s %10s %12s\n", "request", "sent", "ok", "failed", "timeouts", "unreachable");
+    for (int k = 0; k < FLEET_REQ_COUNT; k++) {
+        const fleet_req_stats_t *s = &r->req[k];
+        if (s->sent + s->unreachable == 0) continue;
+        printf("%-14s %10llu %10llu %10llu %10llu %12llu\n", fleet_req_name(k),
+               (unsigned long long)s->sent, (unsigned long long)s->ok, (unsigned long long)s->failed,
+               (unsigned long long)s->timeouts, (unsigned long long)s->unreachable);
+    }
+    printf("client latency (connect to last byte):\n");
+    for (int k = 0; k < FLEET_REQ_COUNT; k++) {
+        if (r->req[k].sent > 0) print_latency(fleet_req_name(k), &r->req[k].latency);
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--devices N] [--duration S] [--speed X] [--exchange] [--alerts]\n"
+                    "       [--workers W] [--service-ms MS] [--target HOST:PORT] [--jitter-ms MS]\n"
+                    "       [--wifi-drops PER_HOUR] [--wifi-drop-s S] [--outage AT_S:FOR_S]\n"
+                    "       [--storm AT_S] [--commands PER_MIN] [--seed N]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    fleet_config_t cfg;
+    fleet_config_defaults(&cfg);
+    const char *target = NULL;
+    int workers = 4, service_ms = 0;
+    static char host[64];
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--exchange") == 0) {
+            cfg.exchange = true;
+            continue;
+        }
+        if (strcmp(a, "--alerts") == 0) {
+            cfg.alerts = true;
+            continue;
+        }
+        if (!v) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+        if (strcmp(a, "--devices") == 0) {
+            cfg.devices = atoi(v);
+        } else if (strcmp(a, "--duration") == 0) {
+            cfg.duration_s = atof(v);
+        } else if (strcmp(a, "--speed") == 0) {
+            cfg.speed = atof(v);
+        } else if (strcmp(a, "--workers") == 0) {
+            workers = atoi(v);
+        } else if (strcmp(a, "--service-ms") == 0) {
+            service_ms = atoi(v);
+        } else if (strcmp(a, "--target") == 0) {
+            target = v;
+        } else if (strcmp(a, "--jitter-ms") == 0) {
+            cfg.cycle_jitter_ms = atoi(v);
+        } else if (strcmp(a, "--wifi-drops") == 0) {
+            cfg.wifi_drops_per_hour = atof(v);
+        } else if (strcmp(a, "--wifi-drop-s") == 0) {
+            cfg.wifi_drop_mean_s = atof(v);
+        } else if (strcmp(a, "--outage") == 0) {
+            if (sscanf(v, "%lf:%lf", &cfg.outage_at_s, &cfg.outage_s) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(a, "--storm") == 0) {
+            cfg.storm_at_s = atof(v);
+        } else if (strcmp(a, "--commands") == 0) {
+            cfg.commands_per_min = atof(v);
+        } else if (strcmp(a, "--seed") == 0) {
+            cfg.seed = (uint32_t)strtoul(v, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    standin_t *server = NULL;
+    rpc_standin_t *model = NULL;
+    fleet_server_t server_stats;
+    if (target) {
+        const char *colon = strrchr(target, ':');
+        if (!colon || (size_t)(colon - target) >= sizeof(host)) {
+            usage(argv[0]);
+            return 2;
+        }
+        memcpy(host, target, (size_t)(colon - target));
+        cfg.host = host;
+        cfg.port = atoi(colon + 1);
+    } else {
+        server = standin_start_workers(workers);
+        model = server ? rpc_standin_attach(server) : NULL;
+        if (!model) {
+            fprintf(stderr, "aqua_fleet: failed to start the stand-in\n");
+            return 1;
+        }
+        standin_set_delay_ms(server, service_ms);
+        fleet_server_attach(&server_stats, server);
+        cfg.port = standin_port(server);
+        cfg.model = model;
+    }
+
+    fleet_report_t report;
+    if (!fleet_run(&cfg, &report)) {
+        fprintf(stderr, "aqua_fleet: invalid configuration\n");
+        return 2;
+    }
+    print_report(&cfg, &report);
+
+    if (server) {
+        int rows = rpc_standin_row_count(model);
+        fleet_server_detach(&server_stats, server);
+        rpc_standin_detach(model);
+        standin_stop(server);
+
+        fleet_percentiles_t p;
+        fleet_samples_percentiles(&server_stats.service, &p);
+        printf("server (%d workers, %d ms service): %llu requests, %.0f/s real, %llu errors, %d rows stored\n",
+               workers, service_ms, (unsigned long long)server_stats.requests,
+               report.real_s > 0 ? server_stats.requests / report.real_s : 0.0,
+               (unsigned long long)server_stats.errors, rows);
+        print_latency("service", &p);
+        fleet_samples_free(&server_stats.service);
+    }
+    return 0;
+}
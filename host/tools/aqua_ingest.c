@@ -0,0 +1,395 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "aqua_core.h"
+#include "log_ingest.h"
+
+// Turns firmware console output into time series and alerts (replaces
+// monitor.sh and test_sensors.sh).
+//
+//   aqua_ingest [--csv FILE] [--columns DIR] [--alerts FILE] [--follow]
+//               [--baud N] [--quiet] [--stats] INPUT...
+//
+// INPUT is a capture file, "-" for stdin, or a serial device, which is put
+// in raw mode at --baud (115200 by default). All inputs are read at once,
+// each with its own parser state (host/log_ingest.h). Devices and pipes are
+// read until they close or the tool is interrupted; files until their end,
+// or like tail -f with --follow.
+//
+// --csv writes one row per cycle ("-" for stdout). --columns writes the same
+// rows column by column into DIR, one little-endian array per column
+// (<name>.f32 with NaN for missing values, .i8 flags and scores with -1 for
+// unknown, .i32, .i64), plus sources.txt naming the source.u8 indices.
+// Alerts go to stdout (unless --quiet) and are appended to --alerts FILE.
+// --stats reports lines/s on stderr.
+
+#define MAX_INPUTS 16
+#define READ_CHUNK 65536
+#define FOLLOW_POLL_MS 200
+
+typedef struct {
+    const char *path;
+    int fd;
+    bool regular;                   // Plain file: read without polling
+    bool follow;
+    bool done;
+    ingest_source_t src;
+} input_t;
+
+typedef struct {
+    FILE *csv;
+    FILE *alerts;
+    bool quiet;
+    bool live;                      // Following an input: flush every row and alert
+    FILE *col[INGEST_VALUE_COUNT + INGEST_RELAY_COUNT + INGEST_HEALTH_COUNT + 5];
+    input_t *inputs;
+} output_t;
+
+static volatile sig_atomic_t s_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    s_stop = 1;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ========== OUTPUT ==========
+enum { COL_SOURCE, COL_BOOT, COL_CYCLE, COL_UPTIME, COL_UPLOADED, COL_FIXED };
+
+static void csv_header(FILE *f) {
+    fputs("source,boot,cycle,uptime_ms", f);
+    for (int i = 0; i < INGEST_VALUE_COUNT; i++) fprintf(f, ",%s", ingest_value_name(i));
+    for (int i = 0; i < INGEST_RELAY_COUNT; i++) fprintf(f, ",%s", ingest_relay_name(i));
+    fputs(",uploaded", f);
+    for (int i = 0; i < INGEST_HEALTH_COUNT; i++) fprintf(f, ",health_%s", aqua_sensor_name(i));
+    fputc('\n', f);
+}
+
+static void csv_flag(FILE *f, int v) {
+    if (v >= 0) {
+        fprintf(f, ",%d", v);
+    } else {
+        fputc(',', f);
+    }
+}
+
+static void csv_row(FILE *f, const ingest_row_t *r) {
+    fprintf(f, "%s,%d,%d,", r->source, r->boot, r->cycle);
+    if (r->uptime_ms >= 0) fprintf(f, "%lld", (long long)r->uptime_ms);
+    for (int i = 0; i < INGEST_VALUE_COUNT; i++) {
+        if (isnan(r->values[i])) {
+            fputc(',', f);
+        } else {
+            fprintf(f, ",%.2f", r->values[i]);
+        }
+    }
+    for (int i = 0; i < INGEST_RELAY_COUNT; i++) csv_flag(f, r->relays[i]);
+    csv_flag(f, r->uploaded);
+    for (int i = 0; i < INGEST_HEALTH_COUNT; i++) csv_flag(f, r->health[i]);
+    fputc('\n', f);
+}
+
+static FILE *column_file(const char *dir, const char *name, const char *ext) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, name, ext);
+    FILE *f = fopen(path, "wb");
+    if (!f) perror(path);
+    return f;
+}
+
+static bool columns_open(output_t *out, const char *dir, int inputs) {
+    mkdir(dir, 0777);
+    FILE **c = out->col;
+    c[COL_SOURCE] = column_file(dir, "source", "u8");
+    c[COL_BOOT] = column_file(dir, "boot", "i32");
+    c[COL_CYCLE] = column_file(dir, "cycle", "i32");
+    c[COL_UPTIME] = column_file(dir, "uptime_ms", "i64");
+    c[COL_UPLOADED] = column_file(dir, "uploaded", "i8");
+    int n = COL_FIXED;
+    for (int i = 0; i < INGEST_VALUE_COUNT; i++) c[n++] = column_file(dir, ingest_value_name(i), "f32");
+    for (int i = 0; i < INGEST_RELAY_COUNT; i++) c[n++] = column_file(dir, ingest_relay_name(i), "i8");
+    for (int i = 0; i < INGEST_HEALTH_COUNT; i++) {
+        char name[48];
+        snprintf(name, sizeof(name), "health_%s", aqua_sensor_name(i));
+        c[n++] = column_file(dir, name, "i8");
+    }
+    for (int i = 0; i < n; i++) {
+        if (!c[i]) return false;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sources.txt", dir);
+    FILE *names = fopen(path, "w");
+    if (!names) {
+        perror(path);
+        return false;
+    }
+    for (int i = 0; i < inputs; i++) fprintf(names, "%d %s\n", i, out->inputs[i].path);
+    fclose(names);
+    return true;
+}
+
+static void columns_row(output_t *out, const ingest_row_t *r) {
+    FILE **c = out->col;
+    uint8_t source = 0;
+    while (out->inputs[source].src.name != r->source) source++;
+    int32_t boot = r->boot, cycle = r->cycle;
+    int64_t uptime = r->uptime_ms;
+    fwrite(&source, 1, 1, c[COL_SOURCE]);
+    fwrite(&boot, sizeof(boot), 1, c[COL_BOOT]);
+    fwrite(&cycle, sizeof(cycle), 1, c[COL_CYCLE]);
+    fwrite(&uptime, sizeof(uptime), 1, c[COL_UPTIME]);
+    fwrite(&r->uploaded, 1, 1, c[COL_UPLOADED]);
+    int n = COL_FIXED;
+    for (int i = 0; i < INGEST_VALUE_COUNT; i++) fwrite(&r->values[i], sizeof(float), 1, c[n++]);
+    for (int i = 0; i < INGEST_RELAY_COUNT; i++) fwrite(&r->relays[i], 1, 1, c[n++]);
+    for (int i = 0; i < INGEST_HEALTH_COUNT; i++) fwrite(&r->health[i], 1, 1, c[n++]);
+}
+
+static void on_row(const ingest_row_t *row, void *ctx) {
+    output_t *out = ctx;
+    if (out->csv) csv_row(out->csv, row);
+    if (out->col[0]) columns_row(out, row);
+    if (out->live && out->csv) fflush(out->csv);
+}
+
+static void on_alert(const char *source, int boot, int64_t uptime_ms, ingest_alert_t alert,
+                     const char *line, void *ctx) {
+    output_t *out = ctx;
+    char text[INGEST_LINE_MAX + 128];
+    snprintf(text, sizeof(text), "%s boot %d at %lld ms: ALERT %s - %s\n", source, boot,
+             (long long)uptime_ms, ingest_alert_name(alert), line);
+    if (!out->quiet) {
+        fputs(text, stdout);
+        if (out->live) fflush(stdout);
+    }
+    if (out->alerts) {
+        fputs(text, out->alerts);
+        fflush(out->alerts);
+    }
+}
+
+// ========== INPUTS ==========
+static speed_t baud_constant(long baud) {
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return 0;
+    }
+}
+
+static bool input_open(input_t *in, const char *path, bool follow, speed_t baud) {
+    in->path = path;
+    in->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+    if (in->fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    struct stat st;
+    in->regular = fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode);
+    in->follow = in->regular && follow;
+    if (isatty(in->fd)) {
+        struct termios tio;
+        if (tcgetattr(in->fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            cfsetispeed(&tio, baud);
+            cfsetospeed(&tio, baud);
+            tio.c_cflag |= CLOCAL | CREAD;
+            tcsetattr(in->fd, TCSANOW, &tio);
+        }
+    }
+    return true;
+}
+
+// Returns bytes read; marks the input done at its end
+static ssize_t input_read(input_t *in, char *buf) {
+    ssize_t n = read(in->fd, buf, READ_CHUNK);
+    if (n > 0) {
+        ingest_feed(&in->src, buf, (size_t)n);
+    } else if (n == 0 && !in->follow) {
+        in->done = true;
+    } else if (n < 0 && errno != EINTR && errno != EAGAIN) {
+        perror(in->path);
+        in->done = true;
+    }
+    return n;
+}
+
+static void run(input_t *inputs, int count) {
+    static char buf[READ_CHUNK];
+
+    while (!s_stop) {
+        bool progress = false, following = false;
+        struct pollfd pfd[MAX_INPUTS];
+        int map[MAX_INPUTS], polled = 0;
+
+        for (int i = 0; i < count; i++) {
+            input_t *in = &inputs[i];
+            if (in->done) continue;
+            if (in->regular) {
+                if (input_read(in, buf) > 0) progress = true;
+                following |= !in->done;
+            } else {
+                pfd[polled] = (struct pollfd){ .fd = in->fd, .events = POLLIN };
+                map[polled++] = i;
+            }
+        }
+        if (!following && polled == 0) {
+            break;
+        }
+
+        // Followed files have no readiness to wait for, so poll on a timer
+        int timeout = progress ? 0 : FOLLOW_POLL_MS;
+        if (polled == 0) {
+            if (!progress) poll(NULL, 0, timeout);
+            continue;
+        }
+        if (poll(pfd, (nfds_t)polled, timeout) <= 0) {
+            continue;
+        }
+        for (int k = 0; k < polled; k++) {
+            input_t *in = &inputs[map[k]];
+            if (pfd[k].revents & POLLIN) {
+                input_read(in, buf);
+            } else if (pfd[k].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                in->done = true;
+            }
+        }
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--csv FILE] [--columns DIR] [--alerts FILE] [--follow]\n"
+                    "       [--baud N] [--quiet] [--stats] INPUT...\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    static input_t inputs[MAX_INPUTS];
+    static output_t out;
+    const char *csv_path = NULL, *columns_dir = NULL, *alerts_path = NULL;
+    bool follow = false, stats = false;
+    long baud = 115200;
+    int count = 0;
+    const char *paths[MAX_INPUTS];
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(a, "--csv") == 0 && has_value) {
+            csv_path = argv[++i];
+        } else if (strcmp(a, "--columns") == 0 && has_value) {
+            columns_dir = argv[++i];
+        } else if (strcmp(a, "--alerts") == 0 && has_value) {
+            alerts_path = argv[++i];
+        } else if (strcmp(a, "--baud") == 0 && has_value) {
+            baud = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(a, "--follow") == 0) {
+            follow = true;
+        } else if (strcmp(a, "--quiet") == 0) {
+            out.quiet = true;
+        } else if (strcmp(a, "--stats") == 0) {
+            stats = true;
+        } else if (a[0] == '-' && a[1] != '\0') {
+            usage(argv[0]);
+            return 2;
+        } else if (count == MAX_INPUTS) {
+            fprintf(stderr, "aqua_ingest: at most %d inputs\n", MAX_INPUTS);
+            return 2;
+        } else {
+            paths[count++] = a;
+        }
+    }
+    if (count == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    speed_t speed = baud_constant(baud);
+    if (speed == 0) {
+        fprintf(stderr, "aqua_ingest: unsupported baud rate %ld\n", baud);
+        return 2;
+    }
+
+    out.inputs = inputs;
+    if (csv_path) {
+        out.csv = strcmp(csv_path, "-") == 0 ? stdout : fopen(csv_path, "w");
+        if (!out.csv) {
+            perror(csv_path);
+            return 1;
+        }
+        csv_header(out.csv);
+    }
+    if (alerts_path && !(out.alerts = fopen(alerts_path, "a"))) {
+        perror(alerts_path);
+        return 1;
+    }
+
+    ingest_sink_t sink = { .row = on_row, .alert = on_alert, .ctx = &out };
+    for (int i = 0; i < count; i++) {
+        if (!input_open(&inputs[i], paths[i], follow, speed)) {
+            return 1;
+        }
+        ingest_source_init(&inputs[i].src, paths[i], &sink);
+        out.live |= inputs[i].follow || !inputs[i].regular;
+    }
+    if (columns_dir && !columns_open(&out, columns_dir, count)) {
+        return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    double t0 = now_s();
+    run(inputs, count);
+    ingest_stats_t total = { 0 };
+    for (int i = 0; i < count; i++) {
+        ingest_finish(&inputs[i].src);
+        const ingest_stats_t *st = &inputs[i].src.stats;
+        total.lines += st->lines;
+        total.bytes += st->bytes;
+        total.rows += st->rows;
+        total.alerts += st->alerts;
+        total.bad_records += st->bad_records;
+        if (inputs[i].fd != STDIN_FILENO) close(inputs[i].fd);
+    }
+    double elapsed = now_s() - t0;
+
+    if (out.csv && out.csv != stdout) fclose(out.csv);
+    if (out.alerts) fclose(out.alerts);
+    for (size_t i = 0; i < sizeof(out.col) / sizeof(out.col[0]); i++) {
+        if (out.col[i]) fclose(out.col[i]);
+    }
+
+    if (stats) {
+        fprintf(stderr, "aqua_ingest: %llu lines (%llu bytes), %llu rows, %llu alerts in %.3f s: "
+                "%.0f lines/s\n", (unsigned long long)total.lines, (unsigned long long)total.bytes,
+                (unsigned long long)total.rows, (unsigned long long)total.alerts, elapsed,
+                elapsed > 0 ? total.lines / elapsed : 0.0);
+    }
+    if (total.bad_records > 0) {
+        fprintf(stderr, "aqua_ingest: %llu deferred records could not be decoded\n",
+                (unsigned long long)total.bad_records);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_log.h"
+
+// Formats deferred log records captured from the firmware console.
+//
+//   aqua_logdecode [--only] [FILE...]
+//
+// Reads FILE (or stdin) line by line. "AQL:<base64>" lines are decoded with
+// the message table from main/aqua_log_msgs.h and printed in the usual
+// "L (ms) AQUA: message" form; all other lines pass through unchanged unless
+// --only is given. The decoder must be built from the same revision as the
+// firmware; an "AQL#<hash>" line from the device is used to check that.
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+// Returns decoded length, -1 on malformed input
+static int base64_decode(const char *in, uint8_t *out, size_t out_size) {
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+
+    for (; *in && *in != '\r' && *in != '\n' && *in != '='; in++) {
+        int v = base64_value(*in);
+        if (v < 0) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n == out_size) return -1;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (int)n;
+}
+
+static void decode_line(const char *payload, unsigned long line_no, unsigned long *bad) {
+    static const char letters[] = "NEWIDV";
+    uint8_t buf[512];
+    int len = base64_decode(payload, buf, sizeof(buf));
+    if (len < 0) {
+        fprintf(stderr, "aqua_logdecode: line %lu: bad base64\n", line_no);
+        (*bad)++;
+        return;
+    }
+
+    size_t pos = 0;
+    while (pos < (size_t)len) {
+        aqua_log_record_t rec;
+        char text[512];
+        size_t used = aqua_log_decode(buf + pos, (size_t)len - pos, &rec);
+        if (used == 0 || aqua_log_format(&rec, text, sizeof(text)) < 0) {
+            fprintf(stderr, "aqua_logdecode: line %lu: malformed record at byte %zu\n", line_no, pos);
+            (*bad)++;
+            return;
+        }
+        printf("%c (%lu) AQUA: %s\n", letters[aqua_log_msg(rec.id)->level],
+               (unsigned long)rec.timestamp_ms, text);
+        pos += used;
+    }
+}
+
+static unsigned long decode_stream(FILE *in, bool only) {
+    char line[4096];
+    unsigned long line_no = 0, bad = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        line_no++;
+        char *mark = strstr(line, "AQL:");
+        char *hash = strstr(line, "AQL#");
+        if (mark) {
+            decode_line(mark + 4, line_no, &bad);
+        } else if (hash) {
+            unsigned long fw = strtoul(hash + 4, NULL, 16);
+            if (fw != aqua_log_table_hash()) {
+                fprintf(stderr, "aqua_logdecode: message table mismatch (firmware %08lx, decoder %08lx);"
+                        " rebuild the decoder from the firmware's revision\n",
+                        fw, (unsigned long)aqua_log_table_hash());
+            }
+        } else if (!only) {
+            fputs(line, stdout);
+        }
+    }
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    bool only = false;
+    unsigned long bad = 0;
+    int files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--only") == 0) {
+            only = true;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "usage: %s [--only] [FILE...]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') continue;
+        FILE *in = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+        if (!in) {
+            perror(argv[i]);
+            return 1;
+        }
+        bad += decode_stream(in, only);
+        if (in != stdin) fclose(in);
+        files++;
+    }
+    if (files == 0) {
+        bad += decode_stream(stdin, only);
+    }
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "aqua_core.h"
+#include "delta_encoder.h"
+
+// Builds a firmware delta for the OTA manifest.
+//
+//   aqua_mkdelta OLD.bin NEW.bin OUT.aqd
+//
+// OLD.bin must be the exact image running on the devices (the delta carries
+// its CRC and is refused by anything else). Prints the size comparison and
+// the values to publish in the manifest.
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (buf && fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = buf ? (size_t)size : 0;
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: aqua_mkdelta OLD.bin NEW.bin OUT.aqd\n");
+        return 2;
+    }
+
+    size_t old_len, new_len;
+    uint8_t *old_img = read_file(argv[1], &old_len);
+    uint8_t *new_img = read_file(argv[2], &new_len);
+    if (!old_img || !new_img) {
+        fprintf(stderr, "aqua_mkdelta: cannot read %s\n", old_img ? argv[2] : argv[1]);
+        return 1;
+    }
+
+    uint8_t *delta = NULL;
+    delta_encode_stats_t st;
+    size_t delta_len = delta_encode(old_img, old_len, new_img, new_len, &delta, &st);
+    FILE *out = delta_len ? fopen(argv[3], "wb") : NULL;
+    if (!out || fwrite(delta, 1, delta_len, out) != delta_len) {
+        fprintf(stderr, "aqua_mkdelta: cannot write %s\n", argv[3]);
+        return 1;
+    }
+    fclose(out);
+
+    printf("old %zu B, new %zu B, delta %zu B (%.1f%% of the full image)\n",
+           old_len, new_len, delta_len, 100.0 * (double)delta_len / (double)new_len);
+    printf("%zu patch / %zu insert ops, %zu bytes reused, %zu bytes new\n",
+           st.patch_ops, st.insert_ops, st.copied_bytes, st.new_bytes);
+    printf("manifest: \"size\":%zu,\"crc32\":%u  delta \"size\":%zu\n",
+           new_len, (unsigned)aqua_crc32(0, new_img, new_len), delta_len);
+
+    free(delta);
+    free(old_img);
+    free(new_img);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_modbus.h"
+#include "esp_log.h"
+#include "modbus_client.h"
+
+// Polls a Modbus TCP server from several connections at once and reports
+// request latency (host/modbus_client.h).
+//
+//   aqua_modbus_poll [--pollers N] [--duration S] [--interval-ms MS]
+//                    [--publish-us US] [--target HOST:PORT]
+//
+// Every request reads the whole register map with function 4. Without
+// --target the firmware's server runs in process and a stand-in cycle
+// publishes a pond model sample every --publish-us (default 1000 µs, far
+// faster than the device), so the pollers read while the image changes.
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--pollers N] [--duration S] [--interval-ms MS]\n"
+                    "       [--publish-us US] [--target HOST:PORT]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    modbus_poll_config_t cfg;
+    modbus_poll_defaults(&cfg);
+    const char *target = NULL;
+    int publish_us = 1000;
+    static char host[64];
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+        if (strcmp(a, "--pollers") == 0) {
+            cfg.pollers = atoi(v);
+        } else if (strcmp(a, "--duration") == 0) {
+            cfg.duration_s = atof(v);
+        } else if (strcmp(a, "--interval-ms") == 0) {
+            cfg.interval_ms = atoi(v);
+        } else if (strcmp(a, "--publish-us") == 0) {
+            publish_us = atoi(v);
+        } else if (strcmp(a, "--target") == 0) {
+            target = v;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (target) {
+        const char *colon = strrchr(target, ':');
+        if (!colon || (size_t)(colon - target) >= sizeof(host)) {
+            usage(argv[0]);
+            return 2;
+        }
+        memcpy(host, target, (size_t)(colon - target));
+        cfg.host = host;
+        cfg.port = atoi(colon + 1);
+    } else {
+        esp_log_level_set("*", ESP_LOG_NONE);
+        aqua_modbus_init();
+        if (aqua_modbus_start(0) != ESP_OK) {
+            fprintf(stderr, "aqua_modbus_poll: failed to start the server\n");
+            return 1;
+        }
+        cfg.port = aqua_modbus_port();
+        cfg.publish_us = publish_us;
+    }
+
+    modbus_poll_report_t r;
+    if (!modbus_poll_run(&cfg, &r)) {
+        fprintf(stderr, "aqua_modbus_poll: no answers from %s:%d\n", cfg.host, cfg.port);
+        return 1;
+    }
+    printf("modbus: %d pollers, %.2f s, %d ms between requests\n", cfg.pollers, r.real_s, cfg.interval_ms);
+    printf("requests %llu (%.0f/s), errors %llu, torn %llu, samples seen %llu",
+           (unsigned long long)r.requests, r.real_s > 0 ? r.requests / r.real_s : 0.0,
+           (unsigned long long)r.errors, (unsigned long long)r.torn, (unsigned long long)r.samples_seen);
+    if (!target) {
+        printf(", published %llu", (unsigned long long)r.published);
+    }
+    printf("\n");
+    printf("  latency      p50 %8.3f  p90 %8.3f  p99 %8.3f  p99.9 %8.3f  max %8.3f ms\n",
+           r.latency.p50_ms, r.latency.p90_ms, r.latency.p99_ms, r.latency.p999_ms, r.latency.max_ms);
+
+    if (!target) {
+        aqua_modbus_stats_t st;
+        aqua_modbus_get_stats(&st);
+        printf("server: %u requests, %u exceptions, %u publishes, %u skipped (every slot held)\n",
+               (unsigned)st.requests, (unsigned)st.exceptions, (unsigned)st.publishes,
+               (unsigned)st.publish_skipped);
+    }
+    return r.errors == 0 && r.torn == 0 ? 0 : 1;
+}
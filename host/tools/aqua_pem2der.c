@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ca_der.h"
+
+// Generates main/ca_anchors.h, the built-in trust anchors as a DER bundle.
+//
+//   aqua_pem2der OUT.h PEM...
+//
+// Each PEM file may hold several certificates. The header is committed so
+// the firmware build needs no host tools; the "ca_anchors" target rewrites
+// it and the "ca_anchors_current" test fails if it is stale.
+
+#define PEM2DER_MAX_INPUT (64 * 1024)
+#define PEM2DER_MAX_BUNDLE (16 * 1024)
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *buf = malloc(PEM2DER_MAX_INPUT);
+    if (buf) {
+        *len = fread(buf, 1, PEM2DER_MAX_INPUT, f);
+        if (!feof(f)) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(f);
+    return buf;
+}
+
+// Last path component, so the header does not depend on the build directory
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: aqua_pem2der OUT.h PEM...\n");
+        return 2;
+    }
+
+    static uint8_t bundle[PEM2DER_MAX_BUNDLE];
+    size_t bundle_len = 0;
+    size_t pem_bytes = 0;
+    int count = 0;
+
+    for (int i = 2; i < argc; i++) {
+        size_t pem_len = 0;
+        char *pem = read_file(argv[i], &pem_len);
+        if (!pem) {
+            fprintf(stderr, "aqua_pem2der: cannot read %s\n", argv[i]);
+            return 1;
+        }
+        size_t used = 0;
+        int n = ca_der_import_pem(pem, pem_len, bundle + bundle_len,
+                                  sizeof(bundle) - bundle_len, &used);
+        free(pem);
+        if (n <= 0 || count + n > CA_DER_MAX_CERTS) {
+            fprintf(stderr, "aqua_pem2der: %s: no usable certificates\n", argv[i]);
+            return 1;
+        }
+        bundle_len += used;
+        pem_bytes += pem_len;
+        count += n;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        fprintf(stderr, "aqua_pem2der: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    fprintf(out, "#ifndef CA_ANCHORS_H\n#define CA_ANCHORS_H\n\n");
+    fprintf(out, "#include <stdint.h>\n\n");
+    fprintf(out, "// Generated by host/tools/aqua_pem2der from:\n");
+    for (int i = 2; i < argc; i++) {
+        fprintf(out, "//   certificates/%s\n", base_name(argv[i]));
+    }
+    fprintf(out, "// Do not edit; rebuild the host \"ca_anchors\" target instead.\n\n");
+    fprintf(out, "#define AQUA_CA_ANCHORS_COUNT %d\n", count);
+    fprintf(out, "#define AQUA_CA_ANCHORS_PEM_BYTES %zu\n\n", pem_bytes);
+    fprintf(out, "static const uint8_t aqua_ca_anchors[%zu] = {", bundle_len);
+    for (size_t i = 0; i < bundle_len; i++) {
+        fprintf(out, "%s0x%02x,", i % 12 == 0 ? "\n    " : " ", bundle[i]);
+    }
+    fprintf(out, "\n};\n\n#endif // CA_ANCHORS_H\n");
+    fclose(out);
+    return 0;
+}
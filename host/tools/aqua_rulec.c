@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_registry.h"
+#include "aqua_rules.h"
+
+// Compiles local rules with the firmware's compiler, to check them before
+// they are inserted into device_rules.
+//
+//   aqua_rulec [--list] FILE
+//
+// Reports "FILE:LINE: message" and exits 1 if the rules do not compile;
+// otherwise prints the rule count and bytecode size, and with --list the
+// disassembled program.
+
+static const char *const op_names[AQUA_OP_COUNT] = {
+    "end", "const", "value", "trend", "param", "hour", "relay", "add", "sub", "mul",
+    "lt", "le", "gt", "ge", "eq", "ne", "and", "or", "not", "skip_if_false",
+    "set_relay", "alert",
+};
+
+static const char *const relay_names[AQUA_RULES_RELAY_COUNT] = { "ph_relay", "aerator", "filter", "pump" };
+
+static const char *measure_key(uint8_t id) {
+    const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)id);
+    return m ? m->key : "?";
+}
+
+static void list(const aqua_rules_program_t *prog) {
+    const uint8_t *code = prog->code;
+    for (size_t pc = 0; pc < prog->code_len; ) {
+        uint8_t op = code[pc];
+        const uint8_t *arg = &code[pc + 1];
+        printf("%4zu  %-14s", pc, op_names[op]);
+        size_t len = 1;
+        switch (op) {
+        case AQUA_OP_CONST: {
+            uint32_t bits = (uint32_t)arg[0] | (uint32_t)arg[1] << 8 |
+                            (uint32_t)arg[2] << 16 | (uint32_t)arg[3] << 24;
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            printf("%g", v);
+            len += 4;
+            break;
+        }
+        case AQUA_OP_VALUE:
+        case AQUA_OP_TREND:
+            printf("%s", measure_key(arg[0]));
+            len += 1;
+            break;
+        case AQUA_OP_PARAM:
+            printf("%s", aqua_param_fields[arg[0]].key);
+            len += 1;
+            break;
+        case AQUA_OP_RELAY:
+            printf("%s", relay_names[arg[0]]);
+            len += 1;
+            break;
+        case AQUA_OP_SKIP_IF_FALSE:
+            printf("-> %u", (unsigned)(arg[0] | arg[1] << 8));
+            len += 2;
+            break;
+        case AQUA_OP_SET_RELAY:
+            printf("%s %s", relay_names[arg[0]], arg[1] ? "on" : "off");
+            len += 2;
+            break;
+        case AQUA_OP_ALERT:
+            printf("%s_%s", arg[1] ? "high" : "low", aqua_measure((aqua_measure_id_t)arg[0])->alert_name);
+            len += 2;
+            break;
+        default:
+            break;
+        }
+        printf("\n");
+        pc += len;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool listing = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--list") == 0) {
+            listing = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [--list] FILE\n", argv[0]);
+        return 2;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    static char source[AQUA_RULES_SOURCE_MAX + 1];
+    size_t n = fread(source, 1, sizeof(source), f);
+    fclose(f);
+    if (n >= AQUA_RULES_SOURCE_MAX) {
+        fprintf(stderr, "%s: longer than %d bytes\n", path, AQUA_RULES_SOURCE_MAX - 1);
+        return 1;
+    }
+    source[n] = '\0';
+
+    static aqua_rules_program_t prog;
+    aqua_rules_error_t err = {0};
+    if (aqua_rules_compile(source, &prog, &err) != ESP_OK) {
+        fprintf(stderr, "%s:%d: %s\n", path, err.line, err.message);
+        return 1;
+    }
+    if (!aqua_rules_verify(&prog)) {
+        fprintf(stderr, "%s: bytecode rejected by the verifier\n", path);
+        return 1;
+    }
+    printf("%s: %d rules, %u of %d bytecode bytes\n", path, prog.rule_count, prog.code_len, AQUA_RULES_CODE_MAX);
+    if (listing) {
+        list(&prog);
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "aqua_stream.h"
+
+// Receives raw sample captures from the firmware's USB port (aqua_stream.h).
+//
+//   aqua_streamrx [--start "RATE [CH,CH,...]"] [--seconds N] [--out DIR] [--quiet] [PORT|FILE|-]
+//
+// On a serial port (/dev/ttyACM0) it sends "start" with the given
+// arguments, reads for --seconds (default 10), then sends "stop". A file or
+// stdin (a saved capture, host_sim --stream) is read to the end.
+//
+// With --out, the samples are written to DIR as one file per column, raw
+// little-endian so numpy.fromfile() and friends read them directly:
+//
+//   t_us.i64     Device time of each scan
+//   ch<N>.i16    Conversions of ADC channel N, one per scan
+//
+// Frames of a later capture with other channels are left out. The summary
+// gives frames lost on the way, scans the device skipped, and the sustained
+// rate. Exit status is 1 if any frame was lost or corrupt.
+
+#define READ_CHUNK 4096
+
+typedef struct {
+    FILE *time;
+    FILE *ch[AQUA_STREAM_MAX_CHANNELS];
+    uint8_t nch;
+    uint8_t channels[AQUA_STREAM_MAX_CHANNELS];
+    bool have_channels;
+    uint32_t ignored;                   // Frames with another channel set
+    int64_t first_us;
+    int64_t end_us;
+    uint32_t period_us;
+    const char *dir;
+} columns_t;
+
+static int64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static FILE *open_column(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    return f;
+}
+
+static void put_le(FILE *f, uint64_t v, int bytes) {
+    uint8_t b[8];
+    for (int i = 0; i < bytes; i++) {
+        b[i] = (uint8_t)(v >> (8 * i));
+    }
+    fwrite(b, 1, (size_t)bytes, f);
+}
+
+static void on_frame(const aqua_stream_frame_t *f, void *ctx) {
+    columns_t *cols = ctx;
+    if (!cols->have_channels) {
+        cols->have_channels = true;
+        cols->nch = f->nch;
+        memcpy(cols->channels, f->channels, f->nch);
+        cols->first_us = f->first_us;
+        cols->period_us = f->period_us;
+        if (cols->dir) {
+            cols->time = open_column(cols->dir, "t_us.i64");
+            for (int c = 0; c < f->nch; c++) {
+                char name[32];
+                snprintf(name, sizeof(name), "ch%d.i16", f->channels[c]);
+                cols->ch[c] = open_column(cols->dir, name);
+            }
+        }
+    } else if (f->nch != cols->nch || memcmp(f->channels, cols->channels, f->nch) != 0) {
+        cols->ignored++;
+        return;
+    }
+    cols->end_us = f->first_us + (int64_t)f->scans * f->period_us;
+    if (!cols->dir) {
+        return;
+    }
+    for (int k = 0; k < f->scans; k++) {
+        put_le(cols->time, (uint64_t)(f->first_us + (int64_t)k * f->period_us), 8);
+        for (int c = 0; c < f->nch; c++) {
+            put_le(cols->ch[c], (uint16_t)f->samples[k * f->nch + c], 2);
+        }
+    }
+}
+
+static bool port_setup(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcflush(fd, TCIFLUSH);
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static void send_line(int fd, const char *line) {
+    if (write(fd, line, strlen(line)) < 0 || write(fd, "\n", 1) < 0) {
+        perror("write");
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *start_args = NULL;
+    const char *path = "-";
+    int seconds = 10;
+    bool quiet = false;
+    columns_t cols = {0};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+            start_args = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            cols.dir = argv[++i];
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "usage: %s [--start \"RATE [CH,CH,...]\"] [--seconds N] [--out DIR] [--quiet]"
+                    " [PORT|FILE|-]\n", argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (cols.dir && mkdir(cols.dir, 0777) != 0 && errno != EEXIST) {
+        perror(cols.dir);
+        return 1;
+    }
+
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    bool tty = isatty(fd);
+    if (tty) {
+        if (!port_setup(fd)) {
+            perror(path);
+            return 1;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "start %s", start_args ? start_args : "");
+        send_line(fd, line);
+    }
+
+    static aqua_stream_rx_t rx;
+    aqua_stream_rx_init(&rx, on_frame, &cols);
+    uint8_t buf[READ_CHUNK];
+    int64_t t0 = mono_us();
+    int64_t deadline = t0 + (int64_t)seconds * 1000000;
+    for (;;) {
+        if (tty) {
+            int64_t left_ms = (deadline - mono_us()) / 1000;
+            if (left_ms <= 0) {
+                break;
+            }
+            struct pollfd pfd = { .fd = fd, .events = POLLIN };
+            if (poll(&pfd, 1, (int)(left_ms < 100 ? left_ms : 100)) <= 0) {
+                continue;
+            }
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (tty && n == 0) {
+                continue;
+            }
+            break;
+        }
+        aqua_stream_rx_feed(&rx, buf, (size_t)n);
+    }
+    int64_t wall_us = mono_us() - t0;
+    if (tty) {
+        send_line(fd, "stop");
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (cols.time) {
+        fclose(cols.time);
+        for (int c = 0; c < cols.nch; c++) {
+            fclose(cols.ch[c]);
+        }
+    }
+
+    // Device time for a saved capture, wall time for a live one
+    const aqua_stream_rx_stats_t *st = &rx.stats;
+    int64_t span_us = tty ? wall_us : cols.end_us - cols.first_us;
+    double span_s = span_us > 0 ? span_us / 1e6 : 0.0;
+    if (!quiet) {
+        printf("frames        %u (%u lost, %u corrupt, %u other channels)\n", st->frames, st->lost_frames,
+               st->bad_frames, cols.ignored);
+        printf("scans         %llu (%u missed) of %u channels at %u us\n", (unsigned long long)st->scans,
+               st->missed_scans, cols.nch, cols.period_us);
+        if (span_s > 0) {
+            printf("sustained     %.0f scans/s, %.0f samples/s, %.1f kB/s on the wire over %.2f s\n",
+                   st->scans / span_s, st->scans * cols.nch / span_s, st->bytes / span_s / 1e3, span_s);
+        }
+    }
+    return st->lost_frames > 0 || st->bad_frames > 0 ? 1 : 0;
+}
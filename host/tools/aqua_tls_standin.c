@@ -0,0 +1,58 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tls_standin.h"
+
+// TLS stand-in for the firmware's handshake benchmark (CONFIG_AQUA_TLS_BENCH).
+//
+//   aqua_tls_standin [--port N] [--chains rsa|ecdsa|both] [--tls12] [--count N] [CERT_DIR]
+//
+// Serves the test chains in certificates/standin (both by default, so the
+// device picks one by its cipher suites) and prints one line per handshake:
+// peer, version, suite, key exchange group and the server's time. Point
+// *Aquaculture sensors* -> *TLS handshake benchmark* at this machine.
+
+#define DEFAULT_PORT 8443
+
+int main(int argc, char **argv) {
+    int port = DEFAULT_PORT;
+    unsigned chains = TLS_STANDIN_RSA | TLS_STANDIN_ECDSA;
+    bool tls12 = false;
+    int count = 0;
+    const char *dir = AQUA_STANDIN_CERT_DIR;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chains") == 0 && i + 1 < argc) {
+            const char *c = argv[++i];
+            chains = strcmp(c, "rsa") == 0 ? TLS_STANDIN_RSA : strcmp(c, "ecdsa") == 0 ? TLS_STANDIN_ECDSA
+                                                                                       : chains;
+        } else if (strcmp(argv[i], "--tls12") == 0) {
+            tls12 = true;
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--port N] [--chains rsa|ecdsa|both] [--tls12] [--count N] [CERT_DIR]\n",
+                    argv[0]);
+            return 2;
+        } else {
+            dir = argv[i];
+        }
+    }
+
+    tls_standin_t *s = tls_standin_create(dir, chains, tls12);
+    if (!s) {
+        fprintf(stderr, "cannot load the chains in %s\n", dir);
+        return 1;
+    }
+    printf("serving %s on port %d\n", TLS_STANDIN_NAME, port);
+    fflush(stdout);
+    int ret = tls_standin_serve(s, port, count);
+    if (ret != 0) {
+        perror("bind");
+    }
+    tls_standin_free(s);
+    return ret == 0 ? 0 : 1;
+}
@@ -2,10 +2,11 @@
 #define ADC_CONFIG_H
 
 // ADC channel definitions for ESP32-S3 - Updated for connected sensors
-#define ADC1_CHAN0          ADC_CHANNEL_5  // pH sensor on GPIO6
-#define ADC1_CHAN1          ADC_CHANNEL_7  // Turbidity sensor on GPIO8
-#define ADC1_CHAN2          ADC_CHANNEL_2  // DO sensor on GPIO3 (not connected yet)
-#define ADC1_CHAN3          ADC_CHANNEL_0  // Ammonia sensor on GPIO1 (not connected yet)
+// Plain channel numbers (== ADC_CHANNEL_n) so the host build can share them
+#define ADC1_CHAN0          5  // pH sensor on GPIO6 (ADC_CHANNEL_5)
+#define ADC1_CHAN1          7  // Turbidity sensor on GPIO8 (ADC_CHANNEL_7)
+#define ADC1_CHAN2          2  // DO sensor on GPIO3 (not connected yet)
+#define ADC1_CHAN3          0  // Ammonia sensor on GPIO1 (not connected yet)
 
 // ADC channel aliases
 #define PH_ADC_CH          ADC1_CHAN0
@@ -13,4 +14,11 @@
 #define DO_ADC_CH          ADC1_CHAN2
 #define AMMONIA_ADC_CH     ADC1_CHAN3
 
+// Inputs of the external I2C converters (aqua_xadc.h): input 0-3 of
+// converter 0-3. Assign one to a sensor alias above to move the probe there,
+// e.g. #define DO_ADC_CH XADC_CH(0, 2)
+#define XADC_CH(device, input)  (0x40 | ((device) << 2) | (input))
+#define XADC_CH_IS_EXTERNAL(ch) (((ch) & 0x40) != 0)
+#define XADC_CH_INPUT(ch)       ((ch) & 0x3F)
+
 #endif // ADC_CONFIG_H
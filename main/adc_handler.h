@@ -2,6 +2,7 @@
 #define ADC_HANDLER_H
 
 #include "adc_config.h"
+#include "aqua_registry.h"
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
@@ -32,11 +33,13 @@ esp_err_t init_adc() {
         .atten = ADC_ATTEN_DB_12,  // Use DB_12 for ESP32-S3 (renamed from DB_11 in ESP-IDF v6.0)
     };
 
-    // Configure all sensor ADC channels
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, PH_ADC_CH, &config));
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, DO_ADC_CH, &config));
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, TURBIDITY_ADC_CH, &config));
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, AMMONIA_ADC_CH, &config));
+    // Configure the channels of the analog sensors built into the registry
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        int channel = aqua_measures[i].adc_channel;
+        if (channel >= 0 && !XADC_CH_IS_EXTERNAL(channel)) {
+            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, channel, &config));
+        }
+    }
 
     // Skip ADC calibration for now - using raw values
     do_calibration = false;
@@ -47,14 +50,15 @@ esp_err_t init_adc() {
 
 esp_err_t read_adc_voltage(int channel, int *voltage) {
     int adc_raw;
-    ESP_ERROR_CHECK(adc_oneshot_read(adc1_handle, channel, &adc_raw));
+    esp_err_t err = adc_oneshot_read(adc1_handle, channel, &adc_raw);
+    if (err != ESP_OK) {
+        return err;
+    }
 
     if (do_calibration) {
-        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(adc1_cali_handle, adc_raw, voltage));
-    } else {
-        *voltage = adc_raw;
+        return adc_cali_raw_to_voltage(adc1_cali_handle, adc_raw, voltage);
     }
-
+    *voltage = adc_raw;
     return ESP_OK;
 }
 
@@ -0,0 +1,297 @@
+#include <math.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_log.h"
+
+#ifdef ESP_PLATFORM
+#include "dsps_dotprod.h"
+#define ANOMALY_BACKEND "esp-dsp"
+#elif defined(__GNUC__)
+#define ANOMALY_VECTOR 1
+#define ANOMALY_BACKEND "vector"
+#else
+#define ANOMALY_BACKEND "scalar"
+#endif
+
+#include "aqua_anomaly_model.h"
+
+_Static_assert(2 * AQUA_MEAS_ID_COUNT <= AQUA_ANOMALY_FEATURES, "a value and a delta per measurement");
+_Static_assert(AQUA_ANOMALY_FEATURES % 8 == 0 && AQUA_ANOMALY_COMPONENTS % 8 == 0,
+               "the PIE dot product takes lanes in groups of 8");
+_Static_assert(AQUA_ANOMALY_FEATURES <= 32, "present features are a 32-bit mask");
+
+// dsps_dotprod_s16 with shift 15 - Q: (acc + (0x7FFF >> shift)) >> Q
+#define DOT_SHIFT (15 - AQUA_ANOMALY_Q)
+#define DOT_ROUND (0x7FFF >> DOT_SHIFT)
+
+static int16_t sat8(int32_t v) {
+    return (int16_t)(v > 127 ? 127 : v < -127 ? -127 : v);
+}
+
+// ========== FEATURES ==========
+void aqua_anomaly_features(const aqua_reading_t *r, const float *avg, float *out) {
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        out[i] = NAN;
+    }
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        if (v == AQUA_SENSOR_ERROR) continue;
+        out[AQUA_ANOMALY_VALUE(m->id)] = v;
+        if (!isnan(avg[m->id])) {
+            out[AQUA_ANOMALY_DELTA(m->id)] = v - avg[m->id];
+        }
+    }
+}
+
+void aqua_anomaly_average(const aqua_reading_t *r, float *avg) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        if (v == AQUA_SENSOR_ERROR) continue;
+        avg[m->id] = isnan(avg[m->id]) ? v : avg[m->id] + (v - avg[m->id]) / (float)ANOMALY_EMA_SAMPLES;
+    }
+}
+
+void aqua_anomaly_quantize(const aqua_anomaly_model_t *m, const float *features, int16_t *x) {
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        float v = (features[i] - m->mean[i]) * m->scale[i];
+        if (isnan(v) || m->scale[i] == 0.0f) {
+            x[i] = 0;
+            continue;
+        }
+        v = v > 127.0f ? 127.0f : v < -127.0f ? -127.0f : v;
+        x[i] = (int16_t)(v >= 0.0f ? (int32_t)(v + 0.5f) : -(int32_t)(0.5f - v));
+    }
+}
+
+// Features that count towards the score: the model's, and not missing
+static uint32_t present(const aqua_anomaly_model_t *m, const float *features) {
+    uint32_t mask = 0;
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        if (m->scale[i] != 0.0f && !isnan(features[i])) mask |= 1u << i;
+    }
+    return mask;
+}
+
+// ========== INFERENCE ==========
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-tree-vectorize")))     // Stays the scalar baseline
+#endif
+int32_t aqua_anomaly_score_ref(const aqua_anomaly_model_t *m, const int16_t *x, int32_t *residual) {
+    int16_t h[AQUA_ANOMALY_COMPONENTS];
+    for (int k = 0; k < AQUA_ANOMALY_COMPONENTS; k++) {
+        int32_t acc = DOT_ROUND;
+        for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+            acc += (int32_t)m->enc[k][i] * x[i];
+        }
+        h[k] = sat8(acc >> AQUA_ANOMALY_Q);
+    }
+    int32_t score = 0;
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        int32_t acc = DOT_ROUND;
+        for (int k = 0; k < AQUA_ANOMALY_COMPONENTS; k++) {
+            acc += (int32_t)m->dec[i][k] * h[k];
+        }
+        int32_t e = x[i] - sat8(acc >> AQUA_ANOMALY_Q);
+        if (residual) residual[i] = e * e;
+        score += e * e;
+    }
+    return score;
+}
+
+#if ANOMALY_VECTOR
+// Fixed trip counts keep each row in vector registers (pmaddwd on x86,
+// smlal on NEON); |sum| <= 16 * 127 * 127 stays in int32.
+static int16_t dot_features(const int16_t *restrict w, const int16_t *restrict x) {
+    int32_t acc = 0;
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        acc += (int32_t)w[i] * x[i];
+    }
+    return (int16_t)((acc + DOT_ROUND) >> AQUA_ANOMALY_Q);
+}
+
+static int16_t dot_components(const int16_t *restrict w, const int16_t *restrict h) {
+    int32_t acc = 0;
+    for (int k = 0; k < AQUA_ANOMALY_COMPONENTS; k++) {
+        acc += (int32_t)w[k] * h[k];
+    }
+    return (int16_t)((acc + DOT_ROUND) >> AQUA_ANOMALY_Q);
+}
+#endif
+
+int32_t aqua_anomaly_score(const aqua_anomaly_model_t *m, const int16_t *x, int32_t *residual) {
+#if defined(ESP_PLATFORM) || ANOMALY_VECTOR
+    int16_t h[AQUA_ANOMALY_COMPONENTS] AQUA_ANOMALY_ALIGNED;
+    int16_t out;
+    for (int k = 0; k < AQUA_ANOMALY_COMPONENTS; k++) {
+#ifdef ESP_PLATFORM
+        dsps_dotprod_s16(m->enc[k], x, &out, AQUA_ANOMALY_FEATURES, DOT_SHIFT);
+#else
+        out = dot_features(m->enc[k], x);
+#endif
+        h[k] = sat8(out);
+    }
+    int32_t score = 0;
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+#ifdef ESP_PLATFORM
+        dsps_dotprod_s16(m->dec[i], h, &out, AQUA_ANOMALY_COMPONENTS, DOT_SHIFT);
+#else
+        out = dot_components(m->dec[i], h);
+#endif
+        int32_t e = x[i] - sat8(out);
+        if (residual) residual[i] = e * e;
+        score += e * e;
+    }
+    return score;
+#else
+    return aqua_anomaly_score_ref(m, x, residual);
+#endif
+}
+
+// ========== DETECTOR ==========
+typedef struct {
+    float avg[AQUA_MEAS_ID_COUNT];          // Recent averages, NAN until the first value
+    int above_run;                          // Samples above the threshold in a row
+    bool use_vector;
+    bool enabled;                           // The model passed its golden check
+    aqua_anomaly_result_t result;
+    aqua_alert_states_t alerts;
+} detector_t;
+
+_Static_assert(sizeof(detector_t) <= AQUA_ANOMALY_RAM_BYTES, "anomaly detector over its RAM budget");
+
+static detector_t s_det;
+static aqua_anomaly_stats_t s_stats;
+
+const aqua_anomaly_model_t *aqua_anomaly_model(void) {
+    return &aqua_anomaly_builtin;
+}
+
+const char *aqua_anomaly_backend(void) {
+    return s_det.use_vector ? ANOMALY_BACKEND : "scalar";
+}
+
+void aqua_anomaly_init(void) {
+    memset(&s_det, 0, sizeof(s_det));
+    memset(&s_stats, 0, sizeof(s_stats));
+    for (int i = 0; i < AQUA_MEAS_ID_COUNT; i++) {
+        s_det.avg[i] = NAN;
+    }
+    s_det.result.dominant = -1;
+
+    // Both paths must reproduce the scores the host computed for this model
+    const aqua_anomaly_model_t *m = &aqua_anomaly_builtin;
+    s_stats.model_ok = true;
+    s_stats.vector_ok = true;
+    for (int g = 0; g < AQUA_ANOMALY_GOLDEN; g++) {
+        const aqua_anomaly_golden_t *gold = &aqua_anomaly_golden[g];
+        s_stats.model_ok &= aqua_anomaly_score_ref(m, gold->x, NULL) == gold->score;
+        s_stats.vector_ok &= aqua_anomaly_score(m, gold->x, NULL) == gold->score;
+    }
+    s_det.enabled = s_stats.model_ok;
+    s_det.use_vector = s_stats.vector_ok;
+    if (!s_stats.model_ok) {
+        AQUA_LOG(ANOMALY_MODEL_MISMATCH);
+    } else if (!s_stats.vector_ok) {
+        AQUA_LOG(ANOMALY_VECTOR_MISMATCH, ANOMALY_BACKEND);
+    } else {
+        AQUA_LOG(ANOMALY_READY, ANOMALY_BACKEND, m->components, (int)m->threshold);
+    }
+}
+
+// Share of the residual per measurement, and the suspect or event bits
+static void attribute(const aqua_reading_t *r, const int32_t *residual, aqua_anomaly_result_t *res) {
+    int32_t per[AQUA_MEAS_ID_COUNT];
+    int32_t total = 0;
+    res->dominant = -1;
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        per[id] = residual[AQUA_ANOMALY_VALUE(id)] + residual[AQUA_ANOMALY_DELTA(id)];
+        total += per[id];
+        if (res->dominant < 0 || per[id] > per[res->dominant]) {
+            res->dominant = id;
+        }
+    }
+    res->share_pct = total > 0 ? (int)((int64_t)per[res->dominant] * 100 / total) : 0;
+    res->event = 0;
+    res->suspect = 0;
+    if (!res->above) {
+        return;
+    }
+
+    const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)res->dominant);
+    bool degraded = m && r->has_health && r->health[m->sensor] < HEALTH_DEGRADED_BELOW;
+    if (res->share_pct >= ANOMALY_PROBE_SHARE_PCT || degraded) {
+        res->suspect = AQUA_ALERT_BIT(res->dominant);
+        return;
+    }
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        if ((int64_t)per[id] * 100 >= (int64_t)ANOMALY_EVENT_SHARE_PCT * total) {
+            res->event |= AQUA_ALERT_BIT(id);
+        }
+    }
+}
+
+const aqua_anomaly_result_t *aqua_anomaly_observe(const aqua_reading_t *r) {
+    aqua_anomaly_result_t *res = &s_det.result;
+    if (!s_det.enabled) {
+        return res;
+    }
+
+    float features[AQUA_ANOMALY_FEATURES];
+    int16_t x[AQUA_ANOMALY_FEATURES] AQUA_ANOMALY_ALIGNED;
+    int32_t residual[AQUA_ANOMALY_FEATURES];
+    aqua_anomaly_features(r, s_det.avg, features);
+    aqua_anomaly_quantize(&aqua_anomaly_builtin, features, x);
+    res->score = s_det.use_vector ? aqua_anomaly_score(&aqua_anomaly_builtin, x, residual)
+                                  : aqua_anomaly_score_ref(&aqua_anomaly_builtin, x, residual);
+
+    // Missing features are left out rather than scored at the mean
+    uint32_t mask = present(&aqua_anomaly_builtin, features);
+    for (int i = 0; i < AQUA_ANOMALY_FEATURES; i++) {
+        if (!(mask & (1u << i))) {
+            res->score -= residual[i];
+            residual[i] = 0;
+        }
+    }
+    aqua_anomaly_average(r, s_det.avg);
+
+    s_stats.samples++;
+    res->above = res->score > aqua_anomaly_builtin.threshold;
+    s_det.above_run = res->above ? s_det.above_run + 1 : 0;
+    attribute(r, residual, res);
+    if (res->above) {
+        s_stats.above++;
+    }
+
+    bool was_raised = res->raised;
+    res->raised = s_det.above_run >= ANOMALY_CONFIRM_SAMPLES;
+    const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)res->dominant);
+    const char *name = m ? m->key : "?";
+    if (res->raised && !was_raised) {
+        s_stats.raised++;
+        if (res->suspect) {
+            AQUA_LOG(ANOMALY_PROBE, (int)res->score, (int)aqua_anomaly_builtin.threshold, name);
+        } else {
+            AQUA_LOG(ANOMALY_EVENT, (int)res->score, (int)aqua_anomaly_builtin.threshold, name);
+        }
+    } else if (!res->raised && was_raised) {
+        AQUA_LOG(ANOMALY_CLEARED, (int)res->score);
+    }
+
+    s_det.alerts.anomaly = res->raised ? res->event : 0;
+    s_det.alerts.suspect = res->raised ? res->suspect : 0;
+    return res;
+}
+
+const aqua_anomaly_result_t *aqua_anomaly_result(void) {
+    return &s_det.result;
+}
+
+const aqua_alert_states_t *aqua_anomaly_alerts(void) {
+    return &s_det.alerts;
+}
+
+const aqua_anomaly_stats_t *aqua_anomaly_get_stats(void) {
+    return &s_stats;
+}
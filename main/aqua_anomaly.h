@@ -0,0 +1,151 @@
+#ifndef AQUA_ANOMALY_H
+#define AQUA_ANOMALY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_registry.h"
+
+// Multi-sensor anomaly detector (ANOMALY in aqua_config.h).
+//
+// Every sample becomes a feature vector: each measurement's value and its
+// departure from its recent average, standardised and quantised to int8. A
+// PCA model of normal pond water (main/aqua_anomaly_model.h, trained by
+// host/tools/aqua_anomaly_train) projects the vector onto its main
+// components and back; the squared residual is the anomaly score. Values
+// that are each within their limits but do not occur together in normal
+// water, such as warm water with falling oxygen and rising ammonia at high
+// pH, leave a large residual that fixed thresholds never see.
+//
+// The residual also points at a cause. When most of it sits on one
+// measurement, or that probe's health score is degraded, the probe is
+// suspect; otherwise the measurements carrying it are reported as a water
+// event.
+//
+// Inference is int8 x int8 products summed in int32, with rounding shifts
+// between the layers, so every build gives the same score bit for bit. There
+// are two implementations: a scalar reference and a vectorised one. On the
+// ESP32-S3 the vectorised one is esp-dsp's dsps_dotprod_s16 on the PIE SIMD
+// unit (int8 values in 16-bit lanes); on the host it is a fixed-length kernel
+// the compiler vectorises. aqua_anomaly_init() checks both against the
+// golden scores exported with the model and keeps the scalar path if the
+// vectorised one disagrees.
+
+#define AQUA_ANOMALY_FEATURES 16        // Two per measurement, padded for the dot products
+#define AQUA_ANOMALY_COMPONENTS 8       // Model components at most (unused ones are zero)
+#define AQUA_ANOMALY_Q 7                // Weights are Q7: 127 = 1.0
+#define AQUA_ANOMALY_GOLDEN 8           // Check vectors exported with a model
+#define AQUA_ANOMALY_RAM_BYTES 256      // Detector state budget, model and code excluded
+
+// Feature index of a measurement's value and of its departure from the average
+#define AQUA_ANOMALY_VALUE(id) (id)
+#define AQUA_ANOMALY_DELTA(id) (AQUA_MEAS_ID_COUNT + (id))
+
+#define AQUA_ANOMALY_ALIGNED __attribute__((aligned(16)))
+
+typedef struct {
+    float mean[AQUA_ANOMALY_FEATURES];      // Feature units
+    float scale[AQUA_ANOMALY_FEATURES];     // int8 steps per unit; 0 leaves the feature out
+    // Components as rows, and the same transposed, for the two dot-product passes
+    int16_t enc[AQUA_ANOMALY_COMPONENTS][AQUA_ANOMALY_FEATURES] AQUA_ANOMALY_ALIGNED;
+    int16_t dec[AQUA_ANOMALY_FEATURES][AQUA_ANOMALY_COMPONENTS] AQUA_ANOMALY_ALIGNED;
+    int components;
+    int32_t threshold;                      // Scores above it are anomalous
+} aqua_anomaly_model_t;
+
+typedef struct {
+    int16_t x[AQUA_ANOMALY_FEATURES] AQUA_ANOMALY_ALIGNED;  // Quantised features
+    int32_t score;                          // Reference score
+} aqua_anomaly_golden_t;
+
+typedef struct {
+    int32_t score;
+    bool above;                             // score > threshold on this sample
+    bool raised;                            // Above for ANOMALY_CONFIRM_SAMPLES samples in a row
+    int dominant;                           // aqua_measure_id_t carrying most of the residual, -1 if none
+    int share_pct;                          // Its share of the residual
+    uint32_t event;                         // AQUA_ALERT_BIT()s of measurements in a water event
+    uint32_t suspect;                       // ... and of a suspect probe
+} aqua_anomaly_result_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t above;                         // Samples above the threshold
+    uint32_t raised;                        // Times the flag went up
+    bool vector_ok;                         // Vectorised path matched the golden scores at init
+    bool model_ok;                          // Reference path matched them too
+} aqua_anomaly_stats_t;
+
+// ========== FEATURES ==========
+
+/**
+ * @brief Feature vector of a sample
+ * @param avg Recent average per aqua_measure_id_t, NAN where unknown
+ * @param out NAN where the value is missing
+ */
+void aqua_anomaly_features(const aqua_reading_t *r, const float *avg, float *out);
+
+/**
+ * @brief Fold a sample into the recent averages (ANOMALY_EMA_SAMPLES)
+ */
+void aqua_anomaly_average(const aqua_reading_t *r, float *avg);
+
+/**
+ * @brief Standardise and quantise; missing features become 0 (the mean)
+ */
+void aqua_anomaly_quantize(const aqua_anomaly_model_t *m, const float *features, int16_t *x);
+
+// ========== INFERENCE ==========
+
+/**
+ * @brief Anomaly score, scalar reference
+ *
+ * h[k] = sat8((sum of enc[k][i] * x[i] + 127) >> 7), then
+ * r[i] = sat8((sum of dec[i][k] * h[k] + 127) >> 7), and the score is the
+ * sum of (x[i] - r[i])^2 (the rounding esp-dsp uses at shift 8).
+ * @param residual Optional; (x[i] - r[i])^2 per feature
+ */
+int32_t aqua_anomaly_score_ref(const aqua_anomaly_model_t *m, const int16_t *x, int32_t *residual);
+
+/**
+ * @brief Same as aqua_anomaly_score_ref() on the vectorised path
+ * @param x Must be AQUA_ANOMALY_ALIGNED
+ */
+int32_t aqua_anomaly_score(const aqua_anomaly_model_t *m, const int16_t *x, int32_t *residual);
+
+/**
+ * @brief Name of the path in use: "esp-dsp", "vector" or "scalar"
+ */
+const char *aqua_anomaly_backend(void);
+
+// ========== DETECTOR ==========
+
+/**
+ * @brief Check the built-in model against its golden scores and clear the state
+ */
+void aqua_anomaly_init(void);
+
+/**
+ * @brief Score one sample and update the flags
+ */
+const aqua_anomaly_result_t *aqua_anomaly_observe(const aqua_reading_t *r);
+
+/**
+ * @brief Result for the last sample
+ */
+const aqua_anomaly_result_t *aqua_anomaly_result(void);
+
+/**
+ * @brief Alert states for the last sample: anomaly and suspect bits while raised
+ */
+const aqua_alert_states_t *aqua_anomaly_alerts(void);
+
+/**
+ * @brief The model built into the firmware
+ */
+const aqua_anomaly_model_t *aqua_anomaly_model(void);
+
+const aqua_anomaly_stats_t *aqua_anomaly_get_stats(void);
+
+#endif // AQUA_ANOMALY_H
@@ -0,0 +1,66 @@
+#ifndef AQUA_ANOMALY_MODEL_H
+#define AQUA_ANOMALY_MODEL_H
+
+#include "aqua_anomaly.h"
+
+// Generated by host/tools/aqua_anomaly_train from 14 days of the pond model (120930 vectors).
+// 4 components keep 90.4% of the variance.
+// Do not edit; rebuild the host "anomaly_model" target instead.
+
+static const aqua_anomaly_model_t aqua_anomaly_builtin = {
+    .mean = {
+        28.0828381f, 74.8860397f, 27.054966f, 7.47731304f,
+        6.924541f, 9.35827732f, 0.195273891f, -0.000181829426f,
+        9.05173729e-05f, -0.000132964662f, 2.72569241e-06f, 3.29015784e-05f,
+        2.17852157e-05f, 3.48888034e-06f, 0.0f, 0.0f
+    },
+    .scale = {
+        8.42492294f, 2.97568512f, 28.517067f, 102.233307f,
+        33.2894592f, 16.6924629f, 832.021606f, 33.6996918f,
+        11.9027405f, 114.068268f, 408.933228f, 133.157837f,
+        66.7698517f, 3328.08643f, 0.0f, 0.0f
+    },
+    .enc = {
+        {  53, -52,  45,  52,  51,  49,  34,   0,   0,   1,   1,   0,   2,   7,   0,   0},
+        {  -8,   7,  -8,  -8,  -8,  -1,  34,   0,   0,   0,   0,   0,   2, 122,   0,   0},
+        { -16,  12, -23, -13, -13,  48,  42,   0,   0,   0,  -1,   0, 103, -18,   0,   0},
+        { -18,  17, -20, -15, -17,  35,  88,  -2,   3,  -1,  -3,  -3, -71, -28,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0},
+    },
+    .dec = {
+        {  53,  -8, -16, -18,   0,   0,   0,   0},
+        { -52,   7,  12,  17,   0,   0,   0,   0},
+        {  45,  -8, -23, -20,   0,   0,   0,   0},
+        {  52,  -8, -13, -15,   0,   0,   0,   0},
+        {  51,  -8, -13, -17,   0,   0,   0,   0},
+        {  49,  -1,  48,  35,   0,   0,   0,   0},
+        {  34,  34,  42,  88,   0,   0,   0,   0},
+        {   0,   0,   0,  -2,   0,   0,   0,   0},
+        {   0,   0,   0,   3,   0,   0,   0,   0},
+        {   1,   0,   0,  -1,   0,   0,   0,   0},
+        {   1,   0,  -1,  -3,   0,   0,   0,   0},
+        {   0,   0,   0,  -3,   0,   0,   0,   0},
+        {   2,   2, 103, -71,   0,   0,   0,   0},
+        {   7, 122, -18, -28,   0,   0,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0},
+        {   0,   0,   0,   0,   0,   0,   0,   0},
+    },
+    .components = 4,
+    .threshold = 6563,
+};
+
+static const aqua_anomaly_golden_t aqua_anomaly_golden[AQUA_ANOMALY_GOLDEN] = {
+    { { -31,  33, -21, -19, -21, -20, -20,  -6,  -2,  -8,   9,   2,  -3, -39,   0,   0}, 317 },
+    { { -39,  39, -32, -48, -39, -52, -33,   7, -10,  -9, -16,  20, -22, -13,   0,   0}, 997 },
+    { { -35,  18, -68, -13, -14, -42,  -6,  -1, -13, -14,  32,  -5, -30, 112,   0,   0}, 4153 },
+    { {  16, -22, -10,  21,  26,  43,  38,  -2,  15,   0,   1,   7,  62,  61,   0,   0}, 806 },
+    { {  40, -41,  23,  51,  52,  14,  -7,  15,  -3,  19,  14,   0,   1,  59,   0,   0}, 1191 },
+    { {  -8,  -4, -27,  16,  30,  42,  58, -14,   0,  -3, -22,  13,  19,  67,   0,   0}, 2479 },
+    { {  46, -46,  80,  46, -33,  20, 127,   5,   0,  75,   2,-127,  15, 127,   0,   0}, 32430 },
+    { {  46, -46,  38, -56,  50,  20, -19,   5,   0,   1,-127,  18,  15,  -7,   0,   0}, 25367 },
+};
+
+#endif // AQUA_ANOMALY_MODEL_H
@@ -0,0 +1,871 @@
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aqua_core.h"
+#include "aqua_config.h"
+#include "aqua_registry.h"
+
+// DS18B20 CRC lookup table
+static const uint8_t ds18b20_crc_table[256] = {
+    0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
+    0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
+    0x9D, 0xC3, 0x21, 0x7F, 0xFC, 0xA2, 0x40, 0x1E,
+    0x5F, 0x01, 0xE3, 0xBD, 0x3E, 0x60, 0x82, 0xDC,
+    0x23, 0x7D, 0x9F, 0xC1, 0x42, 0x1C, 0xFE, 0xA0,
+    0xE1, 0xBF, 0x5D, 0x03, 0x80, 0xDE, 0x3C, 0x62,
+    0xBE, 0xE0, 0x02, 0x5C, 0xDF, 0x81, 0x63, 0x3D,
+    0x7C, 0x22, 0xC0, 0x9E, 0x1D, 0x43, 0xA1, 0xFF,
+    0x46, 0x18, 0xFA, 0xA4, 0x27, 0x79, 0x9B, 0xC5,
+    0x84, 0xDA, 0x38, 0x66, 0xE5, 0xBB, 0x59, 0x07,
+    0xDB, 0x85, 0x67, 0x39, 0xBA, 0xE4, 0x06, 0x58,
+    0x19, 0x47, 0xA5, 0xFB, 0x78, 0x26, 0xC4, 0x9A,
+    0x65, 0x3B, 0xD9, 0x87, 0x04, 0x5A, 0xB8, 0xE6,
+    0xA7, 0xF9, 0x1B, 0x45, 0xC6, 0x98, 0x7A, 0x24,
+    0xF8, 0xA6, 0x44, 0x1A, 0x99, 0xC7, 0x25, 0x7B,
+    0x3A, 0x64, 0x86, 0xD8, 0x5B, 0x05, 0xE7, 0xB9,
+    0x8C, 0xD2, 0x30, 0x6E, 0xED, 0xB3, 0x51, 0x0F,
+    0x4E, 0x10, 0xF2, 0xAC, 0x2F, 0x71, 0x93, 0xCD,
+    0x11, 0x4F, 0xAD, 0xF3, 0x70, 0x2E, 0xCC, 0x92,
+    0xD3, 0x8D, 0x6F, 0x31, 0xB2, 0xEC, 0x0E, 0x50,
+    0xAF, 0xF1, 0x13, 0x4D, 0xCE, 0x90, 0x72, 0x2C,
+    0x6D, 0x33, 0xD1, 0x8F, 0x0C, 0x52, 0xB0, 0xEE,
+    0x32, 0x6C, 0x8E, 0xD0, 0x53, 0x0D, 0xEF, 0xB1,
+    0xF0, 0xAE, 0x4C, 0x12, 0x91, 0xCF, 0x2D, 0x73,
+    0xCA, 0x94, 0x76, 0x28, 0xAB, 0xF5, 0x17, 0x49,
+    0x08, 0x56, 0xB4, 0xEA, 0x69, 0x37, 0xD5, 0x8B,
+    0x57, 0x09, 0xEB, 0xB5, 0x36, 0x68, 0x8A, 0xD4,
+    0x95, 0xCB, 0x29, 0x77, 0xF4, 0xAA, 0x48, 0x16,
+    0xE9, 0xB7, 0x55, 0x0B, 0x88, 0xD6, 0x34, 0x6A,
+    0x2B, 0x75, 0x97, 0xC9, 0x4A, 0x14, 0xF6, 0xA8,
+    0x74, 0x2A, 0xC8, 0x96, 0x15, 0x4B, 0xA9, 0xF7,
+    0xB6, 0xE8, 0x0A, 0x54, 0xD7, 0x89, 0x6B, 0x35
+};
+
+// ========== CONVERSIONS ==========
+uint8_t aqua_crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = ds18b20_crc_table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+uint32_t aqua_crc32(uint32_t crc, const void *data, size_t len) {
+    // Nibble table: 64 bytes of flash, fast enough to check a whole app image
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ p[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (p[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+int aqua_average_mv(const int *samples, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+    int sum_mv = 0;
+    for (int i = 0; i < count; i++) {
+        sum_mv += samples[i];
+    }
+    return sum_mv / count;
+}
+
+float aqua_mv_to_ph(float avg_mv) {
+    // pH calculation (adjust these values based on calibration)
+    float ph = 7.0f + ((2500.0f - avg_mv) / 180.0f);
+    return (ph >= 0.0f && ph <= 14.0f) ? ph : -1.0f;
+}
+
+float aqua_mv_to_do(float avg_mv) {
+    // DO calculation (adjust calibration values)
+    float do_value = avg_mv * 0.2f; // Convert mV to mg/L (adjust factor based on calibration)
+    return (do_value >= 0.0f && do_value <= 20.0f) ? do_value : -1.0f;
+}
+
+float aqua_mv_to_turbidity(float avg_mv) {
+    // Turbidity calculation (adjust calibration values)
+    float ntu = avg_mv * 0.5f; // Convert mV to NTU (adjust factor based on calibration)
+    return (ntu >= 0.0f && ntu <= 1000.0f) ? ntu : -1.0f;
+}
+
+float aqua_mv_to_ammonia(float avg_mv) {
+    // Ammonia calculation (adjust calibration values)
+    float nh3 = avg_mv * 0.1f; // Convert mV to mg/L (adjust factor based on calibration)
+    return (nh3 >= 0.0f && nh3 <= 10.0f) ? nh3 : -1.0f;
+}
+
+float aqua_ds18b20_raw_to_c(const uint8_t *scratchpad) {
+    int16_t raw_temp = (int16_t)((scratchpad[1] << 8) | scratchpad[0]);
+    return raw_temp / 16.0f;
+}
+
+esp_err_t aqua_dht22_decode(const uint8_t data[5], float *hum, float *temp) {
+    // Verify checksum
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    *hum = ((data[0] << 8) + data[1]) / 10.0f;
+    *temp = ((data[2] << 8) + data[3]) / 10.0f;
+
+    // Validate readings
+    if (*temp < -40.0f || *temp > 80.0f || *hum < 0.0f || *hum > 100.0f) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+// Pulse tolerances: the datasheet values with room for a slow or fast sensor
+// clock, and a dead band between 0 and 1 so an ambiguous bit fails the frame
+#define DHT_RESPONSE_MIN_US 60      // 80 µs low, then 80 µs high
+#define DHT_RESPONSE_MAX_US 110
+#define DHT_BIT_LOW_MIN_US 35       // 50 µs
+#define DHT_BIT_LOW_MAX_US 75
+#define DHT_ZERO_MIN_US 10          // 26-28 µs
+#define DHT_ZERO_MAX_US 45
+#define DHT_ONE_MIN_US 55           // 70 µs
+#define DHT_ONE_MAX_US 95
+
+static bool within(uint16_t us, int min, int max) {
+    return us >= min && us <= max;
+}
+
+esp_err_t aqua_dht22_decode_pulses(const uint16_t *durations, size_t count, uint8_t data[5]) {
+    size_t i = 0;
+    while (i + 1 < count && !(within(durations[i], DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US) &&
+                              within(durations[i + 1], DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US))) {
+        i += 2;     // Lows sit at even indices
+    }
+    if (i + 1 >= count) {
+        return ESP_ERR_TIMEOUT;
+    }
+    i += 2;
+    if (count - i < 80) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(data, 0, 5);
+    for (int bit = 0; bit < 40; bit++, i += 2) {
+        uint16_t low = durations[i];
+        uint16_t high = durations[i + 1];
+        if (!within(low, DHT_BIT_LOW_MIN_US, DHT_BIT_LOW_MAX_US)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (within(high, DHT_ONE_MIN_US, DHT_ONE_MAX_US)) {
+            data[bit / 8] |= (uint8_t)(0x80 >> (bit % 8));
+        } else if (!within(high, DHT_ZERO_MIN_US, DHT_ZERO_MAX_US)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+// ========== PAYLOADS ==========
+const char *aqua_sensor_name(aqua_sensor_t sensor) {
+    static const char *const names[AQUA_SENSOR_COUNT] = {
+        [AQUA_SENSOR_DHT22] = "dht22",
+        [AQUA_SENSOR_DS18B20] = "ds18b20",
+        [AQUA_SENSOR_PH] = "ph",
+        [AQUA_SENSOR_DO] = "dissolved_oxygen",
+        [AQUA_SENSOR_TURBIDITY] = "turbidity",
+        [AQUA_SENSOR_AMMONIA] = "ammonia",
+    };
+    return (unsigned)sensor < AQUA_SENSOR_COUNT ? names[sensor] : "unknown";
+}
+
+const char *aqua_actuator_name(aqua_actuator_t act) {
+    static const char *const names[AQUA_ACT_COUNT] = {
+        [AQUA_ACT_PH_RELAY] = "ph_relay",
+        [AQUA_ACT_AERATOR] = "aerator",
+        [AQUA_ACT_FILTER] = "filter",
+        [AQUA_ACT_PUMP] = "pump",
+    };
+    return (unsigned)act < AQUA_ACT_COUNT ? names[act] : "unknown";
+}
+
+const char *aqua_flow_fault_name(aqua_flow_fault_t fault) {
+    switch (fault) {
+    case AQUA_FLOW_NONE: return "no_flow";
+    case AQUA_FLOW_UNCOMMANDED: return "flow_while_off";
+    default: return "ok";
+    }
+}
+
+const char *aqua_time_quality_name(aqua_time_quality_t quality) {
+    switch (quality) {
+    case AQUA_TIME_SYNCED: return "synced";
+    case AQUA_TIME_HOLDOVER: return "holdover";
+    case AQUA_TIME_PRESYNC: return "presync";
+    default: return "unsynced";
+    }
+}
+
+int aqua_format_utc(int64_t unix_us, char *buf, size_t size) {
+    time_t secs = (time_t)(unix_us / 1000000);
+    long frac = (long)(unix_us % 1000000);
+    if (frac < 0) {
+        secs--;
+        frac += 1000000;
+    }
+
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    int n = snprintf(buf, size, "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec, frac);
+    return (n < 0 || (size_t)n >= size) ? -1 : n;
+}
+
+void aqua_reading_clear(aqua_reading_t *r) {
+    *r = (aqua_reading_t){
+        .air_temp = AQUA_SENSOR_ERROR, .humidity = AQUA_SENSOR_ERROR,
+        .water_temp = AQUA_SENSOR_ERROR, .ph = AQUA_SENSOR_ERROR,
+        .do_level = AQUA_SENSOR_ERROR, .turbidity = AQUA_SENSOR_ERROR,
+        .ammonia = AQUA_SENSOR_ERROR,
+    };
+}
+
+bool aqua_validate_reading(const aqua_reading_t *r) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        // -999.0f marks a missing sensor, not a bad value
+        if (v != AQUA_SENSOR_ERROR && (v < m->valid_min || v > m->valid_max)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int aqua_count_missing_critical(const aqua_reading_t *r) {
+    int missing_sensors = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if ((m->flags & AQUA_MEAS_CRITICAL) && aqua_measure_value(m, r) == AQUA_SENSOR_ERROR) {
+            missing_sensors++;
+        }
+    }
+    return missing_sensors;
+}
+
+int aqua_count_critical(void) {
+    int critical = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        if (aqua_measures[i].flags & AQUA_MEAS_CRITICAL) critical++;
+    }
+    return critical;
+}
+
+// Append formatted text at *len; *len becomes -1 once the buffer overflows
+static bool append(char *buf, size_t size, int *len, const char *fmt, ...) {
+    if (*len < 0 || (size_t)*len >= size) {
+        *len = -1;
+        return false;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - *len) {
+        *len = -1;
+        return false;
+    }
+    *len += n;
+    return true;
+}
+
+static const char *json_bool(bool v) {
+    return v ? "true" : "false";
+}
+
+int aqua_build_payload(const aqua_reading_t *r, const aqua_controls_t *c,
+                       char *buf, size_t size) {
+    int len = 0;
+    const char *sep = "";
+
+    // Sensors that are not connected are left out, except the always-sent ones
+    append(buf, size, &len, "{");
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        if (v != AQUA_SENSOR_ERROR || (m->flags & AQUA_MEAS_ALWAYS_SENT)) {
+            append(buf, size, &len, "%s\"%s\":%.2f", sep, m->key, v);
+            sep = ",";
+        }
+    }
+
+    // Always include control states
+    append(buf, size, &len, "%s\"ph_relay\":%s,\"aerator\":%s,\"filter\":%s,\"pump\":%s", sep,
+           json_bool(c->ph_relay), json_bool(c->aerator),
+           json_bool(c->filter), json_bool(c->pump));
+
+    if (r->seq != 0) {
+        append(buf, size, &len, ",\"device_id\":\"%s\",\"seq\":%lu", AQUA_DEVICE_ID, (unsigned long)r->seq);
+    }
+
+    // Sample time: uptime alone lets the server place rows sent before the first sync
+    if (r->has_time) {
+        append(buf, size, &len, ",\"uptime_us\":%lld", (long long)r->sampled_us);
+        if (r->time.quality != AQUA_TIME_UNSYNCED) {
+            char utc[32];
+            aqua_format_utc(r->time.unix_us, utc, sizeof(utc));
+            append(buf, size, &len, ",\"sampled_at\":\"%s\",\"time_error_ms\":%lu", utc,
+                   (unsigned long)r->time.error_ms);
+        }
+        append(buf, size, &len, ",\"time_quality\":\"%s\"", aqua_time_quality_name(r->time.quality));
+    }
+
+    if (r->has_health) {
+        sep = ",\"sensor_health\":{";
+        for (int i = 0; i < AQUA_SENSOR_COUNT; i++) {
+            if (!aqua_sensor_fitted((aqua_sensor_t)i)) continue;
+            append(buf, size, &len, "%s\"%s\":%d", sep, aqua_sensor_name((aqua_sensor_t)i), r->health[i]);
+            sep = ",";
+        }
+        append(buf, size, &len, "}");
+    }
+
+    if (r->has_actuators) {
+        sep = ",\"actuators\":{";
+        for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+            const aqua_actuator_sample_t *a = &r->actuators[i];
+            append(buf, size, &len, "%s\"%s\":{\"on_s\":%lu,\"wh\":%.1f", sep,
+                   aqua_actuator_name((aqua_actuator_t)i), (unsigned long)a->on_s, a->energy_wh);
+            if (a->metered) {
+                append(buf, size, &len, ",\"l\":%.1f,\"lpm\":%.2f", a->litres, a->flow_lpm);
+            }
+            if (a->fault != AQUA_FLOW_OK) {
+                append(buf, size, &len, ",\"fault\":\"%s\"", aqua_flow_fault_name(a->fault));
+            }
+            append(buf, size, &len, "}");
+            sep = ",";
+        }
+        append(buf, size, &len, "}");
+    }
+    append(buf, size, &len, "}");
+    return len;
+}
+
+int aqua_build_upload_columns(char *buf, size_t size) {
+    int len = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        append(buf, size, &len, "%s,", aqua_measures[i].key);
+    }
+    append(buf, size, &len, "ph_relay,aerator,filter,pump,device_id,seq,uptime_us,sampled_at,"
+           "time_error_ms,time_quality,sensor_health,actuators");
+    return len;
+}
+
+int aqua_build_exchange_payload(const aqua_reading_t *r, const aqua_controls_t *c,
+                                int32_t last_command_id, char *buf, size_t size) {
+    static const char prefix[] = "{\"reading\":";
+    int len = (int)sizeof(prefix) - 1;
+
+    if (size <= (size_t)len) return -1;
+    memcpy(buf, prefix, (size_t)len);
+    int row = aqua_build_payload(r, c, buf + len, size - (size_t)len);
+    if (row < 0) return -1;
+    len += row;
+    append(buf, size, &len, ",\"last_command_id\":%ld}", (long)last_command_id);
+    return len;
+}
+
+// ========== ALERTS ==========
+void aqua_eval_alerts(const aqua_reading_t *r, const aqua_params_t *p, aqua_alert_states_t *out) {
+    out->low = 0;
+    out->high = 0;
+    out->anomaly = 0;
+    out->suspect = 0;
+    out->no_flow = 0;
+    out->flow_while_off = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        // A probe that did not read is reported by sensor health, not as a low value
+        if (v == AQUA_SENSOR_ERROR) {
+            continue;
+        }
+        if (m->alert_min != AQUA_NO_LIMIT && v < aqua_measure_limit(m->alert_min, p)) {
+            out->low |= AQUA_ALERT_BIT(m->id);
+        }
+        if (m->alert_max != AQUA_NO_LIMIT && v > aqua_measure_limit(m->alert_max, p)) {
+            out->high |= AQUA_ALERT_BIT(m->id);
+        }
+    }
+}
+
+bool aqua_alerts_changed(const aqua_alert_states_t *last, const aqua_alert_states_t *current) {
+    return last->low != current->low || last->high != current->high ||
+           last->anomaly != current->anomaly || last->suspect != current->suspect ||
+           last->no_flow != current->no_flow || last->flow_while_off != current->flow_while_off;
+}
+
+// Measurement keys of the set bits, as a JSON list body
+static void append_keys(char *buf, size_t size, int *len, uint32_t bits) {
+    const char *sep = "";
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        if (bits & AQUA_ALERT_BIT(aqua_measures[i].id)) {
+            append(buf, size, len, "%s\"%s\"", sep, aqua_measures[i].key);
+            sep = ",";
+        }
+    }
+}
+
+// Actuator keys of the set bits, as a JSON list body
+static void append_actuators(char *buf, size_t size, int *len, uint32_t bits) {
+    const char *sep = "";
+    for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+        if (bits & AQUA_ALERT_BIT(i)) {
+            append(buf, size, len, "%s\"%s\"", sep, aqua_actuator_name((aqua_actuator_t)i));
+            sep = ",";
+        }
+    }
+}
+
+int aqua_build_alert_payload(const aqua_alert_states_t *a, const aqua_reading_t *r,
+                             char *buf, size_t size) {
+    int len = 0;
+
+    // Alert flags: high_<name> and/or low_<name> for every measurement with limits
+    append(buf, size, &len, "{\"type\":\"alert\",\"alerts\":{");
+    const char *sep = "";
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if (m->alert_max != AQUA_NO_LIMIT) {
+            append(buf, size, &len, "%s\"high_%s\":%s", sep, m->alert_name,
+                   json_bool(a->high & AQUA_ALERT_BIT(m->id)));
+            sep = ",";
+        }
+        if (m->alert_min != AQUA_NO_LIMIT) {
+            append(buf, size, &len, "%s\"low_%s\":%s", sep, m->alert_name,
+                   json_bool(a->low & AQUA_ALERT_BIT(m->id)));
+            sep = ",";
+        }
+    }
+    // Anomaly detector findings, only while it reports some
+    if (a->anomaly) {
+        append(buf, size, &len, "%s\"anomaly\":[", sep);
+        append_keys(buf, size, &len, a->anomaly);
+        append(buf, size, &len, "]");
+        sep = ",";
+    }
+    if (a->suspect) {
+        append(buf, size, &len, "%s\"suspect_probe\":[", sep);
+        append_keys(buf, size, &len, a->suspect);
+        append(buf, size, &len, "]");
+        sep = ",";
+    }
+    // Outputs whose flow disagrees with their commanded state (aqua_meter.h)
+    if (a->no_flow) {
+        append(buf, size, &len, "%s\"no_flow\":[", sep);
+        append_actuators(buf, size, &len, a->no_flow);
+        append(buf, size, &len, "]");
+        sep = ",";
+    }
+    if (a->flow_while_off) {
+        append(buf, size, &len, "%s\"flow_while_off\":[", sep);
+        append_actuators(buf, size, &len, a->flow_while_off);
+        append(buf, size, &len, "]");
+    }
+    append(buf, size, &len, "}");
+
+    // Sensor values
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if (m->alert_key) {
+            append(buf, size, &len, ",\"%s\":%.2f", m->alert_key, aqua_measure_value(m, r));
+        }
+    }
+    append(buf, size, &len, "}");
+    return len;
+}
+
+// ========== CONTROL ==========
+void aqua_decide_controls(const aqua_reading_t *r, const aqua_params_t *p, aqua_controls_t *out) {
+    out->ph_relay = (r->ph < p->ph_relay_on_below);          // Activate if pH is too low
+    out->aerator = (r->do_level < p->aerator_on_below);      // Activate if DO is too low
+    out->filter = (r->turbidity > p->filter_on_above);       // Activate if water is too turbid
+    out->pump = (r->ammonia > p->pump_on_above);             // Activate if ammonia is too high
+}
+
+// ========== RELAY COMMANDS ==========
+// Minimal JSON scanner for the relay_commands response. Only the shape that
+// PostgREST returns is needed: an array of flat objects.
+
+static const char *skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+// Parse a string starting at '"'; copies up to out_size-1 chars (out may be
+// NULL) and sets *len (if given) to the length of the whole string
+static const char *parse_string_len(const char *p, char *out, size_t out_size, size_t *len) {
+    size_t n = 0, total = 0;
+    if (*p != '"') return NULL;
+    p++;
+    while (*p && *p != '"') {
+        char ch = *p;
+        if (ch == '\\') {
+            p++;
+            if (!*p) return NULL;
+            ch = *p;
+            if (ch == 'u') {
+                // Non-ASCII escapes never appear in relay names; keep a placeholder
+                for (int i = 0; i < 4; i++) {
+                    if (!p[1]) return NULL;
+                    p++;
+                }
+                ch = '?';
+            } else if (ch == 'n') {
+                ch = '\n';
+            } else if (ch == 't') {
+                ch = '\t';
+            }
+        }
+        if (out && n + 1 < out_size) out[n++] = ch;
+        total++;
+        p++;
+    }
+    if (*p != '"') return NULL;
+    if (out && out_size > 0) out[n] = '\0';
+    if (len) *len = total;
+    return p + 1;
+}
+
+static const char *parse_string(const char *p, char *out, size_t out_size) {
+    return parse_string_len(p, out, out_size, NULL);
+}
+
+// Skip any JSON value; reports booleans through *bool_out (-1 if not a bool)
+static const char *skip_value(const char *p, int *bool_out) {
+    if (bool_out) *bool_out = -1;
+    p = skip_ws(p);
+    if (*p == '"') return parse_string(p, NULL, 0);
+    if (strncmp(p, "true", 4) == 0) {
+        if (bool_out) *bool_out = 1;
+        return p + 4;
+    }
+    if (strncmp(p, "false", 5) == 0) {
+        if (bool_out) *bool_out = 0;
+        return p + 5;
+    }
+    if (strncmp(p, "null", 4) == 0) return p + 4;
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (*p) {
+            if (*p == '"') {
+                p = parse_string(p, NULL, 0);
+                if (!p) return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            if (*p == '}' || *p == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+    if (*p == '-' || (*p >= '0' && *p <= '9')) {
+        while (*p && strchr("+-.eE0123456789", *p)) p++;
+        return p;
+    }
+    return NULL;
+}
+
+int aqua_parse_relay_commands_after(const char *json, int32_t after_id,
+                                    aqua_relay_cmd_cb_t cb, void *ctx, int32_t *max_id) {
+    const char *p = skip_ws(json);
+    int delivered = 0;
+
+    if (*p != '[') return -1;
+    p = skip_ws(p + 1);
+    if (*p == ']') return 0;
+
+    while (*p) {
+        p = skip_ws(p);
+        if (*p != '{') {
+            // Not an object - skip it
+            p = skip_value(p, NULL);
+            if (!p) return -1;
+        } else {
+            char relay_type[32] = {0};
+            bool have_type = false;
+            int state = -1;
+            long id = -1;
+
+            p = skip_ws(p + 1);
+            while (*p && *p != '}') {
+                char key[32];
+                p = parse_string(p, key, sizeof(key));
+                if (!p) return -1;
+                p = skip_ws(p);
+                if (*p != ':') return -1;
+                p = skip_ws(p + 1);
+
+                if (strcmp(key, "relay_type") == 0 && *p == '"') {
+                    p = parse_string(p, relay_type, sizeof(relay_type));
+                    have_type = (p != NULL);
+                } else if (strcmp(key, "state") == 0) {
+                    p = skip_value(p, &state);
+                } else if (strcmp(key, "id") == 0 && *p >= '0' && *p <= '9') {
+                    id = strtol(p, NULL, 10);
+                    p = skip_value(p, NULL);
+                } else {
+                    p = skip_value(p, NULL);
+                }
+                if (!p) return -1;
+                p = skip_ws(p);
+                if (*p == ',') p = skip_ws(p + 1);
+            }
+            if (*p != '}') return -1;
+            p++;
+
+            if (max_id && id > *max_id) {
+                *max_id = (int32_t)id;
+            }
+            // Commands already applied (or without an ID when filtering) are skipped
+            bool fresh = after_id < 0 || id > after_id;
+            if (have_type && state >= 0 && fresh) {
+                cb(relay_type, state == 1, ctx);
+                delivered++;
+            }
+        }
+
+        p = skip_ws(p);
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == ']') return delivered;
+        return -1;
+    }
+    return -1;
+}
+
+int aqua_parse_relay_commands(const char *json, aqua_relay_cmd_cb_t cb, void *ctx) {
+    return aqua_parse_relay_commands_after(json, -1, cb, ctx, NULL);
+}
+
+// ========== OTA MANIFEST ==========
+typedef struct {
+    char from[24];
+    char url[AQUA_OTA_URL_MAX];
+    uint32_t size;
+} manifest_delta_t;
+
+// Walks one flat-or-nested object; field() consumes the value at p and returns the next position
+typedef const char *(*object_field_fn_t)(const char *key, const char *p, void *ctx);
+
+static const char *parse_object(const char *p, object_field_fn_t field, void *ctx) {
+    p = skip_ws(p);
+    if (*p != '{') return NULL;
+    p = skip_ws(p + 1);
+    while (*p && *p != '}') {
+        char key[32];
+        p = parse_string(p, key, sizeof(key));
+        if (!p) return NULL;
+        p = skip_ws(p);
+        if (*p != ':') return NULL;
+        p = field(key, skip_ws(p + 1), ctx);
+        if (!p) return NULL;
+        p = skip_ws(p);
+        if (*p == ',') p = skip_ws(p + 1);
+    }
+    return *p == '}' ? p + 1 : NULL;
+}
+
+static const char *parse_u32(const char *p, uint32_t *out) {
+    if (*p < '0' || *p > '9') return NULL;
+    *out = (uint32_t)strtoul(p, NULL, 10);
+    return skip_value(p, NULL);
+}
+
+static const char *delta_field(const char *key, const char *p, void *ctx) {
+    manifest_delta_t *d = ctx;
+    if (strcmp(key, "from") == 0) return parse_string(p, d->from, sizeof(d->from));
+    if (strcmp(key, "url") == 0) return parse_string(p, d->url, sizeof(d->url));
+    if (strcmp(key, "size") == 0) return parse_u32(p, &d->size);
+    return skip_value(p, NULL);
+}
+
+typedef struct {
+    aqua_ota_manifest_t *out;
+    const char *running_version;
+    bool have_size;
+    bool have_crc;
+} manifest_ctx_t;
+
+static const char *manifest_field(const char *key, const char *p, void *ctx) {
+    manifest_ctx_t *m = ctx;
+    aqua_ota_manifest_t *out = m->out;
+
+    if (strcmp(key, "version") == 0) return parse_string(p, out->version, sizeof(out->version));
+    if (strcmp(key, "url") == 0) return parse_string(p, out->image_url, sizeof(out->image_url));
+    if (strcmp(key, "size") == 0) {
+        m->have_size = true;
+        return parse_u32(p, &out->image_size);
+    }
+    if (strcmp(key, "crc32") == 0) {
+        m->have_crc = true;
+        return parse_u32(p, &out->image_crc);
+    }
+    if (strcmp(key, "deltas") != 0 || *p != '[') return skip_value(p, NULL);
+
+    // Keep only the delta that starts from the running version
+    p = skip_ws(p + 1);
+    while (*p && *p != ']') {
+        manifest_delta_t d = {0};
+        p = parse_object(p, delta_field, &d);
+        if (!p) return NULL;
+        if (strcmp(d.from, m->running_version) == 0 && d.url[0] && d.size > 0) {
+            snprintf(out->delta_url, sizeof(out->delta_url), "%s", d.url);
+            out->delta_size = d.size;
+        }
+        p = skip_ws(p);
+        if (*p == ',') p = skip_ws(p + 1);
+    }
+    return *p == ']' ? p + 1 : NULL;
+}
+
+bool aqua_parse_ota_manifest(const char *json, const char *running_version, aqua_ota_manifest_t *out) {
+    manifest_ctx_t m = { .out = out, .running_version = running_version };
+    memset(out, 0, sizeof(*out));
+    if (!parse_object(json, manifest_field, &m)) return false;
+    return out->version[0] && out->image_url[0] && m.have_size && m.have_crc && out->image_size > 0;
+}
+
+// ========== PARAMETERS ==========
+static bool in_range(float v, float lo, float hi) {
+    return isfinite(v) && v >= lo && v <= hi;
+}
+
+bool aqua_params_valid(const aqua_params_t *p) {
+    // Same ranges the conversions accept; water temperature as a pond could see it
+    return in_range(p->temp_min, 0.0f, 45.0f) && in_range(p->temp_max, 0.0f, 45.0f) &&
+           p->temp_min < p->temp_max &&
+           in_range(p->ph_min, 0.0f, 14.0f) && in_range(p->ph_max, 0.0f, 14.0f) &&
+           p->ph_min < p->ph_max &&
+           in_range(p->do_min, 0.0f, 20.0f) &&
+           in_range(p->ammonia_max, 0.0f, 10.0f) &&
+           in_range(p->turbidity_max, 0.0f, 1000.0f) &&
+           in_range(p->ph_relay_on_below, 0.0f, 14.0f) &&
+           in_range(p->aerator_on_below, 0.0f, 20.0f) &&
+           in_range(p->filter_on_above, 0.0f, 1000.0f) &&
+           in_range(p->pump_on_above, 0.0f, 10.0f);
+}
+
+typedef struct {
+    aqua_params_t *out;
+    bool have_version;
+} params_ctx_t;
+
+static const char *parse_float(const char *p, float *out) {
+    if (*p != '-' && (*p < '0' || *p > '9')) return NULL;
+    *out = strtof(p, NULL);
+    return skip_value(p, NULL);
+}
+
+const aqua_param_field_t aqua_param_fields[] = {
+    { "temp_min", offsetof(aqua_params_t, temp_min) },
+    { "temp_max", offsetof(aqua_params_t, temp_max) },
+    { "do_min", offsetof(aqua_params_t, do_min) },
+    { "ph_min", offsetof(aqua_params_t, ph_min) },
+    { "ph_max", offsetof(aqua_params_t, ph_max) },
+    { "ammonia_max", offsetof(aqua_params_t, ammonia_max) },
+    { "turbidity_max", offsetof(aqua_params_t, turbidity_max) },
+    { "ph_relay_on_below", offsetof(aqua_params_t, ph_relay_on_below) },
+    { "aerator_on_below", offsetof(aqua_params_t, aerator_on_below) },
+    { "filter_on_above", offsetof(aqua_params_t, filter_on_above) },
+    { "pump_on_above", offsetof(aqua_params_t, pump_on_above) },
+};
+
+const size_t aqua_param_field_count = sizeof(aqua_param_fields) / sizeof(aqua_param_fields[0]);
+
+static const char *params_field(const char *key, const char *p, void *ctx) {
+    params_ctx_t *c = ctx;
+
+    if (strcmp(key, "version") == 0) {
+        c->have_version = true;
+        return parse_u32(p, &c->out->version);
+    }
+    for (size_t i = 0; i < aqua_param_field_count; i++) {
+        if (strcmp(key, aqua_param_fields[i].key) == 0) {
+            // null leaves the base value in place
+            if (strncmp(p, "null", 4) == 0) return p + 4;
+            return parse_float(p, (float *)((char *)c->out + aqua_param_fields[i].offset));
+        }
+    }
+    return skip_value(p, NULL);
+}
+
+int aqua_parse_params(const char *json, const aqua_params_t *base, aqua_params_t *out) {
+    params_ctx_t c = { .out = out };
+    const char *p = skip_ws(json);
+    bool array = *p == '[';
+
+    *out = *base;
+    if (array) {
+        p = skip_ws(p + 1);
+        if (*p == ']') return 0;
+    }
+    p = parse_object(p, params_field, &c);
+    if (!p || !c.have_version) return -1;
+    p = skip_ws(p);
+    if (array && *p != ']') return -1;     // Only the newest row is expected
+    return 1;
+}
+
+// ========== RULES ==========
+typedef struct {
+    uint32_t *version;
+    char *source;
+    size_t size;
+    bool have_version;
+    bool have_source;
+    bool truncated;
+} rules_ctx_t;
+
+static const char *rules_field(const char *key, const char *p, void *ctx) {
+    rules_ctx_t *c = ctx;
+    if (strcmp(key, "version") == 0) {
+        c->have_version = true;
+        return parse_u32(p, c->version);
+    }
+    if (strcmp(key, "source") == 0) {
+        c->have_source = true;
+        size_t len;
+        p = parse_string_len(p, c->source, c->size, &len);
+        c->truncated = p && len >= c->size;
+        return p;
+    }
+    return skip_value(p, NULL);
+}
+
+int aqua_parse_rules(const char *json, uint32_t *version, char *source, size_t size) {
+    rules_ctx_t c = { .version = version, .source = source, .size = size };
+    const char *p = skip_ws(json);
+    bool array = *p == '[';
+
+    *version = 0;
+    source[0] = '\0';
+    if (array) {
+        p = skip_ws(p + 1);
+        if (*p == ']') return 0;
+    }
+    p = parse_object(p, rules_field, &c);
+    if (!p || !c.have_version || !c.have_source || c.truncated) return -1;
+    p = skip_ws(p);
+    if (array && *p != ']') return -1;
+    return 1;
+}
@@ -0,0 +1,335 @@
+#ifndef AQUA_CORE_H
+#define AQUA_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Hardware-independent logic shared by the firmware and the host build:
+// conversions, CRC, payload encoding, alert diffing and control decisions.
+
+#define AQUA_SENSOR_ERROR -999.0f   // Reading not available (sensor missing/failed)
+
+// Physical sensors, in the order of the sensor_health payload object
+typedef enum {
+    AQUA_SENSOR_DHT22,
+    AQUA_SENSOR_DS18B20,
+    AQUA_SENSOR_PH,
+    AQUA_SENSOR_DO,
+    AQUA_SENSOR_TURBIDITY,
+    AQUA_SENSOR_AMMONIA,
+    AQUA_SENSOR_COUNT
+} aqua_sensor_t;
+
+// How a reading's wall-clock time was obtained (aqua_time.h)
+typedef enum {
+    AQUA_TIME_UNSYNCED = 0,     // No sync since boot: only the monotonic time is known
+    AQUA_TIME_SYNCED,           // Within TIME_HOLDOVER_S of the last sync
+    AQUA_TIME_HOLDOVER,         // Extrapolated further than TIME_HOLDOVER_S
+    AQUA_TIME_PRESYNC           // Sampled before the first sync, corrected backwards
+} aqua_time_quality_t;
+
+typedef struct {
+    int64_t unix_us;            // µs since 1970-01-01 UTC
+    aqua_time_quality_t quality;
+    uint32_t error_ms;          // Estimated bound on the error of unix_us
+} aqua_timestamp_t;
+
+// Switched outputs, in the order of the actuators payload object
+typedef enum {
+    AQUA_ACT_PH_RELAY,
+    AQUA_ACT_AERATOR,
+    AQUA_ACT_FILTER,
+    AQUA_ACT_PUMP,
+    AQUA_ACT_COUNT
+} aqua_actuator_t;
+
+// Flow behind an output against the state it was commanded to (aqua_meter.h)
+typedef enum {
+    AQUA_FLOW_OK = 0,
+    AQUA_FLOW_NONE,             // Commanded on, but nothing flowed
+    AQUA_FLOW_UNCOMMANDED       // Commanded off, but it flowed anyway
+} aqua_flow_fault_t;
+
+typedef struct {
+    uint32_t on_s;              // Run time, total over the device's life
+    float energy_wh;            // Run time at the actuator's rated power
+    bool metered;               // A flow meter is fitted; the fields below are valid
+    float litres;               // Total through the meter
+    float flow_lpm;             // Over the last sample interval
+    aqua_flow_fault_t fault;
+} aqua_actuator_sample_t;
+
+typedef struct {
+    float air_temp;
+    float humidity;
+    float water_temp;
+    float ph;
+    float do_level;
+    float turbidity;
+    float ammonia;
+    bool has_health;                        // health[] filled in; payloads then carry sensor_health
+    uint8_t health[AQUA_SENSOR_COUNT];      // 0-100 per sensor (aqua_health.h)
+    bool has_time;                          // sampled_us recorded; payloads then carry the sample time
+    int64_t sampled_us;                     // hal_time_us() when the cycle started sampling
+    aqua_timestamp_t time;                  // Wall-clock time of sampled_us, as of the upload
+    uint32_t seq;                           // Upload sequence number (aqua_seq.h); 0: none
+    bool has_actuators;                     // actuators[] filled in; payloads then carry them
+    aqua_actuator_sample_t actuators[AQUA_ACT_COUNT];
+} aqua_reading_t;
+
+typedef struct {
+    bool ph_relay;
+    bool aerator;
+    bool filter;
+    bool pump;
+} aqua_controls_t;
+
+// Alert states, one bit per aqua_measure_id_t (aqua_registry.h)
+typedef struct {
+    uint32_t low;               // Below the measurement's alert_min
+    uint32_t high;              // Above its alert_max
+    uint32_t anomaly;           // In a multi-sensor water anomaly (aqua_anomaly.h)
+    uint32_t suspect;           // Probe suspected by the anomaly detector
+    uint32_t no_flow;           // Bit per aqua_actuator_t: AQUA_FLOW_NONE
+    uint32_t flow_while_off;    // ... AQUA_FLOW_UNCOMMANDED
+} aqua_alert_states_t;
+
+#define AQUA_ALERT_BIT(id) (1u << (id))
+
+// Alert thresholds and control cut-offs (see aqua_params.h for the live copy)
+typedef struct {
+    uint32_t version;           // 0 = factory defaults; every update must raise it
+    float temp_min;             // Alert thresholds
+    float temp_max;
+    float do_min;
+    float ph_min;
+    float ph_max;
+    float ammonia_max;
+    float turbidity_max;
+    float ph_relay_on_below;    // Control cut-offs
+    float aerator_on_below;
+    float filter_on_above;
+    float pump_on_above;
+} aqua_params_t;
+
+// ========== CONVERSIONS ==========
+/**
+ * @brief Dallas/Maxim CRC-8 (DS18B20 scratchpad and ROM)
+ */
+uint8_t aqua_crc8(const uint8_t *data, size_t len);
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as zlib), continued from crc (0 to start)
+ */
+uint32_t aqua_crc32(uint32_t crc, const void *data, size_t len);
+
+int aqua_average_mv(const int *samples, int count);
+
+// Conversions take the averaged reading (fractional when oversampled) and
+// return -1.0f when the result is outside the sensor's range
+float aqua_mv_to_ph(float avg_mv);
+float aqua_mv_to_do(float avg_mv);
+float aqua_mv_to_turbidity(float avg_mv);
+float aqua_mv_to_ammonia(float avg_mv);
+
+/**
+ * @brief Temperature in °C from the first two scratchpad bytes
+ */
+float aqua_ds18b20_raw_to_c(const uint8_t *scratchpad);
+
+/**
+ * @brief Verify checksum and decode a 40-bit DHT22 frame
+ * @return ESP_OK, ESP_ERR_INVALID_CRC or ESP_ERR_INVALID_RESPONSE (out of range)
+ */
+esp_err_t aqua_dht22_decode(const uint8_t data[5], float *hum, float *temp);
+
+#define AQUA_DHT22_MAX_PULSES 96    // Response (2) + 40 bits (80) + trailer, with room for leading noise
+
+/**
+ * @brief Recover the 40-bit DHT22 frame from captured pulse lengths
+ *
+ * durations alternate low/high starting with a low, in µs. Pulses before the
+ * 80 µs low + 80 µs high response are skipped. Each bit is a ~50 µs low and a
+ * high of ~27 µs (0) or ~70 µs (1); a pulse outside the tolerances rejects
+ * the frame rather than guess.
+ * @return ESP_OK, ESP_ERR_TIMEOUT (no response found) or ESP_ERR_INVALID_SIZE
+ *         (response found but the bits are truncated or malformed)
+ */
+esp_err_t aqua_dht22_decode_pulses(const uint16_t *durations, size_t count, uint8_t data[5]);
+
+// ========== PAYLOADS ==========
+/**
+ * @brief Key of a sensor in the sensor_health object
+ */
+const char *aqua_sensor_name(aqua_sensor_t sensor);
+
+/**
+ * @brief Key of an actuator in the actuators object, as its control state key
+ */
+const char *aqua_actuator_name(aqua_actuator_t act);
+
+/**
+ * @brief "ok", "no_flow" or "flow_while_off"
+ */
+const char *aqua_flow_fault_name(aqua_flow_fault_t fault);
+
+/**
+ * @brief "unsynced", "synced", "holdover" or "presync"
+ */
+const char *aqua_time_quality_name(aqua_time_quality_t quality);
+
+/**
+ * @brief Format as ISO 8601 UTC with microseconds: 2025-10-09T08:00:00.000000Z
+ * @return Length written, or -1 if the buffer is too small (28 bytes needed)
+ */
+int aqua_format_utc(int64_t unix_us, char *buf, size_t size);
+
+/**
+ * @brief Mark every value missing, including those of probes not built in
+ */
+void aqua_reading_clear(aqua_reading_t *r);
+
+/**
+ * @brief Range check every built-in measurement, allowing AQUA_SENSOR_ERROR for missing sensors
+ */
+bool aqua_validate_reading(const aqua_reading_t *r);
+
+/**
+ * @brief Number of missing critical measurements (AQUA_MEAS_CRITICAL in the registry)
+ */
+int aqua_count_missing_critical(const aqua_reading_t *r);
+
+/**
+ * @brief Number of critical measurements built in
+ */
+int aqua_count_critical(void);
+
+/**
+ * @brief Encode a reading as the sensor_data JSON row
+ *
+ * Keys follow the registry; missing values are left out unless
+ * AQUA_MEAS_ALWAYS_SENT, and sensor_health lists fitted sensors only.
+ * A reading with a sample time carries uptime_us and time_quality, plus
+ * sampled_at and time_error_ms once r->time is known. A reading with a
+ * sequence number carries device_id and seq, the key the server
+ * deduplicates retried uploads on. Actuator totals go in an actuators
+ * object; litres and flow only for metered actuators, fault only while set.
+ * @return Payload length, or -1 if the buffer is too small
+ */
+int aqua_build_payload(const aqua_reading_t *r, const aqua_controls_t *c,
+                       char *buf, size_t size);
+
+/**
+ * @brief Every key aqua_build_payload() can emit, comma-separated
+ *
+ * For the columns= parameter of a multi-row insert: PostgREST takes an
+ * array whose rows have different keys (a probe that dropped out, rows on
+ * either side of the first sync) only when the columns are listed.
+ * @return List length, or -1 if the buffer is too small
+ */
+int aqua_build_upload_columns(char *buf, size_t size);
+
+/**
+ * @brief Encode the ingest_reading RPC body: {"reading":{...row...},"last_command_id":N}
+ * @return Payload length, or -1 if the buffer is too small
+ */
+int aqua_build_exchange_payload(const aqua_reading_t *r, const aqua_controls_t *c,
+                                int32_t last_command_id, char *buf, size_t size);
+
+// ========== ALERTS ==========
+/**
+ * @brief Compare every measurement with alert limits against the limits in p
+ *
+ * A measurement at AQUA_SENSOR_ERROR raises no flag.
+ */
+void aqua_eval_alerts(const aqua_reading_t *r, const aqua_params_t *p, aqua_alert_states_t *out);
+bool aqua_alerts_changed(const aqua_alert_states_t *last, const aqua_alert_states_t *current);
+
+/**
+ * @brief Encode an alert notification
+ * @return Payload length, or -1 if the buffer is too small
+ */
+int aqua_build_alert_payload(const aqua_alert_states_t *a, const aqua_reading_t *r,
+                             char *buf, size_t size);
+
+// ========== CONTROL ==========
+void aqua_decide_controls(const aqua_reading_t *r, const aqua_params_t *p, aqua_controls_t *out);
+
+// ========== RELAY COMMANDS ==========
+typedef void (*aqua_relay_cmd_cb_t)(const char *relay_type, bool state, void *ctx);
+
+/**
+ * @brief Parse a relay_commands JSON array ([{"relay_type":"ph","state":true},...])
+ * @param json NUL terminated response body
+ * @param cb Called for every well-formed command, in array order
+ * @return Number of commands delivered, or -1 if the body is not a JSON array
+ */
+int aqua_parse_relay_commands(const char *json, aqua_relay_cmd_cb_t cb, void *ctx);
+
+/**
+ * @brief Like aqua_parse_relay_commands, but only delivers commands whose "id" is above after_id
+ * @param after_id Last applied command ID; -1 delivers everything
+ * @param max_id If not NULL, raised to the highest "id" seen (including skipped commands)
+ */
+int aqua_parse_relay_commands_after(const char *json, int32_t after_id,
+                                    aqua_relay_cmd_cb_t cb, void *ctx, int32_t *max_id);
+
+// ========== OTA MANIFEST ==========
+#define AQUA_OTA_URL_MAX 160
+
+typedef struct {
+    char version[24];
+    char image_url[AQUA_OTA_URL_MAX];   // Full image
+    uint32_t image_size;
+    uint32_t image_crc;                 // CRC-32 of the full image
+    char delta_url[AQUA_OTA_URL_MAX];   // Empty when no delta starts from the running version
+    uint32_t delta_size;
+} aqua_ota_manifest_t;
+
+/**
+ * @brief Parse the firmware manifest published next to the images
+ *
+ * {"version":"4.1.0","url":"...","size":N,"crc32":N,
+ *  "deltas":[{"from":"4.0.0","url":"...","size":N},...]}
+ * @param running_version Selects the delta whose "from" matches
+ * @return false if the manifest is malformed or lacks version, url, size or crc32
+ */
+bool aqua_parse_ota_manifest(const char *json, const char *running_version, aqua_ota_manifest_t *out);
+
+// ========== PARAMETERS ==========
+/**
+ * @brief Check that every value is finite, inside its sensor's range, and min < max
+ */
+bool aqua_params_valid(const aqua_params_t *p);
+
+/**
+ * @brief Parse a device_params row over base (missing fields keep base's values)
+ *
+ * Accepts the row object, or the one-element array PostgREST returns:
+ * [{"version":3,"temp_min":24.0,"aerator_on_below":5.5,...}]
+ * @return 1 if out was filled, 0 for an empty array, -1 if malformed or without "version"
+ */
+int aqua_parse_params(const char *json, const aqua_params_t *base, aqua_params_t *out);
+
+// device_params columns in aqua_params_t; order is fixed (rules bytecode refers to it)
+typedef struct {
+    const char *key;
+    uint16_t offset;
+} aqua_param_field_t;
+
+extern const aqua_param_field_t aqua_param_fields[];
+extern const size_t aqua_param_field_count;
+
+// ========== RULES ==========
+/**
+ * @brief Parse a device_rules row: [{"version":3,"source":"when ... then ..."}]
+ * @param version Receives the version, or 0 if none was read (also on failure)
+ * @param source Receives the rule text, NUL terminated
+ * @return 1 if filled, 0 for an empty array, -1 if malformed, without version
+ *         or source, or if the source does not fit in size - 1 chars
+ */
+int aqua_parse_rules(const char *json, uint32_t *version, char *source, size_t size);
+
+#endif // AQUA_CORE_H
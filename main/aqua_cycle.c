@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_cycle.h"
+#include "aqua_log.h"
+#include "aqua_meter.h"
+#include "aqua_modbus.h"
+#include "aqua_ota.h"
+#include "aqua_params.h"
+#include "aqua_registry.h"
+#include "aqua_rules.h"
+#include "aqua_seq.h"
+#include "aqua_time.h"
+#include "aqua_xadc.h"
+#include "hal.h"
+#include "mqtt_transport.h"
+#include "sensors.h"
+#include "supabase.h"
+
+static aqua_transport_t s_transport = AQUA_USE_MQTT ? AQUA_TRANSPORT_MQTT :
+                                      AQUA_USE_RPC ? AQUA_TRANSPORT_EXCHANGE : AQUA_TRANSPORT_HTTP;
+
+void aqua_cycle_set_transport(aqua_transport_t transport) {
+    s_transport = transport;
+}
+
+aqua_transport_t aqua_cycle_get_transport(void) {
+    return s_transport;
+}
+
+void aqua_gpio_init(void) {
+    // Configure digital sensor pins
+    hal_gpio_set_direction(DHT_PIN, HAL_GPIO_INPUT);
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+    hal_gpio_set_direction(PUMP_PIN, HAL_GPIO_OUTPUT);
+
+    // Configure control output pins
+    hal_gpio_set_direction(RELAY_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_direction(PUMP_RELAY_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_direction(AERATOR_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_direction(FILTER_PIN, HAL_GPIO_OUTPUT);
+
+    // Set initial states for outputs
+    hal_gpio_set_level(RELAY_PIN, 0);
+    hal_gpio_set_level(PUMP_RELAY_PIN, 0);
+    hal_gpio_set_level(AERATOR_PIN, 0);
+    hal_gpio_set_level(FILTER_PIN, 0);
+    hal_gpio_set_level(PUMP_PIN, 0);
+}
+
+// Registry inputs on the external converters, bit per XADC_CH_INPUT()
+static uint16_t external_inputs(void) {
+    uint16_t inputs = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        int channel = aqua_measures[i].adc_channel;
+        if (channel >= 0 && XADC_CH_IS_EXTERNAL(channel)) {
+            inputs |= 1u << XADC_CH_INPUT(channel);
+        }
+    }
+    return inputs;
+}
+
+// Out-of-range reads are stored as AQUA_SENSOR_ERROR
+static void read_analog_sensors(aqua_reading_t *r) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if (m->adc_channel < 0) continue;
+
+        AQUA_LOG(CYCLE_READ_SENSOR, m->label);
+        float value = read_analog_sensor(m);
+        if (value < 0) {
+            AQUA_LOG(CYCLE_SENSOR_ERROR, m->label, m->adc_channel, m->gpio);
+            AQUA_LOG(CYCLE_CHECK_SENSOR);
+            value = AQUA_SENSOR_ERROR; // Error indicator
+        } else {
+            AQUA_LOG(CYCLE_SENSOR, m->label, value, m->unit);
+        }
+        aqua_measure_set(m, r, value);
+        hal_watchdog_feed();
+    }
+}
+
+void aqua_cycle_run(aqua_cycle_state_t *state) {
+    aqua_reading_t *r = &state->reading;
+    aqua_controls_t *c = &state->controls;
+
+    state->cycle_count++;
+    hal_watchdog_feed(); // Feed the watchdog at the start of each cycle
+    AQUA_LOG(CYCLE_START, state->cycle_count);
+    aqua_reading_clear(r);
+
+    // Take any SNTP result first; the reading is timed from the sample instant
+    aqua_time_poll();
+    r->sampled_us = hal_time_us();
+    r->has_time = true;
+
+    // Start the DHT22 capture; the frame arrives during the water temperature conversion
+    AQUA_LOG(CYCLE_READ_DHT);
+    dht22_start();
+
+    // External converters start too; the first inputs convert during the DS18B20 read
+    uint16_t xadc_inputs = external_inputs();
+    if (xadc_inputs) {
+        aqua_xadc_scan_start(xadc_inputs);
+    }
+
+    // Read Water Temperature
+    AQUA_LOG(CYCLE_READ_WATER);
+    r->water_temp = read_water_temp();
+    AQUA_LOG(CYCLE_WATER, r->water_temp);
+    hal_watchdog_feed();
+
+    // Collect Air Temperature and Humidity (DHT22)
+    esp_err_t dht_result = dht22_finish(&r->humidity, &r->air_temp);
+    if (dht_result != ESP_OK) {
+        AQUA_LOG(CYCLE_DHT_FAILED, DHT_PIN);
+        AQUA_LOG(CYCLE_ERROR, esp_err_to_name(dht_result));
+        r->air_temp = AQUA_SENSOR_ERROR; // Error indicator
+        r->humidity = AQUA_SENSOR_ERROR; // Error indicator
+    }
+    AQUA_LOG(CYCLE_AIR, r->air_temp, r->humidity);
+    hal_watchdog_feed();
+
+    // Analog sensors: one pass over the registry
+    if (xadc_inputs) {
+        aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS);
+    }
+    read_analog_sensors(r);
+
+    // Health scores from this cycle's reads travel with the row
+    sensor_health_scores(r->health);
+    r->has_health = true;
+    AQUA_LOG(CYCLE_HEALTH, r->health[AQUA_SENSOR_DHT22], r->health[AQUA_SENSOR_DS18B20],
+             r->health[AQUA_SENSOR_PH], r->health[AQUA_SENSOR_DO],
+             r->health[AQUA_SENSOR_TURBIDITY], r->health[AQUA_SENSOR_AMMONIA]);
+
+    // Multi-sensor anomaly score; its flags go out with the threshold alerts
+    aqua_anomaly_observe(r);
+
+    // Control System Logic (thresholds may change between cycles, never within a decision),
+    // then the local rules over it
+    const aqua_params_t *params = aqua_params_acquire();
+    aqua_decide_controls(r, params, c);
+    aqua_rules_apply(r, params, c);
+    aqua_params_release(params);
+
+    // Update control outputs
+    hal_gpio_set_level(RELAY_PIN, c->ph_relay);
+    hal_gpio_set_level(AERATOR_PIN, c->aerator);
+    hal_gpio_set_level(FILTER_PIN, c->filter);
+    hal_gpio_set_level(PUMP_PIN, c->pump);
+
+    // Run time, energy and flow up to now, judged against the state just replaced
+    aqua_meter_sample(c, r);
+
+    AQUA_LOG(CYCLE_CONTROLS,
+            c->ph_relay ? "ON" : "OFF",
+            c->aerator ? "ON" : "OFF",
+            c->filter ? "ON" : "OFF",
+            c->pump ? "ON" : "OFF");
+
+    // Log final readings
+    AQUA_LOG(CYCLE_FINAL, r->air_temp, r->humidity, r->ph, c->ph_relay ? "ON" : "OFF");
+
+    // Wall-clock time as of the upload (backwards from the first sync if it came later)
+    aqua_time_stamp(r->sampled_us, &r->time);
+
+    // One number per row, kept by every retry, so the server stores it once
+    r->seq = aqua_seq_next();
+
+    // Local SCADA/PLC pollers read this sample from now on
+    aqua_modbus_publish(r, c, (uint32_t)state->cycle_count);
+
+    // Check conditions and send alerts if needed; an alert goes out ahead of
+    // the cycle's other requests and any backlog (aqua_outq.h)
+    AQUA_LOG(CYCLE_ALERTS);
+#if ALERTS_ENABLED
+    check_and_send_alerts(r->water_temp, r->do_level, r->ph, r->ammonia, r->turbidity);
+#endif
+
+    if (s_transport == AQUA_TRANSPORT_MQTT) {
+        // Relay commands arrive by subscription; publish without waiting for the ack
+        AQUA_LOG(CYCLE_MQTT);
+        mqtt_process_commands();
+        state->uploaded = mqtt_send_reading(r, c);
+    } else if (s_transport == AQUA_TRANSPORT_EXCHANGE) {
+        // One round trip: the response carries any newer relay commands
+        AQUA_LOG(CYCLE_EXCHANGE);
+        state->uploaded = exchange_with_supabase(r, c);
+    } else {
+        // Poll for relay control commands from Supabase
+        AQUA_LOG(CYCLE_POLLING);
+        poll_relay_commands();
+
+        // Send data to Supabase
+        AQUA_LOG(CYCLE_SENDING);
+        state->uploaded = send_reading_to_supabase(r, c);
+    }
+    if (!state->uploaded) {
+        AQUA_LOG(CYCLE_UPLOAD_FAILED);
+    }
+
+    hal_watchdog_feed(); // Feed the watchdog after Supabase upload
+
+    // Pick up retuned thresholds and rules; the next cycle decides with them
+    if (state->cycle_count % PARAMS_POLL_INTERVAL_CYCLES == 0) {
+        poll_device_params();
+        poll_device_rules();
+    }
+
+    // Rows that missed their live deadline go out with what time is left
+    supabase_outbound_drain(OUTQ_DRAIN_MS);
+
+    // Confirm or roll back a freshly installed image, and look for updates
+    aqua_ota_after_cycle(state->cycle_count, r, state->uploaded);
+
+    // Deferred mode: push this cycle's records out while the link is idle
+    aqua_log_flush();
+}
@@ -0,0 +1,36 @@
+#ifndef AQUA_CYCLE_H
+#define AQUA_CYCLE_H
+
+#include <stdbool.h>
+#include "aqua_core.h"
+
+typedef enum {
+    AQUA_TRANSPORT_HTTP = 0,    // REST upload plus relay_commands poll
+    AQUA_TRANSPORT_MQTT,        // Persistent MQTT session (mqtt_transport.h)
+    AQUA_TRANSPORT_EXCHANGE     // One ingest_reading RPC: upload and fetch commands
+} aqua_transport_t;
+
+typedef struct {
+    int cycle_count;
+    aqua_reading_t reading;     // Last readings (AQUA_SENSOR_ERROR when missing)
+    aqua_controls_t controls;   // Last control decisions
+    bool uploaded;              // Last upload accepted by the server
+} aqua_cycle_state_t;
+
+/**
+ * @brief Configure sensor and control GPIOs and switch all outputs off
+ */
+void aqua_gpio_init(void);
+
+/**
+ * @brief Select how readings and relay commands travel (default from AQUA_USE_MQTT / AQUA_USE_RPC)
+ */
+void aqua_cycle_set_transport(aqua_transport_t transport);
+aqua_transport_t aqua_cycle_get_transport(void);
+
+/**
+ * @brief One monitoring cycle: read sensors, drive outputs, poll commands, upload
+ */
+void aqua_cycle_run(aqua_cycle_state_t *state);
+
+#endif // AQUA_CYCLE_H
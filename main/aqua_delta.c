@@ -0,0 +1,227 @@
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_delta.h"
+
+enum {
+    ST_HEADER = 0,
+    ST_OP,
+    ST_PATCH_SRC,
+    ST_PATCH_LEN,
+    ST_RUN_SKIP,
+    ST_RUN_N,
+    ST_RUN_BYTES,
+    ST_INSERT_LEN,
+    ST_INSERT_BYTES,
+    ST_FINISHED
+};
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static aqua_delta_result_t fail(aqua_delta_t *d, aqua_delta_result_t result) {
+    d->state = ST_FINISHED;
+    d->result = result;
+    return result;
+}
+
+// Returns 1 when the varint is complete, 0 if more bytes follow, -1 on overflow
+static int take_varint(aqua_delta_t *d, uint8_t b) {
+    if (d->varint_shift > 35) {
+        return -1;
+    }
+    d->varint |= (uint64_t)(b & 0x7F) << d->varint_shift;
+    d->varint_shift += 7;
+    return (b & 0x80) ? 0 : 1;
+}
+
+static bool emit(aqua_delta_t *d, const uint8_t *data, size_t len) {
+    if (!d->write(d->ctx, data, len)) {
+        return false;
+    }
+    d->crc = aqua_crc32(d->crc, data, len);
+    d->written += (uint32_t)len;
+    return true;
+}
+
+static bool copy_source(aqua_delta_t *d, uint32_t len) {
+    while (len > 0) {
+        size_t n = len < sizeof(d->block) ? len : sizeof(d->block);
+        if (!d->read(d->ctx, d->src_pos, d->block, n) || !emit(d, d->block, n)) {
+            return false;
+        }
+        d->src_pos += (uint32_t)n;
+        len -= (uint32_t)n;
+    }
+    return true;
+}
+
+static aqua_delta_result_t parse_header(aqua_delta_t *d) {
+    aqua_delta_header_t *h = &d->header;
+    if (memcmp(d->head, AQUA_DELTA_MAGIC, 4) != 0) {
+        return fail(d, AQUA_DELTA_ERR_FORMAT);
+    }
+    h->source_size = get_u32(d->head + 4);
+    h->source_crc = get_u32(d->head + 8);
+    h->target_size = get_u32(d->head + 12);
+    h->target_crc = get_u32(d->head + 16);
+    if (h->target_size == 0) {
+        return fail(d, AQUA_DELTA_ERR_FORMAT);
+    }
+
+    // Refuse to build on anything but the exact image the delta was made from
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < h->source_size; ) {
+        size_t n = h->source_size - pos < sizeof(d->block) ? h->source_size - pos : sizeof(d->block);
+        if (!d->read(d->ctx, pos, d->block, n)) {
+            return fail(d, AQUA_DELTA_ERR_IO);
+        }
+        crc = aqua_crc32(crc, d->block, n);
+        pos += (uint32_t)n;
+    }
+    if (crc != h->source_crc) {
+        return fail(d, AQUA_DELTA_ERR_SOURCE);
+    }
+    d->state = ST_OP;
+    return AQUA_DELTA_MORE;
+}
+
+// Handles one byte of a non-data state
+static aqua_delta_result_t step(aqua_delta_t *d, uint8_t b) {
+    const aqua_delta_header_t *h = &d->header;
+
+    if (d->state == ST_OP) {
+        d->varint = 0;
+        d->varint_shift = 0;
+        if (b == AQUA_DELTA_OP_END) {
+            d->state = ST_FINISHED;
+            d->result = (d->written == h->target_size && d->crc == h->target_crc) ?
+                        AQUA_DELTA_DONE : AQUA_DELTA_ERR_VERIFY;
+            return d->result;
+        }
+        if (b == AQUA_DELTA_OP_PATCH) {
+            d->state = ST_PATCH_SRC;
+        } else if (b == AQUA_DELTA_OP_INSERT) {
+            d->state = ST_INSERT_LEN;
+        } else {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        return AQUA_DELTA_MORE;
+    }
+
+    int done = take_varint(d, b);
+    if (done < 0) {
+        return fail(d, AQUA_DELTA_ERR_FORMAT);
+    }
+    if (done == 0) {
+        return AQUA_DELTA_MORE;
+    }
+    uint64_t v = d->varint;
+    d->varint = 0;
+    d->varint_shift = 0;
+
+    switch (d->state) {
+    case ST_PATCH_SRC: {
+        int64_t delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        int64_t src = (int64_t)d->src_pos + delta;
+        if (src < 0 || src > (int64_t)h->source_size) {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        d->src_pos = (uint32_t)src;
+        d->state = ST_PATCH_LEN;
+        break;
+    }
+    case ST_PATCH_LEN:
+        if (v > h->target_size - d->written || v > h->source_size - d->src_pos) {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        d->patch_left = (uint32_t)v;
+        d->state = ST_RUN_SKIP;
+        break;
+    case ST_RUN_SKIP:
+        if (v > d->patch_left) {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        if (!copy_source(d, (uint32_t)v)) {
+            return fail(d, AQUA_DELTA_ERR_IO);
+        }
+        d->patch_left -= (uint32_t)v;
+        d->state = d->patch_left == 0 ? ST_OP : ST_RUN_N;
+        break;
+    case ST_RUN_N:
+        if (v == 0 || v > d->patch_left) {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        d->remaining = (uint32_t)v;
+        d->state = ST_RUN_BYTES;
+        break;
+    case ST_INSERT_LEN:
+        if (v > h->target_size - d->written) {
+            return fail(d, AQUA_DELTA_ERR_FORMAT);
+        }
+        d->remaining = (uint32_t)v;
+        d->state = v == 0 ? ST_OP : ST_INSERT_BYTES;
+        break;
+    default:
+        return fail(d, AQUA_DELTA_ERR_FORMAT);
+    }
+    return AQUA_DELTA_MORE;
+}
+
+void aqua_delta_init(aqua_delta_t *d, aqua_delta_read_fn read, aqua_delta_write_fn write, void *ctx) {
+    memset(d, 0, sizeof(*d));
+    d->read = read;
+    d->write = write;
+    d->ctx = ctx;
+    d->state = ST_HEADER;
+    d->result = AQUA_DELTA_MORE;
+}
+
+aqua_delta_result_t aqua_delta_feed(aqua_delta_t *d, const uint8_t *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len && d->state != ST_FINISHED) {
+        if (d->state == ST_HEADER) {
+            size_t n = AQUA_DELTA_HEADER_SIZE - d->head_len;
+            if (n > len - pos) n = len - pos;
+            memcpy(d->head + d->head_len, data + pos, n);
+            d->head_len += n;
+            pos += n;
+            if (d->head_len == AQUA_DELTA_HEADER_SIZE) {
+                parse_header(d);
+            }
+        } else if (d->state == ST_RUN_BYTES || d->state == ST_INSERT_BYTES) {
+            // New bytes pass straight through to the target
+            size_t n = d->remaining < len - pos ? d->remaining : len - pos;
+            if (!emit(d, data + pos, n)) {
+                fail(d, AQUA_DELTA_ERR_IO);
+                break;
+            }
+            pos += n;
+            d->remaining -= (uint32_t)n;
+            if (d->state == ST_RUN_BYTES) {
+                d->src_pos += (uint32_t)n;
+                d->patch_left -= (uint32_t)n;
+                if (d->remaining == 0) d->state = ST_RUN_SKIP;
+            } else if (d->remaining == 0) {
+                d->state = ST_OP;
+            }
+        } else {
+            step(d, data[pos++]);
+        }
+    }
+
+    d->bytes_in += (uint32_t)pos;
+    if (d->state == ST_FINISHED) {
+        // Trailing bytes after END make the delta suspect
+        if (d->result == AQUA_DELTA_DONE && pos < len) {
+            d->result = AQUA_DELTA_ERR_FORMAT;
+        }
+        return d->result;
+    }
+    return AQUA_DELTA_MORE;
+}
+
+const aqua_delta_header_t *aqua_delta_header(const aqua_delta_t *d) {
+    return d->head_len == AQUA_DELTA_HEADER_SIZE && d->state != ST_HEADER ? &d->header : NULL;
+}
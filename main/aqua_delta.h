@@ -0,0 +1,95 @@
+#ifndef AQUA_DELTA_H
+#define AQUA_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming binary delta decoder for firmware updates.
+//
+// A delta rebuilds the new image from the running one, so only the changed
+// bytes cross the network. It is applied as it downloads: the input can be
+// fed in chunks of any size, source bytes are read on demand, and the output
+// is written strictly in order, so nothing is buffered beyond a small copy
+// block. Deltas are produced by host/tools/aqua_mkdelta.
+//
+// Format (integers little endian, varints LEB128, offsets zigzag):
+//   "AQD1" u32 source_size u32 source_crc u32 target_size u32 target_crc
+//   ops:  0x01 PATCH  varint src_delta, varint len, runs
+//                     runs: { varint skip; [varint n, n new bytes] } until len is covered;
+//                     skipped bytes are copied from the source
+//         0x02 INSERT varint len, len new bytes
+//         0x00 END
+//   src_delta is relative to the end of the previous PATCH in the source.
+
+#define AQUA_DELTA_MAGIC "AQD1"
+#define AQUA_DELTA_HEADER_SIZE 20
+#define AQUA_DELTA_OP_END 0x00
+#define AQUA_DELTA_OP_PATCH 0x01
+#define AQUA_DELTA_OP_INSERT 0x02
+
+typedef enum {
+    AQUA_DELTA_MORE = 0,        // Waiting for more input
+    AQUA_DELTA_DONE,            // Target complete and CRC verified
+    AQUA_DELTA_ERR_FORMAT,      // Malformed delta or out-of-range operation
+    AQUA_DELTA_ERR_SOURCE,      // Running image is not the one the delta was made from
+    AQUA_DELTA_ERR_IO,          // Read or write callback failed
+    AQUA_DELTA_ERR_VERIFY       // Rebuilt image does not match the target CRC
+} aqua_delta_result_t;
+
+/**
+ * @brief Read len source bytes at offset
+ */
+typedef bool (*aqua_delta_read_fn)(void *ctx, size_t offset, void *buf, size_t len);
+
+/**
+ * @brief Append len bytes to the target
+ */
+typedef bool (*aqua_delta_write_fn)(void *ctx, const void *data, size_t len);
+
+typedef struct {
+    uint32_t source_size;
+    uint32_t source_crc;
+    uint32_t target_size;
+    uint32_t target_crc;
+} aqua_delta_header_t;
+
+typedef struct {
+    aqua_delta_read_fn read;
+    aqua_delta_write_fn write;
+    void *ctx;
+
+    aqua_delta_header_t header;
+    int state;
+    aqua_delta_result_t result;
+    uint8_t head[AQUA_DELTA_HEADER_SIZE];
+    size_t head_len;
+
+    uint64_t varint;            // Varint being accumulated
+    int varint_shift;
+    uint32_t remaining;         // Bytes left in the current INSERT or PATCH run
+    uint32_t patch_left;        // Bytes of the current PATCH not yet covered
+    uint32_t src_pos;           // Source position of the next copied byte
+    uint32_t written;
+    uint32_t crc;
+    uint32_t bytes_in;          // Delta bytes consumed
+    uint8_t block[256];         // Source copy buffer
+} aqua_delta_t;
+
+void aqua_delta_init(aqua_delta_t *d, aqua_delta_read_fn read, aqua_delta_write_fn write, void *ctx);
+
+/**
+ * @brief Consume the next chunk of the delta
+ *
+ * The source CRC is checked as soon as the header is complete, before
+ * anything is written.
+ * @return AQUA_DELTA_MORE, AQUA_DELTA_DONE or an error (sticky)
+ */
+aqua_delta_result_t aqua_delta_feed(aqua_delta_t *d, const uint8_t *data, size_t len);
+
+/**
+ * @brief Parsed header, or NULL until the first AQUA_DELTA_HEADER_SIZE bytes arrived
+ */
+const aqua_delta_header_t *aqua_delta_header(const aqua_delta_t *d);
+
+#endif // AQUA_DELTA_H
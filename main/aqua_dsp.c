@@ -0,0 +1,221 @@
+#include <stdbool.h>
+#include <string.h>
+#include "aqua_dsp.h"
+#include "hal.h"
+
+#ifdef ESP_PLATFORM
+#include "dsps_dotprod.h"
+#define DSP_BACKEND "esp-dsp"
+#elif defined(__GNUC__)
+#define DSP_VECTOR 1
+#define DSP_BACKEND "vector"
+#else
+#define DSP_BACKEND "scalar"
+#endif
+
+// Hamming-windowed sinc, cutoff 0.05 of the CIC output rate (stop band
+// starts below the FIR output Nyquist), Q15, sum 32768 for unity DC gain.
+// Symmetric, so it is also its own reverse for the dot products below.
+static const int16_t s_fir[AQUA_DSP_FIR_TAPS] AQUA_DSP_ALIGNED = {
+      -54,  -64,  -82,  -97,  -93,  -47,   66,  266,
+      562,  951, 1412, 1909, 2396, 2821, 3136, 3302,
+     3302, 3136, 2821, 2396, 1909, 1412,  951,  562,
+      266,   66,  -47,  -93,  -97,  -82,  -64,  -54,
+};
+
+_Static_assert((AQUA_DSP_FIR_DECIM * sizeof(int16_t)) % 16 == 0,
+               "every FIR window must start on a 16-byte boundary");
+_Static_assert(AQUA_DSP_FIR_TAPS % 8 == 0, "the PIE dot product takes taps in groups of 8");
+
+// ========== CIC ==========
+// Gain is AQUA_DSP_CIC_DECIM^ORDER = 512; shifting by 9 - FRAC_BITS leaves Q3.
+// The integrators wrap; unsigned arithmetic keeps that well defined and the
+// combs undo it.
+#define CIC_SHIFT (9 - AQUA_DSP_FRAC_BITS)
+
+size_t aqua_cic_decimate(const int16_t *in, size_t n, int16_t *out) {
+    uint32_t integ[AQUA_DSP_CIC_ORDER] = { 0 };
+    uint32_t comb[AQUA_DSP_CIC_ORDER] = { 0 };
+    size_t produced = 0, skip = AQUA_DSP_CIC_ORDER;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t v = (uint32_t)(in[i] - AQUA_DSP_MIDSCALE);
+        for (int s = 0; s < AQUA_DSP_CIC_ORDER; s++) {
+            integ[s] += v;
+            v = integ[s];
+        }
+        if ((i + 1) % AQUA_DSP_CIC_DECIM != 0) continue;
+
+        for (int s = 0; s < AQUA_DSP_CIC_ORDER; s++) {
+            uint32_t prev = comb[s];
+            comb[s] = v;
+            v -= prev;
+        }
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        int32_t q = ((int32_t)v + (1 << (CIC_SHIFT - 1))) >> CIC_SHIFT;
+        out[produced++] = (int16_t)q;
+    }
+    return produced;
+}
+
+// ========== FIR ==========
+static size_t fir_outputs(size_t n) {
+    return n < AQUA_DSP_FIR_TAPS ? 0 : (n - AQUA_DSP_FIR_TAPS) / AQUA_DSP_FIR_DECIM + 1;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-tree-vectorize")))     // Stays the scalar baseline
+#endif
+size_t aqua_fir_decimate_ref(const int16_t *in, size_t n, int16_t *out) {
+    size_t count = fir_outputs(n);
+    for (size_t k = 0; k < count; k++) {
+        const int16_t *x = in + k * AQUA_DSP_FIR_DECIM;
+        int64_t acc = 0x7FFF;
+        for (int j = 0; j < AQUA_DSP_FIR_TAPS; j++) {
+            acc += (int32_t)s_fir[j] * x[j];
+        }
+        out[k] = (int16_t)(acc >> 15);
+    }
+    return count;
+}
+
+#if DSP_VECTOR
+// Fixed trip count and a 32-bit accumulator let the compiler keep the whole
+// window in vector registers (pmaddwd on x86, smlal on NEON). |x| <= 16384
+// and the taps sum to under 1.1 in magnitude, so the sum stays in int32.
+static int16_t dot_vector(const int16_t *restrict x) {
+    int32_t acc = 0;
+    for (int j = 0; j < AQUA_DSP_FIR_TAPS; j++) {
+        acc += (int32_t)s_fir[j] * x[j];
+    }
+    return (int16_t)((acc + 0x7FFF) >> 15);
+}
+#endif
+
+size_t aqua_fir_decimate(const int16_t *in, size_t n, int16_t *out) {
+    size_t count = fir_outputs(n);
+#ifdef ESP_PLATFORM
+    for (size_t k = 0; k < count; k++) {
+        dsps_dotprod_s16(in + k * AQUA_DSP_FIR_DECIM, s_fir, &out[k], AQUA_DSP_FIR_TAPS, 0);
+    }
+#elif DSP_VECTOR
+    for (size_t k = 0; k < count; k++) {
+        out[k] = dot_vector(in + k * AQUA_DSP_FIR_DECIM);
+    }
+#else
+    aqua_fir_decimate_ref(in, n, out);
+#endif
+    return count;
+}
+
+const char *aqua_dsp_backend(void) {
+    return DSP_BACKEND;
+}
+
+// ========== CHAIN ==========
+float aqua_oversample_mv(const int16_t *raw, size_t n, int16_t *work) {
+    size_t cic = aqua_cic_decimate(raw, n, work);
+    // FIR outputs overwrite the front of work, behind the window being read
+    size_t count = aqua_fir_decimate(work, cic, work);
+    if (count == 0) {
+        return -1.0f;
+    }
+
+    // The FIR's rounding (+0x7FFF before the shift) adds half an LSB on average
+    int32_t sum = 0;
+    for (size_t k = 0; k < count; k++) {
+        sum += work[k];
+    }
+    float mean = (float)sum / (float)count - 0.5f;
+    return AQUA_DSP_MIDSCALE + mean / (1 << AQUA_DSP_FRAC_BITS);
+}
+
+void aqua_dsp_compare(const int16_t *raw, size_t n, int16_t *work, int iterations,
+                      aqua_dsp_compare_t *res) {
+    enum { MAX_OUT = 64 };
+    int16_t ref[MAX_OUT], fast[MAX_OUT];
+    size_t cic = aqua_cic_decimate(raw, n, work);
+    if (fir_outputs(cic) > MAX_OUT) {
+        cic = (MAX_OUT - 1) * AQUA_DSP_FIR_DECIM + AQUA_DSP_FIR_TAPS;
+    }
+
+    memset(res, 0, sizeof(*res));
+    int64_t t0 = hal_time_us();
+    for (int i = 0; i < iterations; i++) {
+        res->outputs = aqua_fir_decimate_ref(work, cic, ref);
+    }
+    int64_t t1 = hal_time_us();
+    for (int i = 0; i < iterations; i++) {
+        aqua_fir_decimate(work, cic, fast);
+    }
+    int64_t t2 = hal_time_us();
+
+    res->ref_us = t1 - t0;
+    res->fast_us = t2 - t1;
+    for (size_t k = 0; k < res->outputs; k++) {
+        if (ref[k] != fast[k]) res->mismatches++;
+    }
+}
+
+// ========== LOCK-IN ==========
+void aqua_lockin_init(aqua_lockin_t *l, uint32_t half_period) {
+    memset(l, 0, sizeof(*l));
+    l->half_period = half_period;
+}
+
+// Sum of a run of samples that all share one emitter state; a sample at
+// either rail counts once in *clipped
+static int32_t run_sum(const int16_t *x, size_t n, uint32_t *clipped) {
+    int32_t sum = 0;
+    uint32_t clip = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i];
+        clip += (uint16_t)(x[i] - 1) >= AQUA_LOCKIN_FULL_SCALE - 1;
+    }
+    *clipped += clip;
+    return sum;
+}
+
+void aqua_lockin_feed(aqua_lockin_t *l, const int16_t *samples, size_t n) {
+    while (n > 0) {
+        bool on = hal_emitter_on(l->pos, l->half_period);
+        size_t run = l->half_period - (l->pos + l->half_period / 2) % l->half_period;
+        if (run > n) {
+            run = n;
+        }
+        int32_t sum = run_sum(samples, run, &l->clipped);
+        if (on) {
+            l->on_sum += sum;
+            l->on_count += (uint32_t)run;
+        } else {
+            l->off_sum += sum;
+            l->off_count += (uint32_t)run;
+        }
+        l->pos += (uint32_t)run;
+        samples += run;
+        n -= run;
+    }
+}
+
+void aqua_lockin_merge(aqua_lockin_t *l, const aqua_lockin_t *part) {
+    l->pos += part->pos;
+    l->on_sum += part->on_sum;
+    l->off_sum += part->off_sum;
+    l->on_count += part->on_count;
+    l->off_count += part->off_count;
+    l->clipped += part->clipped;
+}
+
+float aqua_lockin_amplitude(const aqua_lockin_t *l) {
+    if (l->on_count == 0 || l->off_count == 0) {
+        return 0.0f;
+    }
+    return (float)((double)l->on_sum / l->on_count - (double)l->off_sum / l->off_count);
+}
+
+float aqua_lockin_ambient(const aqua_lockin_t *l) {
+    return l->off_count == 0 ? 0.0f : (float)((double)l->off_sum / l->off_count);
+}
@@ -0,0 +1,138 @@
+#ifndef AQUA_DSP_H
+#define AQUA_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Decimation chain for oversampled analog reads (AQUA_OVERSAMPLE), and
+// lock-in detection for probes with a switched emitter (below).
+//
+// A burst of raw 12-bit conversions goes through a third-order CIC
+// decimator (integer adds only, decimation AQUA_DSP_CIC_DECIM), then a
+// 32-tap low-pass FIR that decimates by AQUA_DSP_FIR_DECIM, and the FIR
+// outputs are averaged into one value. Filtered values are Q3 offsets from
+// mid-scale (1/8 count resolution) so the extra bits survive in int16.
+//
+// The FIR is the hot loop and has two implementations with identical
+// output: a plain scalar reference and a vectorised one. On the ESP32-S3
+// the vectorised one is esp-dsp's dsps_dotprod_s16, which uses the PIE SIMD
+// instructions; on the host it is a fixed-length kernel the compiler turns
+// into SSE/NEON multiply-adds, so tests can compare the two paths sample for
+// sample.
+
+#define AQUA_DSP_CIC_ORDER 3
+#define AQUA_DSP_CIC_DECIM 8
+#define AQUA_DSP_FIR_TAPS 32
+#define AQUA_DSP_FIR_DECIM 8
+#define AQUA_DSP_FRAC_BITS 3            // Filtered values are in 1/8 counts
+#define AQUA_DSP_MIDSCALE 2048
+
+// Declares a buffer the vectorised FIR can load directly
+#define AQUA_DSP_ALIGNED __attribute__((aligned(16)))
+
+/**
+ * @brief CIC decimator over one burst, starting from a cleared state
+ *
+ * The first AQUA_DSP_CIC_ORDER outputs, while the comb stages fill, are
+ * dropped.
+ * @param in Raw conversions (0-4095)
+ * @param out Q3 offsets from AQUA_DSP_MIDSCALE
+ * @return Outputs written: n / AQUA_DSP_CIC_DECIM - AQUA_DSP_CIC_ORDER, or 0
+ */
+size_t aqua_cic_decimate(const int16_t *in, size_t n, int16_t *out);
+
+/**
+ * @brief FIR low-pass and decimation, scalar reference
+ *
+ * out[k] = (sum of h[j] * in[k*D + j] + 0x7FFF) >> 15 for every k whose
+ * window fits in the input (the rounding esp-dsp uses).
+ * @return Outputs written: (n - AQUA_DSP_FIR_TAPS) / AQUA_DSP_FIR_DECIM + 1, or 0
+ */
+size_t aqua_fir_decimate_ref(const int16_t *in, size_t n, int16_t *out);
+
+/**
+ * @brief Same as aqua_fir_decimate_ref() on the vectorised path
+ * @param in Must be AQUA_DSP_ALIGNED
+ */
+size_t aqua_fir_decimate(const int16_t *in, size_t n, int16_t *out);
+
+/**
+ * @brief Name of the path behind aqua_fir_decimate(): "esp-dsp", "vector" or "scalar"
+ */
+const char *aqua_dsp_backend(void);
+
+/**
+ * @brief Run the whole chain over a burst
+ * @param work AQUA_DSP_ALIGNED scratch of n / AQUA_DSP_CIC_DECIM samples
+ * @return Mean in counts (fractional), -1.0f if the burst is too short
+ */
+float aqua_oversample_mv(const int16_t *raw, size_t n, int16_t *work);
+
+typedef struct {
+    int64_t ref_us;                     // Time for all iterations, scalar path
+    int64_t fast_us;                    // Same on the vectorised path
+    size_t outputs;                     // FIR outputs per iteration
+    int mismatches;                     // Outputs where the two paths differ
+} aqua_dsp_compare_t;
+
+/**
+ * @brief Time both FIR paths on the CIC output of raw and compare their outputs
+ *
+ * Timing uses hal_time_us(), so it is only meaningful on the device.
+ * @param work AQUA_DSP_ALIGNED scratch of n / AQUA_DSP_CIC_DECIM samples
+ */
+void aqua_dsp_compare(const int16_t *raw, size_t n, int16_t *work, int iterations,
+                      aqua_dsp_compare_t *res);
+
+// ========== LOCK-IN ==========
+// Synchronous detection for optical probes read with a switched emitter
+// (hal_adc_read_modulated()). Samples taken with the emitter on are added
+// and samples with it off subtracted, so light that does not follow the
+// emitter cancels and the emitter's own share is left. Over a whole number
+// of emitter periods spanning T seconds, sunlight and any flicker at a
+// multiple of 1/T Hz cancel exactly, unless it falls on an odd harmonic of
+// the emitter frequency. Each period is centred on its on phase
+// (hal_emitter_on()), so light that rises or fades steadily cancels too.
+// The DSP runs block by block as samples arrive: one add per sample,
+// nothing buffered.
+
+#define AQUA_LOCKIN_FULL_SCALE 4095     // Samples at 0 or here are clipped
+
+typedef struct {
+    uint32_t half_period;               // Samples per emitter half period
+    uint32_t pos;                       // Samples fed so far
+    int64_t on_sum;                     // Samples with the emitter on
+    int64_t off_sum;                    // ... and off
+    uint32_t on_count;
+    uint32_t off_count;
+    uint32_t clipped;                   // Samples at either rail
+} aqua_lockin_t;
+
+/**
+ * @brief Start a measurement; the first sample fed is conversion 0 of
+ *        hal_adc_read_modulated() with this half_period
+ */
+void aqua_lockin_init(aqua_lockin_t *l, uint32_t half_period);
+
+/**
+ * @brief Demodulate the next n samples (raw counts)
+ */
+void aqua_lockin_feed(aqua_lockin_t *l, const int16_t *samples, size_t n);
+
+/**
+ * @brief Add the sums of part, a measurement over whole emitter periods, to l
+ */
+void aqua_lockin_merge(aqua_lockin_t *l, const aqua_lockin_t *part);
+
+/**
+ * @brief Emitter signal: mean with the emitter on minus mean with it off
+ * @return Counts (fractional), 0.0f before a sample of each kind
+ */
+float aqua_lockin_amplitude(const aqua_lockin_t *l);
+
+/**
+ * @brief Light from other sources: mean with the emitter off, in counts
+ */
+float aqua_lockin_ambient(const aqua_lockin_t *l);
+
+#endif // AQUA_DSP_H
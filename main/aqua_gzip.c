@@ -0,0 +1,219 @@
+#include <string.h>
+#include "aqua_core.h"
+#include "aqua_gzip.h"
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define END_OF_BLOCK 256
+
+// Length codes 257..285 and distance codes 0..29 (RFC 1951, 3.2.5)
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void flush_out(aqua_gzip_t *z) {
+    if (z->out_len > 0 && !z->failed && !z->write(z->ctx, z->out, z->out_len)) {
+        z->failed = true;
+    }
+    z->size_out += (uint32_t)z->out_len;
+    z->out_len = 0;
+}
+
+static void put_byte(aqua_gzip_t *z, uint8_t b) {
+    z->out[z->out_len++] = b;
+    if (z->out_len == sizeof(z->out)) {
+        flush_out(z);
+    }
+}
+
+// Deflate packs bits starting with the least significant
+static void put_bits(aqua_gzip_t *z, uint32_t value, int count) {
+    z->bits |= value << z->bit_count;
+    z->bit_count += count;
+    while (z->bit_count >= 8) {
+        put_byte(z, (uint8_t)z->bits);
+        z->bits >>= 8;
+        z->bit_count -= 8;
+    }
+}
+
+// Huffman codes go most significant bit first
+static void put_code(aqua_gzip_t *z, uint32_t code, int len) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < len; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(z, reversed, len);
+}
+
+// Fixed literal/length code (RFC 1951, 3.2.6)
+static void put_symbol(aqua_gzip_t *z, int sym) {
+    if (sym < 144) {
+        put_code(z, 0x30 + sym, 8);
+    } else if (sym < 256) {
+        put_code(z, 0x190 + (sym - 144), 9);
+    } else if (sym < 280) {
+        put_code(z, sym - 256, 7);
+    } else {
+        put_code(z, 0xC0 + (sym - 280), 8);
+    }
+}
+
+static void put_match(aqua_gzip_t *z, int len, int dist) {
+    int lc = 28;
+    while (length_base[lc] > len) lc--;
+    put_symbol(z, 257 + lc);
+    put_bits(z, (uint32_t)(len - length_base[lc]), length_extra[lc]);
+
+    int dc = 29;
+    while (dist_base[dc] > dist) dc--;
+    put_code(z, (uint32_t)dc, 5);
+    put_bits(z, (uint32_t)(dist - dist_base[dc]), dist_extra[dc]);
+}
+
+static uint32_t hash3(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - AQUA_GZIP_HASH_BITS);
+}
+
+static void insert(aqua_gzip_t *z, size_t pos) {
+    if (pos + MIN_MATCH > z->end) {
+        return;
+    }
+    uint32_t h = hash3(&z->buf[pos]);
+    z->prev[pos & (AQUA_GZIP_WINDOW - 1)] = z->head[h];
+    z->head[h] = (uint16_t)(pos + 1);
+}
+
+// Longest earlier match for the string at pos, greedy
+static int find_match(aqua_gzip_t *z, size_t pos, int *dist) {
+    size_t avail = z->end - pos;
+    int limit = avail < MAX_MATCH ? (int)avail : MAX_MATCH;
+    int best = 0;
+    if (limit < MIN_MATCH) {
+        return 0;
+    }
+
+    const uint8_t *s = &z->buf[pos];
+    uint16_t cand = z->head[hash3(s)];
+    for (int chain = 0; cand != 0 && chain < AQUA_GZIP_MAX_CHAIN; chain++) {
+        size_t c = (size_t)cand - 1;
+        if (c >= pos || pos - c > AQUA_GZIP_WINDOW) {
+            break;
+        }
+        const uint8_t *m = &z->buf[c];
+        if (m[best] == s[best] && m[0] == s[0]) {
+            int len = 0;
+            while (len < limit && m[len] == s[len]) len++;
+            if (len > best) {
+                best = len;
+                *dist = (int)(pos - c);
+                if (len == limit) break;
+            }
+        }
+        uint16_t next = z->prev[c & (AQUA_GZIP_WINDOW - 1)];
+        if (next >= cand) {
+            break;
+        }
+        cand = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+// Encode while a full match length is buffered (all of it when flushing)
+static void encode(aqua_gzip_t *z, bool flush) {
+    size_t keep = flush ? 0 : MAX_MATCH - 1;
+    while (z->end - z->start > keep) {
+        size_t pos = z->start;
+        int dist = 0;
+        int len = find_match(z, pos, &dist);
+        insert(z, pos);
+        if (len) {
+            put_match(z, len, dist);
+            for (int i = 1; i < len; i++) {
+                insert(z, pos + (size_t)i);
+            }
+            z->start += (size_t)len;
+        } else {
+            put_symbol(z, z->buf[pos]);
+            z->start++;
+        }
+    }
+}
+
+// Drop the older half of the buffer; positions move down by the window
+static void slide(aqua_gzip_t *z) {
+    memmove(z->buf, z->buf + AQUA_GZIP_WINDOW, z->end - AQUA_GZIP_WINDOW);
+    z->start -= AQUA_GZIP_WINDOW;
+    z->end -= AQUA_GZIP_WINDOW;
+    for (size_t i = 0; i < sizeof(z->head) / sizeof(z->head[0]); i++) {
+        z->head[i] = z->head[i] > AQUA_GZIP_WINDOW ? (uint16_t)(z->head[i] - AQUA_GZIP_WINDOW) : 0;
+    }
+    for (size_t i = 0; i < AQUA_GZIP_WINDOW; i++) {
+        z->prev[i] = z->prev[i] > AQUA_GZIP_WINDOW ? (uint16_t)(z->prev[i] - AQUA_GZIP_WINDOW) : 0;
+    }
+}
+
+void aqua_gzip_init(aqua_gzip_t *z, aqua_gzip_write_fn write, void *ctx) {
+    memset(z, 0, sizeof(*z));
+    z->write = write;
+    z->ctx = ctx;
+
+    // Magic, deflate, no flags, no mtime, no extra flags, OS unknown
+    static const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    for (size_t i = 0; i < sizeof(header); i++) {
+        put_byte(z, header[i]);
+    }
+    put_bits(z, 1, 1);                  // Final block...
+    put_bits(z, 1, 2);                  // ... with fixed codes
+}
+
+bool aqua_gzip_feed(aqua_gzip_t *z, const void *data, size_t len) {
+    const uint8_t *p = data;
+    z->crc = aqua_crc32(z->crc, data, len);
+    z->size_in += (uint32_t)len;
+    while (len > 0) {
+        if (z->end == sizeof(z->buf)) {
+            encode(z, false);
+            slide(z);
+        }
+        size_t n = sizeof(z->buf) - z->end;
+        if (n > len) n = len;
+        memcpy(z->buf + z->end, p, n);
+        z->end += n;
+        p += n;
+        len -= n;
+    }
+    encode(z, false);
+    return !z->failed;
+}
+
+bool aqua_gzip_finish(aqua_gzip_t *z) {
+    encode(z, true);
+    put_symbol(z, END_OF_BLOCK);
+    if (z->bit_count > 0) {
+        put_bits(z, 0, 8 - z->bit_count);
+    }
+    for (int i = 0; i < 4; i++) put_byte(z, (uint8_t)(z->crc >> (8 * i)));
+    for (int i = 0; i < 4; i++) put_byte(z, (uint8_t)(z->size_in >> (8 * i)));
+    flush_out(z);
+    return !z->failed;
+}
+
+size_t aqua_gzip_bound(size_t len) {
+    // Every byte a 9-bit literal at worst, plus header, block bits and trailer
+    return len + (len + 7) / 8 + 10 + 2 + 8;
+}
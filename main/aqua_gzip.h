@@ -0,0 +1,71 @@
+#ifndef AQUA_GZIP_H
+#define AQUA_GZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming gzip compressor for request bodies (Content-Encoding: gzip).
+//
+// Deflate with LZ77 over a AQUA_GZIP_WINDOW byte window and the fixed
+// Huffman codes, in a single block: no code tables are built or sent, so
+// state is a few KiB and the output can be decoded by any inflater. Telemetry
+// rows repeat their field names and most of their values, so matches carry
+// nearly all of it; the fixed codes cost little against dynamic ones there.
+//
+// Input can be fed in pieces of any size; output goes to the write callback
+// in small chunks as it is produced.
+
+#define AQUA_GZIP_WINDOW 1024           // Longest match distance (power of two)
+#define AQUA_GZIP_HASH_BITS 10
+#define AQUA_GZIP_MAX_CHAIN 16          // Candidates tried per position
+
+/**
+ * @brief Append len compressed bytes to the output
+ */
+typedef bool (*aqua_gzip_write_fn)(void *ctx, const void *data, size_t len);
+
+typedef struct {
+    aqua_gzip_write_fn write;
+    void *ctx;
+    bool failed;                        // A write failed; sticky
+
+    uint8_t buf[2 * AQUA_GZIP_WINDOW];  // Window, then input not yet encoded
+    size_t start;                       // Next byte to encode
+    size_t end;                         // Bytes held
+    uint16_t head[1 << AQUA_GZIP_HASH_BITS];   // Newest position + 1 per hash, 0 = none
+    uint16_t prev[AQUA_GZIP_WINDOW];    // Previous position + 1 with the same hash
+
+    uint32_t bits;                      // Output bits not yet in out[]
+    int bit_count;
+    uint8_t out[128];
+    size_t out_len;
+
+    uint32_t crc;
+    uint32_t size_in;
+    uint32_t size_out;
+} aqua_gzip_t;
+
+/**
+ * @brief Start a gzip stream; the header is written immediately
+ */
+void aqua_gzip_init(aqua_gzip_t *z, aqua_gzip_write_fn write, void *ctx);
+
+/**
+ * @brief Compress the next piece of input
+ * @return false once a write has failed
+ */
+bool aqua_gzip_feed(aqua_gzip_t *z, const void *data, size_t len);
+
+/**
+ * @brief Encode the rest of the input and write the trailer
+ * @return false if any write failed
+ */
+bool aqua_gzip_finish(aqua_gzip_t *z);
+
+/**
+ * @brief Largest possible stream for len bytes of input
+ */
+size_t aqua_gzip_bound(size_t len);
+
+#endif // AQUA_GZIP_H
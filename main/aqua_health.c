@@ -0,0 +1,88 @@
+#include <math.h>
+#include <string.h>
+#include "aqua_health.h"
+
+void aqua_health_init(aqua_health_t *h, const aqua_health_limits_t *limits) {
+    memset(h, 0, sizeof(*h));
+    h->limits = *limits;
+}
+
+// Running average for the first n samples, then a fixed window
+static float weight(uint32_t n) {
+    return 1.0f / (float)(n < AQUA_HEALTH_WINDOW ? n : AQUA_HEALTH_WINDOW);
+}
+
+static void update_rate(float *rate, bool hit, float w) {
+    *rate += w * ((hit ? 1.0f : 0.0f) - *rate);
+}
+
+// ========== RECORDING ==========
+void aqua_health_record(aqua_health_t *h, aqua_read_status_t status, float value) {
+    float w = weight(++h->reads);
+    update_rate(&h->no_response_rate, status == AQUA_READ_NO_RESPONSE, w);
+    update_rate(&h->crc_rate, status == AQUA_READ_BAD_CRC, w);
+    update_rate(&h->range_rate, status == AQUA_READ_OUT_OF_RANGE, w);
+
+    if (status != AQUA_READ_OK && status != AQUA_READ_BAD_CRC) {
+        h->same_count = 0;
+    } else if (h->same_count > 0 && value == h->last_value) {
+        h->same_count++;
+    } else {
+        h->last_value = value;
+        h->same_count = 1;
+    }
+}
+
+void aqua_health_record_samples(aqua_health_t *h, const int *samples, int count) {
+    if (count < 2) return;
+    float mean = 0.0f;
+    for (int i = 0; i < count; i++) mean += (float)samples[i];
+    mean /= (float)count;
+    float var = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float d = (float)samples[i] - mean;
+        var += d * d;
+    }
+    var /= (float)(count - 1);
+
+    h->noise_var += weight(++h->noise_reads) * (var - h->noise_var);
+}
+
+void aqua_health_record_presence(aqua_health_t *h, int presence_us) {
+    float w = weight(++h->presence_reads);
+    float d = (float)presence_us - h->presence_mean_us;
+    h->presence_mean_us += w * d;
+    h->presence_var = (1.0f - w) * (h->presence_var + w * d * d);
+}
+
+// ========== SCORING ==========
+bool aqua_health_stuck(const aqua_health_t *h) {
+    return h->limits.stuck_reads > 0 && h->same_count >= h->limits.stuck_reads;
+}
+
+int aqua_health_score(const aqua_health_t *h) {
+    const aqua_health_limits_t *l = &h->limits;
+    float score = 100.0f;
+    if (h->reads == 0) return 100;
+
+    score -= 60.0f * h->no_response_rate;
+    score -= 50.0f * h->crc_rate;
+    score -= 50.0f * h->range_rate;
+    if (aqua_health_stuck(h)) {
+        score -= 40.0f;
+    }
+    if (l->noise_limit > 0 && h->noise_reads > 0 && h->noise_var > l->noise_limit * l->noise_limit) {
+        score -= 20.0f;
+    }
+    if (l->presence_max_us > 0 && h->presence_reads > 0) {
+        if (h->presence_mean_us < (float)l->presence_min_us ||
+            h->presence_mean_us > (float)l->presence_max_us) {
+            score -= 20.0f;
+        }
+        if (sqrtf(h->presence_var) > (float)(l->presence_max_us - l->presence_min_us) / 4.0f) {
+            score -= 10.0f;
+        }
+    }
+    if (score < 0.0f) score = 0.0f;
+    return (int)lroundf(score);
+}
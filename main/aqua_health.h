@@ -0,0 +1,84 @@
+#ifndef AQUA_HEALTH_H
+#define AQUA_HEALTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Incremental sensor health, fed from the production reads.
+//
+// Each read updates a few running statistics in O(1) time and memory:
+// exponentially weighted rates of missing responses, CRC failures and
+// out-of-range values, the mean and variance of the 1-Wire presence pulse,
+// the spread of the raw samples within one read, and the length of the
+// current run of identical values. aqua_health_score() folds them into 0-100.
+//
+// The weights start as a plain average (the first read counts fully, so a
+// sensor that never answered is not reported healthy) and settle at
+// 1/AQUA_HEALTH_WINDOW.
+
+#define AQUA_HEALTH_WINDOW 32       // Reads a rate mostly reflects once warmed up
+
+typedef enum {
+    AQUA_READ_OK,
+    AQUA_READ_NO_RESPONSE,          // Timeout or no presence pulse
+    AQUA_READ_BAD_CRC,              // Value decoded, checksum did not match
+    AQUA_READ_OUT_OF_RANGE,         // Answered with a value the sensor cannot produce
+} aqua_read_status_t;
+
+// Per-sensor limits; 0 turns a check off
+typedef struct {
+    uint32_t stuck_reads;           // Identical values in a row that count as stuck
+    float noise_limit;              // Standard deviation of one read's raw samples
+    int presence_min_us;            // Presence pulse length window
+    int presence_max_us;
+} aqua_health_limits_t;
+
+typedef struct {
+    aqua_health_limits_t limits;
+    uint32_t reads;
+    float no_response_rate;
+    float crc_rate;
+    float range_rate;
+    uint32_t noise_reads;
+    float noise_var;                // Weighted mean of the within-read variance
+    uint32_t presence_reads;
+    float presence_mean_us;
+    float presence_var;
+    float last_value;
+    uint32_t same_count;            // Reads in a row that returned last_value
+} aqua_health_t;
+
+void aqua_health_init(aqua_health_t *h, const aqua_health_limits_t *limits);
+
+/**
+ * @brief Fold one read into the rates and the stuck detector
+ * @param value Decoded value; only used for AQUA_READ_OK and AQUA_READ_BAD_CRC
+ */
+void aqua_health_record(aqua_health_t *h, aqua_read_status_t status, float value);
+
+/**
+ * @brief Fold in the spread of the raw samples averaged into one read
+ */
+void aqua_health_record_samples(aqua_health_t *h, const int *samples, int count);
+
+/**
+ * @brief Fold in the length of a presence pulse that was seen
+ */
+void aqua_health_record_presence(aqua_health_t *h, int presence_us);
+
+/**
+ * @brief True once the last limits.stuck_reads values were identical
+ */
+bool aqua_health_stuck(const aqua_health_t *h);
+
+/**
+ * @brief 0-100: 100 minus weighted penalties for each failing statistic
+ *
+ * No-response rate costs up to 60, CRC and out-of-range rates up to 50 each,
+ * a stuck value 40, excess noise 20, and a presence pulse outside the window
+ * 20 (10 more if its length wanders by over a quarter of the window). 100
+ * before the first read.
+ */
+int aqua_health_score(const aqua_health_t *h);
+
+#endif // AQUA_HEALTH_H
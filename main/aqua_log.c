@@ -0,0 +1,408 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "hal.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#define AQUA_LOG_NOINIT __NOINIT_ATTR
+#else
+#define AQUA_LOG_NOINIT
+#endif
+
+#define TAG "AQUA"
+#define AQUA_LOG_MAGIC 0x41514C31u  // "AQL1"
+#define AQUA_LOG_LINE_BYTES 96      // Raw bytes per "AQL:" console line (whole records)
+
+static const aqua_log_msg_t s_messages[AQUA_MSG_COUNT] = {
+#define AQUA_LOG_X_TABLE(id, level, sig, fmt) [AQUA_MSG_##id] = { ESP_LOG_##level, sig, fmt },
+    AQUA_LOG_MESSAGES(AQUA_LOG_X_TABLE)
+#undef AQUA_LOG_X_TABLE
+};
+
+// Ring state lives in no-init RAM on the device so records written just
+// before a panic or watchdog reset can still be flushed after reboot.
+typedef struct {
+    uint32_t magic;
+    uint32_t head;      // Next write offset
+    uint32_t tail;      // Oldest record
+    uint32_t used;      // Bytes between tail and head
+    uint32_t dropped;   // Records overwritten since the last drain
+} aqua_log_ring_t;
+
+static AQUA_LOG_NOINIT aqua_log_ring_t s_ring;
+static AQUA_LOG_NOINIT uint8_t s_ring_buf[AQUA_LOG_RING_SIZE];
+
+static aqua_log_mode_t s_mode = AQUA_LOG_DEFERRED ? AQUA_LOG_MODE_DEFERRED : AQUA_LOG_MODE_TEXT;
+static esp_log_level_t s_level = ESP_LOG_INFO;
+static bool s_hash_reported;
+
+static void console_sink(const uint8_t *data, size_t len);
+static aqua_log_sink_t s_sink = console_sink;
+
+// ========== RING BUFFER ==========
+static void ring_reset(void) {
+    memset(&s_ring, 0, sizeof(s_ring));
+    s_ring.magic = AQUA_LOG_MAGIC;
+}
+
+static bool ring_valid(void) {
+    return s_ring.magic == AQUA_LOG_MAGIC &&
+           s_ring.head < AQUA_LOG_RING_SIZE &&
+           s_ring.tail < AQUA_LOG_RING_SIZE &&
+           s_ring.used <= AQUA_LOG_RING_SIZE &&
+           (s_ring.tail + s_ring.used) % AQUA_LOG_RING_SIZE == s_ring.head;
+}
+
+// Length byte of the oldest record, 0 if the ring is corrupt
+static uint32_t ring_front_len(void) {
+    uint32_t len = s_ring_buf[s_ring.tail];
+    if (len < AQUA_LOG_HEADER_SIZE || len > s_ring.used) {
+        return 0;
+    }
+    return len;
+}
+
+static void ring_copy_in(const uint8_t *src, uint32_t len) {
+    uint32_t first = AQUA_LOG_RING_SIZE - s_ring.head;
+    if (first > len) first = len;
+    memcpy(&s_ring_buf[s_ring.head], src, first);
+    memcpy(s_ring_buf, src + first, len - first);
+    s_ring.head = (s_ring.head + len) % AQUA_LOG_RING_SIZE;
+    s_ring.used += len;
+}
+
+static void ring_copy_out(uint8_t *dst, uint32_t len) {
+    uint32_t first = AQUA_LOG_RING_SIZE - s_ring.tail;
+    if (first > len) first = len;
+    memcpy(dst, &s_ring_buf[s_ring.tail], first);
+    memcpy(dst + first, s_ring_buf, len - first);
+    s_ring.tail = (s_ring.tail + len) % AQUA_LOG_RING_SIZE;
+    s_ring.used -= len;
+}
+
+static void ring_push(const uint8_t *rec, uint32_t len) {
+    if (!ring_valid()) {
+        ring_reset();
+    }
+    // Overwrite the oldest records to make room
+    while (AQUA_LOG_RING_SIZE - s_ring.used < len) {
+        uint32_t front = ring_front_len();
+        if (front == 0) {
+            ring_reset();
+            break;
+        }
+        s_ring.tail = (s_ring.tail + front) % AQUA_LOG_RING_SIZE;
+        s_ring.used -= front;
+        s_ring.dropped++;
+    }
+    ring_copy_in(rec, len);
+}
+
+void aqua_log_init(void) {
+    if (!ring_valid()) {
+        ring_reset();
+        return;
+    }
+    if (s_ring.used > 0) {
+        AQUA_LOG(LOG_RETAINED, (int)s_ring.used);
+    }
+}
+
+void aqua_log_set_mode(aqua_log_mode_t mode) {
+    s_mode = mode;
+}
+
+aqua_log_mode_t aqua_log_get_mode(void) {
+    return s_mode;
+}
+
+void aqua_log_set_level(esp_log_level_t level) {
+    s_level = level;
+}
+
+const aqua_log_msg_t *aqua_log_msg(aqua_msg_id_t id) {
+    return ((int)id >= 0 && (int)id < AQUA_MSG_COUNT) ? &s_messages[id] : NULL;
+}
+
+uint32_t aqua_log_table_hash(void) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < AQUA_MSG_COUNT; i++) {
+        const char *parts[2] = { s_messages[i].signature, s_messages[i].format };
+        for (int p = 0; p < 2; p++) {
+            for (const char *c = parts[p]; *c; c++) {
+                hash = (hash ^ (uint8_t)*c) * 16777619u;
+            }
+            hash = (hash ^ 0xFFu) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// ========== EMIT ==========
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void emit_text(const aqua_log_msg_t *msg, va_list args) {
+    char line[384];
+    vsnprintf(line, sizeof(line), msg->format, args);
+
+    switch (msg->level) {
+    case ESP_LOG_ERROR: ESP_LOGE(TAG, "%s", line); break;
+    case ESP_LOG_WARN: ESP_LOGW(TAG, "%s", line); break;
+    case ESP_LOG_INFO: ESP_LOGI(TAG, "%s", line); break;
+    case ESP_LOG_DEBUG: ESP_LOGD(TAG, "%s", line); break;
+    default: ESP_LOGV(TAG, "%s", line); break;
+    }
+}
+
+static void emit_record(aqua_msg_id_t id, const aqua_log_msg_t *msg, va_list args) {
+    uint8_t rec[AQUA_LOG_RECORD_MAX];
+    uint32_t len = AQUA_LOG_HEADER_SIZE;
+
+    for (const char *sig = msg->signature; *sig; sig++) {
+        if (*sig == 's') {
+            const char *str = va_arg(args, const char *);
+            size_t n = str ? strlen(str) : 0;
+            if (n > AQUA_LOG_MAX_STR) n = AQUA_LOG_MAX_STR;
+            if (len + 1 + n > sizeof(rec)) n = 0;
+            rec[len++] = (uint8_t)n;
+            memcpy(&rec[len], str, n);
+            len += (uint32_t)n;
+        } else {
+            uint32_t raw;
+            if (*sig == 'f') {
+                float f = (float)va_arg(args, double);
+                memcpy(&raw, &f, sizeof(raw));
+            } else {
+                raw = (uint32_t)va_arg(args, int);
+            }
+            put_u32(&rec[len], raw);
+            len += 4;
+        }
+    }
+
+    rec[0] = (uint8_t)len;
+    rec[1] = (uint8_t)id;
+    rec[2] = (uint8_t)(id >> 8);
+    put_u32(&rec[3], (uint32_t)(hal_time_us() / 1000));
+    ring_push(rec, len);
+}
+
+void aqua_log_emit(aqua_msg_id_t id, ...) {
+    const aqua_log_msg_t *msg = aqua_log_msg(id);
+    if (!msg) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, id);
+    if (s_mode == AQUA_LOG_MODE_TEXT) {
+        emit_text(msg, args);
+    } else if (msg->level <= s_level) {
+        emit_record(id, msg, args);
+    }
+    va_end(args);
+}
+
+// ========== DRAIN ==========
+size_t aqua_log_pending(void) {
+    return ring_valid() ? s_ring.used : 0;
+}
+
+size_t aqua_log_drain(uint8_t *out, size_t size) {
+    size_t written = 0;
+
+    if (!ring_valid()) {
+        ring_reset();
+        return 0;
+    }
+
+    // Report overwritten records first so the gap is visible in the output
+    if (s_ring.dropped > 0 && size >= AQUA_LOG_HEADER_SIZE + 4) {
+        uint8_t rec[AQUA_LOG_HEADER_SIZE + 4];
+        rec[0] = sizeof(rec);
+        rec[1] = (uint8_t)AQUA_MSG_LOG_DROPPED;
+        rec[2] = (uint8_t)(AQUA_MSG_LOG_DROPPED >> 8);
+        put_u32(&rec[3], (uint32_t)(hal_time_us() / 1000));
+        put_u32(&rec[7], s_ring.dropped);
+        memcpy(out, rec, sizeof(rec));
+        written = sizeof(rec);
+        s_ring.dropped = 0;
+    }
+
+    while (s_ring.used > 0) {
+        uint32_t len = ring_front_len();
+        if (len == 0) {
+            ring_reset();
+            break;
+        }
+        if (written + len > size) {
+            break;
+        }
+        ring_copy_out(out + written, len);
+        written += len;
+    }
+    return written;
+}
+
+static void console_sink(const uint8_t *data, size_t len) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char line[4 + (AQUA_LOG_RECORD_MAX + 2) / 3 * 4 + 2];
+    size_t n = 0;
+
+    memcpy(line, "AQL:", 4);
+    n = 4;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        line[n++] = alphabet[(v >> 18) & 0x3F];
+        line[n++] = alphabet[(v >> 12) & 0x3F];
+        line[n++] = i + 1 < len ? alphabet[(v >> 6) & 0x3F] : '=';
+        line[n++] = i + 2 < len ? alphabet[v & 0x3F] : '=';
+    }
+    line[n++] = '\n';
+    fwrite(line, 1, n, stdout);
+}
+
+void aqua_log_set_sink(aqua_log_sink_t sink) {
+    s_sink = sink ? sink : console_sink;
+}
+
+void aqua_log_flush(void) {
+    if (!s_hash_reported && s_mode == AQUA_LOG_MODE_DEFERRED && s_sink == console_sink) {
+        printf("AQL#%08lx\n", (unsigned long)aqua_log_table_hash());
+        s_hash_reported = true;
+    }
+
+    // Drain in line-sized chunks; a record longer than a line gets its own
+    uint8_t chunk[AQUA_LOG_RECORD_MAX];
+    while (aqua_log_pending() > 0 || s_ring.dropped > 0) {
+        size_t want = ring_front_len();
+        if (want < AQUA_LOG_LINE_BYTES) want = AQUA_LOG_LINE_BYTES;
+        size_t n = aqua_log_drain(chunk, want);
+        if (n == 0) {
+            break;
+        }
+        s_sink(chunk, n);
+    }
+    fflush(stdout);
+}
+
+// ========== DECODE / FORMAT ==========
+size_t aqua_log_decode(const uint8_t *buf, size_t len, aqua_log_record_t *rec) {
+    if (len < AQUA_LOG_HEADER_SIZE || buf[0] < AQUA_LOG_HEADER_SIZE || buf[0] > len) {
+        return 0;
+    }
+    size_t rec_len = buf[0];
+    const aqua_log_msg_t *msg = aqua_log_msg((aqua_msg_id_t)(buf[1] | (buf[2] << 8)));
+    if (!msg) {
+        return 0;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    rec->id = (aqua_msg_id_t)(buf[1] | (buf[2] << 8));
+    rec->timestamp_ms = get_u32(&buf[3]);
+
+    size_t pos = AQUA_LOG_HEADER_SIZE;
+    for (const char *sig = msg->signature; *sig; sig++) {
+        if (rec->argc == AQUA_LOG_MAX_ARGS) {
+            return 0;
+        }
+        if (*sig == 's') {
+            if (pos + 1 > rec_len || pos + 1 + buf[pos] > rec_len) return 0;
+            rec->args[rec->argc].s.len = buf[pos];
+            rec->args[rec->argc].s.ptr = (const char *)&buf[pos + 1];
+            pos += 1 + buf[pos];
+        } else {
+            if (pos + 4 > rec_len) return 0;
+            uint32_t raw = get_u32(&buf[pos]);
+            memcpy(&rec->args[rec->argc], &raw, sizeof(raw));
+            pos += 4;
+        }
+        rec->argc++;
+    }
+    return pos == rec_len ? rec_len : 0;
+}
+
+int aqua_log_format(const aqua_log_record_t *rec, char *out, size_t size) {
+    const aqua_log_msg_t *msg = aqua_log_msg(rec->id);
+    if (!msg || size == 0) {
+        return -1;
+    }
+
+    size_t n = 0;
+    int arg = 0;
+    out[0] = '\0';
+    for (const char *p = msg->format; *p; ) {
+        if (*p != '%') {
+            if (n + 1 < size) out[n++] = *p;
+            p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            if (n + 1 < size) out[n++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Copy one conversion spec, e.g. "%02X" or "%.2f"
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p && !strchr("diouxXcfeEgGs", *p) && s < sizeof(spec) - 2) {
+            spec[s++] = *p++;
+        }
+        if (!*p || arg >= rec->argc || arg >= (int)strlen(msg->signature)) {
+            return -1;
+        }
+        char conv = *p++;
+        spec[s++] = conv;
+        spec[s] = '\0';
+
+        char sig = msg->signature[arg];
+        char piece[AQUA_LOG_MAX_STR + 32];
+        if (conv == 's' && sig == 's') {
+            char str[AQUA_LOG_MAX_STR + 1];
+            memcpy(str, rec->args[arg].s.ptr, rec->args[arg].s.len);
+            str[rec->args[arg].s.len] = '\0';
+            snprintf(piece, sizeof(piece), spec, str);
+        } else if (strchr("feEgG", conv) && sig == 'f') {
+            snprintf(piece, sizeof(piece), spec, (double)rec->args[arg].f);
+        } else if (strchr("diouxXc", conv) && sig == 'i') {
+            snprintf(piece, sizeof(piece), spec, rec->args[arg].i);
+        } else {
+            return -1;
+        }
+        arg++;
+
+        for (const char *c = piece; *c && n + 1 < size; c++) {
+            out[n++] = *c;
+        }
+    }
+    out[n] = '\0';
+    return arg == rec->argc && arg == (int)strlen(msg->signature) ? (int)n : -1;
+}
+
+// ========== STATE-CHANGE GATE ==========
+bool aqua_log_gate(aqua_log_gate_t *gate, uint32_t state, int64_t now_us, int64_t repeat_us) {
+    if (!gate->primed || gate->state != state || now_us - gate->last_us >= repeat_us) {
+        gate->primed = true;
+        gate->state = state;
+        gate->last_us = now_us;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,137 @@
+#ifndef AQUA_LOG_H
+#define AQUA_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "aqua_log_msgs.h"
+
+// Structured logging for the monitoring cycle.
+//
+// AQUA_LOG(ID, args...) looks up ID in aqua_log_msgs.h. In text mode the
+// message is formatted and written through ESP_LOGx as before. In deferred
+// mode a compact binary record (message ID, timestamp, raw arguments) is
+// appended to a RAM ring buffer instead; aqua_log_flush() drains it to the
+// console as "AQL:" base64 lines, which host/tools/aqua_logdecode formats
+// using the same message table.
+//
+// Record layout (little endian):
+//   u8 length | u16 id | u32 timestamp_ms | arguments
+// with 'i' and 'f' arguments as 4 bytes and 's' as u8 length + bytes.
+
+#define AQUA_LOG_RING_SIZE 4096       // Bytes of records kept on device
+#define AQUA_LOG_MAX_STR 96           // Longer string arguments are truncated
+#define AQUA_LOG_MAX_ARGS 10
+#define AQUA_LOG_RECORD_MAX 255
+#define AQUA_LOG_HEADER_SIZE 7
+
+typedef enum {
+#define AQUA_LOG_X_ENUM(id, level, sig, fmt) AQUA_MSG_##id,
+    AQUA_LOG_MESSAGES(AQUA_LOG_X_ENUM)
+#undef AQUA_LOG_X_ENUM
+    AQUA_MSG_COUNT
+} aqua_msg_id_t;
+
+typedef struct {
+    esp_log_level_t level;
+    const char *signature;
+    const char *format;
+} aqua_log_msg_t;
+
+typedef enum {
+    AQUA_LOG_MODE_TEXT = 0,
+    AQUA_LOG_MODE_DEFERRED
+} aqua_log_mode_t;
+
+// One decoded record; string arguments point into the record buffer
+typedef struct {
+    aqua_msg_id_t id;
+    uint32_t timestamp_ms;
+    int argc;
+    union {
+        int32_t i;
+        float f;
+        struct {
+            const char *ptr;
+            uint8_t len;
+        } s;
+    } args[AQUA_LOG_MAX_ARGS];
+} aqua_log_record_t;
+
+#define AQUA_LOG(id, ...) aqua_log_emit(AQUA_MSG_##id, ##__VA_ARGS__)
+
+/**
+ * @brief Initialize the ring buffer, keeping records that survived a soft reset
+ */
+void aqua_log_init(void);
+
+void aqua_log_set_mode(aqua_log_mode_t mode);
+aqua_log_mode_t aqua_log_get_mode(void);
+
+/**
+ * @brief Minimum level recorded in deferred mode (text mode follows esp_log_level_set)
+ */
+void aqua_log_set_level(esp_log_level_t level);
+
+/**
+ * @brief Emit message id with arguments matching its table signature
+ */
+void aqua_log_emit(aqua_msg_id_t id, ...);
+
+const aqua_log_msg_t *aqua_log_msg(aqua_msg_id_t id);
+
+/**
+ * @brief FNV-1a hash over the message table, used to match decoder and firmware
+ */
+uint32_t aqua_log_table_hash(void);
+
+/**
+ * @brief Move whole records out of the ring buffer
+ * @return Number of bytes written to out
+ */
+size_t aqua_log_drain(uint8_t *out, size_t size);
+
+size_t aqua_log_pending(void);
+
+/**
+ * @brief Receives drained records from aqua_log_flush(), at most one line's worth at a time
+ */
+typedef void (*aqua_log_sink_t)(const uint8_t *records, size_t len);
+
+/**
+ * @brief Replace the console sink (NULL restores it)
+ */
+void aqua_log_set_sink(aqua_log_sink_t sink);
+
+/**
+ * @brief Drain the ring buffer to the sink; the default sink prints "AQL:" base64 lines
+ */
+void aqua_log_flush(void);
+
+/**
+ * @brief Parse one record from buf
+ * @return Bytes consumed, 0 if the record is truncated or malformed
+ */
+size_t aqua_log_decode(const uint8_t *buf, size_t len, aqua_log_record_t *rec);
+
+/**
+ * @brief Format a decoded record's message text (without level/timestamp prefix)
+ * @return Length of the text, -1 if it does not match the table
+ */
+int aqua_log_format(const aqua_log_record_t *rec, char *out, size_t size);
+
+// State-change gate for banner-style messages: opens when the observed state
+// changes, and again every repeat_us while it stays unchanged.
+typedef struct {
+    uint32_t state;
+    int64_t last_us;
+    bool primed;
+} aqua_log_gate_t;
+
+/**
+ * @brief Returns true if a message about state should be logged now
+ */
+bool aqua_log_gate(aqua_log_gate_t *gate, uint32_t state, int64_t now_us, int64_t repeat_us);
+
+#endif // AQUA_LOG_H
@@ -0,0 +1,215 @@
+#ifndef AQUA_LOG_MSGS_H
+#define AQUA_LOG_MSGS_H
+
+// Message table for AQUA_LOG(). Shared by the firmware and the host decoder
+// (host/tools/aqua_logdecode.c), so deferred records only carry the message
+// ID and raw arguments.
+//
+//   X(ID, LEVEL, SIGNATURE, FORMAT)
+//
+// SIGNATURE has one character per argument: 'i' int, 'f' float/double,
+// 's' string. It must match the conversions in FORMAT (checked by the host
+// tests). Append new entries at the end: IDs are positional, and the table
+// hash reported at boot lets the decoder detect a stale table.
+
+#define AQUA_LOG_MESSAGES(X) \
+    /* Log subsystem */ \
+    X(LOG_DROPPED,          WARN,  "i",     "[LOG] %d records overwritten before they were flushed") \
+    X(LOG_RETAINED,         INFO,  "i",     "[LOG] %d bytes of records retained across reset") \
+    /* Cycle (aqua_cycle.c) */ \
+    X(CYCLE_START,          INFO,  "i",     "\n========== CYCLE #%d ==========") \
+    X(CYCLE_READ_DHT,       INFO,  "",      "Reading DHT22 sensor...") \
+    X(CYCLE_DHT_FAILED,     ERROR, "i",     "DHT22 READ FAILED - Sensor not responding (GPIO %d)") \
+    X(CYCLE_ERROR,          ERROR, "s",     "Error: %s") \
+    X(CYCLE_AIR,            INFO,  "ff",    "Air Temp: %.1f°C, Humidity: %.1f%%") \
+    X(CYCLE_READ_WATER,     INFO,  "",      "Reading water temperature...") \
+    X(CYCLE_WATER,          INFO,  "f",     "Water Temp: %.1f°C") \
+    X(CYCLE_READ_PH,        INFO,  "",      "Reading pH...") \
+    X(CYCLE_PH_ERROR,       ERROR, "ii",    "pH sensor error - ADC channel %d (GPIO %d) reading failed") \
+    X(CYCLE_CHECK_SENSOR,   ERROR, "",      "Check sensor connection, power supply, and calibration") \
+    X(CYCLE_PH,             INFO,  "f",     "pH: %.2f (connected and working)") \
+    X(CYCLE_READ_DO,        INFO,  "",      "Reading dissolved oxygen...") \
+    X(CYCLE_DO_ERROR,       ERROR, "ii",    "DO sensor error - ADC channel %d (GPIO %d) reading failed") \
+    X(CYCLE_DO_MISSING,     ERROR, "",      "Sensor not connected yet - will be available when DO sensor is added") \
+    X(CYCLE_DO,             INFO,  "f",     "DO: %.2f mg/L (connected and working)") \
+    X(CYCLE_READ_TURB,      INFO,  "",      "Reading turbidity...") \
+    X(CYCLE_TURB_ERROR,     ERROR, "ii",    "Turbidity sensor error - ADC channel %d (GPIO %d) reading failed") \
+    X(CYCLE_TURB,           INFO,  "f",     "Turbidity: %.2f NTU (connected and working)") \
+    X(CYCLE_READ_NH3,       INFO,  "",      "Reading ammonia...") \
+    X(CYCLE_NH3_ERROR,      ERROR, "ii",    "Ammonia sensor error - ADC channel %d (GPIO %d) reading failed") \
+    X(CYCLE_NH3_MISSING,    ERROR, "",      "Sensor not connected yet - will be available when ammonia sensor is added") \
+    X(CYCLE_NH3,            INFO,  "f",     "Ammonia: %.2f mg/L (connected and working)") \
+    X(CYCLE_CONTROLS,       INFO,  "ssss",  "Control States - pH Relay: %s, Aerator: %s, Filter: %s, Pump: %s") \
+    X(CYCLE_FINAL,          INFO,  "fffs",  "FINAL READINGS: Temperature=%.1f°C, Humidity=%.1f%%, pH=%.2f, Relay=%s") \
+    X(CYCLE_POLLING,        INFO,  "",      "Polling for relay control commands...") \
+    X(CYCLE_SENDING,        INFO,  "",      "Sending data to Supabase...") \
+    X(CYCLE_UPLOAD_FAILED,  WARN,  "",      "UPLOAD FAILED") \
+    X(CYCLE_ALERTS,         INFO,  "",      "Checking alert conditions...") \
+    /* Relay polling and upload (supabase.c) */ \
+    X(RELAY_PH,             INFO,  "s",     "[RELAY] pH relay set to %s") \
+    X(RELAY_AERATOR,        INFO,  "s",     "[RELAY] Aerator set to %s") \
+    X(RELAY_FILTER,         INFO,  "s",     "[RELAY] Filter set to %s") \
+    X(RELAY_PUMP,           INFO,  "s",     "[RELAY] Pump relay set to %s") \
+    X(RELAY_POLLING,        INFO,  "",      "[RELAY] Polling for relay control commands...") \
+    X(RELAY_RECEIVED,       INFO,  "s",     "[RELAY] Received commands: %s") \
+    X(RELAY_ATTEMPT_FAILED, WARN,  "iis",   "[RELAY] Poll attempt %d failed. Status: %d, Error: %s") \
+    X(RELAY_ALL_FAILED,     ERROR, "",      "[RELAY] All polling attempts failed") \
+    X(UPLOAD_INVALID,       ERROR, "",      "Invalid sensor values detected") \
+    X(UPLOAD_TOO_LARGE,     ERROR, "i",     "[SUPABASE] Payload does not fit in %d bytes") \
+    X(SENSOR_MISSING,       ERROR, "si",    "CRITICAL: %s sensor not connected (GPIO %d)") \
+    X(SENSORS_MISSING,      ERROR, "i",     "SYSTEM FAILURE: %d OUT OF 3 CRITICAL SENSORS MISSING") \
+    X(SENSORS_RESTORED,     INFO,  "",      "All critical sensors connected") \
+    X(UPLOAD_PREPARING,     INFO,  "",      "[SUPABASE] Preparing HTTP request...") \
+    X(UPLOAD_URL,           INFO,  "s",     "[SUPABASE] URL: %s") \
+    X(UPLOAD_METHOD,        INFO,  "",      "[SUPABASE] Method: POST") \
+    X(UPLOAD_HEADERS,       INFO,  "",      "[SUPABASE] Headers: Content-Type=application/json, apikey=*****, Authorization=Bearer *****") \
+    X(UPLOAD_PAYLOAD,       INFO,  "s",     "[SUPABASE] Payload: %s") \
+    X(UPLOAD_400,           ERROR, "s",     "[SUPABASE] 400 Error Response: %s") \
+    X(UPLOAD_OK,            INFO,  "i",     "[SUPABASE] Data sent successfully (Status: %d)") \
+    X(UPLOAD_ATTEMPT_FAILED, WARN, "iis",   "[SUPABASE] Attempt %d failed. Status: %d, Error: %s") \
+    X(UPLOAD_RETRY,         INFO,  "i",     "[SUPABASE] Retrying in %d ms...") \
+    X(UPLOAD_ALL_FAILED,    ERROR, "i",     "[SUPABASE] All %d attempts failed") \
+    X(ALERT_TOO_LARGE,      ERROR, "i",     "[ALERTS] Payload does not fit in %d bytes") \
+    X(ALERT_SENT,           INFO,  "",      "Alert notification sent successfully") \
+    X(ALERT_FAILED,         ERROR, "",      "Failed to send alert notification") \
+    /* Sensor drivers (sensors.c) */ \
+    X(DHT_RAW,              INFO,  "iiiii", "DHT22 Raw data: %d %d %d %d %d") \
+    X(DS_HW_TEST,           INFO,  "",      "🔧 HARDWARE DETECTION TEST") \
+    X(DS_GPIO_TOGGLE,       INFO,  "",      "✓ GPIO toggle test passed") \
+    X(DS_PULLUP,            INFO,  "s",     "✓ Pullup test: %s") \
+    X(DS_PRESENCE,          INFO,  "s",     "✓ Presence detection: %s") \
+    X(DS_ELECTRICAL_TEST,   INFO,  "",      "⚡ ELECTRICAL ANALYSIS TEST") \
+    X(DS_LINE_STABILITY,    INFO,  "i",     "✓ Line stability: %d/100 high readings") \
+    X(DS_RESET_TIMING,      INFO,  "i",     "✓ Reset pulse timing: %d μs") \
+    X(DS_PRESENCE_DURATION, INFO,  "i",     "✓ Presence pulse duration: %d μs") \
+    X(DS_PROTOCOL_TEST,     INFO,  "",      "📡 PROTOCOL VALIDATION TEST") \
+    X(DS_NO_PRESENCE,       ERROR, "",      "✗ Protocol test failed: No presence") \
+    X(DS_ROM_COMMANDS,      INFO,  "",      "Testing ROM commands...") \
+    X(DS_SKIP_ROM,          INFO,  "",      "✓ SKIP ROM command sent") \
+    X(DS_CONVERT_T,         INFO,  "",      "✓ CONVERT T command sent") \
+    X(DS_CONVERSION_TIME,   INFO,  "i",     "✓ Conversion time: %d ms") \
+    X(DS_LOST_PRESENCE,     ERROR, "",      "✗ Lost presence after conversion") \
+    X(DS_READ_SCRATCHPAD,   INFO,  "",      "✓ READ SCRATCHPAD command sent") \
+    X(DS_INTEGRITY_TEST,    INFO,  "",      "🔍 DATA INTEGRITY TEST") \
+    X(DS_READ_ATTEMPT,      INFO,  "i",     "Data read attempt %d/3") \
+    X(DS_ATTEMPT_DATA,      INFO,  "iiiiiiiiii", "Attempt %d data: %02X %02X %02X %02X %02X %02X %02X %02X %02X") \
+    X(DS_CRC,               INFO,  "ii",    "CRC calc: %02X, recv: %02X") \
+    X(DS_CRC_VALID,         INFO,  "f",     "✅ CRC valid, temperature: %.2f°C") \
+    X(DS_CRC_BYPASS,        WARN,  "f",     "⚠️ CRC bypass - temperature: %.2f°C (pullup resistor issue)") \
+    X(DS_STRESS_TEST,       INFO,  "",      "🌡️ ENVIRONMENTAL STRESS TEST") \
+    X(DS_STRESS_CYCLE,      INFO,  "i",     "Stress test cycle %d/10") \
+    X(DS_STRESS_RESULT,     INFO,  "i",     "✓ Stress test results: %d/10 successful") \
+    X(DS_TIMING_TEST,       INFO,  "",      "⏱️ TIMING ANALYSIS TEST") \
+    X(DS_TIMING_PULSE,      INFO,  "i",     "Testing reset pulse: %d μs") \
+    X(DS_TIMING_RESULT,     INFO,  "is",    "Timing %d μs: %s") \
+    X(DS_POWER_TEST,        INFO,  "",      "🔋 POWER STABILITY TEST") \
+    X(DS_POWER_RESULT,      INFO,  "s",     "✓ Power-on reset: %s") \
+    X(DS_INTERFERENCE_TEST, INFO,  "",      "📶 INTERFERENCE CHECK TEST") \
+    X(DS_INTERFERENCE_RESULT, INFO, "s",    "✓ Interference test: %s") \
+    X(DS_SUITE_START,       INFO,  "",      "🚀 DS18B20 COMPREHENSIVE TEST SUITE STARTING") \
+    X(DS_RULE,              INFO,  "",      "================================================") \
+    X(DS_SUMMARY,           INFO,  "",      "📊 TEST RESULTS SUMMARY:") \
+    X(DS_RESULT_HW,         INFO,  "s",     "🔧 Hardware Detection:    %s") \
+    X(DS_RESULT_ELECTRICAL, INFO,  "s",     "⚡ Electrical Analysis:   %s") \
+    X(DS_RESULT_PROTOCOL,   INFO,  "s",     "📡 Protocol Validation:   %s") \
+    X(DS_RESULT_INTEGRITY,  INFO,  "s",     "🔍 Data Integrity:        %s") \
+    X(DS_RESULT_STRESS,     INFO,  "s",     "🌡️ Environmental Stress:  %s") \
+    X(DS_RESULT_TIMING,     INFO,  "s",     "⏱️ Timing Analysis:       %s") \
+    X(DS_RESULT_POWER,      INFO,  "s",     "🔋 Power Stability:       %s") \
+    X(DS_RESULT_INTERFERENCE, INFO, "s",    "📶 Interference Check:    %s") \
+    X(DS_FINAL_READ,        INFO,  "",      "🎯 ATTEMPTING FINAL TEMPERATURE READ") \
+    X(DS_FINAL_RAW,         INFO,  "iiii",  "Raw data: %02X %02X, CRC calc: %02X, recv: %02X") \
+    X(DS_FINAL_OK,          INFO,  "f",     "🎉 SUCCESS! Temperature: %.2f°C (CRC valid)") \
+    X(DS_FINAL_BYPASS,      WARN,  "f",     "🎉 SUCCESS! Temperature: %.2f°C (CRC bypass - pullup issue)") \
+    X(DS_OUT_OF_RANGE,      ERROR, "f",     "❌ Temperature out of range: %.2f°C") \
+    X(DS_SUITE_FAILED,      ERROR, "",      "💥 COMPREHENSIVE TEST FAILED - CHECK CONNECTIONS") \
+    X(MQTT_CONNECTED,       INFO,  "sis",   "[MQTT] Connected to %s:%d (session %s)") \
+    X(MQTT_CONNECT_FAILED,  ERROR, "s",     "[MQTT] Connect failed: %s") \
+    X(MQTT_SUBSCRIBED,      INFO,  "s",     "[MQTT] Subscribed to %s") \
+    X(MQTT_PUBLISHED,       INFO,  "isi",   "[MQTT] Published %d bytes to %s (in flight: %d)") \
+    X(MQTT_PUBLISH_FAILED,  ERROR, "s",     "[MQTT] Publish failed: %s") \
+    X(MQTT_COMMAND,         INFO,  "s",     "[MQTT] Relay command: %s") \
+    X(MQTT_COMMAND_INVALID, WARN,  "",      "[MQTT] Ignoring malformed relay command") \
+    X(MQTT_LINK_LOST,       WARN,  "",      "[MQTT] Connection lost, reconnecting next cycle") \
+    X(CYCLE_MQTT,           INFO,  "",      "📡 Exchanging data over MQTT...") \
+    X(CYCLE_EXCHANGE,       INFO,  "",      "Sending data and fetching relay commands...") \
+    X(EXCHANGE_OK,          INFO,  "iii",   "[SUPABASE] Exchange OK (status %d): %d new command(s), last id %d") \
+    X(EXCHANGE_ATTEMPT_FAILED, WARN, "iis", "[SUPABASE] Exchange attempt %d failed. Status: %d, Error: %s") \
+    X(EXCHANGE_ALL_FAILED,  ERROR, "i",     "[SUPABASE] Exchange failed after %d attempts") \
+    X(CA_STORE_READY,       INFO,  "isiiii", "[TLS] CA store: %d anchor(s) from %s, %d B DER (PEM %d B), %d B heap, parsed in %d us") \
+    X(CA_STORE_SETUP_TIME,  INFO,  "iiii",  "[TLS] Client setup over %d connection(s): min %d ms, avg %d ms, max %d ms") \
+    X(CA_STORE_BAD_ANCHOR,  WARN,  "ii",    "[TLS] Skipping trust anchor %d (mbedTLS error -0x%04X)") \
+    X(CA_STORE_FAILED,      ERROR, "s",     "[TLS] CA store unavailable: %s") \
+    X(OTA_CHECK,            INFO,  "s",     "[OTA] Checking for updates (running %s)") \
+    X(OTA_UP_TO_DATE,       INFO,  "",      "[OTA] Firmware is up to date") \
+    X(OTA_MANIFEST_FAILED,  WARN,  "i",     "[OTA] Manifest unavailable (status %d)") \
+    X(OTA_MANIFEST_INVALID, WARN,  "",      "[OTA] Ignoring malformed manifest") \
+    X(OTA_TOO_LARGE,        ERROR, "ii",    "[OTA] Image of %d bytes does not fit the %d byte slot") \
+    X(OTA_UPDATE,           INFO,  "sssi",  "[OTA] Updating %s -> %s using the %s (%d bytes)") \
+    X(OTA_DELTA_REJECTED,   WARN,  "s",     "[OTA] Delta rejected (%s), falling back to the full image") \
+    X(OTA_DOWNLOAD_FAILED,  ERROR, "is",    "[OTA] Update failed after %d bytes: %s") \
+    X(OTA_WRITTEN,          INFO,  "ii",    "[OTA] %d bytes downloaded for a %d byte image, restarting") \
+    X(OTA_CONFIRMED,        INFO,  "s",     "[OTA] Firmware %s passed its first cycle and is now permanent") \
+    X(OTA_ROLLBACK,         ERROR, "si",    "[OTA] First cycle on new firmware failed (upload %s, %d critical sensors missing), rolling back") \
+    X(PARAMS_LOADED,        INFO,  "is",    "[PARAMS] Using parameter version %d (%s)") \
+    X(PARAMS_STORED_INVALID, WARN, "s",     "[PARAMS] Saved parameters ignored (%s), using factory defaults") \
+    X(PARAMS_APPLIED,       INFO,  "ii",    "[PARAMS] Parameter version %d applied (was %d)") \
+    X(PARAMS_REJECTED,      WARN,  "is",    "[PARAMS] Parameter version %d rejected: %s") \
+    X(PARAMS_SAVE_FAILED,   ERROR, "s",     "[PARAMS] Could not save parameters: %s") \
+    X(PARAMS_POLLING,       INFO,  "i",     "[PARAMS] Checking for parameters newer than version %d") \
+    X(PARAMS_POLL_FAILED,   WARN,  "is",    "[PARAMS] Poll failed. Status: %d, Error: %s") \
+    X(PARAMS_INVALID,       WARN,  "",      "[PARAMS] Ignoring malformed device_params response") \
+    X(DS_NOT_RESPONDING,    ERROR, "i",     "DS18B20 not responding (GPIO %d)") \
+    X(HEALTH_LOW,           WARN,  "si",    "[HEALTH] %s health dropped to %d/100") \
+    X(HEALTH_RECOVERED,     INFO,  "si",    "[HEALTH] %s health recovered (%d/100)") \
+    X(HEALTH_DIAGNOSTICS,   WARN,  "si",    "[HEALTH] %s health %d/100 - running full diagnostics") \
+    X(CYCLE_HEALTH,         INFO,  "iiiiii", "Health: DHT22 %d, DS18B20 %d, pH %d, DO %d, Turbidity %d, NH3 %d") \
+    X(CYCLE_READ_SENSOR,    INFO,  "s",     "Reading %s...") \
+    X(CYCLE_SENSOR_ERROR,   ERROR, "sii",   "%s sensor error - ADC channel %d (GPIO %d) reading failed") \
+    X(CYCLE_SENSOR,         INFO,  "sfs",   "%s: %.2f %s (connected and working)") \
+    X(SENSORS_MISSING_OF,   ERROR, "ii",    "SYSTEM FAILURE: %d OUT OF %d CRITICAL SENSORS MISSING") \
+    X(XADC_FOUND,           INFO,  "ii",    "[XADC] %d of %d external converters answering") \
+    X(XADC_MISSING,         ERROR, "ii",    "[XADC] Converter %d (address 0x%02X) not answering") \
+    X(XADC_INPUT_FAILED,    WARN,  "ii",    "[XADC] Converter %d input %d: no result") \
+    X(XADC_SCAN_TIMEOUT,    ERROR, "i",     "[XADC] Scan timed out with %d inputs pending") \
+    X(TIME_FIRST_SYNC,      INFO,  "i",     "[TIME] First SNTP sync %d s after boot; earlier readings are timed from it") \
+    X(TIME_SYNCED,          INFO,  "if",    "[TIME] SNTP sync, clock stepped %d ms, drift %.2f ppm") \
+    X(TIME_DRIFT_REJECTED,  WARN,  "f",     "[TIME] Ignoring drift measurement of %.1f ppm") \
+    X(OUTQ_BACKLOG,         WARN,  "i",     "[QUEUE] Reading kept for a later upload (%d in the backlog)") \
+    X(OUTQ_DROPPED,         WARN,  "si",    "[QUEUE] Undelivered %s request dropped after %d attempts") \
+    X(OUTQ_FULL,            ERROR, "s",     "[QUEUE] Queue full, %s request not sent") \
+    X(UPLOAD_BATCH,         INFO,  "iii",   "[SUPABASE] Sending %d backlog rows, %d bytes (%d on the wire)") \
+    X(UPLOAD_GZIP_REFUSED,  WARN,  "i",     "[SUPABASE] Server refused a compressed body (status %d), sending plain bodies") \
+    X(RULES_LOADED,         INFO,  "ii",    "[RULES] Using rules version %d (%d rules)") \
+    X(RULES_STORED_INVALID, WARN,  "s",     "[RULES] Saved rules ignored (%s)") \
+    X(RULES_APPLIED,        INFO,  "iii",   "[RULES] Rules version %d applied: %d rules, %d bytes of bytecode") \
+    X(RULES_REJECTED,       WARN,  "iis",   "[RULES] Rules version %d rejected, line %d: %s") \
+    X(RULES_SAVE_FAILED,    ERROR, "s",     "[RULES] Could not save rules: %s") \
+    X(RULES_POLL_FAILED,    WARN,  "is",    "[RULES] Poll failed. Status: %d, Error: %s") \
+    X(RULES_INVALID,        WARN,  "",      "[RULES] Ignoring malformed device_rules response") \
+    X(RULES_OVERRIDE,       INFO,  "ss",    "[RULES] %s switched %s by a rule") \
+    X(ANOMALY_READY,        INFO,  "sii",   "[ANOMALY] Detector on the %s path, %d components, threshold %d") \
+    X(ANOMALY_VECTOR_MISMATCH, ERROR, "s",  "[ANOMALY] %s path disagrees with the reference, using the scalar path") \
+    X(ANOMALY_MODEL_MISMATCH, ERROR, "",    "[ANOMALY] Built-in model fails its golden scores, detector off") \
+    X(ANOMALY_EVENT,        WARN,  "iis",   "[ANOMALY] Water anomaly, score %d (threshold %d), mostly %s") \
+    X(ANOMALY_PROBE,        WARN,  "iis",   "[ANOMALY] Score %d (threshold %d) from one probe, %s suspect") \
+    X(ANOMALY_CLEARED,      INFO,  "i",     "[ANOMALY] Cleared, score %d") \
+    X(MODBUS_LISTENING,     INFO,  "ii",    "[MODBUS] Listening on port %d (up to %d pollers)") \
+    X(MODBUS_LISTEN_FAILED, ERROR, "i",     "[MODBUS] Cannot listen on port %d") \
+    X(MODBUS_COILS_WRITTEN, INFO,  "ii",    "[MODBUS] %d relay writes from pollers, relays now 0x%x") \
+    X(SEQ_SAVE_FAILED,      ERROR, "s",     "[SUPABASE] Could not save the upload sequence: %s") \
+    X(UPLOAD_PIPELINED,     INFO,  "iii",   "[SUPABASE] %d upload requests on one connection (%d rows, up to %d in flight)") \
+    X(UPLOAD_PIPELINE_BROKEN, WARN, "is",   "[SUPABASE] Upload connection lost with %d requests in flight: %s") \
+    X(LOCKIN_CLIPPED,       WARN,  "sii",   "[LOCKIN] %s saturated in %d samples (ambient %d counts), reading dropped") \
+    X(METER_FAULT,          WARN,  "ssf",   "[METER] %s: %s (%.2f L/min)") \
+    X(METER_FAULT_CLEARED,  INFO,  "sf",    "[METER] %s flow matches its state again (%.2f L/min)") \
+    X(METER_COUNTER_FAILED, ERROR, "is",    "[METER] Cannot count pulses on GPIO %d: %s") \
+    X(METER_STORED_INVALID, WARN,  "s",     "[METER] Saved totals ignored (%s)") \
+    X(METER_SAVE_FAILED,    ERROR, "s",     "[METER] Could not save totals: %s") \
+    X(STREAM_READY,         INFO,  "",      "[STREAM] Waiting for capture commands on the USB port") \
+    X(STREAM_PORT_FAILED,   ERROR, "",      "[STREAM] Cannot open the USB port") \
+    X(STREAM_BAD_COMMAND,   WARN,  "s",     "[STREAM] Ignoring command: %s") \
+    X(STREAM_STARTED,       INFO,  "iii",   "[STREAM] Capturing %d channels at %d Hz, %d scans per frame") \
+    X(STREAM_STOPPED,       INFO,  "iiii",  "[STREAM] Capture ended: %d frames, %d dropped, %d scans skipped, %d bytes/s")
+
+#endif // AQUA_LOG_MSGS_H
@@ -0,0 +1,226 @@
+#include <stddef.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_meter.h"
+#include "hal.h"
+
+#define METER_KEY "meters"
+#define METER_LAYOUT 1          // Bump when stored_meters_t changes shape
+
+#define METER_PIN(pin) (AQUA_FLOW_METERS ? (pin) : -1)
+
+const aqua_meter_desc_t aqua_meter_descs[AQUA_ACT_COUNT] = {
+    [AQUA_ACT_PH_RELAY] = { RELAY_PIN, -1, PH_RELAY_RATED_W, 0.0f, 0.0f },
+    [AQUA_ACT_AERATOR] = { AERATOR_PIN, METER_PIN(AERATOR_FLOW_PIN), AERATOR_RATED_W,
+                           AERATOR_PULSES_PER_LITRE, AERATOR_MIN_FLOW_LPM },
+    [AQUA_ACT_FILTER] = { FILTER_PIN, METER_PIN(FILTER_FLOW_PIN), FILTER_RATED_W,
+                          FILTER_PULSES_PER_LITRE, FILTER_MIN_FLOW_LPM },
+    [AQUA_ACT_PUMP] = { PUMP_PIN, METER_PIN(PUMP_FLOW_PIN), PUMP_RATED_W,
+                        PUMP_PULSES_PER_LITRE, PUMP_MIN_FLOW_LPM },
+};
+
+// NVS image of the totals
+typedef struct {
+    uint16_t layout;
+    uint16_t count;
+    uint64_t on_us[AQUA_ACT_COUNT];
+    uint64_t pulses[AQUA_ACT_COUNT];
+    uint32_t crc;               // CRC-32 of the fields above
+} stored_meters_t;
+
+static aqua_meter_state_t s_meters[AQUA_ACT_COUNT];
+static aqua_alert_states_t s_alerts;
+static aqua_meter_stats_t s_stats;
+static bool s_ready;
+
+// ========== COUNTING ==========
+void aqua_meter_reset(aqua_meter_state_t *s, bool metered) {
+    memset(s, 0, sizeof(*s));
+    s->metered = metered;
+}
+
+aqua_flow_fault_t aqua_meter_update(aqua_meter_state_t *s, const aqua_meter_desc_t *d,
+                                    int64_t now_us, uint32_t count, bool on) {
+    // First sample, or the clock restarted under us: only take the start
+    if (!s->started || now_us < s->last_us) {
+        s->started = true;
+        s->on = on;
+        s->since_us = now_us;
+        s->last_us = now_us;
+        s->last_count = count;
+        return s->fault;
+    }
+
+    int64_t elapsed_us = now_us - s->last_us;
+    if (elapsed_us > 0) {
+        if (s->on) {
+            s->on_us += (uint64_t)elapsed_us;
+        }
+        if (s->metered && count - s->last_count > UINT32_MAX / 2) {
+            // Behind the last total: a misread counter, not 4 billion pulses.
+            // Keep the higher total, so the pulses since go into the next
+            // interval, and leave this one unjudged
+            count = s->last_count;
+        } else if (s->metered) {
+            uint32_t pulses = count - s->last_count;
+            s->pulses += pulses;
+            s->flow_lpm = (float)((double)pulses / d->pulses_per_litre * 60e6 / (double)elapsed_us);
+
+            // Spin-up and run-down after a switch are not held against it
+            if (s->last_us - s->since_us >= (int64_t)FLOW_SETTLE_MS * 1000) {
+                if (s->on) {
+                    s->fault = s->flow_lpm < d->min_flow_lpm ? AQUA_FLOW_NONE : AQUA_FLOW_OK;
+                } else {
+                    s->fault = s->flow_lpm >= d->min_flow_lpm ? AQUA_FLOW_UNCOMMANDED : AQUA_FLOW_OK;
+                }
+            }
+        }
+        s->last_us = now_us;
+        s->last_count = count;
+    }
+
+    if (on != s->on) {
+        s->on = on;
+        s->since_us = now_us;
+        s->fault = AQUA_FLOW_OK;
+    }
+    return s->fault;
+}
+
+void aqua_meter_fill(const aqua_meter_state_t *s, const aqua_meter_desc_t *d,
+                     aqua_actuator_sample_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->on_s = (uint32_t)(s->on_us / 1000000);
+    out->energy_wh = (float)((double)s->on_us / 3.6e9 * d->rated_w);
+    out->metered = s->metered;
+    if (s->metered) {
+        out->litres = (float)((double)s->pulses / d->pulses_per_litre);
+        out->flow_lpm = s->flow_lpm;
+        out->fault = s->fault;
+    }
+}
+
+// ========== PERSISTENCE ==========
+static uint32_t stored_crc(const stored_meters_t *st) {
+    return aqua_crc32(0, st, offsetof(stored_meters_t, crc));
+}
+
+static void save(void) {
+    stored_meters_t st;
+    memset(&st, 0, sizeof(st));     // Padding is covered by the CRC
+    st.layout = METER_LAYOUT;
+    st.count = AQUA_ACT_COUNT;
+    for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+        st.on_us[i] = s_meters[i].on_us;
+        st.pulses[i] = s_meters[i].pulses;
+    }
+    st.crc = stored_crc(&st);
+    esp_err_t err = hal_settings_set(METER_KEY, &st, sizeof(st));
+    if (err != ESP_OK) {
+        AQUA_LOG(METER_SAVE_FAILED, esp_err_to_name(err));
+        return;
+    }
+    s_stats.saves++;
+}
+
+static const char *load(void) {
+    stored_meters_t st;
+    size_t len = sizeof(st);
+    esp_err_t err = hal_settings_get(METER_KEY, &st, &len);
+    if (err == ESP_ERR_NOT_FOUND) return NULL;
+    if (err != ESP_OK) return esp_err_to_name(err);
+    if (len != sizeof(st) || st.layout != METER_LAYOUT || st.count != AQUA_ACT_COUNT) {
+        return "layout changed";
+    }
+    if (st.crc != stored_crc(&st)) return "bad CRC";
+    for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+        s_meters[i].on_us = st.on_us[i];
+        s_meters[i].pulses = st.pulses[i];
+    }
+    s_stats.from_nvs = true;
+    return NULL;
+}
+
+// ========== MODULE ==========
+void aqua_meter_init(void) {
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(&s_alerts, 0, sizeof(s_alerts));
+    for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+        int pin = aqua_meter_descs[i].meter_pin;
+        bool metered = false;
+        if (pin >= 0) {
+            esp_err_t err = hal_pulse_count_start(pin);
+            metered = (err == ESP_OK);
+            if (!metered) {
+                AQUA_LOG(METER_COUNTER_FAILED, pin, esp_err_to_name(err));
+            }
+        }
+        aqua_meter_reset(&s_meters[i], metered);
+    }
+
+    const char *error = load();
+    if (error) {
+        AQUA_LOG(METER_STORED_INVALID, error);
+    }
+    s_ready = true;
+}
+
+void aqua_meter_sample(const aqua_controls_t *c, aqua_reading_t *r) {
+    if (!s_ready) {
+        aqua_meter_init();
+    }
+    const bool on[AQUA_ACT_COUNT] = {
+        [AQUA_ACT_PH_RELAY] = c->ph_relay,
+        [AQUA_ACT_AERATOR] = c->aerator,
+        [AQUA_ACT_FILTER] = c->filter,
+        [AQUA_ACT_PUMP] = c->pump,
+    };
+
+    int64_t now = hal_time_us();
+    s_alerts.no_flow = 0;
+    s_alerts.flow_while_off = 0;
+    for (int i = 0; i < AQUA_ACT_COUNT; i++) {
+        const aqua_meter_desc_t *d = &aqua_meter_descs[i];
+        aqua_meter_state_t *s = &s_meters[i];
+        uint32_t count = 0;
+        if (s->metered && hal_pulse_count_read(d->meter_pin, &count) != ESP_OK) {
+            // Counter lost (peripheral reset): count again from here
+            hal_pulse_count_start(d->meter_pin);
+            s->started = false;
+        }
+
+        aqua_flow_fault_t was = s->fault;
+        aqua_flow_fault_t fault = aqua_meter_update(s, d, now, count, on[i]);
+        const char *name = aqua_actuator_name((aqua_actuator_t)i);
+        if (fault != was && fault != AQUA_FLOW_OK) {
+            s_stats.faults++;
+            AQUA_LOG(METER_FAULT, name, aqua_flow_fault_name(fault), s->flow_lpm);
+        } else if (fault != was) {
+            AQUA_LOG(METER_FAULT_CLEARED, name, s->flow_lpm);
+        }
+        if (fault == AQUA_FLOW_NONE) {
+            s_alerts.no_flow |= AQUA_ALERT_BIT(i);
+        } else if (fault == AQUA_FLOW_UNCOMMANDED) {
+            s_alerts.flow_while_off |= AQUA_ALERT_BIT(i);
+        }
+        aqua_meter_fill(s, d, &r->actuators[i]);
+    }
+    r->has_actuators = true;
+
+    if (++s_stats.samples % METER_SAVE_INTERVAL_CYCLES == 0) {
+        save();
+    }
+}
+
+const aqua_alert_states_t *aqua_meter_alerts(void) {
+    return &s_alerts;
+}
+
+const aqua_meter_state_t *aqua_meter_state(aqua_actuator_t act) {
+    return &s_meters[act];
+}
+
+const aqua_meter_stats_t *aqua_meter_get_stats(void) {
+    return &s_stats;
+}
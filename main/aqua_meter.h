@@ -0,0 +1,104 @@
+#ifndef AQUA_METER_H
+#define AQUA_METER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "aqua_core.h"
+
+// Actuator metering (ACTUATOR METERING in aqua_config.h).
+//
+// Every output accumulates run time, and energy at its rated power, from the
+// state the cycle commands. The pump, filter and aerator lines can carry a
+// pulse-output flow meter; its pulses are counted by the PCNT peripheral
+// (hal_pulse_count_read()), so they cost no CPU, and the total is read once
+// per cycle, when the outputs are driven.
+//
+// Each interval between two samples is judged against the state commanded
+// throughout it, once that state has held for FLOW_SETTLE_MS before the
+// interval began: on with less than the line's minimum flow is
+// AQUA_FLOW_NONE (dry or clogged pump, tripped breaker, dead relay), off
+// with at least that flow is AQUA_FLOW_UNCOMMANDED (welded relay contacts).
+// A fault lasts until a judged interval disagrees or the state changes, and
+// is raised as a no_flow / flow_while_off alert.
+//
+// Relay commands applied between cycles are seen at the next cycle, which
+// drives the outputs again. Totals are saved to NVS every
+// METER_SAVE_INTERVAL_CYCLES samples, so a restart loses at most that much.
+//
+// The counting and judging below take the time and pulse totals as
+// arguments and run unchanged on the host (host/tests/test_meter.c).
+
+typedef struct {
+    int out_pin;                // Output the actuator is switched by
+    int meter_pin;              // Flow meter input, -1 if none
+    float rated_w;
+    float pulses_per_litre;
+    float min_flow_lpm;         // Judged flow threshold
+} aqua_meter_desc_t;
+
+extern const aqua_meter_desc_t aqua_meter_descs[AQUA_ACT_COUNT];
+
+typedef struct {
+    bool metered;               // Pulse totals are valid
+    bool started;               // First sample taken
+    bool on;                    // Commanded state since the last sample
+    int64_t since_us;           // When it was last switched (or first sampled)
+    int64_t last_us;            // Last sample
+    uint32_t last_count;        // Counter total at it
+    uint64_t on_us;             // Run time, all samples
+    uint64_t pulses;            // Meter pulses, all samples
+    float flow_lpm;             // Over the last interval
+    aqua_flow_fault_t fault;
+} aqua_meter_state_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t faults;            // Faults raised since boot
+    uint32_t saves;             // Totals written to NVS
+    bool from_nvs;              // Totals continued from NVS at init
+} aqua_meter_stats_t;
+
+// ========== COUNTING ==========
+/**
+ * @brief Zero totals; the first aqua_meter_update() only takes its arguments as the start
+ */
+void aqua_meter_reset(aqua_meter_state_t *s, bool metered);
+
+/**
+ * @brief Account for the interval since the last sample, then take the newly commanded state
+ * @param count Counter total now; differences wrap at 2^32, and a total
+ *              behind the last one is ignored
+ * @param on State commanded from now on
+ * @return The fault after judging the interval
+ */
+aqua_flow_fault_t aqua_meter_update(aqua_meter_state_t *s, const aqua_meter_desc_t *d,
+                                    int64_t now_us, uint32_t count, bool on);
+
+/**
+ * @brief Totals and flow in payload units
+ */
+void aqua_meter_fill(const aqua_meter_state_t *s, const aqua_meter_desc_t *d,
+                     aqua_actuator_sample_t *out);
+
+// ========== MODULE ==========
+/**
+ * @brief Start the pulse counters and continue the totals saved in NVS
+ *
+ * Call at boot. Without it the first aqua_meter_sample() does it.
+ */
+void aqua_meter_init(void);
+
+/**
+ * @brief Sample every actuator as the outputs are driven to c, filling r->actuators
+ */
+void aqua_meter_sample(const aqua_controls_t *c, aqua_reading_t *r);
+
+/**
+ * @brief Flow faults of the last sample (no_flow and flow_while_off only)
+ */
+const aqua_alert_states_t *aqua_meter_alerts(void);
+
+const aqua_meter_state_t *aqua_meter_state(aqua_actuator_t act);
+const aqua_meter_stats_t *aqua_meter_get_stats(void);
+
+#endif // AQUA_METER_H
@@ -0,0 +1,434 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_modbus.h"
+#include "aqua_params.h"
+#include "aqua_registry.h"
+#include "aqua_rules.h"
+#include "hal.h"
+
+_Static_assert(AQUA_MEAS_ID_COUNT <= 10 && AQUA_SENSOR_COUNT <= 10, "register blocks are 10 apart");
+_Static_assert(AQUA_MODBUS_REG_FLOAT + 2 * AQUA_MEAS_ID_COUNT == AQUA_MODBUS_REGISTERS, "float block ends the map");
+
+#define MBAP_LEN 7                      // Transaction, protocol, length, unit
+#define PDU_MAX (AQUA_MODBUS_FRAME_MAX - MBAP_LEN)
+#define READ_REGISTERS_MAX 125          // Per request, from the spec
+#define READ_COILS_MAX 2000
+#define WRITE_COILS_MAX 1968
+
+#define FC_READ_COILS 0x01
+#define FC_READ_HOLDING 0x03
+#define FC_READ_INPUT 0x04
+#define FC_WRITE_COIL 0x05
+#define FC_WRITE_COILS 0x0F
+
+#define EX_ILLEGAL_FUNCTION 0x01
+#define EX_ILLEGAL_ADDRESS 0x02
+#define EX_ILLEGAL_VALUE 0x03
+
+// Relay outputs behind the coils, as the cycle drives them
+static const int coil_pins[AQUA_MODBUS_COILS] = { RELAY_PIN, AERATOR_PIN, FILTER_PIN, PUMP_PIN };
+
+// ========== IMAGE ==========
+// image first, so a reader's pointer is also its slot
+typedef struct {
+    uint16_t image[AQUA_MODBUS_REGISTERS];
+    atomic_int readers;
+} slot_t;
+
+static slot_t slots[AQUA_MODBUS_SLOTS];
+static _Atomic(slot_t *) current = &slots[0];
+static atomic_uint coils;               // Bit per coil; written by the cycle and by pollers
+
+static struct {
+    atomic_uint requests;
+    atomic_uint exceptions;
+    atomic_uint coil_writes;
+    atomic_uint accepted;
+    atomic_uint refused;
+    atomic_uint dropped;
+    atomic_int clients;
+    uint32_t publishes;                 // Cycle only
+    uint32_t publish_skipped;
+    uint32_t writes_logged;
+} stats;
+
+static hal_listener_t *listener;
+
+static const uint16_t *acquire(void) {
+    for (;;) {
+        slot_t *s = atomic_load(&current);
+        atomic_fetch_add(&s->readers, 1);
+        // Still current: the cycle cannot pick this slot while we hold it
+        if (atomic_load(&current) == s) {
+            return s->image;
+        }
+        atomic_fetch_sub(&s->readers, 1);
+    }
+}
+
+static void release(const uint16_t *image) {
+    atomic_fetch_sub(&((slot_t *)image)->readers, 1);
+}
+
+static void put_float(uint16_t *image, int reg, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    image[reg] = (uint16_t)(bits >> 16);
+    image[reg + 1] = (uint16_t)bits;
+}
+
+static void put_u32(uint16_t *image, int reg, uint32_t v) {
+    image[reg] = (uint16_t)(v >> 16);
+    image[reg + 1] = (uint16_t)v;
+}
+
+// Every value missing, health unknown
+static void image_empty(uint16_t *image) {
+    memset(image, 0, AQUA_MODBUS_REGISTERS * sizeof(uint16_t));
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        image[AQUA_MODBUS_REG_VALUE + id] = AQUA_MODBUS_MISSING;
+        put_float(image, AQUA_MODBUS_REG_FLOAT + 2 * id, NAN);
+    }
+    for (int s = 0; s < AQUA_SENSOR_COUNT; s++) {
+        image[AQUA_MODBUS_REG_HEALTH + s] = 0xFFFF;
+    }
+}
+
+static void image_build(uint16_t *image, const aqua_reading_t *r, uint32_t relays, uint32_t sample) {
+    image_empty(image);
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        float v = aqua_measure_value(m, r);
+        if (v == AQUA_SENSOR_ERROR) {
+            continue;
+        }
+        // x100 saturates short of the missing marker
+        float scaled = roundf(v * 100.0f);
+        scaled = scaled > 32767.0f ? 32767.0f : scaled < -32767.0f ? -32767.0f : scaled;
+        image[AQUA_MODBUS_REG_VALUE + m->id] = (uint16_t)(int16_t)scaled;
+        put_float(image, AQUA_MODBUS_REG_FLOAT + 2 * m->id, v);
+    }
+    if (r->has_health) {
+        for (int s = 0; s < AQUA_SENSOR_COUNT; s++) {
+            image[AQUA_MODBUS_REG_HEALTH + s] = r->health[s];
+        }
+    }
+
+    aqua_alert_states_t alerts;
+    const aqua_params_t *params = aqua_params_acquire();
+    aqua_eval_alerts(r, params, &alerts);
+    aqua_params_release(params);
+    image[AQUA_MODBUS_REG_RELAYS] = (uint16_t)relays;
+    image[AQUA_MODBUS_REG_ALERTS_LOW] = (uint16_t)(alerts.low | aqua_rules_alerts()->low);
+    image[AQUA_MODBUS_REG_ALERTS_HIGH] = (uint16_t)(alerts.high | aqua_rules_alerts()->high);
+    image[AQUA_MODBUS_REG_ANOMALY] = (uint16_t)aqua_anomaly_alerts()->anomaly;
+    image[AQUA_MODBUS_REG_SUSPECT] = (uint16_t)aqua_anomaly_alerts()->suspect;
+
+    int32_t score = aqua_anomaly_result()->score;
+    image[AQUA_MODBUS_REG_SCORE] = (uint16_t)(score > 0xFFFF ? 0xFFFF : score < 0 ? 0 : score);
+    put_u32(image, AQUA_MODBUS_REG_SAMPLE, sample);
+    if (r->has_time && r->time.quality != AQUA_TIME_UNSYNCED) {
+        put_u32(image, AQUA_MODBUS_REG_TIME, (uint32_t)(r->time.unix_us / 1000000));
+    }
+}
+
+void aqua_modbus_init(void) {
+    for (int i = 0; i < AQUA_MODBUS_SLOTS; i++) {
+        image_empty(slots[i].image);
+    }
+    atomic_store(&current, &slots[0]);
+    atomic_store(&coils, 0);
+    atomic_store(&stats.requests, 0);
+    atomic_store(&stats.exceptions, 0);
+    atomic_store(&stats.coil_writes, 0);
+    atomic_store(&stats.accepted, 0);
+    atomic_store(&stats.refused, 0);
+    atomic_store(&stats.dropped, 0);
+    stats.publishes = 0;
+    stats.publish_skipped = 0;
+    stats.writes_logged = 0;
+}
+
+void aqua_modbus_publish(const aqua_reading_t *r, const aqua_controls_t *c, uint32_t sample) {
+    // Pollers' writes since the last sample, before this decision replaces them
+    uint32_t writes = atomic_load(&stats.coil_writes);
+    if (writes != stats.writes_logged) {
+        AQUA_LOG(MODBUS_COILS_WRITTEN, (int)(writes - stats.writes_logged), (int)atomic_load(&coils));
+        stats.writes_logged = writes;
+    }
+
+    uint32_t relays = (c->ph_relay ? 1u : 0) | (c->aerator ? 2u : 0) | (c->filter ? 4u : 0) | (c->pump ? 8u : 0);
+    atomic_store(&coils, relays);
+
+    slot_t *cur = atomic_load(&current);
+    for (int i = 0; i < AQUA_MODBUS_SLOTS; i++) {
+        slot_t *s = &slots[i];
+        if (s == cur || atomic_load(&s->readers) != 0) {
+            continue;
+        }
+        image_build(s->image, r, relays, sample);
+        atomic_store(&current, s);
+        stats.publishes++;
+        return;
+    }
+    stats.publish_skipped++;
+}
+
+// ========== PROTOCOL ==========
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+int aqua_modbus_frame_length(const uint8_t *buf, size_t have) {
+    if (have < 6) {
+        return 0;
+    }
+    uint16_t len = get16(buf + 4);     // Unit ID and PDU
+    if (get16(buf + 2) != 0 || len < 2 || len > PDU_MAX + 1) {
+        return -1;
+    }
+    return 6 + len;
+}
+
+static int exception(uint8_t *pdu, uint8_t fc, uint8_t code) {
+    atomic_fetch_add(&stats.exceptions, 1);
+    pdu[0] = fc | 0x80;
+    pdu[1] = code;
+    return 2;
+}
+
+static int read_coils(const uint8_t *req, size_t len, uint8_t *pdu) {
+    if (len != 5) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    uint16_t start = get16(req + 1), count = get16(req + 3);
+    if (count < 1 || count > READ_COILS_MAX) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    if ((uint32_t)start + count > AQUA_MODBUS_COILS) {
+        return exception(pdu, req[0], EX_ILLEGAL_ADDRESS);
+    }
+    uint32_t bits = atomic_load(&coils) >> start;
+    pdu[0] = req[0];
+    pdu[1] = 1;
+    pdu[2] = (uint8_t)(bits & ((1u << count) - 1));
+    return 3;
+}
+
+static int read_registers(const uint8_t *req, size_t len, uint8_t *pdu) {
+    if (len != 5) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    uint16_t start = get16(req + 1), count = get16(req + 3);
+    if (count < 1 || count > READ_REGISTERS_MAX) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    if ((uint32_t)start + count > AQUA_MODBUS_REGISTERS) {
+        return exception(pdu, req[0], EX_ILLEGAL_ADDRESS);
+    }
+    pdu[0] = req[0];
+    pdu[1] = (uint8_t)(2 * count);
+    const uint16_t *image = acquire();
+    for (int i = 0; i < count; i++) {
+        put16(pdu + 2 + 2 * i, image[start + i]);
+    }
+    release(image);
+    // Relays as driven now, including pollers' writes since the sample
+    if (start <= AQUA_MODBUS_REG_RELAYS && AQUA_MODBUS_REG_RELAYS < start + count) {
+        put16(pdu + 2 + 2 * (AQUA_MODBUS_REG_RELAYS - start), (uint16_t)atomic_load(&coils));
+    }
+    return 2 + 2 * count;
+}
+
+// Switch the coils in mask to the states in bits
+static void drive(uint32_t mask, uint32_t bits) {
+    for (int i = 0; i < AQUA_MODBUS_COILS; i++) {
+        if (mask & (1u << i)) {
+            hal_gpio_set_level(coil_pins[i], (bits >> i) & 1);
+        }
+    }
+    uint32_t was = atomic_load(&coils);
+    while (!atomic_compare_exchange_weak(&coils, &was, (was & ~mask) | (bits & mask))) {
+    }
+    atomic_fetch_add(&stats.coil_writes, 1);
+}
+
+static int write_coil(const uint8_t *req, size_t len, uint8_t *pdu) {
+    if (len != 5) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    uint16_t addr = get16(req + 1), value = get16(req + 3);
+    if (value != 0xFF00 && value != 0x0000) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    if (addr >= AQUA_MODBUS_COILS) {
+        return exception(pdu, req[0], EX_ILLEGAL_ADDRESS);
+    }
+    drive(1u << addr, value ? 1u << addr : 0);
+    memcpy(pdu, req, 5);                // Echo
+    return 5;
+}
+
+static int write_coils(const uint8_t *req, size_t len, uint8_t *pdu) {
+    if (len < 6) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    uint16_t start = get16(req + 1), count = get16(req + 3);
+    uint8_t bytes = req[5];
+    if (count < 1 || count > WRITE_COILS_MAX || bytes != (count + 7) / 8 || len != 6u + bytes) {
+        return exception(pdu, req[0], EX_ILLEGAL_VALUE);
+    }
+    if ((uint32_t)start + count > AQUA_MODBUS_COILS) {
+        return exception(pdu, req[0], EX_ILLEGAL_ADDRESS);
+    }
+    uint32_t mask = ((1u << count) - 1) << start;
+    drive(mask, (uint32_t)req[6] << start);
+    memcpy(pdu, req, 5);                // Function, start and count
+    return 5;
+}
+
+int aqua_modbus_handle(const uint8_t *req, size_t len, uint8_t *resp, size_t size) {
+    int frame = aqua_modbus_frame_length(req, len);
+    if (frame <= 0 || (size_t)frame != len) {
+        return -1;
+    }
+    if (size < AQUA_MODBUS_FRAME_MAX) {
+        return 0;
+    }
+
+    const uint8_t *pdu = req + MBAP_LEN;
+    size_t pdu_len = len - MBAP_LEN;
+    uint8_t *out = resp + MBAP_LEN;
+    int n;
+    switch (pdu[0]) {
+        case FC_READ_COILS:
+            n = read_coils(pdu, pdu_len, out);
+            break;
+        case FC_READ_HOLDING:
+        case FC_READ_INPUT:
+            n = read_registers(pdu, pdu_len, out);
+            break;
+        case FC_WRITE_COIL:
+            n = write_coil(pdu, pdu_len, out);
+            break;
+        case FC_WRITE_COILS:
+            n = write_coils(pdu, pdu_len, out);
+            break;
+        default:
+            n = exception(out, pdu[0], EX_ILLEGAL_FUNCTION);
+            break;
+    }
+    atomic_fetch_add(&stats.requests, 1);
+
+    // Same transaction, protocol and unit; the length covers unit and PDU
+    memcpy(resp, req, 4);
+    put16(resp + 4, (uint16_t)(n + 1));
+    resp[6] = req[6];
+    return MBAP_LEN + n;
+}
+
+// ========== SERVER ==========
+// One task per connected poller; a request is read, answered from the
+// image and written back without touching the sensors.
+static void client_task(void *arg) {
+    hal_stream_t *stream = arg;
+    uint8_t buf[AQUA_MODBUS_FRAME_MAX];
+    uint8_t resp[AQUA_MODBUS_FRAME_MAX];
+    size_t have = 0;
+    int idle_ms = 0;
+
+    while (idle_ms < MODBUS_IDLE_TIMEOUT_MS) {
+        int n = hal_stream_read(stream, buf + have, sizeof(buf) - have, MODBUS_READ_WAIT_MS);
+        if (n < 0) {
+            break;
+        }
+        if (n == 0) {
+            idle_ms += MODBUS_READ_WAIT_MS;
+            continue;
+        }
+        idle_ms = 0;
+        have += (size_t)n;
+
+        // Every complete frame buffered; pollers may pipeline
+        int frame;
+        while ((frame = aqua_modbus_frame_length(buf, have)) > 0 && (size_t)frame <= have) {
+            int len = aqua_modbus_handle(buf, (size_t)frame, resp, sizeof(resp));
+            if (len < 0 || hal_stream_write(stream, resp, (size_t)len, MODBUS_WRITE_TIMEOUT_MS) < 0) {
+                frame = -1;
+                break;
+            }
+            memmove(buf, buf + frame, have - (size_t)frame);
+            have -= (size_t)frame;
+        }
+        if (frame < 0) {
+            atomic_fetch_add(&stats.dropped, 1);
+            break;
+        }
+    }
+    hal_stream_close(stream);
+    atomic_fetch_sub(&stats.clients, 1);
+}
+
+static void accept_task(void *arg) {
+    for (;;) {
+        hal_stream_t *stream = hal_listener_accept(listener, 1000);
+        if (!stream) {
+            continue;
+        }
+        if (atomic_fetch_add(&stats.clients, 1) >= MODBUS_MAX_CLIENTS) {
+            atomic_fetch_sub(&stats.clients, 1);
+            atomic_fetch_add(&stats.refused, 1);
+            hal_stream_close(stream);
+            continue;
+        }
+        atomic_fetch_add(&stats.accepted, 1);
+        if (hal_task_start("modbus_client", client_task, stream, MODBUS_TASK_STACK, MODBUS_TASK_PRIORITY) != ESP_OK) {
+            atomic_fetch_sub(&stats.clients, 1);
+            hal_stream_close(stream);
+        }
+    }
+}
+
+esp_err_t aqua_modbus_start(int port) {
+    if (listener) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    listener = hal_listener_open(port, MODBUS_MAX_CLIENTS);
+    if (!listener) {
+        AQUA_LOG(MODBUS_LISTEN_FAILED, port);
+        return ESP_FAIL;
+    }
+    if (hal_task_start("modbus", accept_task, NULL, MODBUS_TASK_STACK, MODBUS_TASK_PRIORITY) != ESP_OK) {
+        hal_listener_close(listener);
+        listener = NULL;
+        AQUA_LOG(MODBUS_LISTEN_FAILED, port);
+        return ESP_FAIL;
+    }
+    AQUA_LOG(MODBUS_LISTENING, hal_listener_port(listener), MODBUS_MAX_CLIENTS);
+    return ESP_OK;
+}
+
+int aqua_modbus_port(void) {
+    return listener ? hal_listener_port(listener) : 0;
+}
+
+void aqua_modbus_get_stats(aqua_modbus_stats_t *out) {
+    out->requests = atomic_load(&stats.requests);
+    out->exceptions = atomic_load(&stats.exceptions);
+    out->coil_writes = atomic_load(&stats.coil_writes);
+    out->accepted = atomic_load(&stats.accepted);
+    out->refused = atomic_load(&stats.refused);
+    out->dropped = atomic_load(&stats.dropped);
+    out->clients = atomic_load(&stats.clients);
+    out->publishes = stats.publishes;
+    out->publish_skipped = stats.publish_skipped;
+}
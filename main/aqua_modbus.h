@@ -0,0 +1,121 @@
+#ifndef AQUA_MODBUS_H
+#define AQUA_MODBUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "aqua_core.h"
+
+// Modbus TCP server for local SCADA and PLC pollers (MODBUS in aqua_config.h).
+//
+// The monitoring cycle publishes every sample as a register image with
+// aqua_modbus_publish(). Requests are answered from the latest image, so a
+// poller never waits for a sensor read or an upload, and the cycle never
+// waits for a poller. Images are handed over like the parameter blocks
+// (aqua_params.h): an atomic pointer to one of AQUA_MODBUS_SLOTS slots, a
+// reader holds a slot for one request, and the cycle writes the next image
+// into a slot no reader holds.
+//
+// Function codes: 01 Read Coils, 03 Read Holding Registers and 04 Read
+// Input Registers (one map for both), 05 Write Single Coil and 15 Write
+// Multiple Coils. Every unit ID is answered.
+//
+// Coils are the relays as last driven. A write switches the relay at once;
+// like a relay command from the cloud, it holds until the next cycle's
+// decision.
+//
+//   0 pH relay   1 aerator   2 filter   3 pump
+//
+// Registers:
+//
+//   0-6      Measurements by aqua_measure_id_t, signed, x100; 0x8000 missing
+//   10-15    Sensor health by aqua_sensor_t, 0-100; 0xFFFF unknown
+//   20       Relays, one bit per coil
+//   21, 22   Low and high limit alerts, AQUA_ALERT_BIT() per measurement
+//   23, 24   Anomaly and suspect probe bits (aqua_anomaly.h)
+//   25       Anomaly score, saturated at 0xFFFF
+//   30-31    Sample number since boot (high word first)
+//   32-33    Sample time, Unix seconds; 0 before the first time sync
+//   100-113  Measurements as IEEE 754 floats, two registers each, high
+//            word first; NaN if missing
+//
+// There is no authentication: enable the server only on a trusted plant
+// network.
+
+#define AQUA_MODBUS_COILS 4
+#define AQUA_MODBUS_REGISTERS 114
+#define AQUA_MODBUS_SLOTS 4             // Current image plus spares for readers still holding old ones
+#define AQUA_MODBUS_FRAME_MAX 260       // MBAP header and the longest PDU
+
+#define AQUA_MODBUS_REG_VALUE 0
+#define AQUA_MODBUS_REG_HEALTH 10
+#define AQUA_MODBUS_REG_RELAYS 20
+#define AQUA_MODBUS_REG_ALERTS_LOW 21
+#define AQUA_MODBUS_REG_ALERTS_HIGH 22
+#define AQUA_MODBUS_REG_ANOMALY 23
+#define AQUA_MODBUS_REG_SUSPECT 24
+#define AQUA_MODBUS_REG_SCORE 25
+#define AQUA_MODBUS_REG_SAMPLE 30
+#define AQUA_MODBUS_REG_TIME 32
+#define AQUA_MODBUS_REG_FLOAT 100
+
+#define AQUA_MODBUS_MISSING 0x8000
+
+typedef struct {
+    uint32_t requests;                  // Frames answered
+    uint32_t exceptions;                // ... with an exception response
+    uint32_t coil_writes;               // Write requests that switched relays
+    uint32_t accepted;                  // Connections
+    uint32_t refused;                   // ... closed at once, MODBUS_MAX_CLIENTS already connected
+    uint32_t dropped;                   // ... closed for a malformed frame
+    int clients;                        // Connected now
+    uint32_t publishes;
+    uint32_t publish_skipped;           // No free slot; pollers kept the previous image
+} aqua_modbus_stats_t;
+
+/**
+ * @brief Clear the image (every value missing), the relays and the stats
+ *
+ * Call at boot, before aqua_modbus_start().
+ */
+void aqua_modbus_init(void);
+
+/**
+ * @brief Publish a sample to pollers; called by the monitoring cycle
+ *
+ * Alert bits are evaluated here, as check_and_send_alerts() does, so the
+ * registers carry them whether or not alerts are uploaded.
+ */
+void aqua_modbus_publish(const aqua_reading_t *r, const aqua_controls_t *c, uint32_t sample);
+
+/**
+ * @brief Answer one frame (MBAP header and PDU) from the current image
+ * @param len Exactly one frame (aqua_modbus_frame_length())
+ * @param size At least AQUA_MODBUS_FRAME_MAX
+ * @return Response length; 0 if there is no room for the response; -1 if
+ *         the frame is malformed and the connection should close
+ */
+int aqua_modbus_handle(const uint8_t *req, size_t len, uint8_t *resp, size_t size);
+
+/**
+ * @brief Length of the frame starting at buf, once its header is in
+ * @return Total length, 0 if fewer than 6 bytes are buffered, -1 if malformed
+ */
+int aqua_modbus_frame_length(const uint8_t *buf, size_t have);
+
+/**
+ * @brief Listen on port and serve pollers from tasks of their own
+ * @param port MODBUS_PORT on the device; 0 picks a free port
+ * @return ESP_OK, ESP_ERR_INVALID_STATE (already running) or ESP_FAIL
+ */
+esp_err_t aqua_modbus_start(int port);
+
+/**
+ * @brief Port the server listens on, 0 if it is not running
+ */
+int aqua_modbus_port(void);
+
+void aqua_modbus_get_stats(aqua_modbus_stats_t *out);
+
+#endif // AQUA_MODBUS_H
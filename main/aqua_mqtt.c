@@ -0,0 +1,443 @@
+#include <string.h>
+#include "aqua_mqtt.h"
+
+// ========== PACKET TYPES ==========
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x82
+#define MQTT_SUBACK      0x90
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+#define MQTT_PUBLISH_DUP 0x08
+
+#define MQTT_TOPIC_MAX 128
+#define MQTT_SUBACK_REFUSED 0xFFFF
+
+// ========== ENCODING ==========
+static size_t put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+    return 2;
+}
+
+static size_t put_str(uint8_t *p, const char *s) {
+    size_t len = strlen(s);
+    put_u16(p, (uint16_t)len);
+    memcpy(p + 2, s, len);
+    return len + 2;
+}
+
+// Writes the fixed header for body_len bytes at the end of a 5-byte gap
+// before body; returns the offset of the first header byte.
+static size_t put_header(uint8_t *packet, uint8_t type, size_t body_len) {
+    uint8_t len_bytes[4];
+    int n = 0;
+    do {
+        uint8_t b = body_len % 128;
+        body_len /= 128;
+        if (body_len > 0) b |= 0x80;
+        len_bytes[n++] = b;
+    } while (body_len > 0 && n < 4);
+
+    size_t start = 5 - 1 - (size_t)n;
+    packet[start] = type;
+    memcpy(packet + start + 1, len_bytes, (size_t)n);
+    return start;
+}
+
+// ========== CONNECTION ==========
+static void drop_connection(aqua_mqtt_client_t *client) {
+    if (client->stream) {
+        hal_stream_close(client->stream);
+        client->stream = NULL;
+    }
+    client->connected = false;
+    client->rx_len = 0;
+    client->ping_outstanding = false;
+    client->pending_suback = 0;
+}
+
+static bool send_bytes(aqua_mqtt_client_t *client, const uint8_t *data, size_t len) {
+    if (!client->stream || hal_stream_write(client->stream, data, len, client->cfg.ack_timeout_ms) < 0) {
+        drop_connection(client);
+        return false;
+    }
+    client->last_tx_us = hal_time_us();
+    return true;
+}
+
+static bool send_short(aqua_mqtt_client_t *client, uint8_t type, uint16_t packet_id, bool with_id) {
+    uint8_t packet[4] = { type, 0 };
+    size_t len = 2;
+    if (with_id) {
+        packet[1] = 2;
+        len += put_u16(packet + 2, packet_id);
+    }
+    return send_bytes(client, packet, len);
+}
+
+// Parses the fixed header of the packet at the start of rx.
+// Returns total packet length, 0 if incomplete, -1 if malformed or too big.
+static int frame_length(const aqua_mqtt_client_t *client, size_t *header_len) {
+    size_t remaining = 0;
+    int shift = 0;
+    for (size_t i = 1; i < 5; i++) {
+        if (i >= client->rx_len) return 0;
+        uint8_t b = client->rx[i];
+        remaining |= (size_t)(b & 0x7F) << shift;
+        shift += 7;
+        if (!(b & 0x80)) {
+            *header_len = i + 1;
+            size_t total = *header_len + remaining;
+            if (total > sizeof(client->rx)) return -1;
+            return client->rx_len >= total ? (int)total : 0;
+        }
+    }
+    return -1;
+}
+
+// Packet IDs run 1..0xFFFE so MQTT_SUBACK_REFUSED never collides
+static uint16_t next_packet_id(aqua_mqtt_client_t *client) {
+    uint16_t id = client->next_id++;
+    if (client->next_id == 0xFFFF) client->next_id = 1;
+    return id;
+}
+
+static void free_inflight(aqua_mqtt_client_t *client, uint16_t packet_id) {
+    for (int i = 0; i < AQUA_MQTT_INFLIGHT_MAX; i++) {
+        if (client->inflight[i].packet_id == packet_id) {
+            client->inflight[i].packet_id = 0;
+            client->inflight_count--;
+            client->stats.acked++;
+            return;
+        }
+    }
+}
+
+static bool handle_publish(aqua_mqtt_client_t *client, const uint8_t *p, size_t len, uint8_t flags) {
+    int qos = (flags >> 1) & 0x03;
+    if (len < 2) return false;
+    size_t topic_len = ((size_t)p[0] << 8) | p[1];
+    size_t pos = 2 + topic_len;
+    if (pos > len || topic_len >= MQTT_TOPIC_MAX) return false;
+
+    char topic[MQTT_TOPIC_MAX];
+    memcpy(topic, p + 2, topic_len);
+    topic[topic_len] = '\0';
+
+    uint16_t packet_id = 0;
+    if (qos > 0) {
+        if (pos + 2 > len) return false;
+        packet_id = (uint16_t)((p[pos] << 8) | p[pos + 1]);
+        pos += 2;
+    }
+
+    char payload[AQUA_MQTT_MAX_PACKET];
+    size_t payload_len = len - pos;
+    memcpy(payload, p + pos, payload_len);
+    payload[payload_len] = '\0';
+
+    client->stats.received++;
+    if (client->cfg.on_message) {
+        client->cfg.on_message(topic, payload, payload_len, client->cfg.ctx);
+    }
+    // QoS 2 is not supported; acknowledge it like QoS 1 so the broker moves on
+    if (qos > 0) {
+        return send_short(client, MQTT_PUBACK, packet_id, true);
+    }
+    return true;
+}
+
+// Handles one complete packet; returns false if the connection was dropped
+static bool handle_packet(aqua_mqtt_client_t *client, const uint8_t *packet, size_t header_len, size_t total) {
+    uint8_t type = packet[0] & 0xF0;
+    const uint8_t *body = packet + header_len;
+    size_t body_len = total - header_len;
+
+    switch (type) {
+    case MQTT_PUBLISH:
+        if (!handle_publish(client, body, body_len, packet[0] & 0x0F)) {
+            drop_connection(client);
+            return false;
+        }
+        return true;
+    case MQTT_PUBACK:
+        if (body_len >= 2) {
+            free_inflight(client, (uint16_t)((body[0] << 8) | body[1]));
+        }
+        return true;
+    case MQTT_SUBACK:
+        if (body_len >= 3 && ((body[0] << 8) | body[1]) == client->pending_suback) {
+            client->pending_suback = body[2] == 0x80 ? MQTT_SUBACK_REFUSED : 0;
+        }
+        return true;
+    case MQTT_PINGRESP:
+        client->ping_outstanding = false;
+        return true;
+    default:
+        return true;
+    }
+}
+
+// Reads and handles packets until one arrives or timeout_ms passes.
+// Returns the type of the last packet handled, 0 on timeout, -1 on error.
+static int pump(aqua_mqtt_client_t *client, int timeout_ms) {
+    for (;;) {
+        size_t header_len;
+        int total = frame_length(client, &header_len);
+        if (total < 0) {
+            drop_connection(client);
+            return -1;
+        }
+        if (total > 0) {
+            uint8_t packet[AQUA_MQTT_MAX_PACKET];
+            memcpy(packet, client->rx, (size_t)total);
+            client->rx_len -= (size_t)total;
+            memmove(client->rx, client->rx + total, client->rx_len);
+            if (!handle_packet(client, packet, header_len, (size_t)total)) {
+                return -1;
+            }
+            return packet[0] & 0xF0;
+        }
+
+        if (!client->stream) return -1;
+        int n = hal_stream_read(client->stream, client->rx + client->rx_len,
+                                sizeof(client->rx) - client->rx_len, timeout_ms);
+        if (n < 0) {
+            drop_connection(client);
+            return -1;
+        }
+        if (n == 0) return 0;
+        client->rx_len += (size_t)n;
+    }
+}
+
+static int remaining_ms(int64_t deadline_us) {
+    int64_t left = deadline_us - hal_time_us();
+    return left > 0 ? (int)((left + 999) / 1000) : 0;
+}
+
+static bool resend_inflight(aqua_mqtt_client_t *client, bool all) {
+    int64_t now = hal_time_us();
+    for (int i = 0; i < AQUA_MQTT_INFLIGHT_MAX; i++) {
+        aqua_mqtt_inflight_t *slot = &client->inflight[i];
+        if (slot->packet_id == 0) continue;
+        if (!all && (client->cfg.ack_timeout_ms <= 0 ||
+                     now - slot->sent_us < (int64_t)client->cfg.ack_timeout_ms * 1000)) {
+            continue;
+        }
+        slot->packet[0] |= MQTT_PUBLISH_DUP;
+        slot->sent_us = now;
+        client->stats.resent++;
+        if (!send_bytes(client, slot->packet, slot->len)) return false;
+    }
+    return true;
+}
+
+// ========== PUBLIC API ==========
+void aqua_mqtt_init(aqua_mqtt_client_t *client, const aqua_mqtt_config_t *cfg) {
+    memset(client, 0, sizeof(*client));
+    client->cfg = *cfg;
+    if (client->cfg.inflight_window < 1) client->cfg.inflight_window = 1;
+    if (client->cfg.inflight_window > AQUA_MQTT_INFLIGHT_MAX) client->cfg.inflight_window = AQUA_MQTT_INFLIGHT_MAX;
+    client->next_id = 1;
+}
+
+esp_err_t aqua_mqtt_connect(aqua_mqtt_client_t *client, int timeout_ms) {
+    const aqua_mqtt_config_t *cfg = &client->cfg;
+    drop_connection(client);
+
+    uint8_t packet[AQUA_MQTT_MAX_PACKET];
+    size_t need = 5 + 10 + 2 + strlen(cfg->client_id) +
+                  (cfg->username ? 2 + strlen(cfg->username) : 0) +
+                  (cfg->password ? 2 + strlen(cfg->password) : 0);
+    if (need > sizeof(packet)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *p = packet + 5;
+    p += put_str(p, "MQTT");
+    *p++ = 4;                                   // Protocol level 3.1.1
+    *p++ = (uint8_t)((cfg->clean_session ? 0x02 : 0) |
+                     (cfg->password ? 0x40 : 0) |
+                     (cfg->username ? 0x80 : 0));
+    p += put_u16(p, cfg->keepalive_s);
+    p += put_str(p, cfg->client_id);
+    if (cfg->username) p += put_str(p, cfg->username);
+    if (cfg->password) p += put_str(p, cfg->password);
+    size_t start = put_header(packet, MQTT_CONNECT, (size_t)(p - packet - 5));
+
+    int64_t deadline = hal_time_us() + (int64_t)timeout_ms * 1000;
+    client->stream = hal_stream_open(cfg->host, cfg->port, cfg->tls, timeout_ms);
+    if (!client->stream) {
+        return ESP_FAIL;
+    }
+    if (!send_bytes(client, packet + start, (size_t)(p - packet) - start)) {
+        return ESP_FAIL;
+    }
+
+    // CONNACK must be the first packet from the broker
+    while (client->rx_len < 4) {
+        int left = remaining_ms(deadline);
+        int n = left > 0 ? hal_stream_read(client->stream, client->rx + client->rx_len,
+                                           sizeof(client->rx) - client->rx_len, left) : 0;
+        if (n <= 0) {
+            drop_connection(client);
+            return n == 0 ? ESP_ERR_TIMEOUT : ESP_FAIL;
+        }
+        client->rx_len += (size_t)n;
+    }
+    if (client->rx[0] != MQTT_CONNACK || client->rx[1] != 2 || client->rx[3] != 0) {
+        drop_connection(client);
+        return ESP_FAIL;
+    }
+    client->session_present = (client->rx[2] & 0x01) != 0;
+    client->rx_len -= 4;
+    memmove(client->rx, client->rx + 4, client->rx_len);
+
+    client->connected = true;
+    client->stats.connects++;
+
+    // Unacknowledged messages from the previous connection go out again
+    if (!resend_inflight(client, true)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t aqua_mqtt_subscribe(aqua_mqtt_client_t *client, const char *topic, int qos, int timeout_ms) {
+    if (!client->connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t packet[5 + 2 + 2 + MQTT_TOPIC_MAX + 1];
+    size_t topic_len = strlen(topic);
+    if (topic_len >= MQTT_TOPIC_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint16_t packet_id = next_packet_id(client);
+
+    uint8_t *p = packet + 5;
+    p += put_u16(p, packet_id);
+    p += put_str(p, topic);
+    *p++ = (uint8_t)(qos > 1 ? 1 : qos);
+    size_t start = put_header(packet, MQTT_SUBSCRIBE, (size_t)(p - packet - 5));
+
+    client->pending_suback = packet_id;
+    if (!send_bytes(client, packet + start, (size_t)(p - packet) - start)) {
+        return ESP_FAIL;
+    }
+
+    int64_t deadline = hal_time_us() + (int64_t)timeout_ms * 1000;
+    while (client->pending_suback == packet_id) {
+        int left = remaining_ms(deadline);
+        if (left == 0) return ESP_ERR_TIMEOUT;
+        if (pump(client, left) < 0) return ESP_FAIL;
+    }
+    if (client->pending_suback == MQTT_SUBACK_REFUSED) {
+        client->pending_suback = 0;
+        return ESP_FAIL;                        // Subscription refused
+    }
+    return ESP_OK;
+}
+
+esp_err_t aqua_mqtt_publish(aqua_mqtt_client_t *client, const char *topic,
+                            const void *payload, size_t len, int qos, int timeout_ms) {
+    if (!client->connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    qos = qos > 0 ? 1 : 0;
+    size_t body_len = 2 + strlen(topic) + (qos ? 2 : 0) + len;
+    if (5 + body_len > AQUA_MQTT_MAX_PACKET) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (qos == 0) {
+        uint8_t packet[AQUA_MQTT_MAX_PACKET];
+        size_t pos = 5 + put_str(packet + 5, topic);
+        memcpy(packet + pos, payload, len);
+        size_t start = put_header(packet, MQTT_PUBLISH, body_len);
+        client->stats.published++;
+        return send_bytes(client, packet + start, 5 + body_len - start) ? ESP_OK : ESP_FAIL;
+    }
+
+    // Wait for a free slot in the window
+    int64_t deadline = hal_time_us() + (int64_t)timeout_ms * 1000;
+    while (client->inflight_count >= client->cfg.inflight_window) {
+        int left = remaining_ms(deadline);
+        if (left == 0) return ESP_ERR_TIMEOUT;
+        if (aqua_mqtt_poll(client, left) != ESP_OK) return ESP_FAIL;
+    }
+
+    aqua_mqtt_inflight_t *slot = NULL;
+    for (int i = 0; i < AQUA_MQTT_INFLIGHT_MAX && !slot; i++) {
+        if (client->inflight[i].packet_id == 0) slot = &client->inflight[i];
+    }
+
+    uint16_t packet_id = next_packet_id(client);
+
+    // Build in place, then shift the packet to the start of the slot
+    uint8_t *p = slot->packet + 5;
+    p += put_str(p, topic);
+    p += put_u16(p, packet_id);
+    memcpy(p, payload, len);
+    size_t start = put_header(slot->packet, MQTT_PUBLISH | 0x02, body_len);
+    slot->len = (uint16_t)(5 + body_len - start);
+    memmove(slot->packet, slot->packet + start, slot->len);
+    slot->packet_id = packet_id;
+    slot->sent_us = hal_time_us();
+    client->inflight_count++;
+    client->stats.published++;
+
+    send_bytes(client, slot->packet, slot->len);
+    return ESP_OK;
+}
+
+esp_err_t aqua_mqtt_poll(aqua_mqtt_client_t *client, int timeout_ms) {
+    if (!client->connected) {
+        return ESP_FAIL;
+    }
+
+    // Keepalive: ping when idle, give up if the previous ping went unanswered
+    int64_t now = hal_time_us();
+    int64_t keepalive_us = (int64_t)client->cfg.keepalive_s * 1000000;
+    if (keepalive_us > 0 && now - client->last_tx_us >= keepalive_us) {
+        if (client->ping_outstanding) {
+            drop_connection(client);
+            return ESP_FAIL;
+        }
+        if (!send_short(client, MQTT_PINGREQ, 0, false)) return ESP_FAIL;
+        client->ping_outstanding = true;
+    }
+    if (!resend_inflight(client, false)) {
+        return ESP_FAIL;
+    }
+
+    int handled = pump(client, timeout_ms);
+    // Drain whatever else already arrived without waiting
+    while (handled > 0) {
+        handled = pump(client, 0);
+    }
+    return handled < 0 ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t aqua_mqtt_flush(aqua_mqtt_client_t *client, int timeout_ms) {
+    int64_t deadline = hal_time_us() + (int64_t)timeout_ms * 1000;
+    while (client->inflight_count > 0) {
+        int left = remaining_ms(deadline);
+        if (left == 0) return ESP_ERR_TIMEOUT;
+        if (aqua_mqtt_poll(client, left) != ESP_OK) return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void aqua_mqtt_disconnect(aqua_mqtt_client_t *client) {
+    if (client->connected) {
+        send_short(client, MQTT_DISCONNECT, 0, false);
+    }
+    drop_connection(client);
+}
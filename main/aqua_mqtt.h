@@ -0,0 +1,124 @@
+#ifndef AQUA_MQTT_H
+#define AQUA_MQTT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "hal.h"
+
+// Minimal MQTT 3.1.1 client over the HAL stream transport.
+//
+// - Persistent session (clean_session = false) so the broker keeps the
+//   subscription and queues QoS 1 commands while the device is offline
+// - QoS 1 publishing with a bounded in-flight window: up to inflight_window
+//   PUBLISH packets may be unacknowledged at once. Unacknowledged packets
+//   are resent with DUP set after ack_timeout_ms and after every reconnect
+// - QoS 0/1 delivery of subscribed messages (QoS 2 is not supported)
+//
+// All I/O happens inside the calling task; there is no background thread.
+
+#define AQUA_MQTT_INFLIGHT_MAX 8
+#define AQUA_MQTT_MAX_PACKET 1024
+
+typedef void (*aqua_mqtt_message_cb_t)(const char *topic, const char *payload, size_t len, void *ctx);
+
+typedef struct {
+    const char *host;
+    int port;
+    hal_tls_mode_t tls;
+    const char *client_id;
+    const char *username;           // NULL for none
+    const char *password;           // NULL for none
+    uint16_t keepalive_s;
+    bool clean_session;
+    int inflight_window;            // 1..AQUA_MQTT_INFLIGHT_MAX
+    int ack_timeout_ms;             // Resend unacknowledged PUBLISH after this
+    aqua_mqtt_message_cb_t on_message;
+    void *ctx;
+} aqua_mqtt_config_t;
+
+typedef struct {
+    uint16_t packet_id;             // 0 = free slot
+    int64_t sent_us;
+    uint16_t len;
+    uint8_t packet[AQUA_MQTT_MAX_PACKET];
+} aqua_mqtt_inflight_t;
+
+typedef struct {
+    uint32_t published;
+    uint32_t acked;
+    uint32_t resent;
+    uint32_t received;
+    uint32_t connects;
+} aqua_mqtt_stats_t;
+
+typedef struct {
+    aqua_mqtt_config_t cfg;
+    hal_stream_t *stream;
+    bool connected;
+    bool session_present;
+    uint16_t next_id;
+    int64_t last_tx_us;
+    bool ping_outstanding;
+    uint16_t pending_suback;        // Packet ID of an unanswered SUBSCRIBE
+    aqua_mqtt_inflight_t inflight[AQUA_MQTT_INFLIGHT_MAX];
+    int inflight_count;
+    uint8_t rx[AQUA_MQTT_MAX_PACKET];
+    size_t rx_len;
+    aqua_mqtt_stats_t stats;
+} aqua_mqtt_client_t;
+
+void aqua_mqtt_init(aqua_mqtt_client_t *client, const aqua_mqtt_config_t *cfg);
+
+/**
+ * @brief Open the stream, send CONNECT and wait for CONNACK
+ *
+ * Unacknowledged QoS 1 messages from a previous connection are resent.
+ * @return ESP_OK when connected, ESP_ERR_TIMEOUT / ESP_FAIL otherwise
+ */
+esp_err_t aqua_mqtt_connect(aqua_mqtt_client_t *client, int timeout_ms);
+
+/**
+ * @brief Subscribe to topic and wait for SUBACK
+ */
+esp_err_t aqua_mqtt_subscribe(aqua_mqtt_client_t *client, const char *topic, int qos, int timeout_ms);
+
+/**
+ * @brief Publish without waiting for the acknowledgement
+ *
+ * With qos 1 the message occupies an in-flight slot until PUBACK arrives.
+ * If the window is full this services the connection for up to timeout_ms.
+ * A QoS 1 message that was queued stays owned by the client even if the
+ * connection drops while sending it; it is resent on the next connect.
+ * @return ESP_OK if sent or queued, ESP_ERR_TIMEOUT if the window stayed full,
+ *         ESP_ERR_INVALID_SIZE if the packet does not fit,
+ *         ESP_ERR_INVALID_STATE if not connected, ESP_FAIL on I/O error (QoS 0)
+ */
+esp_err_t aqua_mqtt_publish(aqua_mqtt_client_t *client, const char *topic,
+                            const void *payload, size_t len, int qos, int timeout_ms);
+
+/**
+ * @brief Process incoming packets, keepalive and resends for up to timeout_ms
+ *
+ * Returns as soon as at least one packet was handled (or on timeout).
+ * @return ESP_OK, or ESP_FAIL if the connection was lost
+ */
+esp_err_t aqua_mqtt_poll(aqua_mqtt_client_t *client, int timeout_ms);
+
+/**
+ * @brief Service the connection until every QoS 1 message is acknowledged
+ * @return ESP_OK when the window is empty, ESP_ERR_TIMEOUT otherwise
+ */
+esp_err_t aqua_mqtt_flush(aqua_mqtt_client_t *client, int timeout_ms);
+
+/**
+ * @brief Send DISCONNECT and close; in-flight messages are kept for the next connect
+ */
+void aqua_mqtt_disconnect(aqua_mqtt_client_t *client);
+
+static inline int aqua_mqtt_inflight(const aqua_mqtt_client_t *client) {
+    return client->inflight_count;
+}
+
+#endif // AQUA_MQTT_H
@@ -0,0 +1,252 @@
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_delta.h"
+#include "aqua_log.h"
+#include "aqua_ota.h"
+#include "hal.h"
+
+#define OTA_CHUNK 1024
+#define OTA_TIMEOUT_MS 15000
+
+typedef enum {
+    DL_OK = 0,
+    DL_NETWORK,             // Connection, status or truncated body
+    DL_CONTENT,             // Body arrived but is unusable (worth trying the full image)
+    DL_WRITE                // Flash write or image validation failed
+} dl_result_t;
+
+// Receives each downloaded chunk; returns DL_OK to continue
+typedef dl_result_t (*chunk_fn_t)(const uint8_t *data, size_t len, void *ctx);
+
+static aqua_ota_stats_t stats;
+static aqua_delta_t delta;     // ~330 bytes, kept off the task stack
+
+static dl_result_t download(const char *url, chunk_fn_t chunk, void *ctx) {
+    int status = 0, length = -1;
+    uint32_t received = 0;
+    hal_http_download_t *dl = hal_http_download_open(url, HAL_TLS_CA_STORE, OTA_TIMEOUT_MS, &status, &length);
+    if (!dl) {
+        return DL_NETWORK;
+    }
+    if (status != 200) {
+        hal_http_download_close(dl);
+        return DL_NETWORK;
+    }
+
+    uint8_t buf[OTA_CHUNK];
+    dl_result_t result = DL_OK;
+    for (;;) {
+        int n = hal_http_download_read(dl, buf, sizeof(buf));
+        if (n < 0) {
+            result = DL_NETWORK;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        received += (uint32_t)n;
+        stats.last_downloaded += (uint32_t)n;
+        hal_watchdog_feed();
+        result = chunk(buf, (size_t)n, ctx);
+        if (result != DL_OK) {
+            break;
+        }
+    }
+    hal_http_download_close(dl);
+
+    if (result == DL_OK && length >= 0 && received != (uint32_t)length) {
+        result = DL_NETWORK;
+    }
+    return result;
+}
+
+// ========== DELTA IMAGE ==========
+typedef struct {
+    bool begun;
+    aqua_delta_result_t result;
+} delta_ctx_t;
+
+static bool delta_read(void *ctx, size_t offset, void *buf, size_t len) {
+    return hal_ota_read_running(offset, buf, len) == ESP_OK;
+}
+
+static bool delta_write(void *ctx, const void *data, size_t len) {
+    delta_ctx_t *c = ctx;
+    if (!c->begun) {
+        // The header (and the source check) are done before the first write
+        if (hal_ota_begin(aqua_delta_header(&delta)->target_size) != ESP_OK) {
+            return false;
+        }
+        c->begun = true;
+    }
+    return hal_ota_write(data, len) == ESP_OK;
+}
+
+static dl_result_t delta_chunk(const uint8_t *data, size_t len, void *ctx) {
+    delta_ctx_t *c = ctx;
+    c->result = aqua_delta_feed(&delta, data, len);
+    if (c->result == AQUA_DELTA_MORE || c->result == AQUA_DELTA_DONE) {
+        return DL_OK;
+    }
+    return c->result == AQUA_DELTA_ERR_IO ? DL_WRITE : DL_CONTENT;
+}
+
+static const char *delta_error(aqua_delta_result_t result) {
+    switch (result) {
+    case AQUA_DELTA_ERR_SOURCE: return "made for a different image";
+    case AQUA_DELTA_ERR_VERIFY: return "rebuilt image CRC mismatch";
+    case AQUA_DELTA_ERR_FORMAT: return "malformed";
+    default: return "incomplete";
+    }
+}
+
+static dl_result_t install_delta(const aqua_ota_manifest_t *m) {
+    delta_ctx_t c = { .result = AQUA_DELTA_MORE };
+    aqua_delta_init(&delta, delta_read, delta_write, &c);
+
+    dl_result_t result = download(m->delta_url, delta_chunk, &c);
+    if (result == DL_OK && c.result != AQUA_DELTA_DONE) {
+        result = DL_NETWORK;    // Body ended before the END op
+    }
+    if (result == DL_OK && aqua_delta_header(&delta)->target_crc != m->image_crc) {
+        result = DL_CONTENT;    // A valid delta, but not to the advertised image
+    }
+    if (result != DL_OK) {
+        if (c.begun) hal_ota_abort();
+        if (result == DL_CONTENT) AQUA_LOG(OTA_DELTA_REJECTED, delta_error(c.result));
+    }
+    return result;
+}
+
+// ========== FULL IMAGE ==========
+typedef struct {
+    uint32_t written;
+    uint32_t crc;
+    uint32_t size;
+} full_ctx_t;
+
+static dl_result_t full_chunk(const uint8_t *data, size_t len, void *ctx) {
+    full_ctx_t *c = ctx;
+    if (c->written + len > c->size) {
+        return DL_CONTENT;
+    }
+    if (hal_ota_write(data, len) != ESP_OK) {
+        return DL_WRITE;
+    }
+    c->crc = aqua_crc32(c->crc, data, len);
+    c->written += (uint32_t)len;
+    return DL_OK;
+}
+
+static dl_result_t install_full(const aqua_ota_manifest_t *m) {
+    if (hal_ota_begin(m->image_size) != ESP_OK) {
+        return DL_WRITE;
+    }
+    full_ctx_t c = { .size = m->image_size };
+    dl_result_t result = download(m->image_url, full_chunk, &c);
+    if (result == DL_OK && (c.written != m->image_size || c.crc != m->image_crc)) {
+        result = DL_CONTENT;
+    }
+    if (result != DL_OK) {
+        hal_ota_abort();
+    }
+    return result;
+}
+
+// ========== UPDATE CHECK ==========
+static const char *dl_error(dl_result_t result) {
+    switch (result) {
+    case DL_NETWORK: return "download interrupted";
+    case DL_CONTENT: return "image does not match the manifest";
+    default: return "flash write failed";
+    }
+}
+
+aqua_ota_result_t aqua_ota_check(void) {
+    // Never replace an image that has not proven itself yet
+    if (hal_ota_pending_verify()) {
+        return AQUA_OTA_UP_TO_DATE;
+    }
+    stats.checks++;
+    AQUA_LOG(OTA_CHECK, AQUA_FW_VERSION);
+
+    char body[1024];
+    hal_http_request_t req = {
+        .url = OTA_MANIFEST_URL,
+        .method = HAL_HTTP_GET,
+        .tls = HAL_TLS_CA_STORE,
+        .timeout_ms = 10000
+    };
+    hal_http_response_t resp = { .body = body, .body_size = sizeof(body) };
+    if (hal_http_perform(&req, &resp) != ESP_OK || resp.status != 200) {
+        AQUA_LOG(OTA_MANIFEST_FAILED, resp.status);
+        return AQUA_OTA_NO_MANIFEST;
+    }
+
+    aqua_ota_manifest_t m;
+    if (!aqua_parse_ota_manifest(body, AQUA_FW_VERSION, &m)) {
+        AQUA_LOG(OTA_MANIFEST_INVALID);
+        return AQUA_OTA_NO_MANIFEST;
+    }
+    if (strcmp(m.version, AQUA_FW_VERSION) == 0) {
+        AQUA_LOG(OTA_UP_TO_DATE);
+        return AQUA_OTA_UP_TO_DATE;
+    }
+    if (m.image_size > hal_ota_slot_size()) {
+        AQUA_LOG(OTA_TOO_LARGE, (int)m.image_size, (int)hal_ota_slot_size());
+        return AQUA_OTA_FAILED;
+    }
+
+    stats.last_downloaded = 0;
+    stats.last_image_size = m.image_size;
+    stats.last_used_delta = m.delta_url[0] != '\0';
+    dl_result_t result = DL_CONTENT;
+    if (stats.last_used_delta) {
+        AQUA_LOG(OTA_UPDATE, AQUA_FW_VERSION, m.version, "delta", (int)m.delta_size);
+        result = install_delta(&m);
+        if (result == DL_CONTENT) {
+            stats.delta_fallbacks++;
+            stats.last_used_delta = false;
+        }
+    }
+    if (!stats.last_used_delta) {
+        AQUA_LOG(OTA_UPDATE, AQUA_FW_VERSION, m.version, "full image", (int)m.image_size);
+        result = install_full(&m);
+    }
+    if (result == DL_OK && hal_ota_end() != ESP_OK) {
+        result = DL_WRITE;
+    }
+    if (result != DL_OK) {
+        AQUA_LOG(OTA_DOWNLOAD_FAILED, (int)stats.last_downloaded, dl_error(result));
+        return AQUA_OTA_FAILED;
+    }
+
+    stats.updates++;
+    AQUA_LOG(OTA_WRITTEN, (int)stats.last_downloaded, (int)m.image_size);
+    aqua_log_flush();
+    hal_restart();
+    return AQUA_OTA_UPDATED;
+}
+
+void aqua_ota_after_cycle(int cycle_count, const aqua_reading_t *reading, bool uploaded) {
+    if (hal_ota_pending_verify()) {
+        int missing = aqua_count_missing_critical(reading);
+        // At least one critical probe must read, however many are fitted
+        if (uploaded && missing < aqua_count_critical()) {
+            hal_ota_mark_valid();
+            AQUA_LOG(OTA_CONFIRMED, AQUA_FW_VERSION);
+        } else {
+            AQUA_LOG(OTA_ROLLBACK, uploaded ? "OK" : "FAILED", missing);
+            aqua_log_flush();
+            hal_ota_rollback();
+        }
+        return;
+    }
+    if (OTA_CHECK_INTERVAL_CYCLES > 0 && cycle_count % OTA_CHECK_INTERVAL_CYCLES == 0) {
+        aqua_ota_check();
+    }
+}
+
+const aqua_ota_stats_t *aqua_ota_get_stats(void) {
+    return &stats;
+}
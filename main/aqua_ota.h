@@ -0,0 +1,51 @@
+#ifndef AQUA_OTA_H
+#define AQUA_OTA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "aqua_core.h"
+
+// Firmware updates into the inactive A/B slot.
+//
+// OTA_MANIFEST_URL names the newest image. If it lists a delta from the
+// running AQUA_FW_VERSION, only the delta is downloaded and applied on the
+// fly against the running slot (aqua_delta.h); otherwise, or if the delta
+// does not match the running image, the full image is streamed. The new
+// image boots on trial and is kept only if its first cycle uploads a reading
+// with at least one critical sensor working; otherwise the bootloader goes
+// back to the previous slot.
+
+typedef enum {
+    AQUA_OTA_UP_TO_DATE = 0,    // Nothing to do (or the running image is still on trial)
+    AQUA_OTA_UPDATED,           // New image written and restart requested
+    AQUA_OTA_NO_MANIFEST,       // Manifest could not be fetched or parsed
+    AQUA_OTA_FAILED             // Download or write failed; the running image is untouched
+} aqua_ota_result_t;
+
+typedef struct {
+    int checks;
+    int updates;
+    int delta_fallbacks;        // Deltas rejected and replaced by the full image
+    bool last_used_delta;
+    uint32_t last_downloaded;   // Bytes downloaded by the last update attempt
+    uint32_t last_image_size;
+} aqua_ota_stats_t;
+
+/**
+ * @brief Fetch the manifest and install a newer image if there is one
+ *
+ * Restarts the device on success (on the host, the simulated restart returns).
+ */
+aqua_ota_result_t aqua_ota_check(void);
+
+/**
+ * @brief Call after each monitoring cycle
+ *
+ * Confirms or rolls back an image on trial, and runs aqua_ota_check() every
+ * OTA_CHECK_INTERVAL_CYCLES cycles.
+ */
+void aqua_ota_after_cycle(int cycle_count, const aqua_reading_t *reading, bool uploaded);
+
+const aqua_ota_stats_t *aqua_ota_get_stats(void);
+
+#endif // AQUA_OTA_H
@@ -0,0 +1,320 @@
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_outq.h"
+
+void aqua_outq_config_defaults(aqua_outq_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->cls[AQUA_OUTQ_ALERT] = (aqua_outq_class_cfg_t){
+        .deadline_ms = OUTQ_ALERT_DEADLINE_MS,
+        .max_attempts = OUTQ_ALERT_MAX_ATTEMPTS,
+        .retry_delay_ms = OUTQ_ALERT_RETRY_MS,
+        .retry_max_ms = OUTQ_ALERT_RETRY_MAX_MS,
+        .over_budget = true
+    };
+    cfg->cls[AQUA_OUTQ_COMMAND] = (aqua_outq_class_cfg_t){
+        .deadline_ms = OUTQ_COMMAND_DEADLINE_MS,
+        .max_attempts = RELAY_POLL_MAX_ATTEMPTS,
+        .retry_delay_ms = RELAY_POLL_RETRY_DELAY_MS,
+        .retry_max_ms = OUTQ_COMMAND_DEADLINE_MS,
+        .over_budget = true
+    };
+    cfg->cls[AQUA_OUTQ_LIVE] = (aqua_outq_class_cfg_t){
+        .deadline_ms = OUTQ_LIVE_DEADLINE_MS,
+        .max_attempts = UPLOAD_MAX_ATTEMPTS,
+        .retry_delay_ms = UPLOAD_RETRY_DELAY_MS,
+        .retry_max_ms = OUTQ_LIVE_DEADLINE_MS,
+        .over_budget = true
+    };
+    cfg->cls[AQUA_OUTQ_BACKLOG] = (aqua_outq_class_cfg_t){
+        .deadline_ms = OUTQ_BACKLOG_DEADLINE_MS,
+        .max_attempts = 0,
+        .retry_delay_ms = OUTQ_BACKLOG_RETRY_MS,
+        .retry_max_ms = OUTQ_BACKLOG_RETRY_MAX_MS,
+        .over_budget = false
+    };
+    cfg->budget_bytes_per_s = OUTQ_BUDGET_BYTES_PER_S;
+    cfg->budget_burst_bytes = OUTQ_BUDGET_BURST_BYTES;
+    cfg->request_overhead = OUTQ_REQUEST_OVERHEAD;
+}
+
+void aqua_outq_init(aqua_outq_t *q, const aqua_outq_config_t *cfg,
+                    aqua_outq_drop_cb_t on_drop, void *ctx) {
+    memset(q, 0, sizeof(*q));
+    if (cfg) {
+        q->cfg = *cfg;
+    } else {
+        aqua_outq_config_defaults(&q->cfg);
+    }
+    q->on_drop = on_drop;
+    q->ctx = ctx;
+    q->next_seq = 1;
+    q->tokens = q->cfg.budget_burst_bytes;
+}
+
+const char *aqua_outq_class_name(aqua_outq_class_t cls) {
+    switch (cls) {
+    case AQUA_OUTQ_ALERT: return "alert";
+    case AQUA_OUTQ_COMMAND: return "command";
+    case AQUA_OUTQ_LIVE: return "live";
+    case AQUA_OUTQ_BACKLOG: return "backlog";
+    default: return "?";
+    }
+}
+
+static int64_t deadline_after(const aqua_outq_class_cfg_t *c, int64_t from_us) {
+    return c->deadline_ms > 0 ? from_us + (int64_t)c->deadline_ms * 1000 : INT64_MAX;
+}
+
+static void drop(aqua_outq_t *q, aqua_outq_item_t *item) {
+    if (q->on_drop) {
+        q->on_drop(item, q->ctx);
+    }
+    item->used = false;
+}
+
+// A live row out of time or attempts keeps its age and queue order
+static void demote(aqua_outq_t *q, aqua_outq_item_t *item, int64_t now_us) {
+    const aqua_outq_class_cfg_t *c = &q->cfg.cls[AQUA_OUTQ_BACKLOG];
+    item->cls = AQUA_OUTQ_BACKLOG;
+    item->attempts = 0;
+    item->max_attempts = c->max_attempts;
+    item->not_before_us = now_us + (int64_t)c->retry_delay_ms * 1000;
+    item->deadline_us = deadline_after(c, item->queued_us);
+    q->stats[AQUA_OUTQ_BACKLOG].queued++;
+}
+
+static int64_t cost_of(const aqua_outq_t *q, const aqua_outq_item_t *item) {
+    return (int64_t)item->len + q->cfg.request_overhead;
+}
+
+// Whole bytes only; the remainder stays in the time base
+static void refill(aqua_outq_t *q, int64_t now_us) {
+    uint32_t rate = q->cfg.budget_bytes_per_s;
+    int64_t elapsed = now_us - q->refilled_us;
+    if (rate == 0 || elapsed <= 0 || q->tokens >= (int64_t)q->cfg.budget_burst_bytes) {
+        q->refilled_us = now_us;
+        return;
+    }
+    int64_t add = elapsed * rate / 1000000;
+    q->tokens += add;
+    q->refilled_us += add * 1000000 / rate;
+    if (q->tokens >= (int64_t)q->cfg.budget_burst_bytes) {
+        q->tokens = q->cfg.budget_burst_bytes;
+        q->refilled_us = now_us;
+    }
+}
+
+aqua_outq_item_t *aqua_outq_push(aqua_outq_t *q, aqua_outq_class_t cls, uint8_t kind,
+                                 const char *body, size_t len, int64_t now_us) {
+    if (cls >= AQUA_OUTQ_CLASS_COUNT || len > AQUA_OUTQ_BODY_MAX || (len > 0 && !body)) {
+        return NULL;
+    }
+
+    aqua_outq_item_t *slot = NULL;
+    aqua_outq_item_t *victim = NULL;
+    for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+        aqua_outq_item_t *it = &q->items[i];
+        if (!it->used) {
+            slot = it;
+            break;
+        }
+        if (it->in_flight) continue;
+        if (!victim || it->cls > victim->cls || (it->cls == victim->cls && it->seq < victim->seq)) {
+            victim = it;
+        }
+    }
+    if (!slot) {
+        // Full: the oldest request of the lowest class makes room
+        if (!victim || victim->cls < cls) {
+            q->stats[cls].refused++;
+            return NULL;
+        }
+        q->stats[victim->cls].evicted++;
+        drop(q, victim);
+        slot = victim;
+    }
+
+    const aqua_outq_class_cfg_t *c = &q->cfg.cls[cls];
+    memset(slot, 0, offsetof(aqua_outq_item_t, body));
+    slot->used = true;
+    slot->cls = (uint8_t)cls;
+    slot->kind = kind;
+    slot->max_attempts = c->max_attempts;
+    slot->seq = q->next_seq++;
+    slot->queued_us = now_us;
+    slot->deadline_us = deadline_after(c, now_us);
+    slot->not_before_us = now_us;
+    slot->len = (uint16_t)len;
+    if (len > 0) {
+        memcpy(slot->body, body, len);
+    }
+    slot->body[len] = '\0';
+    q->stats[cls].queued++;
+    return slot;
+}
+
+// The request to send now, without handing it out
+static aqua_outq_item_t *pick(aqua_outq_t *q, int64_t now_us, int64_t *wait_us) {
+    refill(q, now_us);
+    uint32_t rate = q->cfg.budget_bytes_per_s;
+
+    aqua_outq_item_t *best = NULL;
+    int64_t wait = -1;
+    for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+        aqua_outq_item_t *it = &q->items[i];
+        if (!it->used || it->in_flight) continue;
+
+        if (it->deadline_us <= now_us) {
+            q->stats[it->cls].expired++;
+            if (it->cls == AQUA_OUTQ_LIVE) {
+                demote(q, it, now_us);
+            } else {
+                drop(q, it);
+                continue;
+            }
+        }
+
+        int64_t ready_us = it->not_before_us;
+        if (rate > 0 && !q->cfg.cls[it->cls].over_budget && q->tokens < cost_of(q, it)) {
+            int64_t short_by = cost_of(q, it) - q->tokens;
+            int64_t budget_us = q->refilled_us + (short_by * 1000000 + rate - 1) / rate;
+            if (budget_us > ready_us) {
+                ready_us = budget_us;
+            }
+        }
+        if (ready_us > now_us) {
+            if (wait < 0 || ready_us - now_us < wait) {
+                wait = ready_us - now_us;
+            }
+            continue;
+        }
+        if (!best || it->cls < best->cls || (it->cls == best->cls && it->seq < best->seq)) {
+            best = it;
+        }
+    }
+
+    if (wait_us) {
+        *wait_us = best ? 0 : wait;
+    }
+    return best;
+}
+
+aqua_outq_item_t *aqua_outq_next(aqua_outq_t *q, int64_t now_us, int64_t *wait_us) {
+    aqua_outq_item_t *best = pick(q, now_us, wait_us);
+    if (!best) {
+        return NULL;
+    }
+
+    int64_t cost = cost_of(q, best);
+    if (q->cfg.budget_bytes_per_s > 0) {
+        q->tokens -= cost;
+    }
+    best->in_flight = true;
+    best->attempts++;
+    q->stats[best->cls].attempts++;
+    q->stats[best->cls].bytes += (uint32_t)cost;
+    return best;
+}
+
+const aqua_outq_item_t *aqua_outq_peek(aqua_outq_t *q, int64_t now_us) {
+    return pick(q, now_us, NULL);
+}
+
+int aqua_outq_next_batch(aqua_outq_t *q, const aqua_outq_item_t *first, aqua_outq_item_t **more,
+                         int max, size_t max_bytes, int64_t now_us) {
+    bool limited = q->cfg.budget_bytes_per_s > 0 && !q->cfg.cls[first->cls].over_budget;
+    size_t bytes = 0;
+    int n = 0;
+    while (n < max) {
+        // Oldest ready companion not yet taken
+        aqua_outq_item_t *pick = NULL;
+        for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+            aqua_outq_item_t *it = &q->items[i];
+            if (it->used && !it->in_flight && it->cls == first->cls && it->kind == first->kind &&
+                it->not_before_us <= now_us && it->deadline_us > now_us &&
+                (!pick || it->seq < pick->seq)) {
+                pick = it;
+            }
+        }
+        if (!pick || bytes + pick->len > max_bytes || (limited && q->tokens < pick->len)) {
+            break;
+        }
+        bytes += pick->len;
+        if (q->cfg.budget_bytes_per_s > 0) {
+            q->tokens -= pick->len;
+        }
+        pick->in_flight = true;
+        pick->attempts++;
+        q->stats[pick->cls].attempts++;
+        q->stats[pick->cls].bytes += pick->len;
+        more[n++] = pick;
+    }
+    return n;
+}
+
+void aqua_outq_credit(aqua_outq_t *q, aqua_outq_class_t cls, uint32_t bytes) {
+    if (q->cfg.budget_bytes_per_s > 0) {
+        q->tokens += bytes;
+        if (q->tokens > (int64_t)q->cfg.budget_burst_bytes) {
+            q->tokens = q->cfg.budget_burst_bytes;
+        }
+    }
+    q->stats[cls].bytes -= bytes < q->stats[cls].bytes ? bytes : q->stats[cls].bytes;
+}
+
+aqua_outq_outcome_t aqua_outq_complete(aqua_outq_t *q, aqua_outq_item_t *item,
+                                       aqua_outq_result_t result, int64_t now_us) {
+    aqua_outq_class_stats_t *st = &q->stats[item->cls];
+    item->in_flight = false;
+
+    if (result == AQUA_OUTQ_DELIVERED) {
+        st->delivered++;
+        item->used = false;
+        return AQUA_OUTQ_DONE;
+    }
+    if (result == AQUA_OUTQ_FAILED) {
+        st->failed++;
+    }
+    if (result == AQUA_OUTQ_REJECTED || (item->max_attempts > 0 && item->attempts >= item->max_attempts)) {
+        if (result == AQUA_OUTQ_FAILED && item->cls == AQUA_OUTQ_LIVE) {
+            demote(q, item, now_us);
+            return AQUA_OUTQ_DEMOTED;
+        }
+        st->dropped++;
+        drop(q, item);
+        return AQUA_OUTQ_DROPPED;
+    }
+
+    const aqua_outq_class_cfg_t *c = &q->cfg.cls[item->cls];
+    int64_t delay_ms = c->retry_delay_ms;
+    for (int i = 1; i < item->attempts && delay_ms < c->retry_max_ms; i++) {
+        delay_ms *= 2;
+    }
+    if (c->retry_max_ms > 0 && delay_ms > c->retry_max_ms) {
+        delay_ms = c->retry_max_ms;
+    }
+    item->not_before_us = now_us + delay_ms * 1000;
+    return AQUA_OUTQ_RETRYING;
+}
+
+aqua_outq_item_t *aqua_outq_find(aqua_outq_t *q, uint8_t kind) {
+    aqua_outq_item_t *found = NULL;
+    for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+        aqua_outq_item_t *it = &q->items[i];
+        if (it->used && !it->in_flight && it->kind == kind && (!found || it->seq < found->seq)) {
+            found = it;
+        }
+    }
+    return found;
+}
+
+int aqua_outq_pending(const aqua_outq_t *q, aqua_outq_class_t cls) {
+    int n = 0;
+    for (int i = 0; i < AQUA_OUTQ_SLOTS; i++) {
+        const aqua_outq_item_t *it = &q->items[i];
+        if (it->used && (cls == AQUA_OUTQ_CLASS_COUNT || it->cls == cls)) {
+            n++;
+        }
+    }
+    return n;
+}
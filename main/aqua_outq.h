@@ -0,0 +1,189 @@
+#ifndef AQUA_OUTQ_H
+#define AQUA_OUTQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Priority-classed queue for outbound requests (OUTBOUND in aqua_config.h).
+//
+// Every request the controller makes is queued with a class. The sender
+// asks for one request at a time and reports how the attempt went, so a
+// higher class pre-empts lower ones between requests: an alert raised while
+// the backlog drains goes out next, not after it. Within a class requests
+// leave oldest first.
+//
+// - Deadlines: a request not delivered within its class deadline is dropped
+//   (live rows move to the backlog instead)
+// - Retries: failed attempts back off per class, doubling up to a cap; a
+//   request waiting to retry does not hold up the ones behind it
+// - Airtime budget: a token bucket of bytes (body plus a per-request
+//   overhead for headers and TLS records). Classes marked over_budget may
+//   overdraw it, which then holds the others back until it refills
+// - When every slot is taken the oldest request of the lowest class makes
+//   room, if that class is not above the new request's
+//
+// Time is passed in, so the scheduler runs unchanged on the host against a
+// simulated link (host/tests/test_outq.c).
+
+#ifndef AQUA_OUTQ_SLOTS
+#define AQUA_OUTQ_SLOTS 24
+#endif
+#define AQUA_OUTQ_BODY_MAX 896
+
+typedef enum {
+    AQUA_OUTQ_ALERT = 0,        // Critical alerts
+    AQUA_OUTQ_COMMAND,          // Relay command and parameter traffic
+    AQUA_OUTQ_LIVE,             // This cycle's reading
+    AQUA_OUTQ_BACKLOG,          // Readings that missed their live deadline
+    AQUA_OUTQ_CLASS_COUNT
+} aqua_outq_class_t;
+
+typedef enum {
+    AQUA_OUTQ_DELIVERED = 0,    // Server accepted the request
+    AQUA_OUTQ_FAILED,           // Transient failure (timeout, 5xx, no route): retry
+    AQUA_OUTQ_REJECTED          // Permanent failure (4xx): drop
+} aqua_outq_result_t;
+
+typedef enum {
+    AQUA_OUTQ_DONE = 0,         // Delivered and removed
+    AQUA_OUTQ_RETRYING,         // Stays queued until its next attempt
+    AQUA_OUTQ_DEMOTED,          // Live row out of attempts, now in the backlog
+    AQUA_OUTQ_DROPPED           // Removed undelivered
+} aqua_outq_outcome_t;
+
+typedef struct {
+    int32_t deadline_ms;        // Drop if undelivered this long after queueing (0: never)
+    uint8_t max_attempts;       // Default per request (0: until the deadline)
+    int32_t retry_delay_ms;     // Before the second attempt, then doubling...
+    int32_t retry_max_ms;       // ... up to this
+    bool over_budget;           // May send with the airtime budget exhausted
+} aqua_outq_class_cfg_t;
+
+typedef struct {
+    aqua_outq_class_cfg_t cls[AQUA_OUTQ_CLASS_COUNT];
+    uint32_t budget_bytes_per_s;    // Airtime budget refill (0: unlimited)
+    uint32_t budget_burst_bytes;    // Bucket size
+    uint16_t request_overhead;      // Bytes charged per request on top of its body
+} aqua_outq_config_t;
+
+typedef struct {
+    bool used;
+    bool in_flight;             // Handed out by aqua_outq_next(), not yet completed
+    uint8_t cls;
+    uint8_t kind;               // Caller's request type
+    uint8_t attempts;
+    uint8_t max_attempts;       // May be changed after aqua_outq_push()
+    uint32_t seq;               // Queue order, unique per queue
+    int64_t queued_us;
+    int64_t deadline_us;        // INT64_MAX: none
+    int64_t not_before_us;      // Next attempt
+    uint16_t len;
+    char body[AQUA_OUTQ_BODY_MAX + 1];
+} aqua_outq_item_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t attempts;
+    uint32_t delivered;
+    uint32_t failed;            // Failed attempts
+    uint32_t expired;           // Deadline passed (live: moved to the backlog)
+    uint32_t dropped;           // Out of attempts or rejected
+    uint32_t evicted;           // Made room for another request
+    uint32_t refused;           // Queue full of higher classes
+    uint32_t bytes;             // Charged to the budget
+} aqua_outq_class_stats_t;
+
+/**
+ * @brief Called for every request removed undelivered (expired, dropped or evicted)
+ */
+typedef void (*aqua_outq_drop_cb_t)(const aqua_outq_item_t *item, void *ctx);
+
+typedef struct {
+    aqua_outq_config_t cfg;
+    aqua_outq_drop_cb_t on_drop;
+    void *ctx;
+    aqua_outq_item_t items[AQUA_OUTQ_SLOTS];
+    uint32_t next_seq;
+    int64_t tokens;             // Budget left in bytes; negative after an overdraw
+    int64_t refilled_us;
+    aqua_outq_class_stats_t stats[AQUA_OUTQ_CLASS_COUNT];
+} aqua_outq_t;
+
+/**
+ * @brief Class settings and budget from aqua_config.h
+ */
+void aqua_outq_config_defaults(aqua_outq_config_t *cfg);
+
+/**
+ * @brief Empty the queue and fill the budget
+ * @param cfg NULL for aqua_outq_config_defaults()
+ * @param on_drop Optional
+ */
+void aqua_outq_init(aqua_outq_t *q, const aqua_outq_config_t *cfg,
+                    aqua_outq_drop_cb_t on_drop, void *ctx);
+
+/**
+ * @brief Queue a request; body may be NULL for requests without one
+ * @return The queued request (valid until it is completed or dropped), or
+ *         NULL if the body is too large or the queue is full of higher classes
+ */
+aqua_outq_item_t *aqua_outq_push(aqua_outq_t *q, aqua_outq_class_t cls, uint8_t kind,
+                                 const char *body, size_t len, int64_t now_us);
+
+/**
+ * @brief Hand out the request to send now
+ *
+ * Expires requests past their deadline first. The chosen request is charged
+ * to the budget and marked in flight until aqua_outq_complete().
+ * @param wait_us If nothing can go now: time until something can, or -1 if
+ *                the queue is empty (may be NULL)
+ * @return NULL if nothing is ready
+ */
+aqua_outq_item_t *aqua_outq_next(aqua_outq_t *q, int64_t now_us, int64_t *wait_us);
+
+/**
+ * @brief The request aqua_outq_next() would hand out now, left queued
+ *
+ * Expires requests past their deadline like aqua_outq_next(). Lets a sender
+ * with a request in flight decide whether the next one can share its
+ * connection.
+ * @return NULL if nothing is ready
+ */
+const aqua_outq_item_t *aqua_outq_peek(aqua_outq_t *q, int64_t now_us);
+
+/**
+ * @brief Hand out more requests to travel in the same request as first
+ *
+ * Takes ready requests of first's class and kind in queue order while their
+ * bodies add up to at most max_bytes, charging each body (not the request
+ * overhead again) to the budget. Each one is completed on its own.
+ * @return Number of requests stored in more[]
+ */
+int aqua_outq_next_batch(aqua_outq_t *q, const aqua_outq_item_t *first, aqua_outq_item_t **more,
+                         int max, size_t max_bytes, int64_t now_us);
+
+/**
+ * @brief Give back budget charged for bytes that were not sent (a compressed body)
+ */
+void aqua_outq_credit(aqua_outq_t *q, aqua_outq_class_t cls, uint32_t bytes);
+
+/**
+ * @brief Record the result of the attempt aqua_outq_next() handed out
+ */
+aqua_outq_outcome_t aqua_outq_complete(aqua_outq_t *q, aqua_outq_item_t *item,
+                                       aqua_outq_result_t result, int64_t now_us);
+
+/**
+ * @brief Oldest queued request of this kind that is not in flight, or NULL
+ */
+aqua_outq_item_t *aqua_outq_find(aqua_outq_t *q, uint8_t kind);
+
+/**
+ * @brief Requests queued in a class (AQUA_OUTQ_CLASS_COUNT: all classes)
+ */
+int aqua_outq_pending(const aqua_outq_t *q, aqua_outq_class_t cls);
+
+const char *aqua_outq_class_name(aqua_outq_class_t cls);
+
+#endif // AQUA_OUTQ_H
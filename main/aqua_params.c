@@ -0,0 +1,178 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_params.h"
+#include "hal.h"
+
+#define PARAMS_KEY "params"
+#define PARAMS_LAYOUT 1         // Bump when aqua_params_t changes shape
+
+#define PARAMS_DEFAULTS {                           \
+    .version = 0,                                   \
+    .temp_min = TEMP_MIN,                           \
+    .temp_max = TEMP_MAX,                           \
+    .do_min = DO_MIN,                               \
+    .ph_min = PH_MIN,                               \
+    .ph_max = PH_MAX,                               \
+    .ammonia_max = AMMONIA_MAX,                     \
+    .turbidity_max = TURBIDITY_MAX,                 \
+    .ph_relay_on_below = PH_RELAY_ON_BELOW,         \
+    .aerator_on_below = AERATOR_ON_BELOW,           \
+    .filter_on_above = FILTER_ON_ABOVE,             \
+    .pump_on_above = PUMP_ON_ABOVE,                 \
+}
+
+// params first, so a reader's pointer is also its slot
+typedef struct {
+    aqua_params_t params;
+    atomic_int readers;
+} slot_t;
+
+// NVS image of one block
+typedef struct {
+    uint16_t layout;
+    uint16_t size;
+    aqua_params_t params;
+    uint32_t crc;               // CRC-32 of the fields above
+} stored_params_t;
+
+static slot_t slots[AQUA_PARAMS_SLOTS] = { [0] = { .params = PARAMS_DEFAULTS } };
+static _Atomic(slot_t *) current = &slots[0];
+static atomic_flag updating = ATOMIC_FLAG_INIT;
+static aqua_params_stats_t stats;
+
+void aqua_params_defaults(aqua_params_t *out) {
+    *out = (aqua_params_t)PARAMS_DEFAULTS;
+}
+
+// ========== READERS ==========
+const aqua_params_t *aqua_params_acquire(void) {
+    for (;;) {
+        slot_t *s = atomic_load(&current);
+        atomic_fetch_add(&s->readers, 1);
+        // Still current: the writer cannot pick this slot while we hold it
+        if (atomic_load(&current) == s) {
+            return &s->params;
+        }
+        // Swapped in between; the slot may already be refilling
+        atomic_fetch_sub(&s->readers, 1);
+    }
+}
+
+void aqua_params_release(const aqua_params_t *p) {
+    atomic_fetch_sub(&((slot_t *)p)->readers, 1);
+}
+
+uint32_t aqua_params_version(void) {
+    const aqua_params_t *p = aqua_params_acquire();
+    uint32_t version = p->version;
+    aqua_params_release(p);
+    return version;
+}
+
+// ========== WRITER ==========
+// Caller holds the update flag
+static esp_err_t publish(const aqua_params_t *p) {
+    slot_t *cur = atomic_load(&current);
+    for (int i = 0; i < AQUA_PARAMS_SLOTS; i++) {
+        slot_t *s = &slots[i];
+        if (s == cur || atomic_load(&s->readers) != 0) {
+            continue;
+        }
+        s->params = *p;
+        atomic_store(&current, s);
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+static uint32_t stored_crc(const stored_params_t *st) {
+    return aqua_crc32(0, st, offsetof(stored_params_t, crc));
+}
+
+static esp_err_t save(const aqua_params_t *p) {
+    stored_params_t st;
+    memset(&st, 0, sizeof(st));     // Padding is covered by the CRC
+    st.layout = PARAMS_LAYOUT;
+    st.size = sizeof(aqua_params_t);
+    st.params = *p;
+    st.crc = stored_crc(&st);
+    return hal_settings_set(PARAMS_KEY, &st, sizeof(st));
+}
+
+static const char *load(aqua_params_t *out) {
+    stored_params_t st;
+    size_t len = sizeof(st);
+    esp_err_t err = hal_settings_get(PARAMS_KEY, &st, &len);
+    if (err == ESP_ERR_NOT_FOUND) return NULL;
+    if (err != ESP_OK) return esp_err_to_name(err);
+    if (len != sizeof(st) || st.layout != PARAMS_LAYOUT || st.size != sizeof(aqua_params_t)) {
+        return "layout changed";
+    }
+    if (st.crc != stored_crc(&st)) return "bad CRC";
+    if (!aqua_params_valid(&st.params)) return "out of range";
+    *out = st.params;
+    return NULL;
+}
+
+void aqua_params_init(void) {
+    aqua_params_t p;
+    aqua_params_defaults(&p);
+
+    const char *error = load(&p);
+    if (error) {
+        AQUA_LOG(PARAMS_STORED_INVALID, error);
+        aqua_params_defaults(&p);
+    }
+    memset(&stats, 0, sizeof(stats));
+    stats.from_nvs = p.version > 0;
+
+    // Boot: the flag only guards against an update racing init
+    while (atomic_flag_test_and_set(&updating)) {
+    }
+    if (publish(&p) != ESP_OK) {
+        slots[0].params = p;
+        atomic_store(&current, &slots[0]);
+    }
+    atomic_flag_clear(&updating);
+    AQUA_LOG(PARAMS_LOADED, (int)p.version, stats.from_nvs ? "NVS" : "factory defaults");
+}
+
+esp_err_t aqua_params_update(const aqua_params_t *p) {
+    if (!aqua_params_valid(p)) {
+        stats.rejected++;
+        AQUA_LOG(PARAMS_REJECTED, (int)p->version, "value out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (atomic_flag_test_and_set(&updating)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t was = atomic_load(&current)->params.version;
+    esp_err_t err = p->version > was ? publish(p) : ESP_ERR_INVALID_VERSION;
+    if (err == ESP_OK) {
+        stats.updates++;
+        esp_err_t saved = save(p);
+        if (saved != ESP_OK) {
+            // Still applied; the previous saved version returns after a restart
+            AQUA_LOG(PARAMS_SAVE_FAILED, esp_err_to_name(saved));
+        }
+    } else {
+        stats.rejected++;
+    }
+    atomic_flag_clear(&updating);
+
+    if (err == ESP_OK) {
+        AQUA_LOG(PARAMS_APPLIED, (int)p->version, (int)was);
+    } else {
+        AQUA_LOG(PARAMS_REJECTED, (int)p->version,
+                 err == ESP_ERR_INVALID_VERSION ? "not newer than the current version" : "all slots in use");
+    }
+    return err;
+}
+
+const aqua_params_stats_t *aqua_params_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,64 @@
+#ifndef AQUA_PARAMS_H
+#define AQUA_PARAMS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "aqua_core.h"
+
+// Live alert thresholds and control cut-offs.
+//
+// The current parameter block is published through a single atomic pointer.
+// Readers bracket their use with aqua_params_acquire()/aqua_params_release();
+// they never lock or wait, and a block they hold never changes under them.
+// aqua_params_update() copies a newer version into a spare slot, swaps the
+// pointer and saves the block to NVS. A slot is only reused once no reader
+// holds it, so a reader that is preempted mid-decision still sees one
+// consistent version.
+//
+// Updates are made by one task (the monitoring cycle); a second concurrent
+// writer is refused rather than waited for.
+
+#define AQUA_PARAMS_SLOTS 4         // Current block plus spares for readers still holding old ones
+
+typedef struct {
+    int updates;                // Versions applied since boot
+    int rejected;               // Invalid or stale versions, or no free slot
+    bool from_nvs;              // Boot block came from NVS rather than the factory defaults
+} aqua_params_stats_t;
+
+/**
+ * @brief Factory defaults from aqua_config.h (version 0)
+ */
+void aqua_params_defaults(aqua_params_t *out);
+
+/**
+ * @brief Load the saved block from NVS, or the defaults if none is valid
+ *
+ * Call at boot before other tasks read the parameters. Until then readers see
+ * the defaults.
+ */
+void aqua_params_init(void);
+
+/**
+ * @brief Current parameters; pair every call with aqua_params_release()
+ */
+const aqua_params_t *aqua_params_acquire(void);
+void aqua_params_release(const aqua_params_t *p);
+
+/**
+ * @brief Publish p to all readers and save it
+ * @return ESP_OK, ESP_ERR_INVALID_ARG (out of range), ESP_ERR_INVALID_VERSION
+ *         (not newer than the current version), ESP_ERR_INVALID_STATE (another
+ *         update in progress) or ESP_ERR_NO_MEM (every spare slot still held)
+ */
+esp_err_t aqua_params_update(const aqua_params_t *p);
+
+/**
+ * @brief Version readers currently get
+ */
+uint32_t aqua_params_version(void);
+
+const aqua_params_stats_t *aqua_params_get_stats(void);
+
+#endif // AQUA_PARAMS_H
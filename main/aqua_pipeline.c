@@ -0,0 +1,296 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_pipeline.h"
+
+// ========== RESPONSE PARSING ==========
+// Offset of the first "\r\n" at or after from, -1 if there is none yet
+static long find_crlf(const char *buf, size_t len, size_t from) {
+    for (size_t i = from; i + 1 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n') {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Header line starts with name (any case) followed by a colon
+static const char *header_value(const char *line, const char *end, const char *name) {
+    size_t n = strlen(name);
+    if ((size_t)(end - line) <= n || line[n] != ':') {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) {
+            return NULL;
+        }
+    }
+    const char *v = line + n + 1;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    return v;
+}
+
+// Value contains token (any case), e.g. "keep-alive, close"
+static bool value_has(const char *v, const char *end, const char *token) {
+    size_t n = strlen(token);
+    for (; v + n <= end; v++) {
+        size_t i = 0;
+        while (i < n && tolower((unsigned char)v[i]) == token[i]) i++;
+        if (i == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void copy_body(char *body, size_t body_size, int *body_len, const char *data, size_t len) {
+    if (!body || body_size == 0) {
+        return;
+    }
+    size_t room = body_size - 1 - (size_t)*body_len;
+    if (len > room) {
+        len = room;
+    }
+    memcpy(body + *body_len, data, len);
+    *body_len += (int)len;
+    body[*body_len] = '\0';
+}
+
+int aqua_http_parse_response(const char *buf, size_t len, int *status, bool *close,
+                             char *body, size_t body_size, int *body_len) {
+    *body_len = 0;
+    *close = false;
+    if (body && body_size > 0) {
+        body[0] = '\0';
+    }
+
+    // Status line: HTTP/1.x NNN reason
+    long eol = find_crlf(buf, len, 0);
+    if (eol < 0) {
+        return len > AQUA_PIPELINE_RX_MAX ? -1 : 0;
+    }
+    if (eol < 12 || memcmp(buf, "HTTP/1.", 7) != 0 || buf[8] != ' ' ||
+        !isdigit((unsigned char)buf[9]) || !isdigit((unsigned char)buf[10]) ||
+        !isdigit((unsigned char)buf[11])) {
+        return -1;
+    }
+    *status = (buf[9] - '0') * 100 + (buf[10] - '0') * 10 + (buf[11] - '0');
+
+    long content_length = -1;
+    bool chunked = false;
+    size_t pos = (size_t)eol + 2;
+    for (;;) {
+        eol = find_crlf(buf, len, pos);
+        if (eol < 0) {
+            return 0;
+        }
+        const char *line = buf + pos;
+        const char *end = buf + eol;
+        pos = (size_t)eol + 2;
+        if (line == end) {
+            break;
+        }
+        const char *v;
+        if ((v = header_value(line, end, "Content-Length"))) {
+            char *stop;
+            content_length = strtol(v, &stop, 10);
+            if (stop == v || content_length < 0) {
+                return -1;
+            }
+        } else if ((v = header_value(line, end, "Transfer-Encoding"))) {
+            chunked = value_has(v, end, "chunked");
+        } else if ((v = header_value(line, end, "Connection"))) {
+            *close = value_has(v, end, "close");
+        }
+    }
+
+    if (*status < 200 || *status == 204 || *status == 304) {
+        return (int)pos;
+    }
+    if (!chunked) {
+        // A body that ends when the connection closes cannot be followed by
+        // another response
+        if (content_length < 0) {
+            return -1;
+        }
+        if (len - pos < (size_t)content_length) {
+            return 0;
+        }
+        copy_body(body, body_size, body_len, buf + pos, (size_t)content_length);
+        return (int)(pos + (size_t)content_length);
+    }
+
+    // Chunks: size in hex (extensions ignored), data, CRLF; then a zero size
+    // chunk and optional trailers up to an empty line
+    for (;;) {
+        eol = find_crlf(buf, len, pos);
+        if (eol < 0) {
+            return 0;
+        }
+        char *stop;
+        unsigned long size = strtoul(buf + pos, &stop, 16);
+        if (stop == buf + pos) {
+            return -1;
+        }
+        pos = (size_t)eol + 2;
+        if (size == 0) {
+            break;
+        }
+        if (size > AQUA_PIPELINE_RX_MAX) {
+            return -1;
+        }
+        if (len - pos < size + 2) {
+            return 0;
+        }
+        if (buf[pos + size] != '\r' || buf[pos + size + 1] != '\n') {
+            return -1;
+        }
+        copy_body(body, body_size, body_len, buf + pos, size);
+        pos += size + 2;
+    }
+    for (;;) {
+        eol = find_crlf(buf, len, pos);
+        if (eol < 0) {
+            return 0;
+        }
+        bool last = (size_t)eol == pos;
+        pos = (size_t)eol + 2;
+        if (last) {
+            return (int)pos;
+        }
+    }
+}
+
+// ========== CONNECTION ==========
+// Path of the URL, "/" if it has none
+static const char *url_path(const char *url) {
+    const char *p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    p = strchr(p, '/');
+    return p ? p : "/";
+}
+
+esp_err_t aqua_pipeline_open(aqua_pipeline_t *p, const char *url, hal_tls_mode_t tls, int timeout_ms) {
+    const char *host = strstr(url, "://");
+    host = host ? host + 3 : url;
+    size_t host_len = strcspn(host, "/?");
+    if (host_len >= sizeof(p->host)) {
+        return ESP_FAIL;
+    }
+    memcpy(p->host, host, host_len);
+    p->host[host_len] = '\0';
+
+    p->timeout_ms = timeout_ms;
+    p->in_flight = 0;
+    p->closing = false;
+    p->rx_len = 0;
+    p->stream = hal_http_stream_open(url, tls, timeout_ms);
+    if (!p->stream) {
+        return ESP_FAIL;
+    }
+    p->stats.connections++;
+    return ESP_OK;
+}
+
+// The connection cannot carry anything more
+static void broken(aqua_pipeline_t *p) {
+    if (p->in_flight > 0) {
+        p->stats.broken++;
+    }
+    aqua_pipeline_close(p);
+}
+
+esp_err_t aqua_pipeline_send(aqua_pipeline_t *p, const hal_http_request_t *req) {
+    if (!p->stream) {
+        return ESP_FAIL;
+    }
+    if (p->in_flight >= AQUA_PIPELINE_MAX_DEPTH || p->closing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t body_len = req->body ? req->body_len : 0;
+    char head[1024];
+    int n = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s\r\n",
+                     req->method == HAL_HTTP_POST ? "POST" : "GET", url_path(req->url), p->host);
+    for (size_t i = 0; i < req->header_count && n < (int)sizeof(head); i++) {
+        n += snprintf(head + n, sizeof(head) - n, "%s: %s\r\n", req->headers[i].name, req->headers[i].value);
+    }
+    if (n < (int)sizeof(head)) {
+        n += snprintf(head + n, sizeof(head) - n, "Content-Length: %u\r\n\r\n", (unsigned)body_len);
+    }
+    if (n >= (int)sizeof(head)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (hal_stream_write(p->stream, head, (size_t)n, p->timeout_ms) < 0 ||
+        (body_len > 0 && hal_stream_write(p->stream, req->body, body_len, p->timeout_ms) < 0)) {
+        broken(p);
+        return ESP_FAIL;
+    }
+    p->in_flight++;
+    p->stats.requests++;
+    if (p->in_flight > p->stats.max_in_flight) {
+        p->stats.max_in_flight = (uint8_t)p->in_flight;
+    }
+    return ESP_OK;
+}
+
+esp_err_t aqua_pipeline_receive(aqua_pipeline_t *p, hal_http_response_t *resp) {
+    resp->status = 0;
+    resp->body_len = 0;
+    if (resp->body && resp->body_size > 0) {
+        resp->body[0] = '\0';
+    }
+    if (!p->stream || p->in_flight == 0) {
+        return ESP_FAIL;
+    }
+
+    for (;;) {
+        int status = 0;
+        bool close = false;
+        int body_len = 0;
+        int used = p->rx_len > 0 ? aqua_http_parse_response(p->rx, p->rx_len, &status, &close, resp->body,
+                                                            resp->body_size, &body_len)
+                                 : 0;
+        if (used < 0) {
+            broken(p);
+            return ESP_FAIL;
+        }
+        if (used > 0) {
+            p->rx_len -= (size_t)used;
+            memmove(p->rx, p->rx + used, p->rx_len);
+            if (status < 200) {
+                continue;       // Interim (100 Continue): the real one follows
+            }
+            p->in_flight--;
+            p->stats.responses++;
+            p->closing = p->closing || close;
+            resp->status = status;
+            resp->body_len = body_len;
+            return ESP_OK;
+        }
+
+        if (p->rx_len >= AQUA_PIPELINE_RX_MAX) {
+            broken(p);
+            return ESP_FAIL;
+        }
+        int r = hal_stream_read(p->stream, p->rx + p->rx_len, AQUA_PIPELINE_RX_MAX - p->rx_len, p->timeout_ms);
+        if (r == 0) {
+            broken(p);
+            return ESP_ERR_TIMEOUT;
+        }
+        if (r < 0) {
+            broken(p);
+            return ESP_FAIL;
+        }
+        p->rx_len += (size_t)r;
+    }
+}
+
+void aqua_pipeline_close(aqua_pipeline_t *p) {
+    hal_stream_close(p->stream);
+    p->stream = NULL;
+    p->in_flight = 0;
+    p->rx_len = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef AQUA_PIPELINE_H
+#define AQUA_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+// HTTP/1.1 client that keeps several requests in flight on one keep-alive
+// connection (request pipelining, RFC 9112 section 9.3.2).
+//
+// Requests are written as soon as they are sent; responses come back in the
+// order the requests went out and are read one at a time. Only requests that
+// are safe to send twice belong here: if the connection drops, the requests
+// it still carried may or may not have reached the server.
+
+#define AQUA_PIPELINE_MAX_DEPTH 8       // Requests in flight at most
+#define AQUA_PIPELINE_RX_MAX 2048       // Largest response (headers and body)
+
+typedef struct {
+    uint32_t connections;               // Streams opened
+    uint32_t requests;                  // Requests written
+    uint32_t responses;                 // Responses read
+    uint32_t broken;                    // Connections lost with requests in flight
+    uint8_t max_in_flight;
+} aqua_pipeline_stats_t;
+
+typedef struct {
+    hal_stream_t *stream;
+    char host[64];                      // Host header
+    int timeout_ms;
+    int in_flight;                      // Requests written, response not read yet
+    bool closing;                       // The server said Connection: close
+    char rx[AQUA_PIPELINE_RX_MAX];      // Received, not parsed yet
+    size_t rx_len;
+    aqua_pipeline_stats_t stats;
+} aqua_pipeline_t;
+
+/**
+ * @brief Connect to the server of url; stats are kept across connections
+ * @return ESP_OK, or ESP_FAIL if the server could not be reached
+ */
+esp_err_t aqua_pipeline_open(aqua_pipeline_t *p, const char *url, hal_tls_mode_t tls, int timeout_ms);
+
+/**
+ * @brief Write a request without waiting for its response
+ *
+ * req->url is sent as a path on the connection's server; req->tls and
+ * req->timeout_ms are ignored.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if AQUA_PIPELINE_MAX_DEPTH requests
+ *         are in flight or the server is closing the connection,
+ *         ESP_ERR_INVALID_SIZE if the headers do not fit, ESP_FAIL if the
+ *         connection failed
+ */
+esp_err_t aqua_pipeline_send(aqua_pipeline_t *p, const hal_http_request_t *req);
+
+/**
+ * @brief Read the response to the oldest request in flight
+ * @return ESP_OK, ESP_ERR_TIMEOUT if nothing arrived within the timeout,
+ *         ESP_FAIL if the connection failed or the response is malformed or
+ *         larger than AQUA_PIPELINE_RX_MAX. After an error the connection
+ *         cannot be used again.
+ */
+esp_err_t aqua_pipeline_receive(aqua_pipeline_t *p, hal_http_response_t *resp);
+
+/**
+ * @brief Close the connection; responses not read yet are lost
+ */
+void aqua_pipeline_close(aqua_pipeline_t *p);
+
+/**
+ * @brief Parse one HTTP/1.1 response at the start of buf
+ *
+ * Handles Content-Length and chunked bodies, and responses that never carry
+ * one (1xx, 204, 304). The body is copied to body (NUL terminated, cut to
+ * fit); body may be NULL. Connection: close sets *close.
+ * @return Bytes the response takes, 0 if buf does not hold all of it yet, -1
+ *         if it is malformed or its body only ends when the connection does
+ */
+int aqua_http_parse_response(const char *buf, size_t len, int *status, bool *close,
+                             char *body, size_t body_size, int *body_len);
+
+#endif // AQUA_PIPELINE_H
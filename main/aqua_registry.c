@@ -0,0 +1,97 @@
+#include <stddef.h>
+#include "aqua_config.h"
+#include "aqua_registry.h"
+
+#define READING(field) offsetof(aqua_reading_t, field)
+#define LIMIT(field) offsetof(aqua_params_t, field)
+
+// ========== SENSOR TABLE ==========
+// Order is the scan order and the order of the keys in every payload
+const aqua_measure_t aqua_measures[] = {
+    {
+        .id = AQUA_MEAS_AIR_TEMP, .key = "air_temperature", .label = "DHT22 air temperature", .unit = "C",
+        .offset = READING(air_temp), .flags = AQUA_MEAS_ALWAYS_SENT,
+        .sensor = AQUA_SENSOR_DHT22, .adc_channel = -1, .gpio = DHT_PIN,
+        .valid_min = -40.0f, .valid_max = 80.0f,
+        .alert_min = AQUA_NO_LIMIT, .alert_max = AQUA_NO_LIMIT,
+    },
+    {
+        .id = AQUA_MEAS_HUMIDITY, .key = "humidity", .label = "DHT22 humidity", .unit = "%",
+        .offset = READING(humidity), .flags = AQUA_MEAS_ALWAYS_SENT,
+        .sensor = AQUA_SENSOR_DHT22, .adc_channel = -1, .gpio = DHT_PIN,
+        .valid_min = 0.0f, .valid_max = 100.0f,
+        .alert_min = AQUA_NO_LIMIT, .alert_max = AQUA_NO_LIMIT,
+    },
+    {
+        .id = AQUA_MEAS_WATER_TEMP, .key = "water_temperature", .label = "DS18B20 water temperature", .unit = "C",
+        .offset = READING(water_temp), .flags = AQUA_MEAS_CRITICAL,
+        .sensor = AQUA_SENSOR_DS18B20, .adc_channel = -1, .gpio = WATER_TEMP_PIN,
+        .valid_min = -40.0f, .valid_max = 80.0f,
+        .alert_min = LIMIT(temp_min), .alert_max = LIMIT(temp_max),
+        .alert_name = "temperature", .alert_key = "water_temp",
+    },
+#if AQUA_HAS_PH
+    {
+        .id = AQUA_MEAS_PH, .key = "ph", .label = "pH", .unit = "",
+        .offset = READING(ph), .flags = AQUA_MEAS_CRITICAL,
+        .sensor = AQUA_SENSOR_PH, .adc_channel = PH_ADC_CH, .gpio = 6,
+        .convert = aqua_mv_to_ph, .valid_min = 0.0f, .valid_max = 14.0f,
+        .alert_min = LIMIT(ph_min), .alert_max = LIMIT(ph_max),
+        .alert_name = "ph", .alert_key = "ph",
+    },
+#endif
+#if AQUA_HAS_DO
+    {
+        .id = AQUA_MEAS_DO, .key = "dissolved_oxygen", .label = "DO", .unit = "mg/L",
+        .offset = READING(do_level),
+        .sensor = AQUA_SENSOR_DO, .adc_channel = DO_ADC_CH, .gpio = 3,
+        .convert = aqua_mv_to_do, .valid_min = 0.0f, .valid_max = 20.0f,
+        .alert_min = LIMIT(do_min), .alert_max = AQUA_NO_LIMIT,
+        .alert_name = "dissolved_oxygen", .alert_key = "do_level",
+    },
+#endif
+#if AQUA_HAS_TURBIDITY
+    {
+        .id = AQUA_MEAS_TURBIDITY, .key = "turbidity", .label = "Turbidity", .unit = "NTU",
+        .offset = READING(turbidity), .flags = AQUA_MEAS_CRITICAL | AQUA_MEAS_LOCKIN,
+        .sensor = AQUA_SENSOR_TURBIDITY, .adc_channel = TURBIDITY_ADC_CH, .gpio = 8,
+        .emitter_pin = TURBIDITY_EMITTER_PIN,
+        .convert = aqua_mv_to_turbidity, .valid_min = 0.0f, .valid_max = 1000.0f,
+        .alert_min = AQUA_NO_LIMIT, .alert_max = LIMIT(turbidity_max),
+        .alert_name = "turbidity", .alert_key = "turbidity",
+    },
+#endif
+#if AQUA_HAS_AMMONIA
+    {
+        .id = AQUA_MEAS_AMMONIA, .key = "ammonia", .label = "Ammonia", .unit = "mg/L",
+        .offset = READING(ammonia),
+        .sensor = AQUA_SENSOR_AMMONIA, .adc_channel = AMMONIA_ADC_CH, .gpio = 1,
+        .convert = aqua_mv_to_ammonia, .valid_min = 0.0f, .valid_max = 10.0f,
+        .alert_min = AQUA_NO_LIMIT, .alert_max = LIMIT(ammonia_max),
+        .alert_name = "ammonia", .alert_key = "ammonia",
+    },
+#endif
+};
+
+const size_t aqua_measure_count = sizeof(aqua_measures) / sizeof(aqua_measures[0]);
+
+_Static_assert(AQUA_MEAS_ID_COUNT <= 32, "aqua_alert_states_t holds one bit per measurement");
+
+// ========== LOOKUP ==========
+const aqua_measure_t *aqua_measure(aqua_measure_id_t id) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        if (aqua_measures[i].id == id) {
+            return &aqua_measures[i];
+        }
+    }
+    return NULL;
+}
+
+bool aqua_sensor_fitted(aqua_sensor_t sensor) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        if (aqua_measures[i].sensor == sensor) {
+            return true;
+        }
+    }
+    return false;
+}
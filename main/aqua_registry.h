@@ -0,0 +1,84 @@
+#ifndef AQUA_REGISTRY_H
+#define AQUA_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "aqua_core.h"
+
+// Compile-time table of every measured value.
+//
+// One descriptor per aqua_reading_t field: where the value comes from, the
+// range a row may carry, its JSON key, its alert limits in aqua_params_t and
+// whether losing it is critical. The cycle scans the analog entries in one
+// pass, and validation, payload encoding, missing-sensor counting and alerts
+// walk the same array. Probes switched off in menuconfig (aqua_config.h,
+// AQUA_HAS_xxx) are not in the table at all.
+//
+// Adding an analog sensor: a field in aqua_reading_t, an aqua_measure_id_t,
+// a conversion, and one descriptor in aqua_registry.c.
+
+// Stable identity of a measurement; also its bit in aqua_alert_states_t
+typedef enum {
+    AQUA_MEAS_AIR_TEMP,
+    AQUA_MEAS_HUMIDITY,
+    AQUA_MEAS_WATER_TEMP,
+    AQUA_MEAS_PH,
+    AQUA_MEAS_DO,
+    AQUA_MEAS_TURBIDITY,
+    AQUA_MEAS_AMMONIA,
+    AQUA_MEAS_ID_COUNT
+} aqua_measure_id_t;
+
+#define AQUA_MEAS_CRITICAL 0x01     // Counted by aqua_count_missing_critical()
+#define AQUA_MEAS_ALWAYS_SENT 0x02  // In the row even when missing (as -999)
+#define AQUA_MEAS_LOCKIN 0x04       // Optical, can be read against its emitter_pin
+
+#define AQUA_NO_LIMIT (-1)          // alert_min / alert_max unused
+
+typedef struct {
+    aqua_measure_id_t id;
+    const char *key;                // sensor_data column
+    const char *label;              // Name in log messages
+    const char *unit;
+    uint16_t offset;                // Field in aqua_reading_t
+    uint8_t flags;
+    aqua_sensor_t sensor;           // Health slot
+    int8_t adc_channel;             // -1: read by its own driver in the cycle
+    int8_t gpio;                    // Pin named in fault messages
+    int8_t emitter_pin;             // Light source of an AQUA_MEAS_LOCKIN probe
+    float (*convert)(float avg_mv); // ADC mV to units, -1.0f when out of range
+    float valid_min;                // Range aqua_validate_reading() accepts
+    float valid_max;
+    int16_t alert_min;              // Offset in aqua_params_t, or AQUA_NO_LIMIT
+    int16_t alert_max;
+    const char *alert_name;         // Alert flags are low_<name> / high_<name>
+    const char *alert_key;          // Value key in the alert payload
+} aqua_measure_t;
+
+extern const aqua_measure_t aqua_measures[];
+extern const size_t aqua_measure_count;
+
+/**
+ * @brief Descriptor of a measurement, or NULL if it is not built in
+ */
+const aqua_measure_t *aqua_measure(aqua_measure_id_t id);
+
+/**
+ * @brief True if some built-in measurement is read from this sensor
+ */
+bool aqua_sensor_fitted(aqua_sensor_t sensor);
+
+static inline float aqua_measure_value(const aqua_measure_t *m, const aqua_reading_t *r) {
+    return *(const float *)((const char *)r + m->offset);
+}
+
+static inline void aqua_measure_set(const aqua_measure_t *m, aqua_reading_t *r, float value) {
+    *(float *)((char *)r + m->offset) = value;
+}
+
+static inline float aqua_measure_limit(int16_t offset, const aqua_params_t *p) {
+    return *(const float *)((const char *)p + offset);
+}
+
+#endif // AQUA_REGISTRY_H
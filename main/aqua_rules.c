@@ -0,0 +1,766 @@
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aqua_log.h"
+#include "aqua_rules.h"
+#include "aqua_time.h"
+#include "hal.h"
+
+#define RULES_KEY "rules"
+#define RULES_LAYOUT 1          // Bump when the bytecode or aqua_rules_program_t changes
+
+static const char *const relay_names[AQUA_RULES_RELAY_COUNT] = { "ph_relay", "aerator", "filter", "pump" };
+
+// Operand bytes per opcode
+static const uint8_t operand_len[AQUA_OP_COUNT] = {
+    [AQUA_OP_CONST] = 4,
+    [AQUA_OP_VALUE] = 1,
+    [AQUA_OP_TREND] = 1,
+    [AQUA_OP_PARAM] = 1,
+    [AQUA_OP_RELAY] = 1,
+    [AQUA_OP_SKIP_IF_FALSE] = 2,
+    [AQUA_OP_SET_RELAY] = 2,
+    [AQUA_OP_ALERT] = 2,
+};
+
+static bool *relay_state(aqua_controls_t *c, int relay) {
+    switch (relay) {
+    case AQUA_RULES_PH_RELAY: return &c->ph_relay;
+    case AQUA_RULES_AERATOR: return &c->aerator;
+    case AQUA_RULES_FILTER: return &c->filter;
+    default: return &c->pump;
+    }
+}
+
+static float missing_as_nan(float v) {
+    return v == AQUA_SENSOR_ERROR ? NAN : v;
+}
+
+// ========== COMPILER ==========
+// Recursive descent straight to bytecode:
+//
+//   rule   := 'when' expr 'then' action { ',' action }
+//   expr   := and { 'or' and }
+//   and    := not { 'and' not }
+//   not    := 'not' not | cmp
+//   cmp    := sum [ ('<' | '<=' | '>' | '>=' | '==' | '!=') sum ]
+//   sum    := term { ('+' | '-') term }
+//   term   := factor { '*' factor }
+//   factor := number | name | 'trend' '(' name ')' | '(' expr ')'
+//   action := relay ('on' | 'off') | 'alert' flag
+
+typedef enum { TOK_END, TOK_SEP, TOK_NUMBER, TOK_NAME, TOK_PUNCT } tok_kind_t;
+
+typedef struct {
+    const char *p;
+    int line;
+    tok_kind_t kind;
+    char text[32];              // Name or punctuation
+    float number;
+
+    aqua_rules_program_t *out;
+    int depth;                  // Values on the stack at this point of the program
+    int nesting;                // Parentheses and 'not's open, bounds the recursion
+    esp_err_t status;
+    aqua_rules_error_t *err;
+} compiler_t;
+
+static void fail(compiler_t *c, esp_err_t status, const char *fmt, const char *arg) {
+    if (c->status != ESP_OK) {
+        return;
+    }
+    c->status = status;
+    if (c->err) {
+        c->err->line = c->line;
+        snprintf(c->err->message, sizeof(c->err->message), fmt, arg);
+    }
+}
+
+static void next(compiler_t *c) {
+    const char *p = c->p;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+        }
+        if (*p != '\\' || p[1] != '\n') break;
+        p += 2;                 // Line continuation
+        c->line++;
+    }
+
+    c->text[0] = '\0';
+    if (*p == '\0') {
+        c->kind = TOK_END;
+    } else if (*p == '\n' || *p == ';') {
+        c->kind = TOK_SEP;
+        c->line += *p == '\n';
+        p++;
+    } else if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+        char *end;
+        c->kind = TOK_NUMBER;
+        c->number = strtof(p, &end);
+        p = end;
+    } else if (isalpha((unsigned char)*p) || *p == '_') {
+        size_t n = 0;
+        c->kind = TOK_NAME;
+        while (isalnum((unsigned char)*p) || *p == '_') {
+            if (n + 1 < sizeof(c->text)) c->text[n++] = *p;
+            p++;
+        }
+        c->text[n] = '\0';
+    } else {
+        c->kind = TOK_PUNCT;
+        size_t n = (strchr("<>=!", *p) && p[1] == '=') ? 2 : 1;
+        memcpy(c->text, p, n);
+        c->text[n] = '\0';
+        p += n;
+    }
+    c->p = p;
+}
+
+static bool is(const compiler_t *c, const char *text) {
+    return (c->kind == TOK_NAME || c->kind == TOK_PUNCT) && strcmp(c->text, text) == 0;
+}
+
+static bool accept(compiler_t *c, const char *text) {
+    if (!is(c, text)) return false;
+    next(c);
+    return true;
+}
+
+static void expect(compiler_t *c, const char *text) {
+    if (!accept(c, text)) {
+        fail(c, ESP_ERR_INVALID_ARG, "expected '%s'", text);
+    }
+}
+
+static void emit(compiler_t *c, uint8_t byte) {
+    if (c->out->code_len >= AQUA_RULES_CODE_MAX) {
+        fail(c, ESP_ERR_NO_MEM, "rules too long for the bytecode buffer%s", "");
+        return;
+    }
+    c->out->code[c->out->code_len++] = byte;
+}
+
+// Emit an opcode and account for its effect on the stack
+static void emit_op(compiler_t *c, aqua_rules_op_t op, int pops, int pushes) {
+    c->depth += pushes - pops;
+    if (c->depth > AQUA_RULES_STACK) {
+        fail(c, ESP_ERR_NO_MEM, "expression too deep%s", "");
+    }
+    emit(c, (uint8_t)op);
+}
+
+static const aqua_measure_t *find_measure(const char *name) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if (strcmp(name, m->key) == 0 || (m->alert_key && strcmp(name, m->alert_key) == 0)) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static int find_relay(const char *name) {
+    for (int i = 0; i < AQUA_RULES_RELAY_COUNT; i++) {
+        if (strcmp(name, relay_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// What the error message calls the current token
+static const char *token(const compiler_t *c) {
+    return c->kind == TOK_END ? "end" : c->kind == TOK_SEP ? "end of rule" : c->text;
+}
+
+// Parentheses and 'not' recurse; keep the C stack as bounded as the VM's
+static bool enter(compiler_t *c) {
+    if (++c->nesting > 2 * AQUA_RULES_STACK) {
+        fail(c, ESP_ERR_NO_MEM, "expression nested too deep%s", "");
+        return false;
+    }
+    return true;
+}
+
+static void expr(compiler_t *c);
+
+static void factor(compiler_t *c) {
+    if (c->status != ESP_OK) {
+        return;
+    }
+    bool negative = false;
+    if (is(c, "-")) {
+        negative = true;
+        next(c);
+    }
+    if (c->kind == TOK_NUMBER) {
+        float v = negative ? -c->number : c->number;
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        emit_op(c, AQUA_OP_CONST, 0, 1);
+        for (int i = 0; i < 4; i++) emit(c, (uint8_t)(bits >> (8 * i)));
+        next(c);
+        return;
+    }
+    if (negative) {
+        fail(c, ESP_ERR_INVALID_ARG, "expected a number after '-'%s", "");
+        return;
+    }
+    if (accept(c, "(")) {
+        if (enter(c)) {
+            expr(c);
+            expect(c, ")");
+        }
+        c->nesting--;
+        return;
+    }
+    if (c->kind != TOK_NAME) {
+        fail(c, ESP_ERR_INVALID_ARG, "unexpected '%s'", token(c));
+        return;
+    }
+
+    const aqua_measure_t *m;
+    int relay;
+    if (accept(c, "trend")) {
+        expect(c, "(");
+        m = c->kind == TOK_NAME ? find_measure(c->text) : NULL;
+        if (!m) {
+            fail(c, ESP_ERR_INVALID_ARG, "trend of unknown value '%s'", c->text);
+            return;
+        }
+        emit_op(c, AQUA_OP_TREND, 0, 1);
+        emit(c, (uint8_t)m->id);
+        next(c);
+        expect(c, ")");
+        return;
+    }
+    if (is(c, "hour")) {
+        emit_op(c, AQUA_OP_HOUR, 0, 1);
+    } else if ((m = find_measure(c->text)) != NULL) {
+        emit_op(c, AQUA_OP_VALUE, 0, 1);
+        emit(c, (uint8_t)m->id);
+    } else if ((relay = find_relay(c->text)) >= 0) {
+        emit_op(c, AQUA_OP_RELAY, 0, 1);
+        emit(c, (uint8_t)relay);
+    } else {
+        size_t i = 0;
+        while (i < aqua_param_field_count && strcmp(c->text, aqua_param_fields[i].key) != 0) i++;
+        if (i == aqua_param_field_count) {
+            fail(c, ESP_ERR_INVALID_ARG, "unknown name '%s'", c->text);
+            return;
+        }
+        emit_op(c, AQUA_OP_PARAM, 0, 1);
+        emit(c, (uint8_t)i);
+    }
+    next(c);
+}
+
+static void term(compiler_t *c) {
+    factor(c);
+    while (c->status == ESP_OK && accept(c, "*")) {
+        factor(c);
+        emit_op(c, AQUA_OP_MUL, 2, 1);
+    }
+}
+
+static void sum(compiler_t *c) {
+    term(c);
+    while (c->status == ESP_OK && (is(c, "+") || is(c, "-"))) {
+        aqua_rules_op_t op = is(c, "+") ? AQUA_OP_ADD : AQUA_OP_SUB;
+        next(c);
+        term(c);
+        emit_op(c, op, 2, 1);
+    }
+}
+
+static void comparison(compiler_t *c) {
+    static const struct {
+        const char *text;
+        aqua_rules_op_t op;
+    } ops[] = {
+        { "<", AQUA_OP_LT }, { "<=", AQUA_OP_LE }, { ">", AQUA_OP_GT },
+        { ">=", AQUA_OP_GE }, { "==", AQUA_OP_EQ }, { "!=", AQUA_OP_NE },
+    };
+    sum(c);
+    for (size_t i = 0; c->status == ESP_OK && i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (accept(c, ops[i].text)) {
+            sum(c);
+            emit_op(c, ops[i].op, 2, 1);
+            return;
+        }
+    }
+}
+
+static void negation(compiler_t *c) {
+    if (accept(c, "not")) {
+        if (enter(c)) {
+            negation(c);
+            emit_op(c, AQUA_OP_NOT, 1, 1);
+        }
+        c->nesting--;
+        return;
+    }
+    comparison(c);
+}
+
+static void conjunction(compiler_t *c) {
+    negation(c);
+    while (c->status == ESP_OK && accept(c, "and")) {
+        negation(c);
+        emit_op(c, AQUA_OP_AND, 2, 1);
+    }
+}
+
+static void expr(compiler_t *c) {
+    conjunction(c);
+    while (c->status == ESP_OK && accept(c, "or")) {
+        conjunction(c);
+        emit_op(c, AQUA_OP_OR, 2, 1);
+    }
+}
+
+static void action(compiler_t *c) {
+    int relay;
+    if (accept(c, "alert")) {
+        // low_<alert_name> / high_<alert_name> of a measurement with that limit
+        bool high = strncmp(c->text, "high_", 5) == 0;
+        const char *name = c->text + (high ? 5 : 4);
+        const aqua_measure_t *m = NULL;
+        if (c->kind == TOK_NAME && (high || strncmp(c->text, "low_", 4) == 0)) {
+            for (size_t i = 0; i < aqua_measure_count && !m; i++) {
+                const aqua_measure_t *cand = &aqua_measures[i];
+                if (cand->alert_name && strcmp(name, cand->alert_name) == 0 &&
+                    (high ? cand->alert_max : cand->alert_min) != AQUA_NO_LIMIT) {
+                    m = cand;
+                }
+            }
+        }
+        if (!m) {
+            fail(c, ESP_ERR_INVALID_ARG, "unknown alert '%s'", c->text);
+            return;
+        }
+        emit_op(c, AQUA_OP_ALERT, 0, 0);
+        emit(c, (uint8_t)m->id);
+        emit(c, high);
+        next(c);
+    } else if (c->kind == TOK_NAME && (relay = find_relay(c->text)) >= 0) {
+        next(c);
+        bool on = is(c, "on");
+        if (!on && !is(c, "off")) {
+            fail(c, ESP_ERR_INVALID_ARG, "expected 'on' or 'off' after '%s'", relay_names[relay]);
+            return;
+        }
+        emit_op(c, AQUA_OP_SET_RELAY, 0, 0);
+        emit(c, (uint8_t)relay);
+        emit(c, on);
+        next(c);
+    } else {
+        fail(c, ESP_ERR_INVALID_ARG, "unknown action '%s'", token(c));
+    }
+}
+
+static void rule(compiler_t *c) {
+    expect(c, "when");
+    expr(c);
+    expect(c, "then");
+    emit_op(c, AQUA_OP_SKIP_IF_FALSE, 1, 0);
+    size_t patch = c->out->code_len;
+    emit(c, 0);
+    emit(c, 0);
+    do {
+        action(c);
+    } while (c->status == ESP_OK && accept(c, ","));
+    if (c->status == ESP_OK && c->kind != TOK_SEP && c->kind != TOK_END) {
+        fail(c, ESP_ERR_INVALID_ARG, "unexpected '%s' after the actions", token(c));
+    }
+    if (c->status == ESP_OK) {
+        c->out->code[patch] = (uint8_t)c->out->code_len;
+        c->out->code[patch + 1] = (uint8_t)(c->out->code_len >> 8);
+        if (c->out->rule_count == UINT8_MAX) {
+            fail(c, ESP_ERR_NO_MEM, "too many rules%s", "");
+        }
+        c->out->rule_count++;
+    }
+}
+
+esp_err_t aqua_rules_compile(const char *source, aqua_rules_program_t *out, aqua_rules_error_t *err) {
+    compiler_t c = { .p = source, .line = 1, .out = out, .status = ESP_OK, .err = err };
+    memset(out, 0, sizeof(*out));
+    next(&c);
+    while (c.status == ESP_OK && c.kind != TOK_END) {
+        if (c.kind == TOK_SEP) {
+            next(&c);
+            continue;
+        }
+        rule(&c);
+    }
+    emit(&c, AQUA_OP_END);
+    return c.status;
+}
+
+// ========== VERIFIER ==========
+#define NO_TARGET 0xFF
+
+// Every jump target is an instruction start
+static bool targets_on_instructions(const uint8_t *want, const uint8_t *starts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (want[i] != NO_TARGET && !(starts[i / 8] & (1u << (i % 8)))) return false;
+    }
+    return true;
+}
+
+bool aqua_rules_verify(const aqua_rules_program_t *prog) {
+    uint8_t want[AQUA_RULES_CODE_MAX];              // Stack depth a jump target expects
+    uint8_t starts[AQUA_RULES_CODE_MAX / 8] = {0};  // Instruction starts, one bit each
+    size_t len = prog->code_len;
+    if (len == 0 || len > AQUA_RULES_CODE_MAX) {
+        return false;
+    }
+    memset(want, NO_TARGET, len);
+
+    const uint8_t *code = prog->code;
+    int depth = 0;
+    int rules = 0;
+    for (size_t pc = 0; pc < len; ) {
+        if (want[pc] != NO_TARGET && want[pc] != depth) {
+            return false;
+        }
+        starts[pc / 8] |= (uint8_t)(1u << (pc % 8));
+
+        uint8_t op = code[pc];
+        if (op >= AQUA_OP_COUNT || pc + 1 + operand_len[op] > len) {
+            return false;
+        }
+        const uint8_t *arg = &code[pc + 1];
+        int pops = 0, pushes = 0;
+        switch (op) {
+        case AQUA_OP_END:
+            // Last byte, so every jump lands at or before it
+            return pc + 1 == len && rules == prog->rule_count &&
+                   targets_on_instructions(want, starts, len);
+        case AQUA_OP_CONST:
+        case AQUA_OP_HOUR:
+            pushes = 1;
+            break;
+        case AQUA_OP_VALUE:
+        case AQUA_OP_TREND:
+            if (arg[0] >= AQUA_MEAS_ID_COUNT) return false;
+            pushes = 1;
+            break;
+        case AQUA_OP_PARAM:
+            if (arg[0] >= aqua_param_field_count) return false;
+            pushes = 1;
+            break;
+        case AQUA_OP_RELAY:
+            if (arg[0] >= AQUA_RULES_RELAY_COUNT) return false;
+            pushes = 1;
+            break;
+        case AQUA_OP_NOT:
+            pops = 1;
+            pushes = 1;
+            break;
+        case AQUA_OP_SKIP_IF_FALSE: {
+            // Forward only: nothing runs twice
+            size_t target = (size_t)arg[0] | (size_t)arg[1] << 8;
+            if (target <= pc + 2 || target >= len || depth < 1) return false;
+            pops = 1;
+            if (want[target] != NO_TARGET && want[target] != depth - 1) return false;
+            want[target] = (uint8_t)(depth - 1);
+            rules++;
+            break;
+        }
+        case AQUA_OP_SET_RELAY:
+            if (arg[0] >= AQUA_RULES_RELAY_COUNT || arg[1] > 1) return false;
+            break;
+        case AQUA_OP_ALERT:
+            if (arg[0] >= AQUA_MEAS_ID_COUNT || arg[1] > 1) return false;
+            break;
+        default:                // Binary operators
+            pops = 2;
+            pushes = 1;
+            break;
+        }
+        if (depth < pops || depth - pops + pushes > AQUA_RULES_STACK) {
+            return false;
+        }
+        depth += pushes - pops;
+        pc += 1 + operand_len[op];
+    }
+    return false;               // No END
+}
+
+// ========== INTERPRETER ==========
+static bool truth(float v) {
+    return !isnan(v) && v != 0.0f;
+}
+
+int aqua_rules_run(const aqua_rules_program_t *prog, const aqua_rules_input_t *in,
+                   aqua_controls_t *controls, aqua_alert_states_t *alerts) {
+    float stack[AQUA_RULES_STACK];
+    int sp = 0;
+    int fired = 0;
+    const uint8_t *code = prog->code;
+    size_t pc = 0;
+
+    for (;;) {
+        uint8_t op = code[pc];
+        const uint8_t *arg = &code[pc + 1];
+        pc += 1 + operand_len[op];
+
+        float a = 0, b = 0;
+        if (op >= AQUA_OP_ADD && op <= AQUA_OP_OR) {
+            b = stack[--sp];
+            a = stack[--sp];
+        }
+        switch (op) {
+        case AQUA_OP_END:
+            return fired;
+        case AQUA_OP_CONST: {
+            uint32_t bits = (uint32_t)arg[0] | (uint32_t)arg[1] << 8 |
+                            (uint32_t)arg[2] << 16 | (uint32_t)arg[3] << 24;
+            memcpy(&stack[sp++], &bits, sizeof(float));
+            break;
+        }
+        case AQUA_OP_VALUE: {
+            const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)arg[0]);
+            stack[sp++] = m ? missing_as_nan(aqua_measure_value(m, in->reading)) : NAN;
+            break;
+        }
+        case AQUA_OP_TREND: {
+            const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)arg[0]);
+            stack[sp++] = m && in->history
+                ? aqua_rules_trend(in->history, m->id, aqua_measure_value(m, in->reading), in->now_us)
+                : NAN;
+            break;
+        }
+        case AQUA_OP_PARAM:
+            stack[sp++] = aqua_measure_limit((int16_t)aqua_param_fields[arg[0]].offset, in->params);
+            break;
+        case AQUA_OP_HOUR:
+            stack[sp++] = in->hour;
+            break;
+        case AQUA_OP_RELAY:
+            stack[sp++] = *relay_state(controls, arg[0]) ? 1.0f : 0.0f;
+            break;
+        case AQUA_OP_ADD: stack[sp++] = a + b; break;
+        case AQUA_OP_SUB: stack[sp++] = a - b; break;
+        case AQUA_OP_MUL: stack[sp++] = a * b; break;
+        // Comparisons with NAN are false, != included
+        case AQUA_OP_LT: stack[sp++] = a < b; break;
+        case AQUA_OP_LE: stack[sp++] = a <= b; break;
+        case AQUA_OP_GT: stack[sp++] = a > b; break;
+        case AQUA_OP_GE: stack[sp++] = a >= b; break;
+        case AQUA_OP_EQ: stack[sp++] = a == b; break;
+        case AQUA_OP_NE: stack[sp++] = !isnan(a) && !isnan(b) && a != b; break;
+        case AQUA_OP_AND: stack[sp++] = truth(a) && truth(b); break;
+        case AQUA_OP_OR: stack[sp++] = truth(a) || truth(b); break;
+        case AQUA_OP_NOT:
+            stack[sp - 1] = !truth(stack[sp - 1]);
+            break;
+        case AQUA_OP_SKIP_IF_FALSE:
+            if (truth(stack[--sp])) {
+                fired++;
+            } else {
+                pc = (size_t)arg[0] | (size_t)arg[1] << 8;
+            }
+            break;
+        case AQUA_OP_SET_RELAY:
+            *relay_state(controls, arg[0]) = arg[1];
+            break;
+        case AQUA_OP_ALERT:
+            if (arg[1]) {
+                alerts->high |= AQUA_ALERT_BIT(arg[0]);
+            } else {
+                alerts->low |= AQUA_ALERT_BIT(arg[0]);
+            }
+            break;
+        }
+    }
+}
+
+// ========== TRENDS ==========
+void aqua_rules_history_reset(aqua_rules_history_t *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void aqua_rules_history_add(aqua_rules_history_t *h, const aqua_reading_t *r, int64_t now_us) {
+    if (h->count > 0) {
+        int last = (h->next + RULES_TREND_POINTS - 1) % RULES_TREND_POINTS;
+        if (now_us - h->at_us[last] < (int64_t)RULES_TREND_STEP_S * 1000000) {
+            return;
+        }
+    }
+    h->at_us[h->next] = now_us;
+    for (int id = 0; id < AQUA_MEAS_ID_COUNT; id++) {
+        const aqua_measure_t *m = aqua_measure((aqua_measure_id_t)id);
+        h->value[h->next][id] = m ? missing_as_nan(aqua_measure_value(m, r)) : NAN;
+    }
+    h->next = (h->next + 1) % RULES_TREND_POINTS;
+    if (h->count < RULES_TREND_POINTS) {
+        h->count++;
+    }
+}
+
+float aqua_rules_trend(const aqua_rules_history_t *h, aqua_measure_id_t id, float value, int64_t now_us) {
+    if (h->count == 0) {
+        return NAN;
+    }
+    int oldest = h->count < RULES_TREND_POINTS ? 0 : h->next;
+    int64_t dt_us = now_us - h->at_us[oldest];
+    if (dt_us < (int64_t)RULES_TREND_STEP_S * 1000000) {
+        return NAN;
+    }
+    return (missing_as_nan(value) - h->value[oldest][id]) * 3600e6f / (float)dt_us;
+}
+
+// ========== DEVICE PROGRAM ==========
+// NVS image: the bytecode only, not the source
+typedef struct {
+    uint16_t layout;
+    uint16_t size;
+    aqua_rules_program_t program;
+    uint32_t crc;               // CRC-32 of the fields above
+} stored_rules_t;
+
+static aqua_rules_program_t program;
+static aqua_rules_history_t history;
+static aqua_alert_states_t raised;
+static aqua_rules_stats_t stats;
+
+static uint32_t stored_crc(const stored_rules_t *st) {
+    return aqua_crc32(0, st, offsetof(stored_rules_t, crc));
+}
+
+static esp_err_t save(const aqua_rules_program_t *prog) {
+    static stored_rules_t st;
+    memset(&st, 0, sizeof(st));
+    st.layout = RULES_LAYOUT;
+    st.size = sizeof(aqua_rules_program_t);
+    st.program = *prog;
+    st.crc = stored_crc(&st);
+    return hal_settings_set(RULES_KEY, &st, sizeof(st));
+}
+
+static const char *load(aqua_rules_program_t *out) {
+    static stored_rules_t st;
+    size_t len = sizeof(st);
+    esp_err_t err = hal_settings_get(RULES_KEY, &st, &len);
+    if (err == ESP_ERR_NOT_FOUND) return NULL;
+    if (err != ESP_OK) return esp_err_to_name(err);
+    if (len != sizeof(st) || st.layout != RULES_LAYOUT || st.size != sizeof(aqua_rules_program_t)) {
+        return "layout changed";
+    }
+    if (st.crc != stored_crc(&st)) return "bad CRC";
+    if (!aqua_rules_verify(&st.program)) return "bytecode rejected";
+    *out = st.program;
+    return NULL;
+}
+
+// No rules: a program that only ends
+static void clear(aqua_rules_program_t *prog) {
+    memset(prog, 0, sizeof(*prog));
+    prog->code_len = 1;
+    prog->code[0] = AQUA_OP_END;
+}
+
+void aqua_rules_init(void) {
+    memset(&stats, 0, sizeof(stats));
+    memset(&raised, 0, sizeof(raised));
+    aqua_rules_history_reset(&history);
+    clear(&program);
+
+    const char *error = load(&program);
+    if (error) {
+        AQUA_LOG(RULES_STORED_INVALID, error);
+        clear(&program);
+    }
+    stats.from_nvs = program.version > 0;
+    AQUA_LOG(RULES_LOADED, (int)program.version, program.rule_count);
+}
+
+void aqua_rules_reject(uint32_t version, int line, const char *reason) {
+    stats.rejected++;
+    if (version > stats.rejected_version) {
+        stats.rejected_version = version;
+    }
+    AQUA_LOG(RULES_REJECTED, (int)version, line, reason);
+}
+
+esp_err_t aqua_rules_update(uint32_t version, const char *source) {
+    if (version <= program.version) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    static aqua_rules_program_t next;
+    aqua_rules_error_t err = {0};
+    esp_err_t status = aqua_rules_compile(source, &next, &err);
+    if (status == ESP_OK && !aqua_rules_verify(&next)) {
+        status = ESP_FAIL;
+        snprintf(err.message, sizeof(err.message), "bytecode rejected");
+    }
+    if (status != ESP_OK) {
+        aqua_rules_reject(version, err.line, err.message);
+        return status;
+    }
+
+    next.version = version;
+    program = next;
+    stats.updates++;
+    AQUA_LOG(RULES_APPLIED, (int)version, next.rule_count, next.code_len);
+    esp_err_t saved = save(&program);
+    if (saved != ESP_OK) {
+        // Still applied; the previous saved program returns after a restart
+        AQUA_LOG(RULES_SAVE_FAILED, esp_err_to_name(saved));
+    }
+    return ESP_OK;
+}
+
+static float local_hour(int64_t mono_us) {
+    aqua_timestamp_t ts;
+    if (!aqua_time_stamp(mono_us, &ts)) {
+        return NAN;
+    }
+    int64_t day_us = 86400LL * 1000000;
+    int64_t local_us = ts.unix_us + (int64_t)RULES_UTC_OFFSET_MIN * 60 * 1000000;
+    int64_t of_day = ((local_us % day_us) + day_us) % day_us;
+    return (float)of_day / 3600e6f;
+}
+
+void aqua_rules_apply(const aqua_reading_t *r, const aqua_params_t *p, aqua_controls_t *c) {
+    int64_t now_us = r->has_time ? r->sampled_us : hal_time_us();
+    memset(&raised, 0, sizeof(raised));
+    if (program.rule_count > 0) {
+        aqua_rules_input_t in = {
+            .reading = r,
+            .params = p,
+            .history = &history,
+            .now_us = now_us,
+            .hour = local_hour(now_us),
+        };
+        aqua_controls_t before = *c;
+        stats.runs++;
+        stats.fired += (uint32_t)aqua_rules_run(&program, &in, c, &raised);
+        for (int i = 0; i < AQUA_RULES_RELAY_COUNT; i++) {
+            bool now = *relay_state(c, i);
+            if (*relay_state(&before, i) != now) {
+                AQUA_LOG(RULES_OVERRIDE, relay_names[i], now ? "ON" : "OFF");
+            }
+        }
+    }
+    aqua_rules_history_add(&history, r, now_us);
+}
+
+const aqua_alert_states_t *aqua_rules_alerts(void) {
+    return &raised;
+}
+
+uint32_t aqua_rules_version(void) {
+    return program.version;
+}
+
+const aqua_rules_stats_t *aqua_rules_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,191 @@
+#ifndef AQUA_RULES_H
+#define AQUA_RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_registry.h"
+
+// Local automation rules (RULES in aqua_config.h).
+//
+// Rules are written as text, one per line or separated by ';':
+//
+//   when ph < ph_relay_on_below and trend(ph) < 0 then ph_relay on
+//   when hour >= 22 or hour < 5 then aerator on      # night aeration
+//   when ammonia > 0.5 and not pump then alert high_ammonia
+//
+// Conditions compare sensor values (sensor_data column names, or the alert
+// payload's water_temp / do_level), trend(<value>) in units per hour,
+// "hour" (local time of day, 0-24), device_params thresholds by column name,
+// and relay states (ph_relay, aerator, filter, pump: 1 when on), with
+// + - *, and / or / not and parentheses. A missing value makes every
+// comparison that uses it false. Actions switch a relay on or off, or raise
+// an alert flag (low_<name> / high_<name>, as in the alert payload). '#'
+// starts a comment.
+//
+// Rules run after aqua_decide_controls() on every sample and override its
+// decisions; relay states read in a condition are the decisions so far.
+// Later rules win over earlier ones.
+//
+// Text is compiled into a stack bytecode, on the device when a new
+// device_rules row arrives or on the host with aqua_rulec. The verifier
+// accepts only forward jumps, so a program runs each instruction at most once
+// and its evaluation time is bounded by its size.
+
+#define AQUA_RULES_CODE_MAX 512         // Bytecode bytes per program
+#define AQUA_RULES_SOURCE_MAX 2048      // Rule text accepted from device_rules
+#define AQUA_RULES_STACK 8
+
+// ========== BYTECODE ==========
+// One opcode byte, then its operands. Values are floats; conditions are 1 or 0.
+typedef enum {
+    AQUA_OP_END = 0,
+    AQUA_OP_CONST,          // f32 (little endian): push it
+    AQUA_OP_VALUE,          // u8 aqua_measure_id_t: push the reading, NAN if missing
+    AQUA_OP_TREND,          // u8 aqua_measure_id_t: push its change per hour, NAN if unknown
+    AQUA_OP_PARAM,          // u8 index in aqua_param_fields[]: push the threshold
+    AQUA_OP_HOUR,           // Push the local hour, NAN before the clock is set
+    AQUA_OP_RELAY,          // u8 aqua_rules_relay_t: push its state
+    AQUA_OP_ADD,            // Pop b, pop a, push a op b
+    AQUA_OP_SUB,
+    AQUA_OP_MUL,
+    AQUA_OP_LT,
+    AQUA_OP_LE,
+    AQUA_OP_GT,
+    AQUA_OP_GE,
+    AQUA_OP_EQ,
+    AQUA_OP_NE,
+    AQUA_OP_AND,
+    AQUA_OP_OR,
+    AQUA_OP_NOT,            // Pop a, push !a
+    AQUA_OP_SKIP_IF_FALSE,  // u16 target: pop a condition; if false go to target (a rule did not fire)
+    AQUA_OP_SET_RELAY,      // u8 aqua_rules_relay_t, u8 state
+    AQUA_OP_ALERT,          // u8 aqua_measure_id_t, u8 1 = high / 0 = low
+    AQUA_OP_COUNT
+} aqua_rules_op_t;
+
+typedef enum {
+    AQUA_RULES_PH_RELAY = 0,
+    AQUA_RULES_AERATOR,
+    AQUA_RULES_FILTER,
+    AQUA_RULES_PUMP,
+    AQUA_RULES_RELAY_COUNT
+} aqua_rules_relay_t;
+
+typedef struct {
+    uint32_t version;           // device_rules version; 0 = no rules
+    uint16_t code_len;
+    uint8_t rule_count;
+    uint8_t code[AQUA_RULES_CODE_MAX];
+} aqua_rules_program_t;
+
+typedef struct {
+    int line;                   // 1-based line of the error in the source
+    char message[64];
+} aqua_rules_error_t;
+
+// Trend history: one point per RULES_TREND_STEP_S for every measurement
+typedef struct {
+    int64_t at_us[RULES_TREND_POINTS];
+    float value[RULES_TREND_POINTS][AQUA_MEAS_ID_COUNT];    // NAN: missing at that point
+    int count;
+    int next;
+} aqua_rules_history_t;
+
+typedef struct {
+    const aqua_reading_t *reading;
+    const aqua_params_t *params;
+    const aqua_rules_history_t *history;    // May be NULL (no trends)
+    int64_t now_us;             // hal_time_us() of the sample
+    float hour;                 // Local time of day, NAN if unknown
+} aqua_rules_input_t;
+
+typedef struct {
+    int updates;                // Programs applied since boot
+    int rejected;               // Sources that did not compile or could not be read
+    uint32_t rejected_version;  // Newest rejected version (not fetched again)
+    bool from_nvs;              // Boot program came from NVS
+    uint32_t runs;
+    uint32_t fired;             // Rules whose condition held, summed over runs
+} aqua_rules_stats_t;
+
+/**
+ * @brief Compile rule text
+ * @param err Optional; filled when compilation fails
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for a syntax or name error and
+ *         ESP_ERR_NO_MEM when the program exceeds AQUA_RULES_CODE_MAX or the stack
+ */
+esp_err_t aqua_rules_compile(const char *source, aqua_rules_program_t *out, aqua_rules_error_t *err);
+
+/**
+ * @brief Check bytecode before it is run: known opcodes, operands in range,
+ *        forward jumps onto instructions, and stack depth within AQUA_RULES_STACK
+ */
+bool aqua_rules_verify(const aqua_rules_program_t *prog);
+
+/**
+ * @brief Run a verified program over one sample
+ * @param controls In: the decisions so far; out: after the rules' actions
+ * @param alerts Flags raised by the rules are or'ed in
+ * @return Number of rules that fired
+ */
+int aqua_rules_run(const aqua_rules_program_t *prog, const aqua_rules_input_t *in,
+                   aqua_controls_t *controls, aqua_alert_states_t *alerts);
+
+void aqua_rules_history_reset(aqua_rules_history_t *h);
+
+/**
+ * @brief Record a sample if RULES_TREND_STEP_S has passed since the last point
+ */
+void aqua_rules_history_add(aqua_rules_history_t *h, const aqua_reading_t *r, int64_t now_us);
+
+/**
+ * @brief Change per hour from the oldest point to value, NAN if unknown
+ */
+float aqua_rules_trend(const aqua_rules_history_t *h, aqua_measure_id_t id, float value, int64_t now_us);
+
+// ========== DEVICE PROGRAM ==========
+
+/**
+ * @brief Load the saved program from NVS (none if it is missing or invalid)
+ */
+void aqua_rules_init(void);
+
+/**
+ * @brief Compile source as version, then run it from the next sample and save it
+ *
+ * An empty source removes the rules.
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION (not newer than the running
+ *         version) or the compile error
+ */
+esp_err_t aqua_rules_update(uint32_t version, const char *source);
+
+/**
+ * @brief Skip version without applying it, as if it had failed to compile
+ *
+ * For a row whose source could not be read. It is not fetched again.
+ * @param line Line of the error, 0 if none
+ */
+void aqua_rules_reject(uint32_t version, int line, const char *reason);
+
+/**
+ * @brief Run the program on this sample's decisions and update the trend history
+ */
+void aqua_rules_apply(const aqua_reading_t *r, const aqua_params_t *p, aqua_controls_t *c);
+
+/**
+ * @brief Alert flags the rules raised on the last sample
+ */
+const aqua_alert_states_t *aqua_rules_alerts(void);
+
+/**
+ * @brief Running version (0: none)
+ */
+uint32_t aqua_rules_version(void);
+
+const aqua_rules_stats_t *aqua_rules_get_stats(void);
+
+#endif // AQUA_RULES_H
@@ -0,0 +1,39 @@
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_seq.h"
+#include "hal.h"
+
+#define SEQ_KEY "upload_seq"
+
+static uint32_t next_seq;
+static uint32_t reserved;               // First number not yet saved as used; 0: not loaded
+
+void aqua_seq_init(void) {
+    uint32_t stored = 0;
+    size_t len = sizeof(stored);
+    if (hal_settings_get(SEQ_KEY, &stored, &len) != ESP_OK || len != sizeof(stored) || stored == 0) {
+        stored = 1;
+    }
+    next_seq = stored;
+    reserved = stored;
+}
+
+uint32_t aqua_seq_next(void) {
+    if (reserved == 0) {
+        aqua_seq_init();
+    }
+    if (next_seq >= reserved) {
+        // Saved before the first number of the block is used. Unsaved, the
+        // block would be handed out again after a reboot and the server would
+        // drop those rows as duplicates, so the reading goes without a number
+        // and the save is tried again for the next one.
+        uint32_t until = next_seq + UPLOAD_SEQ_RESERVE;
+        esp_err_t err = hal_settings_set(SEQ_KEY, &until, sizeof(until));
+        if (err != ESP_OK) {
+            AQUA_LOG(SEQ_SAVE_FAILED, esp_err_to_name(err));
+            return 0;
+        }
+        reserved = until;
+    }
+    return next_seq++;
+}
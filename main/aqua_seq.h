@@ -0,0 +1,30 @@
+#ifndef AQUA_SEQ_H
+#define AQUA_SEQ_H
+
+#include <stdint.h>
+
+// Upload sequence numbers: one per reading, increasing for the life of the
+// device. The server keys rows on (device_id, seq), so an upload retried
+// after its response was lost stores nothing twice.
+//
+// The next unreserved number is kept in NVS and moved on UPLOAD_SEQ_RESERVE
+// at a time, so a number is never handed out twice across reboots; the
+// numbers reserved but unused before a reboot are skipped. A number is only
+// handed out from a block that was saved; while NVS cannot be written a
+// reading gets none and is uploaded without the key.
+
+/**
+ * @brief Load the reservation from NVS
+ *
+ * Call at boot. Without it the first aqua_seq_next() loads it.
+ */
+void aqua_seq_init(void);
+
+/**
+ * @brief The next sequence number
+ *
+ * @return The number, or 0 if its block could not be saved
+ */
+uint32_t aqua_seq_next(void);
+
+#endif // AQUA_SEQ_H
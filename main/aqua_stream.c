@@ -0,0 +1,465 @@
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adc_config.h"
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_log.h"
+#include "aqua_registry.h"
+#include "aqua_stream.h"
+
+// Capture state lives in statics: the frame and its buffers are the largest
+// things here and only the task serving the port touches them.
+typedef struct {
+    hal_stream_t *port;
+    int64_t end_us;                     // 0: until stopped
+    uint32_t next_scan;                 // Expected first_scan of the next frame
+    uint32_t frames;
+    uint32_t dropped;
+    uint32_t skipped;
+    uint64_t bytes;
+} capture_t;
+
+static aqua_stream_frame_t s_frame;
+static uint8_t s_raw[AQUA_STREAM_FRAME_MAX];
+static uint8_t s_wire[AQUA_STREAM_WIRE_MAX];
+static char s_line[64];                 // Command line being received
+static size_t s_line_len;
+static bool s_line_overflow;
+
+static aqua_stream_config_t s_request;
+static atomic_bool s_requested;
+static atomic_bool s_stop;
+static aqua_stream_stats_t s_stats;
+static hal_stream_t *s_port;
+
+// ========== FRAMES ==========
+size_t aqua_cobs_encode(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+    if (size < 2) {
+        return 0;
+    }
+    size_t o = 1;
+    size_t code_at = 0;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[o++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+        if (o >= size) {
+            return 0;               // No room left for the delimiter
+        }
+    }
+    out[code_at] = code;
+    out[o++] = 0;
+    return o;
+}
+
+int aqua_cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || code - 1u > len - i) {
+            return -1;
+        }
+        for (uint8_t k = 1; k < code; k++) {
+            if (in[i] == 0 || o == size) {
+                return -1;
+            }
+            out[o++] = in[i++];
+        }
+        // Every group but a full one stands for a zero, except the last
+        if (code != 0xFF && i < len) {
+            if (o == size) {
+                return -1;
+            }
+            out[o++] = 0;
+        }
+    }
+    return (int)o;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static size_t frame_len(size_t nch, size_t scans) {
+    return AQUA_STREAM_HEADER_LEN + nch + nch * scans * 2 + 4;
+}
+
+size_t aqua_stream_pack(const aqua_stream_frame_t *f, uint8_t *buf, size_t size) {
+    if (f->nch == 0 || f->nch > AQUA_STREAM_MAX_CHANNELS || f->scans == 0 ||
+        f->scans > AQUA_STREAM_MAX_SCANS) {
+        return 0;
+    }
+    size_t len = frame_len(f->nch, f->scans);
+    if (len > size) {
+        return 0;
+    }
+    buf[0] = AQUA_STREAM_VERSION;
+    buf[1] = f->nch;
+    put16(buf + 2, f->scans);
+    put32(buf + 4, f->seq);
+    put32(buf + 8, f->first_scan);
+    put32(buf + 12, f->period_us);
+    put32(buf + 16, (uint32_t)f->first_us);
+    put32(buf + 20, (uint32_t)((uint64_t)f->first_us >> 32));
+    memcpy(buf + AQUA_STREAM_HEADER_LEN, f->channels, f->nch);
+
+    uint8_t *p = buf + AQUA_STREAM_HEADER_LEN + f->nch;
+    size_t n = (size_t)f->scans * f->nch;
+    for (size_t i = 0; i < n; i++) {
+        put16(p + 2 * i, (uint16_t)f->samples[i]);
+    }
+    put32(buf + len - 4, aqua_crc32(0, buf, len - 4));
+    return len;
+}
+
+bool aqua_stream_unpack(const uint8_t *buf, size_t len, aqua_stream_frame_t *f) {
+    if (len < AQUA_STREAM_HEADER_LEN + 4 || buf[0] != AQUA_STREAM_VERSION) {
+        return false;
+    }
+    size_t nch = buf[1];
+    size_t scans = get16(buf + 2);
+    if (nch == 0 || nch > AQUA_STREAM_MAX_CHANNELS || scans == 0 || scans > AQUA_STREAM_MAX_SCANS ||
+        len != frame_len(nch, scans) || get32(buf + len - 4) != aqua_crc32(0, buf, len - 4)) {
+        return false;
+    }
+    f->nch = (uint8_t)nch;
+    f->scans = (uint16_t)scans;
+    f->seq = get32(buf + 4);
+    f->first_scan = get32(buf + 8);
+    f->period_us = get32(buf + 12);
+    f->first_us = (int64_t)((uint64_t)get32(buf + 20) << 32 | get32(buf + 16));
+    memcpy(f->channels, buf + AQUA_STREAM_HEADER_LEN, nch);
+
+    const uint8_t *p = buf + AQUA_STREAM_HEADER_LEN + nch;
+    for (size_t i = 0; i < nch * scans; i++) {
+        f->samples[i] = (int16_t)get16(p + 2 * i);
+    }
+    return true;
+}
+
+// ========== COMMANDS ==========
+// ADC1 channels of the built-in analog probes; init_adc() sets up no others
+static bool probe_channel(int ch) {
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        int adc = aqua_measures[i].adc_channel;
+        if (adc >= 0 && !XADC_CH_IS_EXTERNAL(adc) && adc == ch) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void default_channels(aqua_stream_config_t *cfg) {
+    cfg->nch = 0;
+    for (size_t i = 0; i < aqua_measure_count && cfg->nch < AQUA_STREAM_MAX_CHANNELS; i++) {
+        int adc = aqua_measures[i].adc_channel;
+        if (adc >= 0 && !XADC_CH_IS_EXTERNAL(adc)) {
+            cfg->channels[cfg->nch++] = (uint8_t)adc;
+        }
+    }
+}
+
+static const char *skip_blanks(const char *p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+static bool at_end(const char *p) {
+    p = skip_blanks(p);
+    return *p == '\0' || *p == '\r' || *p == '\n';
+}
+
+static bool parse_uint(const char **p, uint32_t *v) {
+    if (!isdigit((unsigned char)**p)) {
+        return false;
+    }
+    char *end;
+    unsigned long n = strtoul(*p, &end, 10);
+    if (n > UINT32_MAX) {
+        return false;
+    }
+    *v = (uint32_t)n;
+    *p = end;
+    return true;
+}
+
+aqua_stream_cmd_t aqua_stream_parse_command(const char *line, aqua_stream_config_t *cfg) {
+    const char *p = skip_blanks(line);
+    if (strncmp(p, "stop", 4) == 0 && at_end(p + 4)) {
+        return AQUA_STREAM_CMD_STOP;
+    }
+    if (strncmp(p, "start", 5) != 0 || (!at_end(p + 5) && p[5] != ' ' && p[5] != '\t')) {
+        return AQUA_STREAM_CMD_NONE;
+    }
+
+    aqua_stream_config_t c = { .rate_hz = STREAM_DEFAULT_RATE_HZ };
+    default_channels(&c);
+    p = skip_blanks(p + 5);
+    if (!at_end(p)) {
+        if (!parse_uint(&p, &c.rate_hz)) {
+            return AQUA_STREAM_CMD_NONE;
+        }
+        p = skip_blanks(p);
+    }
+    if (!at_end(p)) {
+        c.nch = 0;
+        for (;;) {
+            uint32_t ch;
+            if (c.nch == AQUA_STREAM_MAX_CHANNELS || !parse_uint(&p, &ch) || ch > UINT8_MAX) {
+                return AQUA_STREAM_CMD_NONE;
+            }
+            c.channels[c.nch++] = (uint8_t)ch;
+            if (*p != ',') {
+                break;
+            }
+            p++;
+        }
+        p = skip_blanks(p);
+    }
+    if (!at_end(p)) {
+        if (!parse_uint(&p, &c.duration_s) || !at_end(p)) {
+            return AQUA_STREAM_CMD_NONE;
+        }
+    }
+    *cfg = c;
+    return AQUA_STREAM_CMD_START;
+}
+
+esp_err_t aqua_stream_check_config(const aqua_stream_config_t *cfg) {
+    if (cfg->rate_hz == 0 || cfg->rate_hz > STREAM_MAX_RATE_HZ || cfg->nch == 0 ||
+        cfg->nch > AQUA_STREAM_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < cfg->nch; i++) {
+        if (!probe_channel(cfg->channels[i])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+// ========== RECEIVER ==========
+void aqua_stream_rx_init(aqua_stream_rx_t *rx, aqua_stream_frame_cb_t cb, void *ctx) {
+    memset(rx, 0, sizeof(*rx));
+    rx->cb = cb;
+    rx->ctx = ctx;
+}
+
+static void rx_frame(aqua_stream_rx_t *rx) {
+    int len = aqua_cobs_decode(rx->wire, rx->have, rx->raw, sizeof(rx->raw));
+    aqua_stream_frame_t *f = &rx->frame;
+    if (len < 0 || !aqua_stream_unpack(rx->raw, (size_t)len, f)) {
+        rx->stats.bad_frames++;
+        return;
+    }
+
+    if (f->seq == 0) {
+        rx->stats.captures++;
+    } else if (rx->started) {
+        rx->stats.lost_frames += f->seq - rx->next_seq;
+        rx->stats.missed_scans += f->first_scan - rx->next_scan;
+    }
+    rx->started = true;
+    rx->next_seq = f->seq + 1;
+    rx->next_scan = f->first_scan + f->scans;
+    rx->stats.frames++;
+    rx->stats.scans += f->scans;
+    if (rx->cb) {
+        rx->cb(f, rx->ctx);
+    }
+}
+
+void aqua_stream_rx_feed(aqua_stream_rx_t *rx, const uint8_t *data, size_t len) {
+    rx->stats.bytes += len;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != 0) {
+            if (rx->have < sizeof(rx->wire)) {
+                rx->wire[rx->have++] = data[i];
+            } else {
+                rx->overflow = true;
+            }
+            continue;
+        }
+        if (rx->overflow) {
+            rx->stats.bad_frames++;
+        } else if (rx->have > 0) {
+            rx_frame(rx);
+        }
+        rx->have = 0;
+        rx->overflow = false;
+    }
+}
+
+// ========== CAPTURE ==========
+esp_err_t aqua_stream_start(const aqua_stream_config_t *cfg) {
+    if (aqua_stream_check_config(cfg) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_request = *cfg;
+    atomic_store(&s_requested, true);
+    return ESP_OK;
+}
+
+void aqua_stream_stop(void) {
+    atomic_store(&s_requested, false);
+    atomic_store(&s_stop, true);
+}
+
+// Takes whatever the port has and acts on every complete line
+static void read_commands(hal_stream_t *port, int timeout_ms) {
+    char buf[64];
+    int n = hal_stream_read(port, buf, sizeof(buf), timeout_ms);
+    for (int i = 0; i < n; i++) {
+        if (buf[i] != '\n' && buf[i] != '\r') {
+            if (s_line_len < sizeof(s_line) - 1) {
+                s_line[s_line_len++] = buf[i];
+            } else {
+                s_line_overflow = true;
+            }
+            continue;
+        }
+        s_line[s_line_len] = '\0';
+        if (s_line_len > 0) {
+            aqua_stream_config_t cfg;
+            aqua_stream_cmd_t cmd = s_line_overflow ? AQUA_STREAM_CMD_NONE
+                                                    : aqua_stream_parse_command(s_line, &cfg);
+            if (cmd == AQUA_STREAM_CMD_STOP) {
+                aqua_stream_stop();
+            } else if (cmd == AQUA_STREAM_CMD_NONE || aqua_stream_start(&cfg) != ESP_OK) {
+                AQUA_LOG(STREAM_BAD_COMMAND, s_line);
+            }
+        }
+        s_line_len = 0;
+        s_line_overflow = false;
+    }
+}
+
+// Scan callback: one frame per block. block is s_frame.samples.
+static bool send_frame(const int16_t *scans, size_t count, uint32_t first, int64_t first_us, void *ctx) {
+    capture_t *cap = ctx;
+    aqua_stream_frame_t *f = &s_frame;
+    f->scans = (uint16_t)count;
+    f->first_scan = first;
+    f->first_us = first_us;
+
+    size_t raw_len = aqua_stream_pack(f, s_raw, sizeof(s_raw));
+    size_t len = aqua_cobs_encode(s_raw, raw_len, s_wire, sizeof(s_wire));
+    if (len > 0 && hal_stream_write(cap->port, s_wire, len, STREAM_WRITE_TIMEOUT_MS) == (int)len) {
+        cap->frames++;
+        cap->bytes += len;
+    } else {
+        cap->dropped++;
+    }
+    cap->skipped += first - cap->next_scan;
+    cap->next_scan = first + (uint32_t)count;
+    s_stats.scans += count;
+    f->seq++;
+
+    // A start or stop from either side ends this capture
+    read_commands(cap->port, 0);
+    if (atomic_load(&s_stop) || atomic_load(&s_requested)) {
+        return false;
+    }
+    return cap->end_us == 0 || first_us + (int64_t)count * f->period_us <= cap->end_us;
+}
+
+static void capture(hal_stream_t *port, const aqua_stream_config_t *cfg) {
+    aqua_stream_frame_t *f = &s_frame;
+    memset(f, 0, sizeof(*f));
+    f->nch = cfg->nch;
+    memcpy(f->channels, cfg->channels, cfg->nch);
+    f->period_us = 1000000 / cfg->rate_hz;
+    int channels[AQUA_STREAM_MAX_CHANNELS];
+    for (int i = 0; i < cfg->nch; i++) {
+        channels[i] = cfg->channels[i];
+    }
+
+    uint32_t per_frame = cfg->rate_hz / STREAM_FRAMES_PER_S;
+    if (per_frame < 1) per_frame = 1;
+    if (per_frame > AQUA_STREAM_MAX_SCANS) per_frame = AQUA_STREAM_MAX_SCANS;
+
+    int64_t start = hal_time_us();
+    capture_t cap = {
+        .port = port,
+        .end_us = cfg->duration_s > 0 ? start + (int64_t)cfg->duration_s * 1000000 : 0,
+    };
+    AQUA_LOG(STREAM_STARTED, cfg->nch, (int)cfg->rate_hz, (int)per_frame);
+    hal_adc_scan(channels, cfg->nch, f->period_us, f->samples, per_frame, send_frame, &cap);
+    int64_t elapsed = hal_time_us() - start;
+
+    s_stats.captures++;
+    s_stats.frames += cap.frames;
+    s_stats.dropped_frames += cap.dropped;
+    s_stats.skipped_scans += cap.skipped;
+    s_stats.bytes += cap.bytes;
+    s_stats.capture_us += elapsed;
+    AQUA_LOG(STREAM_STOPPED, (int)cap.frames, (int)cap.dropped, (int)cap.skipped,
+             elapsed > 0 ? (int)(cap.bytes * 1000000 / (uint64_t)elapsed) : 0);
+}
+
+void aqua_stream_serve(hal_stream_t *port, int timeout_ms) {
+    if (!atomic_load(&s_requested)) {
+        read_commands(port, timeout_ms);
+    }
+    if (!atomic_exchange(&s_requested, false)) {
+        return;
+    }
+    aqua_stream_config_t cfg = s_request;
+    atomic_store(&s_stop, false);
+    capture(port, &cfg);
+}
+
+static void stream_task(void *arg) {
+    for (;;) {
+        aqua_stream_serve(arg, STREAM_COMMAND_WAIT_MS);
+    }
+}
+
+esp_err_t aqua_stream_init(void) {
+    if (s_port) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_port = hal_usb_cdc_open();
+    if (!s_port) {
+        AQUA_LOG(STREAM_PORT_FAILED);
+        return ESP_FAIL;
+    }
+    if (hal_task_start("stream", stream_task, s_port, STREAM_TASK_STACK, STREAM_TASK_PRIORITY) != ESP_OK) {
+        hal_stream_close(s_port);
+        s_port = NULL;
+        AQUA_LOG(STREAM_PORT_FAILED);
+        return ESP_FAIL;
+    }
+    AQUA_LOG(STREAM_READY);
+    return ESP_OK;
+}
+
+void aqua_stream_get_stats(aqua_stream_stats_t *out) {
+    *out = s_stats;
+}
@@ -0,0 +1,188 @@
+#ifndef AQUA_STREAM_H
+#define AQUA_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "hal.h"
+
+// Raw sample streaming over the native USB port (USB STREAMING in
+// aqua_config.h), for probe calibration and noise studies.
+//
+// A capture scans a set of ADC channels at a fixed rate (hal_adc_scan()) and
+// sends the conversions, unfiltered and unconverted, in binary frames on the
+// USB CDC port. The monitoring cycle carries on meanwhile. The port takes
+// commands, one per line:
+//
+//   start [RATE_HZ [CH,CH,... [SECONDS]]]   Capture; defaults: STREAM_DEFAULT_RATE_HZ,
+//                                            every built-in analog probe, until stopped
+//   stop                                    End the capture
+//
+// aqua_stream_start() and aqua_stream_stop() do the same from firmware code.
+// host/tools/aqua_streamrx.c is the receiver.
+//
+// Frames are COBS-encoded and end in a zero byte, so a receiver that joins
+// mid-stream, or sees other output mixed in, resynchronises at the next
+// zero. Decoded, a frame is (little-endian):
+//
+//   u8  version                AQUA_STREAM_VERSION
+//   u8  nch                    Channels per scan
+//   u16 scans                  Scans in the frame
+//   u32 seq                    Frame number in the capture, from 0
+//   u32 first_scan             Scan number of the first scan in the capture
+//   u32 period_us              Scan period
+//   i64 first_us               Device time (hal_time_us()) of the first scan
+//   u8  channel[nch]           ADC channel numbers
+//   i16 sample[scans][nch]     Raw conversions
+//   u32 crc                    CRC-32 (aqua_crc32()) of everything above
+//
+// Scan k of a frame was taken at first_us + k * period_us. A jump in seq is
+// a frame lost on the way (the host did not read the port in time); a jump
+// in first_scan beyond that is scans the device skipped after falling
+// behind. Either way the gap is known exactly.
+
+#define AQUA_STREAM_VERSION 1
+#define AQUA_STREAM_MAX_CHANNELS 8
+#define AQUA_STREAM_MAX_SCANS 64                // Per frame
+#define AQUA_STREAM_HEADER_LEN 24               // Up to the channel list
+#define AQUA_STREAM_FRAME_MAX (AQUA_STREAM_HEADER_LEN + AQUA_STREAM_MAX_CHANNELS + \
+                               AQUA_STREAM_MAX_SCANS * AQUA_STREAM_MAX_CHANNELS * 2 + 4)
+// A COBS-encoded frame with its delimiter
+#define AQUA_STREAM_WIRE_MAX (AQUA_STREAM_FRAME_MAX + AQUA_STREAM_FRAME_MAX / 254 + 2)
+
+typedef struct {
+    uint32_t seq;
+    uint32_t first_scan;
+    uint32_t period_us;
+    int64_t first_us;
+    uint8_t nch;
+    uint8_t channels[AQUA_STREAM_MAX_CHANNELS];
+    uint16_t scans;
+    int16_t samples[AQUA_STREAM_MAX_SCANS * AQUA_STREAM_MAX_CHANNELS];  // [scans][nch]
+} aqua_stream_frame_t;
+
+typedef struct {
+    uint32_t rate_hz;                   // Scans per second
+    uint8_t nch;
+    uint8_t channels[AQUA_STREAM_MAX_CHANNELS];
+    uint32_t duration_s;                // 0: until stopped
+} aqua_stream_config_t;
+
+typedef enum {
+    AQUA_STREAM_CMD_NONE,               // Empty or malformed line
+    AQUA_STREAM_CMD_START,
+    AQUA_STREAM_CMD_STOP,
+} aqua_stream_cmd_t;
+
+// ========== FRAMES ==========
+/**
+ * @brief COBS-encode len bytes and append the zero delimiter
+ * @return Encoded length, 0 if it does not fit in size
+ */
+size_t aqua_cobs_encode(const uint8_t *in, size_t len, uint8_t *out, size_t size);
+
+/**
+ * @brief Decode one COBS frame, without its delimiter
+ * @return Decoded length, -1 if malformed or longer than size
+ */
+int aqua_cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t size);
+
+/**
+ * @brief Serialise a frame with its CRC
+ * @return Length, 0 if the frame is invalid or does not fit in size
+ */
+size_t aqua_stream_pack(const aqua_stream_frame_t *f, uint8_t *buf, size_t size);
+
+/**
+ * @brief Parse and check a serialised frame
+ * @return true if the length, version and CRC are right
+ */
+bool aqua_stream_unpack(const uint8_t *buf, size_t len, aqua_stream_frame_t *f);
+
+// ========== COMMANDS ==========
+/**
+ * @brief Parse one command line (trailing CR/LF allowed); cfg is filled for START
+ */
+aqua_stream_cmd_t aqua_stream_parse_command(const char *line, aqua_stream_config_t *cfg);
+
+/**
+ * @brief Check a capture against the limits and the channels configured
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for a rate above STREAM_MAX_RATE_HZ,
+ *         no or too many channels, or a channel that is not a built-in
+ *         analog probe (only those are set up on the ADC)
+ */
+esp_err_t aqua_stream_check_config(const aqua_stream_config_t *cfg);
+
+// ========== RECEIVER ==========
+typedef struct {
+    uint32_t frames;                    // Good frames
+    uint32_t bad_frames;                // Failed decoding or the CRC
+    uint32_t lost_frames;               // Gaps in seq
+    uint32_t missed_scans;              // Gaps in first_scan, lost frames' scans included
+    uint32_t captures;                  // Frames with seq 0
+    uint64_t scans;                     // In good frames
+    uint64_t bytes;                     // Fed
+} aqua_stream_rx_stats_t;
+
+typedef void (*aqua_stream_frame_cb_t)(const aqua_stream_frame_t *f, void *ctx);
+
+typedef struct {
+    uint8_t wire[AQUA_STREAM_WIRE_MAX];
+    uint8_t raw[AQUA_STREAM_FRAME_MAX];
+    size_t have;
+    bool overflow;                      // Current frame too long, skip to the next zero
+    bool started;                       // next_seq and next_scan are known
+    uint32_t next_seq;
+    uint32_t next_scan;
+    aqua_stream_frame_t frame;
+    aqua_stream_frame_cb_t cb;
+    void *ctx;
+    aqua_stream_rx_stats_t stats;
+} aqua_stream_rx_t;
+
+void aqua_stream_rx_init(aqua_stream_rx_t *rx, aqua_stream_frame_cb_t cb, void *ctx);
+
+/**
+ * @brief Feed bytes from the port; cb gets every good frame, in order
+ */
+void aqua_stream_rx_feed(aqua_stream_rx_t *rx, const uint8_t *data, size_t len);
+
+// ========== CAPTURE ==========
+typedef struct {
+    uint32_t captures;
+    uint32_t frames;                    // Sent
+    uint32_t dropped_frames;            // Not taken by the host in time
+    uint32_t skipped_scans;             // Not taken because writing fell behind
+    uint64_t scans;
+    uint64_t bytes;                     // On the wire
+    int64_t capture_us;                 // Time spent capturing
+} aqua_stream_stats_t;
+
+/**
+ * @brief Ask for a capture; the task serving the port runs it
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG (aqua_stream_check_config())
+ */
+esp_err_t aqua_stream_start(const aqua_stream_config_t *cfg);
+
+/**
+ * @brief End the capture in progress, or cancel one asked for
+ */
+void aqua_stream_stop(void);
+
+/**
+ * @brief Serve the port once: take commands and run the capture one asks for
+ *
+ * Returns after a capture ends, or after timeout_ms without one being asked for.
+ */
+void aqua_stream_serve(hal_stream_t *port, int timeout_ms);
+
+/**
+ * @brief Open the USB port and serve it from a task of its own
+ * @return ESP_OK, ESP_ERR_INVALID_STATE (already running) or ESP_FAIL
+ */
+esp_err_t aqua_stream_init(void);
+
+void aqua_stream_get_stats(aqua_stream_stats_t *out);
+
+#endif // AQUA_STREAM_H
@@ -0,0 +1,102 @@
+#include <math.h>
+#include <stdlib.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_time.h"
+#include "hal.h"
+
+#define US_PER_S 1000000LL
+
+// Reference line: the last sync. Drift is measured from s_base, which only
+// moves once a measurement has been made, so short sync intervals add up.
+static int64_t s_ref_unix, s_ref_mono;
+static int64_t s_base_unix, s_base_mono;
+static int64_t s_first_mono;
+static aqua_time_stats_t s_stats = { .last_sync_us = -1 };
+
+void aqua_time_reset(void) {
+    s_ref_unix = s_ref_mono = 0;
+    s_base_unix = s_base_mono = 0;
+    s_first_mono = 0;
+    s_stats = (aqua_time_stats_t){ .last_sync_us = -1 };
+}
+
+// A clock running fast by p ppm counts p µs too many per second
+static int64_t extrapolate(int64_t mono_us) {
+    int64_t dt = mono_us - s_ref_mono;
+    return s_ref_unix + dt - llround((double)dt * s_stats.drift_ppm / 1e6);
+}
+
+// ========== SYNC ==========
+static void measure_drift(int64_t unix_us, int64_t mono_us) {
+    int64_t span = mono_us - s_base_mono;
+    if (span < TIME_DRIFT_MIN_INTERVAL_S * US_PER_S) {
+        return;
+    }
+
+    double measured = (double)(span - (unix_us - s_base_unix)) * 1e6 / (double)span;
+    if (fabs(measured) > TIME_DRIFT_MAX_PPM) {
+        // A server step or a bad exchange, not the crystal
+        s_stats.drift_rejected++;
+        AQUA_LOG(TIME_DRIFT_REJECTED, (float)measured);
+    } else if (!s_stats.drift_known) {
+        s_stats.drift_ppm = (float)measured;
+        s_stats.drift_known = true;
+    } else {
+        s_stats.drift_ppm += (float)(measured - s_stats.drift_ppm) / 4.0f;
+    }
+    s_base_unix = unix_us;
+    s_base_mono = mono_us;
+}
+
+void aqua_time_sync(int64_t unix_us, int64_t mono_us) {
+    if (s_stats.syncs == 0) {
+        s_first_mono = mono_us;
+        s_base_unix = unix_us;
+        s_base_mono = mono_us;
+        s_stats.last_step_us = 0;
+        AQUA_LOG(TIME_FIRST_SYNC, (int)(mono_us / US_PER_S));
+    } else {
+        s_stats.last_step_us = unix_us - extrapolate(mono_us);
+        measure_drift(unix_us, mono_us);
+        AQUA_LOG(TIME_SYNCED, (int)(s_stats.last_step_us / 1000), s_stats.drift_ppm);
+    }
+    s_ref_unix = unix_us;
+    s_ref_mono = mono_us;
+    s_stats.syncs++;
+    s_stats.last_sync_us = mono_us;
+}
+
+bool aqua_time_poll(void) {
+    int64_t unix_us, mono_us;
+    if (!hal_time_sync_poll(&unix_us, &mono_us)) {
+        return false;
+    }
+    aqua_time_sync(unix_us, mono_us);
+    return true;
+}
+
+// ========== TIMESTAMPS ==========
+bool aqua_time_stamp(int64_t mono_us, aqua_timestamp_t *ts) {
+    if (s_stats.syncs == 0) {
+        *ts = (aqua_timestamp_t){ .unix_us = 0, .quality = AQUA_TIME_UNSYNCED };
+        return false;
+    }
+
+    int64_t age = llabs(mono_us - s_ref_mono);
+    int64_t ppm = s_stats.drift_known ? TIME_DRIFT_RESIDUAL_PPM : TIME_DRIFT_UNKNOWN_PPM;
+    ts->unix_us = extrapolate(mono_us);
+    ts->error_ms = TIME_SYNC_ERROR_MS + (uint32_t)(age * ppm / (1000 * US_PER_S));
+    if (mono_us < s_first_mono) {
+        ts->quality = AQUA_TIME_PRESYNC;
+    } else if (age > TIME_HOLDOVER_S * US_PER_S) {
+        ts->quality = AQUA_TIME_HOLDOVER;
+    } else {
+        ts->quality = AQUA_TIME_SYNCED;
+    }
+    return true;
+}
+
+const aqua_time_stats_t *aqua_time_stats(void) {
+    return &s_stats;
+}
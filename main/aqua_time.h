@@ -0,0 +1,56 @@
+#ifndef AQUA_TIME_H
+#define AQUA_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "aqua_core.h"
+
+// Wall-clock timestamps for readings (TIME in aqua_config.h).
+//
+// Readings record hal_time_us() when they are sampled. Each SNTP result
+// pairs a server time with the monotonic time it arrived at; a timestamp is
+// the last pair extrapolated to the sample's monotonic time, corrected for
+// the drift of the local clock measured between syncs. The same line runs
+// backwards, so samples taken before the first sync get their time once it
+// arrives. Timestamp types are in aqua_core.h.
+
+typedef struct {
+    uint32_t syncs;             // Sync results taken
+    uint32_t drift_rejected;    // Drift measurements above TIME_DRIFT_MAX_PPM, ignored
+    bool drift_known;           // At least one drift measurement accepted
+    float drift_ppm;            // Local clock fast (+) or slow (-) against the server
+    int64_t last_step_us;       // Server time minus the extrapolated time at the last sync
+    int64_t last_sync_us;       // Monotonic time of the last sync, -1 before the first
+} aqua_time_stats_t;
+
+/**
+ * @brief Forget every sync and the drift estimate
+ */
+void aqua_time_reset(void);
+
+/**
+ * @brief Take one sync result
+ *
+ * Becomes the reference for all timestamps. Once syncs span at least
+ * TIME_DRIFT_MIN_INTERVAL_S, the drift between them updates the estimate.
+ * @param unix_us Server time at the sync
+ * @param mono_us hal_time_us() at the same moment
+ */
+void aqua_time_sync(int64_t unix_us, int64_t mono_us);
+
+/**
+ * @brief Pass on a new SNTP result from the HAL, if one arrived
+ * @return true if a sync was taken
+ */
+bool aqua_time_poll(void);
+
+/**
+ * @brief Wall-clock time of a monotonic instant
+ * @param mono_us A hal_time_us() value from this boot
+ * @return false (quality AQUA_TIME_UNSYNCED, unix_us 0) before the first sync
+ */
+bool aqua_time_stamp(int64_t mono_us, aqua_timestamp_t *ts);
+
+const aqua_time_stats_t *aqua_time_stats(void);
+
+#endif // AQUA_TIME_H
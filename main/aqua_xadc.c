@@ -0,0 +1,321 @@
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "aqua_xadc.h"
+#include "hal.h"
+
+_Static_assert(XADC_COUNT <= XADC_MAX_DEVICES, "XADC_COUNT exceeds the converters a scan can address");
+
+// ADS1115 registers and config fields (datasheet section 8.6)
+#define REG_CONVERSION 0
+#define REG_CONFIG 1
+#define REG_LO_THRESH 2
+#define REG_HI_THRESH 3
+
+#define CFG_OS 0x8000                   // Start a single conversion
+#define CFG_MUX_SINGLE(in) ((4 + (in)) << 12)
+#define CFG_PGA_4V 0x0200               // +/-4.096 V full scale, 0.125 mV per count
+#define CFG_MODE_SINGLE 0x0100
+#define CFG_DR_SHIFT 5
+// COMP_QUE = 00: ALERT/RDY asserts after every conversion
+
+#define ALERT_MARGIN_US 2000            // Beyond twice the nominal conversion time
+
+typedef enum {
+    DEV_ABSENT,
+    DEV_IDLE,
+    DEV_STARTING,                       // Config write with OS set is queued
+    DEV_CONVERTING,                     // Waiting for the ALERT/RDY edge
+    DEV_READING                         // Conversion register read is queued
+} dev_state_t;
+
+typedef struct {
+    uint8_t addr;
+    int alert_pin;
+    dev_state_t state;
+    uint8_t pending;                    // Inputs still to convert, including the current one
+    uint8_t input;                      // Input being converted
+    int64_t deadline_us;                // Give up on the ALERT edge after this
+    uint8_t wbuf[3];                    // Owned by the queued transfer until it completes
+    uint8_t rbuf[2];
+} xadc_dev_t;
+
+static xadc_dev_t s_devs[XADC_MAX_DEVICES];
+static bool s_ready;
+static uint16_t s_dr_code;
+static int64_t s_conversion_us;
+static uint16_t s_done;                 // Inputs with a result not yet taken
+static uint16_t s_failed;               // Inputs whose last conversion failed
+static int16_t s_mv[XADC_MAX_INPUTS];
+static bool s_scanning;
+static int64_t s_scan_start_us;
+static aqua_xadc_stats_t s_stats;
+static int s_sync_tag;                  // Tag of the blocking transfers in aqua_xadc_init()
+
+static uint16_t data_rate_code(int sps) {
+    static const int rates[8] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+    for (uint16_t i = 0; i < 8; i++) {
+        if (rates[i] >= sps) {
+            return i;
+        }
+    }
+    return 7;
+}
+
+static esp_err_t submit(xadc_dev_t *d, size_t wlen, size_t rlen) {
+    esp_err_t err = hal_i2c_submit(d->addr, d->wbuf, wlen, rlen ? d->rbuf : NULL, rlen, d);
+    if (err == ESP_OK) {
+        s_stats.bus_transactions++;
+    }
+    return err;
+}
+
+// ========== SCAN STATE MACHINE ==========
+static void input_finished(xadc_dev_t *d, bool ok, int mv) {
+    int device = (int)(d - s_devs);
+    uint16_t bit = 1u << (device * XADC_INPUTS_PER_DEVICE + d->input);
+    d->pending &= ~(1u << d->input);
+    if (ok) {
+        s_mv[device * XADC_INPUTS_PER_DEVICE + d->input] = (int16_t)mv;
+        s_done |= bit;
+        s_stats.conversions++;
+    } else {
+        s_failed |= bit;
+        s_stats.failures++;
+        AQUA_LOG(XADC_INPUT_FAILED, device, d->input);
+    }
+}
+
+// Starts the lowest pending input, or leaves the converter idle
+static void start_next(xadc_dev_t *d) {
+    while (d->pending) {
+        d->input = (uint8_t)__builtin_ctz(d->pending);
+        uint16_t cfg = CFG_OS | CFG_MUX_SINGLE(d->input) | CFG_PGA_4V | CFG_MODE_SINGLE |
+                       (uint16_t)(s_dr_code << CFG_DR_SHIFT);
+        d->wbuf[0] = REG_CONFIG;
+        d->wbuf[1] = cfg >> 8;
+        d->wbuf[2] = cfg & 0xFF;
+        if (submit(d, 3, 0) == ESP_OK) {
+            d->state = DEV_STARTING;
+            return;
+        }
+        input_finished(d, false, 0);
+    }
+    d->state = DEV_IDLE;
+}
+
+static void handle_event(const hal_event_t *evt) {
+    if (evt->type == HAL_EVENT_GPIO_FALLING) {
+        for (int i = 0; i < XADC_COUNT; i++) {
+            xadc_dev_t *d = &s_devs[i];
+            if (d->state == DEV_CONVERTING && d->alert_pin == evt->pin) {
+                d->wbuf[0] = REG_CONVERSION;
+                if (submit(d, 1, 2) == ESP_OK) {
+                    d->state = DEV_READING;
+                } else {
+                    input_finished(d, false, 0);
+                    start_next(d);
+                }
+            }
+        }
+        return;
+    }
+
+    // Completions of transfers from before a re-init match no converter state
+    for (int i = 0; i < XADC_COUNT; i++) {
+        xadc_dev_t *d = &s_devs[i];
+        if (evt->tag != d) continue;
+        if (d->state == DEV_STARTING) {
+            if (evt->err == ESP_OK) {
+                d->state = DEV_CONVERTING;
+                d->deadline_us = hal_time_us() + 2 * s_conversion_us + ALERT_MARGIN_US;
+            } else {
+                input_finished(d, false, 0);
+                start_next(d);
+            }
+        } else if (d->state == DEV_READING) {
+            int16_t code = (int16_t)(d->rbuf[0] << 8 | d->rbuf[1]);
+            input_finished(d, evt->err == ESP_OK, code / 8);
+            start_next(d);
+        }
+        return;
+    }
+}
+
+// A converter whose ALERT edge never came loses that input, not the scan
+static int64_t check_deadlines(int64_t now) {
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < XADC_COUNT; i++) {
+        xadc_dev_t *d = &s_devs[i];
+        if (d->state != DEV_CONVERTING) continue;
+        if (now >= d->deadline_us) {
+            input_finished(d, false, 0);
+            start_next(d);
+        } else if (d->deadline_us < next) {
+            next = d->deadline_us;
+        }
+    }
+    return next;
+}
+
+static int pending_inputs(void) {
+    int count = 0;
+    for (int i = 0; i < XADC_COUNT; i++) {
+        count += __builtin_popcount(s_devs[i].pending);
+    }
+    return count;
+}
+
+// ========== PUBLIC API ==========
+// Blocking register write used while probing, before any scan is running
+static esp_err_t write_sync(uint8_t addr, uint8_t reg, uint16_t value) {
+    uint8_t buf[3] = { reg, value >> 8, value & 0xFF };
+    esp_err_t err = hal_i2c_submit(addr, buf, sizeof(buf), NULL, 0, &s_sync_tag);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_stats.bus_transactions++;
+    hal_event_t evt;
+    while ((err = hal_event_wait(&evt, 100)) == ESP_OK) {
+        if (evt.type == HAL_EVENT_I2C_DONE && evt.tag == &s_sync_tag) {
+            return evt.err;
+        }
+    }
+    return err;
+}
+
+esp_err_t aqua_xadc_init(void) {
+    memset(s_devs, 0, sizeof(s_devs));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_ready = false;
+    s_done = s_failed = 0;
+    s_scanning = false;
+    s_dr_code = data_rate_code(XADC_DATA_RATE_SPS);
+    s_conversion_us = 1000000 / XADC_DATA_RATE_SPS;
+    if (XADC_COUNT == 0) {
+        s_ready = true;
+        return ESP_OK;
+    }
+
+    esp_err_t err = hal_i2c_init(XADC_I2C_SDA_PIN, XADC_I2C_SCL_PIN, XADC_I2C_FREQ_HZ);
+    if (err != ESP_OK) {
+        return err;
+    }
+    int found = 0;
+    for (int i = 0; i < XADC_COUNT; i++) {
+        static const int alert_pins[] = XADC_ALERT_PINS;
+        xadc_dev_t *d = &s_devs[i];
+        d->addr = XADC_ADDR_BASE + i;
+        d->alert_pin = alert_pins[i];
+
+        // hi_thresh MSB set and lo_thresh MSB clear turn ALERT into conversion-ready
+        if (write_sync(d->addr, REG_LO_THRESH, 0x0000) != ESP_OK ||
+            write_sync(d->addr, REG_HI_THRESH, 0x8000) != ESP_OK) {
+            d->state = DEV_ABSENT;
+            AQUA_LOG(XADC_MISSING, i, d->addr);
+            continue;
+        }
+        err = hal_gpio_falling_enable(d->alert_pin);
+        if (err != ESP_OK) {
+            return err;
+        }
+        d->state = DEV_IDLE;
+        found++;
+    }
+    AQUA_LOG(XADC_FOUND, found, XADC_COUNT);
+    s_ready = true;
+    return ESP_OK;
+}
+
+bool aqua_xadc_present(int device) {
+    return s_ready && device >= 0 && device < XADC_COUNT && s_devs[device].state != DEV_ABSENT;
+}
+
+esp_err_t aqua_xadc_scan_start(uint16_t inputs) {
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!s_scanning) {
+        s_scanning = true;
+        s_scan_start_us = hal_time_us();
+    }
+    for (int n = 0; n < XADC_MAX_INPUTS; n++) {
+        if (!(inputs & (1u << n))) continue;
+        int device = n / XADC_INPUTS_PER_DEVICE;
+        if (!aqua_xadc_present(device)) continue;
+        xadc_dev_t *d = &s_devs[device];
+        uint8_t bit = 1u << (n % XADC_INPUTS_PER_DEVICE);
+        if (d->pending & bit) continue;     // Already being converted
+        s_done &= ~(1u << n);
+        s_failed &= ~(1u << n);
+        d->pending |= bit;
+    }
+    for (int i = 0; i < XADC_COUNT; i++) {
+        if (s_devs[i].state == DEV_IDLE) {
+            start_next(&s_devs[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t aqua_xadc_scan_wait(uint32_t timeout_ms) {
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int64_t end = hal_time_us() + (int64_t)timeout_ms * 1000;
+    while (pending_inputs() > 0) {
+        int64_t now = hal_time_us();
+        int64_t wake = check_deadlines(now);
+        if (pending_inputs() == 0) break;
+        if (now >= end) {
+            AQUA_LOG(XADC_SCAN_TIMEOUT, pending_inputs());
+            return ESP_ERR_TIMEOUT;
+        }
+        if (wake > end) wake = end;
+
+        hal_event_t evt;
+        if (hal_event_wait(&evt, (uint32_t)((wake - now + 999) / 1000)) == ESP_OK) {
+            handle_event(&evt);
+        }
+    }
+    if (s_scanning) {
+        s_scanning = false;
+        s_stats.scans++;
+        s_stats.last_scan_us = hal_time_us() - s_scan_start_us;
+    }
+    return ESP_OK;
+}
+
+esp_err_t aqua_xadc_read_mv(int input, int *mv) {
+    if (input < 0 || input >= XADC_MAX_INPUTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!aqua_xadc_present(input / XADC_INPUTS_PER_DEVICE)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint16_t bit = 1u << input;
+    if (s_failed & bit) {
+        s_failed &= ~bit;
+        return ESP_FAIL;
+    }
+    if (!(s_done & bit)) {
+        // Not converted since the last result was taken (or still running)
+        esp_err_t err = aqua_xadc_scan_start(bit);
+        if (err == ESP_OK) {
+            err = aqua_xadc_scan_wait(XADC_SCAN_TIMEOUT_MS);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!(s_done & bit)) {
+            return ESP_FAIL;
+        }
+    }
+    s_done &= ~bit;
+    *mv = s_mv[input];
+    return ESP_OK;
+}
+
+const aqua_xadc_stats_t *aqua_xadc_stats(void) {
+    return &s_stats;
+}
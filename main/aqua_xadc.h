@@ -0,0 +1,77 @@
+#ifndef AQUA_XADC_H
+#define AQUA_XADC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// External ADS1115-class converters on the I2C bus (EXTERNAL ADC in
+// aqua_config.h), four single-ended inputs each.
+//
+// A scan converts any set of inputs with every converter working at once:
+// each one is sent a single-shot config write, signals the end of the
+// conversion on its ALERT/RDY pin, and is then read and started on its next
+// input. Transactions are queued (hal_i2c_submit) and completions and ALERT
+// edges come back through the HAL event queue, so the CPU only spends time
+// on the few bytes of each transfer. A scan of n inputs spread over k
+// converters takes about n/k conversion times instead of n.
+//
+// Input numbers are converter * XADC_INPUTS_PER_DEVICE + input, as packed by
+// XADC_CH() in adc_config.h.
+
+#define XADC_INPUTS_PER_DEVICE 4
+#define XADC_MAX_DEVICES 4
+#define XADC_MAX_INPUTS (XADC_MAX_DEVICES * XADC_INPUTS_PER_DEVICE)
+
+typedef struct {
+    uint32_t scans;                 // Scans completed
+    uint32_t conversions;           // Inputs read successfully
+    uint32_t failures;              // Inputs that NACKed or never signalled ready
+    uint32_t bus_transactions;      // Transfers submitted, including init
+    int64_t last_scan_us;           // First submit to last result of the last scan
+} aqua_xadc_stats_t;
+
+/**
+ * @brief Probe the XADC_COUNT converters and put them in conversion-ready mode
+ *
+ * A converter that does not acknowledge its address is left out; its inputs
+ * fail every scan. Calling it again re-probes and drops all results.
+ * @return ESP_OK (also with no converters fitted), or the I2C/GPIO setup error
+ */
+esp_err_t aqua_xadc_init(void);
+
+/**
+ * @brief True if converter device answered during aqua_xadc_init()
+ */
+bool aqua_xadc_present(int device);
+
+/**
+ * @brief Start converting inputs (bit n = input n) and return at once
+ *
+ * Inputs already being scanned are not converted twice. Results are collected
+ * by aqua_xadc_scan_wait() or aqua_xadc_read_mv().
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE before aqua_xadc_init()
+ */
+esp_err_t aqua_xadc_scan_start(uint16_t inputs);
+
+/**
+ * @brief Run the scan until every started input has a result
+ * @return ESP_OK, or ESP_ERR_TIMEOUT with inputs still pending after timeout_ms
+ */
+esp_err_t aqua_xadc_scan_wait(uint32_t timeout_ms);
+
+/**
+ * @brief Take the result of input from the last scan
+ *
+ * Each result is returned once. An input that was not scanned since its last
+ * result is converted now, on its own.
+ * @param mv Input voltage in mV
+ * @return ESP_OK, ESP_ERR_NOT_FOUND (converter not fitted or not answering),
+ *         ESP_FAIL (no result: NACK or ALERT never came), ESP_ERR_TIMEOUT or
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t aqua_xadc_read_mv(int input, int *mv);
+
+const aqua_xadc_stats_t *aqua_xadc_stats(void);
+
+#endif // AQUA_XADC_H
@@ -0,0 +1,124 @@
+#include <string.h>
+#include "ca_der.h"
+
+#define PEM_BEGIN "-----BEGIN CERTIFICATE-----"
+#define PEM_END "-----END CERTIFICATE-----"
+
+size_t ca_der_cert_length(const uint8_t *der, size_t len) {
+    if (len < 2 || der[0] != 0x30) {
+        return 0;
+    }
+    size_t header = 2;
+    size_t body = der[1];
+    if (body & 0x80) {
+        // Long form; certificates never need more than 3 length bytes
+        size_t n = body & 0x7F;
+        if (n == 0 || n > 3 || len < 2 + n) {
+            return 0;
+        }
+        body = 0;
+        for (size_t i = 0; i < n; i++) {
+            body = (body << 8) | der[2 + i];
+        }
+        header += n;
+    }
+    return header + body <= len ? header + body : 0;
+}
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+// Decodes base64 between p and end, skipping line breaks; -1 on bad input
+static int base64_decode(const char *p, const char *end, uint8_t *out, size_t size) {
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+
+    for (; p < end; p++) {
+        if (*p == '\r' || *p == '\n' || *p == ' ' || *p == '\t') continue;
+        if (*p == '=') break;
+        int v = base64_value(*p);
+        if (v < 0) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n == size) return -1;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (int)n;
+}
+
+static const char *find(const char *p, const char *end, const char *needle) {
+    size_t needle_len = strlen(needle);
+    for (; p + needle_len <= end; p++) {
+        if (memcmp(p, needle, needle_len) == 0) return p;
+    }
+    return NULL;
+}
+
+int ca_der_import_pem(const char *pem, size_t pem_len, uint8_t *out, size_t size, size_t *out_len) {
+    const char *p = pem;
+    const char *end = pem + pem_len;
+    size_t pos = 0;
+    int count = 0;
+
+    while ((p = find(p, end, PEM_BEGIN)) != NULL) {
+        const char *body = p + strlen(PEM_BEGIN);
+        const char *stop = find(body, end, PEM_END);
+        if (!stop || count == CA_DER_MAX_CERTS || size < pos + 2) {
+            return -1;
+        }
+
+        int der_len = base64_decode(body, stop, out + pos + 2, size - pos - 2);
+        if (der_len <= 0 || der_len > 0xFFFF ||
+            ca_der_cert_length(out + pos + 2, (size_t)der_len) != (size_t)der_len) {
+            return -1;
+        }
+        out[pos] = (uint8_t)(der_len >> 8);
+        out[pos + 1] = (uint8_t)der_len;
+        pos += 2 + (size_t)der_len;
+        count++;
+        p = stop + strlen(PEM_END);
+    }
+
+    if (out_len) {
+        *out_len = pos;
+    }
+    return count;
+}
+
+bool ca_der_next(const uint8_t *bundle, size_t len, size_t *pos,
+                 const uint8_t **der, size_t *der_len) {
+    if (*pos + 2 > len) {
+        return false;
+    }
+    size_t n = ((size_t)bundle[*pos] << 8) | bundle[*pos + 1];
+    const uint8_t *cert = bundle + *pos + 2;
+    if (*pos + 2 + n > len || ca_der_cert_length(cert, n) != n) {
+        return false;
+    }
+    *der = cert;
+    *der_len = n;
+    *pos += 2 + n;
+    return true;
+}
+
+int ca_der_count(const uint8_t *bundle, size_t len) {
+    size_t pos = 0;
+    int count = 0;
+    const uint8_t *der;
+    size_t der_len;
+
+    while (ca_der_next(bundle, len, &pos, &der, &der_len)) {
+        count++;
+    }
+    return pos == len ? count : -1;
+}
@@ -0,0 +1,44 @@
+#ifndef CA_DER_H
+#define CA_DER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact trust-anchor bundle shared by every TLS client.
+//
+// Anchors are kept as DER, not PEM, so they can be handed to mbedTLS without
+// a base64 pass and without copying (see ca_store.c). A bundle is a sequence
+// of entries, each a u16 big-endian length followed by one DER certificate.
+// PEM is only an import format: ca_der_import_pem() converts it, and
+// host/tools/aqua_pem2der generates the built-in bundle in ca_anchors.h.
+
+#define CA_DER_MAX_CERTS 8
+
+/**
+ * @brief Length of the DER certificate at der (outer SEQUENCE header included)
+ * @return Certificate length, 0 if der does not start with a complete SEQUENCE
+ */
+size_t ca_der_cert_length(const uint8_t *der, size_t len);
+
+/**
+ * @brief Convert PEM text with one or more CERTIFICATE blocks into a bundle
+ *
+ * Text outside the BEGIN/END markers is ignored.
+ * @return Number of certificates, -1 on malformed input or if out is too small
+ */
+int ca_der_import_pem(const char *pem, size_t pem_len, uint8_t *out, size_t size, size_t *out_len);
+
+/**
+ * @brief Step through a bundle; *pos starts at 0
+ * @return false at the end of the bundle or on a malformed entry
+ */
+bool ca_der_next(const uint8_t *bundle, size_t len, size_t *pos,
+                 const uint8_t **der, size_t *der_len);
+
+/**
+ * @brief Number of certificates in a bundle, -1 if any entry is malformed
+ */
+int ca_der_count(const uint8_t *bundle, size_t len);
+
+#endif // CA_DER_H
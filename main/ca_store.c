@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "mbedtls/x509_crt.h"
+#include "aqua_log.h"
+#include "ca_anchors.h"
+#include "ca_der.h"
+#include "ca_store.h"
+#include "cert_manager.h"
+
+#define CA_STORE_NVS_KEY "ca_der"
+#define CA_STORE_NVS_MAX 4096
+#define CA_STORE_REPORT_EVERY 32    // Setups between timing reports
+
+static ca_store_stats_t stats;
+static bool initialized;
+
+// A provisioned bundle stays allocated: the parsed chain points into it
+static const uint8_t *load_nvs_bundle(size_t *len) {
+    uint8_t *buf = malloc(CA_STORE_NVS_MAX);
+    if (!buf) {
+        return NULL;
+    }
+    *len = CA_STORE_NVS_MAX;
+    if (get_certificate(CA_STORE_NVS_KEY, (char *)buf, len) != ESP_OK || ca_der_count(buf, *len) <= 0) {
+        free(buf);
+        return NULL;
+    }
+    uint8_t *fit = realloc(buf, *len);
+    return fit ? fit : buf;
+}
+
+static int add_bundle(mbedtls_x509_crt *chain, const uint8_t *bundle, size_t len) {
+    size_t pos = 0;
+    const uint8_t *der;
+    size_t der_len;
+    int added = 0;
+
+    while (ca_der_next(bundle, len, &pos, &der, &der_len)) {
+        int ret = mbedtls_x509_crt_parse_der_nocopy(chain, der, der_len);
+        if (ret != 0) {
+            AQUA_LOG(CA_STORE_BAD_ANCHOR, added, -ret);
+            continue;
+        }
+        added++;
+    }
+    return added;
+}
+
+esp_err_t ca_store_init(void) {
+    if (initialized) {
+        return ESP_OK;
+    }
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t err = esp_tls_init_global_ca_store();
+    mbedtls_x509_crt *chain = esp_tls_get_global_ca_store();
+    if (err != ESP_OK || !chain) {
+        AQUA_LOG(CA_STORE_FAILED, esp_err_to_name(err));
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+
+    size_t len = 0;
+    const uint8_t *bundle = load_nvs_bundle(&len);
+    stats.from_nvs = bundle != NULL;
+    if (bundle) {
+        stats.anchors = add_bundle(chain, bundle, len);
+    }
+    if (stats.anchors == 0) {
+        bundle = aqua_ca_anchors;
+        len = sizeof(aqua_ca_anchors);
+        stats.from_nvs = false;
+        stats.pem_bytes = AQUA_CA_ANCHORS_PEM_BYTES;
+        stats.anchors = add_bundle(chain, bundle, len);
+    }
+
+    stats.parse_us = esp_timer_get_time() - start;
+    stats.der_bytes = len;
+    size_t heap_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    stats.heap_bytes = heap_before > heap_after ? heap_before - heap_after : 0;
+
+    if (stats.anchors == 0) {
+        AQUA_LOG(CA_STORE_FAILED, "no usable trust anchors");
+        return ESP_FAIL;
+    }
+    initialized = true;
+    ca_store_report();
+    return ESP_OK;
+}
+
+void ca_store_record_setup(int64_t us) {
+    if (stats.setups == 0 || us < stats.setup_min_us) stats.setup_min_us = us;
+    if (us > stats.setup_max_us) stats.setup_max_us = us;
+    stats.setup_total_us += us;
+    stats.setups++;
+    if (stats.setups == 1 || stats.setups % CA_STORE_REPORT_EVERY == 0) {
+        AQUA_LOG(CA_STORE_SETUP_TIME, (int)stats.setups, (int)(stats.setup_min_us / 1000),
+                 (int)(stats.setup_total_us / stats.setups / 1000), (int)(stats.setup_max_us / 1000));
+    }
+}
+
+void ca_store_report(void) {
+    AQUA_LOG(CA_STORE_READY, stats.anchors, stats.from_nvs ? "NVS" : "firmware",
+             (int)stats.der_bytes, (int)stats.pem_bytes, (int)stats.heap_bytes, (int)stats.parse_us);
+}
+
+const ca_store_stats_t *ca_store_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,48 @@
+#ifndef CA_STORE_H
+#define CA_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Shared trust anchors for every TLS client (HTTP and stream transports).
+//
+// The DER bundle is parsed once into the esp-tls global CA store with
+// mbedtls_x509_crt_parse_der_nocopy(), so the certificates are referenced
+// in flash rather than decoded from PEM and copied per connection.
+
+typedef struct {
+    int anchors;                // Certificates in the store
+    bool from_nvs;              // Bundle provisioned in NVS rather than built in
+    uint32_t der_bytes;         // Bundle size
+    uint32_t pem_bytes;         // Size of the same anchors as PEM (built-in only)
+    uint32_t heap_bytes;        // Heap used by the parsed chain
+    int64_t parse_us;           // One-time parse cost
+    uint32_t setups;            // TLS client setups measured
+    int64_t setup_min_us;
+    int64_t setup_max_us;
+    int64_t setup_total_us;
+} ca_store_stats_t;
+
+/**
+ * @brief Parse the trust anchors into the global CA store (runs once)
+ *
+ * Prefers a bundle provisioned in NVS (see provision_certificates()) and
+ * falls back to the anchors built into the firmware.
+ * @return ESP_OK once the store holds at least one anchor
+ */
+esp_err_t ca_store_init(void);
+
+/**
+ * @brief Record the time from client creation to an established connection
+ */
+void ca_store_record_setup(int64_t us);
+
+/**
+ * @brief Log parse cost and memory use (setup times are logged as they accumulate)
+ */
+void ca_store_report(void);
+
+const ca_store_stats_t *ca_store_get_stats(void);
+
+#endif // CA_STORE_H
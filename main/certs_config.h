@@ -1,19 +0,0 @@
-#ifndef CERTS_CONFIG_H
-#define CERTS_CONFIG_H
-
-#include "esp_err.h"
-
-// Function to load certificates from files
-esp_err_t load_certificates(void) {
-    // This function will load certificates from a secure location
-    // Implementation will depend on your secure storage method
-    // You might want to use:
-    // 1. NVS (Non-volatile storage)
-    // 2. External secure element
-    // 3. Encrypted partition
-    // 4. Secure file system
-
-    return ESP_OK;
-}
-
-#endif // CERTS_CONFIG_H
@@ -0,0 +1,434 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Thin hardware abstraction layer used by the sensor, upload and cycle code.
+// hal_esp32.c implements it on top of ESP-IDF; host/hal_linux.c implements it
+// with simulated sensors and a plain TCP transport for the host build.
+
+// ========== GPIO ==========
+typedef enum {
+    HAL_GPIO_INPUT = 0,
+    HAL_GPIO_OUTPUT
+} hal_gpio_mode_t;
+
+void hal_gpio_reset(int pin);
+void hal_gpio_set_direction(int pin, hal_gpio_mode_t mode);
+void hal_gpio_pullup(int pin);
+void hal_gpio_set_level(int pin, int level);
+int hal_gpio_get_level(int pin);
+
+// ========== ADC ==========
+/**
+ * @brief Configure the ADC unit and all sensor channels from adc_config.h
+ * @return ESP_OK on success
+ */
+esp_err_t hal_adc_init(void);
+
+/**
+ * @brief Single conversion on a sensor channel
+ * @param channel ADC channel number (see adc_config.h)
+ * @param mv Output reading (raw counts while calibration is disabled)
+ * @return ESP_OK on success
+ */
+esp_err_t hal_adc_read_mv(int channel, int *mv);
+
+/**
+ * @brief count conversions on a channel, evenly spaced at rate_hz
+ *
+ * Blocks for count / rate_hz seconds.
+ * @param samples Output readings, in the same units as hal_adc_read_mv()
+ * @return ESP_OK on success
+ */
+esp_err_t hal_adc_read_burst(int channel, uint32_t rate_hz, int16_t *samples, size_t count);
+
+/**
+ * @brief Receives the samples of a modulated read, block_len at a time
+ */
+typedef void (*hal_adc_block_cb_t)(const int16_t *samples, size_t count, void *ctx);
+
+/**
+ * @brief Emitter state during conversion i of hal_adc_read_modulated()
+ *
+ * Off for the first half_period / 2 conversions, then on and off for
+ * half_period each: every period of 2 * half_period is centred on its on
+ * phase.
+ */
+static inline bool hal_emitter_on(size_t i, uint32_t half_period) {
+    return ((i + half_period / 2) / half_period) % 2 == 1;
+}
+
+/**
+ * @brief count conversions at rate_hz while switching emitter_pin on and off
+ *
+ * The emitter follows hal_emitter_on() (half_period even), switched by the
+ * clock that paces the conversions, so the state behind every sample is
+ * known. The samples go to cb through block as each block_len of them is
+ * complete (the last block may be shorter). cb runs between two conversions
+ * and must return well within a sample period. The emitter is left off.
+ * @return ESP_OK on success
+ */
+esp_err_t hal_adc_read_modulated(int channel, int emitter_pin, uint32_t rate_hz, uint32_t half_period,
+                                 size_t count, int16_t *block, size_t block_len,
+                                 hal_adc_block_cb_t cb, void *ctx);
+
+/**
+ * @brief Receives the scans of hal_adc_scan()
+ * @param scans count scans of one sample per channel, in the order requested
+ * @param first Number of the first of them; scan n was due n periods after scan 0
+ * @param first_us hal_time_us() at which the first of them was due
+ * @return false to end the scan
+ */
+typedef bool (*hal_adc_scan_cb_t)(const int16_t *scans, size_t count, uint32_t first, int64_t first_us,
+                                  void *ctx);
+
+/**
+ * @brief Convert every channel in channels[] once per period_us until cb returns false
+ *
+ * Scans are paced by a timer, and the calling task sleeps in between. They
+ * go to cb through block (block_len * nch samples) as each block_len of them
+ * is complete; cb runs in the calling task. Scans whose time has passed by
+ * the time cb returns are skipped, not taken late: the block in progress
+ * goes to cb short and the scan number jumps, so every block is evenly
+ * spaced from its first_us. A scan with a failed conversion is skipped the
+ * same way. The cycle's reads may run meanwhile: the HAL serialises the
+ * conversions on the shared unit.
+ * @return ESP_OK once cb has ended the scan
+ */
+esp_err_t hal_adc_scan(const int *channels, size_t nch, uint32_t period_us, int16_t *block, size_t block_len,
+                       hal_adc_scan_cb_t cb, void *ctx);
+
+// ========== 1-WIRE ==========
+/**
+ * @brief Reset pulse followed by presence detection
+ * @return true if a device answered with a presence pulse
+ */
+bool hal_onewire_reset(int pin);
+
+/**
+ * @brief Reset pulse, timing the presence pulse that answers it
+ * @param presence_us Length of the presence pulse, 0 if none was seen
+ * @return true if a device answered with a presence pulse
+ */
+bool hal_onewire_reset_timed(int pin, int *presence_us);
+void hal_onewire_write_bit(int pin, int bit);
+int hal_onewire_read_bit(int pin);
+
+// ========== PULSE CAPTURE ==========
+/**
+ * @brief Pull pin low for start_low_us, then release it and record the reply
+ *
+ * Returns at once. The release and the capture run in hardware (RMT receiver
+ * on the ESP32), so interrupts cannot disturb the timing and the CPU is free
+ * until hal_pulse_capture_wait(). One capture at a time.
+ * @return ESP_OK once the start pulse is under way
+ */
+esp_err_t hal_pulse_capture_start(int pin, uint32_t start_low_us);
+
+/**
+ * @brief Wait for the capture to end (the line idles high) and copy it out
+ * @param durations Pulse lengths in µs, alternating low/high from the first low
+ * @param count Pulses stored, at most max
+ * @return ESP_OK, ESP_ERR_TIMEOUT (nothing answered within timeout_ms) or
+ *         ESP_ERR_INVALID_STATE (no capture started)
+ */
+esp_err_t hal_pulse_capture_wait(uint16_t *durations, size_t max, size_t *count, uint32_t timeout_ms);
+
+// ========== PULSE COUNTERS ==========
+// Rising edges on an input counted in hardware (PCNT on the ESP32): no
+// interrupt per pulse, the running total is read whenever it is wanted.
+
+/**
+ * @brief Start counting rising edges on pin from 0 (idempotent)
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if every counter is taken
+ */
+esp_err_t hal_pulse_count_start(int pin);
+
+/**
+ * @brief Edges counted on pin since hal_pulse_count_start(); wraps at 2^32
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if pin is not being counted
+ */
+esp_err_t hal_pulse_count_read(int pin, uint32_t *count);
+
+// ========== ASYNC EVENTS ==========
+// Completions of queued I2C transactions and edges on watched pins arrive
+// through one queue, filled from interrupt context, so a single waiter can
+// drive several devices at once.
+typedef enum {
+    HAL_EVENT_I2C_DONE,         // A transaction from hal_i2c_submit() finished
+    HAL_EVENT_GPIO_FALLING      // A pin enabled with hal_gpio_falling_enable() fell
+} hal_event_type_t;
+
+typedef struct {
+    hal_event_type_t type;
+    esp_err_t err;              // I2C: ESP_OK, or ESP_FAIL on NACK/timeout
+    int pin;                    // GPIO: pin that fell
+    void *tag;                  // I2C: tag given to hal_i2c_submit()
+} hal_event_t;
+
+/**
+ * @brief Wait for the next event
+ * @return ESP_OK, or ESP_ERR_TIMEOUT if none arrived within timeout_ms
+ */
+esp_err_t hal_event_wait(hal_event_t *evt, uint32_t timeout_ms);
+
+/**
+ * @brief Make pin a pulled-up input and queue an event on every falling edge
+ */
+esp_err_t hal_gpio_falling_enable(int pin);
+
+// ========== I2C ==========
+/**
+ * @brief Set up the I2C master bus (idempotent)
+ */
+esp_err_t hal_i2c_init(int sda_pin, int scl_pin, uint32_t freq_hz);
+
+/**
+ * @brief Queue a transaction and return at once
+ *
+ * Writes wlen bytes to the 7-bit address addr, then reads rlen bytes after a
+ * repeated start (either may be 0). Both buffers must stay valid until the
+ * HAL_EVENT_I2C_DONE event carrying tag. Transactions complete in the order
+ * they were submitted.
+ * @return ESP_OK once queued, ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t hal_i2c_submit(uint8_t addr, const uint8_t *wbuf, size_t wlen,
+                         uint8_t *rbuf, size_t rlen, void *tag);
+
+// ========== CLOCK ==========
+int64_t hal_time_us(void);
+void hal_delay_ms(uint32_t ms);
+void hal_delay_us(uint32_t us);
+void hal_watchdog_feed(void);
+
+/**
+ * @brief Start SNTP against server, repeating every interval_s (idempotent)
+ *
+ * Needs the network; results are collected with hal_time_sync_poll().
+ */
+esp_err_t hal_time_sync_start(const char *server, uint32_t interval_s);
+
+/**
+ * @brief Take the newest SNTP result if one arrived since the last call
+ * @param unix_us Server time, µs since 1970-01-01 UTC
+ * @param mono_us hal_time_us() when that time was received
+ * @return true if a new result was taken
+ */
+bool hal_time_sync_poll(int64_t *unix_us, int64_t *mono_us);
+
+// ========== HTTP TRANSPORT ==========
+typedef enum {
+    HAL_HTTP_GET = 0,
+    HAL_HTTP_POST
+} hal_http_method_t;
+
+typedef enum {
+    HAL_TLS_CA_STORE = 0,       // Shared CA store (DER trust anchors, parsed once)
+    HAL_TLS_CRT_BUNDLE,         // ESP-IDF certificate bundle
+    HAL_TLS_NONE                // Plain TCP (stream transport only, local brokers)
+} hal_tls_mode_t;
+
+typedef struct {
+    const char *name;
+    const char *value;
+} hal_http_header_t;
+
+typedef struct {
+    const char *url;
+    hal_http_method_t method;
+    hal_tls_mode_t tls;
+    const hal_http_header_t *headers;
+    size_t header_count;
+    const char *body;
+    size_t body_len;
+    int timeout_ms;
+} hal_http_request_t;
+
+typedef struct {
+    int status;             // HTTP status, 0 if no response
+    char *body;             // Caller buffer for the response body, may be NULL
+    size_t body_size;       // Size of body buffer
+    int body_len;           // Bytes stored in body (always NUL terminated)
+} hal_http_response_t;
+
+/**
+ * @brief Make sure the network link is up, reconnecting if needed
+ * @return true if connected
+ */
+bool hal_net_ensure_connected(void);
+
+/**
+ * @brief Perform one HTTP(S) request/response exchange
+ * @param req Request description
+ * @param resp Response status and optional body
+ * @return ESP_OK if a response was received (any status)
+ */
+esp_err_t hal_http_perform(const hal_http_request_t *req, hal_http_response_t *resp);
+
+// Streaming GET for bodies too large to buffer (firmware images)
+typedef struct hal_http_download hal_http_download_t;
+
+/**
+ * @brief Send a GET and read the response headers
+ * @param status HTTP status of the response
+ * @param content_length Body length, -1 if the server did not send one
+ * @return Download handle, NULL if no response was received
+ */
+hal_http_download_t *hal_http_download_open(const char *url, hal_tls_mode_t tls, int timeout_ms,
+                                            int *status, int *content_length);
+
+/**
+ * @brief Read the next part of the body
+ * @return Bytes read, 0 at the end of the body, -1 on error
+ */
+int hal_http_download_read(hal_http_download_t *dl, void *buf, size_t size);
+
+void hal_http_download_close(hal_http_download_t *dl);
+
+// ========== STREAM TRANSPORT ==========
+// Long-lived TLS/TCP byte stream for persistent protocols (MQTT)
+typedef struct hal_stream hal_stream_t;
+
+/**
+ * @brief Connect to host:port
+ * @return Stream handle, NULL on failure
+ */
+hal_stream_t *hal_stream_open(const char *host, int port, hal_tls_mode_t tls, int timeout_ms);
+
+/**
+ * @brief Write all of data
+ * @return len on success, -1 on error
+ */
+int hal_stream_write(hal_stream_t *stream, const void *data, size_t len, int timeout_ms);
+
+/**
+ * @brief Read whatever is available, waiting up to timeout_ms for the first byte
+ * @return Bytes read, 0 on timeout, -1 if the connection failed or was closed
+ */
+int hal_stream_read(hal_stream_t *stream, void *buf, size_t size, int timeout_ms);
+
+void hal_stream_close(hal_stream_t *stream);
+
+/**
+ * @brief Open a keep-alive connection to the server of an http(s) URL
+ *
+ * The caller speaks HTTP/1.1 over the stream itself, so several requests can
+ * share one connection (aqua_pipeline.h).
+ * @return Stream handle, NULL on failure
+ */
+hal_stream_t *hal_http_stream_open(const char *url, hal_tls_mode_t tls, int timeout_ms);
+
+/**
+ * @brief Open the native USB port (a CDC-ACM serial port on the host) as a stream
+ *
+ * The UART console is unaffected. One handle at a time. A write fails when
+ * the host has not taken the data within its timeout (nothing has the port
+ * open, or it reads too slowly).
+ * @return Stream handle, NULL if the port cannot be opened or is already open
+ */
+hal_stream_t *hal_usb_cdc_open(void);
+
+// ========== STREAM SERVER ==========
+// Plain TCP listener for local protocols (Modbus TCP). Accepted connections
+// are streams like the ones above, and may be served from any task.
+typedef struct hal_listener hal_listener_t;
+
+/**
+ * @brief Listen on port on every interface
+ * @param port 0 picks a free port; hal_listener_port() tells which
+ * @return Listener handle, NULL on failure
+ */
+hal_listener_t *hal_listener_open(int port, int backlog);
+int hal_listener_port(const hal_listener_t *listener);
+
+/**
+ * @brief Wait up to timeout_ms for a connection
+ * @return Stream for it, NULL on timeout or error
+ */
+hal_stream_t *hal_listener_accept(hal_listener_t *listener, int timeout_ms);
+void hal_listener_close(hal_listener_t *listener);
+
+// ========== TASKS ==========
+typedef void (*hal_task_fn_t)(void *arg);
+
+/**
+ * @brief Run fn(arg) in a task of its own, which ends when fn returns
+ * @param stack_bytes Stack size (FreeRTOS; ignored on the host)
+ * @param priority FreeRTOS priority (ignored on the host)
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t hal_task_start(const char *name, hal_task_fn_t fn, void *arg, uint32_t stack_bytes, int priority);
+
+// ========== FIRMWARE SLOTS ==========
+// Two app slots (A/B): the running image and the one an update is written to
+
+/**
+ * @brief Start writing an image of image_size bytes to the other slot
+ */
+esp_err_t hal_ota_begin(size_t image_size);
+
+/**
+ * @brief Append to the image being written
+ */
+esp_err_t hal_ota_write(const void *data, size_t len);
+
+/**
+ * @brief Verify the written image and boot it on the next restart
+ */
+esp_err_t hal_ota_end(void);
+
+/**
+ * @brief Discard a partly written image
+ */
+void hal_ota_abort(void);
+
+/**
+ * @brief Read from the running slot (source for delta updates)
+ */
+esp_err_t hal_ota_read_running(size_t offset, void *buf, size_t len);
+
+/**
+ * @brief Size of the running slot
+ */
+size_t hal_ota_slot_size(void);
+
+/**
+ * @brief True while the running image is on trial after an update
+ */
+bool hal_ota_pending_verify(void);
+
+/**
+ * @brief Keep the running image (cancels the pending rollback)
+ */
+void hal_ota_mark_valid(void);
+
+/**
+ * @brief Mark the running image bad and restart into the previous one
+ */
+void hal_ota_rollback(void);
+
+/**
+ * @brief Restart the device
+ */
+void hal_restart(void);
+
+// ========== SETTINGS STORE ==========
+// Small blobs that survive a restart (NVS namespace "aqua" on the device)
+
+/**
+ * @brief Read the blob stored under key (at most 15 characters)
+ * @param len In: size of buf; out: size of the stored blob
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, or ESP_ERR_INVALID_SIZE if buf is too small
+ */
+esp_err_t hal_settings_get(const char *key, void *buf, size_t *len);
+
+/**
+ * @brief Store (or replace) the blob under key and commit it
+ */
+esp_err_t hal_settings_set(const char *key, const void *data, size_t len);
+
+#endif // HAL_H
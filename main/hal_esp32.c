@@ -0,0 +1,1225 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
+#include "driver/pulse_cnt.h"
+#include "driver/rmt_rx.h"
+#include "driver/usb_serial_jtag.h"
+#include "rom/ets_sys.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include "esp_sntp.h"
+#include "esp_task_wdt.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "esp_crt_bundle.h"
+#include "esp_transport.h"
+#include "esp_transport_ssl.h"
+#include "esp_transport_tcp.h"
+#include "lwip/sockets.h"
+#include "adc_handler.h"
+#include "ca_store.h"
+#include "hal.h"
+
+#define TAG "HAL"
+
+// ========== GPIO ==========
+void hal_gpio_reset(int pin) {
+    gpio_reset_pin(pin);
+}
+
+void hal_gpio_set_direction(int pin, hal_gpio_mode_t mode) {
+    gpio_set_direction(pin, mode == HAL_GPIO_OUTPUT ? GPIO_MODE_OUTPUT : GPIO_MODE_INPUT);
+}
+
+void hal_gpio_pullup(int pin) {
+    gpio_pullup_en(pin);
+}
+
+void hal_gpio_set_level(int pin, int level) {
+    gpio_set_level(pin, level);
+}
+
+int hal_gpio_get_level(int pin) {
+    return gpio_get_level(pin);
+}
+
+// ========== ADC ==========
+// ADC1's one-shot unit has two users: the cycle (single reads, the 0.5 s
+// oversample bursts and the lock-in reads) and the stream task's scans.
+// adc_oneshot_read() does not wait for the unit; it fails with
+// ESP_ERR_TIMEOUT while another task converts. So every conversion takes
+// s_adc_lock, one conversion at a time: the two interleave, and each waits
+// at most one conversion (well under 20 µs) for the other.
+static SemaphoreHandle_t s_adc_lock;
+
+static esp_err_t adc_convert(int channel, int *raw) {
+    xSemaphoreTake(s_adc_lock, portMAX_DELAY);
+    esp_err_t err = read_adc_voltage(channel, raw);
+    xSemaphoreGive(s_adc_lock);
+    return err;
+}
+
+esp_err_t hal_adc_init(void) {
+    if (!s_adc_lock) {
+        s_adc_lock = xSemaphoreCreateMutex();
+        if (!s_adc_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xSemaphoreTake(s_adc_lock, portMAX_DELAY);
+    esp_err_t err = init_adc();
+    xSemaphoreGive(s_adc_lock);
+    return err;
+}
+
+esp_err_t hal_adc_read_mv(int channel, int *mv) {
+    return adc_convert(channel, mv);
+}
+
+// One-shot conversions paced against the µs timer. The continuous (DMA)
+// driver would have to take ADC1 away from the one-shot handle the normal
+// reads use; a conversion takes well under the 122 µs period at 8 kHz.
+esp_err_t hal_adc_read_burst(int channel, uint32_t rate_hz, int16_t *samples, size_t count) {
+    int64_t start = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++) {
+        int64_t due = start + (int64_t)i * 1000000 / rate_hz;
+        while (esp_timer_get_time() < due) {
+        }
+        int raw;
+        esp_err_t err = adc_convert(channel, &raw);
+        if (err != ESP_OK) {
+            return err;
+        }
+        samples[i] = (int16_t)raw;
+    }
+    return ESP_OK;
+}
+
+// Same pacing as hal_adc_read_burst(). The emitter switches half a sample
+// period before the first conversion in its new state, so the optics have
+// settled by the time it is sampled.
+esp_err_t hal_adc_read_modulated(int channel, int emitter_pin, uint32_t rate_hz, uint32_t half_period,
+                                 size_t count, int16_t *block, size_t block_len,
+                                 hal_adc_block_cb_t cb, void *ctx) {
+    if (rate_hz == 0 || half_period == 0 || half_period % 2 != 0 || block_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_reset_pin(emitter_pin);
+    gpio_set_direction(emitter_pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(emitter_pin, 0);
+
+    size_t fill = 0;
+    int64_t start = esp_timer_get_time() + 1000000 / rate_hz;
+    for (size_t i = 0; i < count; i++) {
+        int64_t due = start + (int64_t)i * 1000000 / rate_hz;
+        if ((i + half_period / 2) % half_period == 0) {
+            while (esp_timer_get_time() < due - 500000 / rate_hz) {
+            }
+            gpio_set_level(emitter_pin, hal_emitter_on(i, half_period));
+        }
+        while (esp_timer_get_time() < due) {
+        }
+        int raw;
+        esp_err_t err = adc_convert(channel, &raw);
+        if (err != ESP_OK) {
+            gpio_set_level(emitter_pin, 0);
+            return err;
+        }
+        block[fill++] = (int16_t)raw;
+        if (fill == block_len) {
+            cb(block, fill, ctx);
+            fill = 0;
+        }
+    }
+    gpio_set_level(emitter_pin, 0);
+    if (fill > 0) {
+        cb(block, fill, ctx);
+    }
+    return ESP_OK;
+}
+
+// Scans run for as long as a capture lasts, so unlike the bursts above they
+// do not spin: a periodic esp_timer notifies the scanning task, which sleeps
+// in between. The notification count is the number of periods that passed,
+// so a task held up in cb sees at once how many scans it missed.
+static void scan_tick(void *arg) {
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+esp_err_t hal_adc_scan(const int *channels, size_t nch, uint32_t period_us, int16_t *block, size_t block_len,
+                       hal_adc_scan_cb_t cb, void *ctx) {
+    if (nch == 0 || period_us == 0 || block_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const esp_timer_create_args_t args = {
+        .callback = scan_tick,
+        .arg = xTaskGetCurrentTaskHandle(),
+        .name = "adc_scan",
+    };
+    esp_timer_handle_t timer;
+    esp_err_t err = esp_timer_create(&args, &timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ulTaskNotifyTake(pdTRUE, 0);
+    int64_t start = esp_timer_get_time();
+    err = esp_timer_start_periodic(timer, period_us);
+
+    uint32_t ticks = 0;
+    uint32_t first = 0;
+    size_t fill = 0;
+    bool more = true;
+    while (err == ESP_OK && more) {
+        uint32_t n = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period_us / 1000 + 100));
+        if (n == 0) {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        ticks += n;
+        if (n > 1 && fill > 0) {
+            more = cb(block, fill, first, start + (int64_t)(first + 1) * period_us, ctx);
+            fill = 0;
+            if (!more) {
+                break;
+            }
+        }
+        if (fill == 0) {
+            first = ticks - 1;
+        }
+        int16_t *scan = block + fill * nch;
+        esp_err_t conv = ESP_OK;
+        for (size_t c = 0; c < nch && conv == ESP_OK; c++) {
+            int raw;
+            conv = adc_convert(channels[c], &raw);
+            scan[c] = (int16_t)raw;
+        }
+        if (conv != ESP_OK) {
+            // A failed conversion costs this scan, not the capture: it is
+            // skipped like one missed in cb, so the block goes out short
+            if (fill > 0) {
+                more = cb(block, fill, first, start + (int64_t)(first + 1) * period_us, ctx);
+                fill = 0;
+            }
+            continue;
+        }
+        if (++fill == block_len) {
+            more = cb(block, fill, first, start + (int64_t)(first + 1) * period_us, ctx);
+            fill = 0;
+        }
+    }
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+    ulTaskNotifyTake(pdTRUE, 0);
+    return err;
+}
+
+// ========== 1-WIRE (bit-banged) ==========
+bool hal_onewire_reset(int pin) {
+    gpio_reset_pin(pin);
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+    ets_delay_us(480);
+    gpio_set_level(pin, 1);
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+    gpio_pullup_en(pin);
+    ets_delay_us(70);
+    int presence = gpio_get_level(pin);
+    ets_delay_us(410);
+    return (presence == 0);
+}
+
+bool hal_onewire_reset_timed(int pin, int *presence_us) {
+    gpio_reset_pin(pin);
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+    ets_delay_us(480);
+    gpio_set_level(pin, 1);
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+    gpio_pullup_en(pin);
+
+    // Sample through the whole 480 µs presence window: the device pulls
+    // low 15-60 µs after release and holds it for 60-240 µs
+    int64_t released = esp_timer_get_time();
+    int64_t low_at = -1, high_at = -1;
+    int64_t now;
+    while ((now = esp_timer_get_time()) - released < 480) {
+        int level = gpio_get_level(pin);
+        if (low_at < 0) {
+            if (level == 0) low_at = now;
+        } else if (high_at < 0 && level == 1) {
+            high_at = now;
+        }
+    }
+    *presence_us = low_at < 0 ? 0 : (int)((high_at < 0 ? now : high_at) - low_at);
+    return low_at >= 0;
+}
+
+void hal_onewire_write_bit(int pin, int bit) {
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+    ets_delay_us(bit ? 10 : 60);
+    gpio_set_level(pin, 1);
+    ets_delay_us(bit ? 55 : 5);
+}
+
+int hal_onewire_read_bit(int pin) {
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+    ets_delay_us(3);
+    gpio_set_level(pin, 1);
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+    ets_delay_us(10);
+    int bit = gpio_get_level(pin);
+    ets_delay_us(53);
+    return bit;
+}
+
+// ========== PULSE CAPTURE (RMT) ==========
+// The RMT receiver timestamps every edge at 1 µs resolution; the start pulse
+// is ended by an esp_timer callback. The pin is an open-drain output sharing
+// the RMT input, so releasing it (level 1) hands the line to the sensor.
+#define CAPTURE_SYMBOLS 64              // One symbol per low/high pair; a DHT22 frame is 42
+#define CAPTURE_IDLE_NS (200 * 1000)    // Line high this long ends the capture
+
+static rmt_channel_handle_t s_rx_chan;
+static int s_rx_pin = -1;
+static QueueHandle_t s_rx_done;
+static rmt_symbol_word_t s_rx_symbols[CAPTURE_SYMBOLS];
+static esp_timer_handle_t s_release_timer;
+static bool s_capture_armed;
+
+static bool IRAM_ATTR capture_done(rmt_channel_handle_t chan, const rmt_rx_done_event_data_t *edata,
+                                   void *ctx) {
+    BaseType_t woken = pdFALSE;
+    size_t symbols = edata->num_symbols;
+    xQueueSendFromISR(s_rx_done, &symbols, &woken);
+    return woken == pdTRUE;
+}
+
+// esp_timer task: arm the receiver, then let go of the line
+static void capture_release(void *arg) {
+    rmt_receive_config_t rx = {
+        .signal_range_min_ns = 1000,            // Glitch filter
+        .signal_range_max_ns = CAPTURE_IDLE_NS,
+    };
+    rmt_receive(s_rx_chan, s_rx_symbols, sizeof(s_rx_symbols), &rx);
+    gpio_set_level(s_rx_pin, 1);
+}
+
+static esp_err_t capture_init(int pin) {
+    if (s_rx_chan && s_rx_pin == pin) {
+        return ESP_OK;
+    }
+    if (s_rx_chan) {
+        rmt_disable(s_rx_chan);
+        rmt_del_channel(s_rx_chan);
+        s_rx_chan = NULL;
+    }
+    if (!s_rx_done) {
+        s_rx_done = xQueueCreate(1, sizeof(size_t));
+        esp_timer_create_args_t timer = { .callback = capture_release, .name = "pulse_release" };
+        if (!s_rx_done || esp_timer_create(&timer, &s_release_timer) != ESP_OK) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    rmt_rx_channel_config_t cfg = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = 1000000,
+        .mem_block_symbols = CAPTURE_SYMBOLS,
+    };
+    esp_err_t err = rmt_new_rx_channel(&cfg, &s_rx_chan);
+    if (err != ESP_OK) {
+        return err;
+    }
+    rmt_rx_event_callbacks_t cbs = { .on_recv_done = capture_done };
+    rmt_rx_register_event_callbacks(s_rx_chan, &cbs, NULL);
+    err = rmt_enable(s_rx_chan);
+    if (err != ESP_OK) {
+        rmt_del_channel(s_rx_chan);
+        s_rx_chan = NULL;
+        return err;
+    }
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_pullup_en(pin);
+    s_rx_pin = pin;
+    return ESP_OK;
+}
+
+esp_err_t hal_pulse_capture_start(int pin, uint32_t start_low_us) {
+    esp_err_t err = capture_init(pin);
+    if (err != ESP_OK) {
+        return err;
+    }
+    xQueueReset(s_rx_done);
+    gpio_set_level(pin, 0);
+    err = esp_timer_start_once(s_release_timer, start_low_us);
+    s_capture_armed = (err == ESP_OK);
+    return err;
+}
+
+esp_err_t hal_pulse_capture_wait(uint16_t *durations, size_t max, size_t *count, uint32_t timeout_ms) {
+    *count = 0;
+    if (!s_capture_armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_capture_armed = false;
+
+    size_t symbols = 0;
+    if (xQueueReceive(s_rx_done, &symbols, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        // Nothing ended the capture: cancel the pending receive
+        esp_timer_stop(s_release_timer);
+        gpio_set_level(s_rx_pin, 1);
+        rmt_disable(s_rx_chan);
+        rmt_enable(s_rx_chan);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    for (size_t i = 0; i < symbols && *count < max; i++) {
+        const rmt_symbol_word_t *sym = &s_rx_symbols[i];
+        uint16_t duration[2] = { sym->duration0, sym->duration1 };
+        int level[2] = { sym->level0, sym->level1 };
+        for (int k = 0; k < 2 && *count < max; k++) {
+            if (duration[k] == 0) {
+                break;                  // End marker
+            }
+            if (*count == 0 && level[k] == 1) {
+                continue;               // Idle high before the first low
+            }
+            durations[(*count)++] = duration[k];
+        }
+    }
+    return ESP_OK;
+}
+
+// ========== PULSE COUNTERS (PCNT) ==========
+// Each counted pin has a unit of its own. The 16-bit counter clears itself
+// at PCNT_HIGH_LIMIT; with accum_count the driver adds the span to its own
+// total in the watch point's interrupt, and pcnt_unit_get_count() returns
+// total and counter together under the driver's lock. So the CPU sees one
+// interrupt per PCNT_HIGH_LIMIT pulses, and a read cannot pair a cleared
+// counter with the total from before the clear.
+#define PCNT_UNITS 4
+#define PCNT_HIGH_LIMIT 32767
+#define PCNT_GLITCH_NS 10000            // Contact bounce on reed and Hall meters
+
+typedef struct {
+    int pin;
+    pcnt_unit_handle_t unit;
+} pulse_counter_t;
+
+static pulse_counter_t s_counters[PCNT_UNITS] = {
+    { .pin = -1 }, { .pin = -1 }, { .pin = -1 }, { .pin = -1 },
+};
+
+static pulse_counter_t *counter_for(int pin) {
+    for (int i = 0; i < PCNT_UNITS; i++) {
+        if (s_counters[i].pin == pin) {
+            return &s_counters[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t hal_pulse_count_start(int pin) {
+    if (counter_for(pin)) {
+        return ESP_OK;
+    }
+    pulse_counter_t *pc = counter_for(-1);
+    if (!pc) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    pcnt_unit_config_t cfg = {
+        .low_limit = -1,
+        .high_limit = PCNT_HIGH_LIMIT,
+        .flags.accum_count = 1,
+    };
+    esp_err_t err = pcnt_new_unit(&cfg, &pc->unit);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pcnt_glitch_filter_config_t filter = { .max_glitch_ns = PCNT_GLITCH_NS };
+    pcnt_chan_config_t chan_cfg = { .edge_gpio_num = pin, .level_gpio_num = -1 };
+    pcnt_channel_handle_t chan = NULL;
+    err = pcnt_unit_set_glitch_filter(pc->unit, &filter);
+    if (err == ESP_OK) err = pcnt_new_channel(pc->unit, &chan_cfg, &chan);
+    if (err == ESP_OK) err = pcnt_channel_set_edge_action(chan, PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                                                          PCNT_CHANNEL_EDGE_ACTION_HOLD);
+    if (err == ESP_OK) err = pcnt_unit_add_watch_point(pc->unit, PCNT_HIGH_LIMIT);
+    if (err == ESP_OK) err = pcnt_unit_enable(pc->unit);
+    if (err == ESP_OK) err = pcnt_unit_clear_count(pc->unit);
+    if (err == ESP_OK) err = pcnt_unit_start(pc->unit);
+    if (err != ESP_OK) {
+        if (chan) pcnt_del_channel(chan);
+        pcnt_unit_disable(pc->unit);
+        pcnt_del_unit(pc->unit);
+        pc->unit = NULL;
+        return err;
+    }
+    gpio_pullup_en(pin);                // Open-collector meter outputs
+    pc->pin = pin;
+    return ESP_OK;
+}
+
+esp_err_t hal_pulse_count_read(int pin, uint32_t *count) {
+    pulse_counter_t *pc = pin >= 0 ? counter_for(pin) : NULL;
+    if (!pc) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int value;
+    esp_err_t err = pcnt_unit_get_count(pc->unit, &value);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *count = (uint32_t)value;
+    return ESP_OK;
+}
+
+// ========== ASYNC EVENTS ==========
+#define EVENT_QUEUE_LEN 16
+
+static QueueHandle_t s_events;
+
+static esp_err_t events_init(void) {
+    if (!s_events) {
+        s_events = xQueueCreate(EVENT_QUEUE_LEN, sizeof(hal_event_t));
+    }
+    return s_events ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t hal_event_wait(hal_event_t *evt, uint32_t timeout_ms) {
+    if (!s_events || xQueueReceive(s_events, evt, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void IRAM_ATTR gpio_falling_isr(void *arg) {
+    hal_event_t evt = { .type = HAL_EVENT_GPIO_FALLING, .pin = (int)(intptr_t)arg };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(s_events, &evt, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+esp_err_t hal_gpio_falling_enable(int pin) {
+    esp_err_t err = events_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    gpio_config_t cfg = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    err = gpio_config(&cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {     // Already installed
+        return err;
+    }
+    gpio_isr_handler_remove(pin);
+    return gpio_isr_handler_add(pin, gpio_falling_isr, (void *)(intptr_t)pin);
+}
+
+// ========== I2C ==========
+// New master driver in asynchronous mode: transfers are queued and report
+// completion from the ISR. The bus runs them in order, so completions are
+// matched to tags with one FIFO.
+#define I2C_QUEUE_DEPTH 8
+#define I2C_MAX_DEVICES 8
+
+static i2c_master_bus_handle_t s_i2c_bus;
+static uint32_t s_i2c_freq;
+static struct {
+    uint8_t addr;
+    i2c_master_dev_handle_t handle;
+} s_i2c_devs[I2C_MAX_DEVICES];
+static int s_i2c_dev_count;
+static void *s_i2c_tags[I2C_QUEUE_DEPTH];
+static volatile unsigned s_i2c_head;        // Next completion
+static volatile unsigned s_i2c_tail;        // Next submission
+
+static bool IRAM_ATTR i2c_done_isr(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *edata,
+                                   void *arg) {
+    if (edata->event == I2C_EVENT_ALIVE) {
+        return false;
+    }
+    hal_event_t evt = {
+        .type = HAL_EVENT_I2C_DONE,
+        .err = edata->event == I2C_EVENT_DONE ? ESP_OK : ESP_FAIL,
+        .tag = s_i2c_tags[s_i2c_head % I2C_QUEUE_DEPTH],
+    };
+    s_i2c_head++;
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(s_events, &evt, &woken);
+    return woken == pdTRUE;
+}
+
+esp_err_t hal_i2c_init(int sda_pin, int scl_pin, uint32_t freq_hz) {
+    if (s_i2c_bus) {
+        return ESP_OK;
+    }
+    esp_err_t err = events_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2c_master_bus_config_t cfg = {
+        .i2c_port = -1,                     // Any free controller
+        .sda_io_num = sda_pin,
+        .scl_io_num = scl_pin,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2C_QUEUE_DEPTH,
+        .flags.enable_internal_pullup = true,
+    };
+    err = i2c_new_master_bus(&cfg, &s_i2c_bus);
+    s_i2c_freq = freq_hz;
+    return err;
+}
+
+static i2c_master_dev_handle_t i2c_device(uint8_t addr) {
+    for (int i = 0; i < s_i2c_dev_count; i++) {
+        if (s_i2c_devs[i].addr == addr) {
+            return s_i2c_devs[i].handle;
+        }
+    }
+    if (s_i2c_dev_count == I2C_MAX_DEVICES) {
+        return NULL;
+    }
+    i2c_device_config_t cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = addr,
+        .scl_speed_hz = s_i2c_freq,
+    };
+    i2c_master_dev_handle_t handle;
+    if (i2c_master_bus_add_device(s_i2c_bus, &cfg, &handle) != ESP_OK) {
+        return NULL;
+    }
+    i2c_master_event_callbacks_t cbs = { .on_trans_done = i2c_done_isr };
+    i2c_master_register_event_callbacks(handle, &cbs, NULL);
+    s_i2c_devs[s_i2c_dev_count].addr = addr;
+    s_i2c_devs[s_i2c_dev_count].handle = handle;
+    s_i2c_dev_count++;
+    return handle;
+}
+
+esp_err_t hal_i2c_submit(uint8_t addr, const uint8_t *wbuf, size_t wlen,
+                         uint8_t *rbuf, size_t rlen, void *tag) {
+    if (!s_i2c_bus) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_i2c_tail - s_i2c_head >= I2C_QUEUE_DEPTH) {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_dev_handle_t dev = i2c_device(addr);
+    if (!dev) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_i2c_tags[s_i2c_tail % I2C_QUEUE_DEPTH] = tag;
+    s_i2c_tail++;
+    esp_err_t err;
+    if (wlen && rlen) {
+        err = i2c_master_transmit_receive(dev, wbuf, wlen, rbuf, rlen, -1);
+    } else if (rlen) {
+        err = i2c_master_receive(dev, rbuf, rlen, -1);
+    } else {
+        err = i2c_master_transmit(dev, wbuf, wlen, -1);
+    }
+    if (err != ESP_OK) {
+        s_i2c_tail--;           // Not queued: no completion will follow
+    }
+    return err;
+}
+
+// ========== CLOCK ==========
+int64_t hal_time_us(void) {
+    return esp_timer_get_time();
+}
+
+void hal_delay_ms(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void hal_delay_us(uint32_t us) {
+    ets_delay_us(us);
+}
+
+void hal_watchdog_feed(void) {
+    esp_task_wdt_reset();
+}
+
+// The callback runs in the lwIP task right after the reply is applied; the
+// pair it records is handed over under a spinlock.
+static portMUX_TYPE s_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_sync_new;
+static int64_t s_sync_unix_us, s_sync_mono_us;
+
+static void time_sync_cb(struct timeval *tv) {
+    int64_t mono = esp_timer_get_time();
+    portENTER_CRITICAL(&s_sync_lock);
+    s_sync_unix_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    s_sync_mono_us = mono;
+    s_sync_new = true;
+    portEXIT_CRITICAL(&s_sync_lock);
+}
+
+esp_err_t hal_time_sync_start(const char *server, uint32_t interval_s) {
+    static bool started;
+    if (started) {
+        return ESP_OK;
+    }
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(server);
+    config.sync_cb = time_sync_cb;
+    sntp_set_sync_interval(interval_s * 1000);
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err == ESP_OK) {
+        started = true;
+    }
+    return err;
+}
+
+bool hal_time_sync_poll(int64_t *unix_us, int64_t *mono_us) {
+    portENTER_CRITICAL(&s_sync_lock);
+    bool fresh = s_sync_new;
+    *unix_us = s_sync_unix_us;
+    *mono_us = s_sync_mono_us;
+    s_sync_new = false;
+    portEXIT_CRITICAL(&s_sync_lock);
+    return fresh;
+}
+
+// ========== HTTP TRANSPORT ==========
+bool hal_net_ensure_connected(void) {
+    // Check WiFi connection status directly
+    wifi_ap_record_t ap_info;
+    esp_err_t wifi_status = esp_wifi_sta_get_ap_info(&ap_info);
+
+    if (wifi_status == ESP_OK) {
+        return true;
+    }
+
+    ESP_LOGW(TAG, "WiFi not connected, attempting reconnection...");
+
+    // Try to reconnect
+    for (int attempt = 0; attempt < 3; attempt++) {
+        esp_wifi_connect();
+        vTaskDelay(pdMS_TO_TICKS(5000));
+
+        wifi_status = esp_wifi_sta_get_ap_info(&ap_info);
+        if (wifi_status == ESP_OK) {
+            ESP_LOGI(TAG, "WiFi reconnected successfully");
+            return true;
+        }
+        ESP_LOGW(TAG, "Reconnection attempt %d/3 failed", attempt + 1);
+    }
+
+    ESP_LOGE(TAG, "WiFi connection failed after 3 attempts");
+    return false;
+}
+
+static esp_err_t apply_tls(esp_http_client_config_t *config, hal_tls_mode_t tls) {
+    if (tls == HAL_TLS_CRT_BUNDLE) {
+        config->crt_bundle_attach = esp_crt_bundle_attach;
+        config->skip_cert_common_name_check = true;
+        config->keep_alive_enable = false;
+        return ESP_OK;
+    }
+    if (ca_store_init() != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    config->use_global_ca_store = true;
+    config->skip_cert_common_name_check = false;
+    return ESP_OK;
+}
+
+esp_err_t hal_http_perform(const hal_http_request_t *req, hal_http_response_t *resp) {
+    esp_http_client_config_t config = {
+        .url = req->url,
+        .method = req->method == HAL_HTTP_POST ? HTTP_METHOD_POST : HTTP_METHOD_GET,
+        .timeout_ms = req->timeout_ms,
+        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .buffer_size = 2048,
+        .buffer_size_tx = 1024
+    };
+
+    if (apply_tls(&config, req->tls) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    resp->status = 0;
+    resp->body_len = 0;
+    if (resp->body && resp->body_size > 0) {
+        resp->body[0] = '\0';
+    }
+
+    int64_t setup_start = esp_timer_get_time();
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP client");
+        return ESP_FAIL;
+    }
+
+    for (size_t i = 0; i < req->header_count; i++) {
+        esp_http_client_set_header(client, req->headers[i].name, req->headers[i].value);
+    }
+
+    size_t body_len = req->body ? req->body_len : 0;
+    esp_err_t err = esp_http_client_open(client, body_len);
+    if (err == ESP_OK && req->tls == HAL_TLS_CA_STORE) {
+        ca_store_record_setup(esp_timer_get_time() - setup_start);
+    }
+    if (err == ESP_OK && body_len > 0) {
+        if (esp_http_client_write(client, req->body, body_len) != (int)body_len) {
+            err = ESP_FAIL;
+        }
+    }
+    if (err == ESP_OK && esp_http_client_fetch_headers(client) < 0) {
+        err = ESP_FAIL;
+    }
+
+    if (err == ESP_OK) {
+        resp->status = esp_http_client_get_status_code(client);
+        if (resp->body && resp->body_size > 1) {
+            int data_read = esp_http_client_read_response(client, resp->body, resp->body_size - 1);
+            if (data_read > 0) {
+                resp->body_len = data_read;
+                resp->body[data_read] = '\0';
+            }
+        }
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+struct hal_http_download {
+    esp_http_client_handle_t client;
+};
+
+hal_http_download_t *hal_http_download_open(const char *url, hal_tls_mode_t tls, int timeout_ms,
+                                            int *status, int *content_length) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .timeout_ms = timeout_ms,
+        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .buffer_size = 2048,
+        .buffer_size_tx = 1024
+    };
+    if (apply_tls(&config, tls) != ESP_OK) {
+        return NULL;
+    }
+
+    hal_http_download_t *dl = calloc(1, sizeof(*dl));
+    if (!dl) {
+        return NULL;
+    }
+    dl->client = esp_http_client_init(&config);
+    if (!dl->client || esp_http_client_open(dl->client, 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Download of %s failed to connect", url);
+        hal_http_download_close(dl);
+        return NULL;
+    }
+    int64_t length = esp_http_client_fetch_headers(dl->client);
+    if (length < 0) {
+        hal_http_download_close(dl);
+        return NULL;
+    }
+    *status = esp_http_client_get_status_code(dl->client);
+    *content_length = esp_http_client_is_chunked_response(dl->client) ? -1 : (int)length;
+    return dl;
+}
+
+int hal_http_download_read(hal_http_download_t *dl, void *buf, size_t size) {
+    return esp_http_client_read(dl->client, buf, (int)size);
+}
+
+void hal_http_download_close(hal_http_download_t *dl) {
+    if (!dl) {
+        return;
+    }
+    if (dl->client) {
+        esp_http_client_close(dl->client);
+        esp_http_client_cleanup(dl->client);
+    }
+    free(dl);
+}
+
+// ========== STREAM TRANSPORT ==========
+// Client streams go through esp_transport; accepted ones are bare sockets,
+// and the USB port goes through the USB-Serial-JTAG driver
+struct hal_stream {
+    esp_transport_handle_t transport;
+    int fd;                         // Accepted socket, -1 for a transport
+    bool usb;                       // The native USB port (no transport, no socket)
+};
+
+#define HAL_USB_TX_BUFFER 8192      // About 0.25 s of a full-rate capture
+#define HAL_USB_RX_BUFFER 256       // Command lines
+
+static bool s_usb_installed;
+static bool s_usb_open;
+
+// Wait until fd can be read (or written); 1 ready, 0 timeout, -1 error
+static int socket_wait(int fd, bool for_write, int timeout_ms) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    int n = select(fd + 1, for_write ? NULL : &set, for_write ? &set : NULL, NULL, &tv);
+    return n < 0 ? -1 : n;
+}
+
+hal_stream_t *hal_stream_open(const char *host, int port, hal_tls_mode_t tls, int timeout_ms) {
+    hal_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->fd = -1;
+
+    if (tls == HAL_TLS_NONE) {
+        stream->transport = esp_transport_tcp_init();
+    } else {
+        stream->transport = esp_transport_ssl_init();
+        if (stream->transport && tls == HAL_TLS_CRT_BUNDLE) {
+            esp_transport_ssl_crt_bundle_attach(stream->transport, esp_crt_bundle_attach);
+        } else if (stream->transport) {
+            if (ca_store_init() != ESP_OK) {
+                esp_transport_destroy(stream->transport);
+                free(stream);
+                return NULL;
+            }
+            esp_transport_ssl_enable_global_ca_store(stream->transport);
+        }
+    }
+    if (!stream->transport) {
+        free(stream);
+        return NULL;
+    }
+
+    if (esp_transport_connect(stream->transport, host, port, timeout_ms) < 0) {
+        ESP_LOGW(TAG, "Stream connect to %s:%d failed", host, port);
+        esp_transport_destroy(stream->transport);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+int hal_stream_write(hal_stream_t *stream, const void *data, size_t len, int timeout_ms) {
+    const char *p = data;
+    size_t left = len;
+    while (left > 0) {
+        int n;
+        if (stream->usb) {
+            n = usb_serial_jtag_write_bytes(p, left, pdMS_TO_TICKS(timeout_ms));
+        } else if (stream->fd >= 0) {
+            n = socket_wait(stream->fd, true, timeout_ms) > 0 ? send(stream->fd, p, left, 0) : -1;
+        } else {
+            n = esp_transport_write(stream->transport, p, (int)left, timeout_ms);
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    return (int)len;
+}
+
+int hal_stream_read(hal_stream_t *stream, void *buf, size_t size, int timeout_ms) {
+    if (stream->usb) {
+        return usb_serial_jtag_read_bytes(buf, (uint32_t)size, pdMS_TO_TICKS(timeout_ms));
+    }
+    if (stream->fd >= 0) {
+        int ready = socket_wait(stream->fd, false, timeout_ms);
+        if (ready <= 0) {
+            return ready;
+        }
+        int n = recv(stream->fd, buf, size, 0);
+        return n > 0 ? n : -1;
+    }
+    int n = esp_transport_read(stream->transport, buf, (int)size, timeout_ms);
+    if (n == ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT) {
+        return 0;
+    }
+    return n > 0 ? n : -1;
+}
+
+void hal_stream_close(hal_stream_t *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->usb) {
+        s_usb_open = false;         // The driver stays installed for the next open
+    } else if (stream->fd >= 0) {
+        close(stream->fd);
+    } else {
+        esp_transport_close(stream->transport);
+        esp_transport_destroy(stream->transport);
+    }
+    free(stream);
+}
+
+hal_stream_t *hal_http_stream_open(const char *url, hal_tls_mode_t tls, int timeout_ms) {
+    bool https = strncmp(url, "https://", 8) == 0;
+    const char *host = url + (https ? 8 : strncmp(url, "http://", 7) == 0 ? 7 : 0);
+    size_t host_len = strcspn(host, ":/?");
+    char name[128];
+    if (host_len == 0 || host_len >= sizeof(name)) {
+        return NULL;
+    }
+    memcpy(name, host, host_len);
+    name[host_len] = '\0';
+
+    int port = https ? 443 : 80;
+    if (host[host_len] == ':') {
+        port = atoi(host + host_len + 1);
+    }
+    return hal_stream_open(name, port, https ? tls : HAL_TLS_NONE, timeout_ms);
+}
+
+// The S3's USB-Serial-JTAG controller enumerates as a CDC-ACM port. The
+// stream needs it to itself, so the console must be on UART0 with no
+// secondary output (sdkconfig.defaults); the build refuses otherwise. Writes
+// copy into the driver's TX ring buffer and only wait when the host falls
+// behind.
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG
+#error "The USB-Serial-JTAG port carries the ADC stream; keep the console off it"
+#endif
+hal_stream_t *hal_usb_cdc_open(void) {
+    if (s_usb_open) {
+        return NULL;
+    }
+    if (!s_usb_installed) {
+        usb_serial_jtag_driver_config_t cfg = {
+            .tx_buffer_size = HAL_USB_TX_BUFFER,
+            .rx_buffer_size = HAL_USB_RX_BUFFER,
+        };
+        esp_err_t err = usb_serial_jtag_driver_install(&cfg);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "USB serial driver: %s", esp_err_to_name(err));
+            return NULL;
+        }
+        s_usb_installed = true;
+    }
+    hal_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->fd = -1;
+    stream->usb = true;
+    s_usb_open = true;
+    return stream;
+}
+
+// ========== STREAM SERVER ==========
+struct hal_listener {
+    int fd;
+    int port;
+};
+
+hal_listener_t *hal_listener_open(int port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port),
+                                .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        ESP_LOGW(TAG, "Listen on port %d failed: errno %d", port, errno);
+        close(fd);
+        return NULL;
+    }
+
+    hal_listener_t *listener = calloc(1, sizeof(*listener));
+    if (!listener) {
+        close(fd);
+        return NULL;
+    }
+    listener->fd = fd;
+    listener->port = ntohs(addr.sin_port);
+    return listener;
+}
+
+int hal_listener_port(const hal_listener_t *listener) {
+    return listener->port;
+}
+
+hal_stream_t *hal_listener_accept(hal_listener_t *listener, int timeout_ms) {
+    if (socket_wait(listener->fd, false, timeout_ms) <= 0) {
+        return NULL;
+    }
+    int fd = accept(listener->fd, NULL, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Short request/response exchanges: do not let Nagle hold replies back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    hal_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    return stream;
+}
+
+void hal_listener_close(hal_listener_t *listener) {
+    if (!listener) {
+        return;
+    }
+    close(listener->fd);
+    free(listener);
+}
+
+// ========== TASKS ==========
+typedef struct {
+    hal_task_fn_t fn;
+    void *arg;
+} task_start_t;
+
+static void task_entry(void *p) {
+    task_start_t start = *(task_start_t *)p;
+    free(p);
+    start.fn(start.arg);
+    vTaskDelete(NULL);
+}
+
+esp_err_t hal_task_start(const char *name, hal_task_fn_t fn, void *arg, uint32_t stack_bytes, int priority) {
+    task_start_t *start = malloc(sizeof(*start));
+    if (!start) {
+        return ESP_ERR_NO_MEM;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    if (xTaskCreate(task_entry, name, stack_bytes, start, (UBaseType_t)priority, NULL) != pdPASS) {
+        free(start);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ========== FIRMWARE SLOTS ==========
+static const esp_partition_t *s_ota_target;
+static esp_ota_handle_t s_ota_handle;
+
+esp_err_t hal_ota_begin(size_t image_size) {
+    s_ota_target = esp_ota_get_next_update_partition(NULL);
+    if (!s_ota_target) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size > s_ota_target->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Erase sector by sector as data arrives instead of stalling the download up front
+    return esp_ota_begin(s_ota_target, OTA_WITH_SEQUENTIAL_WRITES, &s_ota_handle);
+}
+
+esp_err_t hal_ota_write(const void *data, size_t len) {
+    return esp_ota_write(s_ota_handle, data, len);
+}
+
+esp_err_t hal_ota_end(void) {
+    esp_err_t err = esp_ota_end(s_ota_handle);
+    s_ota_handle = 0;
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(s_ota_target);
+    }
+    return err;
+}
+
+void hal_ota_abort(void) {
+    if (s_ota_handle) {
+        esp_ota_abort(s_ota_handle);
+        s_ota_handle = 0;
+    }
+}
+
+esp_err_t hal_ota_read_running(size_t offset, void *buf, size_t len) {
+    return esp_partition_read(esp_ota_get_running_partition(), offset, buf, len);
+}
+
+size_t hal_ota_slot_size(void) {
+    return esp_ota_get_running_partition()->size;
+}
+
+bool hal_ota_pending_verify(void) {
+    esp_ota_img_states_t state;
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+void hal_ota_mark_valid(void) {
+    esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void hal_ota_rollback(void) {
+    // Only returns if there is no valid image to go back to
+    esp_err_t err = esp_ota_mark_app_invalid_rollback_and_reboot();
+    ESP_LOGE(TAG, "Rollback failed: %s", esp_err_to_name(err));
+}
+
+void hal_restart(void) {
+    esp_restart();
+}
+
+// ========== SETTINGS STORE ==========
+#define SETTINGS_NAMESPACE "aqua"
+
+esp_err_t hal_settings_get(const char *key, void *buf, size_t *len) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;   // Namespace not created yet
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(nvs, key, buf, len);
+    nvs_close(nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return err == ESP_ERR_NVS_INVALID_LENGTH ? ESP_ERR_INVALID_SIZE : err;
+}
+
+esp_err_t hal_settings_set(const char *key, const void *data, size_t len) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, key, data, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
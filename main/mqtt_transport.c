@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_log.h"
+#include "hal.h"
+#include "mqtt_transport.h"
+#include "supabase.h"
+
+#define TELEMETRY_TOPIC "aqua/" AQUA_DEVICE_ID "/telemetry"
+#define RELAY_TOPIC "aqua/" AQUA_DEVICE_ID "/relay"
+
+static aqua_mqtt_client_t client;
+static bool initialized;
+
+static void on_message(const char *topic, const char *payload, size_t len, void *ctx) {
+    (void)len;
+    (void)ctx;
+
+    if (strcmp(topic, RELAY_TOPIC) != 0) {
+        return;
+    }
+    AQUA_LOG(MQTT_COMMAND, payload);
+    if (aqua_parse_relay_commands(payload, apply_relay_command, NULL) < 0) {
+        AQUA_LOG(MQTT_COMMAND_INVALID);
+    }
+}
+
+aqua_mqtt_client_t *mqtt_transport_client(void) {
+    return &client;
+}
+
+bool mqtt_transport_start(void) {
+    if (!initialized) {
+        aqua_mqtt_config_t cfg = {
+            .host = MQTT_BROKER_HOST,
+            .port = MQTT_BROKER_PORT,
+            .tls = HAL_TLS_CRT_BUNDLE,
+            .client_id = AQUA_DEVICE_ID,
+            .username = MQTT_USERNAME,
+            .password = MQTT_PASSWORD,
+            .keepalive_s = MQTT_KEEPALIVE_S,
+            .clean_session = false,
+            .inflight_window = MQTT_INFLIGHT_WINDOW,
+            .ack_timeout_ms = MQTT_ACK_TIMEOUT_MS,
+            .on_message = on_message,
+        };
+        aqua_mqtt_init(&client, &cfg);
+        initialized = true;
+    }
+    if (client.connected) {
+        return true;
+    }
+    if (!hal_net_ensure_connected()) {
+        return false;
+    }
+
+    esp_err_t err = aqua_mqtt_connect(&client, 10000);
+    if (err != ESP_OK) {
+        AQUA_LOG(MQTT_CONNECT_FAILED, esp_err_to_name(err));
+        return false;
+    }
+    AQUA_LOG(MQTT_CONNECTED, MQTT_BROKER_HOST, MQTT_BROKER_PORT,
+             client.session_present ? "resumed" : "new");
+
+    // A resumed session still holds the subscription
+    if (!client.session_present) {
+        err = aqua_mqtt_subscribe(&client, RELAY_TOPIC, 1, 10000);
+        if (err != ESP_OK) {
+            AQUA_LOG(MQTT_CONNECT_FAILED, esp_err_to_name(err));
+            aqua_mqtt_disconnect(&client);
+            return false;
+        }
+        AQUA_LOG(MQTT_SUBSCRIBED, RELAY_TOPIC);
+    }
+    return true;
+}
+
+bool mqtt_process_commands(void) {
+    if (!mqtt_transport_start()) {
+        return false;
+    }
+    if (aqua_mqtt_poll(&client, 0) != ESP_OK) {
+        AQUA_LOG(MQTT_LINK_LOST);
+        return false;
+    }
+    return true;
+}
+
+bool mqtt_send_reading(const aqua_reading_t *reading, const aqua_controls_t *controls) {
+    if (!aqua_validate_reading(reading)) {
+        AQUA_LOG(UPLOAD_INVALID);
+        return false;
+    }
+
+    char json[896];
+    int json_len = aqua_build_payload(reading, controls, json, sizeof(json));
+    if (json_len < 0) {
+        AQUA_LOG(UPLOAD_TOO_LARGE, (int)sizeof(json));
+        return false;
+    }
+
+    report_missing_sensors(reading);
+
+    if (!mqtt_transport_start()) {
+        return false;
+    }
+
+    esp_err_t err = aqua_mqtt_publish(&client, TELEMETRY_TOPIC, json, (size_t)json_len, 1, MQTT_ACK_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        AQUA_LOG(MQTT_PUBLISH_FAILED, esp_err_to_name(err));
+        return false;
+    }
+    AQUA_LOG(MQTT_PUBLISHED, json_len, TELEMETRY_TOPIC, aqua_mqtt_inflight(&client));
+
+    // Collect acknowledgements that are already waiting
+    if (aqua_mqtt_poll(&client, 0) != ESP_OK) {
+        AQUA_LOG(MQTT_LINK_LOST);
+    }
+    return true;
+}
+
+void mqtt_transport_stop(void) {
+    if (initialized) {
+        aqua_mqtt_disconnect(&client);
+    }
+}
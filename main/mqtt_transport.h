@@ -0,0 +1,41 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <stdbool.h>
+#include "aqua_core.h"
+#include "aqua_mqtt.h"
+
+// Telemetry and relay commands over one persistent MQTT session.
+//
+// Readings are published with QoS 1 to aqua/<AQUA_DEVICE_ID>/telemetry using
+// the same JSON body as the REST upload. Relay commands arrive on
+// aqua/<AQUA_DEVICE_ID>/relay in the relay_commands format
+// ([{"relay_type":"ph","state":true},...]) and are applied as they are
+// received; the broker queues them while the device is offline.
+
+/**
+ * @brief Connect (if needed) and subscribe to the relay topic
+ * @return true when the session is up
+ */
+bool mqtt_transport_start(void);
+
+/**
+ * @brief Handle queued relay commands and acknowledgements without blocking
+ * @return false if the session is down and could not be re-established
+ */
+bool mqtt_process_commands(void);
+
+/**
+ * @brief Validate and publish one reading (QoS 1, does not wait for the ack)
+ * @return true once the message is queued in the in-flight window
+ */
+bool mqtt_send_reading(const aqua_reading_t *reading, const aqua_controls_t *controls);
+
+/**
+ * @brief Disconnect; unacknowledged readings are kept for the next session
+ */
+void mqtt_transport_stop(void);
+
+aqua_mqtt_client_t *mqtt_transport_client(void);
+
+#endif // MQTT_TRANSPORT_H
@@ -1,42 +1,38 @@
-#include <stdio.h>
-#include <string.h>
+#include <stdlib.h>
 #include "esp_log.h"
+#include "ca_der.h"
 #include "cert_manager.h"
+#include "provision_certs.h"
 
 static const char *TAG = "provision_certs";
 
-esp_err_t provision_certificates(void) {
-    ESP_LOGI(TAG, "Using embedded certificates");
-    
-    // Declare external embedded certificate data
-    extern const uint8_t server_cert_pem_start[] asm("_binary_server_cert_pem_start");
-    extern const uint8_t server_cert_pem_end[]   asm("_binary_server_cert_pem_end");
-    extern const uint8_t isrg_root_x1_pem_start[] asm("_binary_isrg_root_x1_pem_start");
-    extern const uint8_t isrg_root_x1_pem_end[]   asm("_binary_isrg_root_x1_pem_end");
-    
-    // Initialize the certificate manager
-    esp_err_t ret = init_cert_manager();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize certificate manager");
-        return ret;
+#define PROVISION_MAX_BUNDLE 4096   // Must fit CA_STORE_NVS_MAX in ca_store.c
+
+esp_err_t provision_certificates(const char *pem, size_t pem_len) {
+    uint8_t *bundle = malloc(PROVISION_MAX_BUNDLE);
+    if (!bundle) {
+        return ESP_ERR_NO_MEM;
     }
-    
-    // Store server certificate
-    size_t server_cert_len = server_cert_pem_end - server_cert_pem_start;
-    ret = store_certificate("server_cert", (const char*)server_cert_pem_start, server_cert_len);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to store server certificate");
-        return ret;
+
+    size_t bundle_len = 0;
+    int count = ca_der_import_pem(pem, pem_len, bundle, PROVISION_MAX_BUNDLE, &bundle_len);
+    if (count <= 0) {
+        ESP_LOGE(TAG, "No valid certificates in PEM input");
+        free(bundle);
+        return ESP_ERR_INVALID_ARG;
     }
-    
-    // Store root certificate
-    size_t root_cert_len = isrg_root_x1_pem_end - isrg_root_x1_pem_start;
-    ret = store_certificate("root_cert", (const char*)isrg_root_x1_pem_start, root_cert_len);
+
+    esp_err_t ret = init_cert_manager();
+    if (ret == ESP_OK) {
+        ret = store_certificate("ca_der", (const char *)bundle, bundle_len);
+    }
+    free(bundle);
+
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to store root certificate");
+        ESP_LOGE(TAG, "Failed to store trust anchors");
         return ret;
     }
-    
-    ESP_LOGI(TAG, "All certificates provisioned successfully");
+    ESP_LOGI(TAG, "Provisioned %d trust anchor(s): %u B DER from %u B PEM (active after reboot)",
+             count, (unsigned)bundle_len, (unsigned)pem_len);
     return ESP_OK;
 }
@@ -1,16 +1,20 @@
 #ifndef PROVISION_CERTS_H
 #define PROVISION_CERTS_H
 
+#include <stddef.h>
 #include "esp_err.h"
 
 /**
- * @brief Load certificates from files and store them in secure storage
+ * @brief Replace the built-in TLS trust anchors with the given PEM roots
  *
- * This function reads certificates from the ../certificates directory
- * and stores them securely using the certificate manager.
+ * The PEM text is converted once to a compact DER bundle and stored in NVS,
+ * where ca_store_init() picks it up on the next boot. PEM is only the import
+ * format; nothing parses it at connection time.
  *
- * @return ESP_OK on success
+ * @param pem One or more PEM CERTIFICATE blocks
+ * @param pem_len Length of pem
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if no certificate could be decoded
  */
-esp_err_t provision_certificates(void);
+esp_err_t provision_certificates(const char *pem, size_t pem_len);
 
 #endif // PROVISION_CERTS_H
@@ -0,0 +1,687 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_dsp.h"
+#include "aqua_health.h"
+#include "aqua_log.h"
+#include "aqua_registry.h"
+#include "aqua_xadc.h"
+#include "hal.h"
+#include "sensors.h"
+
+// ========== HEALTH ==========
+static const aqua_health_limits_t health_limits[AQUA_SENSOR_COUNT] = {
+    [AQUA_SENSOR_DHT22] = { .stuck_reads = HEALTH_STUCK_READS_DHT22 },
+    [AQUA_SENSOR_DS18B20] = { .stuck_reads = HEALTH_STUCK_READS_DS18B20,
+                              .presence_min_us = HEALTH_PRESENCE_MIN_US,
+                              .presence_max_us = HEALTH_PRESENCE_MAX_US },
+    [AQUA_SENSOR_PH] = { .stuck_reads = HEALTH_STUCK_READS_ANALOG, .noise_limit = HEALTH_ADC_NOISE_MV },
+    [AQUA_SENSOR_DO] = { .stuck_reads = HEALTH_STUCK_READS_ANALOG, .noise_limit = HEALTH_ADC_NOISE_MV },
+    [AQUA_SENSOR_TURBIDITY] = { .stuck_reads = HEALTH_STUCK_READS_ANALOG, .noise_limit = HEALTH_ADC_NOISE_MV },
+    [AQUA_SENSOR_AMMONIA] = { .stuck_reads = HEALTH_STUCK_READS_ANALOG, .noise_limit = HEALTH_ADC_NOISE_MV },
+};
+
+static const char *const health_labels[AQUA_SENSOR_COUNT] = {
+    "DHT22", "DS18B20", "pH", "DO", "Turbidity", "Ammonia"
+};
+
+static aqua_health_t s_health[AQUA_SENSOR_COUNT];
+static bool s_degraded[AQUA_SENSOR_COUNT];
+static bool s_health_ready;
+static uint32_t s_reads_since_diag;
+static int s_diag_runs;
+
+void sensor_health_reset(void) {
+    for (int i = 0; i < AQUA_SENSOR_COUNT; i++) {
+        aqua_health_init(&s_health[i], &health_limits[i]);
+        s_degraded[i] = false;
+    }
+    s_reads_since_diag = HEALTH_DIAG_MIN_READS;    // First degradation diagnoses at once
+    s_diag_runs = 0;
+    s_health_ready = true;
+}
+
+static aqua_health_t *health(aqua_sensor_t sensor) {
+    if (!s_health_ready) {
+        sensor_health_reset();
+    }
+    return &s_health[sensor];
+}
+
+static void health_record(aqua_sensor_t sensor, aqua_read_status_t status, float value) {
+    aqua_health_t *h = health(sensor);
+    aqua_health_record(h, status, value);
+
+    // Report crossings only, not every degraded read
+    int score = aqua_health_score(h);
+    bool degraded = score < HEALTH_DEGRADED_BELOW;
+    if (degraded != s_degraded[sensor]) {
+        s_degraded[sensor] = degraded;
+        if (degraded) {
+            AQUA_LOG(HEALTH_LOW, health_labels[sensor], score);
+        } else {
+            AQUA_LOG(HEALTH_RECOVERED, health_labels[sensor], score);
+        }
+    }
+}
+
+const aqua_health_t *sensor_health(aqua_sensor_t sensor) {
+    return health(sensor);
+}
+
+void sensor_health_scores(uint8_t scores[AQUA_SENSOR_COUNT]) {
+    for (int i = 0; i < AQUA_SENSOR_COUNT; i++) {
+        scores[i] = (uint8_t)aqua_health_score(health((aqua_sensor_t)i));
+    }
+}
+
+int sensor_diagnostics_runs(void) {
+    return s_diag_runs;
+}
+
+// ========== DHT22 ==========
+// The reply is captured by the pulse-capture peripheral and decoded from
+// pulse lengths afterwards, so interrupts during the frame cannot flip bits.
+#define DHT_START_LOW_US 20000      // Host start signal: at least 1 ms low, 20 ms to be safe
+#define DHT_CAPTURE_TIMEOUT_MS 50   // Start pulse plus a ~5 ms frame
+
+esp_err_t dht22_start(void) {
+    return hal_pulse_capture_start(DHT_PIN, DHT_START_LOW_US);
+}
+
+esp_err_t dht22_finish(float* hum, float* temp) {
+    uint16_t pulses[AQUA_DHT22_MAX_PULSES];
+    size_t count = 0;
+    uint8_t data[5] = {0};
+
+    esp_err_t err = hal_pulse_capture_wait(pulses, AQUA_DHT22_MAX_PULSES, &count, DHT_CAPTURE_TIMEOUT_MS);
+    if (err == ESP_ERR_INVALID_STATE) {
+        err = ESP_ERR_TIMEOUT;      // dht22_start() failed: nothing was sent
+    }
+    if (err == ESP_OK) {
+        err = aqua_dht22_decode_pulses(pulses, count, data);
+    }
+    if (err == ESP_OK) {
+        err = aqua_dht22_decode(data, hum, temp);
+    }
+    if (err == ESP_OK) {
+        AQUA_LOG(DHT_RAW, data[0], data[1], data[2], data[3], data[4]);
+    }
+
+    // A malformed pulse train is a corrupted transfer, like a bad checksum
+    aqua_read_status_t status = err == ESP_OK ? AQUA_READ_OK :
+                                err == ESP_ERR_TIMEOUT ? AQUA_READ_NO_RESPONSE :
+                                err == ESP_ERR_INVALID_CRC || err == ESP_ERR_INVALID_SIZE ? AQUA_READ_BAD_CRC :
+                                AQUA_READ_OUT_OF_RANGE;
+    health_record(AQUA_SENSOR_DHT22, status, err == ESP_OK ? *temp : NAN);
+    return err;
+}
+
+esp_err_t dht22_read(float* hum, float* temp) {
+    dht22_start();      // A failed start shows up as ESP_ERR_TIMEOUT here
+    return dht22_finish(hum, temp);
+}
+
+// ========== SENSOR READINGS ==========
+
+// Average of SAMPLES conversions, 10 ms apart; their spread feeds the noise estimate
+static int read_analog_avg_mv(aqua_sensor_t sensor, int channel) {
+    const int SAMPLES = 10;
+    int samples[SAMPLES];
+
+    for (int i = 0; i < SAMPLES; i++) {
+        ESP_ERROR_CHECK(hal_adc_read_mv(channel, &samples[i]));
+        hal_delay_ms(10);
+    }
+
+    aqua_health_record_samples(health(sensor), samples, SAMPLES);
+    return aqua_average_mv(samples, SAMPLES);
+}
+
+// One conversion from the last external scan; the ADS1115 filters internally
+static float read_external_sensor(const aqua_measure_t *m) {
+    int mv;
+    if (aqua_xadc_read_mv(XADC_CH_INPUT(m->adc_channel), &mv) != ESP_OK) {
+        health_record(m->sensor, AQUA_READ_NO_RESPONSE, NAN);
+        return -1.0f;
+    }
+    float value = m->convert(mv);
+    health_record(m->sensor, value < 0 ? AQUA_READ_OUT_OF_RANGE : AQUA_READ_OK, value);
+    return value;
+}
+
+static bool s_oversample = AQUA_OVERSAMPLE;
+
+void sensors_set_oversampling(bool on) {
+    s_oversample = on;
+}
+
+// One burst through the CIC/FIR chain. Ten raw samples spread over the
+// burst feed the noise estimate, so its limit means the same in both modes.
+static float read_analog_oversampled_mv(aqua_sensor_t sensor, int channel) {
+    static int16_t raw[OVERSAMPLE_SAMPLES] AQUA_DSP_ALIGNED;
+    static int16_t work[OVERSAMPLE_SAMPLES / AQUA_DSP_CIC_DECIM] AQUA_DSP_ALIGNED;
+    const int SAMPLES = 10;
+    int samples[SAMPLES];
+
+    ESP_ERROR_CHECK(hal_adc_read_burst(channel, OVERSAMPLE_RATE_HZ, raw, OVERSAMPLE_SAMPLES));
+    for (int i = 0; i < SAMPLES; i++) {
+        samples[i] = raw[i * (OVERSAMPLE_SAMPLES / SAMPLES)];
+    }
+    aqua_health_record_samples(health(sensor), samples, SAMPLES);
+    return aqua_oversample_mv(raw, OVERSAMPLE_SAMPLES, work);
+}
+
+static bool s_lockin = AQUA_TURBIDITY_LOCKIN;
+
+void sensors_set_lockin(bool on) {
+    s_lockin = on;
+}
+
+#define LOCKIN_BLOCKS (OVERSAMPLE_SAMPLES / LOCKIN_BLOCK_SAMPLES)
+
+_Static_assert(LOCKIN_HALF_PERIOD % 2 == 0, "hal_emitter_on() centres the on phase");
+_Static_assert(LOCKIN_BLOCK_SAMPLES % (2 * LOCKIN_HALF_PERIOD) == 0,
+               "every block must start at the same emitter phase");
+_Static_assert(OVERSAMPLE_SAMPLES % LOCKIN_BLOCK_SAMPLES == 0, "a lock-in read is whole blocks");
+
+typedef struct {
+    aqua_lockin_t total;
+    int block_mv[LOCKIN_BLOCKS];    // Each block's own amplitude
+    int blocks;
+} lockin_read_t;
+
+static void lockin_block(const int16_t *samples, size_t count, void *ctx) {
+    lockin_read_t *r = ctx;
+    aqua_lockin_t block;
+    aqua_lockin_init(&block, LOCKIN_HALF_PERIOD);
+    aqua_lockin_feed(&block, samples, count);
+    aqua_lockin_merge(&r->total, &block);
+    if (r->blocks < LOCKIN_BLOCKS) {
+        r->block_mv[r->blocks++] = (int)lroundf(aqua_lockin_amplitude(&block));
+    }
+}
+
+// Emitter switched at LOCKIN_MOD_HZ through one burst, demodulated a block
+// at a time. The spread of the per-block amplitudes is the noise estimate:
+// the raw samples swing with the emitter and with the ambient light.
+static float read_analog_lockin_mv(const aqua_measure_t *m) {
+    static int16_t block[LOCKIN_BLOCK_SAMPLES];
+    lockin_read_t r = { .blocks = 0 };
+    aqua_lockin_init(&r.total, LOCKIN_HALF_PERIOD);
+
+    ESP_ERROR_CHECK(hal_adc_read_modulated(m->adc_channel, m->emitter_pin, OVERSAMPLE_RATE_HZ,
+                                           LOCKIN_HALF_PERIOD, OVERSAMPLE_SAMPLES, block,
+                                           LOCKIN_BLOCK_SAMPLES, lockin_block, &r));
+    aqua_health_record_samples(health(m->sensor), r.block_mv, r.blocks);
+
+    // A sample at either rail lost the emitter's share: the probe is saturated
+    if (r.total.clipped > 0) {
+        AQUA_LOG(LOCKIN_CLIPPED, m->label, (int)r.total.clipped, (int)lroundf(aqua_lockin_ambient(&r.total)));
+        return -1.0f;
+    }
+    return aqua_lockin_amplitude(&r.total);
+}
+
+float read_analog_sensor(const aqua_measure_t *m) {
+    if (XADC_CH_IS_EXTERNAL(m->adc_channel)) {
+        return read_external_sensor(m);
+    }
+    float mv = s_lockin && (m->flags & AQUA_MEAS_LOCKIN) ? read_analog_lockin_mv(m)
+             : s_oversample ? read_analog_oversampled_mv(m->sensor, m->adc_channel)
+             : read_analog_avg_mv(m->sensor, m->adc_channel);
+    float value = m->convert(mv);
+    health_record(m->sensor, value < 0 ? AQUA_READ_OUT_OF_RANGE : AQUA_READ_OK, value);
+    return value;
+}
+
+// DS18B20 timing constants (in microseconds)
+#define DS18B20_RESET_PULSE 480
+#define DS18B20_PRESENCE_WAIT 60
+#define DS18B20_PRESENCE_PULSE 240
+#define DS18B20_WRITE_0 60
+#define DS18B20_WRITE_1 10
+#define DS18B20_READ_SLOT 15
+#define DS18B20_RECOVERY_TIME 1
+
+// DS18B20 Comprehensive Test Suite: over 2 s of bus time, so it only runs
+// when the probe's health score says something is wrong
+typedef enum {
+    TEST_HARDWARE_DETECTION = 1,
+    TEST_ELECTRICAL_ANALYSIS = 2,
+    TEST_PROTOCOL_VALIDATION = 3,
+    TEST_DATA_INTEGRITY = 4,
+    TEST_ENVIRONMENTAL_STRESS = 5,
+    TEST_TIMING_ANALYSIS = 6,
+    TEST_POWER_STABILITY = 7,
+    TEST_INTERFERENCE_CHECK = 8
+} ds18b20_test_type_t;
+
+// Helper functions
+static bool ds18b20_reset_test(void) {
+    return hal_onewire_reset(WATER_TEMP_PIN);
+}
+
+static void ds18b20_write_bit(int bit) {
+    hal_onewire_write_bit(WATER_TEMP_PIN, bit);
+}
+
+static int ds18b20_read_bit(void) {
+    return hal_onewire_read_bit(WATER_TEMP_PIN);
+}
+
+// Hardware Detection Tests
+static bool test_hardware_detection(void) {
+    AQUA_LOG(DS_HW_TEST);
+    
+    // Test 1: GPIO functionality
+    hal_gpio_reset(WATER_TEMP_PIN);
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_level(WATER_TEMP_PIN, 1);
+    hal_delay_ms(10);
+    hal_gpio_set_level(WATER_TEMP_PIN, 0);
+    hal_delay_ms(10);
+    hal_gpio_set_level(WATER_TEMP_PIN, 1);
+    AQUA_LOG(DS_GPIO_TOGGLE);
+    
+    // Test 2: Pullup resistor check
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+    hal_gpio_pullup(WATER_TEMP_PIN);
+    hal_delay_ms(1);
+    int pullup_level = hal_gpio_get_level(WATER_TEMP_PIN);
+    AQUA_LOG(DS_PULLUP, pullup_level ? "WORKING" : "FAILED");
+    
+    // Test 3: Basic presence detection
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_level(WATER_TEMP_PIN, 0);
+    hal_delay_us(480);
+    hal_gpio_set_level(WATER_TEMP_PIN, 1);
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+    hal_gpio_pullup(WATER_TEMP_PIN);
+    hal_delay_us(70);
+    int presence = hal_gpio_get_level(WATER_TEMP_PIN);
+    hal_delay_us(410);
+    
+    AQUA_LOG(DS_PRESENCE, presence == 0 ? "DETECTED" : "NOT DETECTED");
+    return (presence == 0 && pullup_level == 1);
+}
+
+// Electrical Analysis Tests
+static bool test_electrical_analysis(void) {
+    AQUA_LOG(DS_ELECTRICAL_TEST);
+    
+    // Test 1: Line stability check
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+    hal_gpio_pullup(WATER_TEMP_PIN);
+    int stable_readings = 0;
+    for (int i = 0; i < 100; i++) {
+        if (hal_gpio_get_level(WATER_TEMP_PIN) == 1) stable_readings++;
+        hal_delay_us(10);
+    }
+    AQUA_LOG(DS_LINE_STABILITY, stable_readings);
+    
+    // Test 2: Reset pulse timing verification
+    int64_t start_time = hal_time_us();
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_OUTPUT);
+    hal_gpio_set_level(WATER_TEMP_PIN, 0);
+    hal_delay_us(480);
+    hal_gpio_set_level(WATER_TEMP_PIN, 1);
+    int64_t reset_time = hal_time_us() - start_time;
+    AQUA_LOG(DS_RESET_TIMING, (int)reset_time);
+    
+    // Test 3: Presence pulse measurement
+    hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+    hal_gpio_pullup(WATER_TEMP_PIN);
+    start_time = hal_time_us();
+    while (hal_gpio_get_level(WATER_TEMP_PIN) == 1 && (hal_time_us() - start_time) < 100) {}
+    int64_t presence_start = hal_time_us();
+    while (hal_gpio_get_level(WATER_TEMP_PIN) == 0 && (hal_time_us() - presence_start) < 300) {}
+    int64_t presence_duration = hal_time_us() - presence_start;
+    AQUA_LOG(DS_PRESENCE_DURATION, (int)presence_duration);
+    
+    return (stable_readings > 95 && presence_duration > 60 && presence_duration < 240);
+}
+
+// Protocol Validation Tests
+static bool test_protocol_validation(void) {
+    AQUA_LOG(DS_PROTOCOL_TEST);
+    
+    // Reset and check presence
+    if (!ds18b20_reset_test()) {
+        AQUA_LOG(DS_NO_PRESENCE);
+        return false;
+    }
+    
+    // Test 1: ROM command validation
+    AQUA_LOG(DS_ROM_COMMANDS);
+    
+    // Send SKIP ROM (0xCC)
+    for (int i = 0; i < 8; i++) {
+        ds18b20_write_bit((0xCC >> i) & 1);
+    }
+    AQUA_LOG(DS_SKIP_ROM);
+    
+    // Send CONVERT T (0x44)
+    for (int i = 0; i < 8; i++) {
+        ds18b20_write_bit((0x44 >> i) & 1);
+    }
+    AQUA_LOG(DS_CONVERT_T);
+    
+    // Test 2: Conversion time check
+    int64_t conv_start = hal_time_us();
+    hal_delay_ms(750);
+    int64_t conv_time = hal_time_us() - conv_start;
+    AQUA_LOG(DS_CONVERSION_TIME, (int)(conv_time / 1000));
+    
+    // Test 3: Read command validation
+    if (!ds18b20_reset_test()) {
+        AQUA_LOG(DS_LOST_PRESENCE);
+        return false;
+    }
+    
+    // SKIP ROM again
+    for (int i = 0; i < 8; i++) {
+        ds18b20_write_bit((0xCC >> i) & 1);
+    }
+    
+    // READ SCRATCHPAD (0xBE)
+    for (int i = 0; i < 8; i++) {
+        ds18b20_write_bit((0xBE >> i) & 1);
+    }
+    AQUA_LOG(DS_READ_SCRATCHPAD);
+    
+    return true;
+}
+
+// Data Integrity Tests
+static bool test_data_integrity(void) {
+    AQUA_LOG(DS_INTEGRITY_TEST);
+    
+    uint8_t data[9] = {0};
+    bool success = false;
+    
+    for (int attempt = 0; attempt < 3; attempt++) {
+        AQUA_LOG(DS_READ_ATTEMPT, attempt + 1);
+        
+        if (!ds18b20_reset_test()) continue;
+        
+        // Commands
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xCC >> i) & 1);
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0x44 >> i) & 1);
+        hal_delay_ms(750);
+        
+        if (!ds18b20_reset_test()) continue;
+        
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xCC >> i) & 1);
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xBE >> i) & 1);
+        
+        // Read data
+        memset(data, 0, 9);
+        for (int byte = 0; byte < 9; byte++) {
+            for (int bit = 0; bit < 8; bit++) {
+                data[byte] |= (ds18b20_read_bit() << bit);
+            }
+        }
+        
+        // CRC check
+        uint8_t crc = aqua_crc8(data, 8);
+        
+        AQUA_LOG(DS_ATTEMPT_DATA, attempt + 1, data[0], data[1], data[2], data[3],
+                 data[4], data[5], data[6], data[7], data[8]);
+        AQUA_LOG(DS_CRC, crc, data[8]);
+        
+        // Calculate temperature from raw data (bypass CRC for pullup resistor issue)
+        float temperature = aqua_ds18b20_raw_to_c(data);
+        
+        if (temperature >= -55.0f && temperature <= 125.0f) {
+            if (crc == data[8]) {
+                AQUA_LOG(DS_CRC_VALID, temperature);
+                success = true;
+            } else {
+                AQUA_LOG(DS_CRC_BYPASS, temperature);
+                success = true; // Accept temperature despite CRC failure
+            }
+            break;
+        }
+        
+        if (crc == data[8]) {
+            success = true;
+            break;
+        }
+    }
+    
+    return success;
+}
+
+// Environmental Stress Tests
+static bool test_environmental_stress(void) {
+    AQUA_LOG(DS_STRESS_TEST);
+    
+    int success_count = 0;
+    
+    for (int i = 0; i < 10; i++) {
+        AQUA_LOG(DS_STRESS_CYCLE, i + 1);
+        
+        if (ds18b20_reset_test()) {
+            success_count++;
+        }
+        
+        hal_delay_ms(100);
+    }
+    
+    AQUA_LOG(DS_STRESS_RESULT, success_count);
+    return (success_count >= 8);
+}
+
+// Timing Analysis Tests
+static bool test_timing_analysis(void) {
+    AQUA_LOG(DS_TIMING_TEST);
+    
+    // Test different timing variations
+    int timing_tests[] = {400, 480, 560}; // Reset pulse variations
+    bool timing_success = false;
+    
+    for (int t = 0; t < 3; t++) {
+        AQUA_LOG(DS_TIMING_PULSE, timing_tests[t]);
+        
+        hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_OUTPUT);
+        hal_gpio_set_level(WATER_TEMP_PIN, 0);
+        hal_delay_us(timing_tests[t]);
+        hal_gpio_set_level(WATER_TEMP_PIN, 1);
+        hal_gpio_set_direction(WATER_TEMP_PIN, HAL_GPIO_INPUT);
+        hal_gpio_pullup(WATER_TEMP_PIN);
+        hal_delay_us(70);
+        
+        int presence = hal_gpio_get_level(WATER_TEMP_PIN);
+        AQUA_LOG(DS_TIMING_RESULT, timing_tests[t], presence == 0 ? "SUCCESS" : "FAILED");
+        
+        if (presence == 0) timing_success = true;
+        
+        hal_delay_us(410);
+        hal_delay_ms(10);
+    }
+    
+    return timing_success;
+}
+
+// Power Stability Tests
+static bool test_power_stability(void) {
+    AQUA_LOG(DS_POWER_TEST);
+    
+    // Test power-on reset behavior
+    hal_gpio_reset(WATER_TEMP_PIN);
+    hal_delay_ms(100);
+    
+    bool power_test = ds18b20_reset_test();
+    AQUA_LOG(DS_POWER_RESULT, power_test ? "STABLE" : "UNSTABLE");
+    
+    return power_test;
+}
+
+// Interference Check Tests
+static bool test_interference_check(void) {
+    AQUA_LOG(DS_INTERFERENCE_TEST);
+    
+    // Test with WiFi activity
+    bool interference_test = true;
+    
+    for (int i = 0; i < 5; i++) {
+        if (!ds18b20_reset_test()) {
+            interference_test = false;
+        }
+        hal_delay_ms(50);
+    }
+    
+    AQUA_LOG(DS_INTERFERENCE_RESULT, interference_test ? "CLEAN" : "DETECTED");
+    return interference_test;
+}
+
+// Main comprehensive test function
+static float ds18b20_diagnostics(void) {
+    AQUA_LOG(DS_SUITE_START);
+    AQUA_LOG(DS_RULE);
+    
+    bool test_results[8] = {false};
+    
+    // Run all test types
+    test_results[0] = test_hardware_detection();
+    test_results[1] = test_electrical_analysis();
+    test_results[2] = test_protocol_validation();
+    test_results[3] = test_data_integrity();
+    test_results[4] = test_environmental_stress();
+    test_results[5] = test_timing_analysis();
+    test_results[6] = test_power_stability();
+    test_results[7] = test_interference_check();
+    
+    // Results summary
+    AQUA_LOG(DS_RULE);
+    AQUA_LOG(DS_SUMMARY);
+    AQUA_LOG(DS_RESULT_HW, test_results[0] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_ELECTRICAL, test_results[1] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_PROTOCOL, test_results[2] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_INTEGRITY, test_results[3] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_STRESS, test_results[4] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_TIMING, test_results[5] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_POWER, test_results[6] ? "✅ PASS" : "❌ FAIL");
+    AQUA_LOG(DS_RESULT_INTERFERENCE, test_results[7] ? "✅ PASS" : "❌ FAIL");
+    
+    // Final temperature reading if tests pass
+    if (test_results[0] && test_results[2] && test_results[3]) {
+        AQUA_LOG(DS_FINAL_READ);
+        
+        if (!ds18b20_reset_test()) return -999.0f;
+        
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xCC >> i) & 1);
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0x44 >> i) & 1);
+        hal_delay_ms(750);
+        
+        if (!ds18b20_reset_test()) return -999.0f;
+        
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xCC >> i) & 1);
+        for (int i = 0; i < 8; i++) ds18b20_write_bit((0xBE >> i) & 1);
+        
+        uint8_t data[9] = {0};
+        for (int byte = 0; byte < 9; byte++) {
+            for (int bit = 0; bit < 8; bit++) {
+                data[byte] |= (ds18b20_read_bit() << bit);
+            }
+        }
+        
+        uint8_t crc = aqua_crc8(data, 8);
+        
+        // Calculate temperature regardless of CRC (pullup resistor causes CRC errors)
+        float temperature = aqua_ds18b20_raw_to_c(data);
+        
+        AQUA_LOG(DS_FINAL_RAW, data[0], data[1], crc, data[8]);
+        
+        if (temperature >= -55.0f && temperature <= 125.0f) {
+            if (crc == data[8]) {
+                AQUA_LOG(DS_FINAL_OK, temperature);
+            } else {
+                AQUA_LOG(DS_FINAL_BYPASS, temperature);
+            }
+            return temperature;
+        } else {
+            AQUA_LOG(DS_OUT_OF_RANGE, temperature);
+        }
+    }
+    
+    AQUA_LOG(DS_SUITE_FAILED);
+    return -999.0f;
+}
+
+// ========== DS18B20 PRODUCTION READ ==========
+static void ds18b20_write_byte(uint8_t byte) {
+    for (int i = 0; i < 8; i++) ds18b20_write_bit((byte >> i) & 1);
+}
+
+// One conversion: reset, SKIP ROM, CONVERT T, wait, reset, SKIP ROM, READ SCRATCHPAD
+static aqua_read_status_t ds18b20_read(float *temp) {
+    int presence_us = 0;
+    if (!hal_onewire_reset_timed(WATER_TEMP_PIN, &presence_us)) {
+        return AQUA_READ_NO_RESPONSE;
+    }
+    aqua_health_record_presence(health(AQUA_SENSOR_DS18B20), presence_us);
+    ds18b20_write_byte(0xCC);
+    ds18b20_write_byte(0x44);
+    hal_delay_ms(750);
+
+    if (!ds18b20_reset_test()) {
+        return AQUA_READ_NO_RESPONSE;
+    }
+    ds18b20_write_byte(0xCC);
+    ds18b20_write_byte(0xBE);
+
+    uint8_t data[9] = {0};
+    bool released = true;
+    for (int byte = 0; byte < 9; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+            data[byte] |= (ds18b20_read_bit() << bit);
+        }
+        released &= data[byte] == 0xFF;
+    }
+    // Nobody drove the bus: all ones would otherwise decode as -0.06 °C
+    if (released) {
+        return AQUA_READ_NO_RESPONSE;
+    }
+
+    *temp = aqua_ds18b20_raw_to_c(data);
+    if (*temp < -55.0f || *temp > 125.0f) {
+        return AQUA_READ_OUT_OF_RANGE;
+    }
+    return aqua_crc8(data, 8) == data[8] ? AQUA_READ_OK : AQUA_READ_BAD_CRC;
+}
+
+float read_water_temp(void) {
+    float temp = AQUA_SENSOR_ERROR;
+    aqua_read_status_t status = ds18b20_read(&temp);
+    health_record(AQUA_SENSOR_DS18B20, status, temp);
+    s_reads_since_diag++;
+
+    if (status == AQUA_READ_BAD_CRC) {
+        // In range: accept it despite the CRC (pullup resistor issue); the
+        // failure still counts against the probe's health
+        AQUA_LOG(DS_CRC_BYPASS, temp);
+    } else if (status == AQUA_READ_OUT_OF_RANGE) {
+        AQUA_LOG(DS_OUT_OF_RANGE, temp);
+        temp = AQUA_SENSOR_ERROR;
+    } else if (status == AQUA_READ_NO_RESPONSE) {
+        AQUA_LOG(DS_NOT_RESPONDING, WATER_TEMP_PIN);
+        temp = AQUA_SENSOR_ERROR;
+    }
+
+    int score = aqua_health_score(health(AQUA_SENSOR_DS18B20));
+    if (score < HEALTH_DEGRADED_BELOW && s_reads_since_diag >= HEALTH_DIAG_MIN_READS) {
+        AQUA_LOG(HEALTH_DIAGNOSTICS, health_labels[AQUA_SENSOR_DS18B20], score);
+        s_reads_since_diag = 0;
+        s_diag_runs++;
+        // The suite's own final read stands in when the normal read failed
+        float diag_temp = ds18b20_diagnostics();
+        if (temp == AQUA_SENSOR_ERROR) {
+            temp = diag_temp;
+        }
+    }
+    return temp;
+}
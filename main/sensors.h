@@ -0,0 +1,81 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "aqua_core.h"
+#include "aqua_health.h"
+#include "aqua_registry.h"
+
+/**
+ * @brief Send the DHT22 start signal and capture its reply in the background
+ *
+ * Returns at once; collect the result with dht22_finish().
+ */
+esp_err_t dht22_start(void);
+
+/**
+ * @brief Wait for the capture started by dht22_start() and decode it
+ * @param hum Relative humidity in %
+ * @param temp Air temperature in °C
+ * @return ESP_OK, ESP_ERR_TIMEOUT (no reply), ESP_ERR_INVALID_SIZE (malformed
+ *         pulse train), ESP_ERR_INVALID_CRC or ESP_ERR_INVALID_RESPONSE (out of range)
+ */
+esp_err_t dht22_finish(float* hum, float* temp);
+
+/**
+ * @brief dht22_start() followed by dht22_finish()
+ */
+esp_err_t dht22_read(float* hum, float* temp);
+
+/**
+ * @brief Read the water temperature from the DS18B20
+ *
+ * A single conversion. The full diagnostic suite runs only when the probe's
+ * health score is below HEALTH_DEGRADED_BELOW, at most once every
+ * HEALTH_DIAG_MIN_READS reads.
+ * @return Temperature in °C, or -999.0f if the probe is not working
+ */
+float read_water_temp(void);
+
+/**
+ * @brief Read one analog sensor from the registry (m->adc_channel >= 0)
+ * @return Average of ten samples, the decimated burst when oversampling, or
+ *         the lock-in amplitude for AQUA_MEAS_LOCKIN probes in lock-in mode,
+ *         in engineering units; -1.0f if out of range or saturated
+ */
+float read_analog_sensor(const aqua_measure_t *m);
+
+/**
+ * @brief Read internal ADC probes as oversampled bursts (default AQUA_OVERSAMPLE)
+ */
+void sensors_set_oversampling(bool on);
+
+/**
+ * @brief Read AQUA_MEAS_LOCKIN probes against their switched emitter
+ *        (default AQUA_TURBIDITY_LOCKIN)
+ */
+void sensors_set_lockin(bool on);
+
+// ========== HEALTH ==========
+// Every read above also updates its sensor's health (aqua_health.h).
+
+/**
+ * @brief Forget all health history, e.g. after replacing a probe
+ */
+void sensor_health_reset(void);
+
+const aqua_health_t *sensor_health(aqua_sensor_t sensor);
+
+/**
+ * @brief Current score of every sensor, indexed by aqua_sensor_t
+ */
+void sensor_health_scores(uint8_t scores[AQUA_SENSOR_COUNT]);
+
+/**
+ * @brief DS18B20 diagnostic suite runs since the last sensor_health_reset()
+ */
+int sensor_diagnostics_runs(void);
+
+#endif // SENSORS_H
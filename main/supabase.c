@@ -0,0 +1,930 @@
+#include <stdio.h>
+#include <string.h>
+#include "aqua_anomaly.h"
+#include "aqua_config.h"
+#include "aqua_core.h"
+#include "aqua_gzip.h"
+#include "aqua_log.h"
+#include "aqua_meter.h"
+#include "aqua_outq.h"
+#include "aqua_params.h"
+#include "aqua_pipeline.h"
+#include "aqua_registry.h"
+#include "aqua_rules.h"
+#include "aqua_seq.h"
+#include "hal.h"
+#include "supabase.h"
+
+
+static const hal_http_header_t supabase_headers[] = {
+    {"Content-Type", "application/json"},
+    {"apikey", SUPABASE_KEY},
+    {"Authorization", "Bearer " SUPABASE_KEY},
+};
+
+static const hal_http_header_t relay_poll_headers[] = {
+    {"Content-Type", "application/json"},
+    {"apikey", SUPABASE_KEY},
+    {"Authorization", "Bearer " SUPABASE_KEY},
+    {"Prefer", "return=representation"},
+};
+
+// ========== OUTBOUND QUEUE ==========
+// Every request goes through one priority queue (aqua_outq.h). A blocking
+// call queues its request and serves the queue until that request settles,
+// so anything more urgent that is waiting goes out first, and rows that
+// missed their live deadline are sent later from the backlog.
+enum {
+    OUT_READING = 0,            // POST sensor_data
+    OUT_EXCHANGE,               // POST rpc/ingest_reading
+    OUT_RELAY_POLL,             // GET relay_commands
+    OUT_PARAMS_POLL,            // GET device_params
+    OUT_RULES_POLL,             // GET device_rules
+    OUT_ALERT                   // POST alerts
+};
+
+static aqua_outq_t outq;
+static bool outq_ready;
+static bool gzip_refused;       // The server did not take a compressed body this boot
+static bool pipeline_refused;   // The server closed a keep-alive connection after one answer
+static int pipeline_depth = UPLOAD_PIPELINE_DEPTH;
+static aqua_pipeline_t pipeline;
+
+// last_alerts: the set the server has; queued_alerts: the set in the queued
+// notification, if there is one
+static aqua_alert_states_t last_alerts;
+static aqua_alert_states_t queued_alerts;
+
+// The request a blocking call waits for, and how it ended
+static uint32_t wait_seq;
+static bool wait_settled;
+static bool wait_ok;
+
+static aqua_outq_result_t send_reading(aqua_outq_item_t *item);
+static aqua_outq_result_t send_exchange(aqua_outq_item_t *item);
+static aqua_outq_result_t send_relay_poll(aqua_outq_item_t *item);
+static aqua_outq_result_t send_params_poll(aqua_outq_item_t *item);
+static aqua_outq_result_t send_rules_poll(aqua_outq_item_t *item);
+static aqua_outq_result_t send_alert(aqua_outq_item_t *item);
+static bool reading_ready(void);
+static void serve_uploads(aqua_outq_item_t *first, int64_t end_us);
+
+static void outq_dropped(const aqua_outq_item_t *item, void *ctx) {
+    (void)ctx;
+    if (item->seq == wait_seq) {
+        wait_settled = true;
+        wait_ok = false;
+    }
+    AQUA_LOG(OUTQ_DROPPED, aqua_outq_class_name(item->cls), item->attempts);
+}
+
+static aqua_outq_t *outbound(void) {
+    if (!outq_ready) {
+        aqua_outq_init(&outq, NULL, outq_dropped, NULL);
+        outq_ready = true;
+    }
+    return &outq;
+}
+
+void supabase_outbound_reset(void) {
+    outq_ready = false;
+    gzip_refused = false;
+    pipeline_refused = false;
+    memset(&pipeline.stats, 0, sizeof(pipeline.stats));
+    memset(&last_alerts, 0, sizeof(last_alerts));
+}
+
+const aqua_outq_t *supabase_outbound(void) {
+    return outbound();
+}
+
+// Client errors other than timeouts and rate limiting fail again on a retry
+static aqua_outq_result_t attempt_result(esp_err_t err, int status) {
+    if (err == ESP_OK && status >= 400 && status < 500 && status != 408 && status != 429) {
+        return AQUA_OUTQ_REJECTED;
+    }
+    return AQUA_OUTQ_FAILED;
+}
+
+static aqua_outq_result_t perform(aqua_outq_item_t *item) {
+    switch (item->kind) {
+    case OUT_READING: return send_reading(item);
+    case OUT_EXCHANGE: return send_exchange(item);
+    case OUT_RELAY_POLL: return send_relay_poll(item);
+    case OUT_PARAMS_POLL: return send_params_poll(item);
+    case OUT_RULES_POLL: return send_rules_poll(item);
+    case OUT_ALERT: return send_alert(item);
+    default: return AQUA_OUTQ_REJECTED;
+    }
+}
+
+static void report_outcome(uint8_t kind, uint8_t attempts, aqua_outq_outcome_t outcome, int64_t retry_us) {
+    bool upload = kind == OUT_READING || kind == OUT_EXCHANGE;
+    if (outcome == AQUA_OUTQ_RETRYING && upload) {
+        AQUA_LOG(UPLOAD_RETRY, (int)(retry_us / 1000));
+    } else if (outcome == AQUA_OUTQ_DEMOTED || outcome == AQUA_OUTQ_DROPPED) {
+        if (kind == OUT_READING) {
+            AQUA_LOG(UPLOAD_ALL_FAILED, attempts);
+        } else if (kind == OUT_EXCHANGE) {
+            AQUA_LOG(EXCHANGE_ALL_FAILED, attempts);
+        } else if (kind == OUT_RELAY_POLL) {
+            AQUA_LOG(RELAY_ALL_FAILED);
+        }
+        if (outcome == AQUA_OUTQ_DEMOTED) {
+            AQUA_LOG(OUTQ_BACKLOG, aqua_outq_pending(&outq, AQUA_OUTQ_BACKLOG));
+        }
+    }
+}
+
+// Complete a request and note whether it was the one waited for
+static void settle(aqua_outq_item_t *item, aqua_outq_result_t result) {
+    uint8_t kind = item->kind;
+    uint8_t attempts = item->attempts;
+    uint32_t seq = item->seq;
+    int64_t now_us = hal_time_us();
+    aqua_outq_outcome_t outcome = aqua_outq_complete(&outq, item, result, now_us);
+    report_outcome(kind, attempts, outcome, item->not_before_us - now_us);
+    if (wait_seq != 0 && seq == wait_seq && outcome != AQUA_OUTQ_RETRYING) {
+        wait_settled = true;
+        wait_ok = outcome == AQUA_OUTQ_DONE;
+    }
+}
+
+// Send in priority order until request `until` settles (0: no request),
+// nothing is ready within budget_ms, or the link is down
+static void serve(uint32_t until, int budget_ms) {
+    aqua_outq_t *q = outbound();
+    wait_seq = until;
+    wait_settled = false;
+    wait_ok = false;
+    if (!hal_net_ensure_connected()) {
+        return;
+    }
+
+    int64_t end_us = hal_time_us() + (int64_t)budget_ms * 1000;
+    while (!(until && wait_settled)) {
+        int64_t now_us = hal_time_us();
+        int64_t wait_us;
+        aqua_outq_item_t *item = aqua_outq_next(q, now_us, &wait_us);
+        if (!item) {
+            if (wait_us < 0 || now_us + wait_us > end_us) {
+                break;
+            }
+            hal_delay_ms((uint32_t)((wait_us + 999) / 1000));
+            continue;
+        }
+
+        if (item->kind == OUT_READING && pipeline_depth > 1 && !pipeline_refused && reading_ready()) {
+            serve_uploads(item, end_us);
+        } else {
+            settle(item, perform(item));
+        }
+        hal_watchdog_feed();
+    }
+}
+
+static bool send_and_wait(aqua_outq_class_t cls, uint8_t kind, const char *body, size_t len) {
+    aqua_outq_item_t *item = aqua_outq_push(outbound(), cls, kind, body, len, hal_time_us());
+    if (!item) {
+        AQUA_LOG(OUTQ_FULL, aqua_outq_class_name(cls));
+        return false;
+    }
+    serve(item->seq, OUTQ_SERVICE_MS);
+    return wait_settled && wait_ok;
+}
+
+void supabase_outbound_drain(int budget_ms) {
+    if (aqua_outq_pending(outbound(), AQUA_OUTQ_CLASS_COUNT) > 0) {
+        serve(0, budget_ms);
+    }
+}
+
+// ========== RELAY CONTROL POLLING FROM SUPABASE ==========
+void apply_relay_command(const char *type, bool state_bool, void *ctx) {
+    (void)ctx;
+
+    if (strcmp(type, "ph") == 0) {
+        hal_gpio_set_level(RELAY_PIN, state_bool ? 1 : 0);
+        AQUA_LOG(RELAY_PH, state_bool ? "ON" : "OFF");
+    } else if (strcmp(type, "aerator") == 0) {
+        hal_gpio_set_level(AERATOR_PIN, state_bool ? 1 : 0);
+        AQUA_LOG(RELAY_AERATOR, state_bool ? "ON" : "OFF");
+    } else if (strcmp(type, "filter") == 0) {
+        hal_gpio_set_level(FILTER_PIN, state_bool ? 1 : 0);
+        AQUA_LOG(RELAY_FILTER, state_bool ? "ON" : "OFF");
+    } else if (strcmp(type, "pump") == 0) {
+        hal_gpio_set_level(PUMP_RELAY_PIN, state_bool ? 1 : 0);
+        AQUA_LOG(RELAY_PUMP, state_bool ? "ON" : "OFF");
+    }
+}
+
+static aqua_outq_result_t send_relay_poll(aqua_outq_item_t *item) {
+    hal_http_request_t req = {
+        .url = SUPABASE_RELAY_POLL_URL,
+        .method = HAL_HTTP_GET,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = relay_poll_headers,
+        .header_count = sizeof(relay_poll_headers) / sizeof(relay_poll_headers[0]),
+        .timeout_ms = UPLOAD_TIMEOUT_MS
+    };
+    char response_buffer[2048];
+    hal_http_response_t resp = {
+        .body = response_buffer,
+        .body_size = sizeof(response_buffer)
+    };
+
+    esp_err_t err = hal_http_perform(&req, &resp);
+
+    if (err == ESP_OK && resp.status == 200) {
+        if (resp.body_len > 0) {
+            AQUA_LOG(RELAY_RECEIVED, response_buffer);
+
+            // Parse JSON response and execute commands
+            aqua_parse_relay_commands(response_buffer, apply_relay_command, NULL);
+        }
+        return AQUA_OUTQ_DELIVERED;
+    }
+
+    AQUA_LOG(RELAY_ATTEMPT_FAILED, item->attempts, resp.status, esp_err_to_name(err));
+    return attempt_result(err, resp.status);
+}
+
+bool poll_relay_commands(void) {
+    AQUA_LOG(RELAY_POLLING);
+
+    // A poll still queued from an earlier call answers this one too
+    aqua_outq_item_t *pending = aqua_outq_find(outbound(), OUT_RELAY_POLL);
+    if (pending) {
+        serve(pending->seq, OUTQ_SERVICE_MS);
+        return wait_settled && wait_ok;
+    }
+    return send_and_wait(AQUA_OUTQ_COMMAND, OUT_RELAY_POLL, NULL, 0);
+}
+
+// ========== MISSING SENSOR REPORTING ==========
+// Reported when the set of missing critical sensors changes, and repeated
+// every AQUA_LOG_BANNER_REPEAT_MS while it stays the same, instead of a
+// banner on every upload.
+static aqua_log_gate_t missing_gate;
+
+void report_missing_sensors(const aqua_reading_t *reading) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if ((m->flags & AQUA_MEAS_CRITICAL) && aqua_measure_value(m, reading) == AQUA_SENSOR_ERROR) {
+            mask |= 1u << m->id;
+        }
+    }
+    uint32_t previous = missing_gate.state;
+
+    if (!aqua_log_gate(&missing_gate, mask, hal_time_us(), AQUA_LOG_BANNER_REPEAT_MS * 1000LL)) {
+        return;
+    }
+    if (mask == 0) {
+        if (previous != 0) {
+            AQUA_LOG(SENSORS_RESTORED);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < aqua_measure_count; i++) {
+        const aqua_measure_t *m = &aqua_measures[i];
+        if (mask & (1u << m->id)) AQUA_LOG(SENSOR_MISSING, m->label, m->gpio);
+    }
+    AQUA_LOG(SENSORS_MISSING_OF, aqua_count_missing_critical(reading), aqua_count_critical());
+}
+
+// ========== IMPROVED HTTP UPLOAD ==========
+
+bool send_to_supabase(float air_temp, float water_temp, float hum, float ph,
+                      float do_level, float turbidity, float ammonia,
+                      bool ph_relay, bool aerator, bool filter, bool pump) {
+    aqua_reading_t reading = {
+        .air_temp = air_temp,
+        .humidity = hum,
+        .water_temp = water_temp,
+        .ph = ph,
+        .do_level = do_level,
+        .turbidity = turbidity,
+        .ammonia = ammonia,
+        .seq = aqua_seq_next()
+    };
+    aqua_controls_t controls = {
+        .ph_relay = ph_relay,
+        .aerator = aerator,
+        .filter = filter,
+        .pump = pump
+    };
+    return send_reading_to_supabase(&reading, &controls);
+}
+
+// Rows are keyed on (device_id, seq) (sql/upload_seq.sql): a row sent again
+// after its response was lost is skipped instead of stored twice
+static const hal_http_header_t upload_headers[] = {
+    {"Content-Type", "application/json"},
+    {"apikey", SUPABASE_KEY},
+    {"Authorization", "Bearer " SUPABASE_KEY},
+    {"Prefer", "resolution=ignore-duplicates"},
+};
+
+static const hal_http_header_t gzip_headers[] = {
+    {"Content-Type", "application/json"},
+    {"Content-Encoding", "gzip"},
+    {"apikey", SUPABASE_KEY},
+    {"Authorization", "Bearer " SUPABASE_KEY},
+    {"Prefer", "resolution=ignore-duplicates"},
+};
+
+// One POST: a row, or a backlog batch
+typedef struct {
+    aqua_outq_item_t *rows[OUTQ_BATCH_MAX_ROWS];
+    int count;
+    size_t len;                 // JSON body
+    size_t compressed;          // Compressed body in gzip_body, 0: sent as JSON
+    int refused_status;         // Sent again as JSON after the compressed body got this
+} upload_t;
+
+// Backlog batches are built here as one JSON array, then compressed
+static char batch_body[OUTQ_BATCH_MAX_BYTES + 1];
+static uint8_t gzip_body[OUTQ_BATCH_MAX_BYTES];
+static size_t gzip_len;
+static aqua_gzip_t gzip;
+
+static bool gzip_append(void *ctx, const void *data, size_t len) {
+    (void)ctx;
+    if (gzip_len + len > sizeof(gzip_body)) {
+        return false;
+    }
+    memcpy(gzip_body + gzip_len, data, len);
+    gzip_len += len;
+    return true;
+}
+
+// Compressed copy of body in gzip_body; 0 if it would not be smaller
+static size_t compress_body(const char *body, size_t len) {
+    gzip_len = 0;
+    aqua_gzip_init(&gzip, gzip_append, NULL);
+    if (!aqua_gzip_feed(&gzip, body, len) || !aqua_gzip_finish(&gzip) || gzip_len >= len) {
+        return 0;
+    }
+    return gzip_len;
+}
+
+// Rows in one array may have different keys (a probe that dropped out, rows
+// from before and after the first sync); PostgREST takes such an array only
+// when the columns are listed, and stores the keys a row leaves out as NULL
+static const char *batch_url(void) {
+    static char url[sizeof(SUPABASE_UPLOAD_URL) + 512];
+    if (!url[0]) {
+        int n = snprintf(url, sizeof(url), "%s&columns=", SUPABASE_UPLOAD_URL);
+        aqua_build_upload_columns(url + n, sizeof(url) - (size_t)n);
+    }
+    return url;
+}
+
+// The POST for u: body is the JSON, or the compressed copy while u->compressed
+static void upload_request(hal_http_request_t *req, const upload_t *u, const char *body) {
+    bool compressed = u->compressed > 0;
+    *req = (hal_http_request_t){
+        .url = u->count > 1 ? batch_url() : SUPABASE_UPLOAD_URL,
+        .method = HAL_HTTP_POST,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = compressed ? gzip_headers : upload_headers,
+        .header_count = compressed ? sizeof(gzip_headers) / sizeof(gzip_headers[0])
+                                   : sizeof(upload_headers) / sizeof(upload_headers[0]),
+        .body = body,
+        .body_len = compressed ? u->compressed : u->len,
+        .timeout_ms = UPLOAD_TIMEOUT_MS
+    };
+}
+
+static esp_err_t post_rows(const upload_t *u, const char *body, hal_http_response_t *resp) {
+    hal_http_request_t req;
+    upload_request(&req, u, body);
+    return hal_http_perform(&req, resp);
+}
+
+// The JSON body: the row itself, or the rows joined in a JSON array in batch_body
+static const char *upload_body(const upload_t *u) {
+    if (u->count == 1) {
+        return u->rows[0]->body;
+    }
+    size_t n = 0;
+    batch_body[n++] = '[';
+    for (int i = 0; i < u->count; i++) {
+        if (i > 0) {
+            batch_body[n++] = ',';
+        }
+        memcpy(batch_body + n, u->rows[i]->body, u->rows[i]->len);
+        n += u->rows[i]->len;
+    }
+    batch_body[n++] = ']';
+    batch_body[n] = '\0';
+    return batch_body;
+}
+
+// Backlog rows ready to go join the first one, then the body is compressed
+static const char *prepare_upload(upload_t *u, aqua_outq_item_t *item) {
+    u->rows[0] = item;
+    u->count = 1;
+    if (item->cls == AQUA_OUTQ_BACKLOG) {
+        // Room for the brackets and a comma per row
+        size_t room = OUTQ_BATCH_MAX_BYTES - item->len - 2 - (OUTQ_BATCH_MAX_ROWS - 1);
+        u->count += aqua_outq_next_batch(&outq, item, u->rows + 1, OUTQ_BATCH_MAX_ROWS - 1, room,
+                                         hal_time_us());
+    }
+    const char *body = upload_body(u);
+    u->len = u->count == 1 ? item->len : strlen(body);
+
+    u->compressed = 0;
+    u->refused_status = 0;
+    if (UPLOAD_GZIP && !gzip_refused && u->len >= UPLOAD_GZIP_MIN_BYTES) {
+        u->compressed = compress_body(body, u->len);
+        if (u->compressed) {
+            aqua_outq_credit(&outq, (aqua_outq_class_t)item->cls, (uint32_t)(u->len - u->compressed));
+        }
+    }
+    if (u->count > 1) {
+        AQUA_LOG(UPLOAD_BATCH, u->count, (int)u->len, (int)(u->compressed ? u->compressed : u->len));
+    }
+    return u->compressed ? (const char *)gzip_body : body;
+}
+
+// PostgREST answers a body it cannot read with 400, a proxy may say 415;
+// if the same rows then go through uncompressed, stop compressing
+static bool gzip_rejected(const upload_t *u, esp_err_t err, const hal_http_response_t *resp) {
+    return u->compressed && err == ESP_OK && (resp->status == 400 || resp->status == 415);
+}
+
+// Send the same rows again as JSON
+static void uncompress(upload_t *u, int refused_status) {
+    u->compressed = 0;
+    u->refused_status = refused_status;
+}
+
+static aqua_outq_result_t upload_result(const upload_t *u, esp_err_t err, const hal_http_response_t *resp) {
+    // Log response for debugging
+    if (resp->status == 400 && resp->body_len > 0) {
+        AQUA_LOG(UPLOAD_400, resp->body);
+    }
+
+    if (err == ESP_OK && (resp->status == 200 || resp->status == 201)) {
+        if (u->refused_status && !gzip_refused) {
+            gzip_refused = true;
+            AQUA_LOG(UPLOAD_GZIP_REFUSED, u->refused_status);
+        }
+        AQUA_LOG(UPLOAD_OK, resp->status);
+        return AQUA_OUTQ_DELIVERED;
+    }
+    AQUA_LOG(UPLOAD_ATTEMPT_FAILED, u->rows[0]->attempts, resp->status, esp_err_to_name(err));
+    return attempt_result(err, resp->status);
+}
+
+static aqua_outq_result_t send_reading(aqua_outq_item_t *item) {
+    upload_t u;
+    const char *body = prepare_upload(&u, item);
+
+    char response_buffer[512];
+    hal_http_response_t resp = {
+        .body = response_buffer,
+        .body_size = sizeof(response_buffer)
+    };
+    esp_err_t err = post_rows(&u, body, &resp);
+    if (gzip_rejected(&u, err, &resp)) {
+        uncompress(&u, resp.status);
+        err = post_rows(&u, upload_body(&u), &resp);
+    }
+    aqua_outq_result_t result = upload_result(&u, err, &resp);
+
+    // The rows that travelled along settle the same way
+    for (int i = 1; i < u.count; i++) {
+        settle(u.rows[i], result);
+    }
+    return result;
+}
+
+// ========== PIPELINED UPLOADS ==========
+// Readings ready to go one after another share a keep-alive connection, with
+// up to pipeline_depth POSTs in flight: catching up on a backlog costs one
+// round trip per pipeline_depth batches instead of one connection and round
+// trip per batch. Answers come back in order; each POST's rows settle on
+// their own answer, so a failed one is retried without holding up the rest,
+// and rows a lost connection may have delivered are skipped by the server
+// when they come again.
+static upload_t uploads[AQUA_PIPELINE_MAX_DEPTH];
+
+void supabase_set_pipeline_depth(int depth) {
+    pipeline_depth = depth < 1 ? 1 : depth > AQUA_PIPELINE_MAX_DEPTH ? AQUA_PIPELINE_MAX_DEPTH : depth;
+}
+
+const aqua_pipeline_stats_t *supabase_pipeline_stats(void) {
+    return &pipeline.stats;
+}
+
+static void settle_upload(const upload_t *u, aqua_outq_result_t result) {
+    for (int i = 0; i < u->count; i++) {
+        settle(u->rows[i], result);
+    }
+}
+
+// Another reading is due after the one handed out: worth a shared connection
+static bool reading_ready(void) {
+    const aqua_outq_item_t *next = aqua_outq_peek(&outq, hal_time_us());
+    return next && next->kind == OUT_READING;
+}
+
+// The next reading may join the connection if nothing else is due first
+static aqua_outq_item_t *next_upload(int64_t end_us) {
+    int64_t now_us = hal_time_us();
+    if (now_us >= end_us || (wait_seq != 0 && wait_settled)) {
+        return NULL;
+    }
+    const aqua_outq_item_t *next = aqua_outq_peek(&outq, now_us);
+    if (!next || next->kind != OUT_READING) {
+        return NULL;
+    }
+    return aqua_outq_next(&outq, now_us, NULL);
+}
+
+static esp_err_t send_upload(upload_t *u, const char *body) {
+    hal_http_request_t req;
+    upload_request(&req, u, body);
+    esp_err_t err = aqua_pipeline_send(&pipeline, &req);
+    if (err != ESP_OK) {
+        AQUA_LOG(UPLOAD_ATTEMPT_FAILED, u->rows[0]->attempts, 0, esp_err_to_name(err));
+        settle_upload(u, AQUA_OUTQ_FAILED);
+    }
+    return err;
+}
+
+// first has been handed out already
+static void serve_uploads(aqua_outq_item_t *first, int64_t end_us) {
+    if (aqua_pipeline_open(&pipeline, SUPABASE_UPLOAD_URL, HAL_TLS_CA_STORE, UPLOAD_TIMEOUT_MS) != ESP_OK) {
+        settle(first, send_reading(first));
+        return;
+    }
+
+    int head = 0;
+    int queued = 0;
+    int posts = 0;
+    int rows = 0;
+    int answered = 0;
+    int most = 0;
+    aqua_outq_item_t *item = first;
+    for (;;) {
+        while (item && queued < pipeline_depth && !pipeline.closing) {
+            upload_t *u = &uploads[(head + queued) % pipeline_depth];
+            if (send_upload(u, prepare_upload(u, item)) != ESP_OK) {
+                item = NULL;
+                break;
+            }
+            queued++;
+            posts++;
+            rows += u->count;
+            if (queued > most) {
+                most = queued;
+            }
+            item = queued < pipeline_depth ? next_upload(end_us) : NULL;
+        }
+        if (queued == 0) {
+            break;
+        }
+
+        upload_t u = uploads[head];
+        char response_buffer[512];
+        hal_http_response_t resp = {
+            .body = response_buffer,
+            .body_size = sizeof(response_buffer)
+        };
+        esp_err_t err = aqua_pipeline_receive(&pipeline, &resp);
+        if (err != ESP_OK) {
+            // Whatever was in flight may or may not have been stored
+            AQUA_LOG(UPLOAD_PIPELINE_BROKEN, queued, esp_err_to_name(err));
+            for (; queued > 0; queued--, head = (head + 1) % pipeline_depth) {
+                AQUA_LOG(UPLOAD_ATTEMPT_FAILED, uploads[head].rows[0]->attempts, 0, esp_err_to_name(err));
+                settle_upload(&uploads[head], AQUA_OUTQ_FAILED);
+            }
+            break;
+        }
+        head = (head + 1) % pipeline_depth;
+        queued--;
+        answered++;
+
+        if (gzip_rejected(&u, err, &resp)) {
+            // The rows stay in flight, behind the requests already sent
+            upload_t *again = &uploads[(head + queued) % pipeline_depth];
+            *again = u;
+            uncompress(again, resp.status);
+            if (send_upload(again, upload_body(again)) == ESP_OK) {
+                queued++;
+                posts++;
+            }
+        } else {
+            settle_upload(&u, upload_result(&u, err, &resp));
+        }
+        hal_watchdog_feed();
+
+        if (pipeline.closing && answered == 1 && queued > 0) {
+            // Only one request per connection: send one at a time from now on
+            pipeline_refused = true;
+        }
+        if (!item && !pipeline.closing) {
+            item = next_upload(end_us);
+        }
+    }
+    aqua_pipeline_close(&pipeline);
+
+    // Handed out but never sent: the connection went first
+    if (item) {
+        aqua_outq_complete(&outq, item, AQUA_OUTQ_FAILED, hal_time_us());
+    }
+    if (posts > 1) {
+        AQUA_LOG(UPLOAD_PIPELINED, posts, rows, most);
+    }
+}
+
+bool send_reading_to_supabase(const aqua_reading_t *reading, const aqua_controls_t *controls) {
+    if (!aqua_validate_reading(reading)) {
+        AQUA_LOG(UPLOAD_INVALID);
+        return false;
+    }
+
+    char json[AQUA_OUTQ_BODY_MAX];
+    int json_len = aqua_build_payload(reading, controls, json, sizeof(json));
+    if (json_len < 0) {
+        AQUA_LOG(UPLOAD_TOO_LARGE, (int)sizeof(json));
+        return false;
+    }
+
+    report_missing_sensors(reading);
+
+    AQUA_LOG(UPLOAD_PREPARING);
+    AQUA_LOG(UPLOAD_URL, SUPABASE_UPLOAD_URL);
+    AQUA_LOG(UPLOAD_METHOD);
+    AQUA_LOG(UPLOAD_HEADERS);
+    AQUA_LOG(UPLOAD_PAYLOAD, json);
+
+    // Kept in the backlog if it cannot be delivered in time
+    return send_and_wait(AQUA_OUTQ_LIVE, OUT_READING, json, (size_t)json_len);
+}
+
+// ========== COMBINED UPLOAD AND COMMAND FETCH ==========
+// ID of the newest relay command applied; sent with every exchange so the
+// server only returns newer commands. 0 after boot: the server then answers
+// with the latest command per relay instead of the whole history.
+static int32_t last_command_id;
+
+int32_t supabase_last_command_id(void) {
+    return last_command_id;
+}
+
+static aqua_outq_result_t send_exchange(aqua_outq_item_t *item) {
+    hal_http_request_t req = {
+        .url = SUPABASE_RPC_URL,
+        .method = HAL_HTTP_POST,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = supabase_headers,
+        .header_count = sizeof(supabase_headers) / sizeof(supabase_headers[0]),
+        .body = item->body,
+        .body_len = item->len,
+        .timeout_ms = UPLOAD_TIMEOUT_MS
+    };
+    char response_buffer[2048];
+    hal_http_response_t resp = {
+        .body = response_buffer,
+        .body_size = sizeof(response_buffer)
+    };
+
+    esp_err_t err = hal_http_perform(&req, &resp);
+
+    if (resp.status == 400 && resp.body_len > 0) {
+        AQUA_LOG(UPLOAD_400, response_buffer);
+    }
+
+    if (err == ESP_OK && resp.status == 200) {
+        // Filtered against the newest applied ID, which may have moved on
+        // since a backlog row was built
+        int applied = 0;
+        if (resp.body_len > 0) {
+            AQUA_LOG(RELAY_RECEIVED, response_buffer);
+            int32_t newest = last_command_id;
+            applied = aqua_parse_relay_commands_after(response_buffer, last_command_id,
+                                                      apply_relay_command, NULL, &newest);
+            if (applied < 0) {
+                applied = 0;
+            }
+            last_command_id = newest;
+        }
+        AQUA_LOG(EXCHANGE_OK, resp.status, applied, (int)last_command_id);
+        return AQUA_OUTQ_DELIVERED;
+    }
+
+    AQUA_LOG(EXCHANGE_ATTEMPT_FAILED, item->attempts, resp.status, esp_err_to_name(err));
+    return attempt_result(err, resp.status);
+}
+
+bool exchange_with_supabase(const aqua_reading_t *reading, const aqua_controls_t *controls) {
+    if (!aqua_validate_reading(reading)) {
+        AQUA_LOG(UPLOAD_INVALID);
+        return false;
+    }
+
+    char json[AQUA_OUTQ_BODY_MAX];
+    int json_len = aqua_build_exchange_payload(reading, controls, last_command_id, json, sizeof(json));
+    if (json_len < 0) {
+        AQUA_LOG(UPLOAD_TOO_LARGE, (int)sizeof(json));
+        return false;
+    }
+
+    report_missing_sensors(reading);
+    AQUA_LOG(UPLOAD_PAYLOAD, json);
+
+    return send_and_wait(AQUA_OUTQ_LIVE, OUT_EXCHANGE, json, (size_t)json_len);
+}
+
+// ========== RUNTIME PARAMETERS ==========
+// The URL carries the running version as of the attempt
+static aqua_outq_result_t send_params_poll(aqua_outq_item_t *item) {
+    (void)item;
+    uint32_t version = aqua_params_version();
+
+    // Only a row newer than the running version comes back
+    char url[256];
+    snprintf(url, sizeof(url), SUPABASE_PARAMS_URL "?device_id=eq." AQUA_DEVICE_ID
+             "&version=gt.%lu&order=version.desc&limit=1", (unsigned long)version);
+    hal_http_request_t req = {
+        .url = url,
+        .method = HAL_HTTP_GET,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = supabase_headers,
+        .header_count = sizeof(supabase_headers) / sizeof(supabase_headers[0]),
+        .timeout_ms = 10000
+    };
+    char body[1024];
+    hal_http_response_t resp = { .body = body, .body_size = sizeof(body) };
+    esp_err_t err = hal_http_perform(&req, &resp);
+    if (err != ESP_OK || resp.status != 200) {
+        AQUA_LOG(PARAMS_POLL_FAILED, resp.status, esp_err_to_name(err));
+        return attempt_result(err, resp.status);
+    }
+
+    // Fields the row leaves out (or null) keep their current values
+    aqua_params_t next;
+    const aqua_params_t *cur = aqua_params_acquire();
+    int parsed = aqua_parse_params(body, cur, &next);
+    aqua_params_release(cur);
+    if (parsed < 0) {
+        AQUA_LOG(PARAMS_INVALID);
+        return AQUA_OUTQ_REJECTED;
+    }
+    if (parsed > 0) {
+        aqua_params_update(&next);
+    }
+    return AQUA_OUTQ_DELIVERED;
+}
+
+bool poll_device_params(void) {
+    AQUA_LOG(PARAMS_POLLING, (int)aqua_params_version());
+
+    // One attempt; the next poll interval tries again
+    aqua_outq_item_t *item = aqua_outq_push(outbound(), AQUA_OUTQ_COMMAND, OUT_PARAMS_POLL,
+                                            NULL, 0, hal_time_us());
+    if (!item) {
+        AQUA_LOG(OUTQ_FULL, aqua_outq_class_name(AQUA_OUTQ_COMMAND));
+        return false;
+    }
+    item->max_attempts = 1;
+    serve(item->seq, OUTQ_SERVICE_MS);
+    return wait_settled && wait_ok;
+}
+
+static aqua_outq_result_t send_rules_poll(aqua_outq_item_t *item) {
+    (void)item;
+    // Versions that failed to compile or to parse are not fetched again
+    uint32_t version = aqua_rules_version();
+    if (aqua_rules_get_stats()->rejected_version > version) {
+        version = aqua_rules_get_stats()->rejected_version;
+    }
+
+    char url[256];
+    snprintf(url, sizeof(url), SUPABASE_RULES_URL "?device_id=eq." AQUA_DEVICE_ID
+             "&version=gt.%lu&order=version.desc&limit=1&select=version,source", (unsigned long)version);
+    hal_http_request_t req = {
+        .url = url,
+        .method = HAL_HTTP_GET,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = supabase_headers,
+        .header_count = sizeof(supabase_headers) / sizeof(supabase_headers[0]),
+        .timeout_ms = 10000
+    };
+    // Rule text is escaped in the response; static to keep it off the task stack
+    static char body[AQUA_RULES_SOURCE_MAX + 256];
+    static char source[AQUA_RULES_SOURCE_MAX];
+    hal_http_response_t resp = { .body = body, .body_size = sizeof(body) };
+    esp_err_t err = hal_http_perform(&req, &resp);
+    if (err != ESP_OK || resp.status != 200) {
+        AQUA_LOG(RULES_POLL_FAILED, resp.status, esp_err_to_name(err));
+        return attempt_result(err, resp.status);
+    }
+
+    uint32_t next;
+    int parsed = aqua_parse_rules(body, &next, source, sizeof(source));
+    if (parsed < 0) {
+        AQUA_LOG(RULES_INVALID);
+        if (next > aqua_rules_version()) {
+            aqua_rules_reject(next, 0, "source unreadable or too long");
+        }
+        return AQUA_OUTQ_REJECTED;
+    }
+    if (parsed > 0) {
+        aqua_rules_update(next, source);
+    }
+    return AQUA_OUTQ_DELIVERED;
+}
+
+bool poll_device_rules(void) {
+    aqua_outq_item_t *item = aqua_outq_push(outbound(), AQUA_OUTQ_COMMAND, OUT_RULES_POLL,
+                                            NULL, 0, hal_time_us());
+    if (!item) {
+        AQUA_LOG(OUTQ_FULL, aqua_outq_class_name(AQUA_OUTQ_COMMAND));
+        return false;
+    }
+    item->max_attempts = 1;
+    serve(item->seq, OUTQ_SERVICE_MS);
+    return wait_settled && wait_ok;
+}
+
+// ========== ALERTS ==========
+static aqua_outq_result_t send_alert(aqua_outq_item_t *item) {
+    hal_http_request_t req = {
+        .url = SUPABASE_ALERTS_URL,
+        .method = HAL_HTTP_POST,
+        .tls = HAL_TLS_CA_STORE,
+        .headers = supabase_headers,
+        .header_count = sizeof(supabase_headers) / sizeof(supabase_headers[0]),
+        .body = item->body,
+        .body_len = item->len,
+        .timeout_ms = 10000
+    };
+    hal_http_response_t resp = {0};
+
+    esp_err_t err = hal_http_perform(&req, &resp);
+    if (err == ESP_OK && resp.status >= 200 && resp.status < 300) {
+        // Update last alert state only if successfully sent
+        last_alerts = queued_alerts;
+        AQUA_LOG(ALERT_SENT);
+        return AQUA_OUTQ_DELIVERED;
+    }
+    AQUA_LOG(ALERT_FAILED);
+    return attempt_result(err, resp.status);
+}
+
+// Check sensor values and send alerts if needed
+void check_and_send_alerts(float water_temp, float do_level, float ph,
+                           float ammonia, float turbidity) {
+    aqua_reading_t reading = {
+        .air_temp = AQUA_SENSOR_ERROR,
+        .humidity = AQUA_SENSOR_ERROR,
+        .water_temp = water_temp,
+        .ph = ph,
+        .do_level = do_level,
+        .turbidity = turbidity,
+        .ammonia = ammonia
+    };
+    aqua_alert_states_t current_alerts;
+    const aqua_params_t *params = aqua_params_acquire();
+    aqua_eval_alerts(&reading, params, &current_alerts);
+    aqua_params_release(params);
+
+    // Flags the rules raised on this sample, the anomaly detector's findings
+    // and the flow meters' faults
+    current_alerts.low |= aqua_rules_alerts()->low;
+    current_alerts.high |= aqua_rules_alerts()->high;
+    current_alerts.anomaly = aqua_anomaly_alerts()->anomaly;
+    current_alerts.suspect = aqua_anomaly_alerts()->suspect;
+    current_alerts.no_flow = aqua_meter_alerts()->no_flow;
+    current_alerts.flow_while_off = aqua_meter_alerts()->flow_while_off;
+
+    // Compare with the last state sent or queued to avoid duplicate alerts
+    aqua_outq_item_t *pending = aqua_outq_find(outbound(), OUT_ALERT);
+    if (!aqua_alerts_changed(pending ? &queued_alerts : &last_alerts, &current_alerts)) {
+        return;
+    }
+
+    char json[640];
+    int json_len = aqua_build_alert_payload(&current_alerts, &reading, json, sizeof(json));
+    if (json_len < 0) {
+        AQUA_LOG(ALERT_TOO_LARGE, (int)sizeof(json));
+        return;
+    }
+
+    // A notification still waiting to go out is replaced by the newer set
+    queued_alerts = current_alerts;
+    if (pending) {
+        memcpy(pending->body, json, (size_t)json_len + 1);
+        pending->len = (uint16_t)json_len;
+        serve(pending->seq, OUTQ_SERVICE_MS);
+    } else {
+        send_and_wait(AQUA_OUTQ_ALERT, OUT_ALERT, json, (size_t)json_len);
+    }
+}
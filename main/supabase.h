@@ -0,0 +1,102 @@
+#ifndef SUPABASE_H
+#define SUPABASE_H
+
+#include <stdbool.h>
+#include "aqua_core.h"
+#include "aqua_outq.h"
+#include "aqua_pipeline.h"
+
+/**
+ * @brief Drive the relay named by type ("ph", "aerator", "filter", "pump")
+ *
+ * Matches aqua_relay_cmd_cb_t; shared by the HTTP poll and the MQTT subscription.
+ */
+void apply_relay_command(const char *type, bool state_bool, void *ctx);
+
+/**
+ * @brief Log the set of missing critical sensors when it changes (rate limited)
+ */
+void report_missing_sensors(const aqua_reading_t *reading);
+
+/**
+ * @brief Fetch pending relay commands and apply them to the relay outputs
+ * @return true if the poll request succeeded
+ */
+bool poll_relay_commands(void);
+
+/**
+ * @brief Validate, encode and POST one sensor_data row (with retries)
+ * @return true once the server accepted the row
+ */
+bool send_to_supabase(float air_temp, float water_temp, float hum, float ph,
+                      float do_level, float turbidity, float ammonia,
+                      bool ph_relay, bool aerator, bool filter, bool pump);
+
+/**
+ * @brief send_to_supabase() for a whole reading, including its sensor health
+ */
+bool send_reading_to_supabase(const aqua_reading_t *reading, const aqua_controls_t *controls);
+
+/**
+ * @brief Upload one reading and fetch newer relay commands in a single request
+ *
+ * POSTs to the ingest_reading RPC with the ID of the last applied command and
+ * applies the commands it returns (skipping any that are not newer).
+ * @return true once the server accepted the row
+ */
+bool exchange_with_supabase(const aqua_reading_t *reading, const aqua_controls_t *controls);
+
+/**
+ * @brief ID of the newest relay command applied through exchange_with_supabase()
+ */
+int32_t supabase_last_command_id(void);
+
+/**
+ * @brief Fetch the newest device_params row for AQUA_DEVICE_ID and apply it if newer
+ * @return true if the request succeeded and the response was well formed
+ */
+bool poll_device_params(void);
+
+/**
+ * @brief Fetch the newest device_rules row for AQUA_DEVICE_ID and compile it if newer
+ * @return true if the request succeeded and the response was well formed
+ */
+bool poll_device_rules(void);
+
+/**
+ * @brief Evaluate alert thresholds and POST a notification when the alert set changes
+ */
+void check_and_send_alerts(float water_temp, float do_level, float ph,
+                           float ammonia, float turbidity);
+
+/**
+ * @brief Send queued requests (backlog rows, retries) for up to budget_ms
+ *
+ * Every request above goes through one priority queue (aqua_outq.h); the
+ * blocking calls return once their own request settles.
+ */
+void supabase_outbound_drain(int budget_ms);
+
+/**
+ * @brief Forget every queued request, that the server refused gzip bodies or
+ *        pipelining, the pipelining counters and the alerts last sent
+ */
+void supabase_outbound_reset(void);
+
+/**
+ * @brief The outbound queue, for its counters
+ */
+const aqua_outq_t *supabase_outbound(void);
+
+/**
+ * @brief Readings POSTed at once on one connection (default
+ *        UPLOAD_PIPELINE_DEPTH, 1: one request per connection)
+ */
+void supabase_set_pipeline_depth(int depth);
+
+/**
+ * @brief Counters of the pipelined upload connection
+ */
+const aqua_pipeline_stats_t *supabase_pipeline_stats(void);
+
+#endif // SUPABASE_H
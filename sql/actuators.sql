@@ -0,0 +1,11 @@
+-- Actuator run time, energy and flow sent with every reading:
+--   "actuators": {"ph_relay": {"on_s": 120, "wh": 0.1},
+--                 "aerator": {"on_s": 86400, "wh": 840.0, "l": 28800.0, "lpm": 20.00},
+--                 "filter": {...}, "pump": {..., "fault": "no_flow"}}
+-- on_s and wh are totals over the device's life, l the total through the
+-- line's flow meter and lpm the flow over the last sample interval; l and
+-- lpm only for metered lines, fault ("no_flow" or "flow_while_off") only
+-- while raised. Deploy before (or with) sql/ingest_reading.sql; older
+-- firmware leaves it NULL.
+
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS actuators JSONB NULL;
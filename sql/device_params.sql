@@ -0,0 +1,34 @@
+-- Runtime thresholds and control cut-offs, polled by the device every
+-- PARAMS_POLL_INTERVAL_CYCLES cycles:
+--   GET /rest/v1/device_params?device_id=eq.<id>&version=gt.<running>&order=version.desc&limit=1
+-- Insert a new row with a higher version to retune a pond. Columns left NULL
+-- keep the device's current value. The device rejects rows whose values
+-- are out of range, and saves accepted rows in NVS.
+
+CREATE TABLE IF NOT EXISTS public.device_params (
+  id BIGINT GENERATED BY DEFAULT AS IDENTITY NOT NULL,
+  device_id TEXT NOT NULL,
+  version INTEGER NOT NULL CHECK (version > 0),
+  -- Alert thresholds
+  temp_min REAL,
+  temp_max REAL,
+  do_min REAL,
+  ph_min REAL,
+  ph_max REAL,
+  ammonia_max REAL,
+  turbidity_max REAL,
+  -- Control cut-offs
+  ph_relay_on_below REAL,
+  aerator_on_below REAL,
+  filter_on_above REAL,
+  pump_on_above REAL,
+  created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT NOW(),
+  CONSTRAINT device_params_pkey PRIMARY KEY (id),
+  CONSTRAINT device_params_version_key UNIQUE (device_id, version)
+);
+
+GRANT SELECT ON public.device_params TO anon;
+
+-- Example: a warm-water species in pond-01
+-- INSERT INTO device_params (device_id, version, temp_min, temp_max, aerator_on_below)
+-- VALUES ('pond-01', 1, 26.0, 32.0, 5.5);
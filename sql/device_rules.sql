@@ -0,0 +1,25 @@
+-- Local automation rules (main/aqua_rules.h), polled by the device every
+-- PARAMS_POLL_INTERVAL_CYCLES cycles:
+--   GET /rest/v1/device_rules?device_id=eq.<id>&version=gt.<running>&order=version.desc&limit=1
+-- Insert a new row with a higher version to replace a pond's rules; an empty
+-- source removes them. The device compiles the source and keeps the bytecode
+-- in NVS; a version that does not compile is skipped and the old rules keep
+-- running. Check rules first with host/tools aqua_rulec.
+
+CREATE TABLE IF NOT EXISTS public.device_rules (
+  id BIGINT GENERATED BY DEFAULT AS IDENTITY NOT NULL,
+  device_id TEXT NOT NULL,
+  version INTEGER NOT NULL CHECK (version > 0),
+  source TEXT NOT NULL CHECK (length(source) < 2048),
+  created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT NOW(),
+  CONSTRAINT device_rules_pkey PRIMARY KEY (id),
+  CONSTRAINT device_rules_version_key UNIQUE (device_id, version)
+);
+
+GRANT SELECT ON public.device_rules TO anon;
+
+-- Example: aerate at night and top up pH while it is still falling
+-- INSERT INTO device_rules (device_id, version, source) VALUES ('pond-01', 1, E'
+--   when hour >= 22 or hour < 5 then aerator on
+--   when ph < ph_relay_on_below and trend(ph) < 0 then ph_relay on
+-- ');
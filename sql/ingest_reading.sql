@@ -0,0 +1,64 @@
+-- Combined upload-and-fetch RPC used when AQUA_USE_RPC is 1. Needs the
+-- sensor_health column from sql/sensor_health.sql, the sample time
+-- columns from sql/sample_time.sql, the sequence key from
+-- sql/upload_seq.sql and the actuators column from sql/actuators.sql.
+--
+-- The device POSTs to /rest/v1/rpc/ingest_reading with
+--   {"reading": {<sensor_data row>}, "last_command_id": <id>}
+-- The row is stored in sensor_data, unless a retry already stored its
+-- (device_id, seq); the commands are returned either way. The response is a JSON array of
+-- relay_commands newer than last_command_id, oldest first:
+--   [{"id": 42, "relay_type": "aerator", "state": true}, ...]
+-- With last_command_id = 0 (fresh boot) only the newest command per relay is
+-- returned, so a restart re-applies the current state instead of the history.
+
+CREATE TABLE IF NOT EXISTS public.relay_commands (
+  id BIGINT GENERATED BY DEFAULT AS IDENTITY NOT NULL,
+  relay_type TEXT NOT NULL,
+  state BOOLEAN NOT NULL,
+  "timestamp" TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT NOW(),
+  CONSTRAINT relay_commands_pkey PRIMARY KEY (id)
+);
+
+CREATE OR REPLACE FUNCTION public.ingest_reading(reading JSONB, last_command_id BIGINT DEFAULT 0)
+RETURNS JSONB
+LANGUAGE plpgsql
+SECURITY DEFINER
+SET search_path = public
+AS $$
+DECLARE
+  commands JSONB;
+BEGIN
+  INSERT INTO sensor_data (air_temperature, humidity, water_temperature, ph,
+                           dissolved_oxygen, turbidity, ammonia,
+                           ph_relay, aerator, filter, pump, sensor_health,
+                           sampled_at, uptime_us, time_error_ms, time_quality,
+                           device_id, seq, actuators)
+  SELECT r.air_temperature, r.humidity, r.water_temperature, r.ph,
+         r.dissolved_oxygen, r.turbidity, r.ammonia,
+         r.ph_relay, r.aerator, r.filter, r.pump, r.sensor_health,
+         r.sampled_at, r.uptime_us, r.time_error_ms, r.time_quality,
+         r.device_id, r.seq, r.actuators
+  FROM jsonb_populate_record(NULL::sensor_data, reading) AS r
+  ON CONFLICT (device_id, seq) DO NOTHING;
+
+  IF last_command_id > 0 THEN
+    SELECT COALESCE(jsonb_agg(jsonb_build_object('id', c.id, 'relay_type', c.relay_type,
+                                                 'state', c.state) ORDER BY c.id), '[]'::jsonb)
+      INTO commands
+      FROM relay_commands c
+     WHERE c.id > last_command_id;
+  ELSE
+    SELECT COALESCE(jsonb_agg(jsonb_build_object('id', l.id, 'relay_type', l.relay_type,
+                                                 'state', l.state) ORDER BY l.id), '[]'::jsonb)
+      INTO commands
+      FROM (SELECT DISTINCT ON (relay_type) id, relay_type, state
+              FROM relay_commands
+             ORDER BY relay_type, id DESC) AS l;
+  END IF;
+
+  RETURN commands;
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION public.ingest_reading(JSONB, BIGINT) TO anon;
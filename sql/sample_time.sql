@@ -0,0 +1,48 @@
+-- Device-side sample times sent with every reading:
+--   "uptime_us": 612000123                   µs since boot when the cycle sampled
+--   "sampled_at": "2025-10-09T08:53:20.123456Z"  once the device has SNTP time
+--   "time_error_ms": 21                      estimated bound on sampled_at
+--   "time_quality": "synced"                 unsynced, synced, holdover or presync
+-- created_at stays the arrival time. Deploy before (or with)
+-- sql/ingest_reading.sql; older firmware leaves the columns NULL.
+
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS sampled_at TIMESTAMP WITH TIME ZONE NULL;
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS uptime_us BIGINT NULL;
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS time_error_ms INTEGER NULL;
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS time_quality TEXT NULL;
+
+-- Rows sent before the device's first sync only carry uptime_us. The first
+-- timed row from the same boot places them: its sampled_at minus the uptime
+-- difference. Rows of this boot are those that arrived after it started
+-- (sampled_at - uptime_us); earlier boots' rows arrived before that.
+CREATE OR REPLACE FUNCTION public.backfill_sample_times()
+RETURNS TRIGGER
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  boot_at TIMESTAMP WITH TIME ZONE;
+BEGIN
+  IF NEW.sampled_at IS NULL OR NEW.uptime_us IS NULL THEN
+    RETURN NULL;
+  END IF;
+  boot_at := NEW.sampled_at - NEW.uptime_us * INTERVAL '1 microsecond';
+
+  UPDATE sensor_data s
+     SET sampled_at = NEW.sampled_at - (NEW.uptime_us - s.uptime_us) * INTERVAL '1 microsecond',
+         time_error_ms = NEW.time_error_ms,
+         time_quality = 'presync'
+   WHERE s.sampled_at IS NULL
+     AND s.uptime_us IS NOT NULL
+     AND s.uptime_us < NEW.uptime_us
+     AND s.created_at >= boot_at
+     AND s.id <> NEW.id;
+  RETURN NULL;
+END;
+$$;
+
+DROP TRIGGER IF EXISTS sensor_data_backfill_sample_times ON public.sensor_data;
+CREATE TRIGGER sensor_data_backfill_sample_times
+  AFTER INSERT ON public.sensor_data
+  FOR EACH ROW EXECUTE FUNCTION public.backfill_sample_times();
+
+CREATE INDEX IF NOT EXISTS sensor_data_sampled_at_idx ON public.sensor_data (sampled_at);
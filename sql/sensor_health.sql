@@ -0,0 +1,6 @@
+-- Per-sensor health scores (0-100) sent with every reading:
+--   "sensor_health": {"dht22": 100, "ds18b20": 92, "ph": 100,
+--                     "dissolved_oxygen": 50, "turbidity": 100, "ammonia": 50}
+-- Deploy before (or with) sql/ingest_reading.sql; older firmware leaves it NULL.
+
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS sensor_health JSONB NULL;
@@ -0,0 +1,26 @@
+-- Upload sequence numbers sent with every reading:
+--   "device_id": "pond-01"                   AQUA_DEVICE_ID
+--   "seq": 1234                              increasing per device, across reboots
+-- A retried upload whose first response was lost arrives again with the same
+-- (device_id, seq). The device POSTs to sensor_data?on_conflict=device_id,seq
+-- with Prefer: resolution=ignore-duplicates, so PostgREST skips the rows
+-- already stored instead of inserting them twice. Deploy before the firmware;
+-- without the columns PostgREST rejects the rows. Older firmware leaves them
+-- NULL, and NULL keys never conflict. So does a reading taken while the
+-- device could not save its numbering to NVS: it is stored, just without
+-- the protection against a retried upload.
+
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS device_id TEXT NULL;
+ALTER TABLE public.sensor_data ADD COLUMN IF NOT EXISTS seq BIGINT NULL;
+
+-- Rows stored twice before this was deployed would block the constraint;
+-- keep the first of each
+DELETE FROM public.sensor_data a
+ USING public.sensor_data b
+ WHERE a.device_id = b.device_id
+   AND a.seq = b.seq
+   AND a.id > b.id;
+
+ALTER TABLE public.sensor_data DROP CONSTRAINT IF EXISTS sensor_data_device_seq_key;
+ALTER TABLE public.sensor_data
+  ADD CONSTRAINT sensor_data_device_seq_key UNIQUE (device_id, seq);